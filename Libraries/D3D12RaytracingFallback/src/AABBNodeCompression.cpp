@@ -0,0 +1,271 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    // Quantized values stay within this many units of the origin, which leaves fp16
+    // headroom for the rounding up of half-extents
+    static const float MaxQuantizedExtent = 16384.0f;
+
+    static const UINT ScaleExponentBias = 127;
+    static const USHORT MaxFiniteFp16 = 0x7bff;
+
+    //
+    // Convert a 16-bit float to 32-bit.
+    //
+
+    static
+        float Fp16ToFp32(USHORT v)
+    {
+        static const UINT kMultiple = 0x77800000;   // 2**112
+        const UINT BiasedFloat = (v & 0x8000) << 16 | (v & 0x7FFF) << 13;
+        return (float&)BiasedFloat * (float&)kMultiple;
+    }
+
+    //
+    // Round toward zero, or away from it if v * RoundDirection is positive.
+    //
+
+    static
+        USHORT Fp32ToFp16(float v, float RoundDirection = 0.0f)
+    {
+        assert(!!_finite(v));
+        assert(v > -65504 && v < 65504);
+
+        // Multiplying by 2^-112 causes exponents below -14 to denormalize
+        static const UINT kMultiple = 0x07800000;   // 2**-112
+        const float BiasedFloat = v * (float&)kMultiple;
+        const UINT u = (UINT&)BiasedFloat;
+
+        const UINT sign = u & 0x80000000;
+        UINT body = u & 0x0fffffff;
+
+        // Increase the magnitude before truncation to ensure proper bounds
+        if (v * RoundDirection > 0.0f)
+        {
+            if (body == 0)
+                body = 0x800000;
+            else
+                body += 0x1fff;
+        }
+
+        return (USHORT)(sign >> 16 | body >> 13);
+    }
+
+    static
+        float GetScale(
+            const CompressedBVHHeader &header)
+    {
+        const UINT scaleBits = (header.flags & CompressedScaleExponentMask) << 23;
+        return (float&)scaleBits;
+    }
+
+    static
+        const CompressedAABBNode *GetCompressedNodes(
+            const void *pBoxes)
+    {
+        return (const CompressedAABBNode *)((const BYTE *)pBoxes + SizeOfCompressedBVHHeader);
+    }
+
+    // Smallest power of two scale that keeps every box within MaxQuantizedExtent of the origin
+    static
+        UINT GetScaleExponent(
+            const AABBNode *pNodes,
+            UINT numNodes,
+            const float origin[3])
+    {
+        float maxExtent = 0.0f;
+        for (UINT i = 0; i < numNodes; i++)
+        {
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                maxExtent = std::max(maxExtent, fabsf(pNodes[i].center[axis] - origin[axis]) + pNodes[i].halfDim[axis]);
+            }
+        }
+
+        int exponent = 0;
+        const float ratio = maxExtent / MaxQuantizedExtent;
+        if (ratio > 0.0f && !!_finite(ratio))
+        {
+            frexpf(ratio, &exponent);
+            exponent = std::min(std::max(exponent, 1 - (int)ScaleExponentBias), (int)ScaleExponentBias);
+        }
+        return (UINT)(exponent + (int)ScaleExponentBias);
+    }
+
+    //
+    // Quantizes one axis of a box. The center is truncated and the half-extent rounded up,
+    // then grown an ulp at a time until the decoded box contains [boxMin, boxMax] with a
+    // margin covering the rounding differences of other decoders.
+    //
+
+    static
+        void CompressAxis(
+            float boxMin,
+            float boxMax,
+            float origin,
+            float scale,
+            USHORT &center,
+            USHORT &halfDim,
+            float &decodedMin,
+            float &decodedMax)
+    {
+        center = Fp32ToFp16(((boxMin + boxMax) * 0.5f - origin) / scale);
+        const float decodedCenter = Fp16ToFp32(center) * scale + origin;
+
+        // Start with room for the margin so the loop below rarely has to run
+        const float extent = std::max(std::max(boxMax - decodedCenter, decodedCenter - boxMin), 0.0f);
+        const float paddedExtent = extent + (fabsf(decodedCenter) + extent) * 2.0f * FLT_EPSILON;
+        halfDim = Fp32ToFp16(paddedExtent / scale, 1.0f);
+        for (;;)
+        {
+            const float decodedHalfDim = Fp16ToFp32(halfDim) * scale;
+            const float margin = (fabsf(decodedCenter) + decodedHalfDim) * FLT_EPSILON;
+            decodedMin = decodedCenter - decodedHalfDim;
+            decodedMax = decodedCenter + decodedHalfDim;
+            if (decodedMin <= boxMin - margin && decodedMax >= boxMax + margin)
+            {
+                break;
+            }
+
+            assert(halfDim < MaxFiniteFp16);
+            halfDim++;
+        }
+    }
+
+    UINT GetCompressedBoxesSize(UINT numNodes)
+    {
+        return SizeOfCompressedBVHHeader + numNodes * SizeOfCompressedAABBNode;
+    }
+
+    void CompressAABBNodes(
+        const AABBNode *pNodes,
+        UINT numNodes,
+        void *pOutput)
+    {
+        assert(numNodes > 0);
+
+        CompressedBVHHeader &header = *(CompressedBVHHeader *)pOutput;
+        CompressedAABBNode *pCompressedNodes = (CompressedAABBNode *)((BYTE *)pOutput + SizeOfCompressedBVHHeader);
+
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            header.origin[axis] = pNodes[0].center[axis];
+        }
+        header.flags = IsCompressedNodeFlag | GetScaleExponent(pNodes, numNodes, header.origin);
+        const float scale = GetScale(header);
+
+        // Depth-first order with both children of a node allocated together
+        std::vector<UINT> sourceIndices(numNodes);
+        std::vector<UINT> leftIndices(numNodes, 0);
+        std::vector<UINT> stack(1, 0);
+        sourceIndices[0] = 0;
+        UINT nextNodeIndex = 1;
+        while (!stack.empty())
+        {
+            const UINT nodeIndex = stack.back();
+            stack.pop_back();
+
+            const AABBNode &node = pNodes[sourceIndices[nodeIndex]];
+            if (!node.leaf)
+            {
+                assert(nextNodeIndex + 1 < numNodes);
+                const UINT leftIndex = nextNodeIndex;
+                nextNodeIndex += 2;
+
+                leftIndices[nodeIndex] = leftIndex;
+                sourceIndices[leftIndex] = node.internalNode.leftNodeIndex;
+                sourceIndices[leftIndex + 1] = node.rightNodeIndex;
+                stack.push_back(leftIndex + 1);
+                stack.push_back(leftIndex);
+            }
+        }
+        assert(nextNodeIndex == numNodes);
+
+        // Children come after their parent, so going backwards every child's decoded box is
+        // known before its parent is encoded around it
+        std::vector<AABB> decodedBoxes(numNodes);
+        for (UINT i = numNodes; i-- > 0;)
+        {
+            const AABBNode &node = pNodes[sourceIndices[i]];
+            AABB box;
+            DecompressAABB(box, node);
+
+            CompressedAABBNode &compressedNode = pCompressedNodes[i];
+            if (node.leaf)
+            {
+                assert(node.numTriangles <= CompressedLeafPrimitiveCountMask);
+                compressedNode.flags = CompressedLeafNodeFlag |
+                    node.numTriangles << CompressedLeafPrimitiveCountShift |
+                    node.leafNode.firstTriangleId;
+            }
+            else
+            {
+                const UINT leftIndex = leftIndices[i];
+                assert(leftIndex <= CompressedNodeIndexMask);
+                for (UINT child = leftIndex; child < leftIndex + 2; child++)
+                {
+                    for (UINT axis = 0; axis < 3; axis++)
+                    {
+                        box.minArr[axis] = std::min(box.minArr[axis], decodedBoxes[child].minArr[axis]);
+                        box.maxArr[axis] = std::max(box.maxArr[axis], decodedBoxes[child].maxArr[axis]);
+                    }
+                }
+                compressedNode.flags = leftIndex;
+            }
+
+            USHORT center[3], halfDim[3];
+            AABB &decodedBox = decodedBoxes[i];
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                CompressAxis(
+                    box.minArr[axis],
+                    box.maxArr[axis],
+                    header.origin[axis],
+                    scale,
+                    center[axis],
+                    halfDim[axis],
+                    decodedBox.minArr[axis],
+                    decodedBox.maxArr[axis]);
+            }
+
+            compressedNode.centerXY = center[0] | center[1] << 16;
+            compressedNode.centerZHalfDimX = center[2] | halfDim[0] << 16;
+            compressedNode.halfDimYZ = halfDim[1] | halfDim[2] << 16;
+        }
+    }
+
+    bool IsCompressedBVH(const void *pBoxes)
+    {
+        return (((const CompressedBVHHeader *)pBoxes)->flags & IsCompressedNodeFlag) != 0;
+    }
+
+    UINT GetNodeCount(const void *pBoxes, UINT sizeOfBoxes)
+    {
+        if (IsCompressedBVH(pBoxes))
+        {
+            return (sizeOfBoxes - SizeOfCompressedBVHHeader) / SizeOfCompressedAABBNode;
+        }
+        return sizeOfBoxes / SizeOfAABBNode;
+    }
+
+    AABBNode ReadAABBNode(
+        const void *pBoxes,
+        UINT nodeIndex)
+    {
+        if (IsCompressedBVH(pBoxes))
+        {
+            return DecompressAABBNode(*(const CompressedBVHHeader *)pBoxes, GetCompressedNodes(pBoxes)[nodeIndex]);
+        }
+        return ((const AABBNode *)pBoxes)[nodeIndex];
+    }
+}
@@ -0,0 +1,108 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    // Same bit as an AABBNode's leaf flag
+    static const UINT CompressedLeafNodeFlag = 0x80000000;
+
+    // Size of the boxes of a BVH with numNodes nodes stored as CompressedAABBNodes
+    UINT GetCompressedBoxesSize(UINT numNodes);
+
+    //
+    // Writes the nodes of an uncompressed BVH (children anywhere, leaves with fewer than
+    // 32 primitives) as a CompressedBVHHeader followed by CompressedAABBNodes. Nodes are
+    // renumbered so siblings are adjacent, leaves keep their primitive ranges.
+    //
+    // Every decoded box contains both the box it was encoded from and the decoded boxes of
+    // its children, with a margin of an ulp so GPU decoding (which may fuse the multiply-add)
+    // stays conservative too.
+    //
+    void CompressAABBNodes(
+        _In_reads_(numNodes) const AABBNode *pNodes,
+        UINT numNodes,
+        _Out_writes_bytes_(GetCompressedBoxesSize(numNodes)) void *pOutput);
+
+    // True if the boxes starting at pBoxes (the BVH's offsetToBoxes) are compressed
+    bool IsCompressedBVH(_In_ const void *pBoxes);
+
+    // Number of nodes in sizeOfBoxes bytes of boxes in either layout
+    UINT GetNodeCount(_In_ const void *pBoxes, UINT sizeOfBoxes);
+
+    //
+    // Decodes a compressed node into the layout the CPU builder writes uncompressed. Inline
+    // since traversal decodes every node it visits: the six halves are widened with SSE2 by
+    // moving their bits into place and rebiasing the exponent with a multiply, which is exact.
+    //
+    inline AABBNode DecompressAABBNode(
+        const CompressedBVHHeader &header,
+        const CompressedAABBNode &node)
+    {
+        // The flags are cleared first, as their halves would often be denormals, which are slow
+        // to multiply
+        const __m128i packed = _mm_and_si128(
+            _mm_loadu_si128((const __m128i *)&node),
+            _mm_set_epi32(0, -1, -1, -1));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 exponentBias = _mm_castsi128_ps(_mm_set1_epi32(0x77800000));   // 2**112
+
+        __m128 values[2];
+        const __m128i halves[2] = { _mm_unpacklo_epi16(packed, zero), _mm_unpackhi_epi16(packed, zero) };
+        for (UINT i = 0; i < 2; i++)
+        {
+            const __m128i sign = _mm_slli_epi32(_mm_and_si128(halves[i], _mm_set1_epi32(0x8000)), 16);
+            const __m128i body = _mm_slli_epi32(_mm_and_si128(halves[i], _mm_set1_epi32(0x7fff)), 13);
+            values[i] = _mm_mul_ps(_mm_castsi128_ps(_mm_or_si128(sign, body)), exponentBias);
+        }
+
+        const UINT scaleBits = (header.flags & CompressedScaleExponentMask) << 23;
+        const __m128 scale = _mm_set1_ps((float&)scaleBits);
+        const __m128 origin = _mm_set_ps(0.0f, header.origin[2], header.origin[1], header.origin[0]);
+
+        // values[0] holds center.xyz and halfDim.x, values[1] halfDim.yz
+        const __m128 halfDim = _mm_shuffle_ps(
+            _mm_shuffle_ps(values[0], values[1], _MM_SHUFFLE(0, 0, 3, 3)),
+            values[1],
+            _MM_SHUFFLE(1, 1, 2, 0));
+
+        // Flags go in the fourth lanes before storing, so that 16-byte reads of the node
+        // forward from the stores
+        UINT nodeAllBits, rightNodeIndex;
+        if (node.flags & CompressedLeafNodeFlag)
+        {
+            // The primitive count lands in leafNode.numTriangleIds
+            nodeAllBits = node.flags;
+            rightNodeIndex = (node.flags >> CompressedLeafPrimitiveCountShift) & CompressedLeafPrimitiveCountMask;
+        }
+        else
+        {
+            nodeAllBits = node.flags & CompressedNodeIndexMask;
+            rightNodeIndex = nodeAllBits + 1;
+        }
+        const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        const __m128 center = _mm_add_ps(_mm_mul_ps(values[0], scale), origin);
+
+        AABBNode decodedNode;
+        _mm_storeu_ps(decodedNode.center, _mm_or_ps(
+            _mm_and_ps(xyzMask, center),
+            _mm_andnot_ps(xyzMask, _mm_castsi128_ps(_mm_set1_epi32(nodeAllBits)))));
+        _mm_storeu_ps(decodedNode.halfDim, _mm_or_ps(
+            _mm_and_ps(xyzMask, _mm_mul_ps(halfDim, scale)),
+            _mm_andnot_ps(xyzMask, _mm_castsi128_ps(_mm_set1_epi32(rightNodeIndex)))));
+        return decodedNode;
+    }
+
+    // Reads a node of either layout
+    AABBNode ReadAABBNode(
+        _In_ const void *pBoxes,
+        UINT nodeIndex);
+}
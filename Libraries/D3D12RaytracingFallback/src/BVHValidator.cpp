@@ -80,24 +80,25 @@ namespace FallbackLayer
             }
 
             BVHOffsets offsets = *(BVHOffsets*)pOutputCpuData;
-            AABBNode *pNodeArray = (AABBNode*)((BYTE *)pOutputCpuData + offsets.offsetToBoxes);
+            const BYTE *pBoxes = (BYTE *)pOutputCpuData + offsets.offsetToBoxes;
             Primitive *pPrimitiveArray = (Primitive*)((BYTE *)pOutputCpuData + offsets.offsetToVertices);
 
-            std::deque<AABBNode*> nodeQueue;
+            // Nodes are read through ReadAABBNode, which decodes compressed BVHs
+            std::deque<AABBNode> nodeQueue;
 
-            nodeQueue.push_back(&pNodeArray[0]);
+            nodeQueue.push_back(FallbackLayer::ReadAABBNode(pBoxes, 0));
             UINT nodesInLevel = 1;
             while (nodeQueue.size())
             {
-                AABBNode *pCompressedNode = nodeQueue.front();
+                const AABBNode node = nodeQueue.front();
                 nodeQueue.pop_front();
                 nodesInLevel--;
                 bool bProcessedLastNodeInCurrentLevel = nodesInLevel == 0;
 
                 AABB parentAABB;
-                FallbackLayer::DecompressAABB(parentAABB, *pCompressedNode);
+                FallbackLayer::DecompressAABB(parentAABB, node);
 
-                const bool bIsLeaf = pCompressedNode->leaf;
+                const bool bIsLeaf = node.leaf;
 
                 for (auto &pLeaf : pExpectedLeafNodes)
                 {
@@ -110,33 +111,33 @@ namespace FallbackLayer
                 if (!bIsLeaf)
                 {
                     {
-                        ThrowErrorIfFalse(IsChildNodeIndexValid(pCompressedNode->internalNode.leftNodeIndex), L"Circular referance to root node");
-                        AABBNode *pLeftNode = &pNodeArray[pCompressedNode->internalNode.leftNodeIndex];
+                        ThrowErrorIfFalse(IsChildNodeIndexValid(node.internalNode.leftNodeIndex), L"Circular referance to root node");
+                        const AABBNode leftNode = FallbackLayer::ReadAABBNode(pBoxes, node.internalNode.leftNodeIndex);
                         AABB leftAABB;
-                        FallbackLayer::DecompressAABB(leftAABB, *pLeftNode);
+                        FallbackLayer::DecompressAABB(leftAABB, leftNode);
                         ThrowErrorIfFalse(IsChildContainedByParent(parentAABB, leftAABB), L"AABB not contained by parent");
 
-                        nodeQueue.push_back(pLeftNode);
+                        nodeQueue.push_back(leftNode);
                     }
 
                     {
-                        UINT rightNodeIndex = pCompressedNode->rightNodeIndex;
+                        UINT rightNodeIndex = node.rightNodeIndex;
       
                         ThrowErrorIfFalse(IsChildNodeIndexValid(rightNodeIndex), L"Circular referance to root node");
-                        AABBNode *pRightNode = &pNodeArray[rightNodeIndex];
+                        const AABBNode rightNode = FallbackLayer::ReadAABBNode(pBoxes, rightNodeIndex);
                         AABB rightAABB;
-                        FallbackLayer::DecompressAABB(rightAABB, *pRightNode);
+                        FallbackLayer::DecompressAABB(rightAABB, rightNode);
                         ThrowErrorIfFalse(IsChildContainedByParent(parentAABB, rightAABB), L"AABB not contained by parent");
 
-                        nodeQueue.push_back(pRightNode);
+                        nodeQueue.push_back(rightNode);
                     }
                 }
                 else
                 {
                     // TODO: Hacky way to use the same code path for both bottom and top level
                     // BVHs. Doing the triangle calculations for both paths, should 
-                    UINT firstTriangleId = pCompressedNode->leafNode.firstTriangleId;
-                    UINT numTriangles = 1; // pCompressedNode->numTriangles;
+                    UINT firstTriangleId = node.leafNode.firstTriangleId;
+                    UINT numTriangles = 1; // node.numTriangles;
                     ThrowErrorIfFalse(numTriangles > 0, L"Invalid value for numTriangles");
 
                     for (UINT triangleId = firstTriangleId; triangleId < firstTriangleId + numTriangles; triangleId++)
@@ -17,6 +17,9 @@ namespace FallbackLayer
         std::vector<AABBNode>   m_nodes;
         std::vector<float> m_triangles;
         std::vector<PrimitiveMetaData> m_metadata;
+
+        // Index of every primitive in the boxes the BVH was built from, in metadata order
+        std::vector<UINT32> m_primitiveOrder;
     };
 
     static
@@ -40,280 +43,454 @@ namespace FallbackLayer
         return v & 0x00ffffff;
     }
 
+    //
+    // Half-extent around center that covers [boxMin, boxMax]. The rounding of center -/+ halfDim
+    // can land an ulp inside the box, in which case halfDim grows until it doesn't.
+    //
+
     static
-        void ComputeBox(
-            AABB& overallBox,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& metadata)
+        float GetHalfDim(
+            float center,
+            float boxMin,
+            float boxMax)
     {
-        if (metadata.empty())
+        float halfDim = max(boxMax - center, center - boxMin);
+        while (center - halfDim > boxMin || center + halfDim < boxMax)
         {
-            overallBox.max.x = overallBox.min.x = 0;
-            overallBox.max.y = overallBox.min.y = 0;
-            overallBox.max.z = overallBox.min.z = 0;
-            return;
+            halfDim = nextafterf(halfDim, FLT_MAX);
         }
+        return halfDim;
+    }
 
-        overallBox = boxes[metadata[0].PrimitiveIndex];
+    static
+        void SetNodeBox(
+            AABBNode& node,
+            const AABB& box)
+    {
+        float cX = (box.max.x + box.min.x) * 0.5f;
+        float cY = (box.max.y + box.min.y) * 0.5f;
+        float cZ = (box.max.z + box.min.z) * 0.5f;
 
-        const UINT32 numTris = (UINT32)metadata.size();
-        for (UINT32 i = 1; i < numTris; ++i)
-        {
-            const UINT32 triId = metadata[i].PrimitiveIndex;
-            assert(triId < boxes.size());
-            const AABB& newBox = boxes[triId];
+        float dX = GetHalfDim(cX, box.min.x, box.max.x);
+        float dY = GetHalfDim(cY, box.min.y, box.max.y);
+        float dZ = GetHalfDim(cZ, box.min.z, box.max.z);
 
-            AddExtentToBox(overallBox, newBox);
-        }
+        node.center[0] = cX;
+        node.center[1] = cY;
+        node.center[2] = cZ;
+        node.halfDim[0] = dX;
+        node.halfDim[1] = dY;
+        node.halfDim[2] = dZ;
     }
 
-    //
-    // Convert a 16-bit float to 32-bit.
-    //
-
     static
-        float Fp16ToFp32(USHORT v)
+        void InitializeNode(
+            AABBNode& node,
+            const AABB& box)
     {
-        static const UINT kMultiple = 0x77800000;   // 2**112
-        const UINT BiasedFloat = (v & 0x8000) << 16 | (v & 0x7FFF) << 13;
-        return (float&)BiasedFloat * (float&)kMultiple;
+        SetNodeBox(node, box);
+        node.nodeAllBits = 0;
     }
 
-    //
-    // Round toward minus infinity.  Guarantees output <= input.
-    //
-
     static
-        USHORT Fp32ToFp16(float v, float RoundDirection = 0.0f)
+        void InitializeInternalNode(
+            AABBNode& node,
+            const AABB& box,
+            UINT32 leftNodeIndex,
+            UINT32 rightNodeIndex)
     {
-        assert(!!_finite(v));
-        assert(v > -65504 && v < 65504);
+        InitializeNode(node, box);
 
-        // Multiplying by 2^-112 causes exponents below -14 to denormalize
-        static const UINT kMultiple = 0x07800000;   // 2**-112
-        const float BiasedFloat = v * (float&)kMultiple;
-        const UINT u = (UINT&)BiasedFloat;
+        node.internalNode.separatingAxis = 0;
+        node.internalNode.leftNodeIndex = leftNodeIndex;
+        node.rightNodeIndex = rightNodeIndex;
+    }
 
-        const UINT sign = u & 0x80000000;
-        UINT body = u & 0x0fffffff;
+    static
+        void InitializeLeafNode(
+            AABBNode& node,
+            const AABB& box,
+            UINT32 firstTriangleId,
+            UINT32 numTriangles)
+    {
+        InitializeNode(node, box);
 
-        // Increase the magnitude before truncation to ensure proper bounds
-        if (v * RoundDirection > 0.0f)
-        {
-            if (body == 0)
-                body = 0x800000;
-            else
-                body += 0x1fff;
-        }
+        assert(numTriangles < 128);
+        assert(firstTriangleId < (1 << 24));
 
-        return (USHORT)(sign >> 16 | body >> 13);
+        node.leaf = true;
+        node.leafNode.firstTriangleId = firstTriangleId;
+        node.leafNode.numTriangleIds = numTriangles;
+        node.numTriangles = numTriangles;
     }
 
     static
-        float QuantizeToFp16(
-            float v)
+        float ComputeBoxSurfaceArea(
+            const AABB& box)
     {
-        return v;
+        const float dims[3] =
+        {
+            box.max.x - box.min.x,
+            box.max.y - box.min.y,
+            box.max.z - box.min.z
+        };
+
+        return 2 * (dims[0] * dims[1] + dims[0] * dims[2] + dims[1] * dims[2]);
     }
 
     static
-        UINT32 BuildBVHAddNode(
-            BVH& bvh,
-            const AABB& box,
-            UINT32 maxDimension)
+        void InitBoxToInverseMax(
+            AABB& box)
     {
-        UNREFERENCED_PARAMETER(maxDimension);
-        assert(maxDimension < 3);
-        const UINT32 nodeIndex = (UINT32)bvh.m_nodes.size();
+        box.max.x = box.max.y = box.max.z = -10e10f;//FLT_MAX;
+        box.min.x = box.min.y = box.min.z = 10e10f;//FLT_MAX;
+    }
 
-        float cX = (box.max.x + box.min.x) * 0.5f;
-        float cY = (box.max.y + box.min.y) * 0.5f;
-        float cZ = (box.max.z + box.min.z) * 0.5f;
-        cX = QuantizeToFp16(cX);
-        cY = QuantizeToFp16(cY);
-        cZ = QuantizeToFp16(cZ);
+    //
+    // Parallel binned SAH builder.
+    //
+    // All primitives live in one index array that gets partitioned in place, so a node
+    // is just a [begin, begin + count) range of it. Internal nodes allocate both children
+    // from a pool sized for the worst case (2n - 1 nodes) and subtrees that are large
+    // enough are handed to the task pool. Once everything is built, the pool is
+    // optionally rewritten into the canonical depth-first order described in BuildBVH.
+    //
 
-        float dX = max(box.max.x - cX, cX - box.min.x);
-        float dY = max(box.max.y - cY, cY - box.min.y);
-        float dZ = max(box.max.z - cZ, cZ - box.min.z);
+    static const UINT NUM_SAH_BINS = 64;
 
-        AABBNode packedBox;
-        packedBox.center[0] = cX;
-        packedBox.center[1] = cY;
-        packedBox.center[2] = cZ;
-        packedBox.halfDim[0] = dX;
-        packedBox.halfDim[1] = dY;
-        packedBox.halfDim[2] = dZ;
-        packedBox.nodeAllBits = 0;
+    // Nodes smaller than this are finished by the worker that split their parent
+    static const UINT32 MinPrimitivesPerTask = 1024;
 
-        bvh.m_nodes.push_back(packedBox);
+    // Nodes larger than this bin and compute boxes across all workers
+    static const UINT32 ParallelBinningThreshold = 64 * 1024;
+    static const UINT32 BinningGrainSize = 16 * 1024;
 
-        assert(bvh.m_nodes.size() - 1 == nodeIndex);
+    struct SahBin
+    {
+        AABB    box;
+        UINT    numTriangles;
+    };
 
-        bvh.m_nodes[nodeIndex].internalNode.separatingAxis = 0;
+    struct SahBins
+    {
+        SahBin  bins[3][NUM_SAH_BINS];
+    };
 
-        return nodeIndex;
-    }
+    struct BinningParameters
+    {
+        float   rangeMin[3];
+        float   inverseExtents[3];
+        bool    axisActive[3];
+    };
 
-    static
-        UINT32 BuildBVHAddLeaf(
-            BVH& bvh,
-            const AABB& box,
-            const std::vector<PrimitiveMetaData>& metadata)
+    struct SahSplitCandidate
+    {
+        UINT32  axis;
+        UINT32  bin;
+        UINT32  numTrisInLeftNode;
+        AABB    leftBox;
+        AABB    rightBox;
+    };
+
+    class BuildTaskArena;
+
+    struct BuildContext
+    {
+        const AABB*         pBoxes;
+        const float*        pCentroids[3];
+        UINT32*             pPrimitiveIndices;
+        AABBNode*           pNodes;
+        std::atomic<UINT32> nodeCount;
+        UINT32              maxTrisInLeaf;
+        std::vector<std::unique_ptr<BuildTaskArena>> arenas;
+    };
+
+    struct BuildTask
     {
-        const UINT32 nodeIndex = BuildBVHAddNode(bvh, box, 0);
+        BuildContext*   pContext;
+        AABB            box;
+        UINT32          nodeIndex;
+        UINT32          begin;
+        UINT32          count;
+    };
 
-        bvh.m_nodes[nodeIndex].nodeAllBits = 0;
-        bvh.m_nodes[nodeIndex].leaf = true;
+    //
+    // Build tasks only live for the duration of a build so they are bump allocated
+    // out of per-worker blocks and released all at once.
+    //
+    class BuildTaskArena
+    {
+    public:
+        BuildTask* Allocate()
+        {
+            if (m_usedInBlock == TasksPerBlock)
+            {
+                m_blocks.emplace_back(new BuildTask[TasksPerBlock]);
+                m_usedInBlock = 0;
+            }
+            return &m_blocks.back()[m_usedInBlock++];
+        }
 
-        const UINT32 idIndex = (UINT32)bvh.m_metadata.size();
+    private:
+        static const UINT TasksPerBlock = 1024;
+        std::vector<std::unique_ptr<BuildTask[]>> m_blocks;
+        UINT m_usedInBlock = TasksPerBlock;
+    };
 
-        std::copy(metadata.begin(), metadata.end(), std::back_inserter(bvh.m_metadata));
+    static
+        UINT ComputeBinIndex(
+            float centroid,
+            float rangeMin,
+            float inverseExtents)
+    {
+        return std::min(NUM_SAH_BINS - 1,
+            UINT(NUM_SAH_BINS * ((centroid - rangeMin) * inverseExtents)));
+    }
 
-        assert(metadata.size() < 128);
-        assert(idIndex < (1 << 24));
+    static
+        void InitBins(
+            SahBins& bins)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+            {
+                bins.bins[i][j].numTriangles = 0;
+                InitBoxToInverseMax(bins.bins[i][j].box);
+            }
+        }
+    }
 
-        bvh.m_nodes[nodeIndex].leafNode.firstTriangleId = idIndex;
-        bvh.m_nodes[nodeIndex].leafNode.numTriangleIds = (UINT32)metadata.size();
+    static
+        void MergeBins(
+            SahBins& bins,
+            const SahBins& otherBins)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+            {
+                bins.bins[i][j].numTriangles += otherBins.bins[i][j].numTriangles;
+                AddExtentToBox(bins.bins[i][j].box, otherBins.bins[i][j].box);
+            }
+        }
+    }
 
-        return nodeIndex;
+    static
+        void AccumulateBins(
+            SahBins& bins,
+            const BuildContext& context,
+            const BinningParameters& params,
+            const UINT32* pIndices,
+            const UINT32 (&binIndices)[3][8],
+            UINT count)
+    {
+        for (UINT k = 0; k < count; ++k)
+        {
+            const AABB& triBox = context.pBoxes[pIndices[k]];
+            for (UINT i = 0; i < 3; ++i)
+            {
+                if (params.axisActive[i])
+                {
+                    SahBin& bin = bins.bins[i][binIndices[i][k]];
+                    bin.numTriangles++;
+                    AddExtentToBox(bin.box, triBox);
+                }
+            }
+        }
     }
 
     //
-    // Sort min to max by centroid
+    // Bin indices are computed for 8 (AVX2) or 4 (SSE) primitives at a time. The math
+    // is the same sequence of IEEE operations as ComputeBinIndex, clamping before the
+    // truncation instead of after, so both paths place every primitive in the same bin.
     //
 
     static
-        void SortByCentroid(
-            std::vector<PrimitiveMetaData>& metadata,
-            const std::vector<AABB>& boxes,
-            UINT32 maxDimension)
+        void BinPrimitivesAvx2(
+            SahBins& bins,
+            const BuildContext& context,
+            const BinningParameters& params,
+            const UINT32* pIndices,
+            UINT count)
     {
-        struct TriPosition
+        const __m256 numBins = _mm256_set1_ps((float)NUM_SAH_BINS);
+        const __m256 maxBin = _mm256_set1_ps((float)(NUM_SAH_BINS - 1));
+        __m256 rangeMin[3];
+        __m256 inverseExtents[3];
+        for (UINT i = 0; i < 3; ++i)
         {
-            float   pos;
-            UINT32  id;
-        };
-
-        std::vector<TriPosition> sortTris(metadata.size());
+            rangeMin[i] = _mm256_set1_ps(params.rangeMin[i]);
+            inverseExtents[i] = _mm256_set1_ps(params.inverseExtents[i]);
+        }
 
-        for (UINT32 i = 0; i < metadata.size(); ++i)
+        UINT32 binIndices[3][8];
+        UINT j = 0;
+        for (; j + 8 <= count; j += 8)
         {
-            const UINT32 triId = metadata[i].PrimitiveIndex;
-            const AABB& box = boxes[triId];
+            const __m256i ids = _mm256_loadu_si256((const __m256i*)(pIndices + j));
+            for (UINT i = 0; i < 3; ++i)
+            {
+                const __m256 centroid = _mm256_i32gather_ps(context.pCentroids[i], ids, sizeof(float));
+                const __m256 bin = _mm256_mul_ps(numBins, _mm256_mul_ps(_mm256_sub_ps(centroid, rangeMin[i]), inverseExtents[i]));
+                _mm256_storeu_si256((__m256i*)binIndices[i], _mm256_cvttps_epi32(_mm256_min_ps(bin, maxBin)));
+            }
+            AccumulateBins(bins, context, params, pIndices + j, binIndices, 8);
+        }
 
-            const float boxCenter = (box.maxArr[maxDimension] + box.minArr[maxDimension]) / 2;
+        for (; j < count; ++j)
+        {
+            for (UINT i = 0; i < 3; ++i)
+            {
+                binIndices[i][0] = ComputeBinIndex(context.pCentroids[i][pIndices[j]], params.rangeMin[i], params.inverseExtents[i]);
+            }
+            AccumulateBins(bins, context, params, pIndices + j, binIndices, 1);
+        }
+    }
 
-            sortTris[i].pos = boxCenter;
-            sortTris[i].id = metadata[i].PrimitiveIndex;
+    static
+        void BinPrimitivesSse(
+            SahBins& bins,
+            const BuildContext& context,
+            const BinningParameters& params,
+            const UINT32* pIndices,
+            UINT count)
+    {
+        const __m128 numBins = _mm_set1_ps((float)NUM_SAH_BINS);
+        const __m128 maxBin = _mm_set1_ps((float)(NUM_SAH_BINS - 1));
+        __m128 rangeMin[3];
+        __m128 inverseExtents[3];
+        for (UINT i = 0; i < 3; ++i)
+        {
+            rangeMin[i] = _mm_set1_ps(params.rangeMin[i]);
+            inverseExtents[i] = _mm_set1_ps(params.inverseExtents[i]);
         }
 
-        // Split the list into left and right sublists
-        std::sort(sortTris.begin(), sortTris.end(), [](auto&& a, auto&& b) -> bool { return a.pos < b.pos; });
+        UINT32 binIndices[3][8];
+        UINT j = 0;
+        for (; j + 4 <= count; j += 4)
+        {
+            for (UINT i = 0; i < 3; ++i)
+            {
+                const float* pCentroids = context.pCentroids[i];
+                const __m128 centroid = _mm_setr_ps(
+                    pCentroids[pIndices[j + 0]],
+                    pCentroids[pIndices[j + 1]],
+                    pCentroids[pIndices[j + 2]],
+                    pCentroids[pIndices[j + 3]]);
+                const __m128 bin = _mm_mul_ps(numBins, _mm_mul_ps(_mm_sub_ps(centroid, rangeMin[i]), inverseExtents[i]));
+                _mm_storeu_si128((__m128i*)binIndices[i], _mm_cvttps_epi32(_mm_min_ps(bin, maxBin)));
+            }
+            AccumulateBins(bins, context, params, pIndices + j, binIndices, 4);
+        }
 
-        // Update the output
-        for (UINT32 i = 0; i < metadata.size(); ++i)
+        for (; j < count; ++j)
         {
-            metadata[i].PrimitiveIndex = sortTris[i].id;
+            for (UINT i = 0; i < 3; ++i)
+            {
+                binIndices[i][0] = ComputeBinIndex(context.pCentroids[i][pIndices[j]], params.rangeMin[i], params.inverseExtents[i]);
+            }
+            AccumulateBins(bins, context, params, pIndices + j, binIndices, 1);
         }
     }
 
-
     static
-        float ComputeBoxSurfaceArea(
-            const AABB& box)
+        void BinPrimitives(
+            SahBins& bins,
+            const BuildContext& context,
+            const BinningParameters& params,
+            const UINT32* pIndices,
+            UINT count)
     {
-        const float dims[3] =
+        static const bool useAvx2 = IsAvx2Supported();
+        if (useAvx2)
         {
-            box.max.x - box.min.x,
-            box.max.y - box.min.y,
-            box.max.z - box.min.z
-        };
+            BinPrimitivesAvx2(bins, context, params, pIndices, count);
+        }
+        else
+        {
+            BinPrimitivesSse(bins, context, params, pIndices, count);
+        }
+    }
 
-        return 2 * (dims[0] * dims[1] + dims[0] * dims[2] + dims[1] * dims[2]);
+    static
+        void ComputeBox(
+            AABB& overallBox,
+            const BuildContext& context,
+            const UINT32* pIndices,
+            UINT count)
+    {
+        InitBoxToInverseMax(overallBox);
+        for (UINT i = 0; i < count; ++i)
+        {
+            AddExtentToBox(overallBox, context.pBoxes[pIndices[i]]);
+        }
     }
 
     static
-        void InitBoxToInverseMax(
-            AABB& box)
+        AABB ComputeRangeBox(
+            CpuTaskPool& pool,
+            UINT workerIndex,
+            const BuildContext& context,
+            const UINT32* pIndices,
+            UINT count)
     {
-        box.max.x = box.max.y = box.max.z = -10e10f;//FLT_MAX;
-        box.min.x = box.min.y = box.min.z = 10e10f;//FLT_MAX;
+        AABB box;
+        if (count < ParallelBinningThreshold)
+        {
+            ComputeBox(box, context, pIndices, count);
+            return box;
+        }
+
+        std::vector<AABB> chunkBoxes(DivideAndRoundUp(count, BinningGrainSize));
+        pool.ParallelFor(workerIndex, count, BinningGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            ComputeBox(chunkBoxes[begin / BinningGrainSize], context, pIndices + begin, end - begin);
+        });
+
+        InitBoxToInverseMax(box);
+        for (auto& chunkBox : chunkBoxes)
+        {
+            AddExtentToBox(box, chunkBox);
+        }
+        return box;
     }
 
     //
-    // A feeble attempt at a SAH builder
+    // Same scoring as the original single-threaded "feeble attempt at a SAH builder":
+    // evaluate every bin boundary on every axis with a non-zero extent and keep the
+    // cheapest one.
     //
 
     static
-        void SahSplit(
-            std::vector<PrimitiveMetaData>& metadata,
-            UINT32& maxDimension,
-            UINT32& numTrisInLeftNode,
+        SahSplitCandidate FindBestSplit(
+            const SahBins& bins,
+            const BinningParameters& params,
             const AABB& nodeBox,
-            const std::vector<AABB>& boxes)
+            UINT numTris)
     {
-        static const UINT NUM_SAH_BINS = 64;
-
-        struct SahBin
-        {
-            AABB    box;
-            UINT    numTriangles;
-        };
-
-        // NOTE: use vector if this blows out the stack?
-        SahBin  sahBins[3][NUM_SAH_BINS];
-
         // For the score to be meaningful it seems we need to normalize it to something
         const float normalizeToParent = 1.f / ComputeBoxSurfaceArea(nodeBox);
 
-        const UINT numTris = (UINT)metadata.size();
-
+        SahSplitCandidate split = {};
         float bestSah = FLT_MAX;
-        maxDimension = 0;
-        //numTrisInLeftNode = triangleIds.size() / 2;
 
-        // Compute SAH score per axis
         for (UINT i = 0; i < 3; ++i)
         {
-            const float extents = nodeBox.maxArr[i] - nodeBox.minArr[i];
-            if (extents == 0)
+            if (!params.axisActive[i])
                 continue;
 
-            const float rangeMin = nodeBox.minArr[i];
-
-            const float inverseExtents = 1.f / extents;
-
-            // Init boxes
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
-            {
-                sahBins[i][j].numTriangles = 0;
-                InitBoxToInverseMax(sahBins[i][j].box);
-            }
-
-            // Place triangles into the buckets
-            for (UINT j = 0; j < metadata.size(); ++j)
-            {
-                const UINT triId = metadata[j].PrimitiveIndex;
-
-                const AABB& triBox = boxes[triId];
-
-                const float centroid = (triBox.maxArr[i] + triBox.minArr[i]) * 0.5f;
-
-                const UINT binIndex = std::min(NUM_SAH_BINS - 1,
-                    UINT(NUM_SAH_BINS * ((centroid - rangeMin) * inverseExtents)));
-
-                sahBins[i][binIndex].numTriangles++;
-                AddExtentToBox(sahBins[i][binIndex].box, triBox);
-            }
+            const SahBin* sahBins = bins.bins[i];
 
+#if _DEBUG
             // Make sure we caught all of them once
             UINT testTris = 0;
             for (UINT j = 0; j < NUM_SAH_BINS; ++j)
             {
-                testTris += sahBins[i][j].numTriangles;
+                testTris += sahBins[j].numTriangles;
             }
             assert(testTris == numTris);
+#endif
 
             // Precompute left and right boxes with counts to be able to test plane positionings
 
@@ -324,8 +501,8 @@ namespace FallbackLayer
             {
                 const UINT rightIdx = NUM_SAH_BINS - j - 1;
 
-                rightBoxes[rightIdx] = sahBins[i][rightIdx].box;
-                leftBoxes[j] = sahBins[i][j].box;
+                rightBoxes[rightIdx] = sahBins[rightIdx].box;
+                leftBoxes[j] = sahBins[j].box;
 
                 if (j > 0)
                 {
@@ -340,13 +517,13 @@ namespace FallbackLayer
             // Find the plane with the best score
             for (UINT j = 0; j < NUM_SAH_BINS - 1; ++j)
             {
-                if (!sahBins[i][j].numTriangles)
+                if (!sahBins[j].numTriangles)
                 {
                     continue;
                 }
 
-                numTrianglesOnLeft += sahBins[i][j].numTriangles;
-                numTrianglesOnRight -= sahBins[i][j].numTriangles;
+                numTrianglesOnLeft += sahBins[j].numTriangles;
+                numTrianglesOnRight -= sahBins[j].numTriangles;
 
                 const float sah = (numTrianglesOnLeft * ComputeBoxSurfaceArea(leftBoxes[j]) +
                     numTrianglesOnRight * ComputeBoxSurfaceArea(rightBoxes[j + 1])) *
@@ -357,171 +534,1270 @@ namespace FallbackLayer
                 if (sah < bestSah)
                 {
                     bestSah = sah;
-                    maxDimension = i;
-                    numTrisInLeftNode = numTrianglesOnLeft;
+                    split.axis = i;
+                    split.bin = j;
+                    split.numTrisInLeftNode = numTrianglesOnLeft;
+                    split.leftBox = leftBoxes[j];
+                    split.rightBox = rightBoxes[j + 1];
                 }
             }
         }
 
-        //
-        // Split the set to try to get a balanced tree
-        //
-
-        SortByCentroid(metadata, boxes, maxDimension);
+        return split;
     }
 
     //
-    // It's a good idea to do a breadth-first build because then nodes from the same level
-    // get adjacent memory locations. It does take a lot of memory though.
-    //
-    // "Uniform BVH"
-    // -- both children are valid for all internal nodes
-    // -- left child's index is +1 of the parent index, right child's index is stored
-    //    in the packed AABB structure.
-    // -- there could be a varaible number of triangles in leaves
+    // Partitions [pIndices, pIndices + count) into a left and right child and returns
+    // the number of primitives that went left along with both child boxes.
     //
+
     static
-        void BuildBVH(
-            BVH& bvh,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& primitiveMetaData,
-            UINT32 maxTrisInLeaf)
+        UINT32 SplitNode(
+            CpuTaskPool& pool,
+            UINT workerIndex,
+            const BuildContext& context,
+            UINT32* pIndices,
+            UINT32 count,
+            const AABB& nodeBox,
+            AABB& leftBox,
+            AABB& rightBox)
     {
-        //
-        // These are huge so use pointers
-        //
-        struct StackItem
+        BinningParameters params;
+        for (UINT i = 0; i < 3; ++i)
         {
-            std::vector<PrimitiveMetaData> primitiveMetaData;
-            UINT32              parentIndex;
-            UINT                right : 1;
-            UINT                axis : 2;
-        };
-
-        std::deque<StackItem*>   fifoLefts;
-        std::deque<StackItem*>   fifoRights;
-
-        StackItem* temp = new StackItem;
-        temp->parentIndex = (UINT)-1;
-        temp->primitiveMetaData = primitiveMetaData;
-        temp->right = false;
-        temp->axis = 0;
-        fifoRights.push_back(temp);
+            const float extents = nodeBox.maxArr[i] - nodeBox.minArr[i];
+            params.axisActive[i] = extents != 0;
+            params.rangeMin[i] = nodeBox.minArr[i];
+            params.inverseExtents[i] = params.axisActive[i] ? 1.f / extents : 0.0f;
+        }
 
-        while (!fifoLefts.empty() || !fifoRights.empty())
+        SahBins bins;
+        InitBins(bins);
+        if (count < ParallelBinningThreshold)
         {
-            // Uniform BVH pops the first left node
-            StackItem* item = nullptr;
-
-            if (!fifoRights.empty())
+            BinPrimitives(bins, context, params, pIndices, count);
+        }
+        else
+        {
+            std::vector<SahBins> chunkBins(DivideAndRoundUp(count, BinningGrainSize));
+            pool.ParallelFor(workerIndex, count, BinningGrainSize, [&](UINT begin, UINT end, UINT)
             {
-                item = fifoRights.back();
-                fifoRights.pop_back();
-            }
+                SahBins& localBins = chunkBins[begin / BinningGrainSize];
+                InitBins(localBins);
+                BinPrimitives(localBins, context, params, pIndices + begin, end - begin);
+            });
 
-            if (!item)
+            for (auto& localBins : chunkBins)
             {
-                item = fifoLefts.back();
-                fifoLefts.pop_back();
+                MergeBins(bins, localBins);
             }
+        }
 
-            //
-            // Compute overall bounding box
-            //
-            AABB nodeBox;
-            ComputeBox(nodeBox, boxes, item->primitiveMetaData);
-
-            const UINT32 numTrianglesInNode = (UINT32)item->primitiveMetaData.size();
-            const UINT32 parentIndex = item->parentIndex;
+        const SahSplitCandidate split = FindBestSplit(bins, params, nodeBox, count);
 
-            UINT32 thisNodeIndex;
+        UINT32 leftCount = 0;
+        if (split.numTrisInLeftNode != 0 && split.numTrisInLeftNode != count)
+        {
+            const float* pCentroids = context.pCentroids[split.axis];
+            const float rangeMin = params.rangeMin[split.axis];
+            const float inverseExtents = params.inverseExtents[split.axis];
 
-            // Leaf or internal node?
-            if (numTrianglesInNode <= maxTrisInLeaf)
+            UINT32* pMiddle = std::partition(pIndices, pIndices + count, [&](UINT32 primitiveIndex)
             {
-                thisNodeIndex = BuildBVHAddLeaf(bvh, nodeBox, item->primitiveMetaData);
-            }
-            else
-            {
-                //
-                // Find separating plane. Use Median for speed.
-                // SAH is better but also more expensive to build.
-                //
-
-                UINT splitDimension;
-                UINT leftChildNumNodes;
-
-                SahSplit(item->primitiveMetaData,
-                    splitDimension,
-                    leftChildNumNodes,
-                    nodeBox,
-                    boxes);
-
-                assert(leftChildNumNodes <= item->primitiveMetaData.size());
+                return ComputeBinIndex(pCentroids[primitiveIndex], rangeMin, inverseExtents) <= split.bin;
+            });
+            leftCount = (UINT32)(pMiddle - pIndices);
+        }
 
-                // Try to balance by using the median if SAH failed
-                if ((leftChildNumNodes == 0 ||
-                    leftChildNumNodes == item->primitiveMetaData.size()) &&
-                    item->primitiveMetaData.size() > MAX_TRIS_IN_LEAF)
-                {
-                    leftChildNumNodes = (UINT)item->primitiveMetaData.size() / 2;
-                }
+        if (leftCount == 0 || leftCount == count)
+        {
+            //
+            // Try to balance by using the median if SAH failed. Ties are broken by
+            // primitive index so the result doesn't depend on the partition order.
+            //
+            const float* pCentroids = context.pCentroids[split.axis];
+            leftCount = count / 2;
+            std::nth_element(pIndices, pIndices + leftCount, pIndices + count, [&](UINT32 a, UINT32 b)
+            {
+                return pCentroids[a] < pCentroids[b] || (pCentroids[a] == pCentroids[b] && a < b);
+            });
+        }
+        else if (leftCount == split.numTrisInLeftNode)
+        {
+            // The bins already know the child boxes
+            leftBox = split.leftBox;
+            rightBox = split.rightBox;
+            return leftCount;
+        }
 
-                const UINT32 rightChildNumNodes = (UINT32)item->primitiveMetaData.size() - leftChildNumNodes;
+        leftBox = ComputeRangeBox(pool, workerIndex, context, pIndices, leftCount);
+        rightBox = ComputeRangeBox(pool, workerIndex, context, pIndices + leftCount, count - leftCount);
+        return leftCount;
+    }
 
+    static
+        void BuildSubtree(
+            CpuTaskPool& pool,
+            UINT workerIndex,
+            const BuildTask& root)
+    {
+        BuildContext& context = *root.pContext;
 
-                //
-                // "Recurse"
-                //
+        // Small subtrees are finished on this worker without going through the pool
+        std::vector<BuildTask> pendingTasks;
+        pendingTasks.push_back(root);
 
-                thisNodeIndex = BuildBVHAddNode(bvh, nodeBox, splitDimension);
+        while (!pendingTasks.empty())
+        {
+            BuildTask task = pendingTasks.back();
+            pendingTasks.pop_back();
 
-                StackItem* leftItem = new StackItem;
-                leftItem->parentIndex = thisNodeIndex;
-                leftItem->primitiveMetaData.resize(leftChildNumNodes);
-                leftItem->right = false;
-                leftItem->axis = splitDimension;
-                for (UINT32 i = 0; i < leftChildNumNodes; ++i)
+            for (;;)
+            {
+                AABBNode& node = context.pNodes[task.nodeIndex];
+                if (task.count <= context.maxTrisInLeaf)
                 {
-                    leftItem->primitiveMetaData[i] = item->primitiveMetaData[i];
+                    InitializeLeafNode(node, task.box, task.begin, task.count);
+                    break;
                 }
 
-                StackItem* rightItem = new StackItem;
-                rightItem->parentIndex = thisNodeIndex;
-                rightItem->primitiveMetaData.resize(rightChildNumNodes);
-                rightItem->right = true;
-                rightItem->axis = splitDimension;
-                for (UINT32 i = 0; i < rightChildNumNodes; ++i)
+                AABB leftBox, rightBox;
+                const UINT32 leftCount = SplitNode(
+                    pool,
+                    workerIndex,
+                    context,
+                    context.pPrimitiveIndices + task.begin,
+                    task.count,
+                    task.box,
+                    leftBox,
+                    rightBox);
+
+                const UINT32 leftNodeIndex = context.nodeCount.fetch_add(2);
+                const UINT32 rightNodeIndex = leftNodeIndex + 1;
+                InitializeInternalNode(node, task.box, leftNodeIndex, rightNodeIndex);
+
+                BuildTask leftTask = { &context, leftBox, leftNodeIndex, task.begin, leftCount };
+                if (leftCount >= MinPrimitivesPerTask)
                 {
-                    rightItem->primitiveMetaData[i] = item->primitiveMetaData[i + leftChildNumNodes];
+                    BuildTask* pLeftTask = context.arenas[workerIndex]->Allocate();
+                    *pLeftTask = leftTask;
+                    pool.Spawn(workerIndex, [](CpuTaskPool& taskPool, UINT taskWorkerIndex, void* pTask)
+                    {
+                        BuildSubtree(taskPool, taskWorkerIndex, *(const BuildTask*)pTask);
+                    }, pLeftTask);
                 }
-
-                fifoLefts.push_back(leftItem);
-                fifoRights.push_back(rightItem);
-            }
-
-            // Update child link of the parent
-            if (parentIndex != -1)
-            {
-                if (!item->right)
+                else
                 {
-                    bvh.m_nodes[parentIndex].internalNode.leftNodeIndex = thisNodeIndex;
-                    bvh.m_nodes[parentIndex].rightNodeIndex = parentIndex + 1;
+                    pendingTasks.push_back(leftTask);
                 }
-            }
 
-            // Free the item after use
-            delete item;
+                // Keep going down the right side on this worker
+                task.box = rightBox;
+                task.nodeIndex = rightNodeIndex;
+                task.begin += leftCount;
+                task.count -= leftCount;
+            }
         }
     }
 
-    void BuildUniformBVH(
-        _In_  UINT NumElements,
-        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
-        BVH &bvh)
-    {
-        using namespace DirectX;
-        //
+    //
+    // Rewrites the pool into the layout the original breadth/depth hybrid builder
+    // produced: the right child immediately follows its parent, the whole right
+    // subtree comes before the left one and leaves reference primitives in the
+    // order they are emitted. Only nodes reachable from the root are written.
+    //
+
+    static
+        void FlattenBVH(
+            BVH& bvh,
+            const std::vector<AABBNode>& nodePool,
+            const std::vector<UINT32>& primitiveIndices,
+            UINT32 numNodes)
+    {
+        struct StackItem
+        {
+            UINT32  poolIndex;
+            UINT32  parentIndex;
+            bool    right;
+        };
+
+        bvh.m_nodes.resize(numNodes);
+        bvh.m_primitiveOrder.clear();
+        bvh.m_primitiveOrder.reserve(primitiveIndices.size());
+
+        std::vector<StackItem> stack;
+        stack.push_back({ 0, (UINT32)-1, true });
+
+        UINT32 nextNodeIndex = 0;
+        while (!stack.empty())
+        {
+            const StackItem item = stack.back();
+            stack.pop_back();
+
+            const UINT32 thisNodeIndex = nextNodeIndex++;
+            const AABBNode& poolNode = nodePool[item.poolIndex];
+            AABBNode& node = bvh.m_nodes[thisNodeIndex];
+            node = poolNode;
+
+            if (poolNode.leaf)
+            {
+                const UINT32 firstPrimitive = poolNode.leafNode.firstTriangleId;
+                const UINT32 numPrimitives = poolNode.numTriangles;
+
+                node.leafNode.firstTriangleId = (UINT32)bvh.m_primitiveOrder.size();
+                for (UINT32 i = 0; i < numPrimitives; ++i)
+                {
+                    bvh.m_primitiveOrder.push_back(primitiveIndices[firstPrimitive + i]);
+                }
+            }
+            else
+            {
+                // Pushed left first so the right child is popped next
+                stack.push_back({ poolNode.internalNode.leftNodeIndex, thisNodeIndex, false });
+                stack.push_back({ poolNode.rightNodeIndex, thisNodeIndex, true });
+            }
+
+            // Update child link of the parent
+            if (!item.right)
+            {
+                bvh.m_nodes[item.parentIndex].internalNode.leftNodeIndex = thisNodeIndex;
+                bvh.m_nodes[item.parentIndex].rightNodeIndex = item.parentIndex + 1;
+            }
+        }
+
+        assert(nextNodeIndex == numNodes);
+    }
+
+    //
+    // It's a good idea to do a breadth-first build because then nodes from the same level
+    // get adjacent memory locations. It does take a lot of memory though.
+    //
+    // "Uniform BVH"
+    // -- both children are valid for all internal nodes
+    // -- left child's index is +1 of the parent index, right child's index is stored
+    //    in the packed AABB structure.
+    // -- there could be a varaible number of triangles in leaves
+    //
+    // Fills in the nodes and m_primitiveOrder, metadata and triangles are up to the caller.
+    //
+    static
+        void BuildBVH(
+            BVH& bvh,
+            CpuTaskPool& pool,
+            const std::vector<AABB>& boxes,
+            UINT32 maxTrisInLeaf,
+            bool deterministic)
+    {
+        const UINT32 numPrimitives = (UINT32)boxes.size();
+        if (numPrimitives == 0)
+        {
+            AABB emptyBox = {};
+            bvh.m_nodes.resize(1);
+            bvh.m_primitiveOrder.clear();
+            InitializeLeafNode(bvh.m_nodes[0], emptyBox, 0, 0);
+            return;
+        }
+
+        std::vector<float> centroids[3];
+        for (auto& axisCentroids : centroids)
+        {
+            axisCentroids.resize(numPrimitives);
+        }
+
+        std::vector<UINT32> primitiveIndices(numPrimitives);
+
+        // A binary tree with at least one primitive per leaf never needs more than this
+        const UINT32 maxNodes = 2 * numPrimitives - 1;
+        std::vector<AABBNode> nodePool(maxNodes);
+
+        BuildContext context;
+        context.pBoxes = boxes.data();
+        context.pPrimitiveIndices = primitiveIndices.data();
+        context.pNodes = nodePool.data();
+        context.nodeCount = 1;
+        context.maxTrisInLeaf = maxTrisInLeaf;
+        for (UINT i = 0; i < 3; ++i)
+        {
+            context.pCentroids[i] = centroids[i].data();
+        }
+        for (UINT i = 0; i < pool.GetWorkerCount(); ++i)
+        {
+            context.arenas.emplace_back(new BuildTaskArena);
+        }
+
+        pool.ParallelFor(numPrimitives, BinningGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                const AABB& box = boxes[i];
+                for (UINT axis = 0; axis < 3; ++axis)
+                {
+                    centroids[axis][i] = (box.maxArr[axis] + box.minArr[axis]) * 0.5f;
+                }
+                primitiveIndices[i] = i;
+            }
+        });
+
+        BuildTask rootTask = { &context, {}, 0, 0, numPrimitives };
+        pool.Run([](CpuTaskPool& taskPool, UINT workerIndex, void* pTask)
+        {
+            BuildTask& task = *(BuildTask*)pTask;
+            task.box = ComputeRangeBox(taskPool, workerIndex, *task.pContext, task.pContext->pPrimitiveIndices, task.count);
+            BuildSubtree(taskPool, workerIndex, task);
+        }, &rootTask);
+
+        const UINT32 numNodes = context.nodeCount;
+        if (deterministic)
+        {
+            FlattenBVH(bvh, nodePool, primitiveIndices, numNodes);
+        }
+        else
+        {
+            nodePool.resize(numNodes);
+            bvh.m_nodes = std::move(nodePool);
+            bvh.m_primitiveOrder = std::move(primitiveIndices);
+        }
+    }
+
+    static const UINT TrianglesPerLoadChunk = 16 * 1024;
+
+    //
+    // Reads the vertices of a triangle of the geometry into pVertices (v0, v1, v2) and
+    // computes the box the builder uses for it.
+    //
+
+    static
+        void LoadTriangle(
+            const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC& triangles,
+            UINT triangleIndex,
+            float* pVertices,
+            AABB& box)
+    {
+        const UINT64 vertexStrideDwords = triangles.VertexBuffer.StrideInBytes / 4;
+        const float* pVertexData = (const float*)triangles.VertexBuffer.StartAddress;
+        const UINT16* pIndices16 = (const UINT16*)triangles.IndexBuffer;
+        const UINT32* pIndices32 = (const UINT32*)triangles.IndexBuffer;
+
+        for (UINT k = 0; k < 3; ++k)
+        {
+            UINT vertexIndex;
+            switch (triangles.IndexFormat)
+            {
+            case DXGI_FORMAT_R16_UINT:
+                vertexIndex = pIndices16[triangleIndex * 3 + k];
+                break;
+            case DXGI_FORMAT_R32_UINT:
+                vertexIndex = pIndices32[triangleIndex * 3 + k];
+                break;
+            default:
+                vertexIndex = triangleIndex * 3 + k;
+                break;
+            }
+
+            const float* pVertex = &pVertexData[vertexIndex * vertexStrideDwords];
+            pVertices[k * 3 + 0] = pVertex[0];
+            pVertices[k * 3 + 1] = pVertex[1];
+            pVertices[k * 3 + 2] = pVertex[2];
+        }
+
+        const float* v0 = pVertices;
+        const float* v1 = pVertices + 3;
+        const float* v2 = pVertices + 6;
+        for (UINT k = 0; k < 3; ++k)
+        {
+#define AABB_Min_Padding 0.001f
+            box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
+            box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
+
+            if (_isnan(box.minArr[k]) ||
+                _isnan(box.maxArr[k]))
+            {
+                box.minArr[k] = 0;
+                box.maxArr[k] = 0;
+            }
+        }
+    }
+
+    static
+        void CopyTriangles(
+            CpuTaskPool& pool,
+            BVH& bvh,
+            const std::vector<float>& triangleVertices,
+            const std::vector<PrimitiveMetaData>& primitiveMetaData,
+            const std::vector<UINT32>& primitiveOrder)
+    {
+        using namespace DirectX;
+
+        const UINT numTris = (UINT)primitiveOrder.size();
+        bvh.m_triangles.resize(numTris * 3 * 3);
+        bvh.m_metadata.resize(numTris);
+
+        pool.ParallelFor(numTris, TrianglesPerLoadChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                UINT inputIndex = primitiveOrder[i];
+                const float *pInputTriangle = &triangleVertices.data()[inputIndex * 9];
+                float* pOutputTriangle = &bvh.m_triangles[i * 9];
+
+                // Construct three planes and write to pPlanes
+                XMVECTOR V0 = XMVectorSet(pInputTriangle[0], pInputTriangle[1], pInputTriangle[2], 0.0f);
+                XMVECTOR V1 = XMVectorSet(pInputTriangle[3], pInputTriangle[4], pInputTriangle[5], 0.0f);
+                XMVECTOR V2 = XMVectorSet(pInputTriangle[6], pInputTriangle[7], pInputTriangle[8], 0.0f);
+
+                XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 0, V0);
+                XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 1, V1);
+                XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 2, V2);
+
+                bvh.m_metadata[i] = primitiveMetaData[inputIndex];
+            }
+        });
+    }
+
+    //
+    // Spatial split BVH (Stich et al. 2009, "Spatial Splits in Bounding Volume Hierarchies")
+    // used for PREFER_FAST_TRACE builds. Nodes work on lists of references, a primitive
+    // and the part of its box the reference covers. Besides binned object splits, nodes
+    // whose object split children overlap also try splitting space: triangles are clipped
+    // against the bin planes, and references straddling the chosen plane end up on both
+    // sides unless moving them whole to one side is cheaper.
+    //
+    // Each subtree gets a share of the duplication budget proportional to its reference
+    // count. That keeps the output independent of scheduling and the reference count
+    // within what GetCpuBvh2ResultDataMaxSizeInBytes allows. Leaves are made once the
+    // SAH prefers a leaf of at most maxTrisInLeaf triangles to splitting.
+    //
+
+    static const float CostOfRayBoxIntersection = 1.0f;
+    static const float CostOfRayTriangleIntersection = 1.0f;
+
+    static const UINT NUM_SPATIAL_BINS = 32;
+
+    // Spatial splits are only tried when the best object split's children overlap by more
+    // than this fraction of the root's surface area. The paper's 1e-5 let the small overlaps
+    // deep in finely tessellated meshes spend the budget on single triangle leaves for a worse
+    // SAH cost.
+    static const float SpatialSplitOverlapThreshold = 1e-3f;
+
+    struct SpatialSplitReference
+    {
+        AABB    box;
+        UINT32  primitiveIndex;
+    };
+
+    struct SpatialBin
+    {
+        AABB    box;
+        UINT32  numEntering;
+        UINT32  numExiting;
+    };
+
+    struct SpatialBins
+    {
+        SpatialBin  bins[3][NUM_SPATIAL_BINS];
+    };
+
+    struct SpatialSplitCandidate
+    {
+        UINT32  axis;
+        UINT32  bin;
+        UINT32  numLeft;
+        UINT32  numRight;
+        float   cost;
+        AABB    leftBox;
+        AABB    rightBox;
+    };
+
+    struct SpatialSplitContext
+    {
+        const float*        pTriangleVertices;
+        const BYTE*         pDuplicationAllowed;
+        float               rootArea;
+        UINT32              maxTrisInLeaf;
+        AABBNode*           pNodes;
+        std::atomic<UINT32> nodeCount;
+        UINT32*             pReferences;
+        std::atomic<UINT32> referenceCount;
+    };
+
+    struct SpatialSplitTask
+    {
+        SpatialSplitContext*                pContext;
+        std::vector<SpatialSplitReference>  references;
+        AABB                                box;
+        UINT32                              nodeIndex;
+        UINT32                              duplicationBudget;
+    };
+
+    // Most leaf references a build may produce, every triangle once plus the spatial split budget
+    static
+        UINT GetMaxReferenceCount(
+            UINT numTriangles,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags,
+            const CpuBvh2BuildSettings& settings)
+    {
+        if (flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE)
+        {
+            return numTriangles + (UINT)(numTriangles * (double)settings.SpatialSplitBudget);
+        }
+        return numTriangles;
+    }
+
+    //
+    // SAH cost of a split. References also pay their share of the box test of the leaf
+    // they end up in, which is the same for every object split of a node but keeps
+    // duplicates from looking free when leaves are small.
+    //
+
+    static
+        float ComputeSplitCost(
+            const AABB& leftBox,
+            UINT32 numLeft,
+            const AABB& rightBox,
+            UINT32 numRight,
+            UINT32 maxTrisInLeaf)
+    {
+        const float referenceCost = CostOfRayTriangleIntersection + CostOfRayBoxIntersection / maxTrisInLeaf;
+        return ComputeBoxSurfaceArea(leftBox) * (CostOfRayBoxIntersection + numLeft * referenceCost) +
+            ComputeBoxSurfaceArea(rightBox) * (CostOfRayBoxIntersection + numRight * referenceCost);
+    }
+
+    static
+        void AddPointToBox(
+            AABB& box,
+            const float* pPoint)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            box.minArr[i] = std::min(box.minArr[i], pPoint[i]);
+            box.maxArr[i] = std::max(box.maxArr[i], pPoint[i]);
+        }
+    }
+
+    static
+        bool IsBoxEmpty(
+            const AABB& box)
+    {
+        return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+    }
+
+    static
+        AABB ComputeReferencesBox(
+            const SpatialSplitReference* pReferences,
+            size_t count)
+    {
+        AABB box;
+        InitBoxToInverseMax(box);
+        for (size_t i = 0; i < count; ++i)
+        {
+            AddExtentToBox(box, pReferences[i].box);
+        }
+        return box;
+    }
+
+    //
+    // Splits a reference at position on axis into the parts of its triangle on either side.
+    // Both parts are padded like triangle boxes and clamped to the reference's box and the
+    // plane, a part that is empty comes back as an inverted box.
+    //
+
+    static
+        void SplitReference(
+            const SpatialSplitContext& context,
+            const SpatialSplitReference& reference,
+            UINT axis,
+            float position,
+            SpatialSplitReference& left,
+            SpatialSplitReference& right)
+    {
+        AABB leftBox, rightBox;
+        InitBoxToInverseMax(leftBox);
+        InitBoxToInverseMax(rightBox);
+
+        const float* pVertices = &context.pTriangleVertices[reference.primitiveIndex * 9];
+        for (UINT i = 0; i < 3; ++i)
+        {
+            const float* v0 = &pVertices[i * 3];
+            const float* v1 = &pVertices[(i + 1) % 3 * 3];
+            if (v0[axis] <= position)
+            {
+                AddPointToBox(leftBox, v0);
+            }
+            if (v0[axis] >= position)
+            {
+                AddPointToBox(rightBox, v0);
+            }
+
+            // Edges crossing the plane add their intersection with it to both sides
+            if ((v0[axis] < position && v1[axis] > position) || (v0[axis] > position && v1[axis] < position))
+            {
+                const float t = (position - v0[axis]) / (v1[axis] - v0[axis]);
+                float point[3];
+                for (UINT k = 0; k < 3; ++k)
+                {
+                    point[k] = v0[k] + (v1[k] - v0[k]) * t;
+                }
+                point[axis] = position;
+                AddPointToBox(leftBox, point);
+                AddPointToBox(rightBox, point);
+            }
+        }
+
+        for (AABB* pBox : { &leftBox, &rightBox })
+        {
+            for (UINT k = 0; k < 3; ++k)
+            {
+                if (k != axis)
+                {
+                    pBox->minArr[k] -= AABB_Min_Padding;
+                    pBox->maxArr[k] += AABB_Min_Padding;
+                }
+            }
+        }
+        leftBox.maxArr[axis] = position;
+        rightBox.minArr[axis] = position;
+
+        for (UINT k = 0; k < 3; ++k)
+        {
+            leftBox.minArr[k] = std::max(leftBox.minArr[k], reference.box.minArr[k]);
+            leftBox.maxArr[k] = std::min(leftBox.maxArr[k], reference.box.maxArr[k]);
+            rightBox.minArr[k] = std::max(rightBox.minArr[k], reference.box.minArr[k]);
+            rightBox.maxArr[k] = std::min(rightBox.maxArr[k], reference.box.maxArr[k]);
+        }
+
+        left.box = leftBox;
+        left.primitiveIndex = reference.primitiveIndex;
+        right.box = rightBox;
+        right.primitiveIndex = reference.primitiveIndex;
+    }
+
+    static
+        UINT ComputeSpatialBinIndex(
+            float position,
+            float rangeMin,
+            float inverseExtents)
+    {
+        const float bin = NUM_SPATIAL_BINS * ((position - rangeMin) * inverseExtents);
+        return bin > 0.0f ? std::min(NUM_SPATIAL_BINS - 1, UINT(bin)) : 0;
+    }
+
+    // Position of the plane between bins - 1 and bin
+    static
+        float GetSpatialBinPlane(
+            const BinningParameters& params,
+            UINT axis,
+            UINT bin)
+    {
+        return params.rangeMin[axis] + bin / (NUM_SPATIAL_BINS * params.inverseExtents[axis]);
+    }
+
+    static
+        void InitSpatialBins(
+            SpatialBins& bins)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            for (UINT j = 0; j < NUM_SPATIAL_BINS; ++j)
+            {
+                bins.bins[i][j].numEntering = 0;
+                bins.bins[i][j].numExiting = 0;
+                InitBoxToInverseMax(bins.bins[i][j].box);
+            }
+        }
+    }
+
+    static
+        void MergeSpatialBins(
+            SpatialBins& bins,
+            const SpatialBins& otherBins)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            for (UINT j = 0; j < NUM_SPATIAL_BINS; ++j)
+            {
+                bins.bins[i][j].numEntering += otherBins.bins[i][j].numEntering;
+                bins.bins[i][j].numExiting += otherBins.bins[i][j].numExiting;
+                AddExtentToBox(bins.bins[i][j].box, otherBins.bins[i][j].box);
+            }
+        }
+    }
+
+    //
+    // References enter the bin of their box's minimum and exit the one of its maximum, the
+    // bins in between get the clipped parts. References that can't be duplicated are binned
+    // whole by their centroid, which is also the side they are later moved to.
+    //
+
+    static
+        void BinReferencesSpatially(
+            SpatialBins& bins,
+            const SpatialSplitContext& context,
+            const BinningParameters& params,
+            const SpatialSplitReference* pReferences,
+            UINT count)
+    {
+        for (UINT k = 0; k < count; ++k)
+        {
+            const SpatialSplitReference& reference = pReferences[k];
+            for (UINT axis = 0; axis < 3; ++axis)
+            {
+                if (!params.axisActive[axis])
+                {
+                    continue;
+                }
+
+                SpatialBin* pAxisBins = bins.bins[axis];
+                if (!context.pDuplicationAllowed[reference.primitiveIndex])
+                {
+                    const float centroid = (reference.box.minArr[axis] + reference.box.maxArr[axis]) * 0.5f;
+                    SpatialBin& bin = pAxisBins[ComputeSpatialBinIndex(centroid, params.rangeMin[axis], params.inverseExtents[axis])];
+                    bin.numEntering++;
+                    bin.numExiting++;
+                    AddExtentToBox(bin.box, reference.box);
+                    continue;
+                }
+
+                const UINT firstBin = ComputeSpatialBinIndex(reference.box.minArr[axis], params.rangeMin[axis], params.inverseExtents[axis]);
+                const UINT lastBin = ComputeSpatialBinIndex(reference.box.maxArr[axis], params.rangeMin[axis], params.inverseExtents[axis]);
+
+                SpatialSplitReference remaining = reference;
+                for (UINT bin = firstBin; bin < lastBin; ++bin)
+                {
+                    SpatialSplitReference left, right;
+                    SplitReference(context, remaining, axis, GetSpatialBinPlane(params, axis, bin + 1), left, right);
+                    AddExtentToBox(pAxisBins[bin].box, left.box);
+                    remaining = right;
+                }
+                AddExtentToBox(pAxisBins[lastBin].box, remaining.box);
+                pAxisBins[firstBin].numEntering++;
+                pAxisBins[lastBin].numExiting++;
+            }
+        }
+    }
+
+    static
+        SpatialSplitCandidate FindBestSpatialSplit(
+            const SpatialBins& bins,
+            const BinningParameters& params,
+            UINT32 count,
+            UINT32 duplicationBudget,
+            UINT32 maxTrisInLeaf)
+    {
+        SpatialSplitCandidate split = {};
+        split.cost = FLT_MAX;
+
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            if (!params.axisActive[axis])
+            {
+                continue;
+            }
+
+            const SpatialBin* pAxisBins = bins.bins[axis];
+            AABB rightBoxes[NUM_SPATIAL_BINS];
+            UINT32 rightCounts[NUM_SPATIAL_BINS];
+            rightBoxes[NUM_SPATIAL_BINS - 1] = pAxisBins[NUM_SPATIAL_BINS - 1].box;
+            rightCounts[NUM_SPATIAL_BINS - 1] = pAxisBins[NUM_SPATIAL_BINS - 1].numExiting;
+            for (UINT j = NUM_SPATIAL_BINS - 1; j-- > 0;)
+            {
+                rightBoxes[j] = rightBoxes[j + 1];
+                AddExtentToBox(rightBoxes[j], pAxisBins[j].box);
+                rightCounts[j] = rightCounts[j + 1] + pAxisBins[j].numExiting;
+            }
+
+            AABB leftBox;
+            InitBoxToInverseMax(leftBox);
+            UINT32 leftCount = 0;
+            for (UINT j = 0; j < NUM_SPATIAL_BINS - 1; ++j)
+            {
+                AddExtentToBox(leftBox, pAxisBins[j].box);
+                leftCount += pAxisBins[j].numEntering;
+
+                // Splits that duplicate more references than the budget allows would have to
+                // unsplit some of them, which the cost here wouldn't account for
+                const UINT32 rightCount = rightCounts[j + 1];
+                if (leftCount == 0 || rightCount == 0 || leftCount + rightCount - count > duplicationBudget)
+                {
+                    continue;
+                }
+
+                const float cost = ComputeSplitCost(leftBox, leftCount, rightBoxes[j + 1], rightCount, maxTrisInLeaf);
+                if (cost < split.cost)
+                {
+                    split.axis = axis;
+                    split.bin = j;
+                    split.numLeft = leftCount;
+                    split.numRight = rightCount;
+                    split.cost = cost;
+                    split.leftBox = leftBox;
+                    split.rightBox = rightBoxes[j + 1];
+                }
+            }
+        }
+        return split;
+    }
+
+    static
+        void BinReferences(
+            SahBins& bins,
+            const BinningParameters& params,
+            const SpatialSplitReference* pReferences,
+            UINT count)
+    {
+        for (UINT k = 0; k < count; ++k)
+        {
+            const AABB& box = pReferences[k].box;
+            for (UINT i = 0; i < 3; ++i)
+            {
+                if (params.axisActive[i])
+                {
+                    const float centroid = (box.minArr[i] + box.maxArr[i]) * 0.5f;
+                    SahBin& bin = bins.bins[i][ComputeBinIndex(centroid, params.rangeMin[i], params.inverseExtents[i])];
+                    bin.numTriangles++;
+                    AddExtentToBox(bin.box, box);
+                }
+            }
+        }
+    }
+
+    // Bins across workers for nodes large enough, chunks are merged in order
+    template <typename Bins, typename BinChunk>
+    static
+        void BinInParallel(
+            CpuTaskPool& pool,
+            UINT workerIndex,
+            UINT count,
+            Bins& bins,
+            void (*initBins)(Bins&),
+            void (*mergeBins)(Bins&, const Bins&),
+            const BinChunk& binChunk)
+    {
+        initBins(bins);
+        if (count < ParallelBinningThreshold)
+        {
+            binChunk(bins, 0, count);
+            return;
+        }
+
+        std::vector<Bins> chunkBins(DivideAndRoundUp(count, BinningGrainSize));
+        pool.ParallelFor(workerIndex, count, BinningGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            Bins& localBins = chunkBins[begin / BinningGrainSize];
+            initBins(localBins);
+            binChunk(localBins, begin, end);
+        });
+
+        for (auto& localBins : chunkBins)
+        {
+            mergeBins(bins, localBins);
+        }
+    }
+
+    //
+    // Splits the task's references between left and right, numDuplicates is set to how
+    // many straddling references ended up on both sides. Returns false when a leaf is
+    // cheaper than any split.
+    //
+
+    static
+        bool SplitReferences(
+            CpuTaskPool& pool,
+            UINT workerIndex,
+            SpatialSplitTask& task,
+            std::vector<SpatialSplitReference>& left,
+            std::vector<SpatialSplitReference>& right,
+            UINT32& numDuplicates)
+    {
+        const SpatialSplitContext& context = *task.pContext;
+        std::vector<SpatialSplitReference>& references = task.references;
+        const UINT32 count = (UINT32)references.size();
+        numDuplicates = 0;
+        if (count == 1)
+        {
+            return false;
+        }
+
+        //
+        // Object split, binned by centroid like the binned builder
+        //
+
+        AABB centroidBox;
+        InitBoxToInverseMax(centroidBox);
+        for (const SpatialSplitReference& reference : references)
+        {
+            float centroid[3];
+            for (UINT i = 0; i < 3; ++i)
+            {
+                centroid[i] = (reference.box.minArr[i] + reference.box.maxArr[i]) * 0.5f;
+            }
+            AddPointToBox(centroidBox, centroid);
+        }
+
+        BinningParameters objectParams;
+        for (UINT i = 0; i < 3; ++i)
+        {
+            const float extents = centroidBox.maxArr[i] - centroidBox.minArr[i];
+            objectParams.axisActive[i] = extents > 0.0f;
+            objectParams.rangeMin[i] = centroidBox.minArr[i];
+            objectParams.inverseExtents[i] = objectParams.axisActive[i] ? 1.f / extents : 0.0f;
+        }
+
+        SahBins objectBins;
+        BinInParallel(pool, workerIndex, count, objectBins, InitBins, MergeBins, [&](SahBins& bins, UINT begin, UINT end)
+        {
+            BinReferences(bins, objectParams, references.data() + begin, end - begin);
+        });
+
+        SahSplitCandidate objectSplit = {};
+        float objectCost = FLT_MAX;
+        if (objectParams.axisActive[0] || objectParams.axisActive[1] || objectParams.axisActive[2])
+        {
+            objectSplit = FindBestSplit(objectBins, objectParams, task.box, count);
+            if (objectSplit.numTrisInLeftNode != 0 && objectSplit.numTrisInLeftNode != count)
+            {
+                objectCost = ComputeSplitCost(
+                    objectSplit.leftBox, objectSplit.numTrisInLeftNode,
+                    objectSplit.rightBox, count - objectSplit.numTrisInLeftNode,
+                    context.maxTrisInLeaf);
+            }
+        }
+
+        //
+        // Spatial split, only worth it where the object split's children overlap
+        //
+
+        SpatialSplitCandidate spatialSplit = {};
+        spatialSplit.cost = FLT_MAX;
+        BinningParameters spatialParams;
+        if (task.duplicationBudget > 0 && objectCost != FLT_MAX)
+        {
+            AABB overlap;
+            for (UINT i = 0; i < 3; ++i)
+            {
+                overlap.minArr[i] = std::max(objectSplit.leftBox.minArr[i], objectSplit.rightBox.minArr[i]);
+                overlap.maxArr[i] = std::min(objectSplit.leftBox.maxArr[i], objectSplit.rightBox.maxArr[i]);
+            }
+
+            if (!IsBoxEmpty(overlap) && ComputeBoxSurfaceArea(overlap) > SpatialSplitOverlapThreshold * context.rootArea)
+            {
+                for (UINT i = 0; i < 3; ++i)
+                {
+                    const float extents = task.box.maxArr[i] - task.box.minArr[i];
+                    spatialParams.axisActive[i] = extents > 0.0f;
+                    spatialParams.rangeMin[i] = task.box.minArr[i];
+                    spatialParams.inverseExtents[i] = spatialParams.axisActive[i] ? 1.f / extents : 0.0f;
+                }
+
+                SpatialBins spatialBins;
+                BinInParallel(pool, workerIndex, count, spatialBins, InitSpatialBins, MergeSpatialBins, [&](SpatialBins& bins, UINT begin, UINT end)
+                {
+                    BinReferencesSpatially(bins, context, spatialParams, references.data() + begin, end - begin);
+                });
+                spatialSplit = FindBestSpatialSplit(spatialBins, spatialParams, count, task.duplicationBudget, context.maxTrisInLeaf);
+            }
+        }
+
+        //
+        // Leaf if that's cheaper than the best split
+        //
+
+        const float splitCost = std::min(objectCost, spatialSplit.cost);
+        if (count <= context.maxTrisInLeaf &&
+            (count == 1 || ComputeBoxSurfaceArea(task.box) * count * CostOfRayTriangleIntersection <= splitCost))
+        {
+            return false;
+        }
+
+        left.clear();
+        right.clear();
+        if (spatialSplit.cost < objectCost)
+        {
+            const UINT axis = spatialSplit.axis;
+            const float position = GetSpatialBinPlane(spatialParams, axis, spatialSplit.bin + 1);
+
+            // Straddling references are unsplit when moving them whole to one side is
+            // cheaper, the boxes and counts of the sides are updated as they go
+            AABB leftBox = spatialSplit.leftBox;
+            AABB rightBox = spatialSplit.rightBox;
+            UINT32 numLeft = spatialSplit.numLeft;
+            UINT32 numRight = spatialSplit.numRight;
+            for (const SpatialSplitReference& reference : references)
+            {
+                const UINT firstBin = ComputeSpatialBinIndex(reference.box.minArr[axis], spatialParams.rangeMin[axis], spatialParams.inverseExtents[axis]);
+                const UINT lastBin = ComputeSpatialBinIndex(reference.box.maxArr[axis], spatialParams.rangeMin[axis], spatialParams.inverseExtents[axis]);
+                if (!context.pDuplicationAllowed[reference.primitiveIndex])
+                {
+                    const float centroid = (reference.box.minArr[axis] + reference.box.maxArr[axis]) * 0.5f;
+                    const bool goesLeft = ComputeSpatialBinIndex(centroid, spatialParams.rangeMin[axis], spatialParams.inverseExtents[axis]) <= spatialSplit.bin;
+                    (goesLeft ? left : right).push_back(reference);
+                    continue;
+                }
+                if (lastBin <= spatialSplit.bin)
+                {
+                    left.push_back(reference);
+                    continue;
+                }
+                if (firstBin > spatialSplit.bin)
+                {
+                    right.push_back(reference);
+                    continue;
+                }
+
+                SpatialSplitReference leftPart, rightPart;
+                SplitReference(context, reference, axis, position, leftPart, rightPart);
+
+                AABB unsplitLeftBox = leftBox;
+                AddExtentToBox(unsplitLeftBox, reference.box);
+                AABB unsplitRightBox = rightBox;
+                AddExtentToBox(unsplitRightBox, reference.box);
+
+                const float duplicateCost = ComputeSplitCost(leftBox, numLeft, rightBox, numRight, context.maxTrisInLeaf);
+                const float leftCost = IsBoxEmpty(leftPart.box) ? FLT_MAX : ComputeSplitCost(unsplitLeftBox, numLeft, rightBox, numRight - 1, context.maxTrisInLeaf);
+                const float rightCost = IsBoxEmpty(rightPart.box) ? FLT_MAX : ComputeSplitCost(leftBox, numLeft - 1, unsplitRightBox, numRight, context.maxTrisInLeaf);
+                const bool canDuplicate = numDuplicates < task.duplicationBudget && !IsBoxEmpty(leftPart.box) && !IsBoxEmpty(rightPart.box);
+
+                if (canDuplicate && duplicateCost < leftCost && duplicateCost < rightCost)
+                {
+                    left.push_back(leftPart);
+                    right.push_back(rightPart);
+                    numDuplicates++;
+                }
+                else if (leftCost <= rightCost)
+                {
+                    left.push_back(reference);
+                    leftBox = unsplitLeftBox;
+                    numRight--;
+                }
+                else
+                {
+                    right.push_back(reference);
+                    rightBox = unsplitRightBox;
+                    numLeft--;
+                }
+            }
+        }
+        else if (objectCost != FLT_MAX)
+        {
+            const UINT axis = objectSplit.axis;
+            for (const SpatialSplitReference& reference : references)
+            {
+                const float centroid = (reference.box.minArr[axis] + reference.box.maxArr[axis]) * 0.5f;
+                const bool goesLeft = ComputeBinIndex(centroid, objectParams.rangeMin[axis], objectParams.inverseExtents[axis]) <= objectSplit.bin;
+                (goesLeft ? left : right).push_back(reference);
+            }
+        }
+
+        if (left.empty() || right.empty())
+        {
+            //
+            // No split separated anything, so fall back to the median on the widest
+            // axis. References in one node are of different primitives, so ties
+            // broken by primitive index keep this deterministic.
+            //
+            UINT axis = 0;
+            for (UINT i = 1; i < 3; ++i)
+            {
+                if (centroidBox.maxArr[i] - centroidBox.minArr[i] > centroidBox.maxArr[axis] - centroidBox.minArr[axis])
+                {
+                    axis = i;
+                }
+            }
+
+            auto centroidLess = [axis](const SpatialSplitReference& a, const SpatialSplitReference& b)
+            {
+                const float centroidA = a.box.minArr[axis] + a.box.maxArr[axis];
+                const float centroidB = b.box.minArr[axis] + b.box.maxArr[axis];
+                return centroidA < centroidB || (centroidA == centroidB && a.primitiveIndex < b.primitiveIndex);
+            };
+            std::nth_element(references.begin(), references.begin() + count / 2, references.end(), centroidLess);
+            left.assign(references.begin(), references.begin() + count / 2);
+            right.assign(references.begin() + count / 2, references.end());
+            numDuplicates = 0;
+        }
+        return true;
+    }
+
+    static
+        void BuildSpatialSplitSubtree(
+            CpuTaskPool& pool,
+            UINT workerIndex,
+            SpatialSplitTask& root)
+    {
+        SpatialSplitContext& context = *root.pContext;
+
+        // Small subtrees are finished on this worker without going through the pool
+        std::vector<SpatialSplitTask> pendingTasks;
+        pendingTasks.push_back(std::move(root));
+
+        while (!pendingTasks.empty())
+        {
+            SpatialSplitTask task = std::move(pendingTasks.back());
+            pendingTasks.pop_back();
+
+            for (;;)
+            {
+                AABBNode& node = context.pNodes[task.nodeIndex];
+                std::vector<SpatialSplitReference> leftReferences, rightReferences;
+                UINT32 numDuplicates;
+                if (!SplitReferences(pool, workerIndex, task, leftReferences, rightReferences, numDuplicates))
+                {
+                    const UINT32 count = (UINT32)task.references.size();
+                    const UINT32 firstReference = context.referenceCount.fetch_add(count);
+                    for (UINT32 i = 0; i < count; ++i)
+                    {
+                        context.pReferences[firstReference + i] = task.references[i].primitiveIndex;
+                    }
+                    InitializeLeafNode(node, task.box, firstReference, count);
+                    break;
+                }
+                task.references = std::vector<SpatialSplitReference>();
+
+                const UINT32 leftNodeIndex = context.nodeCount.fetch_add(2);
+                const UINT32 rightNodeIndex = leftNodeIndex + 1;
+                InitializeInternalNode(node, task.box, leftNodeIndex, rightNodeIndex);
+
+                // What's left of the budget is shared in proportion to the references
+                const UINT32 numLeft = (UINT32)leftReferences.size();
+                const UINT32 numRight = (UINT32)rightReferences.size();
+                const UINT32 remainingBudget = task.duplicationBudget - numDuplicates;
+                const UINT32 leftBudget = (UINT32)((UINT64)remainingBudget * numLeft / (numLeft + numRight));
+
+                SpatialSplitTask leftTask;
+                leftTask.pContext = &context;
+                leftTask.box = ComputeReferencesBox(leftReferences.data(), numLeft);
+                leftTask.references = std::move(leftReferences);
+                leftTask.nodeIndex = leftNodeIndex;
+                leftTask.duplicationBudget = leftBudget;
+                if (numLeft >= MinPrimitivesPerTask)
+                {
+                    pool.Spawn(workerIndex, [](CpuTaskPool& taskPool, UINT taskWorkerIndex, void* pTask)
+                    {
+                        std::unique_ptr<SpatialSplitTask> pSpawnedTask((SpatialSplitTask*)pTask);
+                        BuildSpatialSplitSubtree(taskPool, taskWorkerIndex, *pSpawnedTask);
+                    }, new SpatialSplitTask(std::move(leftTask)));
+                }
+                else
+                {
+                    pendingTasks.push_back(std::move(leftTask));
+                }
+
+                // Keep going down the right side on this worker
+                task.box = ComputeReferencesBox(rightReferences.data(), numRight);
+                task.references = std::move(rightReferences);
+                task.nodeIndex = rightNodeIndex;
+                task.duplicationBudget = remainingBudget - leftBudget;
+            }
+        }
+    }
+
+    //
+    // Same output as BuildBVH, except that m_primitiveOrder can list a primitive more than
+    // once. duplicationAllowed is 0 for primitives that must only be referenced once.
+    //
+
+    static
+        void BuildSpatialSplitBVH(
+            BVH& bvh,
+            CpuTaskPool& pool,
+            const std::vector<AABB>& boxes,
+            const std::vector<float>& triangleVertices,
+            const std::vector<BYTE>& duplicationAllowed,
+            UINT32 maxReferences,
+            UINT32 maxTrisInLeaf,
+            bool deterministic)
+    {
+        const UINT32 numPrimitives = (UINT32)boxes.size();
+        if (numPrimitives == 0)
+        {
+            BuildBVH(bvh, pool, boxes, maxTrisInLeaf, deterministic);
+            return;
+        }
+        assert(maxReferences >= numPrimitives);
+
+        // A binary tree with at least one reference per leaf never needs more than this
+        const UINT32 maxNodes = 2 * maxReferences - 1;
+        std::vector<AABBNode> nodePool(maxNodes);
+        std::vector<UINT32> references(maxReferences);
+
+        SpatialSplitContext context;
+        context.pTriangleVertices = triangleVertices.data();
+        context.pDuplicationAllowed = duplicationAllowed.data();
+        context.maxTrisInLeaf = maxTrisInLeaf;
+        context.pNodes = nodePool.data();
+        context.nodeCount = 1;
+        context.pReferences = references.data();
+        context.referenceCount = 0;
+
+        SpatialSplitTask rootTask;
+        rootTask.pContext = &context;
+        rootTask.references.resize(numPrimitives);
+        pool.ParallelFor(numPrimitives, BinningGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                rootTask.references[i].box = boxes[i];
+                rootTask.references[i].primitiveIndex = i;
+            }
+        });
+        rootTask.box = ComputeReferencesBox(rootTask.references.data(), numPrimitives);
+        rootTask.nodeIndex = 0;
+        rootTask.duplicationBudget = maxReferences - numPrimitives;
+        context.rootArea = ComputeBoxSurfaceArea(rootTask.box);
+
+        pool.Run([](CpuTaskPool& taskPool, UINT workerIndex, void* pTask)
+        {
+            BuildSpatialSplitSubtree(taskPool, workerIndex, *(SpatialSplitTask*)pTask);
+        }, &rootTask);
+
+        const UINT32 numNodes = context.nodeCount;
+        references.resize(context.referenceCount);
+        if (deterministic)
+        {
+            FlattenBVH(bvh, nodePool, references, numNodes);
+        }
+        else
+        {
+            nodePool.resize(numNodes);
+            bvh.m_nodes = std::move(nodePool);
+            bvh.m_primitiveOrder = std::move(references);
+        }
+    }
+
+    static
+        void ValidateBuildSettings(
+            const CpuBvh2BuildSettings& settings)
+    {
+        if (settings.MaxTrianglesInLeaf == 0 || settings.MaxTrianglesInLeaf > CompressedLeafPrimitiveCountMask)
+        {
+            ThrowFailure(E_INVALIDARG, L"CpuBvh2BuildSettings::MaxTrianglesInLeaf has to be between 1 and 31");
+        }
+        if (settings.MaxTrianglesInLeaf > MAX_TRIS_IN_LEAF && !settings.CpuTraversalOnly)
+        {
+            ThrowFailure(E_INVALIDARG, L"CpuBvh2BuildSettings::MaxTrianglesInLeaf above MAX_TRIS_IN_LEAF needs CpuTraversalOnly, the traversal shaders only test the first triangle of a leaf");
+        }
+        if (!(settings.SpatialSplitBudget >= 0.0f))
+        {
+            ThrowFailure(E_INVALIDARG, L"CpuBvh2BuildSettings::SpatialSplitBudget can't be negative");
+        }
+        if (!(settings.UpdateFullRebuildFraction >= 0.0f))
+        {
+            ThrowFailure(E_INVALIDARG, L"CpuBvh2BuildSettings::UpdateFullRebuildFraction can't be negative");
+        }
+    }
+
+    void BuildUniformBVH(
+        _In_  UINT NumElements,
+        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
+        _In_  D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS Flags,
+        _In_  const CpuBvh2BuildSettings &settings,
+        BVH &bvh)
+    {
+        ValidateBuildSettings(settings);
+
+        CpuTaskPool &pool = CpuTaskPool::GetShared(settings.ThreadCount);
+        const bool spatialSplits = (Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE) != 0;
+
+        //
         // Compute number of triangles
         //
 
@@ -554,6 +1830,13 @@ namespace FallbackLayer
         std::vector<float>  triangleVertices;
         triangleVertices.resize(totalNumberOfTriangles * 9);
 
+        // Any-hit shaders may only run once per primitive on geometry that asks for it
+        std::vector<BYTE> duplicationAllowed;
+        if (spatialSplits)
+        {
+            duplicationAllowed.resize(totalNumberOfTriangles);
+        }
+
         UINT triangleIndex = 0;
         for (UINT i = 0; i < NumElements; ++i)
         {
@@ -563,136 +1846,734 @@ namespace FallbackLayer
                 throw - 1; // Intersection shaders not supported yet
             }
 
-            auto &triangles = geometry.Triangles;
-            if (GetPrimitiveCountFromGeometryDesc(geometry) == 0)
-
+            const UINT numTris = GetPrimitiveCountFromGeometryDesc(geometry);
+            if (numTris == 0)
             {
                 continue;
             }
 
-            // 
-            const UINT64 vertexStrideDwords = triangles.VertexBuffer.StrideInBytes / 4;
-            const UINT numTris = GetPrimitiveCountFromGeometryDesc(geometry);
+            // Triangles of one geometry occupy a contiguous range starting at firstTriangle
+            const UINT firstTriangle = triangleIndex;
+            pool.ParallelFor(numTris, TrianglesPerLoadChunk, [&](UINT begin, UINT end, UINT)
+            {
+                for (UINT j = begin; j < end; ++j)
+                {
+                    const UINT globalTriangleIndex = firstTriangle + j;
+                    LoadTriangle(geometry.Triangles, j, &triangleVertices[globalTriangleIndex * 9], boxes[globalTriangleIndex]);
+
+                    // Like PrimitiveIndex(), the index is relative to the geometry. Updates
+                    // also rely on it to find where the triangle's vertices are.
+                    PrimitiveMetaData metadata;
+                    metadata.GeometryContributionToHitGroupIndex = i;
+                    metadata.PrimitiveIndex = j;
+                    primitiveMetaData[globalTriangleIndex] = metadata;
+                }
+            });
 
-            float *pVertexData = (float *)geometry.Triangles.VertexBuffer.StartAddress;
-            float *pIndexData = (float *)geometry.Triangles.IndexBuffer;
+            if (spatialSplits)
+            {
+                const bool noDuplicates = (geometry.Flags & D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION) != 0;
+                std::fill(duplicationAllowed.begin() + firstTriangle, duplicationAllowed.begin() + firstTriangle + numTris, noDuplicates ? 0 : 1);
+            }
 
-            const float* pVertices = (float*)(pVertexData);
-            const UINT16* pIndices = (UINT16*)(pIndexData);
+            // Next geometry
+            triangleIndex += numTris;
+        }
 
-            for (UINT j = 0; j < numTris; ++j)
-            {
-                const UINT16 i0 = pIndices[j * 3 + 0];
-                const UINT16 i1 = pIndices[j * 3 + 1];
-                const UINT16 i2 = pIndices[j * 3 + 2];
+        //
+        // Create a BVH
+        //
 
-                const float* v0 = &pVertices[i0 * vertexStrideDwords];
-                const float* v1 = &pVertices[i1 * vertexStrideDwords];
-                const float* v2 = &pVertices[i2 * vertexStrideDwords];
+        if (spatialSplits)
+        {
+            BuildSpatialSplitBVH(
+                bvh,
+                pool,
+                boxes,
+                triangleVertices,
+                duplicationAllowed,
+                GetMaxReferenceCount(totalNumberOfTriangles, Flags, settings),
+                settings.MaxTrianglesInLeaf,
+                settings.Deterministic);
+        }
+        else
+        {
+            BuildBVH(bvh, pool, boxes, MAX_TRIS_IN_LEAF, settings.Deterministic);
+        }
 
-                float* pTriVerts = &triangleVertices[triangleIndex * 9];
+        //
+        // Now copy geometry and metadata in the order the leaves reference them
+        //
+
+        CopyTriangles(pool, bvh, triangleVertices, primitiveMetaData, bvh.m_primitiveOrder);
+    }
 
-                pTriVerts[0] = v0[0];
-                pTriVerts[1] = v0[1];
-                pTriVerts[2] = v0[2];
+    //
+    // Updates. The source's tree, primitive order and metadata are kept. Triangles are
+    // reloaded from the geometry and triangle index in their metadata, and every box is
+    // recomputed bottom-up from them: leaves are spread over the pool and walk up towards
+    // the root, the second child to finish goes on with its parent. Boxes come out bit for
+    // bit the same as a build with the same topology would give them, except that spatial
+    // split references grow back to their whole triangle.
+    //
+    // Optionally, subtrees that got a lot worse than in the source are rebuilt with the
+    // builder and settings the source was built with and spliced back in, after which the
+    // whole tree is flattened again. When that would rebuild most of the tree, it's built
+    // from scratch instead.
+    //
 
-                pTriVerts[3] = v1[0];
-                pTriVerts[4] = v1[1];
-                pTriVerts[5] = v1[2];
+    static const UINT32 NoParentIndex = 0xffffffff;
+    static const UINT RefitGrainSize = 16 * 1024;
 
-                pTriVerts[6] = v2[0];
-                pTriVerts[7] = v2[1];
-                pTriVerts[8] = v2[2];
+    // Unnormalized SAH cost of a node on its own, its children not included
+    static
+        float ComputeNodeCost(
+            const AABB& box,
+            const AABBNode& node)
+    {
+        const float primitiveCost = node.leaf ? node.numTriangles * CostOfRayTriangleIntersection : 0.0f;
+        return ComputeBoxSurfaceArea(box) * (CostOfRayBoxIntersection + primitiveCost);
+    }
 
-                AABB& box = boxes[triangleIndex];
-                for (UINT k = 0; k < 3; ++k)
+    static
+        void ComputeParentIndices(
+            CpuTaskPool& pool,
+            const std::vector<AABBNode>& nodes,
+            std::vector<UINT32>& parentIndices)
+    {
+        parentIndices.assign(nodes.size(), NoParentIndex);
+        pool.ParallelFor((UINT)nodes.size(), RefitGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                if (!nodes[i].leaf)
                 {
-#define AABB_Min_Padding 0.001f
-                    box.minArr[k] = std::min(v2[k], std::min(v0[k], v1[k]));
-                    box.maxArr[k] = std::max(v2[k], std::max(v0[k], v1[k])) + AABB_Min_Padding;
+                    parentIndices[nodes[i].internalNode.leftNodeIndex] = i;
+                    parentIndices[nodes[i].rightNodeIndex] = i;
+                }
+            }
+        });
+    }
+
+    //
+    // Calls visitLeaf(nodeIndex) for every leaf, then visitInternalNode(nodeIndex) for
+    // every internal node once it has been called for both of its children.
+    //
+
+    template <typename VisitLeaf, typename VisitInternalNode>
+    static
+        void VisitBottomUp(
+            CpuTaskPool& pool,
+            const std::vector<AABBNode>& nodes,
+            const std::vector<UINT32>& parentIndices,
+            const VisitLeaf& visitLeaf,
+            const VisitInternalNode& visitInternalNode)
+    {
+        const UINT numNodes = (UINT)nodes.size();
+        std::unique_ptr<std::atomic<UINT32>[]> pChildrenDone(new std::atomic<UINT32>[numNodes]);
+        pool.ParallelFor(numNodes, RefitGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                pChildrenDone[i].store(0, std::memory_order_relaxed);
+            }
+        });
+
+        pool.ParallelFor(numNodes, RefitGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                if (!nodes[i].leaf)
+                {
+                    continue;
+                }
+
+                visitLeaf(i);
+
+                // The release/acquire pair makes the first child's results visible to
+                // whoever finishes the second one
+                UINT32 nodeIndex = parentIndices[i];
+                while (nodeIndex != NoParentIndex &&
+                    pChildrenDone[nodeIndex].fetch_add(1, std::memory_order_acq_rel) == 1)
+                {
+                    visitInternalNode(nodeIndex);
+                    nodeIndex = parentIndices[nodeIndex];
+                }
+            }
+        });
+    }
+
+    // Unnormalized SAH cost of the subtree below every node
+    static
+        void ComputeSubtreeCosts(
+            CpuTaskPool& pool,
+            const std::vector<AABBNode>& nodes,
+            const std::vector<UINT32>& parentIndices,
+            const std::vector<AABB>& nodeBoxes,
+            std::vector<float>& subtreeCosts)
+    {
+        subtreeCosts.resize(nodes.size());
+        VisitBottomUp(pool, nodes, parentIndices,
+            [&](UINT32 nodeIndex)
+            {
+                subtreeCosts[nodeIndex] = ComputeNodeCost(nodeBoxes[nodeIndex], nodes[nodeIndex]);
+            },
+            [&](UINT32 nodeIndex)
+            {
+                const AABBNode& node = nodes[nodeIndex];
+                subtreeCosts[nodeIndex] = ComputeNodeCost(nodeBoxes[nodeIndex], node) +
+                    subtreeCosts[node.internalNode.leftNodeIndex] +
+                    subtreeCosts[node.rightNodeIndex];
+            });
+    }
 
-                    if (_isnan(box.minArr[k]) ||
-                        _isnan(box.maxArr[k]))
+    static
+        void RefitNodes(
+            CpuTaskPool& pool,
+            std::vector<AABBNode>& nodes,
+            const std::vector<UINT32>& parentIndices,
+            const std::vector<AABB>& primitiveBoxes,
+            std::vector<AABB>& nodeBoxes)
+    {
+        nodeBoxes.resize(nodes.size());
+        VisitBottomUp(pool, nodes, parentIndices,
+            [&](UINT32 nodeIndex)
+            {
+                AABBNode& node = nodes[nodeIndex];
+                AABB box = {};
+                if (node.numTriangles > 0)
+                {
+                    InitBoxToInverseMax(box);
+                    for (UINT32 i = 0; i < node.numTriangles; ++i)
                     {
-                        box.minArr[k] = 0;
-                        box.maxArr[k] = 0;
+                        AddExtentToBox(box, primitiveBoxes[node.leafNode.firstTriangleId + i]);
                     }
                 }
+                nodeBoxes[nodeIndex] = box;
+                SetNodeBox(node, box);
+            },
+            [&](UINT32 nodeIndex)
+            {
+                AABBNode& node = nodes[nodeIndex];
+                AABB box = nodeBoxes[node.internalNode.leftNodeIndex];
+                AddExtentToBox(box, nodeBoxes[node.rightNodeIndex]);
+                nodeBoxes[nodeIndex] = box;
+                SetNodeBox(node, box);
+            });
+    }
+
+    // SAH cost relative to the surface area of the subtree's root, 0 for flat boxes
+    static
+        float NormalizeSubtreeCost(
+            float subtreeCost,
+            const AABB& rootBox)
+    {
+        const float area = ComputeBoxSurfaceArea(rootBox);
+        return area > 0.0f ? subtreeCost / area : 0.0f;
+    }
+
+    // SAH cost of the whole tree, every node has to be reachable
+    static
+        float ComputeSahCost(
+            const AABBNode* pNodes,
+            UINT numNodes)
+    {
+        double cost = 0.0;
+        for (UINT i = 0; i < numNodes; ++i)
+        {
+            AABB box;
+            DecompressAABB(box, pNodes[i]);
+            cost += ComputeNodeCost(box, pNodes[i]);
+        }
+
+        AABB rootBox;
+        DecompressAABB(rootBox, pNodes[0]);
+        return NormalizeSubtreeCost((float)cost, rootBox);
+    }
+
+    // What RebuildSubtree needs to build subtrees the way the source was built, indexed
+    // by the source's primitives
+    struct SubtreeRebuildContext
+    {
+        const AABB* pPrimitiveBoxes;
+        const float* pTriangleVertices;
+
+        // Spatial splits, for PREFER_FAST_TRACE sources, are only used when set
+        const BYTE* pDuplicationAllowed;
+        UINT32 maxTrisInLeaf;
+    };
+
+    //
+    // Lists the primitives the leaves below rootIndex reference. Spatial splits can have
+    // referenced a triangle from several of them, which refitting grew back to the whole
+    // triangle, so each triangle is listed once. Returns the number of nodes and the
+    // number of references in the subtree.
+    //
+
+    static
+        UINT32 GatherSubtreePrimitives(
+            const std::vector<AABBNode>& nodePool,
+            const std::vector<UINT32>& primitiveIndices,
+            const std::vector<UINT32>& primitiveTriangles,
+            UINT32 rootIndex,
+            std::vector<UINT32>& subtreePrimitives,
+            UINT32& numReferences)
+    {
+        subtreePrimitives.clear();
+        UINT32 numNodes = 0;
+        std::vector<UINT32> stack(1, rootIndex);
+        while (!stack.empty())
+        {
+            const AABBNode& node = nodePool[stack.back()];
+            stack.pop_back();
+            numNodes++;
+
+            if (node.leaf)
+            {
+                for (UINT32 i = 0; i < node.numTriangles; ++i)
+                {
+                    subtreePrimitives.push_back(primitiveIndices[node.leafNode.firstTriangleId + i]);
+                }
+            }
+            else
+            {
+                stack.push_back(node.rightNodeIndex);
+                stack.push_back(node.internalNode.leftNodeIndex);
+            }
+        }
+        numReferences = (UINT32)subtreePrimitives.size();
+
+        std::sort(subtreePrimitives.begin(), subtreePrimitives.end(), [&](UINT32 a, UINT32 b)
+        {
+            return primitiveTriangles[a] < primitiveTriangles[b] || (primitiveTriangles[a] == primitiveTriangles[b] && a < b);
+        });
+        subtreePrimitives.erase(std::unique(subtreePrimitives.begin(), subtreePrimitives.end(), [&](UINT32 a, UINT32 b)
+        {
+            return primitiveTriangles[a] == primitiveTriangles[b];
+        }), subtreePrimitives.end());
+        return numNodes;
+    }
+
+    //
+    // Rebuilds the subtree below rootIndex from the primitives GatherSubtreePrimitives
+    // listed, with up to maxReferences references when it uses spatial splits. The new
+    // nodes are appended to the pool and take over rootIndex, their leaves reference
+    // primitiveIndices entries appended after the existing ones. Returns the change in
+    // the number of reachable nodes.
+    //
+
+    static
+        INT RebuildSubtree(
+            CpuTaskPool& pool,
+            const SubtreeRebuildContext& context,
+            std::vector<AABBNode>& nodePool,
+            std::vector<UINT32>& primitiveIndices,
+            const std::vector<UINT32>& subtreePrimitives,
+            UINT32 numOldNodes,
+            UINT32 maxReferences,
+            UINT32 rootIndex)
+    {
+        const UINT32 numSubtreePrimitives = (UINT32)subtreePrimitives.size();
+        std::vector<AABB> subtreeBoxes(numSubtreePrimitives);
+        for (UINT32 i = 0; i < numSubtreePrimitives; ++i)
+        {
+            subtreeBoxes[i] = context.pPrimitiveBoxes[subtreePrimitives[i]];
+        }
+
+        BVH subtree;
+        if (context.pDuplicationAllowed)
+        {
+            std::vector<float> subtreeVertices(numSubtreePrimitives * 9);
+            std::vector<BYTE> duplicationAllowed(numSubtreePrimitives);
+            for (UINT32 i = 0; i < numSubtreePrimitives; ++i)
+            {
+                const UINT32 primitive = subtreePrimitives[i];
+                std::copy(&context.pTriangleVertices[primitive * 9], &context.pTriangleVertices[primitive * 9 + 9], &subtreeVertices[i * 9]);
+                duplicationAllowed[i] = context.pDuplicationAllowed[primitive];
+            }
+            BuildSpatialSplitBVH(subtree, pool, subtreeBoxes, subtreeVertices, duplicationAllowed, maxReferences, context.maxTrisInLeaf, true);
+        }
+        else
+        {
+            BuildBVH(subtree, pool, subtreeBoxes, context.maxTrisInLeaf, true);
+        }
+
+        const UINT32 firstNewNode = (UINT32)nodePool.size();
+        const UINT32 firstNewPrimitive = (UINT32)primitiveIndices.size();
+        for (AABBNode node : subtree.m_nodes)
+        {
+            if (node.leaf)
+            {
+                node.leafNode.firstTriangleId += firstNewPrimitive;
+            }
+            else
+            {
+                node.internalNode.leftNodeIndex += firstNewNode;
+                node.rightNodeIndex += firstNewNode;
+            }
+            nodePool.push_back(node);
+        }
+        for (UINT32 primitive : subtree.m_primitiveOrder)
+        {
+            primitiveIndices.push_back(subtreePrimitives[primitive]);
+        }
+
+        // The appended copy of the new root is left unreachable
+        nodePool[rootIndex] = nodePool[firstNewNode];
+        return (INT)subtree.m_nodes.size() - (INT)numOldNodes;
+    }
+
+    static
+        void ReadSourceBVH(
+            CpuTaskPool& pool,
+            const BYTE* pSource,
+            std::vector<AABBNode>& nodes,
+            std::vector<PrimitiveMetaData>& metadata,
+            bool& compressed)
+    {
+        const BVHOffsets& offsets = *(const BVHOffsets*)pSource;
+        const BYTE* pBoxes = pSource + offsets.offsetToBoxes;
+        compressed = IsCompressedBVH(pBoxes);
+
+        nodes.resize(GetNodeCount(pBoxes, offsets.offsetToVertices - offsets.offsetToBoxes));
+        pool.ParallelFor((UINT)nodes.size(), RefitGrainSize, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                nodes[i] = ReadAABBNode(pBoxes, i);
+            }
+        });
+
+        const UINT numPrimitives = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+        const PrimitiveMetaData* pMetadata = (const PrimitiveMetaData*)(pSource + offsets.offsetToPrimitiveMetaData);
+        metadata.assign(pMetadata, pMetadata + numPrimitives);
+    }
+
+    static
+        double GetMillisecondsSince(
+            std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void UpdateUniformBVH(
+        _In_  UINT NumElements,
+        _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
+        _In_  D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS Flags,
+        _In_  const BYTE *pSource,
+        _In_  const CpuBvh2BuildSettings &settings,
+        BVH &bvh,
+        bool &compressed,
+        CpuBvh2UpdateStats &stats)
+    {
+        ValidateBuildSettings(settings);
 
-                // Create out internal triangle indices.
-                PrimitiveMetaData metadata;
-                metadata.GeometryContributionToHitGroupIndex = i;
-                metadata.PrimitiveIndex = triangleIndex;
-                primitiveMetaData[triangleIndex] = metadata;
+        const auto start = std::chrono::high_resolution_clock::now();
+        CpuTaskPool &pool = CpuTaskPool::GetShared(settings.ThreadCount);
+        const bool spatialSplits = (Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE) != 0;
 
-                // Next triangle
-                triangleIndex++;
+        std::vector<UINT> firstTriangles(NumElements);
+        UINT totalNumberOfTriangles = 0;
+        for (UINT i = 0; i < NumElements; ++i)
+        {
+            if (pGeometries[i].Type != D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            {
+                ThrowFailure(E_INVALIDARG, L"Only triangle geometry can be updated on the CPU");
             }
+            firstTriangles[i] = totalNumberOfTriangles;
+            totalNumberOfTriangles += GetPrimitiveCountFromGeometryDesc(pGeometries[i]);
+        }
+
+        std::vector<AABBNode> nodes;
+        std::vector<PrimitiveMetaData> metadata;
+        ReadSourceBVH(pool, pSource, nodes, metadata, compressed);
+        // Spatial splits can reference a triangle more than once
+        if (metadata.size() < totalNumberOfTriangles)
+        {
+            ThrowFailure(E_INVALIDARG, L"Updates need the same number of triangles as the source acceleration structure was built with");
         }
 
         //
-        // Create a BVH
+        // Reload the triangles, in the order of the source's primitives
         //
 
-        BuildBVH(bvh, boxes, primitiveMetaData, MAX_TRIS_IN_LEAF);
+        const UINT numPrimitives = (UINT)metadata.size();
+        std::vector<float> triangleVertices(numPrimitives * 9);
+        std::vector<AABB> primitiveBoxes(numPrimitives);
+        std::vector<UINT32> primitiveTriangles(numPrimitives);
+        std::vector<BYTE> duplicationAllowed(spatialSplits ? numPrimitives : 0);
+        std::atomic<bool> metadataMismatch(false);
+        pool.ParallelFor(numPrimitives, TrianglesPerLoadChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; ++i)
+            {
+                const UINT geometryIndex = metadata[i].GeometryContributionToHitGroupIndex;
+                if (geometryIndex >= NumElements ||
+                    metadata[i].PrimitiveIndex >= GetPrimitiveCountFromGeometryDesc(pGeometries[geometryIndex]))
+                {
+                    metadataMismatch = true;
+                    continue;
+                }
+                LoadTriangle(pGeometries[geometryIndex].Triangles, metadata[i].PrimitiveIndex, &triangleVertices[i * 9], primitiveBoxes[i]);
+                primitiveTriangles[i] = firstTriangles[geometryIndex] + metadata[i].PrimitiveIndex;
+                if (spatialSplits)
+                {
+                    const bool noDuplicates = (pGeometries[geometryIndex].Flags & D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION) != 0;
+                    duplicationAllowed[i] = noDuplicates ? 0 : 1;
+                }
+            }
+        });
+        if (metadataMismatch)
+        {
+            ThrowFailure(E_INVALIDARG, L"The geometry descs don't match the ones the source acceleration structure was built with");
+        }
 
         //
-        // Now copy and compress geometry
+        // Refit
         //
 
-        // Copy verts
-        const UINT numTris = triangleIndex;
-        bvh.m_triangles.resize(numTris * 3 * 3);
-        assert(bvh.m_triangles.size() == triangleVertices.size());
-        assert(sizeof(bvh.m_triangles[0]) == sizeof(triangleVertices[0]));
+        std::vector<UINT32> parentIndices;
+        ComputeParentIndices(pool, nodes, parentIndices);
+
+        std::vector<AABB> sourceBoxes(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            DecompressAABB(sourceBoxes[i], nodes[i]);
+        }
+        std::vector<float> sourceCosts;
+        ComputeSubtreeCosts(pool, nodes, parentIndices, sourceBoxes, sourceCosts);
+
+        std::vector<AABB> nodeBoxes;
+        std::vector<float> costs;
+        RefitNodes(pool, nodes, parentIndices, primitiveBoxes, nodeBoxes);
+        ComputeSubtreeCosts(pool, nodes, parentIndices, nodeBoxes, costs);
+
+        stats.SourceSahCost = NormalizeSubtreeCost(sourceCosts[0], sourceBoxes[0]);
+        stats.SahCost = NormalizeSubtreeCost(costs[0], nodeBoxes[0]);
+        stats.RebuiltSubtrees = 0;
+        stats.RebuiltPrimitives = 0;
+        stats.Refit = GetMillisecondsSince(start);
 
-        for (UINT i = 0; i < numTris; ++i)
+        //
+        // Rebuild the topmost subtrees that got worse than the threshold allows
+        //
+
+        const auto rebuildStart = std::chrono::high_resolution_clock::now();
+        std::vector<UINT32> rebuildRoots;
+        if (settings.UpdateRebuildThreshold > 0.0f)
+        {
+            std::vector<UINT32> stack(1, 0);
+            while (!stack.empty())
+            {
+                const UINT32 nodeIndex = stack.back();
+                stack.pop_back();
+
+                const AABBNode& node = nodes[nodeIndex];
+                if (node.leaf)
+                {
+                    continue;
+                }
+
+                const float sourceCost = NormalizeSubtreeCost(sourceCosts[nodeIndex], sourceBoxes[nodeIndex]);
+                const float cost = NormalizeSubtreeCost(costs[nodeIndex], nodeBoxes[nodeIndex]);
+                if (cost > sourceCost * settings.UpdateRebuildThreshold)
+                {
+                    rebuildRoots.push_back(nodeIndex);
+                }
+                else
+                {
+                    stack.push_back(node.rightNodeIndex);
+                    stack.push_back(node.internalNode.leftNodeIndex);
+                }
+            }
+        }
+
+        std::vector<UINT32> primitiveOrder(numPrimitives);
+        for (UINT32 i = 0; i < numPrimitives; ++i)
+        {
+            primitiveOrder[i] = i;
+        }
+
+        // The subtrees don't overlap, so they can all be gathered before any is spliced in
+        std::vector<std::vector<UINT32>> subtreePrimitives(rebuildRoots.size());
+        std::vector<UINT32> subtreeNodeCounts(rebuildRoots.size());
+        std::vector<UINT32> subtreeReferenceCounts(rebuildRoots.size());
+        UINT64 numRebuiltReferences = 0;
+        for (size_t i = 0; i < rebuildRoots.size(); ++i)
+        {
+            subtreeNodeCounts[i] = GatherSubtreePrimitives(nodes, primitiveOrder, primitiveTriangles, rebuildRoots[i], subtreePrimitives[i], subtreeReferenceCounts[i]);
+            numRebuiltReferences += subtreeReferenceCounts[i];
+        }
+
+        if (rebuildRoots.empty())
+        {
+            bvh.m_nodes = std::move(nodes);
+            stats.Rebuild = 0.0;
+        }
+        else if (numRebuiltReferences > settings.UpdateFullRebuildFraction * numPrimitives)
+        {
+            BuildUniformBVH(NumElements, pGeometries, Flags, settings, bvh);
+            stats.SahCost = ComputeSahCost(bvh.m_nodes.data(), (UINT)bvh.m_nodes.size());
+            stats.RebuiltSubtrees = 1;
+            stats.RebuiltPrimitives = (UINT)bvh.m_primitiveOrder.size();
+            stats.Rebuild = GetMillisecondsSince(rebuildStart);
+            stats.Total = GetMillisecondsSince(start);
+            return;
+        }
+        else
+        {
+            SubtreeRebuildContext context;
+            context.pPrimitiveBoxes = primitiveBoxes.data();
+            context.pTriangleVertices = triangleVertices.data();
+            context.pDuplicationAllowed = spatialSplits ? duplicationAllowed.data() : nullptr;
+            context.maxTrisInLeaf = spatialSplits ? settings.MaxTrianglesInLeaf : MAX_TRIS_IN_LEAF;
+
+            // Spatial splits of a subtree can use whatever the rest of the tree leaves of
+            // the budget GetCpuBvh2ResultDataMaxSizeInBytes sized the output for
+            const UINT32 maxReferences = GetMaxReferenceCount(totalNumberOfTriangles, Flags, settings);
+            UINT32 numReferences = numPrimitives;
+
+            std::vector<UINT32> primitiveIndices = primitiveOrder;
+            INT numNodes = (INT)nodes.size();
+            for (size_t i = 0; i < rebuildRoots.size(); ++i)
+            {
+                const UINT32 otherReferences = numReferences - subtreeReferenceCounts[i];
+                const UINT32 subtreeMaxReferences = std::max(
+                    maxReferences > otherReferences ? maxReferences - otherReferences : 0u,
+                    (UINT32)subtreePrimitives[i].size());
+
+                const UINT32 firstNewPrimitive = (UINT32)primitiveIndices.size();
+                numNodes += RebuildSubtree(pool, context, nodes, primitiveIndices, subtreePrimitives[i], subtreeNodeCounts[i], subtreeMaxReferences, rebuildRoots[i]);
+                const UINT32 numNewReferences = (UINT32)primitiveIndices.size() - firstNewPrimitive;
+                stats.RebuiltPrimitives += numNewReferences;
+                numReferences = otherReferences + numNewReferences;
+            }
+            stats.RebuiltSubtrees = (UINT)rebuildRoots.size();
+
+            FlattenBVH(bvh, nodes, primitiveIndices, (UINT32)numNodes);
+            primitiveOrder = std::move(bvh.m_primitiveOrder);
+            stats.SahCost = ComputeSahCost(bvh.m_nodes.data(), (UINT)bvh.m_nodes.size());
+            stats.Rebuild = GetMillisecondsSince(rebuildStart);
+        }
+
+        CopyTriangles(pool, bvh, triangleVertices, metadata, primitiveOrder);
+        stats.Total = GetMillisecondsSince(start);
+    }
+
+    float ComputeSahCost(
+        _In_ const void *pBVH)
+    {
+        const BVHOffsets& offsets = *(const BVHOffsets*)pBVH;
+        const BYTE* pBoxes = (const BYTE*)pBVH + offsets.offsetToBoxes;
+
+        std::vector<AABBNode> nodes(GetNodeCount(pBoxes, offsets.offsetToVertices - offsets.offsetToBoxes));
+        for (UINT i = 0; i < nodes.size(); ++i)
         {
-            UINT inputIndex = bvh.m_metadata[i].PrimitiveIndex;
-            float *pInputTriangle = &triangleVertices.data()[inputIndex * 9];
-            float* pOutputTriangle = &bvh.m_triangles[i * 9];
+            nodes[i] = ReadAABBNode(pBoxes, i);
+        }
+        return ComputeSahCost(nodes.data(), (UINT)nodes.size());
+    }
+
+    UINT GetCpuBvh2ResultDataMaxSizeInBytes(
+        _In_ UINT numTriangles,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags,
+        _In_ const CpuBvh2BuildSettings &settings)
+    {
+        // Compressed nodes are smaller, so this covers them too
+        const UINT maxReferences = GetMaxReferenceCount(numTriangles, flags, settings);
+        const UINT maxNodes = std::max(2 * maxReferences, 2u) - 1;
+        return (UINT)(sizeof(BVHOffsets) + maxReferences * (sizeof(Primitive) + sizeof(PrimitiveMetaData)) + maxNodes * sizeof(AABBNode));
+    }
+
+    static
+        void WriteBVH(
+            const BVH& bvh,
+            bool compressNodes,
+            void* pData)
+    {
+        const UINT numNodes = (UINT)bvh.m_nodes.size();
+
+        BYTE* outputData = (BYTE*)pData;
+        BVHOffsets offsets;
+        offsets.offsetToBoxes = sizeof(BVHOffsets);
+        const UINT sizeofBoxes = compressNodes ?
+            GetCompressedBoxesSize(numNodes) :
+            numNodes * (UINT)sizeof(*bvh.m_nodes.data());
+        offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
+
+        UINT numTriangles = (UINT)bvh.m_triangles.size() / 9;
+        const UINT sizeofVertices = numTriangles * sizeof(Primitive);
+        offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + sizeofVertices;
 
-            // Construct three planes and write to pPlanes
-            XMVECTOR V0 = XMVectorSet(pInputTriangle[0], pInputTriangle[1], pInputTriangle[2], 0.0f);
-            XMVECTOR V1 = XMVectorSet(pInputTriangle[3], pInputTriangle[4], pInputTriangle[5], 0.0f);
-            XMVECTOR V2 = XMVectorSet(pInputTriangle[6], pInputTriangle[7], pInputTriangle[8], 0.0f);
+        const UINT sizeofMetadata = (UINT)(bvh.m_metadata.size() * sizeof(*bvh.m_metadata.data()));
+        offsets.totalSize = offsets.offsetToPrimitiveMetaData + sizeofMetadata;
 
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 0, V0);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 1, V1);
-            XMStoreFloat3((XMFLOAT3*)pOutputTriangle + 2, V2);
+        memcpy(outputData,  &offsets, sizeof(offsets));
+        if (compressNodes)
+        {
+            CompressAABBNodes(bvh.m_nodes.data(), numNodes, outputData + offsets.offsetToBoxes);
+        }
+        else
+        {
+            memcpy(outputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+        }
+
+        Primitive *pPrimitives = (Primitive *)(outputData + offsets.offsetToVertices);
+        for (UINT i = 0; i < numTriangles; i++)
+        {
+            Triangle *pTriangle = (Triangle *)((BYTE *)bvh.m_triangles.data() + sizeof(Triangle) * i);
+            pPrimitives[i].PrimitiveType = TRIANGLE_TYPE;
+            pPrimitives[i].triangle = *pTriangle;
         }
+        memcpy(outputData + offsets.offsetToPrimitiveMetaData, bvh.m_metadata.data(), sizeofMetadata);
     }
 }
 
 void BuildRaytracingAccelerationStructureOnCpu(
     _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData)
+    _In_  const FallbackLayer::CpuBvh2BuildSettings &settings,
+    _Out_ void *pData,
+    _Out_opt_ FallbackLayer::CpuBvh2UpdateStats *pUpdateStats)
 {
     FallbackLayer::BVH bvh;
-    FallbackLayer::BuildUniformBVH(pDesc->NumDescs, pDesc->pGeometryDescs, bvh);
 
-    BYTE* outputData = (BYTE*)pData;
-    BVHOffsets offsets;
-    offsets.offsetToBoxes = sizeof(BVHOffsets);
-    const UINT sizeofBoxes = (UINT)(bvh.m_nodes.size() * sizeof(*bvh.m_nodes.data()));
-    offsets.offsetToVertices = offsets.offsetToBoxes + sizeofBoxes;
-    
-    UINT numTriangles = (UINT)bvh.m_triangles.size() / 9;
-    const UINT sizeofVertices = numTriangles * sizeof(Primitive);
-    offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + sizeofVertices;
+    // Every build can be updated, so ALLOW_UPDATE needs nothing extra. Updates keep the
+    // source's node format, which was picked by the flags it was built with.
+    if (pDesc->Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE)
+    {
+        if (pDesc->SourceAccelerationStructureData == 0)
+        {
+            ThrowFailure(E_INVALIDARG, L"PERFORM_UPDATE requires SourceAccelerationStructureData");
+        }
 
-    const UINT sizeofMetadata = (UINT)(bvh.m_metadata.size() * sizeof(*bvh.m_metadata.data()));
-    offsets.totalSize = offsets.offsetToPrimitiveMetaData + sizeofMetadata;
+        FallbackLayer::CpuBvh2UpdateStats stats;
+        bool compressNodes;
+        FallbackLayer::UpdateUniformBVH(
+            pDesc->NumDescs,
+            pDesc->pGeometryDescs,
+            pDesc->Flags,
+            (const BYTE *)pDesc->SourceAccelerationStructureData,
+            settings,
+            bvh,
+            compressNodes,
+            stats);
+        FallbackLayer::WriteBVH(bvh, compressNodes, pData);
+
+        if (pUpdateStats)
+        {
+            // Compression grows the boxes the cost was computed from
+            if (compressNodes)
+            {
+                stats.SahCost = FallbackLayer::ComputeSahCost(pData);
+            }
+            *pUpdateStats = stats;
+        }
+        return;
+    }
 
-    memcpy(outputData,  &offsets, sizeof(offsets));
-    memcpy(outputData + offsets.offsetToBoxes, bvh.m_nodes.data(), sizeofBoxes);
+    FallbackLayer::BuildUniformBVH(pDesc->NumDescs, pDesc->pGeometryDescs, pDesc->Flags, settings, bvh);
 
-    Primitive *pPrimitives = (Primitive *)(outputData + offsets.offsetToVertices);
-    for (UINT i = 0; i < numTriangles; i++)
-    {
-        Triangle *pTriangle = (Triangle *)((BYTE *)bvh.m_triangles.data() + sizeof(Triangle) * i);
-        pPrimitives[i].PrimitiveType = TRIANGLE_TYPE;
-        pPrimitives[i].triangle = *pTriangle;
-    }
-    memcpy(outputData + offsets.offsetToPrimitiveMetaData, bvh.m_metadata.data(), sizeofMetadata);
+    const bool compressNodes = settings.CompressNodes ||
+        (pDesc->Flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_MINIMIZE_MEMORY);
+    FallbackLayer::WriteBVH(bvh, compressNodes, pData);
 }
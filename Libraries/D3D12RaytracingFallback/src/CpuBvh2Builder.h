@@ -0,0 +1,91 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    // Updates rebuild subtrees the way the source was built, so like the build flags, the
+    // settings have to be the ones the source was built with
+    struct CpuBvh2BuildSettings
+    {
+        // Number of threads used for the build, 0 uses one per hardware thread
+        UINT ThreadCount = 0;
+
+        // Nodes and primitive metadata are emitted in the same depth-first order
+        // regardless of thread count and scheduling. When disabled, nodes are left
+        // in the order the workers allocated them which skips a final reordering
+        // pass but makes the output differ from run to run.
+        bool Deterministic = true;
+
+        // Writes CompressedAABBNodes, half the size of AABBNodes at the cost of boxes
+        // growing by the fp16 rounding. Also enabled by the MINIMIZE_MEMORY build flag.
+        bool CompressNodes = false;
+
+        // Updates (PERFORM_UPDATE builds) refit the source's tree to the new vertices. On
+        // top of that, subtrees whose SAH cost relative to the area of their root grew past
+        // this multiple of the source's are rebuilt. 0 only refits. Updating from the last
+        // full build rather than in place keeps slow drift from going unnoticed.
+        float UpdateRebuildThreshold = 0.0f;
+
+        // Once the subtrees to rebuild hold more than this fraction of the references, the
+        // update does a full build instead, which is no slower than splicing that much back
+        // in and gives a better tree. 1 always splices, even when the root has degraded.
+        float UpdateFullRebuildFraction = 0.5f;
+
+        // PREFER_FAST_TRACE builds use spatial splits (SBVH), which reference triangles that
+        // straddle a split from both sides. This caps the extra references as a fraction of
+        // the triangle count. Geometry flagged NO_DUPLICATE_ANYHIT_INVOCATION is never split.
+        float SpatialSplitBudget = 0.25f;
+
+        // Leaves of PREFER_FAST_TRACE builds hold up to this many triangles, as many as the
+        // SAH finds cheaper than splitting further, up to 31. More than MAX_TRIS_IN_LEAF
+        // needs CpuTraversalOnly.
+        UINT MaxTrianglesInLeaf = MAX_TRIS_IN_LEAF;
+
+        // The result is only traced by CpuBvh2Traverser. The traversal shaders only test the
+        // first triangle of a leaf, so builds they could trace reject larger leaves.
+        bool CpuTraversalOnly = false;
+    };
+
+    // What an update did, times are wall clock milliseconds
+    struct CpuBvh2UpdateStats
+    {
+        double Refit;           // Reading the source, reloading triangles and refitting
+        double Rebuild;         // Rebuilding degraded subtrees and reordering the nodes
+        double Total;
+
+        // SAH cost of the source and of the result, the expected number of box and
+        // triangle tests of a ray that hits the root
+        float SourceSahCost;
+        float SahCost;
+
+        UINT RebuiltSubtrees;
+        UINT RebuiltPrimitives;
+    };
+
+    // SAH cost of a bottom-level BVH written by either CPU builder, compressed or not
+    float ComputeSahCost(_In_ const void *pBVH);
+
+    // Size pData needs for a build. Spatial splits make PREFER_FAST_TRACE builds larger
+    // than what the GPU builder's prebuild info reports.
+    UINT GetCpuBvh2ResultDataMaxSizeInBytes(
+        _In_ UINT numTriangles,
+        _In_ D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags,
+        _In_ const CpuBvh2BuildSettings &settings);
+}
+
+// Also performs updates, SourceAccelerationStructureData is read as a CPU pointer like
+// the geometry and can be the same as pData
+void BuildRaytracingAccelerationStructureOnCpu(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _In_  const FallbackLayer::CpuBvh2BuildSettings &settings,
+    _Out_ void *pData,
+    _Out_opt_ FallbackLayer::CpuBvh2UpdateStats *pUpdateStats = nullptr);
@@ -0,0 +1,988 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    // Flags of the AABBNodes, see RayTracingHelper.hlsli
+    static const UINT LeafNodeFlag = 0x80000000;
+    static const UINT ProceduralGeometryFlag = 0x40000000;
+    static const UINT LeftNodeIndexMask = 0x00ffffff;
+
+    static const UINT RootNodeIndex = 0;
+    static const UINT NoPrimitive = (UINT)-1;
+
+    // Traversals of BVHs up to this deep keep their stack in registers/on the stack, deeper
+    // (degenerate) ones allocate it
+    static const UINT LocalStackSize = 64;
+
+    static const UINT PacketWidth = 8;
+    static const UINT StreamBatchSize = 1024;
+    static const UINT StreamSingleRayThreshold = 4;
+
+    // Direction components smaller than this are clamped so the slab test never computes 0 * inf
+    static const float MinDirectionComponent = 1e-20f;
+
+    // Widens the far slab distance by a few ulps so the rounding of the box test can't cull
+    // a triangle that lies exactly on its node's bounds (PBRT's 1 + 2 * gamma(3))
+    static const float SlabFarScale = 1.0f + 2.0f * (3.0f * FLT_EPSILON * 0.5f) / (1.0f - 3.0f * FLT_EPSILON * 0.5f);
+
+    static
+        bool IsLeafNode(
+            const AABBNode &node)
+    {
+        return (node.nodeAllBits & LeafNodeFlag) != 0;
+    }
+
+    static
+        bool IsProceduralLeafNode(
+            const AABBNode &node)
+    {
+        return (node.nodeAllBits & ProceduralGeometryFlag) != 0;
+    }
+
+    static
+        UINT GetLeftNodeIndex(
+            const AABBNode &node)
+    {
+        return node.nodeAllBits & LeftNodeIndexMask;
+    }
+
+    static
+        UINT GetFirstPrimitiveIndex(
+            const AABBNode &node)
+    {
+        return node.nodeAllBits & LeftNodeIndexMask;
+    }
+
+    static
+        float GetInverseDirection(
+            float direction)
+    {
+        if (fabsf(direction) < MinDirectionComponent)
+        {
+            direction = direction < 0.0f ? -MinDirectionComponent : MinDirectionComponent;
+        }
+        return 1.0f / direction;
+    }
+
+    // Returns the axis along which the children's centers are furthest apart and whether
+    // the left child is the nearer one for rays going in the positive direction of it
+    static
+        UINT GetChildOrderAxis(
+            const AABBNode &left,
+            const AABBNode &right,
+            bool &leftFirstForPositiveDirection)
+    {
+        UINT axis = 0;
+        float maxDistance = -1.0f;
+        for (UINT i = 0; i < 3; i++)
+        {
+            const float distance = fabsf(right.center[i] - left.center[i]);
+            if (distance > maxDistance)
+            {
+                maxDistance = distance;
+                axis = i;
+            }
+        }
+        leftFirstForPositiveDirection = left.center[axis] <= right.center[axis];
+        return axis;
+    }
+
+    static
+        CpuRayHit MissedHit(
+            float tMax)
+    {
+        CpuRayHit hit;
+        hit.T = tMax;
+        hit.Barycentrics = { 0.0f, 0.0f };
+        hit.GeometryIndex = CpuRayHit::NoHit;
+        hit.PrimitiveIndex = CpuRayHit::NoHit;
+        return hit;
+    }
+
+    static
+        void ResolveHit(
+            const PrimitiveMetaData *pMetadata,
+            UINT primitiveIndex,
+            float tMax,
+            float t,
+            float u,
+            float v,
+            CpuRayHit &hit)
+    {
+        if (primitiveIndex == NoPrimitive)
+        {
+            hit = MissedHit(tMax);
+            return;
+        }
+
+        hit.T = t;
+        hit.Barycentrics = { u, v };
+        hit.GeometryIndex = pMetadata[primitiveIndex].GeometryContributionToHitGroupIndex;
+        hit.PrimitiveIndex = pMetadata[primitiveIndex].PrimitiveIndex;
+    }
+
+    // Traversal stack that lives on the stack unless the BVH is deeper than LocalStackSize
+    template <typename Entry>
+    class TraversalStack
+    {
+    public:
+        TraversalStack(UINT capacity) : m_pEntries(m_localEntries), m_size(0)
+        {
+            if (capacity > LocalStackSize)
+            {
+                m_heapEntries.resize(capacity);
+                m_pEntries = m_heapEntries.data();
+            }
+        }
+
+        bool IsEmpty() const { return m_size == 0; }
+        void Push(const Entry &entry) { m_pEntries[m_size++] = entry; }
+        Entry Pop() { return m_pEntries[--m_size]; }
+
+    private:
+        Entry m_localEntries[LocalStackSize];
+        std::vector<Entry> m_heapEntries;
+        Entry *m_pEntries;
+        UINT m_size;
+    };
+
+    //
+    // Single ray
+    //
+
+    struct SseRay
+    {
+        __m128 origin;
+        __m128 inverseDirection;
+        __m128 absInverseDirection;
+        float tMin;
+    };
+
+    static
+        float HorizontalMax(
+            __m128 v)
+    {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    static
+        float HorizontalMin(
+            __m128 v)
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    // Slab test against the center/half-extent box of a node. The fourth lane of the loads
+    // holds the node's flags, it's replaced with the ray's [tMin, tMax] interval.
+    static
+        bool IntersectNode(
+            const AABBNode &node,
+            const SseRay &ray,
+            float tMax,
+            float &tEntry)
+    {
+        const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        const __m128 center = _mm_loadu_ps(node.center);
+        const __m128 halfDim = _mm_loadu_ps(node.halfDim);
+
+        const __m128 relativeCenter = _mm_mul_ps(_mm_sub_ps(center, ray.origin), ray.inverseDirection);
+        const __m128 extent = _mm_mul_ps(halfDim, ray.absInverseDirection);
+        const __m128 slabNear = _mm_sub_ps(relativeCenter, extent);
+        const __m128 slabFar = _mm_mul_ps(_mm_add_ps(relativeCenter, extent), _mm_set1_ps(SlabFarScale));
+
+        const __m128 tNear = _mm_or_ps(_mm_and_ps(xyzMask, slabNear), _mm_andnot_ps(xyzMask, _mm_set1_ps(ray.tMin)));
+        const __m128 tFar = _mm_or_ps(_mm_and_ps(xyzMask, slabFar), _mm_andnot_ps(xyzMask, _mm_set1_ps(tMax)));
+
+        tEntry = HorizontalMax(tNear);
+        return tEntry <= HorizontalMin(tFar);
+    }
+
+    // Moller-Trumbore. rayFlags culls the same faces as the GPU traversal (det > 0 is front facing).
+    static
+        bool IntersectTriangle(
+            const Triangle &triangle,
+            const CpuRay &ray,
+            UINT rayFlags,
+            float tMax,
+            float &t,
+            float &u,
+            float &v)
+    {
+        const float3 edge1 = triangle.v1 - triangle.v0;
+        const float3 edge2 = triangle.v2 - triangle.v0;
+        const float3 p = cross(ray.Direction, edge2);
+        const float det = dot(edge1, p);
+
+        if (rayFlags & CpuRayFlagCullFrontFacingTriangles)
+        {
+            if (det >= 0.0f) return false;
+        }
+        else if (rayFlags & CpuRayFlagCullBackFacingTriangles)
+        {
+            if (det <= 0.0f) return false;
+        }
+        else if (det == 0.0f)
+        {
+            return false;
+        }
+
+        const float inverseDet = 1.0f / det;
+        const float3 s = ray.Origin - triangle.v0;
+        u = dot(s, p) * inverseDet;
+        if (u < 0.0f || u > 1.0f) return false;
+
+        const float3 q = cross(s, edge1);
+        v = dot(ray.Direction, q) * inverseDet;
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        t = dot(edge2, q) * inverseDet;
+        return t >= ray.TMin && t < tMax;
+    }
+
+    CpuBvh2Traverser::CpuBvh2Traverser(const void *pBVH) :
+        m_pNodes(nullptr),
+        m_pCompressedHeader(nullptr),
+        m_pCompressedNodes(nullptr),
+        m_numNodes(0),
+        m_maxDepth(0),
+        m_useAvx2(IsAvx2Supported())
+    {
+        const BYTE *pBVHBytes = (const BYTE *)pBVH;
+        const BVHOffsets &offsets = *(const BVHOffsets *)pBVH;
+        const BYTE *pBoxes = pBVHBytes + offsets.offsetToBoxes;
+        m_pPrimitives = (const Primitive *)(pBVHBytes + offsets.offsetToVertices);
+        m_pMetadata = (const PrimitiveMetaData *)(pBVHBytes + offsets.offsetToPrimitiveMetaData);
+
+        const UINT sizeOfBoxes = offsets.offsetToVertices - offsets.offsetToBoxes;
+        if (sizeOfBoxes == 0)
+        {
+            return;
+        }
+
+        m_numNodes = GetNodeCount(pBoxes, sizeOfBoxes);
+        if (IsCompressedBVH(pBoxes))
+        {
+            m_pCompressedHeader = (const CompressedBVHHeader *)pBoxes;
+            m_pCompressedNodes = (const CompressedAABBNode *)(pBoxes + SizeOfCompressedBVHHeader);
+        }
+        else
+        {
+            m_pNodes = (const AABBNode *)pBoxes;
+        }
+
+        // The depth bounds the size of the traversal stacks
+        std::vector<std::pair<UINT, UINT>> stack(1, std::make_pair(RootNodeIndex, 1u));
+        while (!stack.empty())
+        {
+            const UINT nodeIndex = stack.back().first;
+            const UINT depth = stack.back().second;
+            stack.pop_back();
+
+            m_maxDepth = std::max(m_maxDepth, depth);
+            const AABBNode node = GetNode(nodeIndex);
+            if (!IsLeafNode(node))
+            {
+                stack.push_back(std::make_pair(GetLeftNodeIndex(node), depth + 1));
+                stack.push_back(std::make_pair(node.rightNodeIndex, depth + 1));
+            }
+        }
+    }
+
+    CpuRayHit CpuBvh2Traverser::Trace(const CpuRay &ray, UINT rayFlags, CpuTraversalStats *pStats) const
+    {
+        float hitT = ray.TMax, hitU = 0.0f, hitV = 0.0f;
+        UINT hitPrimitive = NoPrimitive;
+        if (m_numNodes > 0)
+        {
+            if (pStats)
+            {
+                TraverseSubtree<true>(RootNodeIndex, ray, rayFlags, hitT, hitU, hitV, hitPrimitive, pStats);
+            }
+            else
+            {
+                TraverseSubtree<false>(RootNodeIndex, ray, rayFlags, hitT, hitU, hitV, hitPrimitive, nullptr);
+            }
+        }
+
+        CpuRayHit hit;
+        ResolveHit(m_pMetadata, hitPrimitive, ray.TMax, hitT, hitU, hitV, hit);
+        return hit;
+    }
+
+    template <bool CollectStats>
+    bool CpuBvh2Traverser::TraverseSubtree(
+        UINT subtreeIndex,
+        const CpuRay &ray,
+        UINT rayFlags,
+        float &hitT,
+        float &hitU,
+        float &hitV,
+        UINT &hitPrimitive,
+        CpuTraversalStats *pStats) const
+    {
+        struct StackEntry
+        {
+            UINT nodeIndex;
+            float tEntry;
+        };
+
+        const float3 inverseDirection =
+        {
+            GetInverseDirection(ray.Direction.x),
+            GetInverseDirection(ray.Direction.y),
+            GetInverseDirection(ray.Direction.z)
+        };
+
+        SseRay sseRay;
+        sseRay.origin = _mm_set_ps(0.0f, ray.Origin.z, ray.Origin.y, ray.Origin.x);
+        sseRay.inverseDirection = _mm_set_ps(0.0f, inverseDirection.z, inverseDirection.y, inverseDirection.x);
+        sseRay.absInverseDirection = _mm_andnot_ps(_mm_set1_ps(-0.0f), sseRay.inverseDirection);
+        sseRay.tMin = ray.TMin;
+
+        const bool anyHit = (rayFlags & CpuRayFlagAcceptFirstHitAndEndSearch) != 0;
+
+        float tEntry;
+        if (CollectStats) pStats->NodesVisited++;
+        if (!IntersectNode(GetNode(subtreeIndex), sseRay, hitT, tEntry))
+        {
+            return false;
+        }
+
+        // Only far children are pushed, so the stack never holds more than one node per level
+        TraversalStack<StackEntry> stack(m_maxDepth);
+        UINT nodeIndex = subtreeIndex;
+        for (;;)
+        {
+            const AABBNode node = GetNode(nodeIndex);
+            bool descend = false;
+            if (IsLeafNode(node))
+            {
+                // Procedural primitives need an intersection shader
+                if (!IsProceduralLeafNode(node))
+                {
+                    const UINT firstPrimitive = GetFirstPrimitiveIndex(node);
+                    for (UINT i = 0; i < node.numTriangles; i++)
+                    {
+                        float t, u, v;
+                        if (CollectStats) pStats->TrianglesTested++;
+                        if (IntersectTriangle(m_pPrimitives[firstPrimitive + i].triangle, ray, rayFlags, hitT, t, u, v))
+                        {
+                            hitT = t;
+                            hitU = u;
+                            hitV = v;
+                            hitPrimitive = firstPrimitive + i;
+                            if (anyHit)
+                            {
+                                return true;
+                            }
+                        }
+                    }
+                }
+            }
+            else
+            {
+                const UINT leftIndex = GetLeftNodeIndex(node);
+                const UINT rightIndex = node.rightNodeIndex;
+                float leftT, rightT;
+                if (CollectStats) pStats->NodesVisited += 2;
+                const bool hitLeft = IntersectNode(GetNode(leftIndex), sseRay, hitT, leftT);
+                const bool hitRight = IntersectNode(GetNode(rightIndex), sseRay, hitT, rightT);
+                if (hitLeft && hitRight)
+                {
+                    const bool rightFirst = rightT < leftT;
+                    stack.Push({ rightFirst ? leftIndex : rightIndex, rightFirst ? leftT : rightT });
+                    nodeIndex = rightFirst ? rightIndex : leftIndex;
+                    descend = true;
+                }
+                else if (hitLeft || hitRight)
+                {
+                    nodeIndex = hitLeft ? leftIndex : rightIndex;
+                    descend = true;
+                }
+            }
+
+            if (!descend)
+            {
+                // Skip far children that are now behind the closest hit
+                bool found = false;
+                while (!stack.IsEmpty())
+                {
+                    const StackEntry entry = stack.Pop();
+                    if (entry.tEntry <= hitT)
+                    {
+                        nodeIndex = entry.nodeIndex;
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (!found)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    //
+    // AVX2 packets and streams
+    //
+
+    // Eight rays in SoA form, or eight lanes gathered from a stream
+    struct Avx2Rays
+    {
+        __m256 origin[3];
+        __m256 direction[3];
+        __m256 inverseDirection[3];
+        __m256 absInverseDirection[3];
+        __m256 tMin;
+    };
+
+    static
+        __m256 IntersectNode8(
+            const AABBNode &node,
+            const Avx2Rays &rays,
+            __m256 tMax)
+    {
+        __m256 tNear = rays.tMin;
+        __m256 tFar = tMax;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            const __m256 relativeCenter = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.center[axis]), rays.origin[axis]), rays.inverseDirection[axis]);
+            const __m256 extent = _mm256_mul_ps(_mm256_set1_ps(node.halfDim[axis]), rays.absInverseDirection[axis]);
+            tNear = _mm256_max_ps(tNear, _mm256_sub_ps(relativeCenter, extent));
+            tFar = _mm256_min_ps(tFar, _mm256_mul_ps(_mm256_add_ps(relativeCenter, extent), _mm256_set1_ps(SlabFarScale)));
+        }
+        return _mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ);
+    }
+
+    static
+        __m256 Cross8(
+            const __m256 a[3],
+            const __m256 b[3],
+            UINT axis)
+    {
+        const UINT i = (axis + 1) % 3;
+        const UINT j = (axis + 2) % 3;
+        return _mm256_sub_ps(_mm256_mul_ps(a[i], b[j]), _mm256_mul_ps(a[j], b[i]));
+    }
+
+    static
+        __m256 Dot8(
+            const __m256 a[3],
+            const __m256 b[3])
+    {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], b[0]), _mm256_mul_ps(a[1], b[1])), _mm256_mul_ps(a[2], b[2]));
+    }
+
+    // Same test as IntersectTriangle on eight rays, returns the mask of the lanes that hit
+    static
+        __m256 IntersectTriangle8(
+            const Triangle &triangle,
+            const Avx2Rays &rays,
+            UINT rayFlags,
+            __m256 tMax,
+            __m256 &t,
+            __m256 &u,
+            __m256 &v)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        const __m256 v0[3] = { _mm256_set1_ps(triangle.v0.x), _mm256_set1_ps(triangle.v0.y), _mm256_set1_ps(triangle.v0.z) };
+        const __m256 edge1[3] =
+        {
+            _mm256_set1_ps(triangle.v1.x - triangle.v0.x),
+            _mm256_set1_ps(triangle.v1.y - triangle.v0.y),
+            _mm256_set1_ps(triangle.v1.z - triangle.v0.z)
+        };
+        const __m256 edge2[3] =
+        {
+            _mm256_set1_ps(triangle.v2.x - triangle.v0.x),
+            _mm256_set1_ps(triangle.v2.y - triangle.v0.y),
+            _mm256_set1_ps(triangle.v2.z - triangle.v0.z)
+        };
+
+        const __m256 p[3] = { Cross8(rays.direction, edge2, 0), Cross8(rays.direction, edge2, 1), Cross8(rays.direction, edge2, 2) };
+        const __m256 det = Dot8(edge1, p);
+
+        __m256 valid;
+        if (rayFlags & CpuRayFlagCullFrontFacingTriangles)
+        {
+            valid = _mm256_cmp_ps(det, zero, _CMP_LT_OQ);
+        }
+        else if (rayFlags & CpuRayFlagCullBackFacingTriangles)
+        {
+            valid = _mm256_cmp_ps(det, zero, _CMP_GT_OQ);
+        }
+        else
+        {
+            valid = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+        }
+        if (_mm256_movemask_ps(valid) == 0)
+        {
+            return valid;
+        }
+
+        const __m256 inverseDet = _mm256_div_ps(one, det);
+        const __m256 s[3] = { _mm256_sub_ps(rays.origin[0], v0[0]), _mm256_sub_ps(rays.origin[1], v0[1]), _mm256_sub_ps(rays.origin[2], v0[2]) };
+        u = _mm256_mul_ps(Dot8(s, p), inverseDet);
+        valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+
+        const __m256 q[3] = { Cross8(s, edge1, 0), Cross8(s, edge1, 1), Cross8(s, edge1, 2) };
+        v = _mm256_mul_ps(Dot8(rays.direction, q), inverseDet);
+        valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+
+        t = _mm256_mul_ps(Dot8(edge2, q), inverseDet);
+        valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, rays.tMin, _CMP_GE_OQ), _mm256_cmp_ps(t, tMax, _CMP_LT_OQ)));
+        return valid;
+    }
+
+    void CpuBvh2Traverser::TracePacket8(const CpuRay *pRays, UINT numRays, UINT rayFlags, CpuRayHit *pHits) const
+    {
+        if (numRays > PacketWidth)
+        {
+            ThrowFailure(E_INVALIDARG, L"TracePacket8 traces at most 8 rays");
+        }
+
+        if (m_useAvx2 && m_numNodes > 0)
+        {
+            TracePacket8Avx2(pRays, numRays, rayFlags, pHits);
+        }
+        else
+        {
+            for (UINT i = 0; i < numRays; i++)
+            {
+                pHits[i] = Trace(pRays[i], rayFlags);
+            }
+        }
+    }
+
+    void CpuBvh2Traverser::TracePacket8Avx2(const CpuRay *pRays, UINT numRays, UINT rayFlags, CpuRayHit *pHits) const
+    {
+        // Unused lanes get an empty interval so they never hit anything
+        __declspec(align(32)) float lanes[13][PacketWidth];
+        for (UINT i = 0; i < PacketWidth; i++)
+        {
+            const bool used = i < numRays;
+            const CpuRay &ray = pRays[used ? i : 0];
+            const float *pOrigin = &ray.Origin.x;
+            const float *pDirection = &ray.Direction.x;
+            for (UINT axis = 0; axis < 3; axis++)
+            {
+                lanes[axis][i] = pOrigin[axis];
+                lanes[3 + axis][i] = pDirection[axis];
+                lanes[6 + axis][i] = GetInverseDirection(pDirection[axis]);
+                lanes[9 + axis][i] = fabsf(lanes[6 + axis][i]);
+            }
+            lanes[12][i] = used ? ray.TMax : -FLT_MAX;
+        }
+
+        Avx2Rays rays;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            rays.origin[axis] = _mm256_load_ps(lanes[axis]);
+            rays.direction[axis] = _mm256_load_ps(lanes[3 + axis]);
+            rays.inverseDirection[axis] = _mm256_load_ps(lanes[6 + axis]);
+            rays.absInverseDirection[axis] = _mm256_load_ps(lanes[9 + axis]);
+        }
+
+        __declspec(align(32)) float tMinLanes[PacketWidth];
+        for (UINT i = 0; i < PacketWidth; i++)
+        {
+            tMinLanes[i] = i < numRays ? pRays[i].TMin : FLT_MAX;
+        }
+        rays.tMin = _mm256_load_ps(tMinLanes);
+
+        const bool anyHit = (rayFlags & CpuRayFlagAcceptFirstHitAndEndSearch) != 0;
+        __m256 tMax = _mm256_load_ps(lanes[12]);
+        __m256 hitT = tMax;
+        __m256 hitU = _mm256_setzero_ps();
+        __m256 hitV = _mm256_setzero_ps();
+        __m256i hitPrimitive = _mm256_set1_epi32((int)NoPrimitive);
+        int activeLanes = (1 << numRays) - 1;
+
+        // Children are only tested once popped, so each level leaves at most one node behind
+        TraversalStack<UINT> stack(m_maxDepth + 1);
+        stack.Push(RootNodeIndex);
+        while (!stack.IsEmpty() && activeLanes != 0)
+        {
+            const AABBNode node = GetNode(stack.Pop());
+            const int nodeLanes = _mm256_movemask_ps(IntersectNode8(node, rays, tMax)) & activeLanes;
+            if (nodeLanes == 0)
+            {
+                continue;
+            }
+
+            if (IsLeafNode(node))
+            {
+                if (IsProceduralLeafNode(node))
+                {
+                    continue;
+                }
+
+                const UINT firstPrimitive = GetFirstPrimitiveIndex(node);
+                for (UINT i = 0; i < node.numTriangles; i++)
+                {
+                    __m256 t, u, v;
+                    const __m256 hitMask = IntersectTriangle8(m_pPrimitives[firstPrimitive + i].triangle, rays, rayFlags, tMax, t, u, v);
+                    const int hitLanes = _mm256_movemask_ps(hitMask) & activeLanes;
+                    if (hitLanes == 0)
+                    {
+                        continue;
+                    }
+
+                    hitT = _mm256_blendv_ps(hitT, t, hitMask);
+                    hitU = _mm256_blendv_ps(hitU, u, hitMask);
+                    hitV = _mm256_blendv_ps(hitV, v, hitMask);
+                    hitPrimitive = _mm256_castps_si256(_mm256_blendv_ps(
+                        _mm256_castsi256_ps(hitPrimitive),
+                        _mm256_castsi256_ps(_mm256_set1_epi32((int)(firstPrimitive + i))),
+                        hitMask));
+
+                    if (anyHit)
+                    {
+                        // Finished lanes drop out of every further test
+                        activeLanes &= ~hitLanes;
+                        tMax = _mm256_blendv_ps(tMax, _mm256_set1_ps(-FLT_MAX), hitMask);
+                    }
+                    else
+                    {
+                        tMax = hitT;
+                    }
+                }
+            }
+            else
+            {
+                // Order the children for the first ray that reached the node, coherent rays agree with it
+                const AABBNode left = GetNode(GetLeftNodeIndex(node));
+                const AABBNode right = GetNode(node.rightNodeIndex);
+                bool leftFirstForPositiveDirection;
+                const UINT axis = GetChildOrderAxis(left, right, leftFirstForPositiveDirection);
+
+                unsigned long firstLane;
+                BitScanForward(&firstLane, (unsigned long)nodeLanes);
+                const bool positiveDirection = lanes[3 + axis][firstLane] >= 0.0f;
+                const bool leftFirst = positiveDirection == leftFirstForPositiveDirection;
+
+                stack.Push(leftFirst ? node.rightNodeIndex : GetLeftNodeIndex(node));
+                stack.Push(leftFirst ? GetLeftNodeIndex(node) : node.rightNodeIndex);
+            }
+        }
+
+        __declspec(align(32)) float tResults[PacketWidth], uResults[PacketWidth], vResults[PacketWidth];
+        __declspec(align(32)) UINT primitiveResults[PacketWidth];
+        _mm256_store_ps(tResults, hitT);
+        _mm256_store_ps(uResults, hitU);
+        _mm256_store_ps(vResults, hitV);
+        _mm256_store_si256((__m256i *)primitiveResults, hitPrimitive);
+        for (UINT i = 0; i < numRays; i++)
+        {
+            ResolveHit(m_pMetadata, primitiveResults[i], pRays[i].TMax, tResults[i], uResults[i], vResults[i], pHits[i]);
+        }
+    }
+
+    void CpuBvh2Traverser::TraceStream(const CpuRay *pRays, UINT numRays, UINT rayFlags, CpuRayHit *pHits) const
+    {
+        if (m_useAvx2 && m_numNodes > 0)
+        {
+            TraceStreamAvx2(pRays, numRays, rayFlags, pHits);
+        }
+        else
+        {
+            for (UINT i = 0; i < numRays; i++)
+            {
+                pHits[i] = Trace(pRays[i], rayFlags);
+            }
+        }
+    }
+
+    // A batch of rays in SoA form, read with gathers. The extra ray at StreamBatchSize has an
+    // empty interval and pads the last group of eight of a list.
+    struct StreamBatch
+    {
+        static const UINT PaddingRay = StreamBatchSize;
+        static const UINT Capacity = StreamBatchSize + 1;
+
+        float origin[3][Capacity];
+        float direction[3][Capacity];
+        float inverseDirection[3][Capacity];
+        float tMin[Capacity];
+
+        // Upper bound of the interval tested, -FLT_MAX once an any-hit ray is done
+        float tMax[Capacity];
+
+        float hitT[Capacity];
+        float hitU[Capacity];
+        float hitV[Capacity];
+        UINT hitPrimitive[Capacity];
+    };
+
+    // Gathers the members the box test or, with forTriangleTest, the triangle test reads
+    static
+        void GatherRays8(
+            const StreamBatch &batch,
+            __m256i rayIds,
+            bool forTriangleTest,
+            Avx2Rays &rays,
+            __m256 &tMax)
+    {
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            rays.origin[axis] = _mm256_i32gather_ps(batch.origin[axis], rayIds, sizeof(float));
+            if (forTriangleTest)
+            {
+                rays.direction[axis] = _mm256_i32gather_ps(batch.direction[axis], rayIds, sizeof(float));
+            }
+            else
+            {
+                rays.inverseDirection[axis] = _mm256_i32gather_ps(batch.inverseDirection[axis], rayIds, sizeof(float));
+                rays.absInverseDirection[axis] = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), rays.inverseDirection[axis]);
+            }
+        }
+        rays.tMin = _mm256_i32gather_ps(batch.tMin, rayIds, sizeof(float));
+        tMax = _mm256_i32gather_ps(batch.tMax, rayIds, sizeof(float));
+    }
+
+    // Loads eight ids of a list, padding the ones past its end
+    static
+        __m256i LoadRayIds8(
+            const UINT *pRayIds,
+            UINT count,
+            UINT (&ids)[PacketWidth])
+    {
+        for (UINT i = 0; i < PacketWidth; i++)
+        {
+            ids[i] = i < count ? pRayIds[i] : StreamBatch::PaddingRay;
+        }
+        return _mm256_load_si256((const __m256i *)ids);
+    }
+
+    void CpuBvh2Traverser::TraceStreamAvx2(const CpuRay *pRays, UINT numRays, UINT rayFlags, CpuRayHit *pHits) const
+    {
+        struct StreamEntry
+        {
+            UINT nodeIndex;
+            UINT firstRay;
+            UINT numRays;
+        };
+
+        const bool anyHit = (rayFlags & CpuRayFlagAcceptFirstHitAndEndSearch) != 0;
+        std::unique_ptr<StreamBatch> pBatch(new StreamBatch);
+        StreamBatch &batch = *pBatch;
+        for (UINT axis = 0; axis < 3; axis++)
+        {
+            batch.origin[axis][StreamBatch::PaddingRay] = 0.0f;
+            batch.direction[axis][StreamBatch::PaddingRay] = 1.0f;
+            batch.inverseDirection[axis][StreamBatch::PaddingRay] = 1.0f;
+        }
+        batch.tMin[StreamBatch::PaddingRay] = FLT_MAX;
+        batch.tMax[StreamBatch::PaddingRay] = -FLT_MAX;
+
+        // The ray lists of all the pending entries, each one ends where the next one starts,
+        // so the list of the entry on top of the stack is always at the end
+        std::vector<UINT> rayIds;
+        std::vector<StreamEntry> stack;
+
+        for (UINT batchStart = 0; batchStart < numRays; batchStart += StreamBatchSize)
+        {
+            const UINT batchSize = std::min(StreamBatchSize, numRays - batchStart);
+            rayIds.resize(batchSize);
+            for (UINT i = 0; i < batchSize; i++)
+            {
+                const CpuRay &ray = pRays[batchStart + i];
+                const float *pOrigin = &ray.Origin.x;
+                const float *pDirection = &ray.Direction.x;
+                for (UINT axis = 0; axis < 3; axis++)
+                {
+                    batch.origin[axis][i] = pOrigin[axis];
+                    batch.direction[axis][i] = pDirection[axis];
+                    batch.inverseDirection[axis][i] = GetInverseDirection(pDirection[axis]);
+                }
+                batch.tMin[i] = ray.TMin;
+                batch.tMax[i] = ray.TMax;
+                batch.hitT[i] = ray.TMax;
+                batch.hitU[i] = 0.0f;
+                batch.hitV[i] = 0.0f;
+                batch.hitPrimitive[i] = NoPrimitive;
+                rayIds[i] = i;
+            }
+
+            stack.push_back({ RootNodeIndex, 0, batchSize });
+            while (!stack.empty())
+            {
+                const StreamEntry entry = stack.back();
+                stack.pop_back();
+
+                // Keep the rays that reach the node, compacting the list in place
+                const AABBNode node = GetNode(entry.nodeIndex);
+                UINT *pList = rayIds.data() + entry.firstRay;
+                UINT numActive = 0;
+                for (UINT i = 0; i < entry.numRays; i += PacketWidth)
+                {
+                    __declspec(align(32)) UINT ids[PacketWidth];
+                    const __m256i ids8 = LoadRayIds8(pList + i, entry.numRays - i, ids);
+
+                    Avx2Rays rays;
+                    __m256 tMax;
+                    GatherRays8(batch, ids8, false, rays, tMax);
+                    int mask = _mm256_movemask_ps(IntersectNode8(node, rays, tMax));
+                    while (mask)
+                    {
+                        unsigned long lane;
+                        BitScanForward(&lane, (unsigned long)mask);
+                        mask &= mask - 1;
+                        pList[numActive++] = ids[lane];
+                    }
+                }
+
+                // Lists this short would leave most lanes idle, their rays finish the subtree one at a time
+                if (numActive <= StreamSingleRayThreshold && !IsLeafNode(node))
+                {
+                    for (UINT i = 0; i < numActive; i++)
+                    {
+                        const UINT rayId = pList[i];
+                        const bool done = TraverseSubtree<false>(
+                            entry.nodeIndex,
+                            pRays[batchStart + rayId],
+                            rayFlags,
+                            batch.hitT[rayId],
+                            batch.hitU[rayId],
+                            batch.hitV[rayId],
+                            batch.hitPrimitive[rayId],
+                            nullptr);
+                        batch.tMax[rayId] = done ? -FLT_MAX : batch.hitT[rayId];
+                    }
+
+                    rayIds.resize(entry.firstRay);
+                    continue;
+                }
+
+                if (numActive == 0 || IsLeafNode(node))
+                {
+                    if (numActive > 0 && !IsProceduralLeafNode(node))
+                    {
+                        const UINT firstPrimitive = GetFirstPrimitiveIndex(node);
+                        for (UINT p = 0; p < node.numTriangles; p++)
+                        {
+                            const Triangle &triangle = m_pPrimitives[firstPrimitive + p].triangle;
+                            for (UINT i = 0; i < numActive; i += PacketWidth)
+                            {
+                                __declspec(align(32)) UINT ids[PacketWidth];
+                                const __m256i ids8 = LoadRayIds8(pList + i, numActive - i, ids);
+
+                                Avx2Rays rays;
+                                __m256 tMax;
+                                GatherRays8(batch, ids8, true, rays, tMax);
+
+                                __m256 t, u, v;
+                                int mask = _mm256_movemask_ps(IntersectTriangle8(triangle, rays, rayFlags, tMax, t, u, v));
+                                if (mask == 0)
+                                {
+                                    continue;
+                                }
+
+                                __declspec(align(32)) float tLanes[PacketWidth], uLanes[PacketWidth], vLanes[PacketWidth];
+                                _mm256_store_ps(tLanes, t);
+                                _mm256_store_ps(uLanes, u);
+                                _mm256_store_ps(vLanes, v);
+                                while (mask)
+                                {
+                                    unsigned long lane;
+                                    BitScanForward(&lane, (unsigned long)mask);
+                                    mask &= mask - 1;
+
+                                    const UINT rayId = ids[lane];
+                                    batch.hitT[rayId] = tLanes[lane];
+                                    batch.hitU[rayId] = uLanes[lane];
+                                    batch.hitV[rayId] = vLanes[lane];
+                                    batch.hitPrimitive[rayId] = firstPrimitive + p;
+                                    batch.tMax[rayId] = anyHit ? -FLT_MAX : tLanes[lane];
+                                }
+                            }
+                        }
+                    }
+
+                    rayIds.resize(entry.firstRay);
+                    continue;
+                }
+
+                // Both children get the surviving rays: the far one keeps this list and the near
+                // one, which is popped first, a copy on top of it
+                const AABBNode left = GetNode(GetLeftNodeIndex(node));
+                const AABBNode right = GetNode(node.rightNodeIndex);
+                bool leftFirstForPositiveDirection;
+                const UINT axis = GetChildOrderAxis(left, right, leftFirstForPositiveDirection);
+                const bool positiveDirection = batch.direction[axis][pList[0]] >= 0.0f;
+                const bool leftFirst = positiveDirection == leftFirstForPositiveDirection;
+
+                rayIds.resize(entry.firstRay + 2 * numActive);
+                pList = rayIds.data() + entry.firstRay;
+                memcpy(pList + numActive, pList, numActive * sizeof(UINT));
+
+                stack.push_back({ leftFirst ? node.rightNodeIndex : GetLeftNodeIndex(node), entry.firstRay, numActive });
+                stack.push_back({ leftFirst ? GetLeftNodeIndex(node) : node.rightNodeIndex, entry.firstRay + numActive, numActive });
+            }
+
+            for (UINT i = 0; i < batchSize; i++)
+            {
+                ResolveHit(
+                    m_pMetadata,
+                    batch.hitPrimitive[i],
+                    pRays[batchStart + i].TMax,
+                    batch.hitT[i],
+                    batch.hitU[i],
+                    batch.hitV[i],
+                    pHits[batchStart + i]);
+            }
+        }
+    }
+
+    void CpuBvh2Traverser::TraceRays(
+        CpuTaskPool &pool,
+        const CpuRay *pRays,
+        UINT numRays,
+        CpuTraversalMode mode,
+        UINT rayFlags,
+        CpuRayHit *pHits,
+        UINT raysPerTile) const
+    {
+        pool.ParallelFor(numRays, raysPerTile, [&](UINT begin, UINT end, UINT)
+        {
+            switch (mode)
+            {
+            case CpuTraversalModeSingleRay:
+                for (UINT i = begin; i < end; i++)
+                {
+                    pHits[i] = Trace(pRays[i], rayFlags);
+                }
+                break;
+            case CpuTraversalModePacket8:
+                for (UINT i = begin; i < end; i += PacketWidth)
+                {
+                    TracePacket8(pRays + i, std::min(PacketWidth, end - i), rayFlags, pHits + i);
+                }
+                break;
+            case CpuTraversalModeStream:
+                TraceStream(pRays + begin, end - begin, rayFlags, pHits + begin);
+                break;
+            default:
+                ThrowFailure(E_INVALIDARG, L"Unrecognized CpuTraversalMode");
+            }
+        });
+    }
+}
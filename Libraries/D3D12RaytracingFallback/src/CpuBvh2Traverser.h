@@ -0,0 +1,166 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    struct CpuRay
+    {
+        float3 Origin;
+        float TMin;
+        float3 Direction;
+        float TMax;
+    };
+
+    struct CpuRayHit
+    {
+        static const UINT NoHit = (UINT)-1;
+
+        float T;
+
+        // Weights of the second and third vertex, like BuiltInTriangleIntersectionAttributes
+        float2 Barycentrics;
+
+        // Read from the PrimitiveMetaData of the hit triangle. GeometryIndex is NoHit on a miss.
+        UINT GeometryIndex;
+        UINT PrimitiveIndex;
+
+        bool IsHit() const { return GeometryIndex != NoHit; }
+    };
+
+    // Same values as the HLSL RAY_FLAG_* they correspond to
+    enum CpuRayFlags
+    {
+        CpuRayFlagNone = 0,
+
+        // Any-hit query: stop at the first hit found instead of the closest one
+        CpuRayFlagAcceptFirstHitAndEndSearch = 0x4,
+        CpuRayFlagCullBackFacingTriangles = 0x10,
+        CpuRayFlagCullFrontFacingTriangles = 0x20,
+    };
+
+    enum CpuTraversalMode
+    {
+        // One ray at a time, ordered traversal with SSE box tests
+        CpuTraversalModeSingleRay,
+
+        // 8 rays in AVX2 lanes sharing one traversal stack, best for coherent rays
+        CpuTraversalModePacket8,
+
+        // Every node filters the list of rays still inside it, 8 at a time with AVX2.
+        // Keeps SIMD lanes full for incoherent rays that would diverge in a packet.
+        CpuTraversalModeStream,
+    };
+
+    // Work done by single ray traversals, for comparing BVH quality
+    struct CpuTraversalStats
+    {
+        // Ray/box tests, each internal node tests both of its children
+        UINT64 NodesVisited;
+        UINT64 TrianglesTested;
+    };
+
+    //
+    // Traces rays against a bottom-level acceleration structure in the fallback layer's
+    // layout (BVHOffsets, AABBNodes, Primitives and PrimitiveMetaData) as written by
+    // CpuBvh2Builder, CpuLbvhBuilder or read back from GpuBvh2Builder. Intended for
+    // picking, baking and validating BVHs on the CPU, not for shading: there are no
+    // hit groups, and procedural primitives are skipped since they need an
+    // intersection shader.
+    //
+    // Triangles are intersected with Moller-Trumbore. Front faces are the ones the GPU
+    // traversal treats as front facing, but unlike its watertight test, rays passing
+    // exactly through a shared edge can miss both triangles.
+    //
+    // Compressed BVHs are decoded node by node as they're visited, so they trace the
+    // slightly larger boxes the GPU sees.
+    //
+    // Packet and stream modes need AVX2 and fall back to single rays without it. All
+    // modes find the same closest hit, up to which of several hits at the same distance
+    // is reported.
+    //
+    class CpuBvh2Traverser
+    {
+    public:
+        // pBVH has to stay valid for the traverser's lifetime
+        CpuBvh2Traverser(_In_ const void *pBVH);
+
+        CpuRayHit Trace(
+            _In_  const CpuRay &ray,
+            UINT rayFlags = CpuRayFlagNone,
+            _Inout_opt_ CpuTraversalStats *pStats = nullptr) const;
+
+        // Traces up to 8 rays as one packet
+        void TracePacket8(
+            _In_reads_(numRays) const CpuRay *pRays,
+            UINT numRays,
+            UINT rayFlags,
+            _Out_writes_(numRays) CpuRayHit *pHits) const;
+
+        void TraceStream(
+            _In_reads_(numRays) const CpuRay *pRays,
+            UINT numRays,
+            UINT rayFlags,
+            _Out_writes_(numRays) CpuRayHit *pHits) const;
+
+        // Splits the rays into tiles of raysPerTile consecutive rays, traced in parallel on the
+        // pool with the given mode. Rays of a tile should be close to each other (for example a
+        // block of pixels) for packets to stay coherent.
+        void TraceRays(
+            CpuTaskPool &pool,
+            _In_reads_(numRays) const CpuRay *pRays,
+            UINT numRays,
+            CpuTraversalMode mode,
+            UINT rayFlags,
+            _Out_writes_(numRays) CpuRayHit *pHits,
+            UINT raysPerTile = DefaultRaysPerTile) const;
+
+        static const UINT DefaultRaysPerTile = 256;
+
+        bool IsEmpty() const { return m_numNodes == 0; }
+        UINT GetMaxDepth() const { return m_maxDepth; }
+
+    private:
+        // Single ray traversal of the subtree below subtreeIndex, updating the hit passed in if a
+        // closer one is found. Returns true once an any-hit query is done.
+        template <bool CollectStats>
+        bool TraverseSubtree(
+            UINT subtreeIndex,
+            const CpuRay &ray,
+            UINT rayFlags,
+            float &hitT,
+            float &hitU,
+            float &hitV,
+            UINT &hitPrimitive,
+            CpuTraversalStats *pStats) const;
+
+        void TracePacket8Avx2(const CpuRay *pRays, UINT numRays, UINT rayFlags, CpuRayHit *pHits) const;
+        void TraceStreamAvx2(const CpuRay *pRays, UINT numRays, UINT rayFlags, CpuRayHit *pHits) const;
+
+        // Copies the node, or decodes it from a compressed BVH
+        AABBNode GetNode(UINT nodeIndex) const
+        {
+            return m_pCompressedNodes ?
+                DecompressAABBNode(*m_pCompressedHeader, m_pCompressedNodes[nodeIndex]) :
+                m_pNodes[nodeIndex];
+        }
+
+        // Only one of m_pNodes and m_pCompressedNodes is set
+        const AABBNode *m_pNodes;
+        const CompressedBVHHeader *m_pCompressedHeader;
+        const CompressedAABBNode *m_pCompressedNodes;
+        const Primitive *m_pPrimitives;
+        const PrimitiveMetaData *m_pMetadata;
+        UINT m_numNodes;
+        UINT m_maxDepth;
+        bool m_useAvx2;
+    };
+}
@@ -0,0 +1,1192 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    // Primitives and nodes handed to a worker at a time by every stage
+    static const UINT ElementsPerChunk = 16 * 1024;
+
+    // The radix sort scatters larger chunks since each one carries a histogram
+    static const UINT SortKeysPerChunk = 64 * 1024;
+    static const UINT RadixBits = 8;
+    static const UINT RadixBuckets = 1 << RadixBits;
+
+    static const UINT RootNodeIndex = 0;
+    static const UINT NoParentIndex = (UINT)-1;
+
+    // Flags of the AABBNodes, see RayTracingHelper.hlsli
+    static const UINT LeafNodeFlag = 0x80000000;
+    static const UINT ProceduralGeometryFlag = 0x40000000;
+    static const UINT LeftNodeIndexMask = 0x00ffffff;
+
+    static const float AABBMinPadding = 0.001f;
+    static const float SceneDimensionEpsilon = 0.00001f;
+
+    // Treelet optimization constants from TreeletReorder.hlsl and TreeletReorder.cpp
+    static const UINT MaxTreeletSize = 7;
+    static const UINT NumTreeletSplitPermutations = 1 << MaxTreeletSize;
+    static const UINT FirstPassMinTrianglesPerTreelet = 7;
+    static const float CostOfRayBoxIntersection = 1.0f;
+
+    class StageTimer
+    {
+    public:
+        StageTimer() : m_start(std::chrono::high_resolution_clock::now()) {}
+
+        // Milliseconds since construction or the previous call
+        double Lap()
+        {
+            const auto now = std::chrono::high_resolution_clock::now();
+            const double elapsed = std::chrono::duration<double, std::milli>(now - m_start).count();
+            m_start = now;
+            return elapsed;
+        }
+
+    private:
+        std::chrono::high_resolution_clock::time_point m_start;
+    };
+
+    // The center/half-extent box the GPU passes write into AABBNodes
+    struct BoundingBox
+    {
+        float3 center;
+        float3 halfDim;
+    };
+
+    static
+        BoundingBox AABBToBoundingBox(
+            const AABB &aabb)
+    {
+        BoundingBox box;
+        box.center = (aabb.min + aabb.max) * 0.5f;
+        box.halfDim = aabb.max - box.center;
+        return box;
+    }
+
+    static
+        AABB BoundingBoxToAABB(
+            const BoundingBox &box)
+    {
+        AABB aabb;
+        aabb.min = box.center - box.halfDim;
+        aabb.max = box.center + box.halfDim;
+        return aabb;
+    }
+
+    static
+        AABB CombineAABB(
+            const AABB &aabb0,
+            const AABB &aabb1)
+    {
+        AABB parentAABB;
+        parentAABB.min = min(aabb0.min, aabb1.min);
+        parentAABB.max = max(aabb0.max, aabb1.max);
+        return parentAABB;
+    }
+
+    static
+        float ComputeSurfaceArea(
+            const AABB &aabb)
+    {
+        const float3 dim = aabb.max - aabb.min;
+        return 2.0f * (dim.x * dim.y + dim.x * dim.z + dim.y * dim.z);
+    }
+
+    // GetBoxDataFromTriangle: the triangle's bounds, at least AABBMinPadding thick on every axis
+    static
+        BoundingBox GetTriangleBoundingBox(
+            const Triangle &tri)
+    {
+        AABB aabb;
+        aabb.min = min(min(tri.v0, tri.v1), tri.v2);
+        aabb.max = max(max(tri.v0, tri.v1), tri.v2);
+
+        const float3 padding = { AABBMinPadding, AABBMinPadding, AABBMinPadding };
+        aabb.min = min(aabb.min, aabb.max - padding);
+        return AABBToBoundingBox(aabb);
+    }
+
+    static
+        float3 GetCentroid(
+            const Primitive &primitive)
+    {
+        if (primitive.PrimitiveType == TRIANGLE_TYPE)
+        {
+            const Triangle &tri = primitive.triangle;
+            return (tri.v0 + tri.v1 + tri.v2) / 3.0f;
+        }
+        else
+        {
+            return (primitive.aabb.min + primitive.aabb.max) / 2.0f;
+        }
+    }
+
+    //
+    // Morton codes interleave the axes in y, x, z order starting from the lowest bit,
+    // like GetMortonCodesFromUnitCoord in CalculateMortonCodesBindings.h.
+    //
+
+    template <typename MortonCode>
+    struct MortonCodeTraits;
+
+    template <>
+    struct MortonCodeTraits<UINT32>
+    {
+        static const UINT BitsPerAxis = 10;
+
+        // Spreads the low 10 bits of v so that bit i moves to bit 3i
+        static UINT32 SpreadBits(UINT32 v)
+        {
+            v &= 0x3ff;
+            v = (v | (v << 16)) & 0x030000ff;
+            v = (v | (v << 8)) & 0x0300f00f;
+            v = (v | (v << 4)) & 0x030c30c3;
+            v = (v | (v << 2)) & 0x09249249;
+            return v;
+        }
+
+        static INT CountLeadingZeroes(UINT32 v)
+        {
+            // firstbithigh of 0 is -1 on the GPU
+            unsigned long highestBit;
+            if (!_BitScanReverse(&highestBit, v))
+            {
+                return 32;
+            }
+            return 31 - (INT)highestBit;
+        }
+
+        // The GPU pass breaks ties between equal codes with the index bits below the 31 bits
+        // a code can share with another
+        static const INT EqualCodesPrefixLength = 31;
+    };
+
+    template <>
+    struct MortonCodeTraits<UINT64>
+    {
+        static const UINT BitsPerAxis = 21;
+
+        static UINT64 SpreadBits(UINT64 v)
+        {
+            v &= 0x1fffff;
+            v = (v | (v << 32)) & 0x001f00000000ffffull;
+            v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+            v = (v | (v << 8)) & 0x100f00f00f00f00full;
+            v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+            v = (v | (v << 2)) & 0x1249249249249249ull;
+            return v;
+        }
+
+        static INT CountLeadingZeroes(UINT64 v)
+        {
+            // firstbithigh of 0 is -1 on the GPU
+            unsigned long highestBit;
+            if (!_BitScanReverse64(&highestBit, v))
+            {
+                return 64;
+            }
+            return 63 - (INT)highestBit;
+        }
+
+        static const INT EqualCodesPrefixLength = 64;
+    };
+
+    template <typename MortonCode>
+    static
+        MortonCode GetMortonCodeFromUnitCoord(
+            const float3 &unitCoord)
+    {
+        typedef MortonCodeTraits<MortonCode> Traits;
+        const float maxCoord = (float)(1u << Traits::BitsPerAxis);
+
+        // Clamped with the NaN behavior of HLSL's min and max, which return the other operand
+        const float3 scaledCoord = unitCoord * maxCoord;
+        const MortonCode x = (MortonCode)std::min(maxCoord - 1, std::max(0.0f, scaledCoord.x));
+        const MortonCode y = (MortonCode)std::min(maxCoord - 1, std::max(0.0f, scaledCoord.y));
+        const MortonCode z = (MortonCode)std::min(maxCoord - 1, std::max(0.0f, scaledCoord.z));
+
+        return Traits::SpreadBits(y) | (Traits::SpreadBits(x) << 1) | (Traits::SpreadBits(z) << 2);
+    }
+
+    //
+    // Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees",
+    // following BuildBVHSplits.hlsli step for step so the same codes give the same hierarchy.
+    //
+
+    template <typename MortonCode>
+    struct HierarchyBuildContext
+    {
+        const MortonCode *pMortonCodes;
+        UINT numElements;
+
+        INT GetLongestCommonPrefix(UINT indexA, UINT indexB) const
+        {
+            typedef MortonCodeTraits<MortonCode> Traits;
+            if (indexA >= numElements || indexB >= numElements)
+            {
+                return -1;
+            }
+
+            const MortonCode mortonCodeA = pMortonCodes[indexA];
+            const MortonCode mortonCodeB = pMortonCodes[indexB];
+            if (mortonCodeA != mortonCodeB)
+            {
+                return Traits::CountLeadingZeroes(mortonCodeA ^ mortonCodeB);
+            }
+            return MortonCodeTraits<UINT32>::CountLeadingZeroes(indexA ^ indexB) + Traits::EqualCodesPrefixLength;
+        }
+
+        void DetermineRange(UINT idx, UINT &first, UINT &last) const
+        {
+            INT d = GetLongestCommonPrefix(idx, idx + 1) - GetLongestCommonPrefix(idx, idx - 1);
+            d = std::max(-1, std::min(1, d));
+            const INT minPrefix = GetLongestCommonPrefix(idx, idx - d);
+
+            INT maxLength = 2;
+            while (GetLongestCommonPrefix(idx, idx + maxLength * d) > minPrefix)
+            {
+                maxLength *= 4;
+            }
+
+            INT length = 0;
+            for (INT t = maxLength / 2; t > 0; t /= 2)
+            {
+                if (GetLongestCommonPrefix(idx, idx + (length + t) * d) > minPrefix)
+                {
+                    length = length + t;
+                }
+            }
+
+            const UINT j = idx + length * d;
+            first = std::min(idx, j);
+            last = std::max(idx, j);
+        }
+
+        UINT FindSplit(UINT first, UINT last) const
+        {
+            const INT commonPrefix = GetLongestCommonPrefix(first, last);
+            UINT split = first;
+            UINT step = last - first;
+
+            do
+            {
+                step = (step + 1) >> 1;
+                const UINT newSplit = split + step;
+
+                if (newSplit < last)
+                {
+                    const INT splitPrefix = GetLongestCommonPrefix(first, newSplit);
+                    if (splitPrefix > commonPrefix)
+                    {
+                        split = newSplit;
+                    }
+                }
+            } while (step > 1);
+
+            return split;
+        }
+
+        void GenerateHierarchy(UINT idx, HierarchyNode *pHierarchy) const
+        {
+            UINT first, last;
+            DetermineRange(idx, first, last);
+            const UINT split = FindSplit(first, last);
+
+            const UINT leafNodeOffset = numElements - 1;
+            const UINT childAIndex = (split == first) ? leafNodeOffset + split : split;
+            const UINT childBIndex = (split + 1 == last) ? leafNodeOffset + split + 1 : split + 1;
+
+            pHierarchy[idx].LeftChildIndex = childAIndex;
+            pHierarchy[idx].RightChildIndex = childBIndex;
+            pHierarchy[childAIndex].ParentIndex = idx;
+            pHierarchy[childBIndex].ParentIndex = idx;
+        }
+    };
+
+    //
+    // Treelet reordering from Karras and Aila, "Fast Parallel Construction of High-Quality
+    // Bounding Volume Hierarchies", as done by TreeletReorder.hlsl.
+    //
+
+    static
+        UINT CountBits(
+            UINT mask)
+    {
+        UINT count = 0;
+        for (; mask; mask &= mask - 1)
+        {
+            count++;
+        }
+        return count;
+    }
+
+    static
+        UINT GetLowestBitIndex(
+            UINT mask)
+    {
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+    }
+
+    static
+        AABB GetTreeletLeafAABB(
+            const Primitive &primitive)
+    {
+        if (primitive.PrimitiveType == TRIANGLE_TYPE)
+        {
+            return BoundingBoxToAABB(GetTriangleBoundingBox(primitive.triangle));
+        }
+        else
+        {
+            return primitive.aabb;
+        }
+    }
+
+    static
+        void ReorderTreelet(
+            HierarchyNode *pHierarchy,
+            AABB *pAABBs,
+            UINT numInternalNodes,
+            UINT rootIndex,
+            const AABB &rootAABB)
+    {
+        // Grow the treelet by repeatedly expanding the child with the largest surface area
+        UINT nodesToReorder[MaxTreeletSize];
+        const UINT numInternalTreeletNodes = MaxTreeletSize - 1;
+        UINT internalNodes[numInternalTreeletNodes];
+        internalNodes[0] = rootIndex;
+
+        nodesToReorder[0] = pHierarchy[rootIndex].LeftChildIndex;
+        nodesToReorder[1] = pHierarchy[rootIndex].RightChildIndex;
+        for (UINT treeletSize = 2; treeletSize < MaxTreeletSize; treeletSize++)
+        {
+            // The GPU pass starts at 0 and would expand node 0 if every candidate were flat,
+            // starting below it picks the first internal node instead
+            float largestSurfaceArea = -1.0f;
+            UINT nodeIndexToTraverse = 0;
+            UINT indexOfNodeIndexToTraverse = 0;
+            for (UINT i = 0; i < treeletSize; i++)
+            {
+                const UINT treeletNodeIndex = nodesToReorder[i];
+                if (treeletNodeIndex < numInternalNodes)
+                {
+                    const float surfaceArea = ComputeSurfaceArea(pAABBs[treeletNodeIndex]);
+                    if (surfaceArea > largestSurfaceArea)
+                    {
+                        largestSurfaceArea = surfaceArea;
+                        nodeIndexToTraverse = treeletNodeIndex;
+                        indexOfNodeIndexToTraverse = i;
+                    }
+                }
+            }
+
+            const HierarchyNode &nodeToTraverse = pHierarchy[nodeIndexToTraverse];
+            internalNodes[treeletSize - 1] = nodeIndexToTraverse;
+            nodesToReorder[indexOfNodeIndexToTraverse] = nodeToTraverse.LeftChildIndex;
+            nodesToReorder[treeletSize] = nodeToTraverse.RightChildIndex;
+        }
+
+        AABB treeletAABBs[MaxTreeletSize];
+        for (UINT i = 0; i < MaxTreeletSize; i++)
+        {
+            treeletAABBs[i] = pAABBs[nodesToReorder[i]];
+        }
+
+        float area[NumTreeletSplitPermutations];
+        float optimalCost[NumTreeletSplitPermutations];
+        UINT optimalPartition[NumTreeletSplitPermutations];
+        for (UINT treeletBitmask = 1; treeletBitmask < NumTreeletSplitPermutations; treeletBitmask++)
+        {
+            AABB aabb;
+            aabb.min = { FLT_MAX, FLT_MAX, FLT_MAX };
+            aabb.max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (UINT i = 0; i < MaxTreeletSize; i++)
+            {
+                if ((1u << i) & treeletBitmask)
+                {
+                    aabb = CombineAABB(aabb, treeletAABBs[i]);
+                }
+            }
+            area[treeletBitmask] = ComputeSurfaceArea(aabb);
+        }
+
+        const float rootAABBSurfaceArea = ComputeSurfaceArea(rootAABB);
+        for (UINT i = 0; i < MaxTreeletSize; i++)
+        {
+            optimalCost[1u << i] = CostOfRayBoxIntersection * ComputeSurfaceArea(treeletAABBs[i]) / rootAABBSurfaceArea;
+        }
+
+        for (UINT bits = 2; bits <= MaxTreeletSize; bits++)
+        {
+            for (UINT treeletBitmask = (1u << bits) - 1; treeletBitmask < NumTreeletSplitPermutations; treeletBitmask++)
+            {
+                if (CountBits(treeletBitmask) != bits)
+                {
+                    continue;
+                }
+
+                // Visits the proper subsets in increasing order like the GPU's loop over every
+                // smaller mask, so ties pick the same partition
+                float lowestCost = FLT_MAX;
+                UINT bestPartition = 0;
+                for (UINT partitionBitmask = (0u - treeletBitmask) & treeletBitmask;
+                    partitionBitmask != treeletBitmask;
+                    partitionBitmask = (partitionBitmask - treeletBitmask) & treeletBitmask)
+                {
+                    const float cost = optimalCost[partitionBitmask] + optimalCost[treeletBitmask ^ partitionBitmask];
+                    if (cost < lowestCost)
+                    {
+                        lowestCost = cost;
+                        bestPartition = partitionBitmask;
+                    }
+                }
+                optimalCost[treeletBitmask] = CostOfRayBoxIntersection * area[treeletBitmask] + lowestCost;
+                optimalPartition[treeletBitmask] = bestPartition;
+            }
+        }
+
+        // Rebuild the treelet from the best partitioning, reusing its internal nodes in order
+        struct PartitionEntry
+        {
+            UINT Mask;
+            UINT NodeIndex;
+        };
+        UINT nodesAllocated = 1;
+        UINT partitionStackSize = 1;
+        PartitionEntry partitionStack[MaxTreeletSize];
+        partitionStack[0].Mask = NumTreeletSplitPermutations - 1;
+        partitionStack[0].NodeIndex = internalNodes[0];
+        while (partitionStackSize > 0)
+        {
+            const PartitionEntry partition = partitionStack[--partitionStackSize];
+
+            PartitionEntry leftEntry;
+            leftEntry.Mask = optimalPartition[partition.Mask];
+            if (CountBits(leftEntry.Mask) > 1)
+            {
+                leftEntry.NodeIndex = internalNodes[nodesAllocated++];
+                partitionStack[partitionStackSize++] = leftEntry;
+            }
+            else
+            {
+                leftEntry.NodeIndex = nodesToReorder[GetLowestBitIndex(leftEntry.Mask)];
+            }
+
+            PartitionEntry rightEntry;
+            rightEntry.Mask = partition.Mask ^ leftEntry.Mask;
+            if (CountBits(rightEntry.Mask) > 1)
+            {
+                rightEntry.NodeIndex = internalNodes[nodesAllocated++];
+                partitionStack[partitionStackSize++] = rightEntry;
+            }
+            else
+            {
+                rightEntry.NodeIndex = nodesToReorder[GetLowestBitIndex(rightEntry.Mask)];
+            }
+
+            pHierarchy[partition.NodeIndex].LeftChildIndex = leftEntry.NodeIndex;
+            pHierarchy[partition.NodeIndex].RightChildIndex = rightEntry.NodeIndex;
+            pHierarchy[leftEntry.NodeIndex].ParentIndex = partition.NodeIndex;
+            pHierarchy[rightEntry.NodeIndex].ParentIndex = partition.NodeIndex;
+        }
+
+        // Internal nodes were allocated top-down, so walking them backwards refits bottom-up
+        for (INT j = numInternalTreeletNodes - 1; j >= 0; j--)
+        {
+            const UINT internalNodeIndex = internalNodes[j];
+            pAABBs[internalNodeIndex] = CombineAABB(
+                pAABBs[pHierarchy[internalNodeIndex].LeftChildIndex],
+                pAABBs[pHierarchy[internalNodeIndex].RightChildIndex]);
+        }
+    }
+
+    //
+    // Both the treelet and AABB stages walk from every leaf towards the root. Each
+    // walk adds its primitive count to the parent's counter and only the second child
+    // to arrive continues upwards, which guarantees both subtrees are finished.
+    //
+
+    static
+        void ReorderTreeletsFromLeaf(
+            HierarchyNode *pHierarchy,
+            AABB *pAABBs,
+            std::atomic<UINT> *pTriangleCounts,
+            const Primitive *pPrimitives,
+            UINT numElements,
+            UINT minTrianglesPerTreelet,
+            UINT nodeIndex)
+    {
+        const UINT numInternalNodes = GetNumInternalNodes(numElements);
+        UINT numTriangles = 1;
+        bool isLeaf = true;
+        while (true)
+        {
+            AABB nodeAABB;
+            if (isLeaf)
+            {
+                nodeAABB = GetTreeletLeafAABB(pPrimitives[nodeIndex - numInternalNodes]);
+            }
+            else
+            {
+                nodeAABB = CombineAABB(
+                    pAABBs[pHierarchy[nodeIndex].LeftChildIndex],
+                    pAABBs[pHierarchy[nodeIndex].RightChildIndex]);
+            }
+
+            if (numTriangles >= minTrianglesPerTreelet)
+            {
+                ReorderTreelet(pHierarchy, pAABBs, numInternalNodes, nodeIndex, nodeAABB);
+            }
+            pAABBs[nodeIndex] = nodeAABB;
+
+            if (nodeIndex == RootNodeIndex)
+            {
+                return;
+            }
+
+            const UINT parentNodeIndex = pHierarchy[nodeIndex].ParentIndex;
+            const UINT numTrianglesFromOtherNode = pTriangleCounts[parentNodeIndex].fetch_add(numTriangles, std::memory_order_acq_rel);
+            if (numTrianglesFromOtherNode == 0)
+            {
+                return;
+            }
+            numTriangles += numTrianglesFromOtherNode;
+            nodeIndex = parentNodeIndex;
+            isLeaf = false;
+        }
+    }
+
+    static
+        void WriteNode(
+            AABBNode &node,
+            const BoundingBox &box,
+            UINT flagsX,
+            UINT flagsY)
+    {
+        node.center[0] = box.center.x;
+        node.center[1] = box.center.y;
+        node.center[2] = box.center.z;
+        node.nodeAllBits = flagsX;
+        node.halfDim[0] = box.halfDim.x;
+        node.halfDim[1] = box.halfDim.y;
+        node.halfDim[2] = box.halfDim.z;
+        node.rightNodeIndex = flagsY;
+    }
+
+    static
+        AABB ReadNodeAABB(
+            const AABBNode &node)
+    {
+        BoundingBox box;
+        box.center = { node.center[0], node.center[1], node.center[2] };
+        box.halfDim = { node.halfDim[0], node.halfDim[1], node.halfDim[2] };
+        return BoundingBoxToAABB(box);
+    }
+
+    static
+        void ConstructAABBsFromLeaf(
+            const HierarchyNode *pHierarchy,
+            AABBNode *pNodes,
+            std::atomic<UINT> *pTriangleCounts,
+            const Primitive *pPrimitives,
+            UINT numElements,
+            UINT nodeIndex)
+    {
+        const UINT numInternalNodes = GetNumInternalNodes(numElements);
+        UINT numTriangles = 1;
+        bool swapChildIndices = false;
+        while (true)
+        {
+            if (nodeIndex >= numInternalNodes)
+            {
+                const UINT leafIndex = nodeIndex - numInternalNodes;
+                const Primitive &primitive = pPrimitives[leafIndex];
+                if (primitive.PrimitiveType == TRIANGLE_TYPE)
+                {
+                    WriteNode(pNodes[nodeIndex], GetTriangleBoundingBox(primitive.triangle), leafIndex | LeafNodeFlag, 1);
+                }
+                else
+                {
+                    WriteNode(pNodes[nodeIndex], AABBToBoundingBox(primitive.aabb), leafIndex | LeafNodeFlag | ProceduralGeometryFlag, 1);
+                }
+            }
+            else
+            {
+                UINT leftNodeIndex = pHierarchy[nodeIndex].LeftChildIndex;
+                UINT rightNodeIndex = pHierarchy[nodeIndex].RightChildIndex;
+                if (swapChildIndices)
+                {
+                    std::swap(leftNodeIndex, rightNodeIndex);
+                }
+
+                const AABB aabb = CombineAABB(ReadNodeAABB(pNodes[leftNodeIndex]), ReadNodeAABB(pNodes[rightNodeIndex]));
+                WriteNode(pNodes[nodeIndex], AABBToBoundingBox(aabb), leftNodeIndex & LeftNodeIndexMask, rightNodeIndex);
+            }
+
+            if (nodeIndex == RootNodeIndex)
+            {
+                return;
+            }
+
+            const UINT parentNodeIndex = pHierarchy[nodeIndex].ParentIndex;
+            const UINT trianglesFromOtherChild = pTriangleCounts[parentNodeIndex].fetch_add(numTriangles, std::memory_order_acq_rel);
+            if (trianglesFromOtherChild == 0)
+            {
+                return;
+            }
+
+            // Smaller subtrees go on the left. The GPU resolves ties by which child arrived last,
+            // here they keep the hierarchy's order so the output doesn't depend on scheduling.
+            const bool isLeft = pHierarchy[parentNodeIndex].LeftChildIndex == nodeIndex;
+            const UINT leftTriangles = isLeft ? numTriangles : trianglesFromOtherChild;
+            const UINT rightTriangles = isLeft ? trianglesFromOtherChild : numTriangles;
+            swapChildIndices = leftTriangles > rightTriangles;
+
+            nodeIndex = parentNodeIndex;
+            numTriangles += trianglesFromOtherChild;
+        }
+    }
+
+    static
+        void WriteBVHOffsets(
+            BYTE *pOutputBVH,
+            UINT numElements)
+    {
+        BVHOffsets &offsets = *(BVHOffsets *)pOutputBVH;
+        offsets.offsetToBoxes = SizeOfBVHOffsets;
+        if (numElements == 0)
+        {
+            offsets.offsetToVertices = offsets.offsetToPrimitiveMetaData = offsets.totalSize = SizeOfBVHOffsets;
+            return;
+        }
+
+        offsets.offsetToVertices = GetOffsetToPrimitives(numElements);
+        offsets.offsetToPrimitiveMetaData = offsets.offsetToVertices + GetOffsetFromPrimitivesToPrimitiveMetaData(numElements);
+        offsets.totalSize = offsets.offsetToPrimitiveMetaData + numElements * SizeOfPrimitiveMetaData;
+    }
+
+    static
+        float3 TransformVertex(
+            const float3 &v,
+            const float *pTransform)
+    {
+        // Row-major 3x4 matrix applied to (v, 1)
+        float3 result;
+        result.x = pTransform[0] * v.x + pTransform[1] * v.y + pTransform[2] * v.z + pTransform[3];
+        result.y = pTransform[4] * v.x + pTransform[5] * v.y + pTransform[6] * v.z + pTransform[7];
+        result.z = pTransform[8] * v.x + pTransform[9] * v.y + pTransform[10] * v.z + pTransform[11];
+        return result;
+    }
+
+    CpuLbvhBuilder::CpuLbvhBuilder(const CpuLbvhBuildSettings &settings) :
+        m_pool(CpuTaskPool::GetShared(settings.ThreadCount)),
+        m_use63BitMortonCodes(settings.Use63BitMortonCodes)
+    {
+    }
+
+    UINT CpuLbvhBuilder::GetResultDataMaxSizeInBytes(UINT numPrimitives)
+    {
+        if (numPrimitives == 0)
+        {
+            return SizeOfBVHOffsets;
+        }
+        return GetOffsetToPrimitives(numPrimitives) + numPrimitives * (SizeOfPrimitive + SizeOfPrimitiveMetaData);
+    }
+
+    UINT CpuLbvhBuilder::GetTreeletReorderPassCount(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags)
+    {
+        const bool bPrioritizeTrace = (buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE) != 0;
+        const bool bPrioritizeBuild = (buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD) != 0;
+        return bPrioritizeTrace ? 3 : bPrioritizeBuild ? 0 : 1;
+    }
+
+    void CpuLbvhBuilder::LoadPrimitives(
+        const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc,
+        UINT totalPrimitiveCount,
+        Primitive *pPrimitives,
+        PrimitiveMetaData *pMetadata)
+    {
+        UINT numPrimitivesLoaded = 0;
+        for (UINT elementIndex = 0; elementIndex < desc.NumDescs; elementIndex++)
+        {
+            const D3D12_RAYTRACING_GEOMETRY_DESC &geometryDesc = GetGeometryDesc(desc, elementIndex);
+            const UINT numPrimitivesInGeometry = GetPrimitiveCountFromGeometryDesc(geometryDesc);
+            const UINT primitiveOffset = numPrimitivesLoaded;
+            if (numPrimitivesLoaded + numPrimitivesInGeometry > totalPrimitiveCount)
+            {
+                ThrowFailure(E_INVALIDARG, L"The geometry descs contain more primitives than totalPrimitiveCount");
+            }
+
+            if (geometryDesc.Type == D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES)
+            {
+                const D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC &triangles = geometryDesc.Triangles;
+                if (triangles.IndexBuffer == 0 && triangles.IndexFormat != DXGI_FORMAT_UNKNOWN)
+                {
+                    ThrowFailure(E_INVALIDARG, L"If the index buffer is null, the Index format must be DXGI_FORMAT_UNKNOWN");
+                }
+                if (!IsVertexBufferFormatSupported(triangles.VertexFormat))
+                {
+                    ThrowFailure(E_INVALIDARG, L"Invalid vertex format provided. Supported is limited to DXGI_FORMAT_R32G32B32_FLOAT/DXGI_FORMAT_R32G32B32A32_FLOAT");
+                }
+
+                // The CPU builders address buffers directly through their virtual addresses
+                const BYTE *pVertices = (const BYTE *)triangles.VertexBuffer.StartAddress;
+                const UINT64 vertexStride = triangles.VertexBuffer.StrideInBytes;
+                const UINT16 *pIndices16 = (const UINT16 *)triangles.IndexBuffer;
+                const UINT32 *pIndices32 = (const UINT32 *)triangles.IndexBuffer;
+                const float *pTransform = (const float *)triangles.Transform;
+                const DXGI_FORMAT indexFormat = triangles.IndexFormat;
+
+                m_pool.ParallelFor(numPrimitivesInGeometry, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+                {
+                    for (UINT localIndex = begin; localIndex < end; localIndex++)
+                    {
+                        Primitive &primitive = pPrimitives[primitiveOffset + localIndex];
+                        ZeroMemory(&primitive, sizeof(primitive));
+                        primitive.PrimitiveType = TRIANGLE_TYPE;
+                        for (UINT v = 0; v < 3; v++)
+                        {
+                            const UINT vertexIndex = localIndex * 3 + v;
+                            UINT index;
+                            switch (indexFormat)
+                            {
+                            case DXGI_FORMAT_R16_UINT:
+                                index = pIndices16[vertexIndex];
+                                break;
+                            case DXGI_FORMAT_R32_UINT:
+                                index = pIndices32[vertexIndex];
+                                break;
+                            default:
+                                index = vertexIndex;
+                                break;
+                            }
+
+                            const float *pVertex = (const float *)(pVertices + index * vertexStride);
+                            float3 vertex = { pVertex[0], pVertex[1], pVertex[2] };
+                            if (pTransform)
+                            {
+                                vertex = TransformVertex(vertex, pTransform);
+                            }
+                            primitive.triangle.v[v] = vertex;
+                        }
+
+                        pMetadata[primitiveOffset + localIndex].GeometryContributionToHitGroupIndex = elementIndex;
+                        pMetadata[primitiveOffset + localIndex].PrimitiveIndex = localIndex;
+                    }
+                });
+            }
+            else
+            {
+                if (geometryDesc.Type != D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS)
+                {
+                    ThrowFailure(E_INVALIDARG, L"Unrecognized D3D12_RAYTRACING_GEOMETRY_TYPE");
+                }
+
+                const D3D12_RAYTRACING_GEOMETRY_AABBS_DESC &aabbs = geometryDesc.AABBs;
+                if (aabbs.AABBs.StartAddress == 0 && aabbs.AABBCount > 0)
+                {
+                    ThrowFailure(E_INVALIDARG, L"Non-zero AABBCount provided with a null AABB buffer");
+                }
+
+                const BYTE *pAABBs = (const BYTE *)aabbs.AABBs.StartAddress;
+                const UINT64 aabbStride = aabbs.AABBs.StrideInBytes;
+                m_pool.ParallelFor(numPrimitivesInGeometry, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+                {
+                    for (UINT localIndex = begin; localIndex < end; localIndex++)
+                    {
+                        Primitive &primitive = pPrimitives[primitiveOffset + localIndex];
+                        ZeroMemory(&primitive, sizeof(primitive));
+                        primitive.PrimitiveType = PROCEDURAL_PRIMITIVE_TYPE;
+                        memcpy(&primitive.aabb, pAABBs + localIndex * aabbStride, sizeof(AABB));
+
+                        pMetadata[primitiveOffset + localIndex].GeometryContributionToHitGroupIndex = elementIndex;
+                        pMetadata[primitiveOffset + localIndex].PrimitiveIndex = localIndex;
+                    }
+                });
+            }
+            numPrimitivesLoaded += numPrimitivesInGeometry;
+        }
+    }
+
+    AABB CpuLbvhBuilder::CalculateSceneAABB(const Primitive *pPrimitives, UINT numElements)
+    {
+        AABB sceneAABB;
+        sceneAABB.min = { FLT_MAX, FLT_MAX, FLT_MAX };
+        sceneAABB.max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        // Min and max are exact, so reducing per chunk gives the GPU's result for any chunking
+        std::vector<AABB> chunkAABBs(DivideAndRoundUp(std::max(numElements, 1u), ElementsPerChunk), sceneAABB);
+        m_pool.ParallelFor(numElements, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+        {
+            AABB &chunkAABB = chunkAABBs[begin / ElementsPerChunk];
+            for (UINT i = begin; i < end; i++)
+            {
+                const Primitive &primitive = pPrimitives[i];
+                if (primitive.PrimitiveType == TRIANGLE_TYPE)
+                {
+                    const Triangle &tri = primitive.triangle;
+                    chunkAABB.min = min(min(min(tri.v0, chunkAABB.min), tri.v1), tri.v2);
+                    chunkAABB.max = max(max(max(tri.v0, chunkAABB.max), tri.v1), tri.v2);
+                }
+                else
+                {
+                    chunkAABB = CombineAABB(chunkAABB, primitive.aabb);
+                }
+            }
+        });
+
+        for (const AABB &chunkAABB : chunkAABBs)
+        {
+            sceneAABB = CombineAABB(sceneAABB, chunkAABB);
+        }
+        return sceneAABB;
+    }
+
+    template <typename MortonCode>
+    void CpuLbvhBuilder::CalculateMortonCodesImpl(
+        const Primitive *pPrimitives,
+        UINT numElements,
+        const AABB &sceneAABB,
+        MortonCode *pMortonCodes,
+        UINT32 *pIndices)
+    {
+        const float3 epsilon = { SceneDimensionEpsilon, SceneDimensionEpsilon, SceneDimensionEpsilon };
+        const float3 sceneDimension = max(sceneAABB.max - sceneAABB.min, epsilon);
+
+        m_pool.ParallelFor(numElements, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; i++)
+            {
+                const float3 unitCoord = (GetCentroid(pPrimitives[i]) - sceneAABB.min) / sceneDimension;
+                pMortonCodes[i] = GetMortonCodeFromUnitCoord<MortonCode>(unitCoord);
+                pIndices[i] = i;
+            }
+        });
+    }
+
+    void CpuLbvhBuilder::CalculateMortonCodes(const Primitive *pPrimitives, UINT numElements, const AABB &sceneAABB, UINT32 *pMortonCodes, UINT32 *pIndices)
+    {
+        CalculateMortonCodesImpl(pPrimitives, numElements, sceneAABB, pMortonCodes, pIndices);
+    }
+
+    void CpuLbvhBuilder::CalculateMortonCodes(const Primitive *pPrimitives, UINT numElements, const AABB &sceneAABB, UINT64 *pMortonCodes, UINT32 *pIndices)
+    {
+        CalculateMortonCodesImpl(pPrimitives, numElements, sceneAABB, pMortonCodes, pIndices);
+    }
+
+    //
+    // Least significant digit radix sort. Every chunk histograms its keys, an exclusive
+    // scan in digit then chunk order gives each chunk its output ranges, and the chunks
+    // scatter in parallel. That keeps equal keys in input order, so primitives with the
+    // same Morton code stay sorted by index.
+    //
+    template <typename MortonCode>
+    void CpuLbvhBuilder::SortImpl(MortonCode *pMortonCodes, UINT32 *pIndices, UINT numElements)
+    {
+        if (numElements < 2)
+        {
+            return;
+        }
+
+        const UINT numChunks = DivideAndRoundUp(numElements, SortKeysPerChunk);
+        std::vector<UINT> chunkOffsets(numChunks * RadixBuckets);
+        std::vector<MortonCode> tempMortonCodes(numElements);
+        std::vector<UINT32> tempIndices(numElements);
+
+        MortonCode *pSourceCodes = pMortonCodes;
+        UINT32 *pSourceIndices = pIndices;
+        MortonCode *pDestCodes = tempMortonCodes.data();
+        UINT32 *pDestIndices = tempIndices.data();
+
+        // Codes never use the bits above 3 * BitsPerAxis
+        const UINT numPasses = DivideAndRoundUp(3 * MortonCodeTraits<MortonCode>::BitsPerAxis, RadixBits);
+        for (UINT pass = 0; pass < numPasses; pass++)
+        {
+            const UINT shift = pass * RadixBits;
+            m_pool.ParallelFor(numElements, SortKeysPerChunk, [&](UINT begin, UINT end, UINT)
+            {
+                UINT *pHistogram = &chunkOffsets[(begin / SortKeysPerChunk) * RadixBuckets];
+                std::fill(pHistogram, pHistogram + RadixBuckets, 0);
+                for (UINT i = begin; i < end; i++)
+                {
+                    pHistogram[(pSourceCodes[i] >> shift) & (RadixBuckets - 1)]++;
+                }
+            });
+
+            UINT offset = 0;
+            bool bAllKeysInOneBucket = false;
+            for (UINT digit = 0; digit < RadixBuckets; digit++)
+            {
+                const UINT digitStart = offset;
+                for (UINT chunk = 0; chunk < numChunks; chunk++)
+                {
+                    UINT &chunkOffset = chunkOffsets[chunk * RadixBuckets + digit];
+                    const UINT count = chunkOffset;
+                    chunkOffset = offset;
+                    offset += count;
+                }
+                bAllKeysInOneBucket |= (offset - digitStart == numElements);
+            }
+
+            // Every key has the same digit, the scatter would only copy
+            if (bAllKeysInOneBucket)
+            {
+                continue;
+            }
+
+            m_pool.ParallelFor(numElements, SortKeysPerChunk, [&](UINT begin, UINT end, UINT)
+            {
+                UINT *pOffsets = &chunkOffsets[(begin / SortKeysPerChunk) * RadixBuckets];
+                for (UINT i = begin; i < end; i++)
+                {
+                    const UINT destIndex = pOffsets[(pSourceCodes[i] >> shift) & (RadixBuckets - 1)]++;
+                    pDestCodes[destIndex] = pSourceCodes[i];
+                    pDestIndices[destIndex] = pSourceIndices[i];
+                }
+            });
+            std::swap(pSourceCodes, pDestCodes);
+            std::swap(pSourceIndices, pDestIndices);
+        }
+
+        if (pSourceCodes != pMortonCodes)
+        {
+            m_pool.ParallelFor(numElements, SortKeysPerChunk, [&](UINT begin, UINT end, UINT)
+            {
+                memcpy(pMortonCodes + begin, pSourceCodes + begin, (end - begin) * sizeof(MortonCode));
+                memcpy(pIndices + begin, pSourceIndices + begin, (end - begin) * sizeof(UINT32));
+            });
+        }
+    }
+
+    void CpuLbvhBuilder::Sort(UINT32 *pMortonCodes, UINT32 *pIndices, UINT numElements)
+    {
+        SortImpl(pMortonCodes, pIndices, numElements);
+    }
+
+    void CpuLbvhBuilder::Sort(UINT64 *pMortonCodes, UINT32 *pIndices, UINT numElements)
+    {
+        SortImpl(pMortonCodes, pIndices, numElements);
+    }
+
+    void CpuLbvhBuilder::Rearrange(
+        const Primitive *pInputPrimitives,
+        const PrimitiveMetaData *pInputMetadata,
+        const UINT32 *pIndices,
+        UINT numElements,
+        Primitive *pOutputPrimitives,
+        PrimitiveMetaData *pOutputMetadata)
+    {
+        m_pool.ParallelFor(numElements, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT dstIndex = begin; dstIndex < end; dstIndex++)
+            {
+                const UINT srcIndex = pIndices[dstIndex];
+                pOutputPrimitives[dstIndex] = pInputPrimitives[srcIndex];
+                pOutputMetadata[dstIndex] = pInputMetadata[srcIndex];
+            }
+        });
+    }
+
+    template <typename MortonCode>
+    void CpuLbvhBuilder::ConstructHierarchyImpl(const MortonCode *pSortedMortonCodes, UINT numElements, HierarchyNode *pHierarchy)
+    {
+        if (numElements == 0)
+        {
+            return;
+        }
+
+        // Every internal node only writes itself and its children's parent links
+        pHierarchy[RootNodeIndex].ParentIndex = NoParentIndex;
+        const HierarchyBuildContext<MortonCode> context = { pSortedMortonCodes, numElements };
+        m_pool.ParallelFor(GetNumInternalNodes(numElements), ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; i++)
+            {
+                context.GenerateHierarchy(i, pHierarchy);
+            }
+        });
+    }
+
+    void CpuLbvhBuilder::ConstructHierarchy(const UINT32 *pSortedMortonCodes, UINT numElements, HierarchyNode *pHierarchy)
+    {
+        ConstructHierarchyImpl(pSortedMortonCodes, numElements, pHierarchy);
+    }
+
+    void CpuLbvhBuilder::ConstructHierarchy(const UINT64 *pSortedMortonCodes, UINT numElements, HierarchyNode *pHierarchy)
+    {
+        ConstructHierarchyImpl(pSortedMortonCodes, numElements, pHierarchy);
+    }
+
+    void CpuLbvhBuilder::ReorderTreelets(
+        HierarchyNode *pHierarchy,
+        const Primitive *pSortedPrimitives,
+        UINT numElements,
+        UINT numOptimizationPasses,
+        AABB *pAABBBuffer)
+    {
+        if (numElements == 0 || numOptimizationPasses == 0)
+        {
+            return;
+        }
+
+        const UINT numInternalNodes = GetNumInternalNodes(numElements);
+        const UINT numNodes = numInternalNodes + numElements;
+        std::unique_ptr<std::atomic<UINT>[]> triangleCounts(new std::atomic<UINT>[numNodes]);
+
+        UINT minTrianglesPerTreelet = FirstPassMinTrianglesPerTreelet;
+        for (UINT pass = 0; pass < numOptimizationPasses; pass++)
+        {
+            m_pool.ParallelFor(numInternalNodes, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+            {
+                for (UINT i = begin; i < end; i++)
+                {
+                    triangleCounts[i].store(0, std::memory_order_relaxed);
+                }
+            });
+
+            m_pool.ParallelFor(numElements, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+            {
+                for (UINT i = begin; i < end; i++)
+                {
+                    ReorderTreeletsFromLeaf(pHierarchy, pAABBBuffer, triangleCounts.get(), pSortedPrimitives, numElements, minTrianglesPerTreelet, numNodes - i - 1);
+                }
+            });
+
+            minTrianglesPerTreelet *= 2;
+        }
+    }
+
+    void CpuLbvhBuilder::ConstructAABB(const HierarchyNode *pHierarchy, UINT numElements, BYTE *pOutputBVH)
+    {
+        WriteBVHOffsets(pOutputBVH, numElements);
+        if (numElements == 0)
+        {
+            return;
+        }
+
+        const UINT numInternalNodes = GetNumInternalNodes(numElements);
+        const UINT numNodes = numInternalNodes + numElements;
+        AABBNode *pNodes = (AABBNode *)(pOutputBVH + SizeOfBVHOffsets);
+        const Primitive *pPrimitives = (const Primitive *)(pOutputBVH + GetOffsetToPrimitives(numElements));
+
+        std::unique_ptr<std::atomic<UINT>[]> triangleCounts(new std::atomic<UINT>[numNodes]);
+        m_pool.ParallelFor(numInternalNodes, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; i++)
+            {
+                triangleCounts[i].store(0, std::memory_order_relaxed);
+            }
+        });
+
+        m_pool.ParallelFor(numElements, ElementsPerChunk, [&](UINT begin, UINT end, UINT)
+        {
+            for (UINT i = begin; i < end; i++)
+            {
+                ConstructAABBsFromLeaf(pHierarchy, pNodes, triangleCounts.get(), pPrimitives, numElements, numNodes - i - 1);
+            }
+        });
+    }
+
+    template <typename MortonCode>
+    void CpuLbvhBuilder::BuildWithMortonCodes(
+        const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc,
+        UINT numElements,
+        BYTE *pOutputBVH,
+        CpuLbvhStageTimings &timings)
+    {
+        StageTimer timer;
+
+        std::vector<Primitive> primitives(numElements);
+        std::vector<PrimitiveMetaData> metadata(numElements);
+        LoadPrimitives(desc, numElements, primitives.data(), metadata.data());
+        timings.LoadPrimitives = timer.Lap();
+
+        const AABB sceneAABB = CalculateSceneAABB(primitives.data(), numElements);
+        timings.SceneAABB = timer.Lap();
+
+        std::vector<MortonCode> mortonCodes(numElements);
+        std::vector<UINT32> indices(numElements);
+        CalculateMortonCodesImpl(primitives.data(), numElements, sceneAABB, mortonCodes.data(), indices.data());
+        timings.MortonCodes = timer.Lap();
+
+        SortImpl(mortonCodes.data(), indices.data(), numElements);
+        timings.Sort = timer.Lap();
+
+        // The sorted primitives go straight to their place in the output like the GPU's
+        Primitive *pSortedPrimitives = (Primitive *)(pOutputBVH + GetOffsetToPrimitives(numElements));
+        PrimitiveMetaData *pSortedMetadata = (PrimitiveMetaData *)((BYTE *)pSortedPrimitives + GetOffsetFromPrimitivesToPrimitiveMetaData(numElements));
+        Rearrange(primitives.data(), metadata.data(), indices.data(), numElements, pSortedPrimitives, pSortedMetadata);
+        timings.Rearrange = timer.Lap();
+
+        const UINT numNodes = GetNumInternalNodes(numElements) + numElements;
+        std::vector<HierarchyNode> hierarchy(numNodes);
+        ConstructHierarchyImpl(mortonCodes.data(), numElements, hierarchy.data());
+        timings.ConstructHierarchy = timer.Lap();
+
+        const UINT numTreeletReorderPasses = GetTreeletReorderPassCount(desc.Flags);
+        if (numTreeletReorderPasses > 0)
+        {
+            std::vector<AABB> treeletAABBs(numNodes);
+            ReorderTreelets(hierarchy.data(), pSortedPrimitives, numElements, numTreeletReorderPasses, treeletAABBs.data());
+        }
+        timings.TreeletReorder = timer.Lap();
+
+        ConstructAABB(hierarchy.data(), numElements, pOutputBVH);
+        timings.ConstructAABB = timer.Lap();
+    }
+
+    void CpuLbvhBuilder::Build(
+        const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc,
+        void *pData,
+        CpuLbvhStageTimings *pTimings)
+    {
+        if (desc.Type != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL)
+        {
+            ThrowFailure(E_NOTIMPL, L"The CPU LBVH builder only builds bottom-level acceleration structures");
+        }
+
+        StageTimer buildTimer;
+        CpuLbvhStageTimings timings = {};
+
+        BYTE *pOutputBVH = (BYTE *)pData;
+        const UINT numElements = GetTotalPrimitiveCount(desc);
+        if (numElements == 0)
+        {
+            WriteBVHOffsets(pOutputBVH, 0);
+        }
+        else if (m_use63BitMortonCodes)
+        {
+            BuildWithMortonCodes<UINT64>(desc, numElements, pOutputBVH, timings);
+        }
+        else
+        {
+            BuildWithMortonCodes<UINT32>(desc, numElements, pOutputBVH, timings);
+        }
+
+        timings.Total = buildTimer.Lap();
+        if (pTimings)
+        {
+            *pTimings = timings;
+        }
+    }
+}
+
+void BuildRaytracingAccelerationStructureOnCpuLbvh(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _In_  const FallbackLayer::CpuLbvhBuildSettings &settings,
+    _Out_ void *pData,
+    _Out_opt_ FallbackLayer::CpuLbvhStageTimings *pTimings)
+{
+    FallbackLayer::CpuLbvhBuilder builder(settings);
+    builder.Build(*pDesc, pData, pTimings);
+}
@@ -0,0 +1,147 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    struct CpuLbvhBuildSettings
+    {
+        // Number of threads used for the build, 0 uses one per hardware thread
+        UINT ThreadCount = 0;
+
+        // 63-bit Morton codes (21 bits per axis) separate primitives that the 30-bit
+        // codes of the GPU pass put in the same cell. Only the hierarchy changes, the
+        // buffers written by every other stage are identical.
+        bool Use63BitMortonCodes = false;
+    };
+
+    // Wall clock time spent in each stage of CpuLbvhBuilder::Build, in milliseconds
+    struct CpuLbvhStageTimings
+    {
+        double LoadPrimitives;
+        double SceneAABB;
+        double MortonCodes;
+        double Sort;
+        double Rearrange;
+        double ConstructHierarchy;
+        double TreeletReorder;
+        double ConstructAABB;
+        double Total;
+    };
+
+    //
+    // CPU implementation of the bottom-level LBVH build done by GpuBvh2Builder. Every
+    // stage is a multithreaded version of the matching GPU pass and reads and writes
+    // the same buffer layouts, so any stage can be run on data read back from the GPU
+    // (or the other way around) to debug, benchmark or regression-test it. Build()
+    // chains them into a linear-time alternative to the binned SAH CPU builder.
+    //
+    // Results match the GPU passes bit for bit except where the GPU itself depends on
+    // scheduling:
+    // - Sort is a stable radix sort, primitives with equal Morton codes stay in index order
+    // - ConstructAABB puts the child with fewer primitives on the left like the GPU, and
+    //   keeps the hierarchy's order when both have the same count
+    //
+    class CpuLbvhBuilder
+    {
+    public:
+        CpuLbvhBuilder(const CpuLbvhBuildSettings &settings = CpuLbvhBuildSettings());
+
+        // Builds a bottom-level acceleration structure into pData, which has to hold
+        // GetResultDataMaxSizeInBytes bytes
+        void Build(
+            _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc,
+            _Out_ void *pData,
+            _Out_opt_ CpuLbvhStageTimings *pTimings = nullptr);
+
+        static UINT GetResultDataMaxSizeInBytes(UINT numPrimitives);
+
+        // LoadPrimitivesPass: one Primitive and PrimitiveMetaData per triangle or AABB of every geometry
+        void LoadPrimitives(
+            _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc,
+            _In_  UINT totalPrimitiveCount,
+            _Out_writes_(totalPrimitiveCount) Primitive *pPrimitives,
+            _Out_writes_(totalPrimitiveCount) PrimitiveMetaData *pMetadata);
+
+        // SceneAABBCalculator
+        AABB CalculateSceneAABB(_In_reads_(numElements) const Primitive *pPrimitives, UINT numElements);
+
+        // MortonCodesCalculator: pMortonCodes[i] is the code of the primitive's centroid, pIndices[i] = i
+        void CalculateMortonCodes(
+            _In_reads_(numElements) const Primitive *pPrimitives,
+            UINT numElements,
+            _In_  const AABB &sceneAABB,
+            _Out_writes_(numElements) UINT32 *pMortonCodes,
+            _Out_writes_(numElements) UINT32 *pIndices);
+
+        void CalculateMortonCodes(
+            _In_reads_(numElements) const Primitive *pPrimitives,
+            UINT numElements,
+            _In_  const AABB &sceneAABB,
+            _Out_writes_(numElements) UINT64 *pMortonCodes,
+            _Out_writes_(numElements) UINT32 *pIndices);
+
+        // BitonicSort: sorts the codes ascending and moves the indices with them
+        void Sort(_Inout_updates_(numElements) UINT32 *pMortonCodes, _Inout_updates_(numElements) UINT32 *pIndices, UINT numElements);
+        void Sort(_Inout_updates_(numElements) UINT64 *pMortonCodes, _Inout_updates_(numElements) UINT32 *pIndices, UINT numElements);
+
+        // RearrangeElementsPass: pOutput[i] = pInput[pIndices[i]]
+        void Rearrange(
+            _In_reads_(numElements) const Primitive *pInputPrimitives,
+            _In_reads_(numElements) const PrimitiveMetaData *pInputMetadata,
+            _In_reads_(numElements) const UINT32 *pIndices,
+            UINT numElements,
+            _Out_writes_(numElements) Primitive *pOutputPrimitives,
+            _Out_writes_(numElements) PrimitiveMetaData *pOutputMetadata);
+
+        // ConstructHierarchyPass: internal nodes are [0, numElements - 1), leaf i is node numElements - 1 + i.
+        // The root's ParentIndex, which the GPU pass leaves unwritten, is set to -1.
+        void ConstructHierarchy(_In_reads_(numElements) const UINT32 *pSortedMortonCodes, UINT numElements, _Out_writes_(2 * numElements - 1) HierarchyNode *pHierarchy);
+        void ConstructHierarchy(_In_reads_(numElements) const UINT64 *pSortedMortonCodes, UINT numElements, _Out_writes_(2 * numElements - 1) HierarchyNode *pHierarchy);
+
+        // TreeletReorder: pAABBBuffer receives the box of every node like the GPU pass's scratch buffer
+        void ReorderTreelets(
+            _Inout_updates_(2 * numElements - 1) HierarchyNode *pHierarchy,
+            _In_reads_(numElements) const Primitive *pSortedPrimitives,
+            UINT numElements,
+            UINT numOptimizationPasses,
+            _Out_writes_(2 * numElements - 1) AABB *pAABBBuffer);
+
+        // Number of passes TreeletReorder::Optimize runs for the build flags
+        static UINT GetTreeletReorderPassCount(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags);
+
+        // ConstructAABBPass: writes the BVHOffsets header and the AABBNodes of pOutputBVH. The
+        // sorted primitives are read from where Rearrange put them, at GetOffsetToPrimitives.
+        void ConstructAABB(_In_reads_(2 * numElements - 1) const HierarchyNode *pHierarchy, UINT numElements, _Inout_ BYTE *pOutputBVH);
+
+    private:
+        template <typename MortonCode>
+        void BuildWithMortonCodes(const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &desc, UINT numElements, BYTE *pOutputBVH, CpuLbvhStageTimings &timings);
+
+        template <typename MortonCode>
+        void CalculateMortonCodesImpl(const Primitive *pPrimitives, UINT numElements, const AABB &sceneAABB, MortonCode *pMortonCodes, UINT32 *pIndices);
+
+        template <typename MortonCode>
+        void SortImpl(MortonCode *pMortonCodes, UINT32 *pIndices, UINT numElements);
+
+        template <typename MortonCode>
+        void ConstructHierarchyImpl(const MortonCode *pSortedMortonCodes, UINT numElements, HierarchyNode *pHierarchy);
+
+        CpuTaskPool &m_pool;
+        bool m_use63BitMortonCodes;
+    };
+}
+
+void BuildRaytracingAccelerationStructureOnCpuLbvh(
+    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
+    _In_  const FallbackLayer::CpuLbvhBuildSettings &settings,
+    _Out_ void *pData,
+    _Out_opt_ FallbackLayer::CpuLbvhStageTimings *pTimings = nullptr);
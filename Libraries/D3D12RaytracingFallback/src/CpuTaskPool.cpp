@@ -0,0 +1,218 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+
+namespace FallbackLayer
+{
+    CpuTaskPool::CpuTaskPool(UINT threadCount) :
+        m_pendingTasks(0),
+        m_sleepingWorkers(0),
+        m_workEpoch(0),
+        m_generation(0),
+        m_activeWorkers(0),
+        m_shutdown(false)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        for (UINT i = 0; i < threadCount; i++)
+        {
+            m_queues.emplace_back(new WorkerQueue);
+        }
+
+        // Worker 0 is whichever thread calls Run()
+        for (UINT i = 1; i < threadCount; i++)
+        {
+            m_threads.emplace_back(&CpuTaskPool::WorkerThread, this, i);
+        }
+    }
+
+    CpuTaskPool::~CpuTaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeLock);
+            m_shutdown = true;
+        }
+        m_wakeCondition.notify_all();
+
+        for (auto &thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    CpuTaskPool &CpuTaskPool::GetShared(UINT threadCount)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        // Never destroyed, joining the workers from a static destructor can deadlock on exit
+        static std::mutex s_lock;
+        static std::map<UINT, CpuTaskPool *> s_pools;
+
+        std::lock_guard<std::mutex> lock(s_lock);
+        CpuTaskPool *&pPool = s_pools[threadCount];
+        if (pPool == nullptr)
+        {
+            pPool = new CpuTaskPool(threadCount);
+        }
+        return *pPool;
+    }
+
+    void CpuTaskPool::Run(TaskFunction function, void *pContext)
+    {
+        std::lock_guard<std::mutex> runLock(m_runLock);
+        assert(m_pendingTasks == 0);
+
+        m_pendingTasks = 1;
+        {
+            std::lock_guard<std::mutex> lock(m_queues[0]->lock);
+            m_queues[0]->tasks.push_back({ function, pContext });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_wakeLock);
+            m_generation++;
+        }
+        m_wakeCondition.notify_all();
+
+        ExecuteUntilZero(0, m_pendingTasks);
+
+        // Don't let the caller release task data while a worker may still be looking at a queue
+        std::unique_lock<std::mutex> lock(m_wakeLock);
+        m_idleCondition.wait(lock, [this] { return m_activeWorkers == 0; });
+    }
+
+    void CpuTaskPool::Spawn(UINT workerIndex, TaskFunction function, void *pContext)
+    {
+        m_pendingTasks.fetch_add(1);
+
+        {
+            WorkerQueue &queue = *m_queues[workerIndex];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.tasks.push_back({ function, pContext });
+        }
+        WakeSleepingWorkers();
+    }
+
+    bool CpuTaskPool::AnyQueuedTask()
+    {
+        for (auto &pQueue : m_queues)
+        {
+            std::lock_guard<std::mutex> lock(pQueue->lock);
+            if (!pQueue->tasks.empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void CpuTaskPool::WakeSleepingWorkers()
+    {
+        // Pairs with the increment in ExecuteUntilZero: either the sleeper sees the new task or
+        // finished counter when it checks again, or this sees the sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepingWorkers.load() != 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_workLock);
+                m_workEpoch++;
+            }
+            m_workCondition.notify_all();
+        }
+    }
+
+    bool CpuTaskPool::PopOrSteal(UINT workerIndex, Task &task)
+    {
+        {
+            WorkerQueue &queue = *m_queues[workerIndex];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (!queue.tasks.empty())
+            {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+
+        const UINT workerCount = GetWorkerCount();
+        for (UINT i = 1; i < workerCount; i++)
+        {
+            WorkerQueue &victim = *m_queues[(workerIndex + i) % workerCount];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void CpuTaskPool::ExecuteUntilZero(UINT workerIndex, const std::atomic<UINT> &counter)
+    {
+        while (counter.load() != 0)
+        {
+            Task task;
+            if (PopOrSteal(workerIndex, task))
+            {
+                task.function(*this, workerIndex, task.pContext);
+                m_pendingTasks.fetch_sub(1);
+
+                // Whoever waits on a counter this task brought to zero may be asleep
+                WakeSleepingWorkers();
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(m_workLock);
+                m_sleepingWorkers.fetch_add(1);
+                const UINT64 epoch = m_workEpoch;
+                if (counter.load() != 0 && !AnyQueuedTask())
+                {
+                    m_workCondition.wait(lock, [&] { return m_workEpoch != epoch; });
+                }
+                m_sleepingWorkers.fetch_sub(1);
+            }
+        }
+    }
+
+    void CpuTaskPool::WorkerThread(UINT workerIndex)
+    {
+        UINT64 lastGeneration = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_wakeLock);
+                m_wakeCondition.wait(lock, [&] { return m_shutdown || m_generation != lastGeneration; });
+                if (m_shutdown)
+                {
+                    return;
+                }
+                lastGeneration = m_generation;
+                m_activeWorkers++;
+            }
+
+            ExecuteUntilZero(workerIndex, m_pendingTasks);
+
+            {
+                std::lock_guard<std::mutex> lock(m_wakeLock);
+                m_activeWorkers--;
+            }
+            m_idleCondition.notify_all();
+        }
+    }
+}
@@ -0,0 +1,158 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+
+namespace FallbackLayer
+{
+    //
+    // Small work-stealing thread pool used by the CPU acceleration structure code.
+    // Every worker owns a deque that it pushes to and pops from LIFO, idle workers
+    // steal FIFO from the others. The thread calling Run() participates as worker 0.
+    // Concurrent Run() calls on the same pool execute one after the other.
+    //
+    class CpuTaskPool
+    {
+    public:
+        typedef void(*TaskFunction)(CpuTaskPool &pool, UINT workerIndex, void *pContext);
+
+        // A thread count of 0 creates one worker per hardware thread
+        CpuTaskPool(UINT threadCount = 0);
+        ~CpuTaskPool();
+
+        UINT GetWorkerCount() const { return (UINT)m_queues.size(); }
+
+        // Pool shared by every caller asking for the same thread count. Created on first use
+        // and kept for the lifetime of the process, so per-frame work doesn't start threads.
+        static CpuTaskPool &GetShared(UINT threadCount = 0);
+
+        // Executes the task and everything it spawns. Returns once all of it has finished.
+        void Run(TaskFunction function, void *pContext);
+
+        // Queues work on the calling worker. Only valid from inside a task started by Run().
+        void Spawn(UINT workerIndex, TaskFunction function, void *pContext);
+
+        // Splits [0, count) into chunks of grainSize and invokes function(begin, end, workerIndex)
+        // on each of them. Only valid from inside a task; the calling worker keeps executing
+        // queued work until every chunk has completed.
+        template <typename Function>
+        void ParallelFor(UINT workerIndex, UINT count, UINT grainSize, const Function &function);
+
+        // Same as above for callers that are not already running on the pool
+        template <typename Function>
+        void ParallelFor(UINT count, UINT grainSize, const Function &function);
+
+    private:
+        struct Task
+        {
+            TaskFunction function;
+            void *pContext;
+        };
+
+        struct WorkerQueue
+        {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        template <typename Function>
+        struct ParallelForChunk
+        {
+            const Function *pFunction;
+            UINT begin;
+            UINT end;
+            std::atomic<UINT> *pRemainingChunks;
+        };
+
+        template <typename Function>
+        static void RunParallelForChunk(CpuTaskPool &pool, UINT workerIndex, void *pContext)
+        {
+            UNREFERENCED_PARAMETER(pool);
+            ParallelForChunk<Function> &chunk = *(ParallelForChunk<Function> *)pContext;
+            (*chunk.pFunction)(chunk.begin, chunk.end, workerIndex);
+            chunk.pRemainingChunks->fetch_sub(1);
+        }
+
+        bool PopOrSteal(UINT workerIndex, Task &task);
+        bool AnyQueuedTask();
+        void WakeSleepingWorkers();
+        void ExecuteUntilZero(UINT workerIndex, const std::atomic<UINT> &counter);
+        void WorkerThread(UINT workerIndex);
+
+        std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+        std::vector<std::thread> m_threads;
+        std::atomic<UINT> m_pendingTasks;
+        std::mutex m_runLock;
+
+        // Workers with nothing to execute sleep here until a task is queued or one finishes
+        std::mutex m_workLock;
+        std::condition_variable m_workCondition;
+        std::atomic<UINT> m_sleepingWorkers;
+        UINT64 m_workEpoch;
+
+        std::mutex m_wakeLock;
+        std::condition_variable m_wakeCondition;
+        std::condition_variable m_idleCondition;
+        UINT64 m_generation;
+        UINT m_activeWorkers;
+        bool m_shutdown;
+    };
+
+    template <typename Function>
+    void CpuTaskPool::ParallelFor(UINT workerIndex, UINT count, UINT grainSize, const Function &function)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        grainSize = std::max(grainSize, 1u);
+        const UINT numChunks = DivideAndRoundUp(count, grainSize);
+        if (numChunks == 1 || GetWorkerCount() == 1)
+        {
+            // Callers may rely on the chunk boundaries, so keep them even when running serially
+            for (UINT begin = 0; begin < count; begin += grainSize)
+            {
+                function(begin, std::min(count, begin + grainSize), workerIndex);
+            }
+            return;
+        }
+
+        std::atomic<UINT> remainingChunks(numChunks);
+        std::vector<ParallelForChunk<Function>> chunks(numChunks);
+        for (UINT i = 0; i < numChunks; i++)
+        {
+            chunks[i].pFunction = &function;
+            chunks[i].begin = i * grainSize;
+            chunks[i].end = std::min(count, (i + 1) * grainSize);
+            chunks[i].pRemainingChunks = &remainingChunks;
+            Spawn(workerIndex, &RunParallelForChunk<Function>, &chunks[i]);
+        }
+
+        ExecuteUntilZero(workerIndex, remainingChunks);
+    }
+
+    template <typename Function>
+    void CpuTaskPool::ParallelFor(UINT count, UINT grainSize, const Function &function)
+    {
+        struct RootContext
+        {
+            UINT count;
+            UINT grainSize;
+            const Function *pFunction;
+        } context = { count, grainSize, &function };
+
+        Run([](CpuTaskPool &pool, UINT workerIndex, void *pContext)
+        {
+            const RootContext &root = *(const RootContext *)pContext;
+            pool.ParallelFor(workerIndex, root.count, root.grainSize, *root.pFunction);
+        }, &context);
+    }
+}
@@ -719,6 +719,600 @@ namespace FallbackLayerUnitTests
                 testCase);
         }
 
+        TEST_METHOD(ParallelBottomLevelCpuBVHBuilderMatchesSingleThreaded)
+        {
+            // Enough triangles for the builder to spawn tasks and bin in parallel. Each geometry
+            // uses every vertex a 16-bit index buffer can address exactly once.
+            const UINT numGeoms = 4;
+            const UINT verticesPerGeom = 65535;
+            std::vector<UINT16> indices(verticesPerGeom);
+            for (UINT i = 0; i < verticesPerGeom; i++)
+            {
+                indices[i] = (UINT16)i;
+            }
+
+            srand(10);
+            std::vector<float> vertices[numGeoms];
+            std::vector<CpuGeometryDescriptor> testCases;
+            for (UINT geom = 0; geom < numGeoms; geom++)
+            {
+                vertices[geom].resize(verticesPerGeom * 3);
+                for (float &f : vertices[geom])
+                {
+                    f = (rand() / (float)RAND_MAX) * 200.0f - 100.0f;
+                }
+                testCases.push_back(CpuGeometryDescriptor(vertices[geom].data(), verticesPerGeom, indices.data(), (UINT)indices.size()));
+            }
+
+            FallbackLayer::CpuBvh2BuildSettings singleThreaded;
+            singleThreaded.ThreadCount = 1;
+            std::unique_ptr<BYTE[]> pSingleThreadedData;
+            UINT singleThreadedSize = TestCpuBvh2Builder(testCases.data(), numGeoms, singleThreaded, pSingleThreadedData);
+
+            FallbackLayer::CpuBvh2BuildSettings multiThreaded;
+            multiThreaded.ThreadCount = 8;
+            std::unique_ptr<BYTE[]> pMultiThreadedData;
+            UINT multiThreadedSize = TestCpuBvh2Builder(testCases.data(), numGeoms, multiThreaded, pMultiThreadedData);
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)pSingleThreadedData.get();
+            Assert::AreEqual(singleThreadedSize, multiThreadedSize);
+            Assert::IsTrue(memcmp(pSingleThreadedData.get(), pMultiThreadedData.get(), offsets.totalSize) == 0,
+                L"Deterministic CPU BVH builds differ between thread counts");
+
+            FallbackLayer::CpuBvh2BuildSettings nonDeterministic;
+            nonDeterministic.Deterministic = false;
+            std::unique_ptr<BYTE[]> pNonDeterministicData;
+            TestCpuBvh2Builder(testCases.data(), numGeoms, nonDeterministic, pNonDeterministicData);
+        }
+
+        TEST_METHOD(BottomLevelCpuLBVHBuilder)
+        {
+            CpuGeometryDescriptor testCases[] =
+            {
+                CpuGeometryDescriptor(ReferenceVerticies0, VERTEX_COUNT(ReferenceVerticies0), ReferenceIndices0, ARRAYSIZE(ReferenceIndices0)),
+                CpuGeometryDescriptor(ReferenceVerticies1, VERTEX_COUNT(ReferenceVerticies1), ReferenceIndices1, ARRAYSIZE(ReferenceIndices1))
+            };
+
+            for (UINT testIndex = 0; testIndex < ARRAYSIZE(testCases); testIndex++)
+            {
+                for (bool use63BitMortonCodes : { false, true })
+                {
+                    FallbackLayer::CpuLbvhBuildSettings settings;
+                    settings.Use63BitMortonCodes = use63BitMortonCodes;
+                    std::unique_ptr<BYTE[]> pData;
+                    TestCpuLbvhBuilder(&testCases[testIndex], 1, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE, settings, pData);
+                }
+            }
+        }
+
+        TEST_METHOD(ParallelBottomLevelCpuLBVHBuilderMatchesSingleThreaded)
+        {
+            // Large enough for every stage to split its work into several chunks
+            const UINT numGeoms = 4;
+            const UINT verticesPerGeom = 65535;
+            std::vector<UINT16> indices(verticesPerGeom);
+            for (UINT i = 0; i < verticesPerGeom; i++)
+            {
+                indices[i] = (UINT16)i;
+            }
+
+            srand(11);
+            std::vector<float> vertices[numGeoms];
+            std::vector<CpuGeometryDescriptor> testCases;
+            for (UINT geom = 0; geom < numGeoms; geom++)
+            {
+                vertices[geom].resize(verticesPerGeom * 3);
+                for (float &f : vertices[geom])
+                {
+                    f = (rand() / (float)RAND_MAX) * 200.0f - 100.0f;
+                }
+                testCases.push_back(CpuGeometryDescriptor(vertices[geom].data(), verticesPerGeom, indices.data(), (UINT)indices.size()));
+            }
+
+            const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags[] = {
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE };
+            for (auto flags : buildFlags)
+            {
+                for (bool use63BitMortonCodes : { false, true })
+                {
+                    FallbackLayer::CpuLbvhBuildSettings singleThreaded;
+                    singleThreaded.ThreadCount = 1;
+                    singleThreaded.Use63BitMortonCodes = use63BitMortonCodes;
+                    std::unique_ptr<BYTE[]> pSingleThreadedData;
+                    UINT size = TestCpuLbvhBuilder(testCases.data(), numGeoms, flags, singleThreaded, pSingleThreadedData);
+
+                    FallbackLayer::CpuLbvhBuildSettings multiThreaded = singleThreaded;
+                    multiThreaded.ThreadCount = 8;
+                    std::unique_ptr<BYTE[]> pMultiThreadedData;
+                    TestCpuLbvhBuilder(testCases.data(), numGeoms, flags, multiThreaded, pMultiThreadedData);
+
+                    Assert::IsTrue(memcmp(pSingleThreadedData.get(), pMultiThreadedData.get(), size) == 0,
+                        L"CPU LBVH builds differ between thread counts");
+                }
+            }
+        }
+
+        TEST_METHOD(CpuTraversalMatchesBruteForce)
+        {
+            srand(12);
+            std::vector<TraversalScene> scenes = CreateStandardScenes();
+            ForEachTraversalScene(scenes, [&](TraversalScene &scene, CpuGeometryDescriptor &geomDesc, const std::vector<CpuRay> &rays)
+            {
+                std::unique_ptr<BYTE[]> pSahData, pLbvhData;
+                TestCpuBvh2Builder(&geomDesc, 1, FallbackLayer::CpuBvh2BuildSettings(), pSahData);
+                TestCpuLbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE, FallbackLayer::CpuLbvhBuildSettings(), pLbvhData);
+
+                VerifyCpuTraversal(scene, pSahData.get(), rays);
+                VerifyCpuTraversal(scene, pLbvhData.get(), rays);
+            });
+        }
+
+        TEST_METHOD(CompressedBottomLevelCpuBVHBuilderIsConservative)
+        {
+            srand(13);
+            std::vector<TraversalScene> scenes = CreateStandardScenes();
+
+            // Far from the origin the fp16 offsets have the least precision left for small boxes
+            TraversalScene offsetScene = CreateSphereScene(32);
+            for (UINT i = 0; i < offsetScene.vertices.size(); i += 3)
+            {
+                offsetScene.vertices[i] += 5000.0f;
+                offsetScene.vertices[i + 2] -= 300.0f;
+            }
+            scenes.push_back(offsetScene);
+
+            FallbackLayer::CpuBvh2BuildSettings compressed;
+            compressed.CompressNodes = true;
+            ForEachTraversalScene(scenes, [&](TraversalScene &scene, CpuGeometryDescriptor &geomDesc, const std::vector<CpuRay> &rays)
+            {
+                std::unique_ptr<BYTE[]> pData, pCompressedData;
+                TestCpuBvh2Builder(&geomDesc, 1, FallbackLayer::CpuBvh2BuildSettings(), pData);
+                TestCpuBvh2Builder(&geomDesc, 1, compressed, pCompressedData);
+
+                const BVHOffsets &offsets = *(const BVHOffsets *)pData.get();
+                const BVHOffsets &compressedOffsets = *(const BVHOffsets *)pCompressedData.get();
+                const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / SizeOfAABBNode;
+                Assert::IsTrue(FallbackLayer::IsCompressedBVH(pCompressedData.get() + compressedOffsets.offsetToBoxes));
+                Assert::AreEqual(FallbackLayer::GetCompressedBoxesSize(numNodes), compressedOffsets.offsetToVertices - compressedOffsets.offsetToBoxes);
+
+                VerifyNodesContainPrimitives(pCompressedData.get());
+                VerifyCpuTraversal(scene, pCompressedData.get(), rays);
+            });
+        }
+
+        TEST_METHOD(CpuBVHUpdateMatchesDeformedGeometry)
+        {
+            srand(14);
+            for (TraversalScene &scene : CreateStandardScenes())
+            {
+                // Traced against the geometry the BVH is updated to, not the one it was built from
+                TraversalScene deformedScene = TwistScene(scene, 1.5f);
+                std::vector<CpuRay> rays = CreateTestRays(deformedScene);
+
+                CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+                CpuGeometryDescriptor deformedGeomDesc = deformedScene.GetGeometryDescriptor();
+                for (bool compressNodes : { false, true })
+                {
+                    FallbackLayer::CpuBvh2BuildSettings settings;
+                    settings.CompressNodes = compressNodes;
+
+                    std::unique_ptr<BYTE[]> pData;
+                    const UINT size = TestCpuBvh2Builder(&geomDesc, 1, settings, pData);
+                    const UINT totalSize = ((const BVHOffsets *)pData.get())->totalSize;
+                    std::unique_ptr<BYTE[]> pRefitData(new BYTE[size]);
+                    std::unique_ptr<BYTE[]> pRebuiltData(new BYTE[size]);
+
+                    // Refitting to the vertices the BVH was built from has to give back the build
+                    UpdateCpuBvh2(&geomDesc, 1, settings, pData.get(), pRefitData.get());
+                    Assert::IsTrue(memcmp(pData.get(), pRefitData.get(), totalSize) == 0, L"Updating with unchanged geometry changed the BVH");
+
+                    FallbackLayer::CpuBvh2UpdateStats refitStats;
+                    UpdateCpuBvh2(&deformedGeomDesc, 1, settings, pData.get(), pRefitData.get(), &refitStats);
+                    Assert::AreEqual(0u, refitStats.RebuiltSubtrees);
+                    VerifyNodesContainPrimitives(pRefitData.get());
+                    VerifyCpuTraversal(deformedScene, pRefitData.get(), rays);
+
+                    // Splices the rebuilt subtrees back in however much of the tree they cover
+                    FallbackLayer::CpuBvh2BuildSettings rebuildSettings = settings;
+                    rebuildSettings.UpdateRebuildThreshold = 1.1f;
+                    rebuildSettings.UpdateFullRebuildFraction = 1.0f;
+                    FallbackLayer::CpuBvh2UpdateStats rebuildStats;
+                    UpdateCpuBvh2(&deformedGeomDesc, 1, rebuildSettings, pData.get(), pRebuiltData.get(), &rebuildStats);
+                    Assert::IsTrue(rebuildStats.RebuiltSubtrees > 0, L"No degraded subtree was rebuilt");
+                    Assert::IsTrue(rebuildStats.SahCost < refitStats.SahCost, L"Rebuilding degraded subtrees didn't improve on refitting");
+                    Assert::AreEqual(rebuildStats.SahCost, FallbackLayer::ComputeSahCost(pRebuiltData.get()), 1e-3f * rebuildStats.SahCost);
+                    VerifyNodesContainPrimitives(pRebuiltData.get());
+                    VerifyCpuTraversal(deformedScene, pRebuiltData.get(), rays);
+
+                    // Past UpdateFullRebuildFraction the update is a plain build of the new geometry
+                    FallbackLayer::CpuBvh2BuildSettings fullRebuildSettings = rebuildSettings;
+                    fullRebuildSettings.UpdateFullRebuildFraction = 0.0f;
+                    FallbackLayer::CpuBvh2UpdateStats fullRebuildStats;
+                    UpdateCpuBvh2(&deformedGeomDesc, 1, fullRebuildSettings, pData.get(), pRebuiltData.get(), &fullRebuildStats);
+                    std::unique_ptr<BYTE[]> pDeformedData;
+                    TestCpuBvh2Builder(&deformedGeomDesc, 1, settings, pDeformedData);
+                    Assert::AreEqual(1u, fullRebuildStats.RebuiltSubtrees);
+                    Assert::IsTrue(memcmp(pDeformedData.get(), pRebuiltData.get(), ((const BVHOffsets *)pDeformedData.get())->totalSize) == 0,
+                        L"Full rebuild during an update differs from a build of the same geometry");
+
+                    // In place updates read the whole source before writing
+                    UpdateCpuBvh2(&deformedGeomDesc, 1, settings, pData.get(), pData.get());
+                    Assert::IsTrue(memcmp(pData.get(), pRefitData.get(), totalSize) == 0, L"In place and out of place updates differ");
+                }
+            }
+        }
+
+        TEST_METHOD(SpatialSplitCpuBVHBuilderMatchesBruteForce)
+        {
+            srand(15);
+            std::vector<TraversalScene> scenes = CreateStandardScenes();
+            scenes.push_back(CreateDiagonalScene(1500));
+            ForEachTraversalScene(scenes, [&](TraversalScene &scene, CpuGeometryDescriptor &geomDesc, const std::vector<CpuRay> &rays)
+            {
+                std::unique_ptr<BYTE[]> pBinnedData;
+                TestCpuBvh2Builder(&geomDesc, 1, FallbackLayer::CpuBvh2BuildSettings(), pBinnedData);
+
+                for (UINT maxTrianglesInLeaf : { 1u, 4u })
+                {
+                    FallbackLayer::CpuBvh2BuildSettings settings;
+                    settings.MaxTrianglesInLeaf = maxTrianglesInLeaf;
+                    settings.CpuTraversalOnly = maxTrianglesInLeaf > MAX_TRIS_IN_LEAF;
+
+                    std::unique_ptr<BYTE[]> pData;
+                    TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, settings, pData);
+                    VerifyCpuTraversal(scene, pData.get(), rays);
+
+                    // Long diagonal triangles are what spatial splits are for
+                    if (scene.pName == std::wstring(L"Diagonal"))
+                    {
+                        Assert::IsTrue(FallbackLayer::ComputeSahCost(pData.get()) < FallbackLayer::ComputeSahCost(pBinnedData.get()),
+                            L"Spatial splits didn't improve on the binned builder");
+                    }
+
+                    FallbackLayer::CpuBvh2BuildSettings singleThreaded = settings;
+                    singleThreaded.ThreadCount = 1;
+                    std::unique_ptr<BYTE[]> pSingleThreadedData;
+                    TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, singleThreaded, pSingleThreadedData);
+                    Assert::IsTrue(memcmp(pData.get(), pSingleThreadedData.get(), ((const BVHOffsets *)pData.get())->totalSize) == 0,
+                        L"Spatial split builds differ between thread counts");
+
+                    FallbackLayer::CpuBvh2BuildSettings compressed = settings;
+                    compressed.CompressNodes = true;
+                    std::unique_ptr<BYTE[]> pCompressedData;
+                    TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, compressed, pCompressedData);
+                    VerifyCpuTraversal(scene, pCompressedData.get(), rays);
+
+                    // Any-hit shaders of this geometry may only see each triangle once
+                    std::unique_ptr<BYTE[]> pNoDuplicatesData;
+                    TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION, settings, pNoDuplicatesData);
+                    VerifyCpuTraversal(scene, pNoDuplicatesData.get(), rays);
+                }
+            });
+        }
+
+        TEST_METHOD(SpatialSplitCpuBVHUpdateMatchesDeformedGeometry)
+        {
+            srand(16);
+            std::vector<TraversalScene> scenes = CreateStandardScenes();
+            scenes.push_back(CreateDiagonalScene(1500));
+            for (TraversalScene &scene : scenes)
+            {
+                TraversalScene deformedScene = TwistScene(scene, 1.5f);
+                std::vector<CpuRay> rays = CreateTestRays(deformedScene);
+
+                CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+                CpuGeometryDescriptor deformedGeomDesc = deformedScene.GetGeometryDescriptor();
+                for (UINT maxTrianglesInLeaf : { 1u, 4u })
+                {
+                    FallbackLayer::CpuBvh2BuildSettings settings;
+                    settings.MaxTrianglesInLeaf = maxTrianglesInLeaf;
+                    settings.CpuTraversalOnly = maxTrianglesInLeaf > MAX_TRIS_IN_LEAF;
+
+                    std::unique_ptr<BYTE[]> pData, pDeformedData;
+                    const UINT size = TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, settings, pData);
+                    TestCpuSbvhBuilder(&deformedGeomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, settings, pDeformedData);
+                    std::unique_ptr<BYTE[]> pUpdatedData(new BYTE[size]);
+
+                    // Refitting grows split references back to their whole triangle
+                    UpdateCpuSbvh(&deformedGeomDesc, 1, settings, pData.get(), pUpdatedData.get());
+                    VerifyNodesContainPrimitives(pUpdatedData.get());
+                    VerifyCpuTraversal(deformedScene, pUpdatedData.get(), rays);
+
+                    FallbackLayer::CpuBvh2BuildSettings rebuildSettings = settings;
+                    rebuildSettings.UpdateRebuildThreshold = 1.1f;
+                    rebuildSettings.UpdateFullRebuildFraction = 1.0f;
+                    FallbackLayer::CpuBvh2UpdateStats rebuildStats;
+                    UpdateCpuSbvh(&deformedGeomDesc, 1, rebuildSettings, pData.get(), pUpdatedData.get(), &rebuildStats);
+                    Assert::IsTrue(rebuildStats.RebuiltSubtrees > 0, L"No degraded subtree was rebuilt");
+                    VerifyCpuTraversal(deformedScene, pUpdatedData.get(), rays);
+
+                    // Rebuilding from the root, spliced in or as a full build, has to give what a
+                    // build of the new geometry does, leaf size and spatial splits included
+                    for (float fullRebuildFraction : { 1.0f, 0.0f })
+                    {
+                        rebuildSettings.UpdateRebuildThreshold = 1e-3f;
+                        rebuildSettings.UpdateFullRebuildFraction = fullRebuildFraction;
+                        UpdateCpuSbvh(&deformedGeomDesc, 1, rebuildSettings, pData.get(), pUpdatedData.get());
+                        Assert::IsTrue(memcmp(pDeformedData.get(), pUpdatedData.get(), ((const BVHOffsets *)pDeformedData.get())->totalSize) == 0,
+                            L"Rebuilding a spatial split BVH from the root differs from a build of the same geometry");
+                    }
+                }
+            }
+        }
+
+        // The traversal shaders only test the first triangle of a leaf
+        TEST_METHOD(CpuBVHBuilderRejectsMultiTriangleLeavesForGpuTraversal)
+        {
+            srand(17);
+            TraversalScene scene = CreateTriangleSoupScene(64);
+            CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+
+            FallbackLayer::CpuBvh2BuildSettings settings;
+            settings.MaxTrianglesInLeaf = 4;
+            Assert::ExpectException<_com_error>([&]()
+            {
+                std::unique_ptr<BYTE[]> pData;
+                TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, settings, pData);
+            });
+
+            settings.CpuTraversalOnly = true;
+            std::unique_ptr<BYTE[]> pData;
+            TestCpuSbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_GEOMETRY_FLAG_NONE, settings, pData);
+        }
+
+        // Rays per second of every traversal mode and query on the standard scenes, written to the
+        // test output. Meant to be run on its own in Release: /TestCaseFilter:"TestCategory=Benchmark"
+        BEGIN_TEST_METHOD_ATTRIBUTE(CpuTraversalBenchmark)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(CpuTraversalBenchmark)
+        {
+            const UINT imageSize = 512;
+            const UINT numDiffuseRays = imageSize * imageSize;
+
+            // Traversal statistics come from single ray traces of every StatsSampleRate-th ray
+            const UINT StatsSampleRate = 16;
+
+            const CpuTraversalMode modes[] = { CpuTraversalModeSingleRay, CpuTraversalModePacket8, CpuTraversalModeStream };
+            const LPCWSTR modeNames[] = { L"single", L"packet8", L"stream" };
+            const UINT queries[] = { CpuRayFlagNone, CpuRayFlagAcceptFirstHitAndEndSearch };
+            const LPCWSTR queryNames[] = { L"closest", L"any" };
+
+            srand(13);
+            FallbackLayer::CpuTaskPool pool;
+            for (TraversalScene &scene : CreateStandardScenes(256, 100000))
+            {
+                std::vector<CpuRay> raySets[] = { CreatePrimaryRays(scene, imageSize, imageSize), CreateDiffuseRays(scene, numDiffuseRays) };
+                const LPCWSTR raySetNames[] = { L"primary", L"diffuse" };
+
+                CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+                std::unique_ptr<BYTE[]> pBVHs[2];
+                TestCpuBvh2Builder(&geomDesc, 1, FallbackLayer::CpuBvh2BuildSettings(), pBVHs[0]);
+                TestCpuLbvhBuilder(&geomDesc, 1, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE, FallbackLayer::CpuLbvhBuildSettings(), pBVHs[1]);
+                const LPCWSTR builderNames[] = { L"SAH", L"LBVH" };
+
+                for (UINT builder = 0; builder < ARRAYSIZE(pBVHs); builder++)
+                {
+                    FallbackLayer::CpuBvh2Traverser traverser(pBVHs[builder].get());
+                    for (UINT raySet = 0; raySet < ARRAYSIZE(raySets); raySet++)
+                    {
+                        const std::vector<CpuRay> &rays = raySets[raySet];
+                        std::vector<CpuRayHit> hits(rays.size());
+                        for (UINT query = 0; query < ARRAYSIZE(queries); query++)
+                        {
+                            CpuTraversalStats stats = {};
+                            UINT numSampledRays = 0;
+                            for (UINT i = 0; i < rays.size(); i += StatsSampleRate, numSampledRays++)
+                            {
+                                traverser.Trace(rays[i], queries[query], &stats);
+                            }
+
+                            for (UINT mode = 0; mode < ARRAYSIZE(modes); mode++)
+                            {
+                                // Best of a few runs, the first one also warms up the caches and the pool
+                                double bestSeconds = DBL_MAX;
+                                for (UINT run = 0; run < 3; run++)
+                                {
+                                    const auto start = std::chrono::high_resolution_clock::now();
+                                    traverser.TraceRays(pool, rays.data(), (UINT)rays.size(), modes[mode], queries[query], hits.data());
+                                    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+                                    bestSeconds = std::min(bestSeconds, elapsed.count());
+                                }
+
+                                wchar_t message[256];
+                                swprintf_s(message, L"%-7ls %-4ls %-7ls %-7ls %-7ls %8.2f Mrays/s, %6.1f nodes and %5.1f triangles per ray\n",
+                                    scene.pName,
+                                    builderNames[builder],
+                                    raySetNames[raySet],
+                                    queryNames[query],
+                                    modeNames[mode],
+                                    rays.size() / bestSeconds / 1000000.0,
+                                    stats.NodesVisited / (double)numSampledRays,
+                                    stats.TrianglesTested / (double)numSampledRays);
+                                Logger::WriteMessage(message);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Per frame of an animation that twists the standard scenes further and further: time, SAH
+        // cost and nodes visited per primary ray of a full rebuild, of refitting the first frame's
+        // BVH, and of refitting it with partial rebuilds. Written to the test output.
+        BEGIN_TEST_METHOD_ATTRIBUTE(CpuBVHUpdateBenchmark)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(CpuBVHUpdateBenchmark)
+        {
+            const UINT numFrames = 8;
+            const float maxTwist = 1.5f;
+
+            FallbackLayer::CpuBvh2BuildSettings partialRebuild;
+            partialRebuild.UpdateRebuildThreshold = 1.2f;
+
+            srand(14);
+            for (TraversalScene &scene : CreateStandardScenes(256, 100000))
+            {
+                CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+                std::unique_ptr<BYTE[]> pSourceData;
+                const UINT size = TestCpuBvh2Builder(&geomDesc, 1, FallbackLayer::CpuBvh2BuildSettings(), pSourceData);
+
+                const LPCWSTR methodNames[] = { L"rebuild", L"refit", L"partial" };
+                std::unique_ptr<BYTE[]> pBVHs[ARRAYSIZE(methodNames)];
+                for (std::unique_ptr<BYTE[]> &pBVH : pBVHs)
+                {
+                    pBVH.reset(new BYTE[size]);
+                }
+
+                for (UINT frame = 1; frame <= numFrames; frame++)
+                {
+                    TraversalScene deformedScene = TwistScene(scene, maxTwist * frame / numFrames);
+                    CpuGeometryDescriptor deformedGeomDesc = deformedScene.GetGeometryDescriptor();
+                    std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(&deformedGeomDesc, 1);
+
+                    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
+                    desc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+                    desc.NumDescs = 1;
+                    desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+                    desc.pGeometryDescs = geomDescs.data();
+
+                    const auto start = std::chrono::high_resolution_clock::now();
+                    BuildRaytracingAccelerationStructureOnCpu(&desc, FallbackLayer::CpuBvh2BuildSettings(), pBVHs[0].get());
+                    const std::chrono::duration<double, std::milli> rebuildTime = std::chrono::high_resolution_clock::now() - start;
+
+                    FallbackLayer::CpuBvh2UpdateStats refitStats, partialRebuildStats;
+                    UpdateCpuBvh2(&deformedGeomDesc, 1, FallbackLayer::CpuBvh2BuildSettings(), pSourceData.get(), pBVHs[1].get(), &refitStats);
+                    UpdateCpuBvh2(&deformedGeomDesc, 1, partialRebuild, pSourceData.get(), pBVHs[2].get(), &partialRebuildStats);
+
+                    const double milliseconds[] = { rebuildTime.count(), refitStats.Total, partialRebuildStats.Total };
+                    const UINT rebuiltPrimitives[] = { scene.GetTriangleCount(), 0, partialRebuildStats.RebuiltPrimitives };
+
+                    std::vector<CpuRay> rays = CreatePrimaryRays(deformedScene, 64, 64);
+                    for (UINT method = 0; method < ARRAYSIZE(methodNames); method++)
+                    {
+                        FallbackLayer::CpuBvh2Traverser traverser(pBVHs[method].get());
+                        CpuTraversalStats stats = {};
+                        for (const CpuRay &ray : rays)
+                        {
+                            traverser.Trace(ray, CpuRayFlagNone, &stats);
+                        }
+
+                        wchar_t message[256];
+                        swprintf_s(message, L"%-7ls frame %u %-7ls %8.2f ms, SAH cost %6.1f, %6.1f nodes per primary ray, %6u triangles rebuilt\n",
+                            scene.pName,
+                            frame,
+                            methodNames[method],
+                            milliseconds[method],
+                            FallbackLayer::ComputeSahCost(pBVHs[method].get()),
+                            stats.NodesVisited / (double)rays.size(),
+                            rebuiltPrimitives[method]);
+                        Logger::WriteMessage(message);
+                    }
+                }
+            }
+        }
+
+        // Build time, SAH cost and diffuse ray traversal of spatial split builds with one and four
+        // triangle leaves next to the binned builder, written to the test output
+        BEGIN_TEST_METHOD_ATTRIBUTE(SpatialSplitCpuBVHBuilderBenchmark)
+            TEST_METHOD_ATTRIBUTE(L"TestCategory", L"Benchmark")
+        END_TEST_METHOD_ATTRIBUTE()
+        TEST_METHOD(SpatialSplitCpuBVHBuilderBenchmark)
+        {
+            const UINT numDiffuseRays = 256 * 1024;
+
+            // Traversal statistics come from single ray traces of every StatsSampleRate-th ray
+            const UINT StatsSampleRate = 16;
+
+            const LPCWSTR builderNames[] = { L"binned", L"SBVH", L"SBVH-4" };
+            const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS builderFlags[] = {
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE };
+            const UINT maxTrianglesInLeaf[] = { 1, 1, 4 };
+
+            srand(15);
+            std::vector<TraversalScene> scenes = CreateStandardScenes(256, 100000);
+            scenes.push_back(CreateDiagonalScene(100000));
+            FallbackLayer::CpuTaskPool pool;
+            for (TraversalScene &scene : scenes)
+            {
+                std::vector<CpuRay> rays = CreateDiffuseRays(scene, numDiffuseRays);
+                std::vector<CpuRayHit> hits(rays.size());
+
+                CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+                std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(&geomDesc, 1);
+
+                double binnedMilliseconds = 0.0;
+                float binnedSahCost = 0.0f;
+                for (UINT builder = 0; builder < ARRAYSIZE(builderNames); builder++)
+                {
+                    FallbackLayer::CpuBvh2BuildSettings settings;
+                    settings.MaxTrianglesInLeaf = maxTrianglesInLeaf[builder];
+                    settings.CpuTraversalOnly = true;
+
+                    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
+                    desc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+                    desc.NumDescs = 1;
+                    desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+                    desc.Flags = builderFlags[builder];
+                    desc.pGeometryDescs = geomDescs.data();
+
+                    std::unique_ptr<BYTE[]> pData(new BYTE[FallbackLayer::GetCpuBvh2ResultDataMaxSizeInBytes(scene.GetTriangleCount(), desc.Flags, settings)]);
+                    double bestMilliseconds = DBL_MAX;
+                    for (UINT run = 0; run < 3; run++)
+                    {
+                        const auto start = std::chrono::high_resolution_clock::now();
+                        BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData.get());
+                        const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+                        bestMilliseconds = std::min(bestMilliseconds, elapsed.count());
+                    }
+
+                    const BVHOffsets &offsets = *(const BVHOffsets *)pData.get();
+                    const UINT numReferences = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+                    const float sahCost = FallbackLayer::ComputeSahCost(pData.get());
+                    if (builder == 0)
+                    {
+                        binnedMilliseconds = bestMilliseconds;
+                        binnedSahCost = sahCost;
+                    }
+
+                    FallbackLayer::CpuBvh2Traverser traverser(pData.get());
+                    CpuTraversalStats stats = {};
+                    UINT numSampledRays = 0;
+                    for (UINT i = 0; i < rays.size(); i += StatsSampleRate, numSampledRays++)
+                    {
+                        traverser.Trace(rays[i], CpuRayFlagNone, &stats);
+                    }
+
+                    double bestSeconds = DBL_MAX;
+                    for (UINT run = 0; run < 3; run++)
+                    {
+                        const auto start = std::chrono::high_resolution_clock::now();
+                        traverser.TraceRays(pool, rays.data(), (UINT)rays.size(), CpuTraversalModeSingleRay, CpuRayFlagNone, hits.data());
+                        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+                        bestSeconds = std::min(bestSeconds, elapsed.count());
+                    }
+
+                    wchar_t message[256];
+                    swprintf_s(message, L"%-8ls %-6ls %8.1f ms (%5.2fx), SAH cost %6.1f (%4.2fx), %4.2f references per triangle, %6.1f nodes and %5.1f triangles per ray, %6.2f Mrays/s\n",
+                        scene.pName,
+                        builderNames[builder],
+                        bestMilliseconds,
+                        bestMilliseconds / binnedMilliseconds,
+                        sahCost,
+                        sahCost / binnedSahCost,
+                        numReferences / (double)scene.GetTriangleCount(),
+                        stats.NodesVisited / (double)numSampledRays,
+                        stats.TrianglesTested / (double)numSampledRays,
+                        rays.size() / bestSeconds / 1000000.0);
+                    Logger::WriteMessage(message);
+                }
+            }
+        }
+
         void GenerateRandomTranformation(float *pMatrix)
         {
             // Identity matrix
@@ -1053,14 +1647,9 @@ namespace FallbackLayerUnitTests
             }
         }
 
-        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
+        // Geometry descs pointing straight at the CPU data, which is how the CPU builders read them
+        std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> GetCpuTriangleGeometryDescs(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms)
         {
-            ID3D12Device &device = m_d3d12Context.GetDevice();
-            std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder> pBuilder =
-                std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder>(
-                    new FallbackLayer::GpuBvh2Builder(&device, m_d3d12Context.GetTotalLaneCount(), 0));
-            InternalFallbackBuilder builderWrapper(pBuilder.get());
-
             std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs(numGeoms);
             for (UINT i = 0; i < numGeoms; i++)
             {
@@ -1073,6 +1662,28 @@ namespace FallbackLayerUnitTests
                 triangleDesc.VertexCount = pGeomDescs[i].m_numVerticies;
                 triangleDesc.VertexBuffer.StrideInBytes = sizeof(float) * 3;
             }
+            return geomDescs;
+        }
+
+        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms)
+        {
+            std::unique_ptr<BYTE[]> pData;
+            TestCpuBvh2Builder(pGeomDescs, numGeoms, FallbackLayer::CpuBvh2BuildSettings(), pData);
+        }
+
+        UINT TestCpuBvh2Builder(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            const FallbackLayer::CpuBvh2BuildSettings &settings,
+            std::unique_ptr<BYTE[]> &pData)
+        {
+            ID3D12Device &device = m_d3d12Context.GetDevice();
+            std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder> pBuilder =
+                std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder>(
+                    new FallbackLayer::GpuBvh2Builder(&device, m_d3d12Context.GetTotalLaneCount(), 0));
+            InternalFallbackBuilder builderWrapper(pBuilder.get());
+
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(pGeomDescs, numGeoms);
 
             D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuildInfo;
             builderWrapper.GetRaytracingAccelerationStructurePrebuildInfo(&device,
@@ -1081,7 +1692,7 @@ namespace FallbackLayerUnitTests
                 numGeoms,
                 geomDescs.data(),
                 &prebuildInfo);
-            std::unique_ptr<BYTE[]> pData = std::unique_ptr<BYTE[]>(new BYTE[prebuildInfo.ResultDataMaxSizeInBytes]);
+            pData = std::unique_ptr<BYTE[]>(new BYTE[prebuildInfo.ResultDataMaxSizeInBytes]);
 
 
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
@@ -1090,13 +1701,14 @@ namespace FallbackLayerUnitTests
             desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
             desc.pGeometryDescs = geomDescs.data();
 
-            BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get());
+            BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData.get());
             std::wstring errorMessage;
             auto &validator = FallbackLayer::GetAccelerationStructureValidator(pBuilder->GetAccelerationStructureType());
             if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData.get(), errorMessage))
             {
                 Assert::Fail(errorMessage.c_str());
             }
+            return (UINT)prebuildInfo.ResultDataMaxSizeInBytes;
         }
 
         void TestCpuBvh2Builder(CpuGeometryDescriptor &geomDesc)
@@ -1104,6 +1716,627 @@ namespace FallbackLayerUnitTests
             TestCpuBvh2Builder(&geomDesc, 1);
         }
 
+        // Updates the BVH in pSource to the given geometry and writes it to pData, which can be pSource
+        void UpdateCpuBvh2(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            const FallbackLayer::CpuBvh2BuildSettings &settings,
+            const BYTE *pSource,
+            BYTE *pData,
+            FallbackLayer::CpuBvh2UpdateStats *pStats = nullptr)
+        {
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(pGeomDescs, numGeoms);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
+            desc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.NumDescs = numGeoms;
+            desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+            desc.pGeometryDescs = geomDescs.data();
+            desc.SourceAccelerationStructureData = (D3D12_GPU_VIRTUAL_ADDRESS)pSource;
+
+            FallbackLayer::CpuBvh2UpdateStats stats;
+            BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData, &stats);
+            Assert::IsTrue(stats.Total >= stats.Refit + stats.Rebuild, L"Update timings exceed the total update time");
+            Assert::IsTrue(stats.RebuiltPrimitives >= 2 * stats.RebuiltSubtrees, L"Rebuilt subtrees need at least two primitives");
+
+            std::wstring errorMessage;
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
+            if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData, errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+
+            if (pStats)
+            {
+                *pStats = stats;
+            }
+        }
+
+        // Updates a TestCpuSbvhBuilder build, whose rebuilt subtrees use spatial splits too
+        void UpdateCpuSbvh(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            const FallbackLayer::CpuBvh2BuildSettings &settings,
+            const BYTE *pSource,
+            BYTE *pData,
+            FallbackLayer::CpuBvh2UpdateStats *pStats = nullptr)
+        {
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(pGeomDescs, numGeoms);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
+            desc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.NumDescs = numGeoms;
+            desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+            desc.pGeometryDescs = geomDescs.data();
+            desc.SourceAccelerationStructureData = (D3D12_GPU_VIRTUAL_ADDRESS)pSource;
+
+            FallbackLayer::CpuBvh2UpdateStats stats;
+            BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData, &stats);
+
+            const UINT numTriangles = GetTotalPrimitiveCount(desc);
+            const UINT resultDataSize = FallbackLayer::GetCpuBvh2ResultDataMaxSizeInBytes(numTriangles, desc.Flags, settings);
+            Assert::IsTrue(((const BVHOffsets *)pData)->totalSize <= resultDataSize, L"Updated CPU BVH is larger than GetCpuBvh2ResultDataMaxSizeInBytes");
+            VerifySpatialSplitReferences(pGeomDescs, numGeoms, pData, settings.MaxTrianglesInLeaf, numTriangles + (UINT)(numTriangles * settings.SpatialSplitBudget));
+
+            if (pStats)
+            {
+                *pStats = stats;
+            }
+        }
+
+        // PREFER_FAST_TRACE build, which uses spatial splits. The validator expects whole triangles
+        // in single triangle leaves, so VerifySpatialSplitReferences checks the leaves instead.
+        UINT TestCpuSbvhBuilder(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            D3D12_RAYTRACING_GEOMETRY_FLAGS geometryFlags,
+            const FallbackLayer::CpuBvh2BuildSettings &settings,
+            std::unique_ptr<BYTE[]> &pData)
+        {
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(pGeomDescs, numGeoms);
+            for (D3D12_RAYTRACING_GEOMETRY_DESC &geomDesc : geomDescs)
+            {
+                geomDesc.Flags = geometryFlags;
+            }
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
+            desc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.NumDescs = numGeoms;
+            desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+            desc.pGeometryDescs = geomDescs.data();
+
+            const UINT numTriangles = GetTotalPrimitiveCount(desc);
+            const UINT resultDataSize = FallbackLayer::GetCpuBvh2ResultDataMaxSizeInBytes(numTriangles, desc.Flags, settings);
+            pData = std::unique_ptr<BYTE[]>(new BYTE[resultDataSize]);
+
+            BuildRaytracingAccelerationStructureOnCpu(&desc, settings, pData.get());
+            Assert::IsTrue(((const BVHOffsets *)pData.get())->totalSize <= resultDataSize, L"CPU BVH output is larger than GetCpuBvh2ResultDataMaxSizeInBytes");
+
+            const bool duplicatesAllowed = !(geometryFlags & D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION);
+            const UINT maxReferences = numTriangles + (UINT)(duplicatesAllowed ? numTriangles * settings.SpatialSplitBudget : 0);
+            VerifySpatialSplitReferences(pGeomDescs, numGeoms, pData.get(), settings.MaxTrianglesInLeaf, maxReferences);
+            return resultDataSize;
+        }
+
+        UINT TestCpuLbvhBuilder(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags,
+            const FallbackLayer::CpuLbvhBuildSettings &settings,
+            std::unique_ptr<BYTE[]> &pData)
+        {
+            std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geomDescs = GetCpuTriangleGeometryDescs(pGeomDescs, numGeoms);
+
+            D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
+            desc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+            desc.NumDescs = numGeoms;
+            desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            desc.Flags = buildFlags;
+            desc.pGeometryDescs = geomDescs.data();
+
+            const UINT resultDataSize = FallbackLayer::CpuLbvhBuilder::GetResultDataMaxSizeInBytes(GetTotalPrimitiveCount(desc));
+            pData = std::unique_ptr<BYTE[]>(new BYTE[resultDataSize]);
+
+            FallbackLayer::CpuLbvhStageTimings timings;
+            BuildRaytracingAccelerationStructureOnCpuLbvh(&desc, settings, pData.get(), &timings);
+            Assert::IsTrue(timings.Total >= timings.Sort + timings.ConstructHierarchy, L"Stage timings exceed the total build time");
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)pData.get();
+            Assert::AreEqual(resultDataSize, offsets.totalSize, L"CPU LBVH output size doesn't match GetResultDataMaxSizeInBytes");
+
+            std::wstring errorMessage;
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
+            if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData.get(), errorMessage))
+            {
+                Assert::Fail(errorMessage.c_str());
+            }
+            return resultDataSize;
+        }
+
+        // Indexed triangle meshes the CPU traversal is tested and benchmarked on
+        struct TraversalScene
+        {
+            LPCWSTR pName;
+            std::vector<float> vertices;
+            std::vector<UINT32> indices;
+
+            CpuGeometryDescriptor GetGeometryDescriptor()
+            {
+                return CpuGeometryDescriptor(vertices.data(), (UINT)vertices.size() / 3, indices.data(), (UINT)indices.size());
+            }
+
+            UINT GetTriangleCount() const { return (UINT)indices.size() / 3; }
+
+            float3 GetVertex(UINT triangleIndex, UINT vertex) const
+            {
+                const float *pVertex = &vertices[indices[triangleIndex * 3 + vertex] * 3];
+                return float3{ pVertex[0], pVertex[1], pVertex[2] };
+            }
+        };
+
+        static float RandomFloat()
+        {
+            return rand() / (float)RAND_MAX;
+        }
+
+        static float3 Normalize(const float3 &v)
+        {
+            return v / sqrtf(dot(v, v));
+        }
+
+        // Two triangles per cell of a grid of columns x rows vertices
+        static void AddGridIndices(TraversalScene &scene, UINT columns, UINT rows)
+        {
+            for (UINT row = 0; row + 1 < rows; row++)
+            {
+                for (UINT column = 0; column + 1 < columns; column++)
+                {
+                    const UINT i = row * columns + column;
+                    const UINT32 cellIndices[] = { i, i + columns, i + 1, i + 1, i + columns, i + columns + 1 };
+                    scene.indices.insert(scene.indices.end(), cellIndices, cellIndices + ARRAYSIZE(cellIndices));
+                }
+            }
+        }
+
+        // UV sphere of radius 10, segments x segments / 2 cells
+        static TraversalScene CreateSphereScene(UINT segments)
+        {
+            const float pi = 3.14159265f;
+            const UINT rings = segments / 2;
+
+            TraversalScene scene;
+            scene.pName = L"Sphere";
+            for (UINT ring = 0; ring <= rings; ring++)
+            {
+                const float theta = pi * ring / rings;
+                for (UINT segment = 0; segment <= segments; segment++)
+                {
+                    const float phi = 2.0f * pi * segment / segments;
+                    scene.vertices.push_back(10.0f * sinf(theta) * cosf(phi));
+                    scene.vertices.push_back(10.0f * cosf(theta));
+                    scene.vertices.push_back(10.0f * sinf(theta) * sinf(phi));
+                }
+            }
+            AddGridIndices(scene, segments + 1, rings + 1);
+            return scene;
+        }
+
+        // Rolling height field over a 100 x 100 square with some noise, size x size cells
+        static TraversalScene CreateTerrainScene(UINT size)
+        {
+            TraversalScene scene;
+            scene.pName = L"Terrain";
+            for (UINT z = 0; z <= size; z++)
+            {
+                for (UINT x = 0; x <= size; x++)
+                {
+                    const float worldX = 100.0f * x / size - 50.0f;
+                    const float worldZ = 100.0f * z / size - 50.0f;
+                    scene.vertices.push_back(worldX);
+                    scene.vertices.push_back(5.0f * sinf(worldX * 0.2f) * cosf(worldZ * 0.3f) + RandomFloat());
+                    scene.vertices.push_back(worldZ);
+                }
+            }
+            AddGridIndices(scene, size + 1, size + 1);
+            return scene;
+        }
+
+        // Small triangles with random positions and orientations in a 100 x 100 x 100 cube
+        static TraversalScene CreateTriangleSoupScene(UINT numTriangles)
+        {
+            TraversalScene scene;
+            scene.pName = L"Soup";
+            for (UINT i = 0; i < numTriangles; i++)
+            {
+                const float center[3] = { RandomFloat() * 100.0f - 50.0f, RandomFloat() * 100.0f - 50.0f, RandomFloat() * 100.0f - 50.0f };
+                for (UINT vertex = 0; vertex < 3; vertex++)
+                {
+                    for (UINT axis = 0; axis < 3; axis++)
+                    {
+                        scene.vertices.push_back(center[axis] + RandomFloat() * 4.0f - 2.0f);
+                    }
+                    scene.indices.push_back((UINT32)scene.indices.size());
+                }
+            }
+            return scene;
+        }
+
+        // Long thin triangles at random orientations through a 100 x 100 x 100 cube, like the beams
+        // and diagonal walls of architectural scenes that make object split children overlap
+        static TraversalScene CreateDiagonalScene(UINT numTriangles)
+        {
+            TraversalScene scene;
+            scene.pName = L"Diagonal";
+            for (UINT i = 0; i < numTriangles; i++)
+            {
+                const float3 center = { RandomFloat() * 100.0f - 50.0f, RandomFloat() * 100.0f - 50.0f, RandomFloat() * 100.0f - 50.0f };
+                const float3 direction = Normalize(float3{ RandomFloat() - 0.5f, RandomFloat() - 0.5f, RandomFloat() - 0.5f } + float3{ 0.01f, 0.01f, 0.01f });
+                const float3 side = { RandomFloat() * 2.0f - 1.0f, RandomFloat() * 2.0f - 1.0f, RandomFloat() * 2.0f - 1.0f };
+                const float halfLength = 5.0f + RandomFloat() * 10.0f;
+
+                const float3 triangleVertices[] = { center - direction * halfLength, center + direction * halfLength, center + side };
+                for (const float3 &vertex : triangleVertices)
+                {
+                    scene.vertices.push_back(vertex.x);
+                    scene.vertices.push_back(vertex.y);
+                    scene.vertices.push_back(vertex.z);
+                    scene.indices.push_back((UINT32)scene.indices.size());
+                }
+            }
+            return scene;
+        }
+
+        // Center of the scene's bounds and the distance from there to their corners
+        static void GetBoundingSphere(const TraversalScene &scene, float3 &center, float &radius)
+        {
+            float3 sceneMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float3 sceneMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (UINT i = 0; i < scene.vertices.size(); i += 3)
+            {
+                const float3 vertex = { scene.vertices[i], scene.vertices[i + 1], scene.vertices[i + 2] };
+                sceneMin = min(sceneMin, vertex);
+                sceneMax = max(sceneMax, vertex);
+            }
+            center = (sceneMin + sceneMax) * 0.5f;
+            radius = sqrtf(dot(sceneMax - center, sceneMax - center));
+        }
+
+        // Rotates every vertex around the vertical axis through the scene's center by an angle that
+        // grows with its height, up to maxAngle at one radius above the center. The triangles move
+        // past each other, which is what wears down a refitted BVH.
+        static TraversalScene TwistScene(const TraversalScene &scene, float maxAngle)
+        {
+            float3 center;
+            float radius;
+            GetBoundingSphere(scene, center, radius);
+
+            TraversalScene twistedScene = scene;
+            for (UINT i = 0; i < twistedScene.vertices.size(); i += 3)
+            {
+                float *pVertex = &twistedScene.vertices[i];
+                const float angle = maxAngle * (pVertex[1] - center.y) / radius;
+                const float x = pVertex[0] - center.x;
+                const float z = pVertex[2] - center.z;
+                pVertex[0] = center.x + x * cosf(angle) - z * sinf(angle);
+                pVertex[2] = center.z + x * sinf(angle) + z * cosf(angle);
+            }
+            return twistedScene;
+        }
+
+        // Pinhole camera rays looking at the scene from above and in front. The pixels are ordered
+        // in 8x8 tiles so that consecutive rays, and so packets, are neighbours on screen.
+        static std::vector<CpuRay> CreatePrimaryRays(const TraversalScene &scene, UINT width, UINT height)
+        {
+            float3 center;
+            float radius;
+            GetBoundingSphere(scene, center, radius);
+
+            const float3 eye = center + float3{ 0.3f, 0.6f, -1.6f } * radius;
+            const float3 forward = Normalize(center - eye);
+            const float3 right = Normalize(cross(float3{ 0.0f, 1.0f, 0.0f }, forward));
+            const float3 up = cross(forward, right);
+            const float tanHalfFov = 0.577f;
+
+            const UINT TileSize = 8;
+            std::vector<CpuRay> rays;
+            for (UINT tileY = 0; tileY < height; tileY += TileSize)
+            {
+                for (UINT tileX = 0; tileX < width; tileX += TileSize)
+                {
+                    for (UINT y = tileY; y < std::min(height, tileY + TileSize); y++)
+                    {
+                        for (UINT x = tileX; x < std::min(width, tileX + TileSize); x++)
+                        {
+                            const float screenX = ((x + 0.5f) / width * 2.0f - 1.0f) * tanHalfFov * width / height;
+                            const float screenY = (1.0f - (y + 0.5f) / height * 2.0f) * tanHalfFov;
+
+                            CpuRay ray;
+                            ray.Origin = eye;
+                            ray.Direction = Normalize(forward + right * screenX + up * screenY);
+                            ray.TMin = 0.0f;
+                            ray.TMax = FLT_MAX;
+                            rays.push_back(ray);
+                        }
+                    }
+                }
+            }
+            return rays;
+        }
+
+        // Rays leaving random points of the surface in random directions of the hemisphere around
+        // the triangle's normal, like the bounces of a path tracer
+        static std::vector<CpuRay> CreateDiffuseRays(const TraversalScene &scene, UINT numRays)
+        {
+            std::vector<CpuRay> rays;
+            while (rays.size() < numRays)
+            {
+                const UINT triangleIndex = (UINT)(RandomFloat() * (scene.GetTriangleCount() - 1));
+                const float3 v0 = scene.GetVertex(triangleIndex, 0);
+                const float3 edge1 = scene.GetVertex(triangleIndex, 1) - v0;
+                const float3 edge2 = scene.GetVertex(triangleIndex, 2) - v0;
+                const float3 normal = cross(edge1, edge2);
+                float3 direction = { RandomFloat() * 2.0f - 1.0f, RandomFloat() * 2.0f - 1.0f, RandomFloat() * 2.0f - 1.0f };
+                if (dot(normal, normal) == 0.0f || dot(direction, direction) > 1.0f || dot(direction, direction) < 0.01f)
+                {
+                    continue;
+                }
+
+                float u = RandomFloat();
+                float v = RandomFloat();
+                if (u + v > 1.0f)
+                {
+                    u = 1.0f - u;
+                    v = 1.0f - v;
+                }
+
+                CpuRay ray;
+                ray.Origin = v0 + edge1 * u + edge2 * v;
+                ray.Direction = Normalize(dot(direction, normal) < 0.0f ? direction * -1.0f : direction);
+                ray.TMin = 0.01f;
+                ray.TMax = FLT_MAX;
+                rays.push_back(ray);
+            }
+            return rays;
+        }
+
+        // The sphere, terrain and triangle soup every CPU BVH variant is checked on, at test size
+        // unless a benchmark asks for more
+        static std::vector<TraversalScene> CreateStandardScenes(UINT segments = 32, UINT numSoupTriangles = 1500)
+        {
+            std::vector<TraversalScene> scenes;
+            scenes.push_back(CreateSphereScene(segments));
+            scenes.push_back(CreateTerrainScene(segments));
+            scenes.push_back(CreateTriangleSoupScene(numSoupTriangles));
+            return scenes;
+        }
+
+        // Coherent primary rays followed by incoherent diffuse ones
+        static std::vector<CpuRay> CreateTestRays(const TraversalScene &scene)
+        {
+            std::vector<CpuRay> rays = CreatePrimaryRays(scene, 32, 32);
+            std::vector<CpuRay> diffuseRays = CreateDiffuseRays(scene, 1024);
+            rays.insert(rays.end(), diffuseRays.begin(), diffuseRays.end());
+            return rays;
+        }
+
+        // The same Moller-Trumbore test the traverser runs
+        static bool IntersectTriangleReference(float3 v0, float3 v1, float3 v2, const CpuRay &ray, UINT rayFlags, float tMax, float &t)
+        {
+            const float3 edge1 = v1 - v0;
+            const float3 edge2 = v2 - v0;
+            const float3 p = cross(ray.Direction, edge2);
+            const float det = dot(edge1, p);
+            if ((rayFlags & CpuRayFlagCullFrontFacingTriangles) ? det >= 0.0f :
+                (rayFlags & CpuRayFlagCullBackFacingTriangles) ? det <= 0.0f : det == 0.0f)
+            {
+                return false;
+            }
+
+            const float inverseDet = 1.0f / det;
+            const float3 s = ray.Origin - v0;
+            const float u = dot(s, p) * inverseDet;
+            const float3 q = cross(s, edge1);
+            const float v = dot(ray.Direction, q) * inverseDet;
+            if (u < 0.0f || u > 1.0f || v < 0.0f || u + v > 1.0f)
+            {
+                return false;
+            }
+
+            t = dot(edge2, q) * inverseDet;
+            return t >= ray.TMin && t < tMax;
+        }
+
+        // Every vertex of a leaf's primitives has to be inside the boxes of the leaf and all of its
+        // ancestors, with no tolerance, for traversal to never miss a triangle
+        void VerifyNodesContainPrimitives(const BYTE *pBVH)
+        {
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBVH;
+            const BYTE *pBoxes = pBVH + offsets.offsetToBoxes;
+            const Primitive *pPrimitives = (const Primitive *)(pBVH + offsets.offsetToVertices);
+
+            // Node index and depth, ancestors[depth] holds the node's own box
+            std::vector<std::pair<UINT, UINT>> stack(1, std::make_pair(0u, 0u));
+            std::vector<AABB> ancestors;
+            while (!stack.empty())
+            {
+                const UINT nodeIndex = stack.back().first;
+                const UINT depth = stack.back().second;
+                stack.pop_back();
+
+                const AABBNode node = FallbackLayer::ReadAABBNode(pBoxes, nodeIndex);
+                ancestors.resize(depth + 1);
+                FallbackLayer::DecompressAABB(ancestors[depth], node);
+
+                if (!node.leaf)
+                {
+                    stack.push_back(std::make_pair((UINT)node.internalNode.leftNodeIndex, depth + 1));
+                    stack.push_back(std::make_pair((UINT)node.rightNodeIndex, depth + 1));
+                    continue;
+                }
+
+                for (UINT i = 0; i < node.numTriangles; i++)
+                {
+                    const Triangle &triangle = pPrimitives[node.leafNode.firstTriangleId + i].triangle;
+                    for (const AABB &box : ancestors)
+                    {
+                        for (UINT vertex = 0; vertex < 3; vertex++)
+                        {
+                            const float3 &v = triangle.v[vertex];
+                            Assert::IsTrue(
+                                v.x >= box.min.x && v.y >= box.min.y && v.z >= box.min.z &&
+                                v.x <= box.max.x && v.y <= box.max.y && v.z <= box.max.z,
+                                L"Triangle outside the box of its leaf or one of its ancestors");
+                        }
+                    }
+                }
+            }
+        }
+
+        // Every triangle has to be referenced by a leaf at least once, each reference has to touch
+        // its leaf's box and leaves can't be larger than allowed
+        void VerifySpatialSplitReferences(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            const BYTE *pBVH,
+            UINT maxTrianglesInLeaf,
+            UINT maxReferences)
+        {
+            std::vector<UINT> firstTriangles(numGeoms + 1, 0);
+            for (UINT i = 0; i < numGeoms; i++)
+            {
+                const UINT numVertices = pGeomDescs[i].m_pIndexBuffer ? pGeomDescs[i].m_numIndicies : pGeomDescs[i].m_numVerticies;
+                firstTriangles[i + 1] = firstTriangles[i] + numVertices / 3;
+            }
+
+            const BVHOffsets &offsets = *(const BVHOffsets *)pBVH;
+            const BYTE *pBoxes = pBVH + offsets.offsetToBoxes;
+            const Primitive *pPrimitives = (const Primitive *)(pBVH + offsets.offsetToVertices);
+            const PrimitiveMetaData *pMetadata = (const PrimitiveMetaData *)(pBVH + offsets.offsetToPrimitiveMetaData);
+            const UINT numReferences = (offsets.offsetToPrimitiveMetaData - offsets.offsetToVertices) / sizeof(Primitive);
+            Assert::IsTrue(numReferences <= maxReferences, L"More references than the spatial split budget allows");
+
+            std::vector<UINT> referenceCounts(firstTriangles[numGeoms], 0);
+            std::vector<UINT> stack(1, 0);
+            while (!stack.empty())
+            {
+                const AABBNode node = FallbackLayer::ReadAABBNode(pBoxes, stack.back());
+                stack.pop_back();
+                if (!node.leaf)
+                {
+                    stack.push_back(node.internalNode.leftNodeIndex);
+                    stack.push_back(node.rightNodeIndex);
+                    continue;
+                }
+
+                Assert::IsTrue(node.numTriangles > 0 && node.numTriangles <= maxTrianglesInLeaf, L"Leaf with too many or no triangles");
+                AABB box;
+                FallbackLayer::DecompressAABB(box, node);
+                for (UINT i = node.leafNode.firstTriangleId; i < node.leafNode.firstTriangleId + node.numTriangles; i++)
+                {
+                    Assert::IsTrue(pMetadata[i].GeometryContributionToHitGroupIndex < numGeoms);
+                    referenceCounts[firstTriangles[pMetadata[i].GeometryContributionToHitGroupIndex] + pMetadata[i].PrimitiveIndex]++;
+
+                    const Triangle &triangle = pPrimitives[i].triangle;
+                    const float3 triangleMin = min(min(triangle.v[0], triangle.v[1]), triangle.v[2]);
+                    const float3 triangleMax = max(max(triangle.v[0], triangle.v[1]), triangle.v[2]);
+                    Assert::IsTrue(
+                        triangleMin.x <= box.max.x && triangleMin.y <= box.max.y && triangleMin.z <= box.max.z &&
+                        triangleMax.x >= box.min.x && triangleMax.y >= box.min.y && triangleMax.z >= box.min.z,
+                        L"Triangle doesn't touch the box of its leaf");
+                }
+            }
+
+            UINT totalReferences = 0;
+            for (UINT referenceCount : referenceCounts)
+            {
+                Assert::IsTrue(referenceCount > 0, L"Triangle not referenced by any leaf");
+                Assert::IsTrue(referenceCount == 1 || maxReferences > referenceCounts.size(), L"Triangle referenced more than once despite NO_DUPLICATE_ANYHIT_INVOCATION");
+                totalReferences += referenceCount;
+            }
+            Assert::AreEqual(numReferences, totalReferences, L"Primitives not referenced by exactly one leaf");
+        }
+
+        // Checks every traversal mode and query against intersecting each ray with every triangle
+        void VerifyCpuTraversal(const TraversalScene &scene, const BYTE *pBVH, const std::vector<CpuRay> &rays)
+        {
+            const CpuTraversalMode modes[] = { CpuTraversalModeSingleRay, CpuTraversalModePacket8, CpuTraversalModeStream };
+            const UINT cullFlags[] = { CpuRayFlagNone, CpuRayFlagCullBackFacingTriangles, CpuRayFlagCullFrontFacingTriangles };
+
+            FallbackLayer::CpuBvh2Traverser traverser(pBVH);
+            FallbackLayer::CpuTaskPool pool(4);
+            std::vector<CpuRayHit> hits(rays.size());
+            for (UINT cullFlag : cullFlags)
+            {
+                std::vector<float> closestT(rays.size(), FLT_MAX);
+                for (UINT i = 0; i < rays.size(); i++)
+                {
+                    for (UINT triangle = 0; triangle < scene.GetTriangleCount(); triangle++)
+                    {
+                        float t;
+                        if (IntersectTriangleReference(
+                            scene.GetVertex(triangle, 0), scene.GetVertex(triangle, 1), scene.GetVertex(triangle, 2),
+                            rays[i], cullFlag, closestT[i], t))
+                        {
+                            closestT[i] = t;
+                        }
+                    }
+                }
+
+                for (bool anyHit : { false, true })
+                {
+                    const UINT rayFlags = cullFlag | (anyHit ? CpuRayFlagAcceptFirstHitAndEndSearch : 0);
+                    for (CpuTraversalMode mode : modes)
+                    {
+                        // An odd tile size leaves partial packets and stream batches
+                        traverser.TraceRays(pool, rays.data(), (UINT)rays.size(), mode, rayFlags, hits.data(), 61);
+                        for (UINT i = 0; i < rays.size(); i++)
+                        {
+                            const bool expectHit = closestT[i] != FLT_MAX;
+                            Assert::AreEqual(expectHit, hits[i].IsHit(), L"CPU traversal and brute force disagree on whether a ray hits");
+                            if (!expectHit)
+                            {
+                                continue;
+                            }
+
+                            // The reported triangle has to be hit at the reported distance
+                            const UINT triangle = hits[i].PrimitiveIndex;
+                            float t;
+                            Assert::AreEqual(0u, hits[i].GeometryIndex);
+                            Assert::IsTrue(IntersectTriangleReference(
+                                scene.GetVertex(triangle, 0), scene.GetVertex(triangle, 1), scene.GetVertex(triangle, 2),
+                                rays[i], cullFlag, FLT_MAX, t), L"CPU traversal reported a triangle the ray doesn't hit");
+                            Assert::AreEqual(t, hits[i].T, 1e-4f * std::max(1.0f, t));
+
+                            if (anyHit)
+                            {
+                                Assert::IsTrue(hits[i].T + 1e-4f * std::max(1.0f, closestT[i]) >= closestT[i], L"Any-hit query reported a hit closer than the closest one");
+                            }
+                            else
+                            {
+                                Assert::AreEqual(closestT[i], hits[i].T, 1e-4f * std::max(1.0f, closestT[i]), L"CPU traversal missed the closest hit");
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Calls verifyVariant(scene, geomDesc, rays) for each scene, which builds its build settings
+        // variant of the scene and checks it, usually with VerifyCpuTraversal
+        template <typename VerifyVariant>
+        static void ForEachTraversalScene(std::vector<TraversalScene> &scenes, VerifyVariant verifyVariant)
+        {
+            for (TraversalScene &scene : scenes)
+            {
+                const std::vector<CpuRay> rays = CreateTestRays(scene);
+                CpuGeometryDescriptor geomDesc = scene.GetGeometryDescriptor();
+                verifyVariant(scene, geomDesc, rays);
+            }
+        }
+
         void TestGpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
         {
             ID3D12Device &device = m_d3d12Context.GetDevice();
@@ -2598,6 +3831,131 @@ void AllocateUAVBuffer(ID3D12Device &d3d12device, UINT64 bufferSize, ID3D12Resou
             TestSortingMortonCodes(numElements, expectedMortonCodes, pOutputMortonCodeBuffer, pOutputIndexBuffer);
         }
 
+        TEST_METHOD(CpuCalculatingAndSortingMortonCodes)
+        {
+            for (UINT numElements : { 1u, 300u, 5000u, 200000u })
+            {
+                TestCpuCalculatingAndSortingMortonCodes(numElements);
+            }
+        }
+
+        void TestCpuCalculatingAndSortingMortonCodes(UINT numElements)
+        {
+            AABB expectedAABB;
+            std::vector<byte> outputData;
+            std::vector<MortonCodeIndexPair> expectedMortonCodes;
+            GenerateSceneData(numElements, SceneType::Triangles, outputData, expectedAABB, &expectedMortonCodes);
+            const Primitive *pPrimitives = (const Primitive *)outputData.data();
+
+            FallbackLayer::CpuLbvhBuildSettings settings;
+            settings.ThreadCount = 4;
+            FallbackLayer::CpuLbvhBuilder builder(settings);
+
+            AABB calculatedAABB = builder.CalculateSceneAABB(pPrimitives, numElements);
+            Assert::IsTrue(memcmp(&expectedAABB, &calculatedAABB, sizeof(expectedAABB)) == 0, L"Calculated AABB incorrect");
+
+            std::vector<UINT32> calculatedMortonCodes(numElements);
+            std::vector<UINT32> calculatedIndices(numElements);
+            builder.CalculateMortonCodes(pPrimitives, numElements, calculatedAABB, calculatedMortonCodes.data(), calculatedIndices.data());
+            for (UINT i = 0; i < numElements; i++)
+            {
+                Assert::IsTrue(i == calculatedIndices[i], L"Calculated indices incorrect");
+                Assert::IsTrue(IsMortonCodeEqual(expectedMortonCodes[i].MortonCode, calculatedMortonCodes[i]), L"Calculated morton code is incorrect");
+            }
+
+            // The sort is stable, so equal codes have to stay in index order
+            std::vector<MortonCodeIndexPair> sortedMortonCodes(numElements);
+            for (UINT i = 0; i < numElements; i++)
+            {
+                sortedMortonCodes[i].MortonCode = calculatedMortonCodes[i];
+                sortedMortonCodes[i].Index = i;
+            }
+            std::stable_sort(sortedMortonCodes.begin(), sortedMortonCodes.end(),
+                [](const MortonCodeIndexPair &a, const MortonCodeIndexPair &b) { return a.MortonCode < b.MortonCode; });
+
+            builder.Sort(calculatedMortonCodes.data(), calculatedIndices.data(), numElements);
+            for (UINT i = 0; i < numElements; i++)
+            {
+                Assert::IsTrue(sortedMortonCodes[i].Index == calculatedIndices[i] && sortedMortonCodes[i].MortonCode == calculatedMortonCodes[i], L"Sorted morton codes incorrect");
+            }
+        }
+
+        TEST_METHOD(CpuTreeletReordering)
+        {
+            // Same scene and starting hierarchy as TestTreeletReordering
+            const UINT numTriangles = 16;
+            std::vector<Primitive> triangleBuffer(numTriangles);
+            for (INT i = 0; i < numTriangles; i++)
+            {
+                Primitive &primitive = triangleBuffer[i];
+                primitive.PrimitiveType = TRIANGLE_TYPE;
+                Triangle &tri = primitive.triangle;
+                if (i < numTriangles / 2)
+                {
+                    tri.v0 = tri.v1 = tri.v2 = { (float)-i, 0, 0 };
+                }
+                else
+                {
+                    tri.v0 = tri.v1 = tri.v2 = { (float)i, 0, 0 };
+                }
+            }
+
+            UINT numLeafNodes = (UINT)triangleBuffer.size();
+            UINT numInternalNodes = numLeafNodes - 1;
+            UINT numNodes = numLeafNodes + numInternalNodes;
+            std::vector<HierarchyNode> hierarchy(numNodes);
+            for (UINT i = 0; i < numNodes; i++)
+            {
+                hierarchy[i].ParentIndex = (i - 1) / 2;
+                hierarchy[i].LeftChildIndex = i * 2 + 1;
+                hierarchy[i].RightChildIndex = i * 2 + 2;
+            }
+
+            FallbackLayer::CpuLbvhBuilder builder;
+            std::vector<AABB> outputAABBs(numNodes);
+            builder.ReorderTreelets(
+                hierarchy.data(),
+                triangleBuffer.data(),
+                numLeafNodes,
+                FallbackLayer::CpuLbvhBuilder::GetTreeletReorderPassCount(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE),
+                outputAABBs.data());
+
+            std::vector<UINT> nodeStack;
+            nodeStack.push_back(0);
+
+            UINT leafNodesFound = 0;
+            while (nodeStack.size() > 0)
+            {
+                auto nodeIndex = nodeStack.back();
+                nodeStack.pop_back();
+                bool isLeaf = nodeIndex >= numInternalNodes;
+                if (isLeaf)
+                {
+                    leafNodesFound++;
+                }
+                else
+                {
+                    UINT leftNodeIndex = hierarchy[nodeIndex].LeftChildIndex;
+                    UINT rightNodeIndex = hierarchy[nodeIndex].RightChildIndex;
+                    Assert::IsTrue(hierarchy[leftNodeIndex].ParentIndex == nodeIndex, L"Incorrectly Parent Index");
+                    Assert::IsTrue(hierarchy[rightNodeIndex].ParentIndex == nodeIndex, L"Incorrectly Parent Index");
+
+                    // Every box has to contain both of its children after the reorder
+                    for (UINT childIndex : { leftNodeIndex, rightNodeIndex })
+                    {
+                        const AABB &parent = outputAABBs[nodeIndex];
+                        const AABB &child = outputAABBs[childIndex];
+                        Assert::IsTrue(parent.min.x <= child.min.x && parent.min.y <= child.min.y && parent.min.z <= child.min.z &&
+                            parent.max.x >= child.max.x && parent.max.y >= child.max.y && parent.max.z >= child.max.z, L"Node AABB doesn't contain its child");
+                    }
+
+                    nodeStack.push_back(leftNodeIndex);
+                    nodeStack.push_back(rightNodeIndex);
+                }
+            }
+            Assert::IsTrue(leafNodesFound == numLeafNodes, L"Incorrectly constructed hierarchy");
+        }
+
         TEST_METHOD(TreeletReorderingFastTrace)
         {
             TestTreeletReordering(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE);
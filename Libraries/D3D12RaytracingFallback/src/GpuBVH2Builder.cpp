@@ -311,7 +311,9 @@ namespace FallbackLayer
                 totalNumNodes * sizeof(AABBNode);
 
             pInfo->ScratchDataSizeInBytes = CalculateScratchMemoryUsage(Level::Bottom, totalNumberOfTriangles).TotalSize;
-            pInfo->UpdateScratchDataSizeInBytes = 0;
+
+            // Updates are rebuilt from scratch, so they need as much scratch memory as a build
+            pInfo->UpdateScratchDataSizeInBytes = pInfo->ScratchDataSizeInBytes;
         }
         break;
         case D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL:
@@ -323,7 +325,7 @@ namespace FallbackLayer
 
             pInfo->ResultDataMaxSizeInBytes = sizeof(BVHOffsets) + sizeof(AABBNode) * totalNumNodes + sizeof(BVHMetadata) * numLeaves;
             pInfo->ScratchDataSizeInBytes = CalculateScratchMemoryUsage(Level::Top, numLeaves).TotalSize;
-            pInfo->UpdateScratchDataSizeInBytes = 0;
+            pInfo->UpdateScratchDataSizeInBytes = pInfo->ScratchDataSizeInBytes;
         }
         break;
         default:
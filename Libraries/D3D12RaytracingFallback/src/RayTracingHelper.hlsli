@@ -152,15 +152,61 @@ BoundingBox GetBoxFromBuffer(RWByteAddressBuffer buffer, uint boxStartOffset, ui
 #define GetBVHMetadataFromLeafIndex(byteAddressBufferPointer, offsetToLeafNodeMetaData, leafIndex) \
     LoadBVHMetadata(byteAddressBufferPointer.buffer, GetBVHMetadataAddress(byteAddressBufferPointer, offsetToLeafNodeMetaData, leafIndex))
 
-BoundingBox BVHReadBoundingBox(RWByteAddressBufferPointer pointer, int nodeIndex, out uint2 flags)
+// Decodes a CompressedAABBNode into the flags of an uncompressed node, with the right
+// child index (or the primitive count of a leaf) in flags.y
+BoundingBox CompressedRawDataToBoundingBox(uint4 header, uint4 node, out uint2 flags)
+{
+    const float3 origin = asfloat(header.xyz);
+    const float scale = asfloat((header.w & CompressedScaleExponentMask) << 23);
+
+    BoundingBox box;
+    box.center = f16tof32(uint3(node.x, node.x >> 16, node.y)) * scale + origin;
+    box.halfDim = f16tof32(uint3(node.y >> 16, node.z, node.z >> 16)) * scale;
+
+    const uint count = (node.w >> CompressedLeafPrimitiveCountShift) & CompressedLeafPrimitiveCountMask;
+    const uint index = node.w & CompressedNodeIndexMask;
+    flags.x = node.w;
+    flags.y = (node.w & IsLeafFlag) ? count : index + 1;
+
+    return box;
+}
+
+// Where a BVH's boxes start and their CompressedBVHHeader, or the first half of an
+// uncompressed root. Traversal reads it once per BVH rather than on every node fetch.
+struct BVHBoxesInfo
+{
+    uint offsetToBoxes;
+    uint4 header;
+};
+
+BVHBoxesInfo BVHReadBoxesInfo(RWByteAddressBufferPointer pointer)
+{
+    BVHBoxesInfo info;
+    info.offsetToBoxes = GetOffsetToBoxes(pointer);
+    info.header = pointer.buffer.Load4(info.offsetToBoxes);
+    return info;
+}
+
+BoundingBox BVHReadBoundingBox(RWByteAddressBufferPointer pointer, BVHBoxesInfo info, int nodeIndex, out uint2 flags)
 {
-    const uint boxAddress = GetBoxAddress(GetOffsetToBoxes(pointer), nodeIndex);
+    if (info.header.w & IsCompressedNodeFlag)
+    {
+        const uint nodeAddress = info.offsetToBoxes + SizeOfCompressedBVHHeader + nodeIndex * SizeOfCompressedAABBNode;
+        return CompressedRawDataToBoundingBox(info.header, pointer.buffer.Load4(nodeAddress), flags);
+    }
+
+    const uint boxAddress = GetBoxAddress(info.offsetToBoxes, nodeIndex);
 
     const uint4 a = pointer.buffer.Load4(boxAddress);
     const uint4 b = pointer.buffer.Load4(boxAddress + 16);
     return RawDataToBoundingBox(a, b, flags);
 }
 
+BoundingBox BVHReadBoundingBox(RWByteAddressBufferPointer pointer, int nodeIndex, out uint2 flags)
+{
+    return BVHReadBoundingBox(pointer, BVHReadBoxesInfo(pointer), nodeIndex, flags);
+}
+
 void CompressBox(BoundingBox box, uint2 flags, out uint4 data1, out uint4 data2)
 {
     data1.x = asuint(box.center.x);
@@ -378,6 +378,46 @@ struct AABBNode
 static_assert(sizeof(AABBNode) == SizeOfAABBNode, L"Incorrect sizeof for AABB");
 #endif
 
+// Half-size nodes written by the CPU builder for MINIMIZE_MEMORY builds. The boxes start
+// with a CompressedBVHHeader in place of the root's first half, followed by the nodes.
+// Centers and half-extents are fp16, relative to the header's origin and in units of its
+// power of two scale, rounded so the decoded box always contains the full precision one.
+// Children of a node are stored next to each other, the right one is leftNodeIndex + 1.
+struct CompressedAABBNode
+{
+    uint    centerXY;               // fp16 center.x | fp16 center.y << 16
+    uint    centerZHalfDimX;        // fp16 center.z | fp16 halfDim.x << 16
+    uint    halfDimYZ;              // fp16 halfDim.y | fp16 halfDim.z << 16
+
+    // Leaf flag | procedural flag | number of primitives << 24 | first primitive, or
+    // the left child index for internal nodes
+    uint    flags;
+};
+#define SizeOfCompressedAABBNode (4 * 4)
+#ifndef HLSL
+static_assert(sizeof(CompressedAABBNode) == SizeOfCompressedAABBNode, L"Incorrect sizeof for CompressedAABBNode");
+#endif
+
+struct CompressedBVHHeader
+{
+    float   origin[3];
+
+    // IsCompressedNodeFlag | biased exponent of the scale. The flag is in the same dword as
+    // the flags of an uncompressed root, where it's never set since leaves hold fewer than
+    // 32 primitives.
+    uint    flags;
+};
+#define SizeOfCompressedBVHHeader (4 * 4)
+#ifndef HLSL
+static_assert(sizeof(CompressedBVHHeader) == SizeOfCompressedBVHHeader, L"Incorrect sizeof for CompressedBVHHeader");
+#endif
+
+#define IsCompressedNodeFlag                0x20000000
+#define CompressedScaleExponentMask         0xff
+#define CompressedLeafPrimitiveCountShift   24
+#define CompressedLeafPrimitiveCountMask    0x1f
+#define CompressedNodeIndexMask             0x00ffffff
+
 // BVH description for the traversal shader
 struct BVHOffsets
 {
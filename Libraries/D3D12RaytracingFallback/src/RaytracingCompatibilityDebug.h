@@ -18,7 +18,3 @@ void OutputDebugLog(ID3D12RaytracingFallbackDevice *pDevice);
 #if ENABLE_ACCELERATION_STRUCTURE_VISUALIZATION
 void VisualizeAccelerationStructureLevel(ID3D12RaytracingFallbackDevice *pDevice, UINT level);
 #endif
-
-void BuildRaytracingAccelerationStructureOnCpu(
-    _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData);
@@ -518,10 +518,12 @@ bool Traverse(
     uint offsetToInstanceDescs = GetOffsetToInstanceDesc(topLevelAccelerationStructure);
 
     RWByteAddressBufferPointer currentBVH = CreateRWByteAddressBufferPointerFromGpuVA(currentGpuVA);
+    BVHBoxesInfo currentBoxesInfo = BVHReadBoxesInfo(currentBVH);
     uint2 flags;
     float unusedT;
     BoundingBox topLevelBox = BVHReadBoundingBox(
         currentBVH,
+        currentBoxesInfo,
         0,
         flags);
 
@@ -557,6 +559,7 @@ bool Traverse(
             uint2 flags;
             BoundingBox box = BVHReadBoundingBox(
                 currentBVH,
+                currentBoxesInfo,
                 thisNodeIndex,
                 flags);
 
@@ -586,6 +589,7 @@ bool Traverse(
                             SetBoolFlag(flagContainer, ProcessingBottomLevel, true);
                             StackPush(stackPointer, 0, currentLevel + 1, GI);
                             currentGpuVA = instanceDesc.AccelerationStructure;
+                            currentBoxesInfo = BVHReadBoxesInfo(CreateRWByteAddressBufferPointerFromGpuVA(currentGpuVA));
                             instanceFlags = GetInstanceFlags(instanceDesc);
 
                             float3x4 CurrentWorldToObject = CreateMatrix(instanceDesc.Transform);
@@ -705,11 +709,13 @@ bool Traverse(
                     float leftT, rightT;
                     BoundingBox leftBox = BVHReadBoundingBox(
                         currentBVH,
+                        currentBoxesInfo,
                         leftChildIndex,
                         flags);
 
                     BoundingBox rightBox = BVHReadBoundingBox(
                         currentBVH,
+                        currentBoxesInfo,
                         rightChildIndex,
                         flags);
 
@@ -749,6 +755,7 @@ bool Traverse(
         SetBoolFlag(flagContainer, ProcessingBottomLevel, false);
         currentRayData = GetRayData(WorldRayOrigin(), WorldRayDirection());
         currentGpuVA = TopLevelAccelerationStructureGpuVA;
+        currentBoxesInfo = BVHReadBoxesInfo(topLevelAccelerationStructure);
     } 
     MARK(10,0);
     bool isHit = Fallback_InstanceIndex() != NO_HIT_SENTINEL;
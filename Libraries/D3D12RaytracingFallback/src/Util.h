@@ -49,6 +49,28 @@ template <typename T> T AlignPowerOfTwo(T value)
     return value == 0 ? 0 : 1 << Log2(value);
 }
 
+static bool IsAvx2Supported()
+{
+    int cpuInfo[4];
+    __cpuid(cpuInfo, 0);
+    if (cpuInfo[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS has to save the YMM registers for AVX to be usable
+    __cpuid(cpuInfo, 1);
+    const bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+    const bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+
+    __cpuidex(cpuInfo, 7, 0);
+    return (cpuInfo[1] & (1 << 5)) != 0;
+}
+
 static void CreateRootSignatureHelper(ID3D12Device *pDevice, D3D12_VERSIONED_ROOT_SIGNATURE_DESC &desc, ID3D12RootSignature **ppRootSignature)
 {
     CComPtr<ID3DBlob> pRootSignatureBlob;
@@ -25,6 +25,12 @@
 #include <map>
 #include <deque>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <immintrin.h>
 #include <strsafe.h>
 #include "d3d12_1.h"
 #include "d3dx12.h"
@@ -73,6 +79,11 @@
 #include "GpuBvh2Copy.h"
 #include "TreeletReorder.h"
 #include "GpuBvh2Builder.h"
+#include "CpuTaskPool.h"
+#include "AABBNodeCompression.h"
+#include "CpuBvh2Builder.h"
+#include "CpuLbvhBuilder.h"
+#include "CpuBvh2Traverser.h"
 
 // Dispatchers
 #include "UberShaderBindings.h"
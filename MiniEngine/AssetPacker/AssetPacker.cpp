@@ -0,0 +1,304 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "AssetPack.h"
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <zlib.h>
+
+namespace
+{
+    struct PackOptions
+    {
+        PackOptions() : level(6), alignment(64), storedExtensions(1, L".h3d") {}
+
+        int level;                                  // zlib level, 0 stores everything
+        uint32_t alignment;                         // of the data of every entry
+        std::vector<std::wstring> storedExtensions; // never compressed, so they can be used in place
+    };
+
+    struct PackFile
+    {
+        std::wstring path;      // as found on disk
+        std::wstring name;      // normalized
+        uint64_t hash;
+    };
+
+    bool EndsWith(const std::wstring &name, const std::wstring &suffix)
+    {
+        return name.size() >= suffix.size() && 0 == name.compare(name.size() - suffix.size(), std::wstring::npos, suffix);
+    }
+
+    uint64_t AlignUp(uint64_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) & ~(uint64_t)(alignment - 1);
+    }
+
+    void FindFiles(const std::wstring &directory, std::vector<PackFile> &files)
+    {
+        WIN32_FIND_DATAW findData;
+        HANDLE find = FindFirstFileExW((directory + L"/*").c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE)
+            return;
+
+        do
+        {
+            if (0 == wcscmp(findData.cFileName, L".") || 0 == wcscmp(findData.cFileName, L".."))
+                continue;
+
+            std::wstring path = directory + L"/" + findData.cFileName;
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                FindFiles(path, files);
+                continue;
+            }
+
+            // the same name the runtime looks up, relative to the working directory
+            PackFile file;
+            file.path = path;
+            file.name = path;
+            std::transform(file.name.begin(), file.name.end(), file.name.begin(), AssetPack::NormalizeChar);
+            while (file.name.compare(0, 2, L"./") == 0)
+                file.name.erase(0, 2);
+            file.hash = AssetPack::HashName(file.name.c_str(), file.name.size());
+            files.push_back(file);
+        }
+        while (FindNextFileW(find, &findData));
+
+        FindClose(find);
+    }
+
+    bool ReadWholeFile(const std::wstring &path, std::vector<uint8_t> &data)
+    {
+        FILE *file = nullptr;
+        if (0 != _wfopen_s(&file, path.c_str(), L"rb"))
+            return false;
+
+        bool ok = 0 == _fseeki64(file, 0, SEEK_END);
+        int64_t size = _ftelli64(file);
+        ok = ok && size >= 0 && 0 == _fseeki64(file, 0, SEEK_SET);
+        if (ok)
+        {
+            data.resize((size_t)size);
+            ok = data.empty() || 1 == fread(data.data(), data.size(), 1, file);
+        }
+
+        fclose(file);
+        return ok;
+    }
+
+    // Compresses the file unless it's one of the stored types or zlib saves less than an eighth of it
+    void PackData(const PackFile &file, const std::vector<uint8_t> &data, const PackOptions &options,
+        std::vector<uint8_t> &stored, AssetPack::Entry &entry)
+    {
+        entry.Compression = AssetPack::kStored;
+        entry.Size = data.size();
+
+        bool compress = options.level > 0 && data.size() > 0 && data.size() <= ULONG_MAX;
+        for (const std::wstring &extension : options.storedExtensions)
+            compress = compress && !EndsWith(file.name, extension);
+
+        if (compress)
+        {
+            uLongf compressedSize = compressBound((uLong)data.size());
+            stored.resize(compressedSize);
+            if (Z_OK == compress2(stored.data(), &compressedSize, data.data(), (uLong)data.size(), options.level) &&
+                compressedSize <= data.size() - data.size() / 8)
+            {
+                stored.resize(compressedSize);
+                entry.Compression = AssetPack::kZlib;
+                entry.StoredSize = compressedSize;
+                return;
+            }
+        }
+
+        stored = data;
+        entry.StoredSize = data.size();
+    }
+
+    bool WritePack(const std::wstring &outputFile, std::vector<PackFile> &files, const PackOptions &options)
+    {
+        // the runtime binary searches the entries by hash
+        std::sort(files.begin(), files.end(), [](const PackFile &a, const PackFile &b)
+        {
+            return a.hash < b.hash || (a.hash == b.hash && a.name < b.name);
+        });
+
+        std::vector<AssetPack::Entry> entries(files.size());
+        std::vector<wchar_t> names;
+        for (size_t n = 0; n < files.size(); n++)
+        {
+            if (n > 0 && files[n].name == files[n - 1].name)
+            {
+                wprintf(L"%s was found twice\n", files[n].name.c_str());
+                return false;
+            }
+            if (files[n].name.size() > UINT16_MAX)
+            {
+                wprintf(L"name too long: %s\n", files[n].name.c_str());
+                return false;
+            }
+
+            entries[n] = {};
+            entries[n].NameHash = files[n].hash;
+            entries[n].NameOffset = (uint32_t)names.size();
+            entries[n].NameLength = (uint16_t)files[n].name.size();
+            names.insert(names.end(), files[n].name.begin(), files[n].name.end());
+        }
+
+        AssetPack::Header header = {};
+        header.Magic = AssetPack::kMagic;
+        header.Version = AssetPack::kVersion;
+        header.EntryCount = (uint32_t)entries.size();
+        header.Alignment = options.alignment;
+        header.EntryTableOffset = sizeof(header);
+        header.NameTableOffset = header.EntryTableOffset + entries.size() * sizeof(AssetPack::Entry);
+        header.NameTableLength = names.size();
+
+        FILE *file = nullptr;
+        if (0 != _wfopen_s(&file, outputFile.c_str(), L"wb"))
+        {
+            wprintf(L"failed to open %s\n", outputFile.c_str());
+            return false;
+        }
+
+        // the data goes after the tables, which are written once every entry's place is known
+        uint64_t offset = AlignUp(header.NameTableOffset + names.size() * sizeof(wchar_t), options.alignment);
+        bool ok = 0 == _fseeki64(file, offset, SEEK_SET);
+
+        uint64_t totalSize = 0;
+        uint32_t compressedCount = 0;
+        std::vector<uint8_t> data, stored;
+        for (size_t n = 0; ok && n < files.size(); n++)
+        {
+            if (!ReadWholeFile(files[n].path, data))
+            {
+                wprintf(L"failed to read %s\n", files[n].path.c_str());
+                ok = false;
+                break;
+            }
+
+            PackData(files[n], data, options, stored, entries[n]);
+            entries[n].Offset = offset;
+
+            uint64_t paddedSize = AlignUp(stored.size(), options.alignment);
+            stored.resize((size_t)paddedSize, 0);
+            ok = stored.empty() || 1 == fwrite(stored.data(), stored.size(), 1, file);
+
+            offset += paddedSize;
+            totalSize += data.size();
+            compressedCount += entries[n].Compression == AssetPack::kZlib ? 1 : 0;
+        }
+
+        ok = ok && 0 == _fseeki64(file, 0, SEEK_SET) && 1 == fwrite(&header, sizeof(header), 1, file);
+        ok = ok && (entries.empty() || 1 == fwrite(entries.data(), entries.size() * sizeof(AssetPack::Entry), 1, file));
+        ok = ok && (names.empty() || 1 == fwrite(names.data(), names.size() * sizeof(wchar_t), 1, file));
+
+        if (EOF == fclose(file))
+            ok = false;
+
+        if (!ok)
+        {
+            wprintf(L"failed to write %s\n", outputFile.c_str());
+            return false;
+        }
+
+        wprintf(L"%s: %zu files (%u compressed), %.1f MB -> %.1f MB\n", outputFile.c_str(), files.size(), compressedCount,
+            totalSize / 1048576.0, offset / 1048576.0);
+        return true;
+    }
+}
+
+void PrintHelp()
+{
+    printf("asset_pack\n");
+
+    printf("usage:\n");
+    printf("asset_pack [options] output_file directory [directory ...]\n");
+    printf("packs every file under the directories, which are given relative to the directory the\n");
+    printf("application runs in, so they are found under the same names once the pack is mounted\n");
+    printf("options:\n");
+    printf("  -level n         zlib level 0-9, 0 stores every file as is (default 6)\n");
+    printf("  -align n         power of two alignment of every file's data (default 64)\n");
+    printf("  -store .ext      never compress files with this extension, .h3d never is so models can be mapped\n");
+    printf("files zlib shrinks by less than an eighth are stored as is\n");
+}
+
+int wmain(int argc, wchar_t **argv)
+{
+    PackOptions options;
+
+    int argIndex = 1;
+    for (; argIndex < argc && argv[argIndex][0] == L'-'; argIndex++)
+    {
+        if (0 == wcscmp(argv[argIndex], L"-level") && argIndex + 1 < argc)
+        {
+            options.level = _wtoi(argv[++argIndex]);
+            if (options.level < 0 || options.level > 9)
+            {
+                PrintHelp();
+                return -1;
+            }
+        }
+        else if (0 == wcscmp(argv[argIndex], L"-align") && argIndex + 1 < argc)
+        {
+            int alignment = _wtoi(argv[++argIndex]);
+            if (alignment < 1 || alignment > 65536 || (alignment & (alignment - 1)) != 0)
+            {
+                PrintHelp();
+                return -1;
+            }
+            options.alignment = (uint32_t)alignment;
+        }
+        else if (0 == wcscmp(argv[argIndex], L"-store") && argIndex + 1 < argc)
+        {
+            std::wstring extension = argv[++argIndex];
+            std::transform(extension.begin(), extension.end(), extension.begin(), AssetPack::NormalizeChar);
+            options.storedExtensions.push_back(extension);
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    if (argc - argIndex < 2)
+    {
+        PrintHelp();
+        return -1;
+    }
+
+    std::wstring outputFile = argv[argIndex++];
+
+    std::vector<PackFile> files;
+    for (; argIndex < argc; argIndex++)
+    {
+        std::wstring directory = argv[argIndex];
+        while (!directory.empty() && (directory.back() == L'/' || directory.back() == L'\\'))
+            directory.pop_back();
+        FindFiles(directory, files);
+    }
+
+    if (files.empty())
+    {
+        printf("no files to pack\n");
+        return -1;
+    }
+
+    return WritePack(outputFile, files, options) ? 0 : -1;
+}
@@ -0,0 +1,273 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+    volatile uint64_t s_Sink;
+
+    double ElapsedSeconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const char *PlatformName()
+    {
+#if defined(_WIN32)
+        return "windows";
+#elif defined(__linux__)
+        return "linux";
+#else
+        return "unknown";
+#endif
+    }
+
+    std::string CompilerName()
+    {
+        char name[64];
+#if defined(_MSC_VER)
+        snprintf(name, sizeof(name), "msvc %d", _MSC_FULL_VER);
+#elif defined(__clang__)
+        snprintf(name, sizeof(name), "clang %d.%d.%d", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+        snprintf(name, sizeof(name), "gcc %d.%d.%d", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#else
+        snprintf(name, sizeof(name), "unknown");
+#endif
+        return name;
+    }
+
+    // Names are written by this file, so only quotes and backslashes need escaping
+    std::string Quoted(const std::string &text)
+    {
+        std::string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                quoted += '\\';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    // Reads the name and median of every benchmark in a file written by WriteJson().  Not a JSON
+    // parser, it relies on each benchmark's name coming before its other fields.
+    bool ReadBaseline(const std::string &fileName, std::map<std::string, double> &medians)
+    {
+        FILE *file = fopen(fileName.c_str(), "rb");
+        if (file == nullptr)
+            return false;
+
+        std::string text;
+        char buffer[4096];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            text.append(buffer, count);
+        fclose(file);
+
+        const char *nameKey = "\"name\": \"";
+        const char *medianKey = "\"median_ns\": ";
+        for (size_t pos = text.find(nameKey); pos != std::string::npos; )
+        {
+            std::string name;
+            size_t n = pos + strlen(nameKey);
+            for (; n < text.size() && text[n] != '"'; n++)
+            {
+                if (text[n] == '\\' && n + 1 < text.size())
+                    n++;
+                name += text[n];
+            }
+
+            size_t next = text.find(nameKey, n);
+            size_t median = text.find(medianKey, n);
+            if (median != std::string::npos && median < next)
+                medians[name] = strtod(text.c_str() + median + strlen(medianKey), nullptr);
+
+            pos = next;
+        }
+        return !medians.empty();
+    }
+}
+
+void KeepValue(uint64_t value)
+{
+    s_Sink = value;
+}
+
+void BenchmarkSuite::Add(const std::string &name, const char *unit, const Setup &setup)
+{
+    Benchmark benchmark;
+    benchmark.name = name;
+    benchmark.unit = unit;
+    benchmark.setup = setup;
+    m_Benchmarks.push_back(benchmark);
+}
+
+void BenchmarkSuite::ReportMetric(const std::string &name, double value)
+{
+    Metric metric;
+    metric.name = name;
+    metric.value = value;
+    m_SetupMetrics.push_back(metric);
+}
+
+void BenchmarkSuite::Run(const Options &options)
+{
+    m_Results.clear();
+
+    printf("%-40s %14s %14s %12s\n", "benchmark", "median ns", "min ns", "per");
+    for (const Benchmark &benchmark : m_Benchmarks)
+    {
+        if (benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+
+        Result result;
+        result.name = benchmark.name;
+        result.unit = benchmark.unit;
+        result.itemsPerCall = 0;
+        result.medianNanoseconds = 0.0;
+        result.minNanoseconds = 0.0;
+
+        m_SetupMetrics.clear();
+        Kernel kernel = benchmark.setup();
+        result.metrics.swap(m_SetupMetrics);
+        if (kernel)
+            result.itemsPerCall = kernel();
+        result.failed = result.itemsPerCall == 0;
+
+        std::vector<double> nanoseconds;
+        if (!result.failed)
+        {
+            for (uint32_t repetition = 0; repetition < std::max(options.repetitions, 1u); repetition++)
+            {
+                uint64_t items = 0;
+                double seconds = 0.0;
+                auto start = std::chrono::steady_clock::now();
+                do
+                {
+                    uint64_t callItems = kernel();
+                    result.failed = result.failed || callItems == 0;
+                    items += callItems;
+                    seconds = ElapsedSeconds(start);
+                }
+                while (seconds < options.minSeconds && !result.failed);
+
+                if (result.failed)
+                    break;
+                nanoseconds.push_back(seconds * 1e9 / items);
+            }
+        }
+
+        if (!result.failed)
+        {
+            std::sort(nanoseconds.begin(), nanoseconds.end());
+            size_t middle = nanoseconds.size() / 2;
+            result.medianNanoseconds = nanoseconds.size() & 1 ? nanoseconds[middle] : (nanoseconds[middle - 1] + nanoseconds[middle]) * 0.5;
+            result.minNanoseconds = nanoseconds.front();
+
+            printf("%-40s %14.3f %14.3f %12s\n", result.name.c_str(), result.medianNanoseconds, result.minNanoseconds, result.unit.c_str());
+        }
+        else
+        {
+            printf("%-40s %14s %14s %12s\n", result.name.c_str(), "failed", "failed", result.unit.c_str());
+        }
+        for (size_t n = 0; n < result.metrics.size(); n++)
+            printf("%s%s %.3f%s", n % 4 ? "  " : "    ", result.metrics[n].name.c_str(), result.metrics[n].value,
+                n % 4 == 3 || n + 1 == result.metrics.size() ? "\n" : "");
+        fflush(stdout);
+
+        m_Results.push_back(result);
+    }
+}
+
+bool BenchmarkSuite::WriteJson(const std::string &fileName) const
+{
+    FILE *file = fopen(fileName.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"platform\": \"%s\",\n", PlatformName());
+    fprintf(file, "  \"compiler\": %s,\n", Quoted(CompilerName()).c_str());
+    fprintf(file, "  \"benchmarks\": [\n");
+    for (size_t n = 0; n < m_Results.size(); n++)
+    {
+        const Result &result = m_Results[n];
+        std::string metrics;
+        for (const Metric &metric : result.metrics)
+        {
+            char value[32];
+            snprintf(value, sizeof(value), ": %.4f", metric.value);
+            metrics += (metrics.empty() ? ", \"metrics\": { " : ", ") + Quoted(metric.name) + value;
+        }
+        if (!metrics.empty())
+            metrics += " }";
+
+        fprintf(file, "    { \"name\": %s, \"unit\": %s, \"items\": %llu, \"median_ns\": %.4f, \"min_ns\": %.4f, \"failed\": %s%s }%s\n",
+            Quoted(result.name).c_str(), Quoted(result.unit).c_str(), (unsigned long long)result.itemsPerCall,
+            result.medianNanoseconds, result.minNanoseconds, result.failed ? "true" : "false", metrics.c_str(),
+            n + 1 < m_Results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    return 0 == fclose(file);
+}
+
+bool BenchmarkSuite::CompareWithBaseline(const std::string &fileName, double tolerance) const
+{
+    std::map<std::string, double> baseline;
+    if (!ReadBaseline(fileName, baseline))
+    {
+        printf("error: couldn't read baseline %s\n", fileName.c_str());
+        return false;
+    }
+
+    uint32_t regressions = 0;
+    printf("\ncompared with %s, %.0f%% tolerance:\n", fileName.c_str(), tolerance * 100.0);
+    printf("%-40s %14s %14s %10s\n", "benchmark", "baseline ns", "median ns", "change");
+    for (const Result &result : m_Results)
+    {
+        auto entry = baseline.find(result.name);
+        if (result.failed || entry == baseline.end() || entry->second <= 0.0)
+        {
+            printf("%-40s %14s %14.3f %10s\n", result.name.c_str(), "-", result.medianNanoseconds, result.failed ? "failed" : "new");
+            continue;
+        }
+
+        double change = result.medianNanoseconds / entry->second - 1.0;
+        bool regressed = change > tolerance;
+        regressions += regressed ? 1 : 0;
+        printf("%-40s %14.3f %14.3f %+9.1f%%%s\n", result.name.c_str(), entry->second, result.medianNanoseconds,
+            change * 100.0, regressed ? "  slower" : "");
+    }
+
+    if (regressions > 0)
+        printf("error: %u benchmarks are more than %.0f%% slower than the baseline\n", regressions, tolerance * 100.0);
+    return regressions == 0;
+}
+
+bool BenchmarkSuite::AnyFailed(void) const
+{
+    for (const Result &result : m_Results)
+    {
+        if (result.failed)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+//
+// Times CPU kernels and compares them with an earlier run.  A benchmark is a setup function that
+// builds its inputs, from a fixed seed, and returns the kernel to time.  The kernel does one pass
+// over the inputs and returns how many items it processed, so results are in nanoseconds per item
+// and stay comparable when inputs change size.
+//
+// Each benchmark runs once to warm up, then for a number of repetitions that each call the kernel
+// until a minimum time has passed.  The median repetition is the result, and what the baseline
+// comparison uses.  Results are written as JSON that can be read back as a baseline.
+//
+// A setup function can also report metrics about what its kernel produces, like the cache miss
+// ratio of an index order, which are printed and written with the result but not compared.
+//
+class BenchmarkSuite
+{
+public:
+
+    typedef std::function<uint64_t(void)> Kernel;
+
+    // Returns an empty kernel if the inputs couldn't be built or the code under test gave the wrong answer.
+    // A kernel that returns 0 items while it is timed fails the benchmark the same way.
+    typedef std::function<Kernel(void)> Setup;
+
+    struct Options
+    {
+        Options() : repetitions(5), minSeconds(0.05), tolerance(0.1) {}
+
+        std::string filter;         // only benchmarks whose names contain this
+        uint32_t repetitions;
+        double minSeconds;          // per repetition
+        double tolerance;           // how much slower than the baseline counts as a regression
+    };
+
+    struct Metric
+    {
+        std::string name;
+        double value;
+    };
+
+    struct Result
+    {
+        std::string name;
+        std::string unit;
+        uint64_t itemsPerCall;
+        double medianNanoseconds;   // per item
+        double minNanoseconds;
+        bool failed;
+        std::vector<Metric> metrics;
+    };
+
+    // Names look like "group/case", with the item a kernel counts as the unit
+    void Add(const std::string &name, const char *unit, const Setup &setup);
+
+    // Only called from a setup function, adds a metric to the result of the benchmark being set up
+    void ReportMetric(const std::string &name, double value);
+
+    // Runs every benchmark that passes the filter and prints a line for each
+    void Run(const Options &options);
+
+    bool WriteJson(const std::string &fileName) const;
+
+    // Compares the results with a file written by WriteJson() and prints the change in each.
+    // Returns false if the file couldn't be read or anything got slower than the tolerance allows.
+    bool CompareWithBaseline(const std::string &fileName, double tolerance) const;
+
+    bool AnyFailed(void) const;
+
+private:
+
+    struct Benchmark
+    {
+        std::string name;
+        std::string unit;
+        Setup setup;
+    };
+
+    std::vector<Benchmark> m_Benchmarks;
+    std::vector<Result> m_Results;
+    std::vector<Metric> m_SetupMetrics;
+};
+
+// Stores a value where the compiler can't see it's never read, so work that produces it isn't optimized away
+void KeepValue(uint64_t value);
+
+// Benchmarks of Core and of the model pipeline.  Some need the Windows build.
+void AddCoreBenchmarks(BenchmarkSuite &suite);
+void AddBuddyAllocatorBenchmarks(BenchmarkSuite &suite);
+void AddLinearPageBenchmarks(BenchmarkSuite &suite);
+void AddPSOCacheBenchmarks(BenchmarkSuite &suite);
+void AddRenderGraphBenchmarks(BenchmarkSuite &suite);
+void AddTraceBenchmarks(BenchmarkSuite &suite);
+void AddModelBenchmarks(BenchmarkSuite &suite);
+void AddIndexOptimizeBenchmarks(BenchmarkSuite &suite);
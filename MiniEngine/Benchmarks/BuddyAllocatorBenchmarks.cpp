@@ -0,0 +1,306 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "BuddyBitmap.h"
+
+#include <stdio.h>
+#include <vector>
+#include <set>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+    // 1 GB of 64 KB placed buffers, as BuddyAllocator manages them
+    const uint32_t kMaxOrder = 14;
+    const uint32_t kLargestRequestOrder = 8;
+    const uint32_t kOperationsPerThread = 1 << 16;
+    const uint32_t kTargetLiveBlocks = 1024;
+
+    // BuddyAllocator's previous bookkeeping: a set of free offsets per order, split and merged
+    // recursively, with exhaustion reported by throwing
+    class SetBuddy
+    {
+    public:
+        void Reset(uint32_t maxOrder)
+        {
+            m_maxOrder = maxOrder;
+            m_freeBlocks.clear();
+            m_freeBlocks.resize(maxOrder + 1);
+            m_freeBlocks[maxOrder].insert((size_t)0);
+        }
+
+        size_t Allocate(uint32_t order)
+        {
+            try
+            {
+                return AllocateBlock(order);
+            }
+            catch (std::bad_alloc&)
+            {
+                return BuddyBitmap::kInvalidOffset;
+            }
+        }
+
+        void Free(size_t offset, uint32_t order)
+        {
+            DeallocateBlock(offset, order);
+        }
+
+        bool IsEmpty() const
+        {
+            return m_freeBlocks[m_maxOrder].size() == 1;
+        }
+
+    private:
+        size_t AllocateBlock(uint32_t order)
+        {
+            if (order > m_maxOrder)
+                throw std::bad_alloc();
+
+            auto it = m_freeBlocks[order].begin();
+            if (it == m_freeBlocks[order].end())
+            {
+                size_t left = AllocateBlock(order + 1);
+                m_freeBlocks[order].insert(left + ((size_t)1 << order));
+                return left;
+            }
+
+            size_t offset = *it;
+            m_freeBlocks[order].erase(it);
+            return offset;
+        }
+
+        void DeallocateBlock(size_t offset, uint32_t order)
+        {
+            size_t buddy = offset ^ ((size_t)1 << order);
+            auto it = m_freeBlocks[order].find(buddy);
+            if (it != m_freeBlocks[order].end())
+            {
+                DeallocateBlock(std::min(offset, buddy), order + 1);
+                m_freeBlocks[order].erase(it);
+            }
+            else
+                m_freeBlocks[order].insert(offset);
+        }
+
+        uint32_t m_maxOrder;
+        std::vector<std::set<size_t>> m_freeBlocks;
+    };
+
+    class BitmapBuddy : public BuddyBitmap
+    {
+    public:
+        bool IsEmpty() const
+        {
+            return GetLargestFreeBlock() == (size_t)1 << kMaxOrder;
+        }
+    };
+
+    // Either an allocation of the given order or a free of the live block at the given index
+    struct Operation
+    {
+        bool allocate;
+        uint32_t value;
+    };
+
+    // Keeps about kTargetLiveBlocks / threadCount blocks alive, mostly small ones like vertex and
+    // index buffers with the odd large one.  Which live block a free picks is decided up front, so
+    // any allocator with the same policy replays the exact same sequence.
+    void GenerateOperations(uint32_t seed, uint32_t threadCount, std::vector<Operation> &operations)
+    {
+        std::mt19937 rng(seed);
+        const uint32_t targetLive = std::max(kTargetLiveBlocks / threadCount, 16u);
+
+        operations.resize(kOperationsPerThread);
+        uint32_t live = 0;
+        for (Operation &operation : operations)
+        {
+            operation.allocate = live == 0 || rng() % (2 * targetLive) >= live;
+            if (operation.allocate)
+            {
+                // Geometric: half the requests are order 0, a quarter order 1 and so on
+                uint32_t order = 0;
+                while (order < kLargestRequestOrder && (rng() & 1))
+                    order++;
+                operation.value = order;
+                live++;
+            }
+            else
+            {
+                operation.value = rng() % live;
+                live--;
+            }
+        }
+    }
+
+    struct Block
+    {
+        size_t offset;
+        uint32_t order;
+    };
+
+    // Marks or clears the units of a block in a map shared by every thread.  Returns false if a
+    // unit being marked was already taken.
+    bool MarkUnits(std::vector<std::atomic<uint8_t>> *owners, const Block &block, bool taken)
+    {
+        bool disjoint = true;
+        if (owners != nullptr && block.offset != BuddyBitmap::kInvalidOffset)
+        {
+            for (size_t unit = block.offset; unit < block.offset + ((size_t)1 << block.order); unit++)
+            {
+                if (!taken)
+                    (*owners)[unit] = 0;
+                else if ((*owners)[unit].exchange(1) != 0)
+                    disjoint = false;
+            }
+        }
+        return disjoint;
+    }
+
+    // Replays the operations, skipping the frees of allocations that failed, then frees whatever
+    // is left so the next run starts from an empty allocator.  Returns false if two live blocks overlapped.
+    template <typename Allocator>
+    bool Replay(Allocator &allocator, std::mutex &lock, const std::vector<Operation> &operations,
+        std::vector<size_t> *offsets, std::vector<std::atomic<uint8_t>> *owners)
+    {
+        std::vector<Block> live;
+        live.reserve(kTargetLiveBlocks);
+        bool disjoint = true;
+
+        for (const Operation &operation : operations)
+        {
+            if (operation.allocate)
+            {
+                Block block = { 0, operation.value };
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    block.offset = allocator.Allocate(block.order);
+                }
+
+                if (offsets != nullptr)
+                    offsets->push_back(block.offset);
+                disjoint = MarkUnits(owners, block, true) && disjoint;
+                live.push_back(block);
+            }
+            else
+            {
+                Block block = live[operation.value];
+                live[operation.value] = live.back();
+                live.pop_back();
+
+                if (block.offset == BuddyBitmap::kInvalidOffset)
+                    continue;
+
+                MarkUnits(owners, block, false);
+                std::lock_guard<std::mutex> guard(lock);
+                allocator.Free(block.offset, block.order);
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        for (const Block &block : live)
+        {
+            if (block.offset == BuddyBitmap::kInvalidOffset)
+                continue;
+            MarkUnits(owners, block, false);
+            allocator.Free(block.offset, block.order);
+        }
+        return disjoint;
+    }
+
+    // Every thread replays its own operations at once, behind the one lock BuddyAllocator takes.
+    // Returns the number of operations, or 0 if blocks overlapped or didn't all merge back.
+    template <typename Allocator>
+    uint64_t RunThreads(Allocator &allocator, const std::vector<std::vector<Operation>> &operations,
+        std::vector<std::atomic<uint8_t>> *owners)
+    {
+        const uint32_t threadCount = (uint32_t)operations.size();
+        std::mutex lock;
+        std::atomic<uint32_t> started(0);
+        std::atomic<bool> failed(false);
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            // Start together so the threads contend from the first operation
+            started++;
+            while (started < threadCount)
+                std::this_thread::yield();
+            if (!Replay(allocator, lock, operations[threadIndex], nullptr, owners))
+                failed = true;
+        };
+
+        allocator.Reset(kMaxOrder);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 1; t < threadCount; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (auto &thread : threads)
+            thread.join();
+
+        return failed || !allocator.IsEmpty() ? 0 : (uint64_t)kOperationsPerThread * threadCount;
+    }
+
+    // Single threaded, the bitmap must hand out the same offsets as the std::set allocator it replaced
+    bool SameOffsets()
+    {
+        std::vector<Operation> operations;
+        GenerateOperations(1, 1, operations);
+
+        std::mutex lock;
+        SetBuddy setBuddy;
+        BitmapBuddy bitmap;
+        std::vector<size_t> setOffsets, bitmapOffsets;
+        setBuddy.Reset(kMaxOrder);
+        bitmap.Reset(kMaxOrder);
+        Replay(setBuddy, lock, operations, &setOffsets, nullptr);
+        Replay(bitmap, lock, operations, &bitmapOffsets, nullptr);
+        return setOffsets == bitmapOffsets && setBuddy.IsEmpty() && bitmap.IsEmpty();
+    }
+
+    template <typename Allocator>
+    void AddThreadedBuddyBenchmark(BenchmarkSuite &suite, const char *name)
+    {
+        suite.Add(std::string("buddy_allocator/") + name, "operation", [=]() -> BenchmarkSuite::Kernel
+        {
+            const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+            auto operations = std::make_shared<std::vector<std::vector<Operation>>>(threadCount);
+            for (uint32_t t = 0; t < threadCount; t++)
+                GenerateOperations(t + 1, threadCount, (*operations)[t]);
+
+            // Once with every live unit marked by its owner, to catch blocks handed out twice
+            auto allocator = std::make_shared<Allocator>();
+            std::vector<std::atomic<uint8_t>> owners((size_t)1 << kMaxOrder);
+            for (auto &owner : owners)
+                owner = 0;
+
+            if (!SameOffsets() || RunThreads(*allocator, *operations, &owners) == 0)
+            {
+                printf("error: buddy_allocator/%s handed out overlapping blocks or blocks that don't match std::set\n", name);
+                return BenchmarkSuite::Kernel();
+            }
+
+            return [=]() { return RunThreads(*allocator, *operations, nullptr); };
+        });
+    }
+}
+
+void AddBuddyAllocatorBenchmarks(BenchmarkSuite &suite)
+{
+    AddThreadedBuddyBenchmark<SetBuddy>(suite, "set_threads");
+    AddThreadedBuddyBenchmark<BitmapBuddy>(suite, "bitmap_threads");
+}
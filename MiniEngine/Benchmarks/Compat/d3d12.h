@@ -0,0 +1,66 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+// Stands in for the Windows SDK header when Core headers that only deal in its enums, like
+// RenderGraphCompiler.h, are built with GCC or Clang.  The values match the SDK's.  Only on the
+// include path of the portable build.
+
+enum D3D12_RESOURCE_STATES
+{
+    D3D12_RESOURCE_STATE_COMMON = 0,
+    D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER = 0x1,
+    D3D12_RESOURCE_STATE_INDEX_BUFFER = 0x2,
+    D3D12_RESOURCE_STATE_RENDER_TARGET = 0x4,
+    D3D12_RESOURCE_STATE_UNORDERED_ACCESS = 0x8,
+    D3D12_RESOURCE_STATE_DEPTH_WRITE = 0x10,
+    D3D12_RESOURCE_STATE_DEPTH_READ = 0x20,
+    D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40,
+    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80,
+    D3D12_RESOURCE_STATE_STREAM_OUT = 0x100,
+    D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT = 0x200,
+    D3D12_RESOURCE_STATE_COPY_DEST = 0x400,
+    D3D12_RESOURCE_STATE_COPY_SOURCE = 0x800,
+    D3D12_RESOURCE_STATE_RESOLVE_DEST = 0x1000,
+    D3D12_RESOURCE_STATE_RESOLVE_SOURCE = 0x2000,
+    D3D12_RESOURCE_STATE_GENERIC_READ = 0x1 | 0x2 | 0x40 | 0x80 | 0x200 | 0x800,
+    D3D12_RESOURCE_STATE_PRESENT = 0,
+    D3D12_RESOURCE_STATE_PREDICATION = 0x200,
+};
+
+enum D3D12_RESOURCE_BARRIER_TYPE
+{
+    D3D12_RESOURCE_BARRIER_TYPE_TRANSITION = 0,
+    D3D12_RESOURCE_BARRIER_TYPE_ALIASING = 1,
+    D3D12_RESOURCE_BARRIER_TYPE_UAV = 2,
+};
+
+enum D3D12_RESOURCE_BARRIER_FLAGS
+{
+    D3D12_RESOURCE_BARRIER_FLAG_NONE = 0,
+    D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY = 0x1,
+    D3D12_RESOURCE_BARRIER_FLAG_END_ONLY = 0x2,
+};
+
+// What DEFINE_ENUM_FLAG_OPERATORS gives the flag enums in the SDK
+#define COMPAT_ENUM_FLAG_OPERATORS( Type ) \
+    inline Type operator|( Type a, Type b ) { return Type((int)a | (int)b); } \
+    inline Type operator&( Type a, Type b ) { return Type((int)a & (int)b); } \
+    inline Type operator^( Type a, Type b ) { return Type((int)a ^ (int)b); } \
+    inline Type operator~( Type a ) { return Type(~(int)a); } \
+    inline Type& operator|=( Type& a, Type b ) { return a = a | b; } \
+    inline Type& operator&=( Type& a, Type b ) { return a = a & b; }
+
+COMPAT_ENUM_FLAG_OPERATORS(D3D12_RESOURCE_STATES)
+COMPAT_ENUM_FLAG_OPERATORS(D3D12_RESOURCE_BARRIER_FLAGS)
+
+#undef COMPAT_ENUM_FLAG_OPERATORS
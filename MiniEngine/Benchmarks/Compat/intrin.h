@@ -0,0 +1,34 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+// Stands in for the MSVC header when Core headers are built with GCC or Clang, providing the
+// intrinsics they use on top of the compilers' builtins.  Only on the include path of the
+// portable build.
+
+#include <stdint.h>
+
+inline unsigned char _BitScanForward64( unsigned long* Index, unsigned long long Mask )
+{
+    if (Mask == 0)
+        return 0;
+    *Index = (unsigned long)__builtin_ctzll(Mask);
+    return 1;
+}
+
+inline unsigned char _BitScanReverse64( unsigned long* Index, unsigned long long Mask )
+{
+    if (Mask == 0)
+        return 0;
+    *Index = 63 - (unsigned long)__builtin_clzll(Mask);
+    return 1;
+}
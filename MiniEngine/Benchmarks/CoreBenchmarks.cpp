@@ -0,0 +1,404 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "BuddyBitmap.h"
+#include "Hash.h"
+
+#ifdef _WIN32
+#include "Utility.h"
+#include "VectorMath.h"
+#include "Math/Frustum.h"
+#include "Math/BatchTransform.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // 1 GB of 64 KB placed buffers, as BuddyAllocator manages them
+    const uint32_t kBuddyMaxOrder = 14;
+    const uint32_t kBuddyLargestRequestOrder = 8;
+    const uint32_t kBuddyOperations = 1 << 16;
+    const uint32_t kBuddyTargetLiveBlocks = 1024;
+
+    // Allocations of random orders, most of them small, freed in random order once about
+    // kBuddyTargetLiveBlocks are live.  The choices are made here so the kernel only allocates.
+    struct BuddyTrace
+    {
+        std::vector<uint8_t> orders;        // per allocation
+        std::vector<uint32_t> victims;      // per free, a random number picking a live block
+        std::vector<bool> isFree;           // per operation
+    };
+
+    BuddyTrace MakeBuddyTrace(uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        BuddyTrace trace;
+        uint32_t live = 0;
+        for (uint32_t n = 0; n < kBuddyOperations; n++)
+        {
+            bool isFree = live > 0 && (live >= 2 * kBuddyTargetLiveBlocks || (rng() % (2 * kBuddyTargetLiveBlocks)) < live);
+            trace.isFree.push_back(isFree);
+            if (isFree)
+            {
+                trace.victims.push_back(rng());
+                live--;
+            }
+            else
+            {
+                // each order half as likely as the one below it
+                uint32_t order = 0;
+                while (order < kBuddyLargestRequestOrder && (rng() & 1))
+                    order++;
+                trace.orders.push_back((uint8_t)order);
+                live++;
+            }
+        }
+        return trace;
+    }
+
+    // Returns the number of operations, or 0 if the bitmap lost track of a block
+    uint64_t RunBuddyTrace(const BuddyTrace &trace, BuddyBitmap &bitmap, std::vector<std::pair<size_t, uint32_t> > &live)
+    {
+        bitmap.Reset(kBuddyMaxOrder);
+        live.clear();
+
+        size_t nextOrder = 0, nextVictim = 0;
+        for (bool isFree : trace.isFree)
+        {
+            if (isFree)
+            {
+                size_t victim = trace.victims[nextVictim++] % live.size();
+                bitmap.Free(live[victim].first, live[victim].second);
+                live[victim] = live.back();
+                live.pop_back();
+            }
+            else
+            {
+                uint32_t order = trace.orders[nextOrder++];
+                size_t offset = bitmap.Allocate(order);
+                if (offset != BuddyBitmap::kInvalidOffset)
+                    live.push_back(std::make_pair(offset, order));
+            }
+        }
+
+        for (const auto &block : live)
+            bitmap.Free(block.first, block.second);
+
+        return bitmap.GetFreeUnits() == ((size_t)1 << kBuddyMaxOrder) ? trace.isFree.size() + live.size() : 0;
+    }
+
+    void AddBuddyBenchmarks(BenchmarkSuite &suite)
+    {
+        suite.Add("buddy_allocator/churn", "operation", []() -> BenchmarkSuite::Kernel
+        {
+            auto trace = std::make_shared<BuddyTrace>(MakeBuddyTrace(1));
+            auto bitmap = std::make_shared<BuddyBitmap>(kBuddyMaxOrder);
+            auto live = std::make_shared<std::vector<std::pair<size_t, uint32_t> > >();
+            return [=]() { return RunBuddyTrace(*trace, *bitmap, *live); };
+        });
+
+        // Every unit one at a time, then back again, which splits and merges every level
+        suite.Add("buddy_allocator/fill", "operation", []() -> BenchmarkSuite::Kernel
+        {
+            auto bitmap = std::make_shared<BuddyBitmap>(kBuddyMaxOrder);
+            auto offsets = std::make_shared<std::vector<size_t> >((size_t)1 << kBuddyMaxOrder);
+            return [=]() -> uint64_t
+            {
+                bitmap->Reset(kBuddyMaxOrder);
+                for (size_t &offset : *offsets)
+                    offset = bitmap->Allocate(0);
+                if (bitmap->Allocate(0) != BuddyBitmap::kInvalidOffset)
+                    return 0;
+                for (size_t offset : *offsets)
+                    bitmap->Free(offset, 0);
+                return bitmap->GetFreeUnits() == offsets->size() ? 2 * offsets->size() : 0;
+            };
+        });
+    }
+
+    // Descriptions hashed one after the other, the way the sampler, root signature and PSO caches
+    // key their lookups.  Sizes that aren't a multiple of 8 bytes start half of them unaligned.
+    void AddHashBenchmark(BenchmarkSuite &suite, const char *name, uint32_t descBytes)
+    {
+        suite.Add(std::string("hash_state/") + name, "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            const uint32_t descWords = descBytes / 4;
+            const uint32_t descCount = (1 << 20) / descBytes;
+
+            std::mt19937 rng(descBytes);
+            auto words = std::make_shared<std::vector<uint32_t> >(descWords * descCount);
+            for (uint32_t &word : *words)
+                word = rng() & 0xff00ffff;
+
+            return [=]() -> uint64_t
+            {
+                size_t combined = 0;
+                for (uint32_t n = 0; n < descCount; n++)
+                    combined ^= Utility::HashState(words->data() + n * descWords, descWords);
+                KeepValue(combined);
+                return (uint64_t)descCount * descBytes;
+            };
+        });
+    }
+
+#ifdef _WIN32
+    // Objects spread over a volume about eight times the size of the frustum, so most of them
+    // fail on one of the side planes like they would in a level
+    struct Instances
+    {
+        std::vector<float> centerX, centerY, centerZ, radius;
+        std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    };
+
+    void GenerateInstances(uint32_t count, Instances &instances)
+    {
+        std::mt19937 rng(count);
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+        std::uniform_real_distribution<float> size(0.5f, 20.0f);
+
+        for (uint32_t n = 0; n < count; n++)
+        {
+            float x = position(rng), y = position(rng) * 0.25f, z = position(rng);
+            float extent = size(rng);
+            instances.centerX.push_back(x);
+            instances.centerY.push_back(y);
+            instances.centerZ.push_back(z);
+            instances.radius.push_back(extent * 1.7320508f);
+            instances.minX.push_back(x - extent);
+            instances.minY.push_back(y - extent);
+            instances.minZ.push_back(z - extent);
+            instances.maxX.push_back(x + extent);
+            instances.maxY.push_back(y + extent);
+            instances.maxZ.push_back(z + extent);
+        }
+    }
+
+    // The batch kernels and the parallel variant of Math::Frustum, which cull the same objects
+    enum CullPath { kCullAuto, kCullScalar, kCullSSE, kCullAVX, kCullParallel };
+
+    void AddFrustumBenchmark(BenchmarkSuite &suite, const char *name, uint32_t count, bool boxes, CullPath path = kCullAuto)
+    {
+        suite.Add(std::string("frustum_cull/") + name, "object", [=]() -> BenchmarkSuite::Kernel
+        {
+            // 90 degree field of view looking down -z from the origin
+            auto frustum = std::make_shared<Math::Frustum>(Math::Matrix4(XMMatrixPerspectiveFovRH(XM_PIDIV2, 16.0f / 9.0f, 1.0f, 2000.0f)));
+            auto instances = std::make_shared<Instances>();
+            GenerateInstances(count, *instances);
+            auto mask = std::make_shared<std::vector<uint32_t> >((count + 31) / 32);
+
+            auto cull = [=](CullPath cullPath)
+            {
+                const Instances &i = *instances;
+                const Math::Frustum::BatchKernel kernels[] = { Math::Frustum::kBatchAuto, Math::Frustum::kBatchScalar,
+                    Math::Frustum::kBatchSSE, Math::Frustum::kBatchAVX };
+                Math::Frustum::SphereArray spheres = { i.centerX.data(), i.centerY.data(), i.centerZ.data(), i.radius.data() };
+                Math::Frustum::BoundingBoxArray boundingBoxes = { i.minX.data(), i.minY.data(), i.minZ.data(), i.maxX.data(), i.maxY.data(), i.maxZ.data() };
+
+                if (cullPath == kCullParallel && boxes)
+                    frustum->ParallelIntersectBoundingBoxes(boundingBoxes, count, mask->data());
+                else if (cullPath == kCullParallel)
+                    frustum->ParallelIntersectSpheres(spheres, count, mask->data());
+                else if (boxes)
+                    frustum->IntersectBoundingBoxes(boundingBoxes, 0, count, mask->data(), kernels[cullPath]);
+                else
+                    frustum->IntersectSpheres(spheres, 0, count, mask->data(), kernels[cullPath]);
+            };
+
+            // the path being timed has to agree with the scalar tests
+            cull(kCullScalar);
+            std::vector<uint32_t> reference = *mask;
+            cull(path);
+            if (*mask != reference)
+            {
+                printf("error: frustum_cull/%s differs from the scalar tests\n", name);
+                return BenchmarkSuite::Kernel();
+            }
+
+            return [=]() -> uint64_t
+            {
+                cull(path);
+                return count;
+            };
+        });
+    }
+
+    // Instance transforms and world bounds, as a scene updates them every frame
+    enum BatchOperation { kBatchPoints, kBatchNormals, kBatchBoxes, kBatchMatrices };
+
+    bool NearlyEqual(const std::vector<float> &a, const std::vector<float> &b)
+    {
+        for (size_t n = 0; n < a.size(); n++)
+        {
+            if (std::fabs(a[n] - b[n]) > 1e-4f * std::max(1.0f, std::fabs(a[n])))
+                return false;
+        }
+        return true;
+    }
+
+    void AddBatchTransformBenchmark(BenchmarkSuite &suite, const char *name, const char *unit, BatchOperation operation,
+        Math::BatchTransformKernel kernel)
+    {
+        suite.Add(std::string("batch_transform/") + name, unit, [=]() -> BenchmarkSuite::Kernel
+        {
+            const uint32_t count = 100000;
+
+            // scale, rotation and translation like a typical instance transform
+            auto xform = std::make_shared<Math::AffineTransform>(Math::Matrix3(Math::Quaternion(Math::Vector3(0.3f, 0.8f, 0.5f), 0.7f)) *
+                Math::Matrix3::MakeScale(1.5f, 0.5f, 2.0f), Math::Vector3(10.0f, -4.0f, 250.0f));
+
+            // six streams of inputs, which are box bounds or points and normals, and as many outputs
+            std::mt19937 rng(count);
+            std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+            auto source = std::make_shared<std::vector<float> >(6 * count);
+            auto dest = std::make_shared<std::vector<float> >(6 * count);
+            for (float &value : *source)
+                value = position(rng);
+            for (uint32_t n = 0; n < count; n++)
+            {
+                for (uint32_t axis = 0; axis < 3; axis++)
+                {
+                    float &minBound = (*source)[axis * count + n], &maxBound = (*source)[(axis + 3) * count + n];
+                    if (minBound > maxBound)
+                        std::swap(minBound, maxBound);
+                }
+            }
+
+            auto local = std::make_shared<std::vector<Math::Matrix4> >(count);
+            auto world = std::make_shared<std::vector<Math::Matrix4> >(count);
+            for (Math::Matrix4 &matrix : *local)
+            {
+                float pitch = position(rng), yaw = position(rng), roll = position(rng);
+                float x = position(rng), y = position(rng), z = position(rng);
+                matrix = Math::Matrix4(Math::AffineTransform(Math::Quaternion(pitch, yaw, roll), Math::Vector3(x, y, z)));
+            }
+
+            auto run = [=](Math::BatchTransformKernel runKernel)
+            {
+                float *s = source->data(), *d = dest->data();
+                switch (operation)
+                {
+                case kBatchPoints:
+                    Math::TransformPoints(*xform, { s, s + count, s + 2 * count }, { d, d + count, d + 2 * count }, 0, count, runKernel);
+                    break;
+                case kBatchNormals:
+                    Math::TransformNormals(xform->GetBasis(), { s, s + count, s + 2 * count }, { d, d + count, d + 2 * count }, 0, count, runKernel);
+                    break;
+                case kBatchBoxes:
+                    Math::TransformBoundingBoxes(*xform, { s, s + count, s + 2 * count, s + 3 * count, s + 4 * count, s + 5 * count },
+                        { d, d + count, d + 2 * count, d + 3 * count, d + 4 * count, d + 5 * count }, 0, count, runKernel);
+                    break;
+                case kBatchMatrices:
+                    Math::MultiplyMatrices(Math::Matrix4(*xform), local->data(), world->data(), count, runKernel);
+                    break;
+                }
+            };
+
+            // the kernel being timed has to agree with the Math operators
+            auto results = [=]()
+            {
+                if (operation != kBatchMatrices)
+                    return *dest;
+                const float *matrices = (const float *)world->data();
+                return std::vector<float>(matrices, matrices + 16 * count);
+            };
+            run(Math::kTransformScalar);
+            std::vector<float> reference = results();
+            run(kernel);
+            if (!NearlyEqual(reference, results()))
+            {
+                printf("error: batch_transform/%s differs from the Math operators\n", name);
+                return BenchmarkSuite::Kernel();
+            }
+
+            return [=]() -> uint64_t
+            {
+                run(kernel);
+                return count;
+            };
+        });
+    }
+
+    void AddMemCopyBenchmark(BenchmarkSuite &suite, const char *name, size_t bytes)
+    {
+        suite.Add(std::string("simd_memcopy/") + name, "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            auto source = std::make_shared<std::vector<__m128i> >(bytes / 16);
+            auto dest = std::make_shared<std::vector<__m128i> >(bytes / 16);
+
+            std::mt19937 rng((uint32_t)bytes);
+            for (__m128i &quadword : *source)
+                quadword = _mm_set_epi32(rng(), rng(), rng(), rng());
+
+            SIMDMemCopy(dest->data(), source->data(), source->size());
+            if (0 != memcmp(dest->data(), source->data(), bytes))
+            {
+                printf("error: simd_memcopy/%s didn't copy every byte\n", name);
+                return BenchmarkSuite::Kernel();
+            }
+
+            return [=]() -> uint64_t
+            {
+                SIMDMemCopy(dest->data(), source->data(), source->size());
+                return bytes;
+            };
+        });
+    }
+#endif
+}
+
+void AddCoreBenchmarks(BenchmarkSuite &suite)
+{
+    AddBuddyBenchmarks(suite);
+
+    AddHashBenchmark(suite, "sampler_desc", 52);
+    AddHashBenchmark(suite, "root_parameters", 256);
+    AddHashBenchmark(suite, "pso_desc", 656);
+
+#ifdef _WIN32
+    AddFrustumBenchmark(suite, "spheres_1k", 1000, false);
+    AddFrustumBenchmark(suite, "spheres_100k", 100000, false);
+    AddFrustumBenchmark(suite, "boxes_1k", 1000, true);
+    AddFrustumBenchmark(suite, "boxes_100k", 100000, true);
+
+    // every kernel on its own, and the parallel path split over the worker threads
+    AddFrustumBenchmark(suite, "spheres_100k_scalar", 100000, false, kCullScalar);
+    AddFrustumBenchmark(suite, "spheres_100k_sse", 100000, false, kCullSSE);
+    AddFrustumBenchmark(suite, "spheres_100k_avx", 100000, false, kCullAVX);
+    AddFrustumBenchmark(suite, "spheres_1m_parallel", 1000000, false, kCullParallel);
+    AddFrustumBenchmark(suite, "boxes_100k_scalar", 100000, true, kCullScalar);
+    AddFrustumBenchmark(suite, "boxes_100k_sse", 100000, true, kCullSSE);
+    AddFrustumBenchmark(suite, "boxes_100k_avx", 100000, true, kCullAVX);
+    AddFrustumBenchmark(suite, "boxes_1m_parallel", 1000000, true, kCullParallel);
+
+    // the widest kernel the CPU supports next to the Math operators in a loop
+    AddBatchTransformBenchmark(suite, "points_100k", "point", kBatchPoints, Math::kTransformAuto);
+    AddBatchTransformBenchmark(suite, "points_100k_scalar", "point", kBatchPoints, Math::kTransformScalar);
+    AddBatchTransformBenchmark(suite, "normals_100k", "normal", kBatchNormals, Math::kTransformAuto);
+    AddBatchTransformBenchmark(suite, "normals_100k_scalar", "normal", kBatchNormals, Math::kTransformScalar);
+    AddBatchTransformBenchmark(suite, "boxes_100k", "box", kBatchBoxes, Math::kTransformAuto);
+    AddBatchTransformBenchmark(suite, "boxes_100k_scalar", "box", kBatchBoxes, Math::kTransformScalar);
+    AddBatchTransformBenchmark(suite, "matrices_100k", "matrix", kBatchMatrices, Math::kTransformAuto);
+    AddBatchTransformBenchmark(suite, "matrices_100k_scalar", "matrix", kBatchMatrices, Math::kTransformScalar);
+
+    // in cache, in the last level cache, and streaming from memory
+    AddMemCopyBenchmark(suite, "16kb", 16 << 10);
+    AddMemCopyBenchmark(suite, "1mb", 1 << 20);
+    AddMemCopyBenchmark(suite, "64mb", 64 << 20);
+#endif
+}
@@ -0,0 +1,216 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "IndexOptimizePostTransform.h"
+
+#include <stdio.h>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+    enum CacheType
+    {
+        kFIFO,
+        kLRU,
+    };
+
+    struct CacheConfig
+    {
+        CacheType type;
+        uint32_t size;
+        const char *name;
+    };
+
+    // FIFO covers fixed-function hardware that only caches recently transformed vertices,
+    // LRU is closer to what newer parts do when a hit refreshes the entry
+    const CacheConfig s_CacheConfigs[] =
+    {
+        { kFIFO, 16, "fifo16" },
+        { kFIFO, 24, "fifo24" },
+        { kFIFO, 32, "fifo32" },
+        { kFIFO, 64, "fifo64" },
+        { kLRU, 16, "lru16" },
+        { kLRU, 32, "lru32" },
+        { kLRU, 64, "lru64" },
+    };
+
+    const uint16_t s_OptimizerCacheSizes[] = { 16, 24, 32, 64 };
+
+    struct MeshSize
+    {
+        const char *name;
+        uint32_t quadsPerSide;
+    };
+
+    // A building and a terrain tile, the same sizes as the optimize_faces benchmarks
+    const MeshSize s_MeshSizes[] =
+    {
+        { "32k", 128 },
+        { "512k", 512 },
+    };
+
+    // A grid of quadsPerSide squared quads, two triangles each, in random triangle order, which is
+    // the baseline every optimizer setting starts from
+    std::vector<uint32_t> MakeShuffledGrid(uint32_t quadsPerSide)
+    {
+        const uint32_t side = quadsPerSide + 1;
+        std::vector<uint32_t> indices;
+        indices.reserve(quadsPerSide * quadsPerSide * 6);
+        for (uint32_t z = 0; z < quadsPerSide; z++)
+        {
+            for (uint32_t x = 0; x < quadsPerSide; x++)
+            {
+                uint32_t corner = z * side + x;
+                const uint32_t triangles[6] = { corner, corner + side, corner + 1, corner + 1, corner + side, corner + side + 1 };
+                indices.insert(indices.end(), triangles, triangles + 6);
+            }
+        }
+
+        std::mt19937 random(quadsPerSide);
+        for (uint32_t f = (uint32_t)indices.size() / 3; f > 1; f--)
+        {
+            uint32_t other = std::uniform_int_distribution<uint32_t>(0, f - 1)(random);
+            for (uint32_t v = 0; v < 3; v++)
+                std::swap(indices[(f - 1) * 3 + v], indices[other * 3 + v]);
+        }
+        return indices;
+    }
+
+    // Returns the number of vertex shader invocations needed to draw the index list
+    uint32_t SimulateCache(const CacheConfig &config, const std::vector<uint32_t> &indices, uint32_t vertexCount)
+    {
+        uint32_t misses = 0;
+
+        if (config.type == kFIFO)
+        {
+            // a vertex is resident if fewer than size misses happened since it was inserted
+            std::vector<uint32_t> insertedAt(vertexCount, (uint32_t)-1);
+            for (uint32_t v : indices)
+            {
+                if (insertedAt[v] == (uint32_t)-1 || misses - insertedAt[v] >= config.size)
+                {
+                    insertedAt[v] = misses;
+                    misses++;
+                }
+            }
+        }
+        else
+        {
+            // most recently used first
+            std::vector<uint32_t> cache;
+            cache.reserve(config.size);
+            for (uint32_t v : indices)
+            {
+                auto it = std::find(cache.begin(), cache.end(), v);
+                if (it == cache.end())
+                {
+                    misses++;
+                    if (cache.size() == config.size)
+                        cache.pop_back();
+                    cache.insert(cache.begin(), v);
+                }
+                else
+                {
+                    std::rotate(cache.begin(), it, it + 1);
+                }
+            }
+        }
+
+        return misses;
+    }
+
+    // Reports the average cache miss ratio (misses per triangle) and average transform to vertex
+    // ratio (misses per vertex) of every simulated cache, and returns the ACMRs
+    std::vector<double> ReportCacheMetrics(BenchmarkSuite &suite, const std::vector<uint32_t> &indices, uint32_t vertexCount)
+    {
+        std::vector<double> acmr;
+        const double triangleCount = (double)(indices.size() / 3);
+        for (const CacheConfig &config : s_CacheConfigs)
+        {
+            uint32_t misses = SimulateCache(config, indices, vertexCount);
+            acmr.push_back(misses / triangleCount);
+            suite.ReportMetric(std::string("acmr_") + config.name, misses / triangleCount);
+            suite.ReportMetric(std::string("atvr_") + config.name, (double)misses / vertexCount);
+        }
+        return acmr;
+    }
+
+    // The optimizer only reorders triangles, so the sorted indices have to come out the same
+    bool SameTriangles(std::vector<uint32_t> a, std::vector<uint32_t> b)
+    {
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        return a == b;
+    }
+
+    void AddMeshBenchmarks(BenchmarkSuite &suite, const MeshSize &size)
+    {
+        const uint32_t vertexCount = (size.quadsPerSide + 1) * (size.quadsPerSide + 1);
+
+        // times the cache simulations themselves, the metrics are what the optimizer has to improve on
+        suite.Add(std::string("vertex_cache/") + size.name + "_shuffled", "triangle", [=, &suite]() -> BenchmarkSuite::Kernel
+        {
+            auto indices = std::make_shared<std::vector<uint32_t> >(MakeShuffledGrid(size.quadsPerSide));
+            ReportCacheMetrics(suite, *indices, vertexCount);
+
+            return [=]() -> uint64_t
+            {
+                uint64_t misses = 0;
+                for (const CacheConfig &config : s_CacheConfigs)
+                    misses += SimulateCache(config, *indices, vertexCount);
+                KeepValue(misses);
+                return indices->size() / 3;
+            };
+        });
+
+        for (uint16_t lruCacheSize : s_OptimizerCacheSizes)
+        {
+            std::string name = std::string(size.name) + "_forsyth" + std::to_string(lruCacheSize);
+            suite.Add("vertex_cache/" + name, "triangle", [=, &suite]() -> BenchmarkSuite::Kernel
+            {
+                auto source = std::make_shared<std::vector<uint32_t> >(MakeShuffledGrid(size.quadsPerSide));
+                auto optimized = std::make_shared<std::vector<uint32_t> >(source->size());
+
+                OptimizeFaces<uint32_t>(source->data(), (uint32_t)source->size(), optimized->data(), lruCacheSize);
+                std::vector<double> shuffledAcmr;
+                for (const CacheConfig &config : s_CacheConfigs)
+                    shuffledAcmr.push_back(SimulateCache(config, *source, vertexCount) / (double)(source->size() / 3));
+                std::vector<double> acmr = ReportCacheMetrics(suite, *optimized, vertexCount);
+
+                // whatever cache it's tuned for, the optimized order has to miss less than a random one on every cache
+                bool improved = true;
+                for (size_t c = 0; c < acmr.size(); c++)
+                    improved = improved && acmr[c] < shuffledAcmr[c];
+                if (!SameTriangles(*source, *optimized) || !improved)
+                {
+                    printf("error: vertex_cache/%s %s\n", name.c_str(), improved ? "lost triangles" : "didn't reduce cache misses");
+                    return BenchmarkSuite::Kernel();
+                }
+
+                return [=]() -> uint64_t
+                {
+                    OptimizeFaces<uint32_t>(source->data(), (uint32_t)source->size(), optimized->data(), lruCacheSize);
+                    return source->size() / 3;
+                };
+            });
+        }
+    }
+}
+
+void AddIndexOptimizeBenchmarks(BenchmarkSuite &suite)
+{
+    for (const MeshSize &size : s_MeshSizes)
+        AddMeshBenchmarks(suite, size);
+}
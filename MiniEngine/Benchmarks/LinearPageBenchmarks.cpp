@@ -0,0 +1,320 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "LinearPagePool.h"
+
+#include <stdio.h>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+    const uint32_t kCommandListsPerThread = 1 << 14;
+    const uint32_t kMaxPagesPerCommandList = 4;
+    const uint32_t kCommandListsInFlightPerThread = 3;
+
+    struct FakePage
+    {
+        FakePage() : m_NextAvailable(nullptr), m_SizeClass(0), inUse(0), retiredFence(0) {}
+
+        std::atomic<FakePage*> m_NextAvailable;
+        uint32_t m_SizeClass;
+
+        std::atomic<uint32_t> inUse;
+        uint64_t retiredFence;
+    };
+
+    // Stands in for the command queues.  Work completes a fixed number of command lists after it
+    // was submitted, as if the GPU ran that far behind.
+    class FakeFence
+    {
+    public:
+        FakeFence() : m_submitted(0), m_completed(0), m_lag(0) {}
+
+        void Reset(uint64_t lag)
+        {
+            m_submitted = 0;
+            m_completed = 0;
+            m_lag = lag;
+        }
+
+        uint64_t Submit()
+        {
+            uint64_t fence = ++m_submitted;
+            uint64_t completed = m_completed.load();
+            while (fence > m_lag && completed < fence - m_lag && !m_completed.compare_exchange_weak(completed, fence - m_lag))
+                ;
+            return fence;
+        }
+
+        bool IsFenceComplete(uint64_t fence) const { return fence <= m_completed.load(); }
+
+    private:
+        std::atomic<uint64_t> m_submitted;
+        std::atomic<uint64_t> m_completed;
+        uint64_t m_lag;
+    };
+
+    FakeFence g_Fence;
+
+    // Owns every page either manager creates, as LinearAllocatorPageManager::m_PagePool does
+    class PageStore
+    {
+    public:
+        FakePage *Create(uint32_t sizeClass)
+        {
+            FakePage *page = new FakePage;
+            page->m_SizeClass = sizeClass;
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_pages.emplace_back(page);
+            return page;
+        }
+
+        size_t Count()
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            return m_pages.size();
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<FakePage>> m_pages;
+    };
+
+    // The page manager before LinearPagePool: one lock around polling the retired pages and
+    // taking an available one, on every request
+    class QueueManager
+    {
+    public:
+        explicit QueueManager(PageStore &store) : m_store(store) {}
+
+        FakePage *RequestPage(uint32_t)
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            while (!m_retiredPages.empty() && g_Fence.IsFenceComplete(m_retiredPages.front().first))
+            {
+                m_availablePages.push(m_retiredPages.front().second);
+                m_retiredPages.pop();
+            }
+
+            if (!m_availablePages.empty())
+            {
+                FakePage *page = m_availablePages.front();
+                m_availablePages.pop();
+                return page;
+            }
+
+            return m_store.Create(0);
+        }
+
+        void DiscardPages(uint64_t fence, const std::vector<FakePage*> &pages)
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            for (FakePage *page : pages)
+                m_retiredPages.push(std::make_pair(fence, page));
+        }
+
+        bool CheckRecycled() { return true; }
+
+    private:
+        PageStore &m_store;
+        std::mutex m_mutex;
+        std::queue<std::pair<uint64_t, FakePage*>> m_retiredPages;
+        std::queue<FakePage*> m_availablePages;
+    };
+
+    class PoolManager
+    {
+    public:
+        explicit PoolManager(PageStore &store) : m_store(store) {}
+
+        FakePage *RequestPage(uint32_t sizeClass)
+        {
+            FakePage *page = m_pool.RequestPage(sizeClass, [](uint64_t fence) { return g_Fence.IsFenceComplete(fence); });
+            return page != nullptr ? page : m_store.Create(sizeClass);
+        }
+
+        void DiscardPages(uint64_t fence, const std::vector<FakePage*> &pages)
+        {
+            m_pool.RetirePages(fence, pages.data(), pages.size());
+        }
+
+        // Once every fence has completed, every page created must come back.  The pages the worker
+        // threads kept in their caches only do if the caches were flushed when the threads exited.
+        // After a reset, which empties this thread's cache as well, none may come back.
+        bool CheckRecycled()
+        {
+            auto complete = [](uint64_t) { return true; };
+            std::vector<FakePage*> recycled;
+            while (FakePage *page = m_pool.RequestPage(0, complete))
+                recycled.push_back(page);
+            if (recycled.size() != m_store.Count())
+                return false;
+
+            m_pool.RetirePages(0, recycled.data(), recycled.size());
+            m_pool.RequestPage(0, complete);
+            m_pool.Reset();
+            return m_pool.RequestPage(0, complete) == nullptr;
+        }
+
+    private:
+        PageStore &m_store;
+        LinearPagePool<FakePage> m_pool;
+    };
+
+    // One context per thread.  Each command list takes a few pages, checks they are neither in
+    // use nor still in flight, and retires them with the fence of its submission.  Returns the
+    // number of pages requested.
+    template <typename Manager>
+    uint64_t RecordCommandLists(Manager &manager, uint32_t threadIndex, std::atomic<bool> &failed)
+    {
+        // All of one size, so both managers recycle from a single list
+        std::mt19937 rng(threadIndex + 1);
+        const uint32_t sizeClass = 0;
+        std::vector<FakePage*> pages;
+        uint64_t requests = 0;
+
+        for (uint32_t commandList = 0; commandList < kCommandListsPerThread; commandList++)
+        {
+            uint32_t pageCount = 1 + rng() % kMaxPagesPerCommandList;
+            for (uint32_t n = 0; n < pageCount; n++)
+            {
+                FakePage *page = manager.RequestPage(sizeClass);
+                if (page->inUse.exchange(1) != 0 || !g_Fence.IsFenceComplete(page->retiredFence))
+                    failed = true;
+                pages.push_back(page);
+            }
+            requests += pageCount;
+
+            uint64_t fence = g_Fence.Submit();
+            for (FakePage *page : pages)
+            {
+                page->retiredFence = fence;
+                page->inUse = 0;
+            }
+            manager.DiscardPages(fence, pages);
+            pages.clear();
+        }
+        return requests;
+    }
+
+    // A fresh manager per run, with every context on a thread of its own that exits at the end.
+    // Returns the number of page requests, or 0 if a page was handed out while in use or before
+    // its fence completed, or didn't come back afterwards.
+    template <typename Manager>
+    uint64_t RunContexts(uint32_t threadCount)
+    {
+        PageStore store;
+        Manager manager(store);
+        g_Fence.Reset(kCommandListsInFlightPerThread * threadCount);
+        std::atomic<uint32_t> started(0);
+        std::atomic<uint64_t> requests(0);
+        std::atomic<bool> failed(false);
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            started++;
+            while (started < threadCount)
+                std::this_thread::yield();
+            requests += RecordCommandLists(manager, threadIndex, failed);
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++)
+            threads.emplace_back(worker, t);
+        for (auto &thread : threads)
+            thread.join();
+
+        return failed || !manager.CheckRecycled() ? 0 : requests.load();
+    }
+
+    // Runs a context that allocates the given bytes per command list and returns the page size it settles on
+    size_t SettledPageSize(uint32_t sizeClass, size_t minPageSize, size_t bytesPerCommandList)
+    {
+        typedef LinearPagePool<FakePage> Pool;
+        uint32_t smallCount = 0;
+        for (uint32_t commandList = 0; commandList < 4 * Pool::kShrinkAfter * Pool::kNumSizeClasses; commandList++)
+            sizeClass = Pool::AdaptSizeClass(sizeClass, minPageSize << sizeClass, bytesPerCommandList, smallCount);
+        return minPageSize << sizeClass;
+    }
+
+    // Upload pages start at 2MB in class 3 of 256KB << class.  They should grow until a command
+    // list's allocations fit, and shrink while those use less than a quarter of a page.
+    bool PageSizesFollowUsage()
+    {
+        const size_t KB = 1024;
+        const size_t usages[][2] =
+        {
+            { 16 * KB, 256 * KB }, { 300 * KB, 1024 * KB }, { 1536 * KB, 2048 * KB },
+            { 3072 * KB, 4096 * KB }, { 65536 * KB, 4096 * KB },
+        };
+        for (const auto &usage : usages)
+        {
+            if (SettledPageSize(3, 256 * KB, usage[0]) != usage[1])
+                return false;
+        }
+        return true;
+    }
+
+    // A thread retires 8 pages and requests one back, which leaves 3 of them in its cache.  Once it
+    // has exited, all 8 must be there for another thread.
+    bool ThreadCachesFlushed()
+    {
+        PageStore store;
+        LinearPagePool<FakePage> pool;
+        auto complete = [](uint64_t) { return true; };
+
+        std::thread([&]()
+        {
+            std::vector<FakePage*> pages;
+            for (uint32_t n = 0; n < 8; n++)
+                pages.push_back(store.Create(0));
+            pool.RetirePages(0, pages.data(), pages.size());
+            FakePage *page = pool.RequestPage(0, complete);
+            pool.RetirePages(1, &page, 1);
+        }).join();
+
+        uint32_t recycled = 0;
+        while (pool.RequestPage(0, complete) != nullptr)
+            recycled++;
+        return recycled == store.Count();
+    }
+
+    template <typename Manager>
+    void AddLinearPageBenchmark(BenchmarkSuite &suite, const char *name)
+    {
+        suite.Add(std::string("linear_page/") + name, "request", [=]() -> BenchmarkSuite::Kernel
+        {
+            const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+            if (!PageSizesFollowUsage() || !ThreadCachesFlushed() || RunContexts<Manager>(threadCount) == 0)
+            {
+                printf("error: linear_page/%s reused a page too early, lost pages or settled on the wrong page size\n", name);
+                return BenchmarkSuite::Kernel();
+            }
+
+            return [=]() { return RunContexts<Manager>(threadCount); };
+        });
+    }
+}
+
+void AddLinearPageBenchmarks(BenchmarkSuite &suite)
+{
+    AddLinearPageBenchmark<QueueManager>(suite, "queue_threads");
+    AddLinearPageBenchmark<PoolManager>(suite, "pool_threads");
+}
@@ -0,0 +1,96 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void PrintHelp()
+{
+    printf("benchmarks\n");
+
+    printf("usage:\n");
+    printf("benchmarks [options]\n");
+    printf("options:\n");
+    printf("  -filter text     only run benchmarks whose names contain text\n");
+    printf("  -out file        write the results as JSON\n");
+    printf("  -baseline file   compare with the JSON of an earlier run, fails if anything got slower\n");
+    printf("  -tolerance pct   how much slower than the baseline is still a pass (default 10)\n");
+    printf("  -repetitions n   timed repetitions of each benchmark, the median is reported (default 5)\n");
+    printf("  -mintime ms      shortest time each repetition runs for (default 50)\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchmarkSuite::Options options;
+    const char *outputFile = nullptr;
+    const char *baselineFile = nullptr;
+
+    for (int argIndex = 1; argIndex < argc; argIndex++)
+    {
+        if (0 == strcmp(argv[argIndex], "-filter") && argIndex + 1 < argc)
+        {
+            options.filter = argv[++argIndex];
+        }
+        else if (0 == strcmp(argv[argIndex], "-out") && argIndex + 1 < argc)
+        {
+            outputFile = argv[++argIndex];
+        }
+        else if (0 == strcmp(argv[argIndex], "-baseline") && argIndex + 1 < argc)
+        {
+            baselineFile = argv[++argIndex];
+        }
+        else if (0 == strcmp(argv[argIndex], "-tolerance") && argIndex + 1 < argc)
+        {
+            options.tolerance = atof(argv[++argIndex]) / 100.0;
+        }
+        else if (0 == strcmp(argv[argIndex], "-repetitions") && argIndex + 1 < argc)
+        {
+            options.repetitions = (uint32_t)atoi(argv[++argIndex]);
+        }
+        else if (0 == strcmp(argv[argIndex], "-mintime") && argIndex + 1 < argc)
+        {
+            options.minSeconds = atof(argv[++argIndex]) / 1000.0;
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    BenchmarkSuite suite;
+    AddCoreBenchmarks(suite);
+    AddBuddyAllocatorBenchmarks(suite);
+    AddLinearPageBenchmarks(suite);
+    AddPSOCacheBenchmarks(suite);
+    AddRenderGraphBenchmarks(suite);
+    AddTraceBenchmarks(suite);
+    AddModelBenchmarks(suite);
+    AddIndexOptimizeBenchmarks(suite);
+
+    suite.Run(options);
+
+    int result = suite.AnyFailed() ? 1 : 0;
+
+    if (outputFile != nullptr && !suite.WriteJson(outputFile))
+    {
+        printf("error: couldn't write %s\n", outputFile);
+        result = 1;
+    }
+
+    if (baselineFile != nullptr && !suite.CompareWithBaseline(baselineFile, options.tolerance))
+        result = 1;
+
+    return result;
+}
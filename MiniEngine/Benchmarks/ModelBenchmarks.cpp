@@ -0,0 +1,564 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "IndexOptimizePostTransform.h"
+#include "VertexDeduplicate.h"
+
+#ifdef _WIN32
+#include "Model.h"
+#include "FileUtility.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <zlib.h>
+
+namespace
+{
+    // Position, texcoord, normal, tangent and bitangent, the float layout the converter writes
+    const uint32_t kVertexFloats = 14;
+    const uint32_t kVertexStride = kVertexFloats * sizeof(float);
+
+    // Welded vertices are jittered by a tenth of this, so each lands in its grid cell
+    const float kWeldEpsilon = 1.0f / 1024.0f;
+
+    // Compressed data is inflated in pieces of this size, as Utility::DecompressGzipFile() reads it,
+    // and chunked files are made of chunks of the other
+    const uint32_t kReadChunkSize = 0x40000;
+    const uint32_t kInflateChunkSize = 0x100000;
+
+    struct MeshSize
+    {
+        const char *name;
+        uint32_t quadsPerSide;
+    };
+
+    // Sizes of a prop, a building and a terrain tile
+    const MeshSize s_MeshSizes[] =
+    {
+        { "2k", 32 },
+        { "32k", 128 },
+        { "512k", 512 },
+    };
+
+    // A rolling heightfield of quadsPerSide squared quads, two triangles each, with every vertex
+    // stored once and the triangles in random order, as a mesh looks before it's optimized
+    struct SyntheticMesh
+    {
+        uint32_t vertexCount;
+        std::vector<float> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    SyntheticMesh MakeGrid(uint32_t quadsPerSide)
+    {
+        SyntheticMesh mesh;
+        const uint32_t side = quadsPerSide + 1;
+        mesh.vertexCount = side * side;
+
+        for (uint32_t z = 0; z < side; z++)
+        {
+            for (uint32_t x = 0; x < side; x++)
+            {
+                // on the weld grid, so jittered copies stay in the same cell
+                float height = floorf(sinf(x * 0.3f) * cosf(z * 0.2f) * 2.0f / kWeldEpsilon + 0.5f) * kWeldEpsilon;
+                float slopeX = cosf(x * 0.3f) * cosf(z * 0.2f) * 0.6f;
+                float slopeZ = -sinf(x * 0.3f) * sinf(z * 0.2f) * 0.4f;
+                float normalScale = 1.0f / sqrtf(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+
+                const float vertex[kVertexFloats] =
+                {
+                    (float)x, height, (float)z,
+                    (float)x / quadsPerSide, (float)z / quadsPerSide,
+                    -slopeX * normalScale, normalScale, -slopeZ * normalScale,
+                    1.0f, slopeX, 0.0f,
+                    0.0f, slopeZ, 1.0f,
+                };
+                mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + kVertexFloats);
+            }
+        }
+
+        std::vector<uint32_t> quads(quadsPerSide * quadsPerSide);
+        for (uint32_t n = 0; n < quads.size(); n++)
+            quads[n] = n;
+        std::shuffle(quads.begin(), quads.end(), std::mt19937(quadsPerSide));
+
+        for (uint32_t quad : quads)
+        {
+            uint32_t corner = quad / quadsPerSide * side + quad % quadsPerSide;
+            const uint32_t triangles[6] = { corner, corner + side, corner + 1, corner + 1, corner + side, corner + side + 1 };
+            mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+        }
+
+        return mesh;
+    }
+
+    // A vertex per triangle corner, as a mesh is imported before duplicates are removed. With a
+    // jitter, positions move by up to that much so only welding can merge them.
+    std::vector<float> ExpandCorners(const SyntheticMesh &mesh, float jitter)
+    {
+        std::mt19937 rng(mesh.vertexCount);
+        std::uniform_real_distribution<float> offset(-jitter, jitter);
+
+        std::vector<float> corners;
+        corners.reserve(mesh.indices.size() * kVertexFloats);
+        for (uint32_t index : mesh.indices)
+        {
+            const float *vertex = mesh.vertices.data() + index * kVertexFloats;
+            corners.insert(corners.end(), vertex, vertex + kVertexFloats);
+            if (jitter > 0.0f)
+            {
+                for (uint32_t c = 0; c < 3; c++)
+                    corners[corners.size() - kVertexFloats + c] += offset(rng);
+            }
+        }
+        return corners;
+    }
+
+    // The optimizer only reorders triangles, so the sorted indices have to come out the same
+    template <typename IndexType>
+    bool SameTriangles(std::vector<IndexType> a, std::vector<IndexType> b)
+    {
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        return a == b;
+    }
+
+    template <typename IndexType>
+    BenchmarkSuite::Kernel OptimizeFacesKernel(const char *name, const SyntheticMesh &mesh)
+    {
+        auto source = std::make_shared<std::vector<IndexType> >(mesh.indices.begin(), mesh.indices.end());
+        auto optimized = std::make_shared<std::vector<IndexType> >(source->size());
+
+        OptimizeFaces<IndexType>(source->data(), (uint32_t)source->size(), optimized->data(), 64);
+        if (!SameTriangles(*source, *optimized))
+        {
+            printf("error: optimize_faces/%s lost triangles\n", name);
+            return BenchmarkSuite::Kernel();
+        }
+
+        return [=]() -> uint64_t
+        {
+            OptimizeFaces<IndexType>(source->data(), (uint32_t)source->size(), optimized->data(), 64);
+            return source->size() / 3;
+        };
+    }
+
+    void AddMeshBenchmarks(BenchmarkSuite &suite, const MeshSize &size)
+    {
+        // 16-bit indices whenever the vertices fit, as the converter writes them
+        suite.Add(std::string("optimize_faces/") + size.name, "triangle", [=]() -> BenchmarkSuite::Kernel
+        {
+            SyntheticMesh mesh = MakeGrid(size.quadsPerSide);
+            if (mesh.vertexCount <= 0x10000)
+                return OptimizeFacesKernel<uint16_t>(size.name, mesh);
+            else
+                return OptimizeFacesKernel<uint32_t>(size.name, mesh);
+        });
+
+        for (int weld = 0; weld < 2; weld++)
+        {
+            std::string name = std::string(size.name) + (weld ? "_weld" : "_exact");
+            suite.Add("remove_duplicate_vertices/" + name, "vertex", [=]() -> BenchmarkSuite::Kernel
+            {
+                SyntheticMesh mesh = MakeGrid(size.quadsPerSide);
+                auto corners = std::make_shared<std::vector<float> >(ExpandCorners(mesh, weld ? kWeldEpsilon * 0.1f : 0.0f));
+                auto deduplicated = std::make_shared<std::vector<float> >(corners->size());
+                const uint32_t cornerCount = (uint32_t)mesh.indices.size();
+                auto remap = std::make_shared<std::vector<uint32_t> >(cornerCount);
+
+                // the converter only snaps float attributes, which is all of these
+                auto isFloatWord = std::make_shared<std::vector<char> >(kVertexFloats, (char)true);
+                const float epsilon = weld ? kWeldEpsilon : 0.0f;
+
+                auto deduplicate = [=]()
+                {
+                    return DeduplicateVertices((const unsigned char*)corners->data(), cornerCount, kVertexStride,
+                        (const bool*)isFloatWord->data(), epsilon, (unsigned char*)deduplicated->data(), remap->data());
+                };
+
+                // every corner of a grid point becomes the one vertex there, which without welding is the same vertex
+                uint32_t unique = deduplicate();
+                bool matches = unique == mesh.vertexCount;
+                for (uint32_t n = 0; matches && !weld && n < cornerCount; n++)
+                    matches = 0 == memcmp(deduplicated->data() + (*remap)[n] * kVertexFloats, corners->data() + n * kVertexFloats, kVertexStride);
+                if (!matches)
+                {
+                    printf("error: remove_duplicate_vertices/%s kept %u of %u vertices\n", name.c_str(), unique, mesh.vertexCount);
+                    return BenchmarkSuite::Kernel();
+                }
+
+                return [=]() -> uint64_t
+                {
+                    KeepValue(deduplicate());
+                    return cornerCount;
+                };
+            });
+        }
+    }
+
+    // Something like a texture: smooth gradients with noise in the low bits, seeded by its size
+    std::vector<unsigned char> MakeInflateData(size_t bytes)
+    {
+        std::mt19937 rng((uint32_t)bytes);
+        std::vector<unsigned char> data(bytes);
+        const size_t width = 2048 * 4;
+        for (size_t n = 0; n < bytes; n++)
+        {
+            size_t x = n % width, y = n / width;
+            data[n] = (unsigned char)(((x >> 3) + (y >> 2) + (n & 3) * 64) ^ (rng() & 7));
+        }
+        return data;
+    }
+
+    bool GzipCompress(const std::vector<unsigned char> &data, std::vector<unsigned char> &compressed)
+    {
+        z_stream strm = {};
+        if (deflateInit2(&strm, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+
+        compressed.resize(deflateBound(&strm, (uLong)data.size()));
+        strm.next_in = (Bytef*)data.data();
+        strm.avail_in = (uInt)data.size();
+        strm.next_out = compressed.data();
+        strm.avail_out = (uInt)compressed.size();
+        int err = deflate(&strm, Z_FINISH);
+        compressed.resize(strm.total_out);
+        deflateEnd(&strm);
+        return err == Z_STREAM_END;
+    }
+
+    // What FileUtility did before DecompressGzipFile(): inflate everything into blocks of
+    // kInflateChunkSize and copy the blocks into an output sized from the total
+    bool InflateBlockAndCopy(const std::vector<unsigned char> &compressed, std::vector<unsigned char> &output)
+    {
+        std::vector<std::unique_ptr<unsigned char[]> > blocks;
+
+        z_stream strm = {};
+        strm.next_in = (Bytef*)compressed.data();
+        strm.avail_in = (uInt)compressed.size();
+
+        int err = inflateInit2(&strm, 15 + 32);
+        while (err == Z_OK || err == Z_BUF_ERROR)
+        {
+            blocks.emplace_back(new unsigned char[kInflateChunkSize]);
+            strm.next_out = blocks.back().get();
+            strm.avail_out = kInflateChunkSize;
+            err = inflate(&strm, Z_NO_FLUSH);
+        }
+        inflateEnd(&strm);
+
+        if (err != Z_STREAM_END)
+            return false;
+
+        output.resize(strm.total_out);
+        for (size_t offset = 0, n = 0; offset < output.size(); offset += kInflateChunkSize, n++)
+            memcpy(output.data() + offset, blocks[n].get(), std::min<size_t>(kInflateChunkSize, output.size() - offset));
+        return true;
+    }
+
+    // What DecompressGzipFile() does once the file is read: inflate a piece of input at a time
+    // straight into an output sized from the trailer
+    bool InflateStream(const std::vector<unsigned char> &compressed, std::vector<unsigned char> &output)
+    {
+        z_stream strm = {};
+        int err = inflateInit2(&strm, 15 + 32);
+        strm.next_out = output.data();
+        strm.avail_out = (uInt)output.size();
+
+        for (size_t offset = 0; err == Z_OK && offset < compressed.size(); offset += kReadChunkSize)
+        {
+            strm.next_in = (Bytef*)compressed.data() + offset;
+            strm.avail_in = (uInt)std::min<size_t>(kReadChunkSize, compressed.size() - offset);
+            err = inflate(&strm, Z_NO_FLUSH);
+        }
+
+        bool ok = err == Z_STREAM_END && strm.total_out == output.size();
+        inflateEnd(&strm);
+        return ok;
+    }
+
+    struct ChunkedData
+    {
+        std::vector<unsigned char> compressed;
+        std::vector<size_t> offsets;    // chunk count + 1
+    };
+
+    bool ChunkCompress(const std::vector<unsigned char> &data, ChunkedData &chunked)
+    {
+        chunked.offsets.push_back(0);
+        for (size_t start = 0; start < data.size(); start += kInflateChunkSize)
+        {
+            uLong sourceSize = (uLong)std::min<size_t>(kInflateChunkSize, data.size() - start);
+            uLongf compressedSize = compressBound(sourceSize);
+            chunked.compressed.resize(chunked.offsets.back() + compressedSize);
+            if (compress2(chunked.compressed.data() + chunked.offsets.back(), &compressedSize, data.data() + start, sourceSize, 6) != Z_OK)
+                return false;
+            chunked.offsets.push_back(chunked.offsets.back() + compressedSize);
+        }
+        chunked.compressed.resize(chunked.offsets.back());
+        return true;
+    }
+
+    // What DecompressChunkedFile() does per chunk, on one thread so results don't depend on the core count
+    bool InflateChunks(const ChunkedData &chunked, std::vector<unsigned char> &output)
+    {
+        for (size_t n = 0; n + 1 < chunked.offsets.size(); n++)
+        {
+            size_t start = n * kInflateChunkSize;
+            uLongf expectedSize = (uLongf)std::min<size_t>(kInflateChunkSize, output.size() - start);
+            uLongf outputSize = expectedSize;
+            if (uncompress(output.data() + start, &outputSize, chunked.compressed.data() + chunked.offsets[n],
+                (uLong)(chunked.offsets[n + 1] - chunked.offsets[n])) != Z_OK || outputSize != expectedSize)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void AddInflateBenchmarks(BenchmarkSuite &suite, size_t bytes)
+    {
+        suite.Add("inflate/block_and_copy", "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            auto data = std::make_shared<std::vector<unsigned char> >(MakeInflateData(bytes));
+            auto compressed = std::make_shared<std::vector<unsigned char> >();
+            auto output = std::make_shared<std::vector<unsigned char> >();
+            if (!GzipCompress(*data, *compressed) || !InflateBlockAndCopy(*compressed, *output) || *output != *data)
+            {
+                printf("error: inflate/block_and_copy didn't reproduce its input\n");
+                return BenchmarkSuite::Kernel();
+            }
+            return [=]() -> uint64_t { return InflateBlockAndCopy(*compressed, *output) ? bytes : 0; };
+        });
+
+        suite.Add("inflate/gzip_stream", "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            auto data = std::make_shared<std::vector<unsigned char> >(MakeInflateData(bytes));
+            auto compressed = std::make_shared<std::vector<unsigned char> >();
+            auto output = std::make_shared<std::vector<unsigned char> >(bytes);
+            if (!GzipCompress(*data, *compressed) || !InflateStream(*compressed, *output) || *output != *data)
+            {
+                printf("error: inflate/gzip_stream didn't reproduce its input\n");
+                return BenchmarkSuite::Kernel();
+            }
+            return [=]() -> uint64_t { return InflateStream(*compressed, *output) ? bytes : 0; };
+        });
+
+        suite.Add("inflate/chunks", "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            auto data = std::make_shared<std::vector<unsigned char> >(MakeInflateData(bytes));
+            auto chunked = std::make_shared<ChunkedData>();
+            auto output = std::make_shared<std::vector<unsigned char> >(bytes);
+            if (!ChunkCompress(*data, *chunked) || !InflateChunks(*chunked, *output) || *output != *data)
+            {
+                printf("error: inflate/chunks didn't reproduce its input\n");
+                return BenchmarkSuite::Kernel();
+            }
+            return [=]() -> uint64_t { return InflateChunks(*chunked, *output) ? bytes : 0; };
+        });
+    }
+
+#ifdef _WIN32
+    std::string TempFileName(const char *name)
+    {
+        const char *directory = getenv("TEMP");
+        return std::string(directory != nullptr ? directory : ".") + "\\" + name;
+    }
+
+    // The real file paths, from the temp directory, so the OS file cache is part of what is measured
+    void AddInflateFileBenchmarks(BenchmarkSuite &suite, size_t bytes)
+    {
+        suite.Add("inflate/gzip_file", "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            auto data = std::make_shared<std::vector<unsigned char> >(MakeInflateData(bytes));
+            std::vector<unsigned char> compressed;
+            std::wstring fileName = MakeWStr(TempFileName("inflate_benchmark.gz"));
+            FILE *file = nullptr;
+            bool ok = GzipCompress(*data, compressed) && 0 == _wfopen_s(&file, fileName.c_str(), L"wb");
+            if (file != nullptr)
+            {
+                ok = ok && 1 == fwrite(compressed.data(), compressed.size(), 1, file);
+                ok = 0 == fclose(file) && ok;
+            }
+
+            Utility::ByteArray result = ok ? Utility::DecompressGzipFile(fileName) : Utility::NullFile;
+            if (*result != *data)
+            {
+                printf("error: inflate/gzip_file didn't reproduce its input\n");
+                return BenchmarkSuite::Kernel();
+            }
+            return [=]() -> uint64_t { return Utility::DecompressGzipFile(fileName)->size(); };
+        });
+
+        suite.Add("inflate/chunked_file", "byte", [=]() -> BenchmarkSuite::Kernel
+        {
+            auto data = std::make_shared<std::vector<unsigned char> >(MakeInflateData(bytes));
+            std::wstring fileName = MakeWStr(TempFileName("inflate_benchmark.zc"));
+            bool ok = Utility::WriteChunkedFile(fileName, *data);
+
+            Utility::ByteArray result = ok ? Utility::DecompressChunkedFile(fileName) : Utility::NullFile;
+            if (*result != *data)
+            {
+                printf("error: inflate/chunked_file didn't reproduce its input\n");
+                return BenchmarkSuite::Kernel();
+            }
+            return [=]() -> uint64_t { return Utility::DecompressChunkedFile(fileName)->size(); };
+        });
+    }
+
+    // Builds a model from synthetic meshes and loads it back without a device, which is everything
+    // LoadH3DView() does before it creates buffers and loads textures
+    class H3DBenchmarkModel : public Model
+    {
+    public:
+        bool Build(uint32_t meshCount, uint32_t quadsPerSide, uint32_t clustersPerMesh)
+        {
+            SyntheticMesh grid = MakeGrid(quadsPerSide);
+            const uint32_t vertexBytes = grid.vertexCount * kVertexStride;
+            const uint32_t indexBytes = (uint32_t)grid.indices.size() * sizeof(uint32_t);
+            const uint32_t depthBytes = grid.vertexCount * 3 * sizeof(float);
+
+            m_Header.meshCount = meshCount;
+            m_Header.materialCount = 1;
+            m_Header.vertexDataByteSize = vertexBytes * meshCount;
+            m_Header.indexDataByteSize = indexBytes * meshCount;
+            m_Header.vertexDataByteSizeDepth = depthBytes * meshCount;
+            m_Header.indexSize = sizeof(uint32_t);
+
+            m_pMesh = new Mesh [meshCount];
+            m_pMaterial = new Material [1];
+            memset(m_pMesh, 0, sizeof(Mesh) * meshCount);
+            memset(m_pMaterial, 0, sizeof(Material));
+            m_pVertexData = new unsigned char [m_Header.vertexDataByteSize];
+            m_pIndexData = new unsigned char [m_Header.indexDataByteSize];
+            m_pVertexDataDepth = new unsigned char [m_Header.vertexDataByteSizeDepth];
+            m_pIndexDataDepth = new unsigned char [m_Header.indexDataByteSize];
+
+            m_ClusterCount = meshCount * clustersPerMesh;
+            m_pClusters = new Cluster [m_ClusterCount];
+            memset(m_pClusters, 0, sizeof(Cluster) * m_ClusterCount);
+
+            const uint32_t clusterIndices = (uint32_t)grid.indices.size() / clustersPerMesh / 3 * 3;
+            for (uint32_t meshIndex = 0; meshIndex < meshCount; meshIndex++)
+            {
+                Mesh &mesh = m_pMesh[meshIndex];
+                mesh.attribsEnabled = attrib_mask_position | attrib_mask_texcoord0 | attrib_mask_normal | attrib_mask_tangent | attrib_mask_bitangent;
+                mesh.attribsEnabledDepth = attrib_mask_position;
+                mesh.vertexStride = kVertexStride;
+                mesh.vertexStrideDepth = 3 * sizeof(float);
+                const uint16_t offsets[] = { 0, 12, 20, 32, 44 };
+                const uint16_t components[] = { 3, 2, 3, 3, 3 };
+                for (int n = 0; n < 5; n++)
+                    mesh.attrib[n] = { offsets[n], 0, components[n], attrib_format_float };
+                mesh.attribDepth[0] = mesh.attrib[0];
+
+                mesh.vertexDataByteOffset = meshIndex * vertexBytes;
+                mesh.vertexCount = grid.vertexCount;
+                mesh.indexDataByteOffset = meshIndex * indexBytes;
+                mesh.indexCount = (uint32_t)grid.indices.size();
+                mesh.vertexDataByteOffsetDepth = meshIndex * depthBytes;
+                mesh.vertexCountDepth = grid.vertexCount;
+
+                memcpy(m_pVertexData + mesh.vertexDataByteOffset, grid.vertices.data(), vertexBytes);
+                memcpy(m_pIndexData + mesh.indexDataByteOffset, grid.indices.data(), indexBytes);
+                memcpy(m_pIndexDataDepth + mesh.indexDataByteOffset, grid.indices.data(), indexBytes);
+                float *depth = (float*)(m_pVertexDataDepth + mesh.vertexDataByteOffsetDepth);
+                for (uint32_t v = 0; v < grid.vertexCount; v++)
+                    memcpy(depth + v * 3, grid.vertices.data() + v * kVertexFloats, 3 * sizeof(float));
+
+                for (uint32_t c = 0; c < clustersPerMesh; c++)
+                {
+                    Cluster &cluster = m_pClusters[meshIndex * clustersPerMesh + c];
+                    cluster.meshIndex = meshIndex;
+                    cluster.indexOffset = c * clusterIndices;
+                    cluster.indexCount = clusterIndices;
+                    cluster.coneCutoff = 1.0f;
+                }
+            }
+
+            return true;
+        }
+
+        bool Save(const char *fileName) const { return SaveH3DChunked(fileName); }
+
+        bool Parse(void *fileData, uint64_t fileSize)
+        {
+            m_pMappedFile = fileData;
+            m_OwnsMappedFile = false;
+            return ParseH3DView(fileSize);
+        }
+    };
+
+    void AddH3DBenchmark(BenchmarkSuite &suite)
+    {
+        suite.Add("h3d_load/read_and_parse", "byte", []() -> BenchmarkSuite::Kernel
+        {
+            const uint32_t meshCount = 64, clustersPerMesh = 64;
+            std::string fileName = TempFileName("h3d_benchmark.h3d");
+            {
+                H3DBenchmarkModel source;
+                if (!source.Build(meshCount, 64, clustersPerMesh) || !source.Save(fileName.c_str()))
+                {
+                    printf("error: h3d_load couldn't write %s\n", fileName.c_str());
+                    return BenchmarkSuite::Kernel();
+                }
+            }
+
+            // 64-bit words keep the chunks as aligned as a file mapping would
+            auto fileData = std::make_shared<std::vector<uint64_t> >();
+            auto model = std::make_shared<H3DBenchmarkModel>();
+            auto load = [=]() -> uint64_t
+            {
+                FILE *file = nullptr;
+                if (0 != fopen_s(&file, fileName.c_str(), "rb"))
+                    return 0;
+                _fseeki64(file, 0, SEEK_END);
+                uint64_t fileSize = _ftelli64(file);
+                _fseeki64(file, 0, SEEK_SET);
+                fileData->resize((size_t)(fileSize + 7) / 8);
+                bool ok = 1 == fread(fileData->data(), (size_t)fileSize, 1, file);
+                fclose(file);
+
+                ok = ok && model->Parse(fileData->data(), fileSize) && model->m_ClusterCount == meshCount * clustersPerMesh;
+                model->Clear();
+                return ok ? fileSize : 0;
+            };
+
+            if (load() == 0)
+            {
+                printf("error: h3d_load couldn't parse the file it wrote\n");
+                return BenchmarkSuite::Kernel();
+            }
+            return load;
+        });
+    }
+#endif
+}
+
+void AddModelBenchmarks(BenchmarkSuite &suite)
+{
+    for (const MeshSize &size : s_MeshSizes)
+        AddMeshBenchmarks(suite, size);
+
+    AddInflateBenchmarks(suite, 16 << 20);
+
+#ifdef _WIN32
+    AddInflateFileBenchmarks(suite, 16 << 20);
+    AddH3DBenchmark(suite);
+#endif
+}
@@ -0,0 +1,245 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "ShardedHashMap.h"
+
+#include <stdio.h>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+    // About the number of distinct pipelines in a level and the size of a graphics key
+    const uint32_t kPipelineCount = 4096;
+    const uint32_t kKeySize = 400;
+    const uint32_t kLookupsPerThread = 1 << 16;
+
+    // Stand-in for compiling a pipeline
+    const auto kCreateTime = std::chrono::microseconds(50);
+
+    typedef std::vector<uint8_t> Key;
+
+    struct Pipeline
+    {
+        uint32_t id;
+    };
+
+    void SimulateCreate()
+    {
+        auto end = std::chrono::steady_clock::now() + kCreateTime;
+        while (std::chrono::steady_clock::now() < end)
+            ;
+    }
+
+    uint64_t HashKey(const Key &key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint8_t byte : key)
+            hash = (hash ^ byte) * 1099511628211ull;
+        return hash;
+    }
+
+    // The cache PipelineState used before: one lock around a tree keyed only by hash, with the
+    // first caller reserving the entry and the others yielding until it is filled in
+    class MutexMapCache
+    {
+    public:
+        MutexMapCache() : m_creations(0) {}
+
+        const Pipeline *Get(uint64_t hash, const Key &, uint32_t id)
+        {
+            std::atomic<const Pipeline*> *entry;
+            bool firstCompile = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto iter = m_map.find(hash);
+                if (iter == m_map.end())
+                {
+                    firstCompile = true;
+                    entry = &m_map[hash];
+                }
+                else
+                    entry = &iter->second;
+            }
+
+            if (firstCompile)
+            {
+                SimulateCreate();
+                m_creations++;
+                m_pipelines[id].id = id;
+                entry->store(&m_pipelines[id]);
+            }
+
+            const Pipeline *pipeline;
+            while ((pipeline = entry->load()) == nullptr)
+                std::this_thread::yield();
+            return pipeline;
+        }
+
+        void Reset()
+        {
+            m_map.clear();
+            m_creations = 0;
+        }
+
+        uint32_t GetCreations() const { return m_creations; }
+
+    private:
+        std::mutex m_mutex;
+        std::map<uint64_t, std::atomic<const Pipeline*>> m_map;
+        Pipeline m_pipelines[kPipelineCount];
+        std::atomic<uint32_t> m_creations;
+    };
+
+    class ShardedCache
+    {
+    public:
+        ShardedCache() : m_creations(0) {}
+
+        const Pipeline *Get(uint64_t hash, const Key &key, uint32_t id)
+        {
+            return m_map.GetOrCreate(hash, key, [&](Pipeline &pipeline)
+            {
+                SimulateCreate();
+                m_creations++;
+                pipeline.id = id;
+            }).Value;
+        }
+
+        void Reset()
+        {
+            m_map.Clear();
+            m_creations = 0;
+        }
+
+        uint32_t GetCreations() const { return m_creations; }
+
+    private:
+        ShardedHashMap<Key, Pipeline> m_map;
+        std::atomic<uint32_t> m_creations;
+    };
+
+    struct Workload
+    {
+        std::vector<Key> keys;
+        std::vector<uint64_t> hashes;
+
+        // Every thread walks its own random order of the same keys, so they collide on
+        // first requests the way streaming workers finalizing shared materials do
+        std::vector<std::vector<uint32_t>> orders;
+    };
+
+    void GenerateWorkload(uint32_t threadCount, Workload &workload)
+    {
+        std::mt19937 rng(kPipelineCount);
+
+        // Real keys differ in a handful of bytes, mostly shader hashes near the end
+        Key base(kKeySize);
+        for (uint8_t &byte : base)
+            byte = (uint8_t)rng();
+
+        for (uint32_t n = 0; n < kPipelineCount; n++)
+        {
+            Key key = base;
+            for (int b = 0; b < 16; b++)
+                key[kKeySize - 16 + b] = (uint8_t)rng();
+            workload.hashes.push_back(HashKey(key));
+            workload.keys.push_back(std::move(key));
+        }
+
+        workload.orders.resize(threadCount);
+        for (auto &order : workload.orders)
+        {
+            order.resize(kLookupsPerThread);
+            std::uniform_int_distribution<uint32_t> pick(0, kPipelineCount - 1);
+            for (uint32_t &index : order)
+                index = pick(rng);
+        }
+    }
+
+    // Returns the number of lookups, or 0 if any of them returned another key's pipeline
+    template <typename Cache>
+    uint64_t RunLookups(Cache &cache, const Workload &workload)
+    {
+        const uint32_t threadCount = (uint32_t)workload.orders.size();
+        std::atomic<uint32_t> started(0);
+        std::atomic<bool> failed(false);
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            // Start together so the first requests overlap
+            started++;
+            while (started < threadCount)
+                std::this_thread::yield();
+
+            for (uint32_t index : workload.orders[threadIndex])
+            {
+                if (cache.Get(workload.hashes[index], workload.keys[index], index)->id != index)
+                    failed = true;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 1; t < threadCount; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (auto &thread : threads)
+            thread.join();
+
+        return failed ? 0 : (uint64_t)kLookupsPerThread * threadCount;
+    }
+
+    // Cold runs start from an empty cache, so the threads race to create every pipeline.
+    // Warm runs only find pipelines that are already there.
+    template <typename Cache>
+    void AddPSOCacheBenchmark(BenchmarkSuite &suite, const char *name, bool cold)
+    {
+        suite.Add(std::string("pso_cache/") + name, "lookup", [=]() -> BenchmarkSuite::Kernel
+        {
+            const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+            auto workload = std::make_shared<Workload>();
+            GenerateWorkload(threadCount, *workload);
+            auto cache = std::make_shared<Cache>();
+
+            // Single-flight: each pipeline is created once no matter how many threads race for it
+            auto run = [=]() -> uint64_t
+            {
+                if (cold)
+                    cache->Reset();
+                uint64_t lookups = RunLookups(*cache, *workload);
+                return cache->GetCreations() == kPipelineCount ? lookups : 0;
+            };
+
+            if (run() == 0)
+            {
+                printf("error: pso_cache/%s returned the wrong pipeline or created one more than once\n", name);
+                return BenchmarkSuite::Kernel();
+            }
+            return run;
+        });
+    }
+}
+
+void AddPSOCacheBenchmarks(BenchmarkSuite &suite)
+{
+    AddPSOCacheBenchmark<MutexMapCache>(suite, "mutex_map_cold", true);
+    AddPSOCacheBenchmark<ShardedCache>(suite, "sharded_cold", true);
+    AddPSOCacheBenchmark<MutexMapCache>(suite, "mutex_map_warm", false);
+    AddPSOCacheBenchmark<ShardedCache>(suite, "sharded_warm", false);
+}
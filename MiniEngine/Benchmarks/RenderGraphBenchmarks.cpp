@@ -0,0 +1,877 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "RenderGraphCompiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+    typedef RenderGraphCompiler Compiler;
+
+    const uint64_t kPlacementAlignment = 65536;
+    const uint32_t kRandomGraphs = 500;
+
+    const D3D12_RESOURCE_STATES kUAV = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    const D3D12_RESOURCE_STATES kRT = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    const D3D12_RESOURCE_STATES kDepthWrite = D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    const D3D12_RESOURCE_STATES kDepthRead = D3D12_RESOURCE_STATE_DEPTH_READ;
+    const D3D12_RESOURCE_STATES kComputeRead = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    const D3D12_RESOURCE_STATES kPixelRead = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+
+    template <typename T, size_t N>
+    uint32_t CountOf(T (&)[N])
+    {
+        return (uint32_t)N;
+    }
+
+    std::wstring Widen(const char *name)
+    {
+        return std::wstring(name, name + strlen(name));
+    }
+
+    // A frame as the benchmark builds it, kept so schedules can be checked against it
+    struct FrameDesc
+    {
+        struct Resource
+        {
+            const char *name;
+            bool transient;
+            uint64_t size;
+            D3D12_RESOURCE_STATES state;
+        };
+
+        struct Access
+        {
+            uint32_t resource;
+            D3D12_RESOURCE_STATES state;
+            bool write;
+        };
+
+        struct Pass
+        {
+            const char *name;
+            Compiler::PassType type;
+            std::vector<Access> accesses;
+        };
+
+        uint32_t Import(const char *name, D3D12_RESOURCE_STATES state)
+        {
+            Resource resource = { name, false, 0, state };
+            resources.push_back(resource);
+            return (uint32_t)resources.size() - 1;
+        }
+
+        uint32_t Transient(const char *name, uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t arraySize = 1)
+        {
+            uint64_t size = (uint64_t)width * height * bytesPerPixel * arraySize;
+            Resource resource = { name, true, (size + kPlacementAlignment - 1) / kPlacementAlignment * kPlacementAlignment,
+                D3D12_RESOURCE_STATE_COMMON };
+            resources.push_back(resource);
+            return (uint32_t)resources.size() - 1;
+        }
+
+        void AddPass(const char *name, Compiler::PassType type)
+        {
+            Pass pass = { name, type, std::vector<Access>() };
+            passes.push_back(pass);
+        }
+
+        void Read(uint32_t resource, D3D12_RESOURCE_STATES state) { AddAccess(resource, state, false); }
+        void Write(uint32_t resource, D3D12_RESOURCE_STATES state) { AddAccess(resource, state, true); }
+
+        void AddAccess(uint32_t resource, D3D12_RESOURCE_STATES state, bool write)
+        {
+            Access access = { resource, state, write };
+            passes.back().accesses.push_back(access);
+        }
+
+        void Build(Compiler &graph) const
+        {
+            graph.Reset();
+            for (const Resource &resource : resources)
+            {
+                if (resource.transient)
+                    graph.AddTransient(Widen(resource.name), resource.size, kPlacementAlignment, resource.state);
+                else
+                    graph.AddResource(Widen(resource.name), resource.state);
+            }
+
+            for (const Pass &pass : passes)
+            {
+                uint32_t passIndex = graph.AddPass(Widen(pass.name), pass.type);
+                for (const Access &access : pass.accesses)
+                {
+                    if (access.write)
+                        graph.Write(passIndex, access.resource, access.state);
+                    else
+                        graph.Read(passIndex, access.resource, access.state);
+                }
+            }
+        }
+
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+    };
+
+    // ModelViewer at 1920x1080 with the buffer sizes and formats of BufferManager.  The buffers
+    // only SSAO, motion blur and bloom use within a frame are transient.
+    FrameDesc BuildModelViewerFrame()
+    {
+        const uint32_t width = 1920, height = 1080;
+        const uint32_t bloomWidth = 640, bloomHeight = 384;
+
+        FrameDesc frame;
+
+        uint32_t sceneDepth = frame.Import("Scene Depth", kDepthRead);
+        uint32_t sceneColor = frame.Import("Scene Color", kUAV);
+        uint32_t shadowMap = frame.Import("Shadow Map", kPixelRead);
+        uint32_t velocity = frame.Import("Motion Vectors", kComputeRead);
+        uint32_t linearDepth = frame.Import("Linear Depth", kComputeRead);
+        uint32_t ssao = frame.Import("SSAO Full Res", kPixelRead);
+        uint32_t postEffects = frame.Import("Post Effects", kComputeRead);
+        uint32_t overlay = frame.Import("UI Overlay", kPixelRead);
+        uint32_t display = frame.Import("Display", D3D12_RESOURCE_STATE_PRESENT);
+
+        uint32_t depthDownsize[4], depthTiled[4], aoMerged[4], aoSmooth[3];
+        static const char *depthDownsizeNames[] = { "Depth Downsize 1", "Depth Downsize 2", "Depth Downsize 3", "Depth Downsize 4" };
+        static const char *depthTiledNames[] = { "Depth De-Interleaved 1", "Depth De-Interleaved 2", "Depth De-Interleaved 3", "Depth De-Interleaved 4" };
+        static const char *aoMergedNames[] = { "AO Merged 1", "AO Merged 2", "AO Merged 3", "AO Merged 4" };
+        static const char *aoSmoothNames[] = { "AO Smooth 1", "AO Smooth 2", "AO Smooth 3" };
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            uint32_t w = width >> (i + 1), h = height >> (i + 1);
+            depthDownsize[i] = frame.Transient(depthDownsizeNames[i], w, h, 4);
+            depthTiled[i] = frame.Transient(depthTiledNames[i], (w + 3) / 4, (h + 3) / 4, 2, 16);
+            aoMerged[i] = frame.Transient(aoMergedNames[i], w, h, 1);
+            if (i < 3)
+                aoSmooth[i] = frame.Transient(aoSmoothNames[i], w, h, 1);
+        }
+
+        uint32_t motionPrep = frame.Transient("Motion Blur Prep", width / 2, height / 2, 4);
+        uint32_t lumaLR = frame.Transient("Luma Buffer", bloomWidth, bloomHeight, 1);
+
+        uint32_t bloom[5][2];
+        static const char *bloomNames[5][2] = { { "Bloom Buffer 1a", "Bloom Buffer 1b" }, { "Bloom Buffer 2a", "Bloom Buffer 2b" },
+            { "Bloom Buffer 3a", "Bloom Buffer 3b" }, { "Bloom Buffer 4a", "Bloom Buffer 4b" }, { "Bloom Buffer 5a", "Bloom Buffer 5b" } };
+        for (uint32_t i = 0; i < 5; i++)
+        {
+            for (uint32_t j = 0; j < 2; j++)
+                bloom[i][j] = frame.Transient(bloomNames[i][j], bloomWidth >> i, bloomHeight >> i, 4);
+        }
+
+        frame.AddPass("Z PrePass", Compiler::kGraphicsPass);
+        frame.Write(sceneDepth, kDepthWrite);
+
+        frame.AddPass("Shadow Map", Compiler::kGraphicsPass);
+        frame.Write(shadowMap, kDepthWrite);
+
+        frame.AddPass("SSAO Prepare Depth", Compiler::kAsyncComputePass);
+        frame.Read(sceneDepth, kComputeRead);
+        frame.Write(linearDepth, kUAV);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            frame.Write(depthDownsize[i], kUAV);
+            frame.Write(depthTiled[i], kUAV);
+        }
+
+        static const char *aoRenderNames[] = { "SSAO Render 1", "SSAO Render 2", "SSAO Render 3", "SSAO Render 4" };
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            frame.AddPass(aoRenderNames[i], Compiler::kAsyncComputePass);
+            frame.Read(depthTiled[i], kComputeRead);
+            frame.Write(aoMerged[i], kUAV);
+        }
+
+        static const char *aoBlurNames[] = { "SSAO Blur And Upsample 1", "SSAO Blur And Upsample 2", "SSAO Blur And Upsample 3", "SSAO Blur And Upsample 4" };
+        for (uint32_t i = 4; i-- > 0; )
+        {
+            frame.AddPass(aoBlurNames[i], Compiler::kAsyncComputePass);
+            frame.Read(i > 0 ? depthDownsize[i - 1] : linearDepth, kComputeRead);
+            frame.Read(depthDownsize[i], kComputeRead);
+            frame.Read(i == 3 ? aoMerged[3] : aoSmooth[i], kComputeRead);
+            if (i > 0)
+                frame.Read(aoMerged[i - 1], kComputeRead);
+            frame.Write(i > 0 ? aoSmooth[i - 1] : ssao, kUAV);
+        }
+
+        frame.AddPass("Render Color", Compiler::kGraphicsPass);
+        frame.Read(sceneDepth, kDepthRead);
+        frame.Read(shadowMap, kPixelRead);
+        frame.Read(ssao, kPixelRead);
+        frame.Write(sceneColor, kRT);
+
+        frame.AddPass("Camera Velocity", Compiler::kComputePass);
+        frame.Read(sceneDepth, kComputeRead);
+        frame.Write(velocity, kUAV);
+
+        frame.AddPass("Motion Blur Prepass", Compiler::kComputePass);
+        frame.Read(sceneColor, kComputeRead);
+        frame.Read(velocity, kComputeRead);
+        frame.Write(motionPrep, kUAV);
+
+        frame.AddPass("Motion Blur", Compiler::kComputePass);
+        frame.Read(motionPrep, kComputeRead);
+        frame.Read(velocity, kComputeRead);
+        frame.Write(sceneColor, kUAV);
+
+        frame.AddPass("Bloom Extract", Compiler::kComputePass);
+        frame.Read(sceneColor, kComputeRead);
+        frame.Write(bloom[0][0], kUAV);
+        frame.Write(lumaLR, kUAV);
+
+        frame.AddPass("Bloom Downsample", Compiler::kComputePass);
+        frame.Read(bloom[0][0], kComputeRead);
+        for (uint32_t i = 1; i < 5; i++)
+            frame.Write(bloom[i][0], kUAV);
+
+        frame.AddPass("Bloom Blur", Compiler::kComputePass);
+        frame.Read(bloom[4][0], kComputeRead);
+        frame.Write(bloom[4][1], kUAV);
+
+        static const char *upsampleNames[] = { "Bloom Upsample 1", "Bloom Upsample 2", "Bloom Upsample 3", "Bloom Upsample 4" };
+        for (uint32_t i = 4; i-- > 0; )
+        {
+            frame.AddPass(upsampleNames[i], Compiler::kComputePass);
+            frame.Read(bloom[i][0], kComputeRead);
+            frame.Read(bloom[i + 1][1], kComputeRead);
+            frame.Write(bloom[i][1], kUAV);
+        }
+
+        frame.AddPass("Tone Map", Compiler::kComputePass);
+        frame.Read(bloom[0][1], kComputeRead);
+        frame.Read(lumaLR, kComputeRead);
+        frame.Write(sceneColor, kUAV);
+        frame.Write(postEffects, kUAV);
+
+        frame.AddPass("FXAA", Compiler::kComputePass);
+        frame.Read(postEffects, kComputeRead);
+        frame.Write(sceneColor, kUAV);
+
+        frame.AddPass("UI", Compiler::kGraphicsPass);
+        frame.Write(overlay, kRT);
+
+        frame.AddPass("Composite", Compiler::kGraphicsPass);
+        frame.Read(sceneColor, kPixelRead);
+        frame.Read(overlay, kPixelRead);
+        frame.Write(display, kRT);
+
+        frame.AddPass("Present", Compiler::kGraphicsPass);
+        frame.Read(display, D3D12_RESOURCE_STATE_PRESENT);
+
+        return frame;
+    }
+
+    // Random passes over a few resources.  Transients are written first, compute passes mostly
+    // stick to states the compute queue allows so they can move there.
+    FrameDesc BuildRandomFrame(std::mt19937 &rng)
+    {
+        static const D3D12_RESOURCE_STATES computeReads[] = { kComputeRead, D3D12_RESOURCE_STATE_COPY_SOURCE, kUAV };
+        static const D3D12_RESOURCE_STATES graphicsReads[] = { kComputeRead, kPixelRead, kDepthRead,
+            D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT };
+        static const D3D12_RESOURCE_STATES computeWrites[] = { kUAV, D3D12_RESOURCE_STATE_COPY_DEST };
+        static const D3D12_RESOURCE_STATES graphicsWrites[] = { kRT, kUAV, kDepthWrite, D3D12_RESOURCE_STATE_COPY_DEST };
+        static const D3D12_RESOURCE_STATES initialStates[] = { D3D12_RESOURCE_STATE_COMMON, kComputeRead, kPixelRead, kRT, kUAV, kDepthWrite };
+        static const char *names[] = { "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L" };
+
+        FrameDesc frame;
+        uint32_t resourceCount = 2 + rng() % 10;
+        for (uint32_t r = 0; r < resourceCount; r++)
+        {
+            // Transients are in whatever state the last frame left them
+            if (rng() % 2)
+                frame.Transient(names[r], 64 << (rng() % 5), 64, 4);
+            else
+                frame.Import(names[r], D3D12_RESOURCE_STATE_COMMON);
+            frame.resources.back().state = initialStates[rng() % CountOf(initialStates)];
+        }
+
+        std::vector<bool> written(resourceCount, false);
+        uint32_t passCount = 1 + rng() % 24;
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            Compiler::PassType type = (Compiler::PassType)(rng() % 3);
+            frame.AddPass("Pass", type);
+
+            bool compute = type != Compiler::kGraphicsPass && rng() % 8 != 0;
+            uint32_t accessCount = 1 + rng() % 4;
+            for (uint32_t a = 0; a < accessCount; a++)
+            {
+                uint32_t resource = rng() % resourceCount;
+                bool named = false;
+                for (const FrameDesc::Access &access : frame.passes.back().accesses)
+                    named = named || access.resource == resource;
+                if (named)
+                    continue;
+
+                bool write = rng() % 3 == 0 || (frame.resources[resource].transient && !written[resource]);
+                if (write)
+                {
+                    frame.Write(resource, compute ? computeWrites[rng() % CountOf(computeWrites)] : graphicsWrites[rng() % CountOf(graphicsWrites)]);
+                    written[resource] = true;
+                }
+                else
+                {
+                    frame.Read(resource, compute ? computeReads[rng() % CountOf(computeReads)] : graphicsReads[rng() % CountOf(graphicsReads)]);
+                }
+            }
+        }
+
+        return frame;
+    }
+
+    // Replays a schedule in pass order.  Every barrier must start from the state the resource is
+    // in, every use must find the state it asked for, and the compute queue must only see states
+    // it allows.  Anything touching a resource after a write or barrier on the other queue, and
+    // any write or barrier after uses on the other queue, must come after them through the
+    // waits.  Transients sharing memory must not be alive at once, and the later one must take
+    // it over with an aliasing barrier after every use of the earlier one.
+    class ScheduleChecker
+    {
+    public:
+        ScheduleChecker(const FrameDesc &frame, const Compiler &graph) : m_frame(frame), m_graph(graph) {}
+
+        bool Check(std::string &error)
+        {
+            const uint32_t passCount = (uint32_t)m_frame.passes.size();
+            const uint32_t resourceCount = (uint32_t)m_frame.resources.size();
+
+            m_clock.assign(passCount, Clock());
+            m_tracks.assign(resourceCount, Track());
+            for (uint32_t r = 0; r < resourceCount; r++)
+                m_tracks[r].state = m_frame.resources[r].state;
+
+            int64_t lastOnQueue[Compiler::kNumQueues] = { -1, -1 };
+            for (uint32_t p = 0; p < passCount; p++)
+            {
+                const Compiler::PassSchedule &schedule = m_graph.GetSchedule(p);
+                const Compiler::QueueType queue = schedule.Queue;
+                const Compiler::QueueType other = queue == Compiler::kGraphicsQueue ? Compiler::kComputeQueue : Compiler::kGraphicsQueue;
+
+                if (queue == Compiler::kComputeQueue && m_frame.passes[p].type != Compiler::kAsyncComputePass)
+                    return Fail(error, p, "only async compute passes may go to the compute queue");
+
+                if (lastOnQueue[queue] >= 0)
+                    m_clock[p] = m_clock[lastOnQueue[queue]];
+                lastOnQueue[queue] = p;
+
+                if (schedule.WaitForPass != Compiler::kInvalid)
+                {
+                    uint32_t wait = schedule.WaitForPass;
+                    if (wait >= p || m_graph.GetSchedule(wait).Queue != other || !m_graph.GetSchedule(wait).Signal)
+                        return Fail(error, p, "waits for a pass that isn't an earlier signaling pass of the other queue");
+                    m_clock[p].done[other] = std::max<int64_t>(m_clock[p].done[other], wait);
+                }
+
+                Event before = { p, 0 }, use = { p, 1 }, after = { p, 2 };
+
+                for (const Compiler::Barrier &barrier : schedule.Before)
+                {
+                    if (!ApplyBarrier(barrier, before, false, error))
+                        return false;
+                }
+
+                for (uint32_t resource : schedule.Discards)
+                {
+                    if (!m_frame.resources[resource].transient || m_tracks[resource].firstUse != -1)
+                        return Fail(error, p, "discards something other than a transient at its first use");
+                    m_tracks[resource].discarded = true;
+                }
+
+                for (const FrameDesc::Access &access : m_frame.passes[p].accesses)
+                {
+                    Track &track = m_tracks[access.resource];
+                    bool covered = access.state == D3D12_RESOURCE_STATE_COMMON ? track.state == D3D12_RESOURCE_STATE_COMMON :
+                        (track.state & access.state) == access.state;
+                    if (!covered || track.pending != -1)
+                        return Fail(error, p, "uses a resource in the wrong state", access.resource);
+                    if (queue == Compiler::kComputeQueue && !Compiler::IsValidOnComputeQueue(track.state))
+                        return Fail(error, p, "uses a resource on the compute queue in a state it doesn't allow", access.resource);
+
+                    if (track.firstUse == -1 && m_frame.resources[access.resource].transient && !track.discarded &&
+                        (access.state == kRT || access.state == kUAV || access.state == kDepthWrite))
+                    {
+                        return Fail(error, p, "doesn't discard a transient before its first use", access.resource);
+                    }
+
+                    if (!Touch(access.resource, use, access.write, error))
+                        return false;
+                    track.uses.push_back(use);
+
+                    if (track.firstUse == -1)
+                        track.firstUse = p;
+                    track.lastUse = p;
+                }
+
+                for (const Compiler::Barrier &barrier : schedule.After)
+                {
+                    if (!ApplyBarrier(barrier, after, true, error))
+                        return false;
+                }
+            }
+
+            for (uint32_t r = 0; r < resourceCount; r++)
+            {
+                if (m_tracks[r].pending != -1)
+                    return Fail(error, passCount - 1, "leaves a split barrier unfinished", r);
+            }
+
+            return CheckAliasing(error);
+        }
+
+    private:
+
+        struct Clock
+        {
+            Clock() { done[0] = done[1] = -1; }
+            int64_t done[Compiler::kNumQueues];     // Latest pass of each queue finished before this one starts
+        };
+
+        struct Event
+        {
+            uint32_t pass;
+            uint32_t phase;     // Barriers before, the pass, barriers after
+        };
+
+        struct Track
+        {
+            Track() : state(D3D12_RESOURCE_STATE_COMMON), pending(-1), firstUse(-1), lastUse(-1), hasExclusive(false), discarded(false)
+            {
+                lastExclusive.pass = 0;
+                lastExclusive.phase = 0;
+            }
+
+            D3D12_RESOURCE_STATES state;
+            int64_t pending;                // The state a split barrier is going to
+            int64_t firstUse;
+            int64_t lastUse;
+            bool hasExclusive;
+            bool discarded;
+            Event lastExclusive;            // The last write or barrier
+            std::vector<Event> shared;      // Reads since then
+            std::vector<Event> uses;
+            std::vector<uint32_t> aliasedFrom;
+        };
+
+        bool Ordered(const Event &first, const Event &second) const
+        {
+            Compiler::QueueType firstQueue = m_graph.GetSchedule(first.pass).Queue;
+            if (firstQueue == m_graph.GetSchedule(second.pass).Queue)
+                return first.pass < second.pass || (first.pass == second.pass && first.phase <= second.phase);
+            return m_clock[second.pass].done[firstQueue] >= (int64_t)first.pass;
+        }
+
+        bool Touch(uint32_t resource, const Event &event, bool exclusive, std::string &error)
+        {
+            Track &track = m_tracks[resource];
+            if (track.hasExclusive && !Ordered(track.lastExclusive, event))
+                return Fail(error, event.pass, "isn't ordered after the last write or barrier on the other queue", resource);
+
+            if (!exclusive)
+            {
+                track.shared.push_back(event);
+                return true;
+            }
+
+            for (const Event &read : track.shared)
+            {
+                if (!Ordered(read, event))
+                    return Fail(error, event.pass, "isn't ordered after reads on the other queue", resource);
+            }
+
+            track.shared.clear();
+            track.lastExclusive = event;
+            track.hasExclusive = true;
+            return true;
+        }
+
+        bool ApplyBarrier(const Compiler::Barrier &barrier, const Event &event, bool after, std::string &error)
+        {
+            const uint32_t p = event.pass;
+            const bool computeQueue = m_graph.GetSchedule(p).Queue == Compiler::kComputeQueue;
+            Track &track = m_tracks[barrier.Resource];
+
+            if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING)
+            {
+                const uint32_t aliased = barrier.AliasedResource;
+                if (after || !m_frame.resources[barrier.Resource].transient || aliased >= m_frame.resources.size() ||
+                    !m_frame.resources[aliased].transient || !MemoryOverlaps(aliased, barrier.Resource))
+                {
+                    return Fail(error, p, "has an aliasing barrier between resources that don't share memory", barrier.Resource);
+                }
+
+                // Others may take over other parts of its memory, so only its own uses matter
+                for (const Event &earlier : m_tracks[aliased].uses)
+                {
+                    if (!Ordered(earlier, event))
+                        return Fail(error, p, "takes over memory before the other queue is done with it", barrier.Resource);
+                }
+
+                track.aliasedFrom.push_back(aliased);
+                return Touch(barrier.Resource, event, true, error);
+            }
+
+            if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV)
+            {
+                if (track.state != kUAV || track.pending != -1)
+                    return Fail(error, p, "has a UAV barrier for a resource not in that state", barrier.Resource);
+                return Touch(barrier.Resource, event, true, error);
+            }
+
+            if (barrier.StateBefore != track.state)
+                return Fail(error, p, "has a transition that doesn't start from the current state", barrier.Resource);
+            if (computeQueue && (!Compiler::IsValidOnComputeQueue(barrier.StateBefore) || !Compiler::IsValidOnComputeQueue(barrier.StateAfter)))
+                return Fail(error, p, "has a transition on the compute queue it doesn't allow", barrier.Resource);
+
+            switch (barrier.Flags)
+            {
+            case D3D12_RESOURCE_BARRIER_FLAG_NONE:
+                if (track.pending != -1)
+                    return Fail(error, p, "transitions a resource in the middle of a split barrier", barrier.Resource);
+                track.state = barrier.StateAfter;
+                break;
+
+            case D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY:
+                if (!after || track.pending != -1)
+                    return Fail(error, p, "begins a split barrier in the wrong place", barrier.Resource);
+                track.pending = barrier.StateAfter;
+                break;
+
+            case D3D12_RESOURCE_BARRIER_FLAG_END_ONLY:
+                if (after || track.pending != (int64_t)barrier.StateAfter)
+                    return Fail(error, p, "ends a split barrier that wasn't begun", barrier.Resource);
+                track.pending = -1;
+                track.state = barrier.StateAfter;
+                break;
+
+            default:
+                return Fail(error, p, "has a barrier with unknown flags", barrier.Resource);
+            }
+
+            return Touch(barrier.Resource, event, true, error);
+        }
+
+        bool MemoryOverlaps(uint32_t a, uint32_t b) const
+        {
+            uint64_t offsetA = m_graph.GetHeapOffset(a), offsetB = m_graph.GetHeapOffset(b);
+            return offsetA != Compiler::kInvalid && offsetB != Compiler::kInvalid &&
+                offsetA < offsetB + m_frame.resources[b].size && offsetB < offsetA + m_frame.resources[a].size;
+        }
+
+        bool CheckAliasing(std::string &error) const
+        {
+            const uint32_t resourceCount = (uint32_t)m_frame.resources.size();
+            for (uint32_t a = 0; a < resourceCount; a++)
+            {
+                const Track &first = m_tracks[a];
+                if (!m_frame.resources[a].transient || first.firstUse == -1)
+                    continue;
+
+                if (m_graph.GetHeapOffset(a) + m_frame.resources[a].size > m_graph.GetHeapSize())
+                    return Fail(error, (uint32_t)first.firstUse, "places a transient past the end of the heap", a);
+
+                for (uint32_t b = 0; b < resourceCount; b++)
+                {
+                    const Track &second = m_tracks[b];
+                    if (a == b || !m_frame.resources[b].transient || second.firstUse == -1 || !MemoryOverlaps(a, b))
+                        continue;
+
+                    if (first.firstUse <= second.lastUse && second.firstUse <= first.lastUse)
+                        return Fail(error, (uint32_t)second.firstUse, "places transients that are alive at once in the same memory", b);
+
+                    if (first.lastUse < second.firstUse &&
+                        std::find(second.aliasedFrom.begin(), second.aliasedFrom.end(), a) == second.aliasedFrom.end())
+                    {
+                        return Fail(error, (uint32_t)second.firstUse, "takes over memory without an aliasing barrier", b);
+                    }
+                }
+            }
+            return true;
+        }
+
+        bool Fail(std::string &error, uint32_t pass, const char *what, uint32_t resource = Compiler::kInvalid) const
+        {
+            char text[256];
+            if (resource != Compiler::kInvalid)
+                snprintf(text, sizeof(text), "pass %u (%s) %s: %s", pass, m_frame.passes[pass].name, what, m_frame.resources[resource].name);
+            else
+                snprintf(text, sizeof(text), "pass %u (%s) %s", pass, m_frame.passes[pass].name, what);
+            error = text;
+            return false;
+        }
+
+        const FrameDesc &m_frame;
+        const Compiler &m_graph;
+        std::vector<Clock> m_clock;
+        std::vector<Track> m_tracks;
+    };
+
+    enum OptionBits
+    {
+        kMergeReads = 1,
+        kSplitBarriers = 2,
+        kAliasTransients = 4,
+        kAsyncCompute = 8,
+        kAllOptions = 15
+    };
+
+    Compiler::Options MakeOptions(uint32_t bits)
+    {
+        Compiler::Options options;
+        options.MergeReads = (bits & kMergeReads) != 0;
+        options.SplitBarriers = (bits & kSplitBarriers) != 0;
+        options.AliasTransients = (bits & kAliasTransients) != 0;
+        options.AsyncCompute = (bits & kAsyncCompute) != 0;
+        return options;
+    }
+
+    // Compiles the frame and replays the schedule, printing what is wrong with it if anything
+    bool CompileAndCheck(const FrameDesc &frame, Compiler &graph, uint32_t bits, const char *what)
+    {
+        frame.Build(graph);
+        graph.Compile(MakeOptions(bits));
+
+        std::string error;
+        ScheduleChecker checker(frame, graph);
+        if (checker.Check(error))
+            return true;
+
+        printf("error: render_graph %s with options %x: %s\n", what, bits, error.c_str());
+        return false;
+    }
+
+    bool Expect(bool condition, const char *test, uint32_t bits, const char *what)
+    {
+        if (!condition)
+            printf("error: render_graph %s with options %x: %s\n", test, bits, what);
+        return condition;
+    }
+
+    bool IsOnlyTransition(const std::vector<Compiler::Barrier> &barriers, D3D12_RESOURCE_BARRIER_FLAGS flags, uint32_t resource,
+        D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+    {
+        return barriers.size() == 1 && barriers[0].Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && barriers[0].Flags == flags &&
+            barriers[0].Resource == resource && barriers[0].StateBefore == before && barriers[0].StateAfter == after;
+    }
+
+    // The small graphs below each exercise one optimization, with it off and on, and check the
+    // schedule barrier by barrier as well as by replaying it
+
+    // Two reads in different states after a write share one transition to both states
+    bool TestMergedReads()
+    {
+        FrameDesc frame;
+        uint32_t a = frame.Import("A", kRT);
+        frame.AddPass("Write", Compiler::kGraphicsPass);
+        frame.Write(a, kRT);
+        frame.AddPass("Pixel Read", Compiler::kGraphicsPass);
+        frame.Read(a, kPixelRead);
+        frame.AddPass("Compute Read", Compiler::kGraphicsPass);
+        frame.Read(a, kComputeRead);
+
+        Compiler graph;
+        bool passed = CompileAndCheck(frame, graph, 0, "merged reads");
+        passed = passed && Expect(IsOnlyTransition(graph.GetSchedule(1).Before, D3D12_RESOURCE_BARRIER_FLAG_NONE, a, kRT, kPixelRead) &&
+            IsOnlyTransition(graph.GetSchedule(2).Before, D3D12_RESOURCE_BARRIER_FLAG_NONE, a, kPixelRead, kComputeRead) &&
+            graph.GetStatistics().Transitions == 2, "merged reads", 0, "doesn't transition before each read");
+
+        passed = passed && CompileAndCheck(frame, graph, kMergeReads, "merged reads");
+        passed = passed && Expect(IsOnlyTransition(graph.GetSchedule(1).Before, D3D12_RESOURCE_BARRIER_FLAG_NONE, a, kRT, kPixelRead | kComputeRead) &&
+            graph.GetSchedule(2).Before.empty() && graph.GetStatistics().Transitions == 1 && graph.GetStatistics().MergedReads == 1 &&
+            graph.GetFinalState(a) == (kPixelRead | kComputeRead), "merged reads", kMergeReads, "doesn't merge the reads into one transition");
+        return passed;
+    }
+
+    // A transition with a pass in between begins after the write and ends before the read
+    bool TestSplitBarriers()
+    {
+        FrameDesc frame;
+        uint32_t a = frame.Import("A", kRT);
+        uint32_t b = frame.Import("B", kRT);
+        frame.AddPass("Write A", Compiler::kGraphicsPass);
+        frame.Write(a, kRT);
+        frame.AddPass("Write B", Compiler::kGraphicsPass);
+        frame.Write(b, kRT);
+        frame.AddPass("Read A", Compiler::kGraphicsPass);
+        frame.Read(a, kPixelRead);
+
+        Compiler graph;
+        bool passed = CompileAndCheck(frame, graph, kMergeReads, "split barriers");
+        passed = passed && Expect(graph.GetSchedule(0).After.empty() &&
+            IsOnlyTransition(graph.GetSchedule(2).Before, D3D12_RESOURCE_BARRIER_FLAG_NONE, a, kRT, kPixelRead),
+            "split barriers", kMergeReads, "doesn't transition right before the read");
+
+        const uint32_t bits = kMergeReads | kSplitBarriers;
+        passed = passed && CompileAndCheck(frame, graph, bits, "split barriers");
+        passed = passed && Expect(IsOnlyTransition(graph.GetSchedule(0).After, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY, a, kRT, kPixelRead) &&
+            IsOnlyTransition(graph.GetSchedule(2).Before, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY, a, kRT, kPixelRead) &&
+            graph.GetSchedule(1).Before.empty() && graph.GetStatistics().SplitTransitions == 1,
+            "split barriers", bits, "doesn't split the transition around the pass in between");
+        return passed;
+    }
+
+    // Back to back UAV writes need a UAV barrier and no transition
+    bool TestUAVBarriers()
+    {
+        FrameDesc frame;
+        uint32_t a = frame.Import("A", kUAV);
+        frame.AddPass("Write 1", Compiler::kComputePass);
+        frame.Write(a, kUAV);
+        frame.AddPass("Write 2", Compiler::kComputePass);
+        frame.Write(a, kUAV);
+
+        Compiler graph;
+        bool passed = CompileAndCheck(frame, graph, kAllOptions, "UAV barriers");
+        const std::vector<Compiler::Barrier> &before = graph.GetSchedule(1).Before;
+        passed = passed && Expect(graph.GetSchedule(0).Before.empty() && before.size() == 1 &&
+            before[0].Type == D3D12_RESOURCE_BARRIER_TYPE_UAV && before[0].Resource == a && graph.GetStatistics().UAVBarriers == 1 &&
+            graph.GetStatistics().Transitions == 0, "UAV barriers", kAllOptions, "doesn't put a UAV barrier between the writes");
+        return passed;
+    }
+
+    // Transients used one after the other share memory, the second taking it over with an
+    // aliasing barrier, and both are discarded before their first write
+    bool TestAliasing()
+    {
+        const uint64_t size = 1024 * 1024;
+
+        FrameDesc frame;
+        uint32_t first = frame.Transient("First", 1024, 1024, 1);
+        uint32_t second = frame.Transient("Second", 1024, 1024, 1);
+        uint32_t output = frame.Import("Output", kUAV);
+        frame.resources[first].state = kUAV;
+        frame.resources[second].state = kUAV;
+        frame.AddPass("Write First", Compiler::kComputePass);
+        frame.Write(first, kUAV);
+        frame.AddPass("Read First", Compiler::kComputePass);
+        frame.Read(first, kComputeRead);
+        frame.Write(output, kUAV);
+        frame.AddPass("Write Second", Compiler::kComputePass);
+        frame.Write(second, kUAV);
+        frame.AddPass("Read Second", Compiler::kComputePass);
+        frame.Read(second, kComputeRead);
+        frame.Write(output, kUAV);
+
+        Compiler graph;
+        bool passed = true;
+        for (uint32_t bits : { (uint32_t)kMergeReads, (uint32_t)(kMergeReads | kAliasTransients) })
+        {
+            const bool alias = (bits & kAliasTransients) != 0;
+            passed = passed && CompileAndCheck(frame, graph, bits, "aliasing");
+            passed = passed && Expect(graph.GetSchedule(0).Discards == std::vector<uint32_t>(1, first) &&
+                graph.GetSchedule(2).Discards == std::vector<uint32_t>(1, second), "aliasing", bits, "doesn't discard the transients before their first writes");
+            if (!passed)
+                break;
+
+            const std::vector<Compiler::Barrier> &before = graph.GetSchedule(2).Before;
+            if (alias)
+            {
+                passed = Expect(graph.GetHeapSize() == size && graph.GetHeapOffset(first) == 0 && graph.GetHeapOffset(second) == 0 &&
+                    before.size() == 1 && before[0].Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING && before[0].Resource == second &&
+                    before[0].AliasedResource == first, "aliasing", bits, "doesn't place the second transient over the first");
+            }
+            else
+            {
+                passed = Expect(graph.GetHeapSize() == 2 * size && graph.GetHeapOffset(first) != graph.GetHeapOffset(second) &&
+                    before.empty(), "aliasing", bits, "shares memory with aliasing off");
+            }
+        }
+        return passed;
+    }
+
+    // An async compute pass moves to the compute queue and the graphics pass reading its output
+    // waits for it, while one using a state the compute queue can't handle stays on graphics
+    bool TestAsyncCompute()
+    {
+        FrameDesc frame;
+        uint32_t a = frame.Import("A", kUAV);
+        uint32_t b = frame.Import("B", kRT);
+        frame.AddPass("Graphics Write", Compiler::kGraphicsPass);
+        frame.Write(b, kRT);
+        frame.AddPass("Async Write", Compiler::kAsyncComputePass);
+        frame.Write(a, kUAV);
+        frame.AddPass("Graphics Read", Compiler::kGraphicsPass);
+        frame.Read(a, kPixelRead);
+        frame.AddPass("Async Pixel Read", Compiler::kAsyncComputePass);
+        frame.Read(b, kPixelRead);
+
+        Compiler graph;
+        bool passed = CompileAndCheck(frame, graph, kMergeReads, "async compute");
+        passed = passed && Expect(graph.GetStatistics().AsyncComputePasses == 0 && graph.GetStatistics().CrossQueueWaits == 0,
+            "async compute", kMergeReads, "uses the compute queue with async compute off");
+
+        passed = passed && CompileAndCheck(frame, graph, kAllOptions, "async compute");
+        passed = passed && Expect(graph.GetSchedule(1).Queue == Compiler::kComputeQueue && graph.GetSchedule(1).Signal &&
+            graph.GetSchedule(2).Queue == Compiler::kGraphicsQueue && graph.GetSchedule(2).WaitForPass == 1 &&
+            IsOnlyTransition(graph.GetSchedule(2).Before, D3D12_RESOURCE_BARRIER_FLAG_NONE, a, kUAV, kPixelRead) &&
+            graph.GetSchedule(3).Queue == Compiler::kGraphicsQueue && graph.GetStatistics().AsyncComputePasses == 1 &&
+            graph.GetStatistics().CrossQueueWaits == 1, "async compute", kAllOptions, "doesn't move only the compute pass and wait for it");
+        return passed;
+    }
+
+    bool RunCompileTests()
+    {
+        bool passed = TestMergedReads();
+        passed = TestSplitBarriers() && passed;
+        passed = TestUAVBarriers() && passed;
+        passed = TestAliasing() && passed;
+        passed = TestAsyncCompute() && passed;
+
+        // Every combination of options on the ModelViewer frame and on random graphs
+        Compiler graph;
+        FrameDesc frame = BuildModelViewerFrame();
+        for (uint32_t bits = 0; bits <= kAllOptions; bits++)
+            passed = CompileAndCheck(frame, graph, bits, "ModelViewer frame") && passed;
+
+        std::mt19937 rng(1);
+        for (uint32_t n = 0; n < kRandomGraphs && passed; n++)
+        {
+            FrameDesc randomFrame = BuildRandomFrame(rng);
+            for (uint32_t bits = 0; bits <= kAllOptions && passed; bits++)
+                passed = CompileAndCheck(randomFrame, graph, bits, "random graph");
+        }
+        return passed;
+    }
+
+    // Times building and compiling the ModelViewer frame, per pass
+    void AddRenderGraphBenchmark(BenchmarkSuite &suite, const char *name, uint32_t bits)
+    {
+        suite.Add(std::string("render_graph/") + name, "pass", [=]() -> BenchmarkSuite::Kernel
+        {
+            if (!RunCompileTests())
+                return BenchmarkSuite::Kernel();
+
+            auto frame = std::make_shared<FrameDesc>(BuildModelViewerFrame());
+            auto graph = std::make_shared<Compiler>();
+            const Compiler::Options options = MakeOptions(bits);
+            return [=]()
+            {
+                frame->Build(*graph);
+                graph->Compile(options);
+                KeepValue(graph->GetStatistics().BarrierBatches);
+                return (uint64_t)graph->GetPassCount();
+            };
+        });
+    }
+}
+
+void AddRenderGraphBenchmarks(BenchmarkSuite &suite)
+{
+    AddRenderGraphBenchmark(suite, "modelviewer_per_pass_barriers", 0);
+    AddRenderGraphBenchmark(suite, "modelviewer_all_optimizations", kAllOptions);
+}
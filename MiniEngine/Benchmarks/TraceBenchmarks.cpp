@@ -0,0 +1,295 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BenchmarkSuite.h"
+#include "TraceRecorder.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+    const uint32_t kMarkerPairsPerThread = 1 << 18;
+    const double kBudgetNanoseconds = 50.0;
+
+    // Markers of the pattern each thread records in the export checks
+    const uint32_t kMarkersPerIteration = 4;
+
+    double ElapsedSeconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // What BeginBlock and EndBlock do for the timing tree: a wide string, a lookup and a time stamp
+    struct StringMarkers
+    {
+        struct Node
+        {
+            int64_t startTick;
+            int64_t endTick;
+        };
+
+        StringMarkers()
+        {
+            const wchar_t* names[] = { L"Render Shadows", L"Render Color", L"Post Effects", L"Particles", L"Bloom", L"SSAO" };
+            for (const wchar_t* name : names)
+                lut[name] = Node();
+        }
+
+        void Run(uint32_t pairCount)
+        {
+            for (uint32_t pair = 0; pair < pairCount; pair++)
+            {
+                Node& node = lut.find(L"Post Effects")->second;
+                node.startTick = TraceRecorder::GetTick();
+                node.endTick = TraceRecorder::GetTick();
+            }
+        }
+
+        std::unordered_map<std::wstring, Node> lut;
+    };
+
+    void RecordPairs(TraceRecorder& recorder, uint32_t id, uint32_t pairCount)
+    {
+        for (uint32_t pair = 0; pair < pairCount; pair++)
+        {
+            recorder.Begin(id);
+            recorder.End(id);
+        }
+    }
+
+    // Runs the work on every thread at once and returns nanoseconds per marker, averaged over the threads
+    template <typename Work>
+    double Measure(uint32_t threadCount, const Work& work)
+    {
+        std::atomic<uint32_t> started(0);
+        std::vector<double> seconds(threadCount);
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            started++;
+            while (started < threadCount)
+                std::this_thread::yield();
+            auto start = std::chrono::steady_clock::now();
+            work(threadIndex);
+            seconds[threadIndex] = ElapsedSeconds(start);
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 1; t < threadCount; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (auto &thread : threads)
+            thread.join();
+
+        double total = 0.0;
+        for (double s : seconds)
+            total += s;
+        return total / threadCount * 1e9 / (2.0 * kMarkerPairsPerThread);
+    }
+
+    // A frame of work, then three steps of it, nested
+    void RecordPattern(TraceRecorder& recorder, uint32_t iterationCount, uint32_t workId, uint32_t stepId)
+    {
+        for (uint32_t iteration = 0; iteration < iterationCount; iteration++)
+        {
+            recorder.Begin(workId);
+            for (uint32_t step = 0; step < kMarkersPerIteration - 1; step++)
+            {
+                recorder.Begin(stepId);
+                recorder.End(stepId);
+            }
+            recorder.End(workId);
+        }
+    }
+
+    size_t Occurrences(const std::string& text, const char* pattern)
+    {
+        size_t count = 0;
+        for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+            count++;
+        return count;
+    }
+
+    bool CheckExports(uint32_t threadCount)
+    {
+        bool passed = true;
+
+        // Threads that fit in their rings keep every marker, and their names
+        {
+            TraceRecorder recorder;
+            const uint32_t workId = recorder.Intern("Work \"quoted\"");
+            const uint32_t stepId = recorder.Intern("Step");
+            const uint32_t iterationCount = TraceRecorder::kEventsPerTrack / (2 * kMarkersPerIteration) - 1;
+
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back([&, t]()
+                {
+                    recorder.SetThreadName("Worker " + std::to_string(t));
+                    RecordPattern(recorder, iterationCount, workId, stepId);
+                });
+            }
+            for (auto &thread : threads)
+                thread.join();
+
+            std::string json;
+            size_t markers = recorder.ExportChromeTrace(0, TraceRecorder::GetTick(), json);
+            size_t expected = (size_t)threadCount * iterationCount * kMarkersPerIteration;
+            if (markers != expected || Occurrences(json, "\"ph\":\"X\"") != expected
+                || Occurrences(json, "\"name\":\"Work \\\"quoted\\\"\"") != (size_t)threadCount * iterationCount
+                || Occurrences(json, "\"name\":\"Worker ") != threadCount)
+            {
+                printf("error: exported %zu of %zu markers from rings that didn't wrap\n", markers, expected);
+                passed = false;
+            }
+        }
+
+        // A ring that wrapped keeps its newest events, of which the first end has lost its begin
+        {
+            TraceRecorder recorder;
+            const uint32_t workId = recorder.Intern("Work");
+            const uint32_t stepId = recorder.Intern("Step");
+            RecordPattern(recorder, 3 * TraceRecorder::kEventsPerTrack / (2 * kMarkersPerIteration) + 1, workId, stepId);
+            recorder.MarkFrame(7);
+
+            std::string json;
+            size_t markers = recorder.ExportChromeTrace(0, TraceRecorder::GetTick(), json);
+            size_t expected = (TraceRecorder::kEventsPerTrack - 2) / 2 - 1;
+            if (markers < expected || markers > TraceRecorder::kEventsPerTrack / 2 || Occurrences(json, "\"name\":\"Frame 7\"") != 1)
+            {
+                printf("error: exported %zu markers from a wrapped ring, expected at least %zu\n", markers, expected);
+                passed = false;
+            }
+        }
+
+        // Exporting while threads write, and wrap, sees only whole markers
+        {
+            TraceRecorder recorder;
+            const uint32_t workId = recorder.Intern("Work");
+            const uint32_t stepId = recorder.Intern("Step");
+            std::atomic<uint32_t> running(threadCount);
+
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back([&]()
+                {
+                    RecordPattern(recorder, 4 * TraceRecorder::kEventsPerTrack / (2 * kMarkersPerIteration), workId, stepId);
+                    running--;
+                });
+            }
+
+            uint32_t exportCount = 0;
+            do
+            {
+                std::string json;
+                size_t markers = recorder.ExportChromeTrace(0, TraceRecorder::GetTick(), json);
+                exportCount++;
+                if (markers > (size_t)threadCount * TraceRecorder::kEventsPerTrack / 2 || json.find("\"dur\":-") != std::string::npos
+                    || Occurrences(json, "\"name\":\"Work\"") * (kMarkersPerIteration - 1) > Occurrences(json, "\"name\":\"Step\"") + threadCount * kMarkersPerIteration)
+                {
+                    printf("error: export %u while threads were recording has %zu broken markers\n", exportCount, markers);
+                    passed = false;
+                    break;
+                }
+            }
+            while (running > 0);
+
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+        return passed;
+    }
+
+    // A thread going back and forth between two recorders keeps one track in each
+    bool CheckRecorderSwitches()
+    {
+        TraceRecorder first, second;
+        const uint32_t firstId = first.Intern("First");
+        const uint32_t secondId = second.Intern("Second");
+
+        std::thread([&]()
+        {
+            for (uint32_t n = 0; n < 64; n++)
+            {
+                RecordPairs(first, firstId, 1);
+                RecordPairs(second, secondId, 1);
+            }
+        }).join();
+
+        std::string firstJson, secondJson;
+        bool passed = first.ExportChromeTrace(0, TraceRecorder::GetTick(), firstJson) == 64 &&
+            second.ExportChromeTrace(0, TraceRecorder::GetTick(), secondJson) == 64 &&
+            Occurrences(firstJson, "\"thread_name\"") == 1 && Occurrences(secondJson, "\"thread_name\"") == 1;
+        if (!passed)
+            printf("error: a thread switching between recorders got more than one track in each\n");
+        return passed;
+    }
+}
+
+void AddTraceBenchmarks(BenchmarkSuite &suite)
+{
+    const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    suite.Add("trace/string_markers_threads", "marker", [=]() -> BenchmarkSuite::Kernel
+    {
+        auto trees = std::make_shared<std::vector<StringMarkers>>(threadCount);
+        return [=]()
+        {
+            Measure(threadCount, [&](uint32_t threadIndex) { (*trees)[threadIndex].Run(kMarkerPairsPerThread); });
+            return (uint64_t)threadCount * kMarkerPairsPerThread * 2;
+        };
+    });
+
+    // Fails if a marker takes longer than the budget on any call
+    suite.Add("trace/interned_markers_threads", "marker", [=]() -> BenchmarkSuite::Kernel
+    {
+        if (!CheckExports(std::min(threadCount, 8u)) || !CheckRecorderSwitches())
+            return BenchmarkSuite::Kernel();
+
+        auto recorder = std::make_shared<TraceRecorder>();
+        const uint32_t id = recorder->Intern("Post Effects");
+        return [=]() -> uint64_t
+        {
+            double cost = Measure(threadCount, [&](uint32_t) { RecordPairs(*recorder, id, kMarkerPairsPerThread); });
+            if (cost > kBudgetNanoseconds)
+            {
+                printf("error: a trace marker took %.1f ns, more than the %.0f ns budget\n", cost, kBudgetNanoseconds);
+                return 0;
+            }
+            return (uint64_t)threadCount * kMarkerPairsPerThread * 2;
+        };
+    });
+
+    suite.Add("trace/export_full_ring", "marker", [=]() -> BenchmarkSuite::Kernel
+    {
+        auto recorder = std::make_shared<TraceRecorder>();
+        const uint32_t workId = recorder->Intern("Work");
+        const uint32_t stepId = recorder->Intern("Step");
+        RecordPattern(*recorder, TraceRecorder::kEventsPerTrack / (2 * kMarkersPerIteration), workId, stepId);
+
+        return [=]()
+        {
+            std::string json;
+            return (uint64_t)recorder->ExportChromeTrace(0, TraceRecorder::GetTick(), json);
+        };
+    });
+}
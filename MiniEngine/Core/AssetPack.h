@@ -0,0 +1,74 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// An asset pack bundles many files into one that is memory mapped once.  It starts with a Header, followed by
+// the entry table, the name table and the file data.  Entries are sorted by the hash of their name so they can
+// be found with a binary search, and every entry's data starts at a multiple of the pack's alignment.  Names
+// are paths relative to the working directory, lower case and with forward slashes.  Written by AssetPacker and
+// read through Utility::MountAssetPack().
+namespace AssetPack
+{
+    const uint32_t kMagic = 'KAPM';
+    const uint32_t kVersion = 1;
+
+    enum Compression : uint16_t
+    {
+        kStored,    // the data is the file as is and can be used in place
+        kZlib,      // a single zlib stream
+    };
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t EntryCount;
+        uint32_t Alignment;
+        uint64_t EntryTableOffset;
+        uint64_t NameTableOffset;
+        uint64_t NameTableLength;   // in characters
+    };
+
+    struct Entry
+    {
+        uint64_t NameHash;
+        uint64_t Offset;            // from the start of the pack
+        uint64_t StoredSize;
+        uint64_t Size;
+        uint32_t NameOffset;        // into the name table, in characters
+        uint16_t NameLength;
+        uint16_t Compression;
+    };
+
+    static_assert(sizeof(wchar_t) == sizeof(uint16_t), "names are stored as UTF-16");
+
+    inline wchar_t NormalizeChar( wchar_t c )
+    {
+        if (c == L'\\')
+            return L'/';
+        if (c >= L'A' && c <= L'Z')
+            return c - L'A' + L'a';
+        return c;
+    }
+
+    // FNV-1a of the normalized name
+    inline uint64_t HashName( const wchar_t* Name, size_t Length )
+    {
+        uint64_t Hash = 14695981039346656037ull;
+        for (size_t i = 0; i < Length; ++i)
+            Hash = (Hash ^ (uint16_t)NormalizeChar(Name[i])) * 1099511628211ull;
+        return Hash;
+    }
+}
@@ -61,10 +61,10 @@ BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D1
     , m_maxBlockSize(maxBlockSize)
     , m_minBlockSize(MinBlockSize)
     , m_pBackingHeap(nullptr)
-#if defined(PROFILE) || defined(_DEBUG)
     , m_SpaceUsed(0)
     , m_InternalFragmentation(0)
-#endif
+    , m_AllocationCount(0)
+    , m_FailedAllocations(0)
 {
     ASSERT(Math::IsDivisible(maxBlockSize, m_minBlockSize));
     ASSERT(Math::IsPowerOfTwo(maxBlockSize / m_minBlockSize));
@@ -96,6 +96,16 @@ void BuddyAllocator::Initialize()
 
 void BuddyAllocator::Destroy()
 {
+    // Blocks still waiting for the GPU go with the heap
+    {
+        lock_guard<mutex> lock(m_deletionMutex);
+        while (m_deferredDeletionQueue.empty() == false)
+        {
+            DeallocateInternal(m_deferredDeletionQueue.front());
+            m_deferredDeletionQueue.pop();
+        }
+    }
+
     if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
     {
         m_pBackingHeap->Release();
@@ -106,115 +116,67 @@ void BuddyAllocator::Destroy()
     }
 }
 
-size_t BuddyAllocator::AllocateBlock(UINT order)
+BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData)
 {
-    size_t offset;
+    size_t size = (size_t)numElements * elementSize;
+    size_t unitSize = max<size_t>(SizeToUnitSize(size), 1);
+    UINT order = UnitSizeToOrder(unitSize);
 
-    if (order > m_maxOrder)
+    size_t offset;
     {
-        throw(std::bad_alloc()); // Can't allocate a block that large  
+        lock_guard<mutex> lock(m_mutex);
+        offset = m_freeBlocks.Allocate(order);
     }
 
-    auto it = m_freeBlocks[order].begin();
-
-    if (it == m_freeBlocks[order].end())
+    if (offset == BuddyBitmap::kInvalidOffset)
     {
-        // No free nodes in the requested pool.  Try to find a higher-order block and split it.  
-        size_t left = AllocateBlock(order + 1);
-
-        size_t size = OrderToUnitSize(order);
-
-        size_t right = left + size;
-
-        m_freeBlocks[order].insert(right); // Add the right block to the free pool  
-
-        offset = left; // Return the left block  
-    }
-
-    else
-    {
-        offset = *it;
-
-        // Remove the block from the free list  
-        m_freeBlocks[order].erase(it);
+        // There are no blocks available for the requested size so  
+        // return the NULL block type  
+        ++m_FailedAllocations;
+        return new BuddyBlock();
     }
 
-    return offset;
-}
+    uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
 
-void BuddyAllocator::DeallocateBlock(size_t offset, UINT order)
-{
-    // See if the buddy block is free  
-    size_t size = OrderToUnitSize(order);
+    uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
 
-    size_t buddy = GetBuddyOffset(offset, size);
+    m_SpaceUsed += paddedSize;
+    m_InternalFragmentation += paddedSize - size;
+    ++m_AllocationCount;
 
-    auto it = m_freeBlocks[order].find(buddy);
+    BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
+        paddedSize, //total size (padded to fit a block)
+        uint32_t(size));
 
-    if (it != m_freeBlocks[order].end())
+    if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
     {
-        // Deallocate merged blocks  
-        DeallocateBlock(min(offset, buddy), order + 1);
-        // Remove the buddy from the free list  
-        m_freeBlocks[order].erase(it);
+        pBlock->InitPlaced(m_pBackingHeap, numElements, elementSize, initialData);
     }
     else
     {
-        // Add the block to the free list  
-        m_freeBlocks[order].insert(offset); // throw(std::bad_alloc) 
+        //TODO: To be truely thread-safe this operation should be atomic to guard against
+        //      the case in which blocks from this allocator are used on multiple threads 
+        //      (because it's really only 1 resource underneath)
+        pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
     }
+
+    return pBlock;
 }
 
-BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData)
+void BuddyAllocator::Deallocate(BuddyBlock* pBlock)
 {
-    size_t size = numElements * elementSize;
-    size_t unitSize = SizeToUnitSize(size);
-    UINT order = UnitSizeToOrder(unitSize);
-
-    try
+    // Blocks that failed to allocate own nothing
+    if (pBlock->GetSize() == 0)
     {
-        size_t offset = AllocateBlock(order);
-        uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
-
-        uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
-
-        INCREASE_BUDDY_COUNTER(m_SpaceUsed, paddedSize);
-        INCREASE_BUDDY_COUNTER(m_InternalFragmentation, (paddedSize - size));
-
-        BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
-            paddedSize, //total size (padded to fit a block)
-            numElements * elementSize);
-            
-        if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
-        {
-            pBlock->InitPlaced(m_pBackingHeap, numElements, elementSize, initialData);
-        }
-        else
-        {
-            //TODO: To be truely thread-safe this operation should be atomic to guard against
-            //      the case in which blocks from this allocator are used on multiple threads 
-            //      (because it's really only 1 resource underneath)
-            pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
-        }
-
-        return pBlock;
+        delete pBlock;
+        return;
     }
 
-    catch (std::bad_alloc&)
-    {
-        // There are no blocks available for the requested size so  
-        // return the NULL block type  
-        return new BuddyBlock();
-    }
-}
+    pBlock->m_fenceValue = g_CommandManager.GetGraphicsQueue().GetNextFenceValue();
 
-/*
-void BuddyAllocator::Deallocate(BuddyBlock* pBlock)
-{
-    pBlock->m_fenceValue = g_CommandManager.GetNextFenceValue();
+    lock_guard<mutex> lock(m_deletionMutex);
     m_deferredDeletionQueue.push(pBlock);
 }
-*/
 
 void BuddyAllocator::DeallocateInternal(BuddyBlock* pBlock)
 {
@@ -226,39 +188,60 @@ void BuddyAllocator::DeallocateInternal(BuddyBlock* pBlock)
 
     UINT order = UnitSizeToOrder(size);
 
-    try
     {
-        DeallocateBlock(offset, order); // throw(std::bad_alloc)
-
-        DECREASE_BUDDY_COUNTER(m_SpaceUsed, size);
-        DECREASE_BUDDY_COUNTER(m_InternalFragmentation, (size - pBlock->m_unpaddedSize));
-        
-        if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
-        {
-            // Release the resource
-            pBlock->Destroy();
-        }
-        delete(pBlock);
+        lock_guard<mutex> lock(m_mutex);
+        ASSERT(!m_freeBlocks.IsFree(offset, order), "Buddy block freed twice");
+        m_freeBlocks.Free(offset, order);
     }
 
-    catch (std::bad_alloc&)
+    m_SpaceUsed -= pBlock->GetSize();
+    m_InternalFragmentation -= pBlock->GetSize() - pBlock->m_unpaddedSize;
+
+    if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
     {
-        // Deallocate failed trying to add the free block to the pool  
-        // resulting in a leak.  Unfortunately there is not much we can do.  
-        // Fortunately this is expected to be extremely rare as the storage  
-        // needed for each deallocate is very small.  
+        // Release the resource
+        pBlock->Destroy();
     }
-};
+    delete(pBlock);
+}
 
-/*
 void BuddyAllocator::CleanUpAllocations()
 {
-    while (m_deferredDeletionQueue.empty() == false &&
-        g_CommandManager.IsFenceComplete(m_deferredDeletionQueue.front()->m_fenceValue))
+    // The fences are increasing, so the first pending block that isn't done ends the scan
+    vector<BuddyBlock*> completed;
     {
-        BuddyBlock* pBlock = m_deferredDeletionQueue.front();
-        m_deferredDeletionQueue.pop();
+        lock_guard<mutex> lock(m_deletionMutex);
+        while (m_deferredDeletionQueue.empty() == false &&
+            g_CommandManager.IsFenceComplete(m_deferredDeletionQueue.front()->m_fenceValue))
+        {
+            completed.push_back(m_deferredDeletionQueue.front());
+            m_deferredDeletionQueue.pop();
+        }
+    }
 
+    for (BuddyBlock* pBlock : completed)
         DeallocateInternal(pBlock);
+}
+
+BuddyAllocatorStatistics BuddyAllocator::GetStatistics()
+{
+    BuddyAllocatorStatistics stats;
+    stats.TotalSize = m_maxBlockSize;
+    stats.SpaceUsed = m_SpaceUsed;
+    stats.InternalFragmentation = m_InternalFragmentation;
+    stats.AllocationCount = m_AllocationCount;
+    stats.FailedAllocations = m_FailedAllocations;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        stats.FreeSpace = m_freeBlocks.GetFreeUnits() * m_minBlockSize;
+        stats.LargestFreeBlock = m_freeBlocks.GetLargestFreeBlock() * m_minBlockSize;
+    }
+
+    {
+        lock_guard<mutex> lock(m_deletionMutex);
+        stats.PendingFrees = m_deferredDeletionQueue.size();
     }
-}*/
+
+    return stats;
+}
@@ -21,22 +21,15 @@
 #pragma once
 
 #include "GpuBuffer.h"
+#include "BuddyBitmap.h"
 #include <vector>
 #include <queue>
 #include <mutex>
-#include <set>
+#include <atomic>
 
 // Unfortunately the api restricts the minimum size of a placed buffer resource to 64k
 #define MIN_PLACED_BUFFER_SIZE (64 * 1024)
 
-#if defined(PROFILE) || defined(_DEBUG)
-#define INCREASE_BUDDY_COUNTER(A, B) (A = A + B);
-#define DECREASE_BUDDY_COUNTER(A, B) (A = A - B);
-#else
-#define INCREASE_BUDDY_COUNTER(A, B)
-#define DECREASE_BUDDY_COUNTER(A, B)
-#endif
-
 enum kBuddyAllocationStrategy
 {
     // This strategy uses Placed Resources to sub-allocate a buffer out of an underlying ID3D12Heap.
@@ -75,6 +68,28 @@ struct BuddyBlock
     void Destroy();
 };
 
+// A snapshot of the allocator, in bytes unless noted otherwise
+struct BuddyAllocatorStatistics
+{
+    size_t TotalSize;
+    size_t SpaceUsed;               // Padded sizes of the live blocks
+    size_t InternalFragmentation;   // Padding of the live blocks
+    size_t FreeSpace;
+    size_t LargestFreeBlock;
+    size_t PendingFrees;            // Blocks waiting for the GPU, still counted as used
+    uint64_t AllocationCount;
+    uint64_t FailedAllocations;
+
+    // Share of the free space that can't be handed out as one block, 0 when it all can
+    float GetExternalFragmentation() const
+    {
+        return FreeSpace == 0 ? 0.0f : 1.0f - (float)LargestFreeBlock / FreeSpace;
+    }
+};
+
+// Allocate() and Deallocate() may be called from any thread.  The free block bitmaps have their
+// own lock, held only for the few bit operations of an allocation or free, and the queue of blocks
+// waiting for the GPU has another.  Resource creation and uploads happen outside both.
 class BuddyAllocator
 {
 public:
@@ -87,33 +102,40 @@ public:
 
     BuddyBlock* Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData = nullptr);
 
+    // The block is only made available again once the GPU is done with the work submitted so far,
+    // see CleanUpAllocations()
     void Deallocate(BuddyBlock* pBlock);
 
     inline bool IsOwner(const BuddyBlock &block)
     {
-        return block.GetOffset() >= m_baseOffset && block.GetSize() <= m_maxBlockSize;
+        return block.GetOffset() >= m_baseOffset && block.GetOffset() + block.GetSize() <= m_baseOffset + m_maxBlockSize;
     }
 
     inline void Reset()
     {
-        // Clear the free blocks collection  
-        m_freeBlocks.clear();
-
         // Initialize the pool with a free inner block of max inner block size  
-        m_freeBlocks.resize(m_maxOrder + 1);
-        m_freeBlocks[m_maxOrder].insert((size_t)0);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_freeBlocks.Reset(m_maxOrder);
+        m_SpaceUsed = 0;
+        m_InternalFragmentation = 0;
     }
 
+    // Frees the deferred blocks whose fence has completed
     void CleanUpAllocations();
 
+    BuddyAllocatorStatistics GetStatistics();
+
 private:
     ID3D12Heap* m_pBackingHeap;
     ByteAddressBuffer m_BackingResource;
 
     const D3D12_HEAP_TYPE m_heapType;
 
+    std::mutex m_deletionMutex;
     std::queue<BuddyBlock*> m_deferredDeletionQueue;
-    std::vector<std::set<size_t>> m_freeBlocks;
+
+    std::mutex m_mutex;
+    BuddyBitmap m_freeBlocks;
     UINT m_maxOrder;
     const size_t m_baseOffset;
     const size_t m_maxBlockSize;
@@ -131,19 +153,12 @@ private:
         return Math::Log2(size); // Log2 rounds up fractions to next whole value
     }
 
-    inline size_t GetBuddyOffset(const size_t &offset, const size_t &size)
-    {
-        return offset ^ size;
-    }
-
     void DeallocateInternal(BuddyBlock* pBlock);
 
     size_t OrderToUnitSize(UINT order) const { return ((size_t)1) << order; }
-    size_t AllocateBlock(UINT order);
-    void DeallocateBlock(size_t offset, UINT order);
 
-#if defined(PROFILE) || defined(_DEBUG)
-    size_t m_SpaceUsed;
-    size_t m_InternalFragmentation;
-#endif
+    std::atomic<size_t> m_SpaceUsed;
+    std::atomic<size_t> m_InternalFragmentation;
+    std::atomic<uint64_t> m_AllocationCount;
+    std::atomic<uint64_t> m_FailedAllocations;
 };
@@ -0,0 +1,173 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <intrin.h>
+
+//
+// The bookkeeping of a buddy allocator over 2^MaxOrder units, with no knowledge of what the
+// units are.  Every order has a bitmap with a bit per block of that size that is set while the
+// block is free.  Each bitmap is a small hierarchy: above the bits, every level has a bit per
+// non-zero word of the level below, up to a single word.  A mask with a bit per order that has
+// any free block picks the smallest order that can satisfy a request, so finding a block is a
+// handful of bit scans, and splitting or merging touches one bit per order on the way.
+//
+// Blocks are handed out lowest address first, the same policy as a set of free offsets per
+// order.  The class isn't thread-safe, BuddyAllocator guards it with a lock.
+//
+class BuddyBitmap
+{
+public:
+
+    static const size_t kInvalidOffset = ~(size_t)0;
+
+    explicit BuddyBitmap( uint32_t MaxOrder = 0 ) { Reset(MaxOrder); }
+
+    // Makes the whole range one free block of 2^MaxOrder units
+    void Reset( uint32_t MaxOrder )
+    {
+        m_MaxOrder = MaxOrder;
+        m_FreeOrders = 0;
+        m_FreeUnits = 0;
+
+        m_Orders.resize(MaxOrder + 1);
+        for (uint32_t Order = 0; Order <= MaxOrder; ++Order)
+        {
+            std::vector<std::vector<uint64_t>>& Levels = m_Orders[Order];
+            Levels.clear();
+
+            size_t BitCount = (size_t)1 << (MaxOrder - Order);
+            do
+            {
+                size_t WordCount = (BitCount + 63) / 64;
+                Levels.emplace_back(WordCount, 0);
+                BitCount = WordCount;
+            }
+            while (BitCount > 1);
+        }
+
+        SetBit(MaxOrder, 0);
+        m_FreeUnits = (size_t)1 << MaxOrder;
+    }
+
+    // Returns the unit offset of a block of 2^Order units, or kInvalidOffset if none is free
+    size_t Allocate( uint32_t Order )
+    {
+        unsigned long FreeOrder;
+        if (Order > m_MaxOrder || !_BitScanForward64(&FreeOrder, m_FreeOrders >> Order << Order))
+            return kInvalidOffset;
+
+        size_t Index = FindFirst(FreeOrder);
+        ClearBit(FreeOrder, Index);
+
+        // Keep the lower half of every split and free the upper one
+        while (FreeOrder > Order)
+        {
+            --FreeOrder;
+            Index *= 2;
+            SetBit(FreeOrder, Index + 1);
+        }
+
+        m_FreeUnits -= (size_t)1 << Order;
+        return Index << Order;
+    }
+
+    // Returns a block and merges it with its buddy for as long as the buddy is free too
+    void Free( size_t Offset, uint32_t Order )
+    {
+        m_FreeUnits += (size_t)1 << Order;
+
+        size_t Index = Offset >> Order;
+        while (Order < m_MaxOrder && TestBit(Order, Index ^ 1))
+        {
+            ClearBit(Order, Index ^ 1);
+            Index >>= 1;
+            ++Order;
+        }
+
+        SetBit(Order, Index);
+    }
+
+    bool IsFree( size_t Offset, uint32_t Order ) const { return TestBit(Order, Offset >> Order); }
+
+    uint32_t GetMaxOrder( void ) const { return m_MaxOrder; }
+    size_t GetFreeUnits( void ) const { return m_FreeUnits; }
+
+    // The size in units of the largest block that can currently be allocated
+    size_t GetLargestFreeBlock( void ) const
+    {
+        unsigned long Order;
+        return _BitScanReverse64(&Order, m_FreeOrders) ? (size_t)1 << Order : 0;
+    }
+
+private:
+
+    void SetBit( uint32_t Order, size_t Index )
+    {
+        std::vector<std::vector<uint64_t>>& Levels = m_Orders[Order];
+        for (size_t Level = 0; Level < Levels.size(); ++Level)
+        {
+            uint64_t& Word = Levels[Level][Index / 64];
+            const bool WasEmpty = Word == 0;
+            Word |= 1ull << (Index % 64);
+            if (!WasEmpty)
+                break;
+            Index /= 64;
+        }
+        m_FreeOrders |= 1ull << Order;
+    }
+
+    void ClearBit( uint32_t Order, size_t Index )
+    {
+        std::vector<std::vector<uint64_t>>& Levels = m_Orders[Order];
+        for (size_t Level = 0; Level < Levels.size(); ++Level)
+        {
+            uint64_t& Word = Levels[Level][Index / 64];
+            Word &= ~(1ull << (Index % 64));
+            if (Word != 0)
+                return;
+            Index /= 64;
+        }
+
+        // The top word emptied, so nothing of this order is free
+        m_FreeOrders &= ~(1ull << Order);
+    }
+
+    bool TestBit( uint32_t Order, size_t Index ) const
+    {
+        return (m_Orders[Order][0][Index / 64] >> (Index % 64) & 1) != 0;
+    }
+
+    // Follows the lowest set bit from the top level down.  The order must have a free block.
+    size_t FindFirst( uint32_t Order ) const
+    {
+        const std::vector<std::vector<uint64_t>>& Levels = m_Orders[Order];
+
+        size_t Index = 0;
+        for (size_t Level = Levels.size(); Level-- > 0; )
+        {
+            // Every word on the path has a bit set, Bit is initialized only to keep compilers quiet
+            unsigned long Bit = 0;
+            _BitScanForward64(&Bit, Levels[Level][Index]);
+            Index = Index * 64 + Bit;
+        }
+        return Index;
+    }
+
+    uint32_t m_MaxOrder;
+    uint64_t m_FreeOrders;      // Bit N is set when a block of order N is free
+    size_t m_FreeUnits;
+    std::vector<std::vector<std::vector<uint64_t>>> m_Orders;
+};
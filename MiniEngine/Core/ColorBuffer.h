@@ -54,6 +54,14 @@ public:
     void CreateArray(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t ArrayCount,
         DXGI_FORMAT Format, EsramAllocator& Allocator);
 
+    // Create a color buffer in memory of a heap, which buffers that are never needed at the same
+    // time can share.  Creating it again at another offset keeps the same descriptors.
+    void CreatePlaced(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t ArrayCount,
+        DXGI_FORMAT Format, ID3D12Heap* Heap, uint64_t HeapOffset, D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON);
+
+    // The size and alignment of the memory CreatePlaced() needs
+    D3D12_RESOURCE_ALLOCATION_INFO GetPlacedAllocationInfo(uint32_t Width, uint32_t Height, uint32_t ArrayCount, DXGI_FORMAT Format);
+
     // Get pre-created CPU-visible descriptor handles
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV(void) const { return m_SRVHandle; }
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetRTV(void) const { return m_RTVHandle; }
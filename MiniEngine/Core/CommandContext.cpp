@@ -334,6 +334,14 @@ void GraphicsContext::SetScissor( const D3D12_RECT& rect )
     m_CommandList->RSSetScissorRects( 1, &rect );
 }
 
+D3D12_RESOURCE_BARRIER& CommandContext::AppendBarrier( void )
+{
+    if (m_NumBarriersToFlush == kMaxBufferedBarriers)
+        FlushResourceBarriers();
+
+    return m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+}
+
 void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
 {
     D3D12_RESOURCE_STATES OldState = Resource.m_UsageState;
@@ -346,8 +354,7 @@ void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_ST
 
     if (OldState != NewState)
     {
-        ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
-        D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+        D3D12_RESOURCE_BARRIER& BarrierDesc = AppendBarrier();
 
         BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
         BarrierDesc.Transition.pResource = Resource.GetResource();
@@ -369,7 +376,7 @@ void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_ST
     else if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
         InsertUAVBarrier(Resource, FlushImmediate);
 
-    if (FlushImmediate || m_NumBarriersToFlush == 16)
+    if (FlushImmediate)
         FlushResourceBarriers();
 }
 
@@ -383,8 +390,7 @@ void CommandContext::BeginResourceTransition(GpuResource& Resource, D3D12_RESOUR
 
     if (OldState != NewState)
     {
-        ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
-        D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+        D3D12_RESOURCE_BARRIER& BarrierDesc = AppendBarrier();
 
         BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
         BarrierDesc.Transition.pResource = Resource.GetResource();
@@ -397,14 +403,13 @@ void CommandContext::BeginResourceTransition(GpuResource& Resource, D3D12_RESOUR
         Resource.m_TransitioningState = NewState;
     }
 
-    if (FlushImmediate || m_NumBarriersToFlush == 16)
+    if (FlushImmediate)
         FlushResourceBarriers();
 }
 
 void CommandContext::InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate)
 {
-    ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
-    D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+    D3D12_RESOURCE_BARRIER& BarrierDesc = AppendBarrier();
 
     BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
     BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
@@ -416,8 +421,7 @@ void CommandContext::InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate
 
 void CommandContext::InsertAliasBarrier(GpuResource& Before, GpuResource& After, bool FlushImmediate)
 {
-    ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
-    D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+    D3D12_RESOURCE_BARRIER& BarrierDesc = AppendBarrier();
 
     BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
     BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
@@ -170,7 +170,11 @@ protected:
     DynamicDescriptorHeap m_DynamicViewDescriptorHeap;		// HEAP_TYPE_CBV_SRV_UAV
     DynamicDescriptorHeap m_DynamicSamplerDescriptorHeap;	// HEAP_TYPE_SAMPLER
 
-    D3D12_RESOURCE_BARRIER m_ResourceBarrierBuffer[16];
+    // Barriers are submitted together when a draw or dispatch needs them or the buffer fills
+    static const UINT kMaxBufferedBarriers = 64;
+    D3D12_RESOURCE_BARRIER& AppendBarrier( void );
+
+    D3D12_RESOURCE_BARRIER m_ResourceBarrierBuffer[kMaxBufferedBarriers];
     UINT m_NumBarriersToFlush;
 
     ID3D12DescriptorHeap* m_CurrentDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
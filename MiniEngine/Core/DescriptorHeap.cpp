@@ -23,10 +23,62 @@ using namespace Graphics;
 //
 std::mutex DescriptorAllocator::sm_AllocationMutex;
 std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DescriptorAllocator::sm_DescriptorHeapPool;
+uint32_t DescriptorAllocator::sm_PoolGeneration = 0;
+
+namespace
+{
+    const uint32_t kThreadCacheSize = 32;
+    const uint32_t kThreadCacheBatch = 16;
+}
+
+struct DescriptorAllocator::ThreadCache
+{
+    DescriptorAllocator* Owner;
+    uint32_t Generation;
+    uint32_t Count;
+    SIZE_T Handles[kThreadCacheSize];
+
+    // Whatever the thread still holds goes back to the shared free lists when it exits
+    ~ThreadCache()
+    {
+        if (Owner != nullptr && Count > 0)
+            Owner->FlushThreadCache(*this);
+    }
+};
+
+// There is one allocator per heap type
+thread_local DescriptorAllocator::ThreadCache DescriptorAllocator::t_ThreadCaches[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+
+DescriptorAllocator::ThreadCache& DescriptorAllocator::GetThreadCache( void )
+{
+    ThreadCache& Cache = t_ThreadCaches[m_Type];
+
+    // Handles cached before DestroyAll() point into released heaps
+    if (Cache.Owner != this || Cache.Generation != sm_PoolGeneration)
+    {
+        Cache.Owner = this;
+        Cache.Generation = sm_PoolGeneration;
+        Cache.Count = 0;
+    }
+    return Cache;
+}
+
+namespace
+{
+    uint32_t GetSizeClass( uint32_t Count )
+    {
+        unsigned long Log2;
+        _BitScanReverse(&Log2, Count);
+        return Log2;
+    }
+}
 
 void DescriptorAllocator::DestroyAll(void)
 {
     sm_DescriptorHeapPool.clear();
+
+    // Allocators and thread caches notice this and drop their state before next use
+    ++sm_PoolGeneration;
 }
 
 ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(D3D12_DESCRIPTOR_HEAP_TYPE Type)
@@ -45,24 +97,291 @@ ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(D3D12_DESCRIPTOR_HEAP_
     return pHeap.Get();
 }
 
-D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate( uint32_t Count )
+void DescriptorAllocator::ResetIfDestroyed( void )
+{
+    if (m_Generation == sm_PoolGeneration)
+        return;
+
+    m_Generation = sm_PoolGeneration;
+    m_HeapStarts.clear();
+    m_HeapIndexByStart.clear();
+    m_FreeRanges.clear();
+    for (auto& SizeClass : m_SizeClasses)
+        SizeClass.clear();
+    m_FreeCount = 0;
+    m_RetiredRanges = std::queue<RetiredRange>();
+    m_RetiredCount = 0;
+    m_CachedCount = 0;
+}
+
+void DescriptorAllocator::ReclaimRetired( void )
+{
+    while (!m_RetiredRanges.empty() && g_CommandManager.IsFenceComplete(m_RetiredRanges.front().FenceValue))
+    {
+        const RetiredRange& Range = m_RetiredRanges.front();
+        FreeLocked(Range.Handle, Range.Count);
+        m_RetiredCount -= Range.Count;
+        m_RetiredRanges.pop();
+    }
+}
+
+void DescriptorAllocator::AddFreeRange( uint64_t Key, uint32_t Count )
+{
+    m_FreeRanges[Key] = Count;
+    m_SizeClasses[GetSizeClass(Count)].insert(Key);
+    m_FreeCount += Count;
+}
+
+void DescriptorAllocator::RemoveFreeRange( uint64_t Key, uint32_t Count )
+{
+    m_FreeRanges.erase(Key);
+    m_SizeClasses[GetSizeClass(Count)].erase(Key);
+    m_FreeCount -= Count;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::AllocateLocked( uint32_t Count )
 {
-    if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < Count)
+    const uint64_t kNone = ~0ull;
+    uint64_t Key = kNone;
+
+    // Ranges in the class of the request may still be too small, larger classes always fit
+    const uint32_t SizeClass = GetSizeClass(Count);
+    for (uint64_t Candidate : m_SizeClasses[SizeClass])
+    {
+        if (m_FreeRanges[Candidate] >= Count)
+        {
+            Key = Candidate;
+            break;
+        }
+    }
+
+    for (uint32_t Larger = SizeClass + 1; Key == kNone && Larger < sm_NumSizeClasses; ++Larger)
+    {
+        if (!m_SizeClasses[Larger].empty())
+            Key = *m_SizeClasses[Larger].begin();
+    }
+
+    if (Key == kNone)
     {
-        m_CurrentHeap = RequestNewHeap(m_Type);
-        m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
-        m_RemainingFreeHandles = sm_NumDescriptorsPerHeap;
+        ID3D12DescriptorHeap* Heap = RequestNewHeap(m_Type);
 
         if (m_DescriptorSize == 0)
             m_DescriptorSize = Graphics::g_Device->GetDescriptorHandleIncrementSize(m_Type);
+
+        const uint32_t HeapIndex = (uint32_t)m_HeapStarts.size();
+        m_HeapStarts.push_back(Heap->GetCPUDescriptorHandleForHeapStart());
+        m_HeapIndexByStart[m_HeapStarts.back().ptr] = HeapIndex;
+
+        Key = MakeRangeKey(HeapIndex, 0);
+        AddFreeRange(Key, sm_NumDescriptorsPerHeap);
     }
 
-    D3D12_CPU_DESCRIPTOR_HANDLE ret = m_CurrentHandle;
-    m_CurrentHandle.ptr += Count * m_DescriptorSize;
-    m_RemainingFreeHandles -= Count;
+    // Take the front of the range and leave the rest free
+    const uint32_t RangeCount = m_FreeRanges[Key];
+    RemoveFreeRange(Key, RangeCount);
+    if (RangeCount > Count)
+        AddFreeRange(Key + Count, RangeCount - Count);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE ret = m_HeapStarts[(uint32_t)(Key >> 32)];
+    ret.ptr += (uint32_t)Key * m_DescriptorSize;
     return ret;
 }
 
+void DescriptorAllocator::FreeLocked( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count )
+{
+    auto Heap = m_HeapIndexByStart.upper_bound(Handle.ptr);
+    ASSERT(Heap != m_HeapIndexByStart.begin(), "Descriptor was not allocated from this allocator");
+    --Heap;
+
+    const uint32_t Offset = (uint32_t)((Handle.ptr - Heap->first) / m_DescriptorSize);
+    ASSERT(Offset + Count <= sm_NumDescriptorsPerHeap, "Descriptor was not allocated from this allocator");
+
+    uint64_t Key = MakeRangeKey(Heap->second, Offset);
+
+    // Merge with the free ranges right after and before it.  Keys of different heaps are
+    // far enough apart that ranges never merge across heaps.
+    auto Next = m_FreeRanges.lower_bound(Key);
+    ASSERT(Next == m_FreeRanges.end() || Next->first >= Key + Count, "Descriptor freed twice");
+    if (Next != m_FreeRanges.end() && Next->first == Key + Count)
+    {
+        const uint32_t NextCount = Next->second;
+        RemoveFreeRange(Key + Count, NextCount);
+        Count += NextCount;
+    }
+
+    auto Prev = m_FreeRanges.lower_bound(Key);
+    if (Prev != m_FreeRanges.begin())
+    {
+        --Prev;
+        ASSERT(Prev->first + Prev->second <= Key, "Descriptor freed twice");
+        if (Prev->first + Prev->second == Key)
+        {
+            Key = Prev->first;
+            const uint32_t PrevCount = Prev->second;
+            RemoveFreeRange(Key, PrevCount);
+            Count += PrevCount;
+        }
+    }
+
+    AddFreeRange(Key, Count);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate( uint32_t Count )
+{
+    ASSERT(Count > 0 && Count <= sm_NumDescriptorsPerHeap, "Descriptor count does not fit in a heap");
+
+    if (Count == 1)
+    {
+        ThreadCache& Cache = GetThreadCache();
+        if (Cache.Count == 0)
+        {
+            std::lock_guard<std::mutex> LockGuard(m_Mutex);
+            ResetIfDestroyed();
+            ReclaimRetired();
+
+            // Filled in reverse so they are handed out in address order
+            for (uint32_t i = 0; i < kThreadCacheBatch; ++i)
+                Cache.Handles[kThreadCacheBatch - 1 - i] = AllocateLocked(1).ptr;
+            Cache.Count = kThreadCacheBatch;
+            m_CachedCount += kThreadCacheBatch;
+        }
+
+        --m_CachedCount;
+        D3D12_CPU_DESCRIPTOR_HANDLE ret;
+        ret.ptr = Cache.Handles[--Cache.Count];
+        return ret;
+    }
+
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+    ResetIfDestroyed();
+    ReclaimRetired();
+    return AllocateLocked(Count);
+}
+
+DescriptorAllocation DescriptorAllocator::AllocateOwned( uint32_t Count )
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE Handle = Allocate(Count);
+    return DescriptorAllocation(this, Handle, Count, sm_PoolGeneration);
+}
+
+void DescriptorAllocator::Free( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint32_t Generation )
+{
+    if (Generation != sm_PoolGeneration)
+        return;
+
+    if (Count == 1)
+    {
+        ThreadCache& Cache = GetThreadCache();
+        if (Cache.Count == kThreadCacheSize)
+        {
+            std::lock_guard<std::mutex> LockGuard(m_Mutex);
+            ResetIfDestroyed();
+
+            // Return the oldest half so the most recently freed ones get reused first
+            for (uint32_t i = 0; i < kThreadCacheBatch; ++i)
+            {
+                D3D12_CPU_DESCRIPTOR_HANDLE Returned;
+                Returned.ptr = Cache.Handles[i];
+                FreeLocked(Returned, 1);
+            }
+            memmove(Cache.Handles, Cache.Handles + kThreadCacheBatch, (kThreadCacheSize - kThreadCacheBatch) * sizeof(SIZE_T));
+            Cache.Count -= kThreadCacheBatch;
+            m_CachedCount -= kThreadCacheBatch;
+        }
+
+        Cache.Handles[Cache.Count++] = Handle.ptr;
+        ++m_CachedCount;
+        return;
+    }
+
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+    ResetIfDestroyed();
+    FreeLocked(Handle, Count);
+}
+
+void DescriptorAllocator::FreeAfterFence( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint32_t Generation, uint64_t FenceValue )
+{
+    if (Generation != sm_PoolGeneration)
+        return;
+
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+    ResetIfDestroyed();
+    ReclaimRetired();
+
+    RetiredRange Range = { FenceValue, Handle, Count };
+    m_RetiredRanges.push(Range);
+    m_RetiredCount += Count;
+}
+
+void DescriptorAllocator::FlushThreadCache( ThreadCache& Cache )
+{
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+    if (Cache.Generation == sm_PoolGeneration && m_Generation == sm_PoolGeneration)
+    {
+        for (uint32_t i = 0; i < Cache.Count; ++i)
+        {
+            D3D12_CPU_DESCRIPTOR_HANDLE Returned;
+            Returned.ptr = Cache.Handles[i];
+            FreeLocked(Returned, 1);
+        }
+        m_CachedCount -= Cache.Count;
+    }
+    Cache.Count = 0;
+}
+
+DescriptorAllocator::Statistics DescriptorAllocator::GetStatistics( void )
+{
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+    ResetIfDestroyed();
+
+    Statistics Stats = {};
+    Stats.HeapCount = (uint32_t)m_HeapStarts.size();
+    Stats.TotalDescriptors = Stats.HeapCount * sm_NumDescriptorsPerHeap;
+    Stats.CachedDescriptors = m_CachedCount;
+    Stats.FreeDescriptors = m_FreeCount;
+    Stats.RetiredDescriptors = m_RetiredCount;
+    Stats.AllocatedDescriptors = Stats.TotalDescriptors - Stats.FreeDescriptors - Stats.CachedDescriptors - Stats.RetiredDescriptors;
+    Stats.FreeRangeCount = (uint32_t)m_FreeRanges.size();
+
+    for (uint32_t SizeClass = sm_NumSizeClasses; SizeClass-- > 0 && Stats.LargestFreeRange == 0; )
+    {
+        for (uint64_t Key : m_SizeClasses[SizeClass])
+            Stats.LargestFreeRange = std::max(Stats.LargestFreeRange, m_FreeRanges[Key]);
+    }
+
+    if (Stats.TotalDescriptors > 0)
+        Stats.Occupancy = (float)Stats.AllocatedDescriptors / Stats.TotalDescriptors;
+    // Ranges never span heaps, so a free heap is as good as it gets
+    if (Stats.FreeDescriptors > 0)
+        Stats.Fragmentation = 1.0f - (float)Stats.LargestFreeRange / std::min(Stats.FreeDescriptors, (uint32_t)sm_NumDescriptorsPerHeap);
+
+    return Stats;
+}
+
+//
+// DescriptorAllocation implementation
+//
+
+void DescriptorAllocation::Reset( void )
+{
+    if (m_Allocator != nullptr)
+        m_Allocator->Free(m_Handle, m_Count, m_Generation);
+
+    m_Allocator = nullptr;
+    m_Handle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    m_Count = 0;
+}
+
+void DescriptorAllocation::Release( uint64_t FenceValue )
+{
+    if (m_Allocator != nullptr)
+        m_Allocator->FreeAfterFence(m_Handle, m_Count, m_Generation, FenceValue);
+
+    m_Allocator = nullptr;
+    m_Handle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    m_Count = 0;
+}
+
 //
 // UserDescriptorHeap implementation
 //
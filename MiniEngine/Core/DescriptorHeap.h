@@ -14,35 +14,159 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
 #include <vector>
 #include <queue>
+#include <map>
+#include <set>
 #include <string>
 
 
 // This is an unbounded resource descriptor allocator.  It is intended to provide space for CPU-visible resource descriptors
 // as resources are created.  For those that need to be made shader-visible, they will need to be copied to a UserDescriptorHeap
 // or a DynamicDescriptorHeap.
+//
+// Descriptors from Allocate() live until DestroyAll().  Those from AllocateOwned() are recycled when the DescriptorAllocation
+// holding them goes away.  Free ranges are kept per heap, merged with their neighbors, and indexed by power of two size class
+// so an allocation takes the lowest addressed range from the smallest class that fits.  Single descriptors, by far the most common,
+// go through a small per-thread cache that only takes the lock to refill or flush in batches, and is flushed when its thread exits.
+class DescriptorAllocation;
+
 class DescriptorAllocator
 {
+    friend class DescriptorAllocation;
+
 public:
-    DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_Type(Type), m_CurrentHeap(nullptr) {}
+    DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_Type(Type), m_DescriptorSize(0), m_Generation(0), m_FreeCount(0), m_RetiredCount(0), m_CachedCount(0) {}
 
     D3D12_CPU_DESCRIPTOR_HANDLE Allocate( uint32_t Count );
+    DescriptorAllocation AllocateOwned( uint32_t Count );
+
+    struct Statistics
+    {
+        uint32_t HeapCount;
+        uint32_t TotalDescriptors;
+        uint32_t AllocatedDescriptors;  // Handed out and not freed
+        uint32_t CachedDescriptors;     // Held by per-thread caches
+        uint32_t FreeDescriptors;       // In the shared free lists
+        uint32_t RetiredDescriptors;    // Freed, waiting for the GPU to pass their fence
+        uint32_t FreeRangeCount;
+        uint32_t LargestFreeRange;
+        float Occupancy;                // Allocated / total
+        float Fragmentation;            // 1 - largest free range / free descriptors that could be contiguous
+    };
+
+    Statistics GetStatistics( void );
 
     static void DestroyAll(void);
 
 protected:
 
+    struct ThreadCache;
+
+    struct RetiredRange
+    {
+        uint64_t FenceValue;
+        D3D12_CPU_DESCRIPTOR_HANDLE Handle;
+        uint32_t Count;
+    };
+
     static const uint32_t sm_NumDescriptorsPerHeap = 256;
+    static const uint32_t sm_NumSizeClasses = 9;        // Floor of log2 of the range size, up to 256
     static std::mutex sm_AllocationMutex;
     static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool;
+    static uint32_t sm_PoolGeneration;
     static ID3D12DescriptorHeap* RequestNewHeap( D3D12_DESCRIPTOR_HEAP_TYPE Type );
+    static thread_local ThreadCache t_ThreadCaches[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+
+    ThreadCache& GetThreadCache( void );
+
+    // Ranges are identified by heap index in the upper and descriptor offset in the lower 32 bits
+    static uint64_t MakeRangeKey( uint32_t HeapIndex, uint32_t Offset ) { return (uint64_t)HeapIndex << 32 | Offset; }
+
+    // Descriptors allocated before DestroyAll() are dropped, their heap is gone
+    void Free( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint32_t Generation );
+    void FreeAfterFence( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint32_t Generation, uint64_t FenceValue );
+    void FlushThreadCache( ThreadCache& Cache );
+
+    // All of these require m_Mutex
+    void ResetIfDestroyed( void );
+    void ReclaimRetired( void );
+    void AddFreeRange( uint64_t Key, uint32_t Count );
+    void RemoveFreeRange( uint64_t Key, uint32_t Count );
+    D3D12_CPU_DESCRIPTOR_HANDLE AllocateLocked( uint32_t Count );
+    void FreeLocked( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count );
 
     D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
-    ID3D12DescriptorHeap* m_CurrentHeap;
-    D3D12_CPU_DESCRIPTOR_HANDLE m_CurrentHandle;
     uint32_t m_DescriptorSize;
-    uint32_t m_RemainingFreeHandles;
+    uint32_t m_Generation;
+
+    std::mutex m_Mutex;
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_HeapStarts;
+    std::map<SIZE_T, uint32_t> m_HeapIndexByStart;
+    std::map<uint64_t, uint32_t> m_FreeRanges;          // Range key to descriptor count
+    std::set<uint64_t> m_SizeClasses[sm_NumSizeClasses];
+    uint32_t m_FreeCount;
+    std::queue<RetiredRange> m_RetiredRanges;
+    uint32_t m_RetiredCount;
+    std::atomic<uint32_t> m_CachedCount;
+};
+
+// Owns descriptors from DescriptorAllocator::AllocateOwned() and returns them to the allocator when it is destroyed or reset.
+// Release() returns them once the GPU has passed a fence instead, for descriptors that frames in flight may still use.
+class DescriptorAllocation
+{
+    friend class DescriptorAllocator;
+
+public:
+    DescriptorAllocation() : m_Allocator(nullptr), m_Count(0), m_Generation(0)
+    {
+        m_Handle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    }
+
+    DescriptorAllocation( DescriptorAllocation&& Other ) : DescriptorAllocation()
+    {
+        *this = std::move(Other);
+    }
+
+    DescriptorAllocation& operator=( DescriptorAllocation&& Other )
+    {
+        if (this != &Other)
+        {
+            Reset();
+            m_Allocator = Other.m_Allocator;
+            m_Handle = Other.m_Handle;
+            m_Count = Other.m_Count;
+            m_Generation = Other.m_Generation;
+            Other.m_Allocator = nullptr;
+            Other.m_Handle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+            Other.m_Count = 0;
+        }
+        return *this;
+    }
+
+    DescriptorAllocation( const DescriptorAllocation& ) = delete;
+    DescriptorAllocation& operator=( const DescriptorAllocation& ) = delete;
+
+    ~DescriptorAllocation() { Reset(); }
+
+    void Reset( void );
+    void Release( uint64_t FenceValue );
+
+    D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle() const { return m_Handle; }
+    uint32_t GetCount() const { return m_Count; }
+    bool IsNull() const { return m_Allocator == nullptr; }
+
+private:
+    DescriptorAllocation( DescriptorAllocator* Allocator, D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint32_t Generation )
+        : m_Allocator(Allocator), m_Handle(Handle), m_Count(Count), m_Generation(Generation)
+    {
+    }
+
+    DescriptorAllocator* m_Allocator;
+    D3D12_CPU_DESCRIPTOR_HANDLE m_Handle;
+    uint32_t m_Count;
+    uint32_t m_Generation;
 };
 
 
@@ -32,6 +32,16 @@ using namespace std;
 namespace EngineProfiling
 {
     bool Paused = false;
+
+    // Before the timing tree, which interns its names
+    TraceRecorder g_Trace;
+    const uint32_t GpuTrack = g_Trace.AddTrack("GPU");
+
+    // Performance counter ticks to those of the trace, which are steady_clock's nanoseconds of the same counter
+    int64_t CpuTicksToTraceTicks(int64_t Tick)
+    {
+        return (int64_t)(SystemTime::TicksToSeconds(Tick) * 1e9);
+    }
 }
 
 class StatHistory
@@ -195,7 +205,10 @@ class NestedTimingTree
 {
 public:
     NestedTimingTree( const wstring& name, NestedTimingTree* parent = nullptr )
-        : m_Name(name), m_Parent(parent), m_IsExpanded(false), m_IsGraphed(false), m_GraphHandle(PERF_GRAPH_ERROR) {}
+        : m_Name(name), m_Parent(parent), m_IsExpanded(false), m_IsGraphed(false), m_GraphHandle(PERF_GRAPH_ERROR)
+    {
+        m_TraceId = EngineProfiling::g_Trace.Intern(string(name.begin(), name.end()));
+    }
 
     NestedTimingTree* GetChild( const wstring& name )
     {
@@ -284,6 +297,7 @@ public:
     void StartTiming( CommandContext* Context )
     {
         m_StartTick = SystemTime::GetCurrentTick();
+        EngineProfiling::g_Trace.Begin(m_TraceId);
         if (Context == nullptr)
             return;
 
@@ -295,6 +309,7 @@ public:
     void StopTiming( CommandContext* Context )
     {
         m_EndTick = SystemTime::GetCurrentTick();
+        EngineProfiling::g_Trace.End(m_TraceId);
         if (Context == nullptr)
             return;
 
@@ -318,9 +333,24 @@ public:
         m_CpuTime.RecordStat(FrameIndex, 1000.0f * (float)SystemTime::TimeBetweenTicks(m_StartTick, m_EndTick));
         m_GpuTime.RecordStat(FrameIndex, 1000.0f * m_GpuTimer.GetTime());
 
+        // Children ran inside this block on the GPU too, so their markers nest in its own
+        int64_t GpuStartTick, GpuEndTick;
+        bool RanOnGpu = GpuTimeManager::GetCpuTicks(m_GpuTimer.GetTimerIndex(), GpuStartTick, GpuEndTick);
+        if (RanOnGpu)
+        {
+            EngineProfiling::g_Trace.RecordOnTrack(EngineProfiling::GpuTrack, m_TraceId, TraceRecorder::kBegin,
+                EngineProfiling::CpuTicksToTraceTicks(GpuStartTick));
+        }
+
         for (auto node : m_Children)
             node->GatherTimes(FrameIndex);
 
+        if (RanOnGpu)
+        {
+            EngineProfiling::g_Trace.RecordOnTrack(EngineProfiling::GpuTrack, m_TraceId, TraceRecorder::kEnd,
+                EngineProfiling::CpuTicksToTraceTicks(GpuEndTick));
+        }
+
         m_StartTick = 0;
         m_EndTick = 0;
     }
@@ -401,6 +431,7 @@ private:
     GpuTimer m_GpuTimer;
     bool m_IsGraphed;
     GraphHandle m_GraphHandle;
+    uint32_t m_TraceId;
     static StatHistory s_TotalCpuTime;
     static StatHistory s_TotalGpuTime;
     static StatHistory s_FrameDelta;
@@ -425,9 +456,57 @@ namespace EngineProfiling
     BoolVar DrawProfiler("Display Profiler", false);
     //BoolVar DrawPerfGraph("Display Performance Graph", false);
     const bool DrawPerfGraph = false;
-    
+    BoolVar CaptureTraceNow("Capture Trace", false);
+
+    // GPU times are read back a frame late
+    const uint32_t kTraceGpuLatency = 2;
+    uint32_t TraceFramesLeft = 0;
+    int64_t TraceStartTick = 0;
+    int64_t TraceEndTick = 0;
+    wstring TraceFileName;
+
+    void CaptureTrace( uint32_t FrameCount, const wstring& FileName )
+    {
+        ASSERT(FrameCount > 0, "Capture at least one frame");
+        TraceFramesLeft = FrameCount + kTraceGpuLatency;
+        TraceStartTick = TraceRecorder::GetTick();
+        TraceFileName = FileName;
+    }
+
+    void WriteTrace( void )
+    {
+        string Json;
+        size_t MarkerCount = g_Trace.ExportChromeTrace(TraceStartTick, TraceEndTick, Json);
+
+        FILE* TraceFile = nullptr;
+        if (_wfopen_s(&TraceFile, TraceFileName.c_str(), L"wb") != 0 || TraceFile == nullptr)
+        {
+            Utility::Printf(L"Unable to write trace to %ws\n", TraceFileName.c_str());
+            return;
+        }
+        fwrite(Json.data(), 1, Json.size(), TraceFile);
+        fclose(TraceFile);
+
+        Utility::Printf(L"Wrote %u trace markers to %ws\n", (uint32_t)MarkerCount, TraceFileName.c_str());
+    }
+
     void Update( void )
     {
+        g_Trace.MarkFrame((uint32_t)Graphics::GetFrameCount());
+
+        if (CaptureTraceNow)
+        {
+            CaptureTraceNow = false;
+            CaptureTrace(60, L"Trace.json");
+        }
+        else if (TraceFramesLeft > 0)
+        {
+            if (--TraceFramesLeft == kTraceGpuLatency)
+                TraceEndTick = TraceRecorder::GetTick();
+            else if (TraceFramesLeft == 0)
+                WriteTrace();
+        }
+
         if (GameInput::IsFirstPressed( GameInput::kStartButton ) 
             || GameInput::IsFirstPressed( GameInput::kKey_space ))
         {
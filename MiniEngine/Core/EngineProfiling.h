@@ -15,6 +15,7 @@
 
 #include <string>
 #include "TextRenderer.h"
+#include "TraceRecorder.h"
 
 class CommandContext;
 
@@ -29,8 +30,38 @@ namespace EngineProfiling
     void DisplayPerfGraph(GraphicsContext& Text);
     void Display(TextContext& Text, float x, float y, float w, float h);
     bool IsPaused();
+
+    // Records TRACE_SCOPE markers from every thread, and the blocks above with their GPU times
+    extern TraceRecorder g_Trace;
+
+    // Writes what was recorded in the next FrameCount frames to a Chrome trace file
+    void CaptureTrace(uint32_t FrameCount, const std::wstring& FileName);
 }
 
+class TraceScope
+{
+public:
+    explicit TraceScope( uint32_t Id ) : m_Id(Id)
+    {
+        EngineProfiling::g_Trace.Begin(Id);
+    }
+    ~TraceScope()
+    {
+        EngineProfiling::g_Trace.End(m_Id);
+    }
+
+private:
+    uint32_t m_Id;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Traces the rest of the scope on any thread, in every build.  The name is interned the first time through.
+#define TRACE_SCOPE(Name) \
+    static const uint32_t TRACE_CONCAT(s_TraceId, __LINE__) = EngineProfiling::g_Trace.Intern(Name); \
+    TraceScope TRACE_CONCAT(TraceScope, __LINE__)(TRACE_CONCAT(s_TraceId, __LINE__))
+
 #ifdef RELEASE
 class ScopedTimer
 {
@@ -13,8 +13,12 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include "AssetPack.h"
 #include <fstream>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <climits>
 #include <zlib.h> // From NuGet package 
 
 using namespace std;
@@ -25,7 +29,113 @@ namespace Utility
     ByteArray NullFile = make_shared<vector<byte> > (vector<byte>() );
 }
 
-ByteArray DecompressZippedFile( wstring& fileName );
+namespace
+{
+    // Chunked files start with this header and a table of ChunkCount + 1 file offsets, one for the start
+    // of each chunk and one for the end of the last.  Every chunk but the last inflates to ChunkSize bytes.
+    struct ChunkedFileHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t UncompressedSize;
+        uint32_t ChunkSize;
+        uint32_t ChunkCount;
+    };
+
+    const uint32_t kChunkedFileMagic = 'CZEM';
+    const uint32_t kChunkedFileVersion = 1;
+
+    // Compressed data is read in pieces of this size rather than all at once
+    const uint32_t kReadChunkSize = 0x40000;
+
+    struct MountedPack
+    {
+        const byte* FileData;
+        const AssetPack::Entry* Entries;
+        uint32_t EntryCount;
+        const wchar_t* Names;
+        bool AllowLooseFiles;
+    };
+
+    // Newest first
+    vector<MountedPack> s_MountedPacks;
+    mutex s_MountMutex;
+
+    // Finds the file in the mounted packs, comparing names the way the packer normalized them
+    bool FindPackEntry( const wstring& fileName, MountedPack& Pack, const AssetPack::Entry*& Entry )
+    {
+        const wchar_t* Name = fileName.c_str();
+        size_t Length = fileName.size();
+        while (Length >= 2 && Name[0] == L'.' && (Name[1] == L'/' || Name[1] == L'\\'))
+        {
+            Name += 2;
+            Length -= 2;
+        }
+
+        const uint64_t Hash = AssetPack::HashName(Name, Length);
+
+        lock_guard<mutex> Guard(s_MountMutex);
+        for (const MountedPack& Mounted : s_MountedPacks)
+        {
+            const AssetPack::Entry* End = Mounted.Entries + Mounted.EntryCount;
+            const AssetPack::Entry* Iter = lower_bound(Mounted.Entries, End, Hash,
+                [](const AssetPack::Entry& E, uint64_t H) { return E.NameHash < H; });
+
+            for (; Iter != End && Iter->NameHash == Hash; ++Iter)
+            {
+                if (Iter->NameLength != Length)
+                    continue;
+
+                const wchar_t* PackedName = Mounted.Names + Iter->NameOffset;
+                size_t i = 0;
+                while (i < Length && AssetPack::NormalizeChar(Name[i]) == PackedName[i])
+                    ++i;
+
+                if (i == Length)
+                {
+                    Pack = Mounted;
+                    Entry = Iter;
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // The disk is only searched when no mounted pack claims to have everything
+    bool SearchLooseFiles( void )
+    {
+        lock_guard<mutex> Guard(s_MountMutex);
+        for (const MountedPack& Mounted : s_MountedPacks)
+        {
+            if (!Mounted.AllowLooseFiles)
+                return false;
+        }
+        return true;
+    }
+
+    FileView ReadPackedEntry( const MountedPack& Pack, const AssetPack::Entry& Entry, const wstring& fileName )
+    {
+        FileView View = { Pack.FileData + Entry.Offset, (size_t)Entry.Size, nullptr };
+        if (Entry.Compression == AssetPack::kStored)
+            return View;
+
+        ByteArray Output = make_shared<vector<byte> >( (size_t)Entry.Size );
+        uLongf OutputSize = (uLongf)Entry.Size;
+        int err = uncompress(Output->data(), &OutputSize, View.Data, (uLong)Entry.StoredSize);
+        if (err != Z_OK || OutputSize != Entry.Size)
+        {
+            Utility::Printf(L"Couldn't decompress packed file %s:  Error = %d\n", fileName.c_str(), err);
+            Output = NullFile;
+        }
+
+        View.Data = Output->data();
+        View.Size = Output->size();
+        View.Storage = Output;
+        return View;
+    }
+}
 
 ByteArray ReadFileHelper(const wstring& fileName)
 {
@@ -47,83 +157,320 @@ ByteArray ReadFileHelper(const wstring& fileName)
     return byteArray;
 }
 
-ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
+ByteArray ReadLooseFile( const wstring& fileName )
 {
-    std::wstring zippedFileName = *fileName + L".gz";
-    ByteArray firstTry = DecompressZippedFile(zippedFileName);
+    ByteArray firstTry = DecompressChunkedFile(fileName + L".zc");
     if (firstTry != NullFile)
         return firstTry;
 
-    return ReadFileHelper(*fileName);
+    ByteArray secondTry = DecompressGzipFile(fileName + L".gz");
+    if (secondTry != NullFile)
+        return secondTry;
+
+    return ReadFileHelper(fileName);
 }
 
-ByteArray Inflate(ByteArray CompressedSource, int& err, uint32_t ChunkSize = 0x100000 ) 
+ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
+{
+    MountedPack Pack;
+    const AssetPack::Entry* Entry;
+    if (FindPackEntry(*fileName, Pack, Entry))
+    {
+        FileView View = ReadPackedEntry(Pack, *Entry, *fileName);
+        if (View.Storage != nullptr)
+            return View.Storage;
+        return make_shared<vector<byte> >( View.Data, View.Data + View.Size );
+    }
+
+    if (!SearchLooseFiles())
+        return NullFile;
+
+    return ReadLooseFile(*fileName);
+}
+
+ByteArray Utility::DecompressGzipFile( const wstring& fileName )
 {
-    // Create a dynamic buffer to hold compressed blocks
-    vector<unique_ptr<byte> > blocks;
+    ifstream file( fileName, ios::in | ios::binary );
+    if (!file)
+        return NullFile;
+
+    // Smallest possible zlib stream, a 2 byte header, an empty block and a 4 byte checksum
+    uint64_t FileSize = file.seekg(0, ios::end).tellg();
+    if (FileSize < 8)
+        return NullFile;
+
+    // A gzip trailer ends with the uncompressed size modulo 4 GB.  It's exact for single member files,
+    // anything else (or a zlib stream) starts from a guess and grows the buffer when it fills up.
+    uint8_t Magic[2] = {};
+    uint32_t ISize = 0;
+    file.seekg(0, ios::beg).read((char*)Magic, sizeof(Magic));
+    file.seekg(FileSize - 4).read((char*)&ISize, sizeof(ISize));
+    file.seekg(0, ios::beg);
+
+    // Deflate can't do better than about 1032:1
+    size_t ExpectedSize = (size_t)FileSize * 4;
+    if (Magic[0] == 0x1F && Magic[1] == 0x8B && ISize <= FileSize * 1032)
+        ExpectedSize = ISize;
+
+    ByteArray Output = make_shared<vector<byte> >( max<size_t>(ExpectedSize, 1) );
+    size_t Produced = 0;
 
     z_stream strm  = {};
     strm.data_type = Z_BINARY;
-    strm.total_in  = strm.avail_in  = (uInt)CompressedSource->size();
-    strm.next_in   = CompressedSource->data();
 
-    err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+    int err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+
+    vector<byte> Input(kReadChunkSize);
+    bool OutputFull = false;
 
-    while (err == Z_OK || err == Z_BUF_ERROR)
+    while (err == Z_OK || err == Z_BUF_ERROR || err == Z_STREAM_END)
     {
-        strm.avail_out = ChunkSize;
-        strm.next_out = (byte*)malloc(ChunkSize);
-        blocks.emplace_back(strm.next_out);
+        if (strm.avail_in == 0)
+        {
+            file.read((char*)Input.data(), Input.size());
+            strm.next_in = Input.data();
+            strm.avail_in = (uInt)file.gcount();
+
+            // Truncated, or done after the last member
+            if (strm.avail_in == 0)
+                break;
+        }
+
+        // Concatenated gzip members inflate one after the other.  Anything else past the end is ignored.
+        if (err == Z_STREAM_END)
+        {
+            if (strm.next_in[0] != 0x1F)
+                break;
+            err = inflateReset(&strm);
+        }
+
+        // Only when inflate stopped with input left over.  The output filling up exactly as expected
+        // still lets the trailer be checked without any room.
+        if (OutputFull)
+            Output->resize(Output->size() * 2);
+
+        strm.next_out = Output->data() + Produced;
+        strm.avail_out = (uInt)min<size_t>(Output->size() - Produced, UINT_MAX);
+
         err = inflate(&strm, Z_NO_FLUSH);
+
+        Produced = strm.next_out - Output->data();
+        OutputFull = Produced == Output->size() && strm.avail_in > 0;
     }
 
-    if (err != Z_STREAM_END) 
+    inflateEnd(&strm);
+
+    if (err != Z_STREAM_END)
     {
-        inflateEnd(&strm);
+        Utility::Printf(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), err);
         return NullFile;
     }
 
-    ASSERT(strm.total_out > 0, "Nothing to decompress");
+    ASSERT(Produced > 0, "Nothing to decompress");
 
-    Utility::ByteArray byteArray = make_shared<vector<byte> >( strm.total_out );
+    // Only shrinks when the trailer didn't match, which doesn't reallocate
+    Output->resize(Produced);
 
-    // Allocate actual memory for this.
-    // copy the bits into that RAM.
-    // Free everything else up!!
-    void* curDest = byteArray->data();
-    size_t remaining = byteArray->size();
+    return Output;
+}
 
-    for (size_t i = 0; i < blocks.size(); ++i)
+ByteArray Utility::DecompressChunkedFile( const wstring& fileName )
+{
+    HANDLE hFile = CreateFile2(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return NullFile;
+
+    LARGE_INTEGER FileSize = {};
+    HANDLE hMapping = nullptr;
+    if (GetFileSizeEx(hFile, &FileSize) && FileSize.QuadPart >= (LONGLONG)sizeof(ChunkedFileHeader))
+        hMapping = CreateFileMappingFromApp(hFile, nullptr, PAGE_READONLY, 0, nullptr);
+    CloseHandle(hFile);
+    if (hMapping == nullptr)
+        return NullFile;
+
+    // The view keeps the mapping alive.  Chunks are inflated straight out of it, so the compressed
+    // data is never copied.
+    const byte* FileData = (const byte*)MapViewOfFileFromApp(hMapping, FILE_MAP_READ, 0, 0);
+    CloseHandle(hMapping);
+    if (FileData == nullptr)
+        return NullFile;
+
+    const ChunkedFileHeader& Header = *(const ChunkedFileHeader*)FileData;
+    const uint64_t* ChunkOffsets = (const uint64_t*)(FileData + sizeof(ChunkedFileHeader));
+    const uint64_t TableEnd = sizeof(ChunkedFileHeader) + ((uint64_t)Header.ChunkCount + 1) * sizeof(uint64_t);
+
+    bool Valid = Header.Magic == kChunkedFileMagic && Header.Version == kChunkedFileVersion && Header.ChunkSize > 0 &&
+        Header.ChunkCount == (Header.UncompressedSize + Header.ChunkSize - 1) / Header.ChunkSize &&
+        TableEnd <= (uint64_t)FileSize.QuadPart && ChunkOffsets[Header.ChunkCount] <= (uint64_t)FileSize.QuadPart;
+
+    for (uint32_t i = 0; Valid && i < Header.ChunkCount; ++i)
+        Valid = ChunkOffsets[i] >= TableEnd && ChunkOffsets[i] <= ChunkOffsets[i + 1];
+
+    if (!Valid || Header.UncompressedSize == 0)
     {
-        ASSERT(remaining > 0);
+        Utility::Printf(L"Invalid chunked file %s\n", fileName.c_str());
+        UnmapViewOfFile(FileData);
+        return NullFile;
+    }
+
+    ByteArray Output = make_shared<vector<byte> >( (size_t)Header.UncompressedSize );
 
-        size_t CopySize = min(remaining, (size_t)ChunkSize);
+    // Every chunk is an independent zlib stream with a known place in the output
+    atomic<bool> Failed(false);
+    parallel_for(0u, Header.ChunkCount, [&](uint32_t i)
+    {
+        uint64_t Start = (uint64_t)i * Header.ChunkSize;
+        uLongf ExpectedSize = (uLongf)min<uint64_t>(Header.ChunkSize, Header.UncompressedSize - Start);
+        uLongf OutputSize = ExpectedSize;
 
-        memcpy(curDest, blocks[i].get(), CopySize);
-        curDest = (byte*)curDest + CopySize;
-        remaining -= CopySize;
+        int err = uncompress(Output->data() + Start, &OutputSize, FileData + ChunkOffsets[i], (uLong)(ChunkOffsets[i + 1] - ChunkOffsets[i]));
+        if (err != Z_OK || OutputSize != ExpectedSize)
+            Failed = true;
+    });
+
+    UnmapViewOfFile(FileData);
+
+    if (Failed)
+    {
+        Utility::Printf(L"Couldn't decompress chunked file %s\n", fileName.c_str());
+        return NullFile;
     }
 
-    inflateEnd(&strm);
+    return Output;
+}
 
-    return byteArray;
+bool Utility::WriteChunkedFile( const wstring& fileName, const vector<byte>& Data, uint32_t ChunkSize, int Level )
+{
+    ASSERT(ChunkSize > 0);
+
+    ChunkedFileHeader Header;
+    Header.Magic = kChunkedFileMagic;
+    Header.Version = kChunkedFileVersion;
+    Header.UncompressedSize = Data.size();
+    Header.ChunkSize = ChunkSize;
+    Header.ChunkCount = (uint32_t)((Data.size() + ChunkSize - 1) / ChunkSize);
+
+    vector<vector<byte> > Chunks(Header.ChunkCount);
+    atomic<bool> Failed(false);
+    parallel_for(0u, Header.ChunkCount, [&](uint32_t i)
+    {
+        size_t Start = (size_t)i * ChunkSize;
+        uLong SourceSize = (uLong)min<size_t>(ChunkSize, Data.size() - Start);
+        uLongf CompressedSize = compressBound(SourceSize);
+
+        Chunks[i].resize(CompressedSize);
+        if (compress2(Chunks[i].data(), &CompressedSize, Data.data() + Start, SourceSize, Level) != Z_OK)
+            Failed = true;
+        Chunks[i].resize(CompressedSize);
+    });
+
+    if (Failed)
+        return false;
+
+    vector<uint64_t> ChunkOffsets(Header.ChunkCount + 1);
+    ChunkOffsets[0] = sizeof(Header) + ChunkOffsets.size() * sizeof(uint64_t);
+    for (uint32_t i = 0; i < Header.ChunkCount; ++i)
+        ChunkOffsets[i + 1] = ChunkOffsets[i] + Chunks[i].size();
+
+    ofstream file( fileName, ios::out | ios::binary | ios::trunc );
+    if (!file)
+        return false;
+
+    file.write((const char*)&Header, sizeof(Header));
+    file.write((const char*)ChunkOffsets.data(), ChunkOffsets.size() * sizeof(uint64_t));
+    for (auto& Chunk : Chunks)
+        file.write((const char*)Chunk.data(), Chunk.size());
+
+    return file.good();
 }
 
-ByteArray DecompressZippedFile( wstring& fileName )
+bool Utility::MountAssetPack( const wstring& fileName, bool AllowLooseFiles )
 {
-    ByteArray CompressedFile = ReadFileHelper(fileName);
-    if (CompressedFile == NullFile)
-        return NullFile;
+    HANDLE hFile = CreateFile2(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER FileSize = {};
+    HANDLE hMapping = nullptr;
+    if (GetFileSizeEx(hFile, &FileSize) && FileSize.QuadPart >= (LONGLONG)sizeof(AssetPack::Header))
+        hMapping = CreateFileMappingFromApp(hFile, nullptr, PAGE_WRITECOPY, 0, nullptr);
+    CloseHandle(hFile);
+    if (hMapping == nullptr)
+        return false;
 
-    int error;
-    ByteArray DecompressedFile = Inflate(CompressedFile, error);
-    if (DecompressedFile->size() == 0)
+    // The view keeps the mapping alive
+    const byte* FileData = (const byte*)MapViewOfFileFromApp(hMapping, FILE_MAP_COPY, 0, 0);
+    CloseHandle(hMapping);
+    if (FileData == nullptr)
+        return false;
+
+    const uint64_t DataSize = (uint64_t)FileSize.QuadPart;
+    const AssetPack::Header& Header = *(const AssetPack::Header*)FileData;
+
+    bool Valid = Header.Magic == AssetPack::kMagic && Header.Version == AssetPack::kVersion &&
+        Header.EntryTableOffset <= DataSize && (uint64_t)Header.EntryCount * sizeof(AssetPack::Entry) <= DataSize - Header.EntryTableOffset &&
+        Header.NameTableOffset <= DataSize && Header.NameTableLength * sizeof(wchar_t) <= DataSize - Header.NameTableOffset;
+
+    // Checked once here so that lookups and reads can trust the tables
+    const AssetPack::Entry* Entries = (const AssetPack::Entry*)(FileData + Header.EntryTableOffset);
+    for (uint32_t i = 0; Valid && i < Header.EntryCount; ++i)
     {
-        Utility::Printf(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), error);
-        return NullFile;
+        const AssetPack::Entry& Entry = Entries[i];
+        Valid = (i == 0 || Entries[i - 1].NameHash <= Entry.NameHash) &&
+            Entry.Offset <= DataSize && Entry.StoredSize <= DataSize - Entry.Offset &&
+            (uint64_t)Entry.NameOffset + Entry.NameLength <= Header.NameTableLength &&
+            (Entry.Compression == AssetPack::kStored ? Entry.StoredSize == Entry.Size :
+                Entry.Compression == AssetPack::kZlib && Entry.Size <= ULONG_MAX && Entry.StoredSize <= ULONG_MAX);
+    }
+
+    if (!Valid)
+    {
+        Utility::Printf(L"Invalid asset pack %s\n", fileName.c_str());
+        UnmapViewOfFile(FileData);
+        return false;
     }
 
-    return DecompressedFile;
+    MountedPack Pack;
+    Pack.FileData = FileData;
+    Pack.Entries = Entries;
+    Pack.EntryCount = Header.EntryCount;
+    Pack.Names = (const wchar_t*)(FileData + Header.NameTableOffset);
+    Pack.AllowLooseFiles = AllowLooseFiles;
+
+    lock_guard<mutex> Guard(s_MountMutex);
+    s_MountedPacks.insert(s_MountedPacks.begin(), Pack);
+    return true;
+}
+
+void Utility::UnmountAssetPacks( void )
+{
+    lock_guard<mutex> Guard(s_MountMutex);
+    for (const MountedPack& Mounted : s_MountedPacks)
+        UnmapViewOfFile(Mounted.FileData);
+    s_MountedPacks.clear();
+}
+
+const byte* Utility::FindPackedFile( const wstring& fileName, size_t& Size )
+{
+    MountedPack Pack;
+    const AssetPack::Entry* Entry;
+    if (!FindPackEntry(fileName, Pack, Entry) || Entry->Compression != AssetPack::kStored)
+        return nullptr;
+
+    Size = (size_t)Entry->Size;
+    return Pack.FileData + Entry->Offset;
+}
+
+FileView Utility::ReadFileView( const wstring& fileName )
+{
+    MountedPack Pack;
+    const AssetPack::Entry* Entry;
+    if (FindPackEntry(fileName, Pack, Entry))
+        return ReadPackedEntry(Pack, *Entry, fileName);
+
+    ByteArray Data = SearchLooseFiles() ? ReadLooseFile(fileName) : NullFile;
+    FileView View = { Data->data(), Data->size(), Data };
+    return View;
 }
 
 ByteArray Utility::ReadFileSync( const wstring& fileName)
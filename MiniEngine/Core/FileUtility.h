@@ -26,12 +26,46 @@ namespace Utility
     typedef shared_ptr<vector<byte> > ByteArray;
     extern ByteArray NullFile;
 
-    // Reads the entire contents of a binary file.  If the file with the same name except with an additional
-    // ".gz" suffix exists, it will be loaded and decompressed instead.
-    // This operation blocks until the entire file is read.
+    // Reads the entire contents of a binary file.  Mounted asset packs are searched first.  Otherwise, if the
+    // file with the same name except with an additional ".zc" or ".gz" suffix exists, it will be loaded and
+    // decompressed instead, in that order of preference.  This operation blocks until the entire file is read.
     ByteArray ReadFileSync(const wstring& fileName);
 
     // Same as previous except that it does not block but instead returns a task.
     task<ByteArray> ReadFileAsync(const wstring& fileName);
 
+    // Inflates a gzip (or zlib) file while reading it in small pieces.  The output is sized from the gzip
+    // trailer, so the data is decompressed straight into the returned array.
+    ByteArray DecompressGzipFile(const wstring& fileName);
+
+    // Decompresses a chunked file, see WriteChunkedFile(), with its chunks spread over all cores.
+    ByteArray DecompressChunkedFile(const wstring& fileName);
+
+    // Writes the data as independently compressed zlib chunks of ChunkSize bytes, preceded by a table of
+    // their offsets.  Returns false if the file couldn't be written.
+    bool WriteChunkedFile(const wstring& fileName, const vector<byte>& Data, uint32_t ChunkSize = 0x100000, int Level = 6);
+
+    // Maps an asset pack, see AssetPack.h.  Packs are searched newest first by every read in this file, and
+    // finding a file in one never touches the file system.  Unless AllowLooseFiles is set, files that aren't
+    // in any mounted pack are reported missing without looking for them on disk either.
+    bool MountAssetPack(const wstring& fileName, bool AllowLooseFiles = false);
+
+    // Unmaps every pack.  Pointers returned by FindPackedFile() and ReadFileView() become invalid.
+    void UnmountAssetPacks();
+
+    // Returns the data of a file stored uncompressed in a mounted pack, or nullptr if it isn't packed or is
+    // compressed.  The view is copy-on-write, so the data can be patched in place by whoever loaded it.
+    const byte* FindPackedFile(const wstring& fileName, size_t& Size);
+
+    // The contents of a file, either pointing into a mounted asset pack or held by Storage
+    struct FileView
+    {
+        const byte* Data;
+        size_t Size;
+        ByteArray Storage;
+    };
+
+    // Same as ReadFileSync() except that files stored uncompressed in a pack aren't copied
+    FileView ReadFileView(const wstring& fileName);
+
 } // namespace Utility
@@ -19,6 +19,7 @@
 #include "BufferManager.h"
 #include "CommandContext.h"
 #include "PostEffects.h"
+#include "TextureManager.h"
 
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
     #pragma comment(lib, "runtimeobject.lib")
@@ -49,6 +50,7 @@ namespace GameCore
         SystemTime::Initialize();
         GameInput::Initialize();
         EngineTuning::Initialize();
+        EngineProfiling::g_Trace.SetThreadName("Main");
 
         game.Startup();
     }
@@ -63,6 +65,9 @@ namespace GameCore
     bool UpdateApplication( IGameApp& game )
     {
         EngineProfiling::Update();
+        TRACE_SCOPE("Frame");
+
+        TextureManager::PublishCompletedLoads();
 
         float DeltaTime = Graphics::GetFrameTime();
     
@@ -16,6 +16,7 @@
 #include "GraphicsCore.h"
 #include "CommandContext.h"
 #include "CommandListManager.h"
+#include "SystemTime.h"
 
 namespace
 {
@@ -28,6 +29,8 @@ namespace
     uint64_t sm_ValidTimeStart = 0;
     uint64_t sm_ValidTimeEnd = 0;
     double sm_GpuTickDelta = 0.0;
+    uint64_t sm_CalibrationGpuTick = 0;
+    uint64_t sm_CalibrationCpuTick = 0;
 }
 
 void GpuTimeManager::Initialize(uint32_t MaxNumTimers)
@@ -103,6 +106,9 @@ void GpuTimeManager::BeginReadBack(void)
     Range.End = (sm_NumTimers * 2) * sizeof(uint64_t);
     ASSERT_SUCCEEDED(sm_ReadBackBuffer->Map(0, &Range, reinterpret_cast<void**>(&sm_TimeStampBuffer)));
 
+    // Time stamps read back are from the last frame, close enough to now for the clocks not to drift apart
+    Graphics::g_CommandManager.GetCommandQueue()->GetClockCalibration(&sm_CalibrationGpuTick, &sm_CalibrationCpuTick);
+
     sm_ValidTimeStart = sm_TimeStampBuffer[0];
     sm_ValidTimeEnd = sm_TimeStampBuffer[1];
 
@@ -141,3 +147,20 @@ float GpuTimeManager::GetTime(uint32_t TimerIdx)
 
     return static_cast<float>(sm_GpuTickDelta * (TimeStamp2 - TimeStamp1));
 }
+
+bool GpuTimeManager::GetCpuTicks(uint32_t TimerIdx, int64_t& StartTick, int64_t& StopTick)
+{
+    ASSERT(sm_TimeStampBuffer != nullptr, "Time stamp readback buffer is not mapped");
+    ASSERT(TimerIdx < sm_NumTimers, "Invalid GPU timer index");
+
+    uint64_t TimeStamp1 = sm_TimeStampBuffer[TimerIdx * 2];
+    uint64_t TimeStamp2 = sm_TimeStampBuffer[TimerIdx * 2 + 1];
+
+    if (TimeStamp1 < sm_ValidTimeStart || TimeStamp2 > sm_ValidTimeEnd || TimeStamp2 <= TimeStamp1 )
+        return false;
+
+    const double CpuTicksPerGpuTick = sm_GpuTickDelta / SystemTime::TicksToSeconds(1);
+    StartTick = (int64_t)sm_CalibrationCpuTick + (int64_t)((double)(int64_t)(TimeStamp1 - sm_CalibrationGpuTick) * CpuTicksPerGpuTick);
+    StopTick = (int64_t)sm_CalibrationCpuTick + (int64_t)((double)(int64_t)(TimeStamp2 - sm_CalibrationGpuTick) * CpuTicksPerGpuTick);
+    return true;
+}
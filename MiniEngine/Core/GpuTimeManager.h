@@ -36,4 +36,8 @@ namespace GpuTimeManager
 
     // Returns the time in milliseconds between start and stop queries
     float GetTime(uint32_t TimerIdx);
+
+    // Returns the start and stop time stamps on the CPU performance counter's clock, or false
+    // if the timer didn't run in the frame read back
+    bool GetCpuTicks(uint32_t TimerIdx, int64_t& StartTick, int64_t& StopTick);
 }
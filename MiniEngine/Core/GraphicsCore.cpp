@@ -189,10 +189,10 @@ namespace Graphics
 
     DescriptorAllocator g_DescriptorAllocator[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES] =
     {
-        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-        D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
-        D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
-        D3D12_DESCRIPTOR_HEAP_TYPE_DSV,
+        { D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV },
+        { D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER },
+        { D3D12_DESCRIPTOR_HEAP_TYPE_RTV },
+        { D3D12_DESCRIPTOR_HEAP_TYPE_DSV },
     };
 
     RootSignature s_PresentRS;
@@ -451,6 +451,9 @@ void Graphics::Initialize(void)
         }
     }
 
+    // Must exist before any pipeline is finalized
+    PSO::InitializeDiskCache(L"PSOCache.bin");
+
     g_CommandManager.Create(g_Device);
 
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
@@ -68,6 +68,10 @@ namespace Graphics
     {
         return g_DescriptorAllocator[Type].Allocate(Count);
     }
+    inline DescriptorAllocation AllocateOwnedDescriptor( D3D12_DESCRIPTOR_HEAP_TYPE Type, UINT Count = 1 )
+    {
+        return g_DescriptorAllocator[Type].AllocateOwned(Count);
+    }
 
     extern RootSignature g_GenerateMipsRS;
     extern ComputePSO g_GenerateMipsLinearPSO[4];
@@ -12,30 +12,35 @@
 
 #pragma once
 
-#include "Math/Common.h"
+#include <cstddef>
+#include <cstdint>
 
 // This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
 // and AMD Bulldozer (Oct. 2011) processors.  I could put a runtime
 // check for this, but I'm just going to assume people playing with
-// DirectX 12 on Windows 10 have fairly recent machines.
-#ifdef _M_X64
+// DirectX 12 on Windows 10 have fairly recent machines.  Other compilers
+// only use it when told they may, with -msse4.2.
+#if defined(_M_X64) || (defined(__x86_64__) && defined(__SSE4_2__))
 #define ENABLE_SSE_CRC32 1
 #else
 #define ENABLE_SSE_CRC32 0
 #endif
 
 #if ENABLE_SSE_CRC32
+#include <nmmintrin.h>
+#ifdef _MSC_VER
 #pragma intrinsic(_mm_crc32_u32)
 #pragma intrinsic(_mm_crc32_u64)
 #endif
+#endif
 
 namespace Utility
 {
     inline size_t HashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
     {
 #if ENABLE_SSE_CRC32
-        const uint64_t* Iter64 = (const uint64_t*)Math::AlignUp(Begin, 8);
-        const uint64_t* const End64 = (const uint64_t* const)Math::AlignDown(End, 8);
+        const uint64_t* Iter64 = (const uint64_t*)(((size_t)Begin + 7) & ~(size_t)7);
+        const uint64_t* const End64 = (const uint64_t*)((size_t)End & ~(size_t)7);
 
         // If not 64-bit aligned, start with a single u32
         if ((uint32_t*)Iter64 > Begin)
@@ -32,26 +32,28 @@ LinearAllocatorPageManager::LinearAllocatorPageManager()
 
 LinearAllocatorPageManager LinearAllocator::sm_PageManager[2];
 
-LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
+size_t LinearAllocatorPageManager::GetPageSize( uint32_t SizeClass ) const
 {
-    lock_guard<mutex> LockGuard(m_Mutex);
+    ASSERT(SizeClass < LinearPagePool<LinearAllocationPage>::kNumSizeClasses);
+    return (size_t)(m_AllocationType == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorMinPageSize) << SizeClass;
+}
 
-    while (!m_RetiredPages.empty() && g_CommandManager.IsFenceComplete(m_RetiredPages.front().first))
-    {
-        m_AvailablePages.push(m_RetiredPages.front().second);
-        m_RetiredPages.pop();
-    }
+uint32_t LinearAllocatorPageManager::GetInitialSizeClass( void ) const
+{
+    return m_AllocationType == kGpuExclusive ? 0 : Math::Log2(kCpuAllocatorPageSize / kCpuAllocatorMinPageSize);
+}
 
-    LinearAllocationPage* PagePtr = nullptr;
+LinearAllocationPage* LinearAllocatorPageManager::RequestPage( uint32_t SizeClass )
+{
+    LinearAllocationPage* PagePtr = m_RecycledPages.RequestPage(SizeClass,
+        [](uint64_t FenceValue) { return g_CommandManager.IsFenceComplete(FenceValue); });
 
-    if (!m_AvailablePages.empty())
-    {
-        PagePtr = m_AvailablePages.front();
-        m_AvailablePages.pop();
-    }
-    else
+    if (PagePtr == nullptr)
     {
-        PagePtr = CreateNewPage();
+        PagePtr = CreateNewPage(GetPageSize(SizeClass));
+        PagePtr->m_SizeClass = SizeClass;
+
+        lock_guard<mutex> LockGuard(m_Mutex);
         m_PagePool.emplace_back(PagePtr);
     }
 
@@ -59,10 +61,15 @@ LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
 }
 
 void LinearAllocatorPageManager::DiscardPages( uint64_t FenceValue, const vector<LinearAllocationPage*>& UsedPages )
+{
+    m_RecycledPages.RetirePages(FenceValue, UsedPages.data(), UsedPages.size());
+}
+
+void LinearAllocatorPageManager::Destroy( void )
 {
     lock_guard<mutex> LockGuard(m_Mutex);
-    for (auto iter = UsedPages.begin(); iter != UsedPages.end(); ++iter)
-        m_RetiredPages.push(make_pair(FenceValue, *iter));
+    m_RecycledPages.Reset();
+    m_PagePool.clear();
 }
 
 void LinearAllocatorPageManager::FreeLargePages( uint64_t FenceValue, const vector<LinearAllocationPage*>& LargePages )
@@ -139,6 +146,9 @@ void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
     sm_PageManager[m_AllocationType].DiscardPages(FenceID, m_RetiredPages);
     m_RetiredPages.clear();
 
+    SetSizeClass(LinearPagePool<LinearAllocationPage>::AdaptSizeClass(m_SizeClass, m_PageSize, m_BytesUsed, m_SmallCount));
+    m_BytesUsed = 0;
+
     sm_PageManager[m_AllocationType].FreeLargePages(FenceID, m_LargePageList);
     m_LargePageList.clear();
 }
@@ -155,6 +165,14 @@ DynAlloc LinearAllocator::AllocateLargePage(size_t SizeInBytes)
     return ret;
 }
 
+void LinearAllocator::SetSizeClass( uint32_t SizeClass )
+{
+    // The current page must have been retired, its size no longer matches
+    ASSERT(SizeClass == m_SizeClass || m_CurPage == nullptr);
+    m_SizeClass = SizeClass;
+    m_PageSize = sm_PageManager[m_AllocationType].GetPageSize(SizeClass);
+}
+
 DynAlloc LinearAllocator::Allocate(size_t SizeInBytes, size_t Alignment)
 {
     const size_t AlignmentMask = Alignment - 1;
@@ -166,7 +184,24 @@ DynAlloc LinearAllocator::Allocate(size_t SizeInBytes, size_t Alignment)
     const size_t AlignedSize = Math::AlignUpWithMask(SizeInBytes, AlignmentMask);
 
     if (AlignedSize > m_PageSize)
-        return AllocateLargePage(AlignedSize);
+    {
+        const uint32_t LargestSizeClass = LinearPagePool<LinearAllocationPage>::kNumSizeClasses - 1;
+        if (AlignedSize > sm_PageManager[m_AllocationType].GetPageSize(LargestSizeClass))
+            return AllocateLargePage(AlignedSize);
+
+        // Switch to the smallest pages it fits in, the current page is too small anyway
+        if (m_CurPage != nullptr)
+        {
+            m_RetiredPages.push_back(m_CurPage);
+            m_CurPage = nullptr;
+            m_CurOffset = 0;
+        }
+
+        uint32_t SizeClass = m_SizeClass;
+        while (sm_PageManager[m_AllocationType].GetPageSize(SizeClass) < AlignedSize)
+            ++SizeClass;
+        SetSizeClass(SizeClass);
+    }
 
     m_CurOffset = Math::AlignUp(m_CurOffset, Alignment);
 
@@ -179,7 +214,7 @@ DynAlloc LinearAllocator::Allocate(size_t SizeInBytes, size_t Alignment)
 
     if (m_CurPage == nullptr)
     {
-        m_CurPage = sm_PageManager[m_AllocationType].RequestPage();
+        m_CurPage = sm_PageManager[m_AllocationType].RequestPage(m_SizeClass);
         m_CurOffset = 0;
     }
 
@@ -188,6 +223,7 @@ DynAlloc LinearAllocator::Allocate(size_t SizeInBytes, size_t Alignment)
     ret.GpuAddress = m_CurPage->m_GpuVirtualAddress + m_CurOffset;
 
     m_CurOffset += AlignedSize;
+    m_BytesUsed += AlignedSize;
 
     return ret;
 }
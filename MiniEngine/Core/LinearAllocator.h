@@ -13,16 +13,20 @@
 // Description:  This is a dynamic graphics memory allocator for DX12.  It's designed to work in concert
 // with the CommandContext class and to do so in a thread-safe manner.  There may be many command contexts,
 // each with its own linear allocators.  They act as windows into a global memory pool by reserving a
-// context-local memory page.  Requesting a new page is done in a thread-safe manner by guarding accesses
-// with a mutex lock.
+// context-local memory page.  Requesting a new page takes no lock unless no page is ready for reuse, see
+// LinearPagePool.
 //
 // When a command context is finished, it will receive a fence ID that indicates when it's safe to reclaim
 // used resources.  The CleanupUsedPages() method must be invoked at this time so that the used pages can be
 // scheduled for reuse after the fence has cleared.
+//
+// Page sizes follow what each allocator uses.  A context that needed more than one page for a command list
+// gets pages twice as large for the next, and one that keeps using a fraction of a page gets smaller ones.
 
 #pragma once
 
 #include "GpuResource.h"
+#include "LinearPagePool.h"
 #include <vector>
 #include <queue>
 #include <mutex>
@@ -46,7 +50,7 @@ struct DynAlloc
 class LinearAllocationPage : public GpuResource
 {
 public:
-    LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource()
+    LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource(), m_NextAvailable(nullptr), m_SizeClass(0)
     {
         m_pResource.Attach(pResource);
         m_UsageState = Usage;
@@ -78,6 +82,10 @@ public:
 
     void* m_CpuVirtualAddress;
     D3D12_GPU_VIRTUAL_ADDRESS m_GpuVirtualAddress;
+
+    // Used by LinearPagePool
+    std::atomic<LinearAllocationPage*> m_NextAvailable;
+    uint32_t m_SizeClass;
 };
 
 enum LinearAllocatorType
@@ -92,8 +100,9 @@ enum LinearAllocatorType
 
 enum
 {
-    kGpuAllocatorPageSize = 0x10000,	// 64K
-    kCpuAllocatorPageSize = 0x200000	// 2MB
+    kGpuAllocatorPageSize = 0x10000,	// 64K, the initial and smallest size
+    kCpuAllocatorPageSize = 0x200000,	// 2MB, the initial size
+    kCpuAllocatorMinPageSize = 0x40000	// 256K
 };
 
 class LinearAllocatorPageManager
@@ -101,27 +110,30 @@ class LinearAllocatorPageManager
 public:
 
     LinearAllocatorPageManager();
-    LinearAllocationPage* RequestPage( void );
+    LinearAllocationPage* RequestPage( uint32_t SizeClass );
     LinearAllocationPage* CreateNewPage( size_t PageSize = 0 );
 
-    // Discarded pages will get recycled.  This is for fixed size pages.
+    // Pages of size class N are twice the size of those of class N - 1
+    size_t GetPageSize( uint32_t SizeClass ) const;
+    uint32_t GetInitialSizeClass( void ) const;
+
+    // Discarded pages will get recycled.  This is for pages from RequestPage().
     void DiscardPages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
 
     // Freed pages will be destroyed once their fence has passed.  This is for single-use,
     // "large" pages.
     void FreeLargePages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
 
-    void Destroy( void ) { m_PagePool.clear(); }
+    void Destroy( void );
 
 private:
 
     static LinearAllocatorType sm_AutoType;
 
     LinearAllocatorType m_AllocationType;
+    LinearPagePool<LinearAllocationPage> m_RecycledPages;
     std::vector<std::unique_ptr<LinearAllocationPage> > m_PagePool;
-    std::queue<std::pair<uint64_t, LinearAllocationPage*> > m_RetiredPages;
     std::queue<std::pair<uint64_t, LinearAllocationPage*> > m_DeletionQueue;
-    std::queue<LinearAllocationPage*> m_AvailablePages;
     std::mutex m_Mutex;
 };
 
@@ -129,10 +141,12 @@ class LinearAllocator
 {
 public:
 
-    LinearAllocator(LinearAllocatorType Type) : m_AllocationType(Type), m_PageSize(0), m_CurOffset(~(size_t)0), m_CurPage(nullptr)
+    LinearAllocator(LinearAllocatorType Type) : m_AllocationType(Type), m_PageSize(0), m_CurOffset(~(size_t)0), m_CurPage(nullptr),
+        m_BytesUsed(0), m_SmallCount(0)
     {
         ASSERT(Type > kInvalidAllocator && Type < kNumAllocatorTypes);
-        m_PageSize = (Type == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorPageSize);
+        m_SizeClass = sm_PageManager[Type].GetInitialSizeClass();
+        m_PageSize = sm_PageManager[Type].GetPageSize(m_SizeClass);
     }
 
     DynAlloc Allocate( size_t SizeInBytes, size_t Alignment = DEFAULT_ALIGN );
@@ -148,13 +162,17 @@ public:
 private:
 
     DynAlloc AllocateLargePage( size_t SizeInBytes );
+    void SetSizeClass( uint32_t SizeClass );
 
     static LinearAllocatorPageManager sm_PageManager[2];
 
     LinearAllocatorType m_AllocationType;
-    size_t m_PageSize;
+    uint32_t m_SizeClass;
+    size_t m_PageSize;          // Of m_SizeClass, and of m_CurPage
     size_t m_CurOffset;
     LinearAllocationPage* m_CurPage;
+    size_t m_BytesUsed;         // In pages since the last CleanupUsedPages()
+    uint32_t m_SmallCount;
     std::vector<LinearAllocationPage*> m_RetiredPages;
     std::vector<LinearAllocationPage*> m_LargePageList;
 };
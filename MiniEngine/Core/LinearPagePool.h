@@ -0,0 +1,356 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+//
+// The recycling half of the linear allocator page manager.  It knows nothing about pages other
+// than two members, std::atomic<Page*> m_NextAvailable and uint32_t m_SizeClass, and nothing about
+// fences other than a function that says whether one has completed, so it runs without a device.
+//
+// Pages that are ready for reuse sit on a lock-free stack per size class.  The stack head packs
+// the address of the top page with a count of changes in the upper 16 bits, so a pop can't be
+// fooled by the top page leaving and coming back in between.  Retired pages wait in batches
+// per fence and are only looked at when a request finds its stack empty.  Every batch whose fence
+// has completed then goes back at once, and the thread doing it keeps a few pages of each size
+// for itself in a per-thread cache that it takes from before touching the shared stacks.  A
+// thread's cache goes back to the shared stacks when the thread exits, and is emptied when the
+// pool is reset or destroyed.
+//
+// RequestPage() returns null when no page is ready, and the caller creates one of that size class.
+// Pages remain owned by the caller, the pool only links them together.
+//
+template <typename Page>
+class LinearPagePool
+{
+public:
+
+    static const uint32_t kNumSizeClasses = 5;
+
+    LinearPagePool() { Reset(); }
+
+    ~LinearPagePool()
+    {
+        // Threads that outlive the pool must not flush into it
+        std::lock_guard<std::mutex> CacheGuard(sm_CacheMutex);
+        for (ThreadCache* Cache : m_ThreadCaches)
+            Cache->Detach();
+        m_ThreadCaches.clear();
+    }
+
+    // Forgets every page, including those in thread caches.  Not safe while other threads use the pool.
+    void Reset( void )
+    {
+        for (uint32_t SizeClass = 0; SizeClass < kNumSizeClasses; ++SizeClass)
+            m_Available[SizeClass] = 0;
+
+        {
+            std::lock_guard<std::mutex> CacheGuard(sm_CacheMutex);
+            for (ThreadCache* Cache : m_ThreadCaches)
+                Cache->Clear();
+        }
+
+        std::lock_guard<std::mutex> LockGuard(m_RetiredMutex);
+        m_RetiredBatches.clear();
+    }
+
+    // IsFenceComplete is called as bool(uint64_t FenceValue), only if the stack of the size class is empty
+    template <typename FenceTest>
+    Page* RequestPage( uint32_t SizeClass, const FenceTest& IsFenceComplete )
+    {
+        ThreadCache* Cache = GetThreadCache();
+        if (Cache != nullptr && Cache->Count[SizeClass] > 0)
+            return Cache->Pages[SizeClass][--Cache->Count[SizeClass]];
+
+        Page* Result = Pop(SizeClass);
+        if (Result != nullptr)
+            return Result;
+
+        std::lock_guard<std::mutex> LockGuard(m_RetiredMutex);
+
+        // Whoever held the lock may have just reclaimed pages of this size
+        Result = Pop(SizeClass);
+        if (Result != nullptr)
+            return Result;
+
+        ReclaimLocked(IsFenceComplete, Cache);
+
+        if (Cache != nullptr && Cache->Count[SizeClass] > 0)
+            return Cache->Pages[SizeClass][--Cache->Count[SizeClass]];
+        return Pop(SizeClass);
+    }
+
+    // The pages may be reused once FenceValue has completed
+    void RetirePages( uint64_t FenceValue, Page* const* Pages, size_t Count )
+    {
+        if (Count == 0)
+            return;
+
+        for (size_t i = 0; i + 1 < Count; ++i)
+            Pages[i]->m_NextAvailable.store(Pages[i + 1], std::memory_order_relaxed);
+        Pages[Count - 1]->m_NextAvailable.store(nullptr, std::memory_order_relaxed);
+
+        RetiredBatch Batch = { FenceValue, Pages[0] };
+
+        std::lock_guard<std::mutex> LockGuard(m_RetiredMutex);
+        m_RetiredBatches.push_back(Batch);
+    }
+
+    // Makes the pages of every completed fence available now rather than on the next empty stack.
+    // Returns the number of pages reclaimed.
+    template <typename FenceTest>
+    size_t ReclaimPages( const FenceTest& IsFenceComplete )
+    {
+        std::lock_guard<std::mutex> LockGuard(m_RetiredMutex);
+        return ReclaimLocked(IsFenceComplete, nullptr);
+    }
+
+    size_t GetRetiredBatchCount( void )
+    {
+        std::lock_guard<std::mutex> LockGuard(m_RetiredMutex);
+        return m_RetiredBatches.size();
+    }
+
+    // Picks the size class of the pages for a context's next command list from how much the last
+    // one allocated.  Pages grow as soon as one wasn't enough, and shrink after kShrinkAfter command
+    // lists in a row used less than a quarter of one.
+    static const uint32_t kShrinkAfter = 16;
+
+    static uint32_t AdaptSizeClass( uint32_t SizeClass, size_t PageSize, size_t BytesUsed, uint32_t& SmallCount )
+    {
+        if (BytesUsed > PageSize)
+        {
+            SmallCount = 0;
+            return SizeClass + 1 < kNumSizeClasses ? SizeClass + 1 : SizeClass;
+        }
+
+        if (BytesUsed >= PageSize / 4)
+        {
+            SmallCount = 0;
+            return SizeClass;
+        }
+
+        if (++SmallCount < kShrinkAfter)
+            return SizeClass;
+
+        SmallCount = 0;
+        return SizeClass > 0 ? SizeClass - 1 : 0;
+    }
+
+private:
+
+    static const uint32_t kThreadCacheSize = 4;     // Pages per size class
+    static const uint32_t kThreadCacheSlots = 4;    // Pools a thread can cache pages of at once
+
+    static const uint64_t kAddressMask = (1ull << 48) - 1;
+    static const uint64_t kTagIncrement = 1ull << 48;
+
+    static_assert(sizeof(void*) == sizeof(uint64_t), "the stack heads pack 48-bit addresses with a tag");
+
+    struct RetiredBatch
+    {
+        uint64_t FenceValue;
+        Page* First;        // Linked through m_NextAvailable
+    };
+
+    // Owner is only changed with sm_CacheMutex held, and is read without it only by the cache's own thread
+    struct ThreadCache
+    {
+        LinearPagePool* Owner;
+        uint32_t Count[kNumSizeClasses];
+        Page* Pages[kNumSizeClasses][kThreadCacheSize];
+
+        ~ThreadCache()
+        {
+            std::lock_guard<std::mutex> CacheGuard(sm_CacheMutex);
+            if (Owner != nullptr)
+            {
+                Owner->FlushThreadCache(*this);
+                Owner->UnregisterThreadCache(this);
+            }
+        }
+
+        bool IsEmpty( void ) const
+        {
+            for (uint32_t SizeClass = 0; SizeClass < kNumSizeClasses; ++SizeClass)
+            {
+                if (Count[SizeClass] > 0)
+                    return false;
+            }
+            return true;
+        }
+
+        void Clear( void )
+        {
+            for (uint32_t SizeClass = 0; SizeClass < kNumSizeClasses; ++SizeClass)
+                Count[SizeClass] = 0;
+        }
+
+        void Detach( void )
+        {
+            Owner = nullptr;
+            Clear();
+        }
+    };
+
+    static Page* Unpack( uint64_t Head ) { return (Page*)(uintptr_t)(Head & kAddressMask); }
+
+    // The new head bumps the tag of the one it replaces
+    static uint64_t Pack( Page* Top, uint64_t PreviousHead )
+    {
+        return (uint64_t)(uintptr_t)Top | ((PreviousHead & ~kAddressMask) + kTagIncrement);
+    }
+
+    Page* Pop( uint32_t SizeClass )
+    {
+        std::atomic<uint64_t>& Stack = m_Available[SizeClass];
+        uint64_t Head = Stack.load(std::memory_order_acquire);
+        for (;;)
+        {
+            Page* Top = Unpack(Head);
+            if (Top == nullptr)
+                return nullptr;
+
+            // Top may be popped and pushed again meanwhile, the tag then fails the exchange
+            Page* Next = Top->m_NextAvailable.load(std::memory_order_relaxed);
+            if (Stack.compare_exchange_weak(Head, Pack(Next, Head), std::memory_order_acquire, std::memory_order_acquire))
+                return Top;
+        }
+    }
+
+    void PushChain( uint32_t SizeClass, Page* First, Page* Last )
+    {
+        std::atomic<uint64_t>& Stack = m_Available[SizeClass];
+        uint64_t Head = Stack.load(std::memory_order_relaxed);
+        do
+        {
+            Last->m_NextAvailable.store(Unpack(Head), std::memory_order_relaxed);
+        }
+        while (!Stack.compare_exchange_weak(Head, Pack(First, Head), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Each pool a thread has cached pages of holds a slot, which is registered with the pool so the
+    // pool can empty it on reset and detach it when destroyed
+    ThreadCache* GetThreadCache( void )
+    {
+        thread_local ThreadCache t_Caches[kThreadCacheSlots];
+
+        ThreadCache* Unused = nullptr;
+        for (ThreadCache& Cache : t_Caches)
+        {
+            if (Cache.Owner == this)
+                return &Cache;
+
+            if (Unused == nullptr && Cache.IsEmpty())
+                Unused = &Cache;
+        }
+
+        // A thread using more pools than there are slots goes to the shared stacks for the rest
+        if (Unused != nullptr)
+        {
+            std::lock_guard<std::mutex> CacheGuard(sm_CacheMutex);
+            if (Unused->Owner != nullptr)
+                Unused->Owner->UnregisterThreadCache(Unused);
+            Unused->Owner = this;
+            Unused->Clear();
+            m_ThreadCaches.push_back(Unused);
+        }
+        return Unused;
+    }
+
+    // Both require sm_CacheMutex
+    void UnregisterThreadCache( ThreadCache* Cache )
+    {
+        m_ThreadCaches.erase(std::find(m_ThreadCaches.begin(), m_ThreadCaches.end(), Cache));
+    }
+
+    void FlushThreadCache( ThreadCache& Cache )
+    {
+        for (uint32_t SizeClass = 0; SizeClass < kNumSizeClasses; ++SizeClass)
+        {
+            const uint32_t Count = Cache.Count[SizeClass];
+            if (Count == 0)
+                continue;
+
+            Page* const* Pages = Cache.Pages[SizeClass];
+            for (uint32_t i = 0; i + 1 < Count; ++i)
+                Pages[i]->m_NextAvailable.store(Pages[i + 1], std::memory_order_relaxed);
+            PushChain(SizeClass, Pages[0], Pages[Count - 1]);
+        }
+        Cache.Clear();
+    }
+
+    // Requires m_RetiredMutex.  Batches aren't necessarily retired in fence order, nor are their
+    // fences necessarily of the same queue, so all of them are checked.
+    template <typename FenceTest>
+    size_t ReclaimLocked( const FenceTest& IsFenceComplete, ThreadCache* Cache )
+    {
+        Page* First[kNumSizeClasses] = {};
+        Page* Last[kNumSizeClasses] = {};
+        size_t Reclaimed = 0;
+
+        size_t Kept = 0;
+        for (size_t i = 0; i < m_RetiredBatches.size(); ++i)
+        {
+            if (!IsFenceComplete(m_RetiredBatches[i].FenceValue))
+            {
+                m_RetiredBatches[Kept++] = m_RetiredBatches[i];
+                continue;
+            }
+
+            for (Page* Next = m_RetiredBatches[i].First; Next != nullptr; ++Reclaimed)
+            {
+                Page* Reused = Next;
+                Next = Reused->m_NextAvailable.load(std::memory_order_relaxed);
+
+                const uint32_t SizeClass = Reused->m_SizeClass;
+                if (Cache != nullptr && Cache->Count[SizeClass] < kThreadCacheSize)
+                {
+                    Cache->Pages[SizeClass][Cache->Count[SizeClass]++] = Reused;
+                    continue;
+                }
+
+                Reused->m_NextAvailable.store(First[SizeClass], std::memory_order_relaxed);
+                First[SizeClass] = Reused;
+                if (Last[SizeClass] == nullptr)
+                    Last[SizeClass] = Reused;
+            }
+        }
+        m_RetiredBatches.resize(Kept);
+
+        for (uint32_t SizeClass = 0; SizeClass < kNumSizeClasses; ++SizeClass)
+        {
+            if (First[SizeClass] != nullptr)
+                PushChain(SizeClass, First[SizeClass], Last[SizeClass]);
+        }
+
+        return Reclaimed;
+    }
+
+    static std::mutex sm_CacheMutex;
+
+    std::atomic<uint64_t> m_Available[kNumSizeClasses];
+
+    std::mutex m_RetiredMutex;
+    std::vector<RetiredBatch> m_RetiredBatches;
+
+    std::vector<ThreadCache*> m_ThreadCaches;     // Guarded by sm_CacheMutex
+};
+
+template <typename Page>
+std::mutex LinearPagePool<Page>::sm_CacheMutex;
@@ -0,0 +1,509 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#include "pch.h"
+#include "BatchTransform.h"
+#include "CpuFeatures.h"
+
+// The AVX-512 intrinsics arrived with Visual Studio 2017 15.3.  Older compilers use the AVX2 kernels.
+#if !defined(_MSC_VER) || _MSC_VER >= 1911
+#define BATCH_TRANSFORM_AVX512
+#endif
+
+using namespace Math;
+
+namespace
+{
+    BatchTransformKernel ResolveKernel( BatchTransformKernel Kernel )
+    {
+        const CpuFeatures& Features = GetCpuFeatures();
+
+        if (Kernel == kTransformAuto)
+            Kernel = kTransformAVX512;
+#ifdef BATCH_TRANSFORM_AVX512
+        if (Kernel == kTransformAVX512 && !Features.AVX512)
+            Kernel = kTransformAVX2;
+#else
+        if (Kernel == kTransformAVX512)
+            Kernel = kTransformAVX2;
+#endif
+        if (Kernel == kTransformAVX2 && !Features.AVX2)
+            Kernel = kTransformSSE;
+        return Kernel;
+    }
+
+    // The kernels are written once against these.  ScalarLanes finishes the elements left over after the
+    // last full vector.
+
+    struct ScalarLanes
+    {
+        typedef float Vec;
+        enum { Width = 1 };
+
+        static Vec Load( const float* Src ) { return *Src; }
+        static void Store( float* Dst, Vec V ) { *Dst = V; }
+        static Vec Splat( float F ) { return F; }
+        static Vec Add( Vec A, Vec B ) { return A + B; }
+        static Vec Mul( Vec A, Vec B ) { return A * B; }
+        static Vec MulAdd( Vec A, Vec B, Vec C ) { return A * B + C; }
+        static Vec Div( Vec A, Vec B ) { return A / B; }
+        static Vec Sqrt( Vec A ) { return sqrtf(A); }
+        static Vec ZeroWhereZero( Vec V, Vec Test ) { return Test != 0.0f ? V : 0.0f; }
+    };
+
+    struct SSELanes
+    {
+        typedef __m128 Vec;
+        enum { Width = 4 };
+
+        static Vec Load( const float* Src ) { return _mm_loadu_ps(Src); }
+        static void Store( float* Dst, Vec V ) { _mm_storeu_ps(Dst, V); }
+        static Vec Splat( float F ) { return _mm_set1_ps(F); }
+        static Vec Add( Vec A, Vec B ) { return _mm_add_ps(A, B); }
+        static Vec Mul( Vec A, Vec B ) { return _mm_mul_ps(A, B); }
+        static Vec MulAdd( Vec A, Vec B, Vec C ) { return _mm_add_ps(_mm_mul_ps(A, B), C); }
+        static Vec Div( Vec A, Vec B ) { return _mm_div_ps(A, B); }
+        static Vec Sqrt( Vec A ) { return _mm_sqrt_ps(A); }
+        static Vec ZeroWhereZero( Vec V, Vec Test ) { return _mm_and_ps(V, _mm_cmpneq_ps(Test, _mm_setzero_ps())); }
+    };
+
+    struct AVX2Lanes
+    {
+        typedef __m256 Vec;
+        enum { Width = 8 };
+
+        static Vec Load( const float* Src ) { return _mm256_loadu_ps(Src); }
+        static void Store( float* Dst, Vec V ) { _mm256_storeu_ps(Dst, V); }
+        static Vec Splat( float F ) { return _mm256_set1_ps(F); }
+        static Vec Add( Vec A, Vec B ) { return _mm256_add_ps(A, B); }
+        static Vec Mul( Vec A, Vec B ) { return _mm256_mul_ps(A, B); }
+        static Vec MulAdd( Vec A, Vec B, Vec C ) { return _mm256_fmadd_ps(A, B, C); }
+        static Vec Div( Vec A, Vec B ) { return _mm256_div_ps(A, B); }
+        static Vec Sqrt( Vec A ) { return _mm256_sqrt_ps(A); }
+        static Vec ZeroWhereZero( Vec V, Vec Test ) { return _mm256_and_ps(V, _mm256_cmp_ps(Test, _mm256_setzero_ps(), _CMP_NEQ_UQ)); }
+    };
+
+#ifdef BATCH_TRANSFORM_AVX512
+    struct AVX512Lanes
+    {
+        typedef __m512 Vec;
+        enum { Width = 16 };
+
+        static Vec Load( const float* Src ) { return _mm512_loadu_ps(Src); }
+        static void Store( float* Dst, Vec V ) { _mm512_storeu_ps(Dst, V); }
+        static Vec Splat( float F ) { return _mm512_set1_ps(F); }
+        static Vec Add( Vec A, Vec B ) { return _mm512_add_ps(A, B); }
+        static Vec Mul( Vec A, Vec B ) { return _mm512_mul_ps(A, B); }
+        static Vec MulAdd( Vec A, Vec B, Vec C ) { return _mm512_fmadd_ps(A, B, C); }
+        static Vec Div( Vec A, Vec B ) { return _mm512_div_ps(A, B); }
+        static Vec Sqrt( Vec A ) { return _mm512_sqrt_ps(A); }
+        static Vec ZeroWhereZero( Vec V, Vec Test ) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(Test, _mm512_setzero_ps(), _CMP_NEQ_UQ), V); }
+    };
+#endif
+
+    // The rows of an affine matrix, Rows[3] being the translation.  A point transforms to
+    // x * Rows[0] + y * Rows[1] + z * Rows[2] + Rows[3], the same as the Vector3 operators.
+    struct AffineRows
+    {
+        float Rows[4][3];
+
+        explicit AffineRows( const float* Mat )
+        {
+            for (int r = 0; r < 4; ++r)
+                for (int c = 0; c < 3; ++c)
+                    Rows[r][c] = Mat[r * 4 + c];
+        }
+    };
+
+    // Each kernel returns the index it stopped at, which is where the next narrower one carries on.
+    // Every vector of the sources is loaded before any is stored so that transforming in place works.
+
+    template <typename Lanes>
+    uint32_t TransformPointRange( const AffineRows& M, const Vector3Streams& Src, const Vector3Streams& Dst, uint32_t i, uint32_t End )
+    {
+        typedef typename Lanes::Vec Vec;
+
+        Vec R[4][3];
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 3; ++c)
+                R[r][c] = Lanes::Splat(M.Rows[r][c]);
+
+        for (; i + Lanes::Width <= End; i += Lanes::Width)
+        {
+            const Vec X = Lanes::Load(Src.X + i);
+            const Vec Y = Lanes::Load(Src.Y + i);
+            const Vec Z = Lanes::Load(Src.Z + i);
+
+            // z first, then y, then x, which is how XMVector3Transform rounds
+            Lanes::Store(Dst.X + i, Lanes::MulAdd(X, R[0][0], Lanes::MulAdd(Y, R[1][0], Lanes::MulAdd(Z, R[2][0], R[3][0]))));
+            Lanes::Store(Dst.Y + i, Lanes::MulAdd(X, R[0][1], Lanes::MulAdd(Y, R[1][1], Lanes::MulAdd(Z, R[2][1], R[3][1]))));
+            Lanes::Store(Dst.Z + i, Lanes::MulAdd(X, R[0][2], Lanes::MulAdd(Y, R[1][2], Lanes::MulAdd(Z, R[2][2], R[3][2]))));
+        }
+        return i;
+    }
+
+    template <typename Lanes>
+    uint32_t TransformNormalRange( const AffineRows& M, const Vector3Streams& Src, const Vector3Streams& Dst, uint32_t i, uint32_t End )
+    {
+        typedef typename Lanes::Vec Vec;
+
+        Vec R[3][3];
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c)
+                R[r][c] = Lanes::Splat(M.Rows[r][c]);
+
+        for (; i + Lanes::Width <= End; i += Lanes::Width)
+        {
+            const Vec X = Lanes::Load(Src.X + i);
+            const Vec Y = Lanes::Load(Src.Y + i);
+            const Vec Z = Lanes::Load(Src.Z + i);
+
+            const Vec NX = Lanes::MulAdd(X, R[0][0], Lanes::MulAdd(Y, R[1][0], Lanes::Mul(Z, R[2][0])));
+            const Vec NY = Lanes::MulAdd(X, R[0][1], Lanes::MulAdd(Y, R[1][1], Lanes::Mul(Z, R[2][1])));
+            const Vec NZ = Lanes::MulAdd(X, R[0][2], Lanes::MulAdd(Y, R[1][2], Lanes::Mul(Z, R[2][2])));
+
+            const Vec Length = Lanes::Sqrt(Lanes::Add(Lanes::Add(Lanes::Mul(NX, NX), Lanes::Mul(NY, NY)), Lanes::Mul(NZ, NZ)));
+            Lanes::Store(Dst.X + i, Lanes::ZeroWhereZero(Lanes::Div(NX, Length), Length));
+            Lanes::Store(Dst.Y + i, Lanes::ZeroWhereZero(Lanes::Div(NY, Length), Length));
+            Lanes::Store(Dst.Z + i, Lanes::ZeroWhereZero(Lanes::Div(NZ, Length), Length));
+        }
+        return i;
+    }
+
+    // Arvo's method adds min(a * min, a * max) to the new minimum for every matrix element a, and the max of
+    // the two to the new maximum.  Which bound gives the smaller product only depends on the sign of a, so
+    // that is decided once up front: Select[out][in] is the stream (0-2 for min, 3-5 for max) that the
+    // new minimum takes, and the new maximum takes the other one.
+    struct ArvoSelect
+    {
+        int Select[3][3];
+
+        explicit ArvoSelect( const AffineRows& M )
+        {
+            for (int Out = 0; Out < 3; ++Out)
+                for (int In = 0; In < 3; ++In)
+                    Select[Out][In] = M.Rows[In][Out] < 0.0f ? In + 3 : In;
+        }
+    };
+
+    template <typename Lanes>
+    uint32_t TransformBoxRange( const AffineRows& M, const ArvoSelect& S, const BoundingBoxStreams& Src, const BoundingBoxStreams& Dst,
+        uint32_t i, uint32_t End )
+    {
+        typedef typename Lanes::Vec Vec;
+
+        Vec R[4][3];
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 3; ++c)
+                R[r][c] = Lanes::Splat(M.Rows[r][c]);
+
+        const float* SrcStreams[] = { Src.MinX, Src.MinY, Src.MinZ, Src.MaxX, Src.MaxY, Src.MaxZ };
+        float* DstStreams[] = { Dst.MinX, Dst.MinY, Dst.MinZ, Dst.MaxX, Dst.MaxY, Dst.MaxZ };
+
+        for (; i + Lanes::Width <= End; i += Lanes::Width)
+        {
+            Vec Bounds[6];
+            for (int s = 0; s < 6; ++s)
+                Bounds[s] = Lanes::Load(SrcStreams[s] + i);
+
+            Vec NewBounds[6];
+            for (int Out = 0; Out < 3; ++Out)
+            {
+                const int* Sel = S.Select[Out];
+                NewBounds[Out] = Lanes::MulAdd(R[2][Out], Bounds[Sel[2]], Lanes::MulAdd(R[1][Out], Bounds[Sel[1]],
+                    Lanes::MulAdd(R[0][Out], Bounds[Sel[0]], R[3][Out])));
+                NewBounds[Out + 3] = Lanes::MulAdd(R[2][Out], Bounds[(Sel[2] + 3) % 6], Lanes::MulAdd(R[1][Out], Bounds[(Sel[1] + 3) % 6],
+                    Lanes::MulAdd(R[0][Out], Bounds[(Sel[0] + 3) % 6], R[3][Out])));
+            }
+
+            for (int s = 0; s < 6; ++s)
+                Lanes::Store(DstStreams[s] + i, NewBounds[s]);
+        }
+        return i;
+    }
+
+    // With row vectors, row j of Left * Right is the sum over k of Right[j][k] * Left row k, so every row of
+    // Left is broadcast and every element of Right is splatted across its row.  Prepare() loads the Left
+    // rows once when they are shared by every product.
+
+    struct SSEMatrixMultiply
+    {
+        struct Prepared { __m128 L[4]; };
+
+        static Prepared Prepare( const float* Left )
+        {
+            Prepared P;
+            for (int k = 0; k < 4; ++k)
+                P.L[k] = _mm_loadu_ps(Left + 4 * k);
+            return P;
+        }
+
+        static void Multiply( const Prepared& P, const float* Right, float* Dst )
+        {
+            __m128 Rows[4];
+            for (int j = 0; j < 4; ++j)
+            {
+                const __m128 R = _mm_loadu_ps(Right + 4 * j);
+                Rows[j] = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(R, R, _MM_SHUFFLE(0, 0, 0, 0)), P.L[0]), _mm_mul_ps(_mm_shuffle_ps(R, R, _MM_SHUFFLE(1, 1, 1, 1)), P.L[1])),
+                    _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(R, R, _MM_SHUFFLE(2, 2, 2, 2)), P.L[2]), _mm_mul_ps(_mm_shuffle_ps(R, R, _MM_SHUFFLE(3, 3, 3, 3)), P.L[3])));
+            }
+            for (int j = 0; j < 4; ++j)
+                _mm_storeu_ps(Dst + 4 * j, Rows[j]);
+        }
+    };
+
+    // Two rows per register
+    struct AVX2MatrixMultiply
+    {
+        struct Prepared { __m256 L[4]; };
+
+        static Prepared Prepare( const float* Left )
+        {
+            Prepared P;
+            for (int k = 0; k < 4; ++k)
+                P.L[k] = _mm256_broadcast_ps((const __m128*)(Left + 4 * k));
+            return P;
+        }
+
+        static void Multiply( const Prepared& P, const float* Right, float* Dst )
+        {
+            const __m256 R01 = _mm256_loadu_ps(Right);
+            const __m256 R23 = _mm256_loadu_ps(Right + 8);
+
+            __m256 Rows01 = _mm256_mul_ps(_mm256_permute_ps(R01, 0x00), P.L[0]);
+            __m256 Rows23 = _mm256_mul_ps(_mm256_permute_ps(R23, 0x00), P.L[0]);
+            Rows01 = _mm256_fmadd_ps(_mm256_permute_ps(R01, 0x55), P.L[1], Rows01);
+            Rows23 = _mm256_fmadd_ps(_mm256_permute_ps(R23, 0x55), P.L[1], Rows23);
+            Rows01 = _mm256_fmadd_ps(_mm256_permute_ps(R01, 0xAA), P.L[2], Rows01);
+            Rows23 = _mm256_fmadd_ps(_mm256_permute_ps(R23, 0xAA), P.L[2], Rows23);
+            Rows01 = _mm256_fmadd_ps(_mm256_permute_ps(R01, 0xFF), P.L[3], Rows01);
+            Rows23 = _mm256_fmadd_ps(_mm256_permute_ps(R23, 0xFF), P.L[3], Rows23);
+
+            _mm256_storeu_ps(Dst, Rows01);
+            _mm256_storeu_ps(Dst + 8, Rows23);
+        }
+    };
+
+#ifdef BATCH_TRANSFORM_AVX512
+    // The whole matrix in one register
+    struct AVX512MatrixMultiply
+    {
+        struct Prepared { __m512 L[4]; };
+
+        static Prepared Prepare( const float* Left )
+        {
+            Prepared P;
+            for (int k = 0; k < 4; ++k)
+                P.L[k] = _mm512_broadcast_f32x4(_mm_loadu_ps(Left + 4 * k));
+            return P;
+        }
+
+        static void Multiply( const Prepared& P, const float* Right, float* Dst )
+        {
+            const __m512 R = _mm512_loadu_ps(Right);
+
+            __m512 Rows = _mm512_mul_ps(_mm512_permute_ps(R, 0x00), P.L[0]);
+            Rows = _mm512_fmadd_ps(_mm512_permute_ps(R, 0x55), P.L[1], Rows);
+            Rows = _mm512_fmadd_ps(_mm512_permute_ps(R, 0xAA), P.L[2], Rows);
+            Rows = _mm512_fmadd_ps(_mm512_permute_ps(R, 0xFF), P.L[3], Rows);
+
+            _mm512_storeu_ps(Dst, Rows);
+        }
+    };
+#endif
+
+    template <typename Kernel>
+    void MultiplyMatrixRange( const Matrix4* Left, bool SharedLeft, const Matrix4* Right, Matrix4* Dst, uint32_t Count )
+    {
+        if (SharedLeft)
+        {
+            const typename Kernel::Prepared P = Kernel::Prepare((const float*)Left);
+            for (uint32_t i = 0; i < Count; ++i)
+                Kernel::Multiply(P, (const float*)(Right + i), (float*)(Dst + i));
+        }
+        else
+        {
+            for (uint32_t i = 0; i < Count; ++i)
+                Kernel::Multiply(Kernel::Prepare((const float*)(Left + i)), (const float*)(Right + i), (float*)(Dst + i));
+        }
+    }
+
+    void MultiplyMatrixArray( const Matrix4* Left, bool SharedLeft, const Matrix4* Right, Matrix4* Dst, uint32_t Count,
+        BatchTransformKernel Kernel )
+    {
+        switch (ResolveKernel(Kernel))
+        {
+        case kTransformScalar:
+            for (uint32_t i = 0; i < Count; ++i)
+                Dst[i] = Left[SharedLeft ? 0 : i] * Right[i];
+            break;
+
+        case kTransformSSE:
+            MultiplyMatrixRange<SSEMatrixMultiply>(Left, SharedLeft, Right, Dst, Count);
+            break;
+
+        case kTransformAVX2:
+            MultiplyMatrixRange<AVX2MatrixMultiply>(Left, SharedLeft, Right, Dst, Count);
+            // Avoid the AVX to SSE transition penalty in the caller
+            _mm256_zeroupper();
+            break;
+
+#ifdef BATCH_TRANSFORM_AVX512
+        case kTransformAVX512:
+            MultiplyMatrixRange<AVX512MatrixMultiply>(Left, SharedLeft, Right, Dst, Count);
+            _mm256_zeroupper();
+            break;
+#endif
+
+        default:
+            break;
+        }
+    }
+}
+
+void Math::TransformPoints( const AffineTransform& Xform, const Vector3Streams& Src, const Vector3Streams& Dst,
+    uint32_t First, uint32_t Count, BatchTransformKernel Kernel )
+{
+    const AffineRows M((const float*)&Xform);
+    const uint32_t End = First + Count;
+    uint32_t i = First;
+
+    switch (ResolveKernel(Kernel))
+    {
+    case kTransformScalar:
+        for (; i < End; ++i)
+        {
+            Vector3 P = Xform * Vector3(Src.X[i], Src.Y[i], Src.Z[i]);
+            Dst.X[i] = P.GetX();
+            Dst.Y[i] = P.GetY();
+            Dst.Z[i] = P.GetZ();
+        }
+        break;
+
+#ifdef BATCH_TRANSFORM_AVX512
+    case kTransformAVX512:
+        i = TransformPointRange<AVX512Lanes>(M, Src, Dst, i, End);
+        // The remainder is less than 16 elements, so fall through to the narrower kernels
+#endif
+    case kTransformAVX2:
+        i = TransformPointRange<AVX2Lanes>(M, Src, Dst, i, End);
+        _mm256_zeroupper();
+    case kTransformSSE:
+        i = TransformPointRange<SSELanes>(M, Src, Dst, i, End);
+        TransformPointRange<ScalarLanes>(M, Src, Dst, i, End);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Math::TransformNormals( const Matrix3& Basis, const Vector3Streams& Src, const Vector3Streams& Dst,
+    uint32_t First, uint32_t Count, BatchTransformKernel Kernel )
+{
+    // Matrix3 has the same layout as the first three rows of a Matrix4
+    float Rows[16] = {};
+    memcpy(Rows, &Basis, sizeof(Basis));
+    const AffineRows M(Rows);
+    const uint32_t End = First + Count;
+    uint32_t i = First;
+
+    switch (ResolveKernel(Kernel))
+    {
+    case kTransformScalar:
+        for (; i < End; ++i)
+        {
+            Vector3 N = Normalize(Basis * Vector3(Src.X[i], Src.Y[i], Src.Z[i]));
+            Dst.X[i] = N.GetX();
+            Dst.Y[i] = N.GetY();
+            Dst.Z[i] = N.GetZ();
+        }
+        break;
+
+#ifdef BATCH_TRANSFORM_AVX512
+    case kTransformAVX512:
+        i = TransformNormalRange<AVX512Lanes>(M, Src, Dst, i, End);
+#endif
+    case kTransformAVX2:
+        i = TransformNormalRange<AVX2Lanes>(M, Src, Dst, i, End);
+        _mm256_zeroupper();
+    case kTransformSSE:
+        i = TransformNormalRange<SSELanes>(M, Src, Dst, i, End);
+        TransformNormalRange<ScalarLanes>(M, Src, Dst, i, End);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Math::TransformBoundingBoxes( const AffineTransform& Xform, const BoundingBoxStreams& Src, const BoundingBoxStreams& Dst,
+    uint32_t First, uint32_t Count, BatchTransformKernel Kernel )
+{
+    const AffineRows M((const float*)&Xform);
+    const ArvoSelect S(M);
+    const uint32_t End = First + Count;
+    uint32_t i = First;
+
+    switch (ResolveKernel(Kernel))
+    {
+    case kTransformScalar:
+        // Arvo's method as published, with a min and a max per matrix element
+        for (; i < End; ++i)
+        {
+            const float Min[3] = { Src.MinX[i], Src.MinY[i], Src.MinZ[i] };
+            const float Max[3] = { Src.MaxX[i], Src.MaxY[i], Src.MaxZ[i] };
+            float NewMin[3], NewMax[3];
+            for (int Out = 0; Out < 3; ++Out)
+            {
+                NewMin[Out] = NewMax[Out] = M.Rows[3][Out];
+                for (int In = 0; In < 3; ++In)
+                {
+                    const float A = M.Rows[In][Out] * Min[In];
+                    const float B = M.Rows[In][Out] * Max[In];
+                    NewMin[Out] += std::min(A, B);
+                    NewMax[Out] += std::max(A, B);
+                }
+            }
+            Dst.MinX[i] = NewMin[0]; Dst.MinY[i] = NewMin[1]; Dst.MinZ[i] = NewMin[2];
+            Dst.MaxX[i] = NewMax[0]; Dst.MaxY[i] = NewMax[1]; Dst.MaxZ[i] = NewMax[2];
+        }
+        break;
+
+#ifdef BATCH_TRANSFORM_AVX512
+    case kTransformAVX512:
+        i = TransformBoxRange<AVX512Lanes>(M, S, Src, Dst, i, End);
+#endif
+    case kTransformAVX2:
+        i = TransformBoxRange<AVX2Lanes>(M, S, Src, Dst, i, End);
+        _mm256_zeroupper();
+    case kTransformSSE:
+        i = TransformBoxRange<SSELanes>(M, S, Src, Dst, i, End);
+        TransformBoxRange<ScalarLanes>(M, S, Src, Dst, i, End);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Math::MultiplyMatrices( const Matrix4* Left, const Matrix4* Right, Matrix4* Dst, uint32_t Count, BatchTransformKernel Kernel )
+{
+    MultiplyMatrixArray(Left, false, Right, Dst, Count, Kernel);
+}
+
+void Math::MultiplyMatrices( const Matrix4& Parent, const Matrix4* Local, Matrix4* Dst, uint32_t Count, BatchTransformKernel Kernel )
+{
+    MultiplyMatrixArray(&Parent, true, Local, Dst, Count, Kernel);
+}
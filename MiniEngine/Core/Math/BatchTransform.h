@@ -0,0 +1,87 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#pragma once
+
+#include "Matrix4.h"
+
+namespace Math
+{
+    // Structure-of-arrays vectors and bounds for the batch transforms.  Source and destination may be the
+    // same arrays to transform in place.
+    struct Vector3Streams
+    {
+        float* X;
+        float* Y;
+        float* Z;
+    };
+
+    struct BoundingBoxStreams
+    {
+        float* MinX;
+        float* MinY;
+        float* MinZ;
+        float* MaxX;
+        float* MaxY;
+        float* MaxZ;
+    };
+
+    enum BatchTransformKernel
+    {
+        kTransformAuto,     // widest kernel the CPU supports
+        kTransformScalar,   // the Vector3 and Matrix operators in a loop
+        kTransformSSE,      // 4 elements per iteration
+        kTransformAVX2,     // 8 elements per iteration with FMA, falls back to SSE when AVX2 is unavailable
+        kTransformAVX512,   // 16 elements per iteration, falls back to AVX2 when AVX-512 is unavailable
+    };
+
+    // Elements [First, First + Count) of Src are transformed into the same elements of Dst.  Ranges don't share
+    // any output, so jobs can split the arrays between them freely.  The FMA kernels round differently than the
+    // others in the last bit or so.
+
+    // Dst = Xform * Src
+    void TransformPoints( const AffineTransform& Xform, const Vector3Streams& Src, const Vector3Streams& Dst,
+        uint32_t First, uint32_t Count, BatchTransformKernel Kernel = kTransformAuto );
+
+    // Dst = Normalize(Basis * Src).  Pass the inverse transpose of the basis when it scales non-uniformly.
+    // Zero vectors stay zero.
+    void TransformNormals( const Matrix3& Basis, const Vector3Streams& Src, const Vector3Streams& Dst,
+        uint32_t First, uint32_t Count, BatchTransformKernel Kernel = kTransformAuto );
+
+    // The smallest boxes containing the transformed boxes, using Arvo's method of picking the min or max
+    // bound per matrix element instead of transforming eight corners.
+    void TransformBoundingBoxes( const AffineTransform& Xform, const BoundingBoxStreams& Src, const BoundingBoxStreams& Dst,
+        uint32_t First, uint32_t Count, BatchTransformKernel Kernel = kTransformAuto );
+
+    // Dst[i] = Left[i] * Right[i] for i in [0, Count).  Dst may be Left or Right.
+    void MultiplyMatrices( const Matrix4* Left, const Matrix4* Right, Matrix4* Dst, uint32_t Count,
+        BatchTransformKernel Kernel = kTransformAuto );
+
+    // Dst[i] = Parent * Local[i], such as the world matrices of the instances of a model
+    void MultiplyMatrices( const Matrix4& Parent, const Matrix4* Local, Matrix4* Dst, uint32_t Count,
+        BatchTransformKernel Kernel = kTransformAuto );
+
+    // Matrix4 versions for affine matrices.  The fourth column is assumed to be (0, 0, 0, 1).
+    inline void TransformPoints( const Matrix4& Xform, const Vector3Streams& Src, const Vector3Streams& Dst,
+        uint32_t First, uint32_t Count, BatchTransformKernel Kernel = kTransformAuto )
+    {
+        TransformPoints(AffineTransform((XMMATRIX)Xform), Src, Dst, First, Count, Kernel);
+    }
+
+    inline void TransformBoundingBoxes( const Matrix4& Xform, const BoundingBoxStreams& Src, const BoundingBoxStreams& Dst,
+        uint32_t First, uint32_t Count, BatchTransformKernel Kernel = kTransformAuto )
+    {
+        TransformBoundingBoxes(AffineTransform((XMMATRIX)Xform), Src, Dst, First, Count, Kernel);
+    }
+
+} // namespace Math
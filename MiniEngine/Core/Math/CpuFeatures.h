@@ -0,0 +1,60 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <intrin.h>
+
+namespace Math
+{
+    // The instruction sets the batch kernels pick between.  Each is only reported when the OS also
+    // saves the registers it uses.
+    struct CpuFeatures
+    {
+        bool AVX;
+        bool AVX2;      // With FMA
+        bool AVX512;    // AVX-512F
+    };
+
+    inline CpuFeatures DetectCpuFeatures( void )
+    {
+        CpuFeatures Features = { false, false, false };
+
+        int CpuInfo[4];
+        __cpuid(CpuInfo, 0);
+        const int MaxLeaf = CpuInfo[0];
+
+        __cpuid(CpuInfo, 1);
+        const bool OSXSave = (CpuInfo[2] & (1 << 27)) != 0;
+        const bool AVX = (CpuInfo[2] & (1 << 28)) != 0;
+        const bool FMA = (CpuInfo[2] & (1 << 12)) != 0;
+        if (!OSXSave || !AVX)
+            return Features;
+
+        // The upper halves of the YMM registers, and for AVX-512 the ZMM and mask registers as well
+        const unsigned long long XCR0 = _xgetbv(0);
+        Features.AVX = (XCR0 & 0x06) == 0x06;
+        if (MaxLeaf < 7)
+            return Features;
+
+        __cpuidex(CpuInfo, 7, 0);
+        Features.AVX2 = Features.AVX && FMA && (CpuInfo[1] & (1 << 5)) != 0;
+        Features.AVX512 = Features.AVX2 && (CpuInfo[1] & (1 << 16)) != 0 && (XCR0 & 0xE6) == 0xE6;
+        return Features;
+    }
+
+    // Detected on first use
+    inline const CpuFeatures& GetCpuFeatures( void )
+    {
+        static const CpuFeatures s_Features = DetectCpuFeatures();
+        return s_Features;
+    }
+}
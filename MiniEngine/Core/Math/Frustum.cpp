@@ -13,7 +13,9 @@
 
 #include "pch.h"
 #include "Frustum.h"
+#include "CpuFeatures.h"
 #include "Camera.h"
+#include <ppl.h>
 
 using namespace Math;
 
@@ -114,3 +116,271 @@ Frustum::Frustum( const Matrix4& ProjMat )
         ConstructPerspectiveFrustum( RcpXX, RcpYY, NearClip, FarClip );
     }
 }
+
+namespace
+{
+    enum { kMaxStreams = 6 };
+
+    Frustum::BatchKernel ResolveKernel( Frustum::BatchKernel Kernel )
+    {
+        if (Kernel == Frustum::kBatchAuto || Kernel == Frustum::kBatchAVX)
+            return GetCpuFeatures().AVX ? Frustum::kBatchAVX : Frustum::kBatchSSE;
+        return Kernel;
+    }
+
+    // Runs TestGroup on every group of GroupWidth objects and packs the visibility bits it returns.
+    // The last group is padded with copies of its first object instead of reading past the arrays.
+    template <uint32_t GroupWidth, typename GroupFunction>
+    void RunBatch( const float* const* Streams, uint32_t StreamCount, uint32_t First, uint32_t Count,
+        uint32_t* VisibleMask, const GroupFunction& TestGroup )
+    {
+        static_assert(32 % GroupWidth == 0, "Groups must not straddle mask words");
+        ASSERT(First % 32 == 0, "Batch ranges must start on a mask word");
+
+        const uint32_t End = First + Count;
+        for (uint32_t Word = First / 32; Word < (End + 31) / 32; ++Word)
+            VisibleMask[Word] = 0;
+
+        uint32_t i = First;
+        for (; i + GroupWidth <= End; i += GroupWidth)
+            VisibleMask[i / 32] |= TestGroup(Streams, i) << (i % 32);
+
+        if (i < End)
+        {
+            __declspec(align(32)) float Padded[kMaxStreams][GroupWidth];
+            const float* PaddedStreams[kMaxStreams];
+            for (uint32_t s = 0; s < StreamCount; ++s)
+            {
+                for (uint32_t j = 0; j < GroupWidth; ++j)
+                    Padded[s][j] = Streams[s][i + j < End ? i + j : i];
+                PaddedStreams[s] = Padded[s];
+            }
+            uint32_t Bits = TestGroup(PaddedStreams, 0) & ((1u << (End - i)) - 1);
+            VisibleMask[i / 32] |= Bits << (i % 32);
+        }
+    }
+
+    // The plane loop runs per group and stops as soon as every object of the group is outside one
+    // of the planes tested so far.  Comparisons are "not less than" so NaNs count as visible like
+    // they do in the scalar tests.
+
+    struct SphereGroupSSE
+    {
+        __m128 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+
+        uint32_t operator()( const float* const* Streams, uint32_t i ) const
+        {
+            const __m128 CenterX = _mm_loadu_ps(Streams[0] + i);
+            const __m128 CenterY = _mm_loadu_ps(Streams[1] + i);
+            const __m128 CenterZ = _mm_loadu_ps(Streams[2] + i);
+            const __m128 Radius = _mm_loadu_ps(Streams[3] + i);
+
+            __m128 Visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m128 Dist = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(CenterX, PlaneX[p]), _mm_mul_ps(CenterY, PlaneY[p])),
+                    _mm_add_ps(_mm_mul_ps(CenterZ, PlaneZ[p]), PlaneW[p]));
+                Visible = _mm_and_ps(Visible, _mm_cmpnlt_ps(_mm_add_ps(Dist, Radius), _mm_setzero_ps()));
+                if (_mm_movemask_ps(Visible) == 0)
+                    break;
+            }
+            return (uint32_t)_mm_movemask_ps(Visible);
+        }
+    };
+
+    struct SphereGroupAVX
+    {
+        __m256 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+
+        uint32_t operator()( const float* const* Streams, uint32_t i ) const
+        {
+            const __m256 CenterX = _mm256_loadu_ps(Streams[0] + i);
+            const __m256 CenterY = _mm256_loadu_ps(Streams[1] + i);
+            const __m256 CenterZ = _mm256_loadu_ps(Streams[2] + i);
+            const __m256 Radius = _mm256_loadu_ps(Streams[3] + i);
+
+            __m256 Visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 Dist = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(CenterX, PlaneX[p]), _mm256_mul_ps(CenterY, PlaneY[p])),
+                    _mm256_add_ps(_mm256_mul_ps(CenterZ, PlaneZ[p]), PlaneW[p]));
+                Visible = _mm256_and_ps(Visible, _mm256_cmp_ps(_mm256_add_ps(Dist, Radius), _mm256_setzero_ps(), _CMP_NLT_UQ));
+                if (_mm256_movemask_ps(Visible) == 0)
+                    break;
+            }
+            return (uint32_t)_mm256_movemask_ps(Visible);
+        }
+    };
+
+    // Only the corner furthest along the plane normal needs testing, so each plane picks the min
+    // or max stream per axis up front: Select[p][axis] is 0-2 for min and 3-5 for max.
+    struct BoxGroupSSE
+    {
+        __m128 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+        int Select[6][3];
+
+        uint32_t operator()( const float* const* Streams, uint32_t i ) const
+        {
+            __m128 Bounds[6];
+            for (int s = 0; s < 6; ++s)
+                Bounds[s] = _mm_loadu_ps(Streams[s] + i);
+
+            __m128 Visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m128 Dist = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(Bounds[Select[p][0]], PlaneX[p]), _mm_mul_ps(Bounds[Select[p][1]], PlaneY[p])),
+                    _mm_add_ps(_mm_mul_ps(Bounds[Select[p][2]], PlaneZ[p]), PlaneW[p]));
+                Visible = _mm_and_ps(Visible, _mm_cmpnlt_ps(Dist, _mm_setzero_ps()));
+                if (_mm_movemask_ps(Visible) == 0)
+                    break;
+            }
+            return (uint32_t)_mm_movemask_ps(Visible);
+        }
+    };
+
+    struct BoxGroupAVX
+    {
+        __m256 PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+        int Select[6][3];
+
+        uint32_t operator()( const float* const* Streams, uint32_t i ) const
+        {
+            __m256 Bounds[6];
+            for (int s = 0; s < 6; ++s)
+                Bounds[s] = _mm256_loadu_ps(Streams[s] + i);
+
+            __m256 Visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 Dist = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(Bounds[Select[p][0]], PlaneX[p]), _mm256_mul_ps(Bounds[Select[p][1]], PlaneY[p])),
+                    _mm256_add_ps(_mm256_mul_ps(Bounds[Select[p][2]], PlaneZ[p]), PlaneW[p]));
+                Visible = _mm256_and_ps(Visible, _mm256_cmp_ps(Dist, _mm256_setzero_ps(), _CMP_NLT_UQ));
+                if (_mm256_movemask_ps(Visible) == 0)
+                    break;
+            }
+            return (uint32_t)_mm256_movemask_ps(Visible);
+        }
+    };
+
+    inline void Splat( __m128& Dest, float Value ) { Dest = _mm_set1_ps(Value); }
+    inline void Splat( __m256& Dest, float Value ) { Dest = _mm256_set1_ps(Value); }
+
+    template <typename GroupType>
+    void SetPlanes( const Frustum& frustum, GroupType& Group )
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            Vector4 Plane = frustum.GetFrustumPlane((Frustum::PlaneID)p);
+            Splat(Group.PlaneX[p], Plane.GetX());
+            Splat(Group.PlaneY[p], Plane.GetY());
+            Splat(Group.PlaneZ[p], Plane.GetZ());
+            Splat(Group.PlaneW[p], Plane.GetW());
+        }
+    }
+
+    template <typename GroupType>
+    void SetBoxPlanes( const Frustum& frustum, GroupType& Group )
+    {
+        SetPlanes(frustum, Group);
+        for (int p = 0; p < 6; ++p)
+        {
+            Vector4 Plane = frustum.GetFrustumPlane((Frustum::PlaneID)p);
+            Group.Select[p][0] = Plane.GetX() > 0.0f ? 3 : 0;
+            Group.Select[p][1] = Plane.GetY() > 0.0f ? 4 : 1;
+            Group.Select[p][2] = Plane.GetZ() > 0.0f ? 5 : 2;
+        }
+    }
+}
+
+void Frustum::IntersectSpheres( const SphereArray& Spheres, uint32_t First, uint32_t Count, uint32_t* VisibleMask, BatchKernel Kernel ) const
+{
+    const float* Streams[] = { Spheres.CenterX, Spheres.CenterY, Spheres.CenterZ, Spheres.Radius };
+
+    switch (ResolveKernel(Kernel))
+    {
+    case kBatchScalar:
+        RunBatch<1>(Streams, 4, First, Count, VisibleMask, [this]( const float* const* s, uint32_t i ) -> uint32_t
+        {
+            return IntersectSphere(BoundingSphere(Vector3(s[0][i], s[1][i], s[2][i]), s[3][i])) ? 1u : 0u;
+        });
+        break;
+
+    case kBatchSSE:
+    {
+        SphereGroupSSE Group;
+        SetPlanes(*this, Group);
+        RunBatch<4>(Streams, 4, First, Count, VisibleMask, Group);
+        break;
+    }
+
+    case kBatchAVX:
+    {
+        SphereGroupAVX Group;
+        SetPlanes(*this, Group);
+        RunBatch<8>(Streams, 4, First, Count, VisibleMask, Group);
+        // Avoid the AVX to SSE transition penalty in the caller
+        _mm256_zeroupper();
+        break;
+    }
+    }
+}
+
+void Frustum::IntersectBoundingBoxes( const BoundingBoxArray& Boxes, uint32_t First, uint32_t Count, uint32_t* VisibleMask, BatchKernel Kernel ) const
+{
+    const float* Streams[] = { Boxes.MinX, Boxes.MinY, Boxes.MinZ, Boxes.MaxX, Boxes.MaxY, Boxes.MaxZ };
+
+    switch (ResolveKernel(Kernel))
+    {
+    case kBatchScalar:
+        RunBatch<1>(Streams, 6, First, Count, VisibleMask, [this]( const float* const* s, uint32_t i ) -> uint32_t
+        {
+            return IntersectBoundingBox(Vector3(s[0][i], s[1][i], s[2][i]), Vector3(s[3][i], s[4][i], s[5][i])) ? 1u : 0u;
+        });
+        break;
+
+    case kBatchSSE:
+    {
+        BoxGroupSSE Group;
+        SetBoxPlanes(*this, Group);
+        RunBatch<4>(Streams, 6, First, Count, VisibleMask, Group);
+        break;
+    }
+
+    case kBatchAVX:
+    {
+        BoxGroupAVX Group;
+        SetBoxPlanes(*this, Group);
+        RunBatch<8>(Streams, 6, First, Count, VisibleMask, Group);
+        _mm256_zeroupper();
+        break;
+    }
+    }
+}
+
+void Frustum::ParallelIntersectSpheres( const SphereArray& Spheres, uint32_t Count, uint32_t* VisibleMask, uint32_t JobSize ) const
+{
+    JobSize = AlignUp(std::max(JobSize, 1u), 32);
+    const uint32_t JobCount = (uint32_t)DivideByMultiple(Count, JobSize);
+
+    Concurrency::parallel_for(0u, JobCount, [&]( uint32_t Job )
+    {
+        const uint32_t First = Job * JobSize;
+        IntersectSpheres(Spheres, First, std::min(JobSize, Count - First), VisibleMask);
+    });
+}
+
+void Frustum::ParallelIntersectBoundingBoxes( const BoundingBoxArray& Boxes, uint32_t Count, uint32_t* VisibleMask, uint32_t JobSize ) const
+{
+    JobSize = AlignUp(std::max(JobSize, 1u), 32);
+    const uint32_t JobCount = (uint32_t)DivideByMultiple(Count, JobSize);
+
+    Concurrency::parallel_for(0u, JobCount, [&]( uint32_t Job )
+    {
+        const uint32_t First = Job * JobSize;
+        IntersectBoundingBoxes(Boxes, First, std::min(JobSize, Count - First), VisibleMask);
+    });
+}
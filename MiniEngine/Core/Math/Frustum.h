@@ -47,6 +47,45 @@ namespace Math
         // simple struct in the Model project.)
         bool IntersectBoundingBox(const Vector3 minBound, const Vector3 maxBound) const;
 
+        // Structure-of-arrays bounds for the batch tests
+        struct SphereArray
+        {
+            const float* CenterX;
+            const float* CenterY;
+            const float* CenterZ;
+            const float* Radius;
+        };
+
+        struct BoundingBoxArray
+        {
+            const float* MinX;
+            const float* MinY;
+            const float* MinZ;
+            const float* MaxX;
+            const float* MaxY;
+            const float* MaxZ;
+        };
+
+        enum BatchKernel
+        {
+            kBatchAuto,     // widest kernel the CPU supports
+            kBatchScalar,   // IntersectSphere() / IntersectBoundingBox() in a loop
+            kBatchSSE,      // 4 objects per iteration
+            kBatchAVX,      // 8 objects per iteration, falls back to SSE when AVX is unavailable
+        };
+
+        // Batch versions of the tests above.  Objects [First, First + Count) are tested and the result for
+        // object i is stored in bit (i % 32) of VisibleMask[i / 32].  First must be a multiple of 32 so that
+        // jobs working on different ranges of the same arrays never write to the same mask word.  Bits in
+        // the last word past the end of the range are cleared.
+        void IntersectSpheres( const SphereArray& Spheres, uint32_t First, uint32_t Count, uint32_t* VisibleMask, BatchKernel Kernel = kBatchAuto ) const;
+        void IntersectBoundingBoxes( const BoundingBoxArray& Boxes, uint32_t First, uint32_t Count, uint32_t* VisibleMask, BatchKernel Kernel = kBatchAuto ) const;
+
+        // Splits [0, Count) into jobs of JobSize objects (rounded up to a multiple of 32) and runs them
+        // on the thread pool.
+        void ParallelIntersectSpheres( const SphereArray& Spheres, uint32_t Count, uint32_t* VisibleMask, uint32_t JobSize = 8192 ) const;
+        void ParallelIntersectBoundingBoxes( const BoundingBoxArray& Boxes, uint32_t Count, uint32_t* VisibleMask, uint32_t JobSize = 8192 ) const;
+
         friend Frustum  operator* ( const OrthogonalTransform& xform, const Frustum& frustum );	// Fast
         friend Frustum  operator* ( const AffineTransform& xform, const Frustum& frustum );		// Slow
         friend Frustum  operator* ( const Matrix4& xform, const Frustum& frustum );				// Slowest (and most general)
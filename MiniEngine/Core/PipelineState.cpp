@@ -14,23 +14,289 @@
 #include "GraphicsCore.h"
 #include "PipelineState.h"
 #include "RootSignature.h"
-#include "Hash.h"
-#include <map>
-#include <thread>
+#include "ShardedHashMap.h"
 #include <mutex>
+#include <atomic>
+
+// Pipeline libraries were added in the Anniversary Update
+#if defined(NTDDI_WIN10_RS1) && (NTDDI_VERSION >= NTDDI_WIN10_RS1)
+#define ENABLE_PSO_DISK_CACHE 1
+#else
+#define ENABLE_PSO_DISK_CACHE 0
+#endif
 
 using Math::IsAligned;
 using namespace Graphics;
 using Microsoft::WRL::ComPtr;
 using namespace std;
 
-static map< size_t, ComPtr<ID3D12PipelineState> > s_GraphicsPSOHashMap;
-static map< size_t, ComPtr<ID3D12PipelineState> > s_ComputePSOHashMap;
+namespace
+{
+    // The CRC based Utility::HashState() only has 32 bits, too few to name pipelines on disk
+    uint64_t HashBytes( const void* Data, size_t Size, uint64_t Hash = 14695981039346656037ull )
+    {
+        const uint8_t* Bytes = (const uint8_t*)Data;
+        for (size_t i = 0; i < Size; ++i)
+            Hash = (Hash ^ Bytes[i]) * 1099511628211ull;
+        return Hash;
+    }
+
+    // Everything that identifies a pipeline, with pointers replaced by what they point to
+    // so the key is the same from run to run.  Shader bytecode is represented by its size
+    // and hash rather than copied.
+    class PSOKey
+    {
+    public:
+        void Append( const void* Data, size_t Size )
+        {
+            const uint8_t* Bytes = (const uint8_t*)Data;
+            m_Bytes.insert(m_Bytes.end(), Bytes, Bytes + Size);
+        }
+
+        template <typename T> void Append( const T& Value ) { Append(&Value, sizeof(T)); }
+
+        void AppendShader( const D3D12_SHADER_BYTECODE& Shader )
+        {
+            Append((uint64_t)Shader.BytecodeLength);
+            Append(HashBytes(Shader.pShaderBytecode, Shader.BytecodeLength));
+        }
+
+        uint64_t GetHash( void ) const { return HashBytes(m_Bytes.data(), m_Bytes.size()); }
+
+        bool operator==( const PSOKey& Other ) const { return m_Bytes == Other.m_Bytes; }
+
+    private:
+        vector<uint8_t> m_Bytes;
+    };
+
+    // Different descriptors may share a hash, so entries are also compared by key.  Hits
+    // don't lock, so worker threads finalizing the same pipelines don't serialize.
+    typedef ShardedHashMap< PSOKey, ComPtr<ID3D12PipelineState> > PSOCacheMap;
+
+    PSOCacheMap s_GraphicsPSOHashMap;
+    PSOCacheMap s_ComputePSOHashMap;
+
+    atomic<uint64_t> s_CacheHits(0);
+    atomic<uint64_t> s_CacheMisses(0);
+    atomic<uint64_t> s_CacheCollisions(0);
+    atomic<uint64_t> s_DiskHits(0);
+    atomic<uint64_t> s_DiskMisses(0);
+
+    void CountLookup( const PSOCacheMap::LookupResult& Result )
+    {
+        ++(Result.Created ? s_CacheMisses : s_CacheHits);
+        if (Result.Collided)
+            ++s_CacheCollisions;
+    }
+
+#if ENABLE_PSO_DISK_CACHE
+
+    // The file is a small header followed by the serialized ID3D12PipelineLibrary.  The
+    // library reads pipelines straight out of the memory mapped file, so the view stays
+    // mapped for as long as the library exists.
+    struct DiskCacheHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t LibrarySize;
+    };
+
+    const uint32_t kDiskCacheMagic = 'COSP';
+    const uint32_t kDiskCacheVersion = 1;
+
+    mutex s_DiskCacheMutex;
+    wstring s_DiskCacheFileName;
+    ComPtr<ID3D12PipelineLibrary> s_PipelineLibrary;
+    void* s_MappedFile = nullptr;
+    bool s_DiskCacheDirty = false;
+
+    // Maps the file read only, returns the size of the view or 0
+    size_t MapDiskCacheFile( const wstring& FileName )
+    {
+        HANDLE File = CreateFile2(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+        if (File == INVALID_HANDLE_VALUE)
+            return 0;
+
+        LARGE_INTEGER FileSize = {};
+        HANDLE Mapping = nullptr;
+        if (GetFileSizeEx(File, &FileSize) && FileSize.QuadPart >= (LONGLONG)sizeof(DiskCacheHeader))
+            Mapping = CreateFileMappingFromApp(File, nullptr, PAGE_READONLY, 0, nullptr);
+        CloseHandle(File);
+        if (Mapping == nullptr)
+            return 0;
+
+        // The view keeps the mapping alive
+        s_MappedFile = MapViewOfFileFromApp(Mapping, FILE_MAP_READ, 0, 0);
+        CloseHandle(Mapping);
+
+        return s_MappedFile == nullptr ? 0 : (size_t)FileSize.QuadPart;
+    }
+
+    void UnmapDiskCacheFile( void )
+    {
+        if (s_MappedFile != nullptr)
+        {
+            UnmapViewOfFile(s_MappedFile);
+            s_MappedFile = nullptr;
+        }
+    }
+
+    void SaveDiskCache( void )
+    {
+        if (s_PipelineLibrary == nullptr)
+            return;
+
+        vector<uint8_t> FileData;
+        if (s_DiskCacheDirty)
+        {
+            DiskCacheHeader Header = { kDiskCacheMagic, kDiskCacheVersion, s_PipelineLibrary->GetSerializedSize() };
+            FileData.resize(sizeof(Header) + (size_t)Header.LibrarySize);
+            memcpy(FileData.data(), &Header, sizeof(Header));
+            if (FAILED(s_PipelineLibrary->Serialize(FileData.data() + sizeof(Header), (size_t)Header.LibrarySize)))
+                FileData.clear();
+        }
+
+        // The file can't be replaced while it is still mapped
+        s_PipelineLibrary = nullptr;
+        UnmapDiskCacheFile();
+
+        if (FileData.empty())
+            return;
+
+        HANDLE File = CreateFile2(s_DiskCacheFileName.c_str(), GENERIC_WRITE, 0, CREATE_ALWAYS, nullptr);
+        if (File == INVALID_HANDLE_VALUE)
+        {
+            Utility::Printf(L"Unable to write pipeline cache \"%s\"\n", s_DiskCacheFileName.c_str());
+            return;
+        }
+
+        DWORD BytesWritten = 0;
+        bool Succeeded = WriteFile(File, FileData.data(), (DWORD)FileData.size(), &BytesWritten, nullptr) && BytesWritten == FileData.size();
+        CloseHandle(File);
+
+        // Don't leave a truncated library behind
+        if (!Succeeded)
+            DeleteFileW(s_DiskCacheFileName.c_str());
+    }
+
+    void GetPipelineName( wchar_t (&Name)[20], wchar_t Type, uint64_t Hash )
+    {
+        swprintf_s(Name, L"%c%016llX", Type, Hash);
+    }
+
+    HRESULT LoadPipeline( const wchar_t* Name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, ID3D12PipelineState** Pipeline )
+    {
+        return s_PipelineLibrary->LoadGraphicsPipeline(Name, &Desc, MY_IID_PPV_ARGS(Pipeline));
+    }
+
+    HRESULT LoadPipeline( const wchar_t* Name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, ID3D12PipelineState** Pipeline )
+    {
+        return s_PipelineLibrary->LoadComputePipeline(Name, &Desc, MY_IID_PPV_ARGS(Pipeline));
+    }
+
+    // The library compares the complete descriptor with the one the pipeline was stored
+    // with, so a name taken by a colliding pipeline fails to load just like an unknown one.
+    template <typename DescType>
+    ID3D12PipelineState* LoadFromDiskCache( const DescType& Desc, wchar_t Type, uint64_t Hash )
+    {
+        lock_guard<mutex> CS(s_DiskCacheMutex);
+        if (s_PipelineLibrary == nullptr)
+            return nullptr;
+
+        wchar_t Name[20];
+        GetPipelineName(Name, Type, Hash);
+
+        ID3D12PipelineState* Pipeline = nullptr;
+        if (SUCCEEDED(LoadPipeline(Name, Desc, &Pipeline)))
+        {
+            ++s_DiskHits;
+            return Pipeline;
+        }
+
+        ++s_DiskMisses;
+        return nullptr;
+    }
+
+    void StoreInDiskCache( ID3D12PipelineState* Pipeline, wchar_t Type, uint64_t Hash )
+    {
+        lock_guard<mutex> CS(s_DiskCacheMutex);
+        if (s_PipelineLibrary == nullptr)
+            return;
+
+        wchar_t Name[20];
+        GetPipelineName(Name, Type, Hash);
+
+        // Fails when a colliding pipeline already owns the name, which just leaves this one uncached
+        if (SUCCEEDED(s_PipelineLibrary->StorePipeline(Name, Pipeline)))
+            s_DiskCacheDirty = true;
+    }
+
+#else
+
+    template <typename DescType>
+    ID3D12PipelineState* LoadFromDiskCache( const DescType&, wchar_t, uint64_t ) { return nullptr; }
+    void StoreInDiskCache( ID3D12PipelineState*, wchar_t, uint64_t ) {}
+
+#endif // ENABLE_PSO_DISK_CACHE
+}
+
+void PSO::InitializeDiskCache( const std::wstring& FileName )
+{
+#if ENABLE_PSO_DISK_CACHE
+    ComPtr<ID3D12Device1> Device1;
+    if (FAILED(g_Device->QueryInterface(MY_IID_PPV_ARGS(&Device1))))
+        return;
+
+    s_DiskCacheFileName = FileName;
+
+    size_t FileSize = MapDiskCacheFile(FileName);
+    const DiskCacheHeader* Header = (const DiskCacheHeader*)s_MappedFile;
+    if (FileSize > 0 && Header->Magic == kDiskCacheMagic && Header->Version == kDiskCacheVersion &&
+        Header->LibrarySize > 0 && Header->LibrarySize <= FileSize - sizeof(DiskCacheHeader))
+    {
+        // Anything from another driver, adapter or OS build is rejected and rebuilt from scratch
+        HRESULT hr = Device1->CreatePipelineLibrary(Header + 1, (SIZE_T)Header->LibrarySize, MY_IID_PPV_ARGS(&s_PipelineLibrary));
+        if (FAILED(hr))
+        {
+            Utility::Printf(L"Discarding pipeline cache \"%s\" (0x%08X)\n", FileName.c_str(), hr);
+            s_PipelineLibrary = nullptr;
+        }
+    }
+
+    if (s_PipelineLibrary == nullptr)
+    {
+        UnmapDiskCacheFile();
+
+        // DXGI_ERROR_UNSUPPORTED here means the driver has no pipeline library support
+        if (FAILED(Device1->CreatePipelineLibrary(nullptr, 0, MY_IID_PPV_ARGS(&s_PipelineLibrary))))
+            s_PipelineLibrary = nullptr;
+    }
+
+    s_DiskCacheDirty = false;
+#else
+    (void)FileName;
+#endif
+}
 
 void PSO::DestroyAll(void)
 {
-    s_GraphicsPSOHashMap.clear();
-    s_ComputePSOHashMap.clear();
+    s_GraphicsPSOHashMap.Clear();
+    s_ComputePSOHashMap.Clear();
+
+#if ENABLE_PSO_DISK_CACHE
+    SaveDiskCache();
+#endif
+}
+
+PSO::CacheStatistics PSO::GetCacheStatistics( void )
+{
+    CacheStatistics Stats;
+    Stats.Hits = s_CacheHits;
+    Stats.Misses = s_CacheMisses;
+    Stats.Collisions = s_CacheCollisions;
+    Stats.DiskHits = s_DiskHits;
+    Stats.DiskMisses = s_DiskMisses;
+    return Stats;
 }
 
 
@@ -111,40 +377,56 @@ void GraphicsPSO::Finalize()
     // Make sure the root signature is finalized first
     m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
     ASSERT(m_PSODesc.pRootSignature != nullptr);
-
-    m_PSODesc.InputLayout.pInputElementDescs = nullptr;
-    size_t HashCode = Utility::HashState(&m_PSODesc);
-    HashCode = Utility::HashState(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements, HashCode);
     m_PSODesc.InputLayout.pInputElementDescs = m_InputLayouts.get();
 
-    ID3D12PipelineState** PSORef = nullptr;
-    bool firstCompile = false;
-    {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_GraphicsPSOHashMap.find(HashCode);
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC KeyDesc = m_PSODesc;
+    KeyDesc.pRootSignature = nullptr;
+    KeyDesc.VS.pShaderBytecode = nullptr;
+    KeyDesc.PS.pShaderBytecode = nullptr;
+    KeyDesc.DS.pShaderBytecode = nullptr;
+    KeyDesc.HS.pShaderBytecode = nullptr;
+    KeyDesc.GS.pShaderBytecode = nullptr;
+    KeyDesc.StreamOutput.pSODeclaration = nullptr;
+    KeyDesc.StreamOutput.pBufferStrides = nullptr;
+    KeyDesc.InputLayout.pInputElementDescs = nullptr;
+    KeyDesc.CachedPSO = D3D12_CACHED_PIPELINE_STATE();
 
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_GraphicsPSOHashMap.end())
-        {
-            firstCompile = true;
-            PSORef = s_GraphicsPSOHashMap[HashCode].GetAddressOf();
-        }
-        else
-            PSORef = iter->second.GetAddressOf();
-    }
+    PSOKey Key;
+    Key.Append(KeyDesc);
+    Key.Append((uint64_t)m_RootSignature->GetHashCode());
+    Key.AppendShader(m_PSODesc.VS);
+    Key.AppendShader(m_PSODesc.PS);
+    Key.AppendShader(m_PSODesc.DS);
+    Key.AppendShader(m_PSODesc.HS);
+    Key.AppendShader(m_PSODesc.GS);
 
-    if (firstCompile)
-    {
-        ASSERT_SUCCEEDED( g_Device->CreateGraphicsPipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-        s_GraphicsPSOHashMap[HashCode].Attach(m_PSO);
-    }
-    else
+    ASSERT(m_PSODesc.StreamOutput.NumEntries == 0, "Stream output is not supported");
+
+    for (UINT i = 0; i < m_PSODesc.InputLayout.NumElements; ++i)
     {
-        while (*PSORef == nullptr)
-            this_thread::yield();
-        m_PSO = *PSORef;
+        D3D12_INPUT_ELEMENT_DESC Element = m_InputLayouts.get()[i];
+        const char* SemanticName = Element.SemanticName;
+        Element.SemanticName = nullptr;
+        Key.Append(Element);
+        Key.Append(SemanticName, strlen(SemanticName) + 1);
     }
+
+    const uint64_t HashCode = Key.GetHash();
+
+    // Only the first thread to ask for a pipeline creates it, the others wait for the result
+    PSOCacheMap::LookupResult Result = s_GraphicsPSOHashMap.GetOrCreate(HashCode, Key,
+        [&]( ComPtr<ID3D12PipelineState>& Pipeline )
+        {
+            Pipeline.Attach(LoadFromDiskCache(m_PSODesc, L'G', HashCode));
+            if (Pipeline == nullptr)
+            {
+                ASSERT_SUCCEEDED( g_Device->CreateGraphicsPipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&Pipeline)) );
+                StoreInDiskCache(Pipeline.Get(), L'G', HashCode);
+            }
+        });
+
+    CountLookup(Result);
+    m_PSO = Result.Value->Get();
 }
 
 void ComputePSO::Finalize()
@@ -153,36 +435,31 @@ void ComputePSO::Finalize()
     m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
     ASSERT(m_PSODesc.pRootSignature != nullptr);
 
-    size_t HashCode = Utility::HashState(&m_PSODesc);
+    D3D12_COMPUTE_PIPELINE_STATE_DESC KeyDesc = m_PSODesc;
+    KeyDesc.pRootSignature = nullptr;
+    KeyDesc.CS.pShaderBytecode = nullptr;
+    KeyDesc.CachedPSO = D3D12_CACHED_PIPELINE_STATE();
 
-    ID3D12PipelineState** PSORef = nullptr;
-    bool firstCompile = false;
-    {
-        static mutex s_HashMapMutex;
-        lock_guard<mutex> CS(s_HashMapMutex);
-        auto iter = s_ComputePSOHashMap.find(HashCode);
+    PSOKey Key;
+    Key.Append(KeyDesc);
+    Key.Append((uint64_t)m_RootSignature->GetHashCode());
+    Key.AppendShader(m_PSODesc.CS);
+
+    const uint64_t HashCode = Key.GetHash();
 
-        // Reserve space so the next inquiry will find that someone got here first.
-        if (iter == s_ComputePSOHashMap.end())
+    PSOCacheMap::LookupResult Result = s_ComputePSOHashMap.GetOrCreate(HashCode, Key,
+        [&]( ComPtr<ID3D12PipelineState>& Pipeline )
         {
-            firstCompile = true;
-            PSORef = s_ComputePSOHashMap[HashCode].GetAddressOf();
-        }
-        else
-            PSORef = iter->second.GetAddressOf();
-    }
+            Pipeline.Attach(LoadFromDiskCache(m_PSODesc, L'C', HashCode));
+            if (Pipeline == nullptr)
+            {
+                ASSERT_SUCCEEDED( g_Device->CreateComputePipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&Pipeline)) );
+                StoreInDiskCache(Pipeline.Get(), L'C', HashCode);
+            }
+        });
 
-    if (firstCompile)
-    {
-        ASSERT_SUCCEEDED( g_Device->CreateComputePipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-        s_ComputePSOHashMap[HashCode].Attach(m_PSO);
-    }
-    else
-    {
-        while (*PSORef == nullptr)
-            this_thread::yield();
-        m_PSO = *PSORef;
-    }
+    CountLookup(Result);
+    m_PSO = Result.Value->Get();
 }
 
 ComputePSO::ComputePSO()
@@ -30,8 +30,24 @@ public:
 
     PSO() : m_RootSignature(nullptr) {}
 
+    // Compiled pipelines are stored in a pipeline library that is loaded from and written
+    // back to this file, so later runs can skip shader compilation.  Must be called before
+    // the first Finalize().  DestroyAll() saves any pipelines that were added.
+    static void InitializeDiskCache( const std::wstring& FileName );
+
     static void DestroyAll( void );
 
+    struct CacheStatistics
+    {
+        uint64_t Hits;          // Found in memory
+        uint64_t Misses;        // Not in memory, loaded from disk or compiled
+        uint64_t Collisions;    // Hash matched a different descriptor
+        uint64_t DiskHits;      // Loaded from the pipeline library
+        uint64_t DiskMisses;    // Compiled and added to the pipeline library
+    };
+
+    static CacheStatistics GetCacheStatistics( void );
+
     void SetRootSignature( const RootSignature& BindMappings )
     {
         m_RootSignature = &BindMappings;
@@ -46,6 +46,10 @@ protected:
     void CreateTextureResource( ID3D12Device* Device, const std::wstring& Name, const D3D12_RESOURCE_DESC& ResourceDesc,
         D3D12_CLEAR_VALUE ClearValue, EsramAllocator& Allocator );
 
+    // Place the resource in memory of a heap instead of allocating its own
+    void CreateTextureResource( ID3D12Device* Device, const std::wstring& Name, const D3D12_RESOURCE_DESC& ResourceDesc,
+        D3D12_CLEAR_VALUE ClearValue, ID3D12Heap* Heap, uint64_t HeapOffset, D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON );
+
     static DXGI_FORMAT GetBaseFormat( DXGI_FORMAT Format );
     static DXGI_FORMAT GetUAVFormat( DXGI_FORMAT Format );
     static DXGI_FORMAT GetDSVFormat( DXGI_FORMAT Format );
@@ -0,0 +1,248 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "pch.h"
+#include "RenderGraph.h"
+#include "GraphicsCore.h"
+#include "CommandListManager.h"
+#include "CommandContext.h"
+#include <algorithm>
+
+using namespace Graphics;
+
+void RenderGraph::Destroy( void )
+{
+    for (std::unique_ptr<TransientBuffer>& Transient : m_Transients)
+        Transient->Buffer->Destroy();
+    m_Transients.clear();
+
+    if (m_Heap != nullptr)
+    {
+        m_Heap->Release();
+        m_Heap = nullptr;
+    }
+    m_HeapSize = 0;
+
+    Reset();
+}
+
+void RenderGraph::Reset( void )
+{
+    m_Compiler.Reset();
+    m_Resources.clear();
+    m_FrameTransients.clear();
+    m_Passes.clear();
+}
+
+RenderGraph::ResourceHandle RenderGraph::Import( GpuResource& Resource, const std::wstring& Name )
+{
+    ASSERT(Resource.m_TransitioningState == (D3D12_RESOURCE_STATES)-1, "Imported resources can't be in the middle of a split barrier");
+
+    m_Resources.push_back(&Resource);
+    m_FrameTransients.push_back(nullptr);
+    return m_Compiler.AddResource(Name, Resource.m_UsageState);
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateTransient( const std::wstring& Name, uint32_t Width, uint32_t Height,
+    DXGI_FORMAT Format, uint32_t ArrayCount )
+{
+    TransientBuffer* Transient = nullptr;
+    for (std::unique_ptr<TransientBuffer>& Existing : m_Transients)
+    {
+        if (Existing->Name == Name)
+        {
+            Transient = Existing.get();
+            break;
+        }
+    }
+
+    if (Transient == nullptr)
+    {
+        m_Transients.emplace_back(new TransientBuffer());
+        Transient = m_Transients.back().get();
+        Transient->Name = Name;
+        Transient->Width = 0;
+        Transient->Buffer.reset(new ColorBuffer());
+    }
+
+    ASSERT(std::find(m_FrameTransients.begin(), m_FrameTransients.end(), Transient) == m_FrameTransients.end(),
+        "Transient buffer created twice in a frame");
+
+    // A different size means a different buffer, created again wherever it is placed
+    if (Transient->Width != Width || Transient->Height != Height || Transient->ArrayCount != ArrayCount || Transient->Format != Format)
+    {
+        Transient->Width = Width;
+        Transient->Height = Height;
+        Transient->ArrayCount = ArrayCount;
+        Transient->Format = Format;
+        Transient->AllocationInfo = Transient->Buffer->GetPlacedAllocationInfo(Width, Height, ArrayCount, Format);
+        Transient->HeapOffset = kNotPlaced;
+    }
+
+    m_Resources.push_back(Transient->Buffer.get());
+    m_FrameTransients.push_back(Transient);
+    return m_Compiler.AddTransient(Name, Transient->AllocationInfo.SizeInBytes, Transient->AllocationInfo.Alignment,
+        Transient->Buffer->m_UsageState);
+}
+
+ColorBuffer& RenderGraph::GetTransient( ResourceHandle Handle )
+{
+    ASSERT(m_FrameTransients[Handle] != nullptr, "Not a transient buffer");
+    return *m_FrameTransients[Handle]->Buffer;
+}
+
+RenderGraph::PassHandle RenderGraph::AddPass( const std::wstring& Name, RenderGraphCompiler::PassType Type, const ExecuteFunction& Execute )
+{
+    m_Passes.push_back(Execute);
+    return m_Compiler.AddPass(Name, Type);
+}
+
+void RenderGraph::Read( PassHandle Pass, ResourceHandle Resource, D3D12_RESOURCE_STATES State )
+{
+    m_Compiler.Read(Pass, Resource, State);
+}
+
+void RenderGraph::Write( PassHandle Pass, ResourceHandle Resource, D3D12_RESOURCE_STATES State )
+{
+    m_Compiler.Write(Pass, Resource, State);
+}
+
+// Creates the transient buffers where the compiler placed them, unless they are there already.
+// Moving any waits for the GPU to finish with them, so it only happens when the frame changes.
+void RenderGraph::PlaceTransients( void )
+{
+    const uint64_t HeapSize = m_Compiler.GetHeapSize();
+    bool Moved = HeapSize > m_HeapSize;
+    for (uint32_t ResourceIndex = 0; ResourceIndex < m_FrameTransients.size() && !Moved; ++ResourceIndex)
+    {
+        const TransientBuffer* Transient = m_FrameTransients[ResourceIndex];
+        const uint64_t Offset = m_Compiler.GetHeapOffset(ResourceIndex);
+        Moved = Transient != nullptr && Offset != RenderGraphCompiler::kInvalid && Offset != Transient->HeapOffset;
+    }
+
+    if (!Moved)
+        return;
+
+    g_CommandManager.IdleGPU();
+
+    if (HeapSize > m_HeapSize)
+    {
+        for (std::unique_ptr<TransientBuffer>& Transient : m_Transients)
+        {
+            Transient->Buffer->Destroy();
+            Transient->HeapOffset = kNotPlaced;
+        }
+
+        if (m_Heap != nullptr)
+            m_Heap->Release();
+
+        D3D12_HEAP_DESC HeapDesc = {};
+        HeapDesc.SizeInBytes = HeapSize;
+        HeapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        HeapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        HeapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+
+        ASSERT_SUCCEEDED(g_Device->CreateHeap(&HeapDesc, MY_IID_PPV_ARGS(&m_Heap)));
+        m_HeapSize = HeapSize;
+    }
+
+    for (uint32_t ResourceIndex = 0; ResourceIndex < m_FrameTransients.size(); ++ResourceIndex)
+    {
+        TransientBuffer* Transient = m_FrameTransients[ResourceIndex];
+        const uint64_t Offset = m_Compiler.GetHeapOffset(ResourceIndex);
+        if (Transient == nullptr || Offset == RenderGraphCompiler::kInvalid || Offset == Transient->HeapOffset)
+            continue;
+
+        // In the state the frame was compiled for
+        Transient->Buffer->CreatePlaced(Transient->Name, Transient->Width, Transient->Height, Transient->ArrayCount,
+            Transient->Format, m_Heap, Offset, Transient->Buffer->m_UsageState);
+        Transient->HeapOffset = Offset;
+    }
+}
+
+void RenderGraph::RecordBarriers( CommandContext& Context, const std::vector<RenderGraphCompiler::Barrier>& Barriers )
+{
+    for (const RenderGraphCompiler::Barrier& Barrier : Barriers)
+    {
+        GpuResource& Resource = *m_Resources[Barrier.Resource];
+
+        switch (Barrier.Type)
+        {
+        case D3D12_RESOURCE_BARRIER_TYPE_ALIASING:
+            Context.InsertAliasBarrier(*m_Resources[Barrier.AliasedResource], Resource);
+            break;
+
+        case D3D12_RESOURCE_BARRIER_TYPE_UAV:
+            Context.InsertUAVBarrier(Resource);
+            break;
+
+        default:
+            ASSERT(Resource.m_UsageState == Barrier.StateBefore, "Resource state changed outside of the render graph");
+
+            // Ending a split barrier is a transition to the state it began
+            if (Barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+                Context.BeginResourceTransition(Resource, Barrier.StateAfter);
+            else
+                Context.TransitionResource(Resource, Barrier.StateAfter);
+            break;
+        }
+    }
+
+    Context.FlushResourceBarriers();
+}
+
+void RenderGraph::Execute( const RenderGraphCompiler::Options& Options )
+{
+    m_Compiler.Compile(Options);
+    PlaceTransients();
+
+    const uint32_t PassCount = m_Compiler.GetPassCount();
+    m_FenceValues.assign(PassCount, 0);
+
+    GraphicsContext& Graphics = GraphicsContext::Begin(L"Render Graph");
+    ComputeContext* AsyncCompute = nullptr;
+    if (m_Compiler.GetStatistics().AsyncComputePasses > 0)
+        AsyncCompute = &ComputeContext::Begin(L"Render Graph Async Compute", true);
+
+    for (uint32_t PassIndex = 0; PassIndex < PassCount; ++PassIndex)
+    {
+        const RenderGraphCompiler::PassSchedule& Schedule = m_Compiler.GetSchedule(PassIndex);
+        const bool OnComputeQueue = Schedule.Queue == RenderGraphCompiler::kComputeQueue;
+        CommandContext& Context = OnComputeQueue ? *AsyncCompute : Graphics;
+
+        if (Schedule.WaitForPass != RenderGraphCompiler::kInvalid)
+        {
+            // What was recorded before doesn't need to wait
+            Context.Flush();
+            g_CommandManager.GetQueue(OnComputeQueue ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT)
+                .StallForFence(m_FenceValues[Schedule.WaitForPass]);
+        }
+
+        RecordBarriers(Context, Schedule.Before);
+        for (uint32_t ResourceIndex : Schedule.Discards)
+            Context.GetCommandList()->DiscardResource(m_Resources[ResourceIndex]->GetResource(), nullptr);
+
+        Context.PIXBeginEvent(m_Compiler.GetPassName(PassIndex).c_str());
+        m_Passes[PassIndex](Context);
+        Context.PIXEndEvent();
+
+        RecordBarriers(Context, Schedule.After);
+
+        if (Schedule.Signal)
+            m_FenceValues[PassIndex] = Context.Flush();
+    }
+
+    // The next frame may reuse the memory of transients async compute still reads
+    uint64_t ComputeFence = AsyncCompute != nullptr ? AsyncCompute->Finish() : 0;
+    Graphics.Finish();
+    if (AsyncCompute != nullptr)
+        g_CommandManager.GetGraphicsQueue().StallForFence(ComputeFence);
+}
@@ -0,0 +1,93 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include "RenderGraphCompiler.h"
+#include "ColorBuffer.h"
+#include <functional>
+#include <memory>
+
+class CommandContext;
+
+//
+// Records a frame from passes that declare the resources they read and write instead of
+// transitioning them.  Every frame: Reset(), import the buffers that outlive it, create the
+// transient ones, add the passes and Execute().  RenderGraphCompiler works out the barriers,
+// where the transients go in a heap they share, and which passes run on the async compute queue.
+//
+// Passes must not change the states of the resources they declare, the graph relies on knowing
+// them.  Transient buffers are only defined from their first write to their last use in a frame.
+//
+class RenderGraph
+{
+public:
+
+    typedef uint32_t ResourceHandle;
+    typedef uint32_t PassHandle;
+    typedef std::function<void(CommandContext&)> ExecuteFunction;
+
+    RenderGraph() : m_Heap(nullptr), m_HeapSize(0) {}
+
+    // Releases the transient buffers and their heap.  The GPU must be done with them.
+    void Destroy( void );
+
+    // Forgets the passes and resources of the last frame.  Transient buffers are kept for reuse.
+    void Reset( void );
+
+    ResourceHandle Import( GpuResource& Resource, const std::wstring& Name );
+
+    // A buffer of the same name and size as in an earlier frame is the same buffer with the same
+    // descriptors.  GetTransient() returns it for passes to bind.
+    ResourceHandle CreateTransient( const std::wstring& Name, uint32_t Width, uint32_t Height, DXGI_FORMAT Format, uint32_t ArrayCount = 1 );
+    ColorBuffer& GetTransient( ResourceHandle Handle );
+
+    // Passes run in the order they are added, with a compute context if they are compute passes
+    PassHandle AddPass( const std::wstring& Name, RenderGraphCompiler::PassType Type, const ExecuteFunction& Execute );
+    void Read( PassHandle Pass, ResourceHandle Resource, D3D12_RESOURCE_STATES State );
+    void Write( PassHandle Pass, ResourceHandle Resource, D3D12_RESOURCE_STATES State );
+
+    void Execute( const RenderGraphCompiler::Options& Options = RenderGraphCompiler::Options() );
+
+    const RenderGraphCompiler::Statistics& GetStatistics( void ) const { return m_Compiler.GetStatistics(); }
+
+private:
+
+    struct TransientBuffer
+    {
+        std::wstring Name;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t ArrayCount;
+        DXGI_FORMAT Format;
+        D3D12_RESOURCE_ALLOCATION_INFO AllocationInfo;
+        uint64_t HeapOffset;            // Where the buffer was created, or kNotPlaced
+        std::unique_ptr<ColorBuffer> Buffer;
+    };
+
+    static const uint64_t kNotPlaced = ~0ull;
+
+    void PlaceTransients( void );
+    void RecordBarriers( CommandContext& Context, const std::vector<RenderGraphCompiler::Barrier>& Barriers );
+
+    RenderGraphCompiler m_Compiler;
+
+    // Per resource of the frame
+    std::vector<GpuResource*> m_Resources;
+    std::vector<TransientBuffer*> m_FrameTransients;
+
+    std::vector<ExecuteFunction> m_Passes;
+    std::vector<uint64_t> m_FenceValues;
+
+    std::vector<std::unique_ptr<TransientBuffer>> m_Transients;
+    ID3D12Heap* m_Heap;
+    uint64_t m_HeapSize;
+};
@@ -0,0 +1,610 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <d3d12.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+//
+// Turns a frame's passes, each naming the resources it reads and writes and the state it needs
+// them in, into the barriers, memory placement and queue synchronization that run it.  It only
+// deals in indices and states and never touches a device, RenderGraph executes what it produces.
+//
+// Passes run in the order they were added.  For every resource the compiler walks its uses:
+//  - A read that follows reads in another read state is merged with the reads after it, so one
+//    transition to the combined state serves all of them.
+//  - A transition whose previous use was at least one pass earlier on the same queue is split.
+//    It begins right after that use and ends right before the next, letting the GPU overlap it
+//    with the passes in between.
+//  - Back to back uses in the UNORDERED_ACCESS state get a UAV barrier if either one writes.
+// Transient resources only live from their first to their last use.  They are placed in one heap
+// lowest offset first, largest first, so those whose lifetimes don't overlap share memory.  Their
+// contents are undefined at the start of a frame.  The first use of one begins with aliasing
+// barriers against the earlier ones it overlaps, and is discarded unless it is a copy, so it must
+// be a write that initializes it.
+//
+// Async compute passes go to the compute queue when every state they use is valid there.  A pass
+// waits for the latest pass on the other queue it depends on.  That covers reads after writes,
+// writes after reads or writes, and state changes.  A transition from a state the compute queue
+// can't handle is done on the graphics queue after the last graphics pass before the compute pass.
+//
+class RenderGraphCompiler
+{
+public:
+
+    static const uint32_t kInvalid = ~0u;
+
+    enum PassType
+    {
+        kGraphicsPass,
+        kComputePass,           // Runs on the graphics queue
+        kAsyncComputePass,      // Runs on the compute queue when possible
+    };
+
+    enum QueueType
+    {
+        kGraphicsQueue,
+        kComputeQueue,
+        kNumQueues
+    };
+
+    struct Options
+    {
+        Options() : MergeReads(true), SplitBarriers(true), AliasTransients(true), AsyncCompute(true) {}
+
+        bool MergeReads;
+        bool SplitBarriers;
+        bool AliasTransients;
+        bool AsyncCompute;
+    };
+
+    struct Barrier
+    {
+        D3D12_RESOURCE_BARRIER_TYPE Type;
+        D3D12_RESOURCE_BARRIER_FLAGS Flags;
+        uint32_t Resource;              // For aliasing barriers, the resource taking over the memory
+        uint32_t AliasedResource;       // For aliasing barriers, the resource giving it up
+        D3D12_RESOURCE_STATES StateBefore;
+        D3D12_RESOURCE_STATES StateAfter;
+    };
+
+    struct PassSchedule
+    {
+        QueueType Queue;
+        uint32_t WaitForPass;           // Pass on the other queue to wait for before this one, or kInvalid
+        bool Signal;                    // A pass on the other queue waits for this one
+        std::vector<Barrier> Before;    // Flushed together before the pass
+        std::vector<Barrier> After;     // Flushed together after the pass
+        std::vector<uint32_t> Discards; // Transient resources to discard after the barriers before the pass
+    };
+
+    struct Statistics
+    {
+        uint32_t Passes;
+        uint32_t AsyncComputePasses;
+        uint32_t Transitions;           // Split ones count once
+        uint32_t SplitTransitions;
+        uint32_t MergedReads;           // Reads that needed no transition of their own
+        uint32_t AliasingBarriers;
+        uint32_t UAVBarriers;
+        uint32_t BarrierBatches;        // ResourceBarrier() calls
+        uint32_t CrossQueueWaits;
+        uint64_t TransientSize;         // Of every transient resource on its own
+        uint64_t HeapSize;              // Of the heap they share
+    };
+
+    void Reset( void )
+    {
+        m_Resources.clear();
+        m_Passes.clear();
+        m_Schedule.clear();
+        m_HeapSize = 0;
+        m_Stats = Statistics();
+    }
+
+    // A resource that outlives the frame, in the state it is in now
+    uint32_t AddResource( const std::wstring& Name, D3D12_RESOURCE_STATES CurrentState )
+    {
+        Resource NewResource = { Name, CurrentState, CurrentState, false, 0, 1, kInvalid };
+        m_Resources.push_back(NewResource);
+        return (uint32_t)m_Resources.size() - 1;
+    }
+
+    // A resource only used within the frame, to be placed in the shared heap
+    uint32_t AddTransient( const std::wstring& Name, uint64_t Size, uint64_t Alignment, D3D12_RESOURCE_STATES CurrentState )
+    {
+        Resource NewResource = { Name, CurrentState, CurrentState, true, Size, Alignment, kInvalid };
+        m_Resources.push_back(NewResource);
+        return (uint32_t)m_Resources.size() - 1;
+    }
+
+    uint32_t AddPass( const std::wstring& Name, PassType Type )
+    {
+        Pass NewPass;
+        NewPass.Name = Name;
+        NewPass.Type = Type;
+        m_Passes.push_back(NewPass);
+        return (uint32_t)m_Passes.size() - 1;
+    }
+
+    // Naming a resource twice in a pass combines the states
+    void Read( uint32_t PassIndex, uint32_t ResourceIndex, D3D12_RESOURCE_STATES State ) { AddAccess(PassIndex, ResourceIndex, State, false); }
+    void Write( uint32_t PassIndex, uint32_t ResourceIndex, D3D12_RESOURCE_STATES State ) { AddAccess(PassIndex, ResourceIndex, State, true); }
+
+    void Compile( const Options& CompileOptions = Options() )
+    {
+        const uint32_t PassCount = (uint32_t)m_Passes.size();
+        const uint32_t ResourceCount = (uint32_t)m_Resources.size();
+
+        m_Options = CompileOptions;
+        m_Stats = Statistics();
+        m_Stats.Passes = PassCount;
+
+        m_Schedule.assign(PassCount, PassSchedule());
+        for (PassSchedule& Schedule : m_Schedule)
+        {
+            Schedule.Queue = kGraphicsQueue;
+            Schedule.WaitForPass = kInvalid;
+            Schedule.Signal = false;
+        }
+
+        // Every resource's uses in pass order
+        m_Uses.assign(ResourceCount, std::vector<Use>());
+        for (uint32_t PassIndex = 0; PassIndex < PassCount; ++PassIndex)
+        {
+            for (const Access& PassAccess : m_Passes[PassIndex].Accesses)
+            {
+                Use NewUse = { PassIndex, PassAccess.State, PassAccess.Write };
+                m_Uses[PassAccess.Resource].push_back(NewUse);
+            }
+        }
+
+        PlaceTransients();
+        m_Stats.HeapSize = m_HeapSize;
+
+        ScheduleBarriers();
+        ValidateSplitBarriers();
+
+        for (const PassSchedule& Schedule : m_Schedule)
+        {
+            m_Stats.AsyncComputePasses += Schedule.Queue == kComputeQueue ? 1 : 0;
+            m_Stats.CrossQueueWaits += Schedule.WaitForPass != kInvalid ? 1 : 0;
+            m_Stats.BarrierBatches += (Schedule.Before.empty() ? 0 : 1) + (Schedule.After.empty() ? 0 : 1);
+        }
+    }
+
+    uint32_t GetPassCount( void ) const { return (uint32_t)m_Passes.size(); }
+    uint32_t GetResourceCount( void ) const { return (uint32_t)m_Resources.size(); }
+    const std::wstring& GetPassName( uint32_t PassIndex ) const { return m_Passes[PassIndex].Name; }
+    const std::wstring& GetResourceName( uint32_t ResourceIndex ) const { return m_Resources[ResourceIndex].Name; }
+    bool IsTransient( uint32_t ResourceIndex ) const { return m_Resources[ResourceIndex].Transient; }
+
+    // The results of Compile()
+    const PassSchedule& GetSchedule( uint32_t PassIndex ) const { return m_Schedule[PassIndex]; }
+    uint64_t GetHeapOffset( uint32_t ResourceIndex ) const { return m_Resources[ResourceIndex].HeapOffset; }   // kInvalid if unused
+    uint64_t GetHeapSize( void ) const { return m_HeapSize; }
+    D3D12_RESOURCE_STATES GetFinalState( uint32_t ResourceIndex ) const { return m_Resources[ResourceIndex].FinalState; }
+    const Statistics& GetStatistics( void ) const { return m_Stats; }
+
+    static bool IsValidOnComputeQueue( D3D12_RESOURCE_STATES State )
+    {
+        const D3D12_RESOURCE_STATES ComputeStates = D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE;
+        return (State & ~ComputeStates) == 0;
+    }
+
+    static bool IsReadOnlyState( D3D12_RESOURCE_STATES State )
+    {
+        const D3D12_RESOURCE_STATES WriteStates = D3D12_RESOURCE_STATE_RENDER_TARGET | D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+            D3D12_RESOURCE_STATE_DEPTH_WRITE | D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_STREAM_OUT |
+            D3D12_RESOURCE_STATE_RESOLVE_DEST;
+        return State != D3D12_RESOURCE_STATE_COMMON && (State & WriteStates) == 0;
+    }
+
+private:
+
+    struct Resource
+    {
+        std::wstring Name;
+        D3D12_RESOURCE_STATES InitialState;
+        D3D12_RESOURCE_STATES FinalState;
+        bool Transient;
+        uint64_t Size;
+        uint64_t Alignment;
+        uint64_t HeapOffset;
+    };
+
+    struct Access
+    {
+        uint32_t Resource;
+        D3D12_RESOURCE_STATES State;
+        bool Write;
+    };
+
+    struct Pass
+    {
+        std::wstring Name;
+        PassType Type;
+        std::vector<Access> Accesses;
+    };
+
+    struct Use
+    {
+        uint32_t Pass;
+        D3D12_RESOURCE_STATES State;
+        bool Write;
+    };
+
+    struct SplitBarrier
+    {
+        uint32_t Resource;
+        uint32_t BeginPass;
+        uint32_t EndPass;
+    };
+
+    void AddAccess( uint32_t PassIndex, uint32_t ResourceIndex, D3D12_RESOURCE_STATES State, bool Write )
+    {
+        for (Access& Existing : m_Passes[PassIndex].Accesses)
+        {
+            if (Existing.Resource == ResourceIndex)
+            {
+                Existing.State = Existing.State | State;
+                Existing.Write = Existing.Write || Write;
+                return;
+            }
+        }
+
+        Access NewAccess = { ResourceIndex, State, Write };
+        m_Passes[PassIndex].Accesses.push_back(NewAccess);
+    }
+
+    static uint64_t AlignUp( uint64_t Value, uint64_t Alignment ) { return (Value + Alignment - 1) / Alignment * Alignment; }
+
+    bool LifetimesOverlap( uint32_t A, uint32_t B ) const
+    {
+        return m_Uses[A].front().Pass <= m_Uses[B].back().Pass && m_Uses[B].front().Pass <= m_Uses[A].back().Pass;
+    }
+
+    bool MemoryOverlaps( uint32_t A, uint32_t B ) const
+    {
+        const Resource& First = m_Resources[A];
+        const Resource& Second = m_Resources[B];
+        return First.HeapOffset < Second.HeapOffset + Second.Size && Second.HeapOffset < First.HeapOffset + First.Size;
+    }
+
+    // Greedy first fit, largest first.  Without aliasing every transient gets memory of its own.
+    void PlaceTransients( void )
+    {
+        std::vector<uint32_t> Transients;
+        for (uint32_t ResourceIndex = 0; ResourceIndex < m_Resources.size(); ++ResourceIndex)
+        {
+            m_Resources[ResourceIndex].HeapOffset = kInvalid;
+            if (m_Resources[ResourceIndex].Transient && !m_Uses[ResourceIndex].empty())
+                Transients.push_back(ResourceIndex);
+        }
+
+        std::stable_sort(Transients.begin(), Transients.end(), [this]( uint32_t A, uint32_t B )
+        {
+            return m_Resources[A].Size > m_Resources[B].Size;
+        });
+
+        m_HeapSize = 0;
+        std::vector<uint32_t> Placed;
+        std::vector<uint32_t> Conflicts;
+        for (uint32_t ResourceIndex : Transients)
+        {
+            Resource& Transient = m_Resources[ResourceIndex];
+            m_Stats.TransientSize += Transient.Size;
+
+            Conflicts.clear();
+            for (uint32_t Other : Placed)
+            {
+                if (!m_Options.AliasTransients || LifetimesOverlap(ResourceIndex, Other))
+                    Conflicts.push_back(Other);
+            }
+
+            std::sort(Conflicts.begin(), Conflicts.end(), [this]( uint32_t A, uint32_t B )
+            {
+                return m_Resources[A].HeapOffset < m_Resources[B].HeapOffset;
+            });
+
+            uint64_t Offset = 0;
+            for (uint32_t Other : Conflicts)
+            {
+                const Resource& Occupant = m_Resources[Other];
+                if (Offset < Occupant.HeapOffset + Occupant.Size && Occupant.HeapOffset < Offset + Transient.Size)
+                    Offset = AlignUp(Occupant.HeapOffset + Occupant.Size, Transient.Alignment);
+            }
+
+            Transient.HeapOffset = Offset;
+            m_HeapSize = std::max(m_HeapSize, Offset + Transient.Size);
+            Placed.push_back(ResourceIndex);
+        }
+    }
+
+    // The queue a pass would go to if nothing forced it onto the graphics queue
+    QueueType PreferredQueue( uint32_t PassIndex ) const
+    {
+        const Pass& Candidate = m_Passes[PassIndex];
+        if (Candidate.Type != kAsyncComputePass || !m_Options.AsyncCompute)
+            return kGraphicsQueue;
+
+        for (const Access& PassAccess : Candidate.Accesses)
+        {
+            if (!IsValidOnComputeQueue(PassAccess.State))
+                return kGraphicsQueue;
+        }
+        return kComputeQueue;
+    }
+
+    // The state the use at UseIndex transitions to.  Reads take in the reads after them on the same queue.
+    D3D12_RESOURCE_STATES TargetState( uint32_t ResourceIndex, uint32_t UseIndex, QueueType Queue ) const
+    {
+        const std::vector<Use>& Uses = m_Uses[ResourceIndex];
+        D3D12_RESOURCE_STATES Target = Uses[UseIndex].State;
+        if (!m_Options.MergeReads || Uses[UseIndex].Write || !IsReadOnlyState(Target))
+            return Target;
+
+        for (uint32_t Next = UseIndex + 1; Next < Uses.size(); ++Next)
+        {
+            if (Uses[Next].Write || !IsReadOnlyState(Uses[Next].State) || PreferredQueue(Uses[Next].Pass) != Queue)
+                break;
+            Target = Target | Uses[Next].State;
+        }
+        return Target;
+    }
+
+    void AddWait( uint32_t PassIndex, uint32_t OtherPass, const uint32_t* SyncedUpTo )
+    {
+        PassSchedule& Schedule = m_Schedule[PassIndex];
+        if (m_Schedule[OtherPass].Queue == Schedule.Queue)
+            return;
+        if (SyncedUpTo[Schedule.Queue] != kInvalid && OtherPass <= SyncedUpTo[Schedule.Queue])
+            return;
+        if (Schedule.WaitForPass == kInvalid || OtherPass > Schedule.WaitForPass)
+            Schedule.WaitForPass = OtherPass;
+    }
+
+    static Barrier MakeBarrier( D3D12_RESOURCE_BARRIER_TYPE Type, D3D12_RESOURCE_BARRIER_FLAGS Flags, uint32_t ResourceIndex,
+        D3D12_RESOURCE_STATES Before = D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATES After = D3D12_RESOURCE_STATE_COMMON )
+    {
+        Barrier NewBarrier = { Type, Flags, ResourceIndex, kInvalid, Before, After };
+        return NewBarrier;
+    }
+
+    void ScheduleBarriers( void )
+    {
+        const uint32_t PassCount = (uint32_t)m_Passes.size();
+        const uint32_t ResourceCount = (uint32_t)m_Resources.size();
+
+        // Per resource: its state, its next use, and its last use that wrote or needed a barrier
+        std::vector<D3D12_RESOURCE_STATES> State(ResourceCount);
+        std::vector<uint32_t> NextUse(ResourceCount, 0);
+        std::vector<uint32_t> LastExclusive(ResourceCount, (uint32_t)kInvalid);
+        for (uint32_t ResourceIndex = 0; ResourceIndex < ResourceCount; ++ResourceIndex)
+            State[ResourceIndex] = m_Resources[ResourceIndex].InitialState;
+
+        // Aliasing may need the last use of a resource on either queue
+        std::vector<uint32_t> LastUseOnQueue(ResourceCount * kNumQueues, (uint32_t)kInvalid);
+
+        // Passes on each queue so far, and the last pass of the other queue each one has waited for
+        std::vector<uint32_t> QueueOrdinal(PassCount);
+        uint32_t QueuePassCount[kNumQueues] = { 0, 0 };
+        uint32_t SyncedUpTo[kNumQueues] = { kInvalid, kInvalid };
+        uint32_t LastGraphicsPass = kInvalid;
+
+        m_Splits.clear();
+
+        for (uint32_t PassIndex = 0; PassIndex < PassCount; ++PassIndex)
+        {
+            PassSchedule& Schedule = m_Schedule[PassIndex];
+            const Pass& CurrentPass = m_Passes[PassIndex];
+
+            // A compute pass needing a transition from a graphics only state can only have it done on the
+            // graphics queue if a graphics pass came before, and transients are activated where they're first used
+            Schedule.Queue = PreferredQueue(PassIndex);
+            for (const Access& PassAccess : CurrentPass.Accesses)
+            {
+                if (Schedule.Queue != kComputeQueue)
+                    break;
+
+                const uint32_t ResourceIndex = PassAccess.Resource;
+                const D3D12_RESOURCE_STATES Target = TargetState(ResourceIndex, NextUse[ResourceIndex], kComputeQueue);
+                if (Target != State[ResourceIndex] && !IsValidOnComputeQueue(State[ResourceIndex]) &&
+                    (LastGraphicsPass == kInvalid || (m_Resources[ResourceIndex].Transient && NextUse[ResourceIndex] == 0)))
+                {
+                    Schedule.Queue = kGraphicsQueue;
+                }
+            }
+
+            const QueueType Queue = Schedule.Queue;
+            QueueOrdinal[PassIndex] = QueuePassCount[Queue]++;
+
+            for (const Access& PassAccess : CurrentPass.Accesses)
+            {
+                const uint32_t ResourceIndex = PassAccess.Resource;
+                const std::vector<Use>& Uses = m_Uses[ResourceIndex];
+                const uint32_t UseIndex = NextUse[ResourceIndex]++;
+                const Use& CurrentUse = Uses[UseIndex];
+
+                D3D12_RESOURCE_STATES& CurrentState = State[ResourceIndex];
+                D3D12_RESOURCE_STATES Target = CurrentUse.State;
+
+                // Reads covered by an earlier merged transition need nothing, if the queue allows the merged state
+                bool Covered = m_Options.MergeReads && !CurrentUse.Write && IsReadOnlyState(Target) &&
+                    IsReadOnlyState(CurrentState) && (CurrentState & Target) == Target &&
+                    (Queue == kGraphicsQueue || IsValidOnComputeQueue(CurrentState));
+                if (!Covered)
+                    Target = TargetState(ResourceIndex, UseIndex, Queue);
+                else if (CurrentState != Target)
+                    ++m_Stats.MergedReads;
+
+                const bool Transition = !Covered && Target != CurrentState;
+
+                // Reads must come after the last write or barrier on the other queue, and writes and barriers after
+                // every use since.  UAV barriers are decided below but always come with a write before or in this use.
+                const uint32_t Exclusive = LastExclusive[ResourceIndex];
+                const bool PreviousWrite = UseIndex > 0 && Uses[UseIndex - 1].Write;
+                const bool UAVBarrier = !Transition && CurrentState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && (CurrentUse.Write || PreviousWrite);
+                if (CurrentUse.Write || Transition || UAVBarrier)
+                {
+                    for (uint32_t Earlier = Exclusive == kInvalid ? 0 : Exclusive; Earlier < UseIndex; ++Earlier)
+                        AddWait(PassIndex, Uses[Earlier].Pass, SyncedUpTo);
+                    LastExclusive[ResourceIndex] = UseIndex;
+                }
+                else if (Exclusive != kInvalid)
+                {
+                    AddWait(PassIndex, Uses[Exclusive].Pass, SyncedUpTo);
+                }
+
+                // A transient sharing memory takes it over from every earlier one it overlaps
+                if (UseIndex == 0 && m_Resources[ResourceIndex].Transient)
+                {
+                    for (uint32_t Other = 0; Other < ResourceCount; ++Other)
+                    {
+                        if (Other == ResourceIndex || !m_Resources[Other].Transient || m_Uses[Other].empty() ||
+                            m_Uses[Other].back().Pass >= PassIndex || !MemoryOverlaps(ResourceIndex, Other))
+                        {
+                            continue;
+                        }
+
+                        Barrier Alias = MakeBarrier(D3D12_RESOURCE_BARRIER_TYPE_ALIASING, D3D12_RESOURCE_BARRIER_FLAG_NONE, ResourceIndex);
+                        Alias.AliasedResource = Other;
+                        Schedule.Before.push_back(Alias);
+                        ++m_Stats.AliasingBarriers;
+
+                        for (uint32_t OtherQueue = 0; OtherQueue < kNumQueues; ++OtherQueue)
+                        {
+                            if (LastUseOnQueue[Other * kNumQueues + OtherQueue] != kInvalid)
+                                AddWait(PassIndex, LastUseOnQueue[Other * kNumQueues + OtherQueue], SyncedUpTo);
+                        }
+                    }
+
+                    // Placed render targets must be discarded or cleared before use after being created or aliased.
+                    // Discarding is only allowed in these states, and copies initialize all of a resource anyway.
+                    if (CurrentUse.Write && (Target == D3D12_RESOURCE_STATE_RENDER_TARGET ||
+                        Target == D3D12_RESOURCE_STATE_DEPTH_WRITE || Target == D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
+                    {
+                        Schedule.Discards.push_back(ResourceIndex);
+                    }
+                }
+
+                const uint32_t PreviousPass = UseIndex > 0 ? Uses[UseIndex - 1].Pass : kInvalid;
+
+                if (Transition)
+                {
+                    ++m_Stats.Transitions;
+
+                    if (Queue == kComputeQueue && !IsValidOnComputeQueue(CurrentState))
+                    {
+                        // The graphics queue does it once its last pass before this one is done
+                        m_Schedule[LastGraphicsPass].After.push_back(MakeBarrier(D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+                            D3D12_RESOURCE_BARRIER_FLAG_NONE, ResourceIndex, CurrentState, Target));
+                        AddWait(PassIndex, LastGraphicsPass, SyncedUpTo);
+                    }
+                    else if (m_Options.SplitBarriers && PreviousPass != kInvalid && m_Schedule[PreviousPass].Queue == Queue &&
+                        QueueOrdinal[PassIndex] - QueueOrdinal[PreviousPass] > 1)
+                    {
+                        m_Schedule[PreviousPass].After.push_back(MakeBarrier(D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+                            D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY, ResourceIndex, CurrentState, Target));
+                        Schedule.Before.push_back(MakeBarrier(D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+                            D3D12_RESOURCE_BARRIER_FLAG_END_ONLY, ResourceIndex, CurrentState, Target));
+
+                        SplitBarrier Split = { ResourceIndex, PreviousPass, PassIndex };
+                        m_Splits.push_back(Split);
+                        ++m_Stats.SplitTransitions;
+                    }
+                    else
+                    {
+                        Schedule.Before.push_back(MakeBarrier(D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+                            D3D12_RESOURCE_BARRIER_FLAG_NONE, ResourceIndex, CurrentState, Target));
+                    }
+
+                    CurrentState = Target;
+                }
+                else if (UAVBarrier && PreviousPass != kInvalid && m_Schedule[PreviousPass].Queue == Queue)
+                {
+                    // After a use on the other queue, waiting for it is enough
+                    Schedule.Before.push_back(MakeBarrier(D3D12_RESOURCE_BARRIER_TYPE_UAV, D3D12_RESOURCE_BARRIER_FLAG_NONE, ResourceIndex));
+                    ++m_Stats.UAVBarriers;
+                }
+
+                LastUseOnQueue[ResourceIndex * kNumQueues + Queue] = PassIndex;
+            }
+
+            if (Schedule.WaitForPass != kInvalid)
+            {
+                m_Schedule[Schedule.WaitForPass].Signal = true;
+                SyncedUpTo[Queue] = Schedule.WaitForPass;
+            }
+
+            if (Queue == kGraphicsQueue)
+                LastGraphicsPass = PassIndex;
+        }
+
+        for (uint32_t ResourceIndex = 0; ResourceIndex < ResourceCount; ++ResourceIndex)
+            m_Resources[ResourceIndex].FinalState = State[ResourceIndex];
+    }
+
+    // RenderGraph submits what it has recorded on a queue before signaling or waiting, and a split
+    // barrier can't span two submissions.  Those that would become one full barrier at their end.
+    void ValidateSplitBarriers( void )
+    {
+        for (const SplitBarrier& Split : m_Splits)
+        {
+            const QueueType Queue = m_Schedule[Split.EndPass].Queue;
+
+            bool Submitted = false;
+            for (uint32_t PassIndex = Split.BeginPass; PassIndex <= Split.EndPass && !Submitted; ++PassIndex)
+            {
+                const PassSchedule& Schedule = m_Schedule[PassIndex];
+                if (Schedule.Queue != Queue)
+                    continue;
+                Submitted = (PassIndex < Split.EndPass && Schedule.Signal) ||
+                    (PassIndex > Split.BeginPass && Schedule.WaitForPass != kInvalid);
+            }
+
+            if (!Submitted)
+                continue;
+
+            std::vector<Barrier>& After = m_Schedule[Split.BeginPass].After;
+            for (size_t i = 0; i < After.size(); ++i)
+            {
+                if (After[i].Resource == Split.Resource && After[i].Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+                {
+                    After.erase(After.begin() + i);
+                    break;
+                }
+            }
+
+            for (Barrier& End : m_Schedule[Split.EndPass].Before)
+            {
+                if (End.Resource == Split.Resource && End.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY)
+                    End.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            }
+
+            --m_Stats.SplitTransitions;
+        }
+    }
+
+    Options m_Options;
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+    std::vector<std::vector<Use>> m_Uses;
+    std::vector<PassSchedule> m_Schedule;
+    std::vector<SplitBarrier> m_Splits;
+    uint64_t m_HeapSize;
+    Statistics m_Stats;
+};
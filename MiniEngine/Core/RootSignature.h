@@ -116,7 +116,7 @@ class RootSignature
 
 public:
 
-    RootSignature( UINT NumRootParams = 0, UINT NumStaticSamplers = 0 ) : m_Finalized(FALSE), m_NumParameters(NumRootParams)
+    RootSignature( UINT NumRootParams = 0, UINT NumStaticSamplers = 0 ) : m_Finalized(FALSE), m_NumParameters(NumRootParams), m_HashCode(0)
     {
         Reset(NumRootParams, NumStaticSamplers);
     }
@@ -162,6 +162,9 @@ public:
 
     ID3D12RootSignature* GetSignature() const { return m_Signature; }
 
+    // Hash of the finalized description, which unlike the signature pointer is the same every run
+    size_t GetHashCode() const { return m_HashCode; }
+
 protected:
 
     BOOL m_Finalized;
@@ -174,4 +177,5 @@ protected:
     std::unique_ptr<RootParameter[]> m_ParamArray;
     std::unique_ptr<D3D12_STATIC_SAMPLER_DESC[]> m_SamplerArray;
     ID3D12RootSignature* m_Signature;
+    size_t m_HashCode;
 };
@@ -0,0 +1,205 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+//
+// A concurrent cache for objects that are expensive to create, are never removed and are
+// looked up far more often than they are added, such as pipeline state objects.
+//
+// Entries are found by a 64-bit hash and then compared by their full key.  The hash picks
+// one of ShardCount shards, each an open-addressing table of atomic node pointers.  Lookups
+// of existing entries never lock: they probe the published table and compare keys.  Adding
+// an entry locks only its shard, and when a table grows the old one is kept alive until
+// Clear() so readers that are still probing it stay safe.
+//
+// GetOrCreate() is single-flight: when several threads ask for the same missing key, one of
+// them runs the create function and the others sleep on the shard's condition variable until
+// its result is ready.
+//
+template <typename KeyType, typename ValueType, uint32_t ShardCount = 16>
+class ShardedHashMap
+{
+    static_assert((ShardCount & (ShardCount - 1)) == 0, "Shard count must be a power of two");
+
+public:
+
+    struct LookupResult
+    {
+        ValueType* Value;
+        bool Created;       // This call ran the create function
+        bool Collided;      // Another key with the same hash was probed
+    };
+
+    ShardedHashMap() {}
+    ~ShardedHashMap() { Clear(); }
+
+    ShardedHashMap( const ShardedHashMap& ) = delete;
+    ShardedHashMap& operator=( const ShardedHashMap& ) = delete;
+
+    // Returns the value for Key, calling Create(ValueType&) to fill it in if the key is new.
+    template <typename CreateFunc>
+    LookupResult GetOrCreate( uint64_t Hash, const KeyType& Key, const CreateFunc& Create )
+    {
+        Shard& S = m_Shards[Hash % ShardCount];
+        LookupResult Result = { nullptr, false, false };
+
+        Node* Found = Probe(S.Current.load(std::memory_order_acquire), Hash, Key, Result.Collided);
+
+        if (Found == nullptr)
+        {
+            std::unique_lock<std::mutex> Lock(S.Mutex);
+
+            // Someone may have added it or grown the table since the unlocked probe
+            Found = Probe(S.Current.load(std::memory_order_relaxed), Hash, Key, Result.Collided);
+
+            if (Found == nullptr)
+            {
+                Found = Insert(S, Hash, Key);
+                Lock.unlock();
+
+                Create(Found->Value);
+
+                // Set under the lock so a waiter can't miss the notification between its check and its wait
+                Lock.lock();
+                Found->Ready.store(true, std::memory_order_release);
+                Lock.unlock();
+                S.Created.notify_all();
+                Result.Created = true;
+            }
+        }
+
+        // The creating thread publishes the node before the value is ready
+        if (!Found->Ready.load(std::memory_order_acquire))
+        {
+            std::unique_lock<std::mutex> Lock(S.Mutex);
+            S.Created.wait(Lock, [Found] { return Found->Ready.load(std::memory_order_acquire); });
+        }
+
+        Result.Value = &Found->Value;
+        return Result;
+    }
+
+    // Releases every entry.  Not safe to call while other threads are using the map.
+    void Clear( void )
+    {
+        for (Shard& S : m_Shards)
+        {
+            S.Current.store(nullptr, std::memory_order_relaxed);
+            S.Tables.clear();
+            S.Nodes.clear();
+        }
+    }
+
+private:
+
+    struct Node
+    {
+        Node( uint64_t NodeHash, const KeyType& NodeKey ) : Hash(NodeHash), Key(NodeKey), Ready(false) {}
+
+        const uint64_t Hash;
+        const KeyType Key;
+        ValueType Value;
+        std::atomic<bool> Ready;
+    };
+
+    struct Table
+    {
+        explicit Table( uint32_t Capacity ) : Mask(Capacity - 1), Slots(new std::atomic<Node*>[Capacity])
+        {
+            for (uint32_t i = 0; i < Capacity; ++i)
+                Slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        const uint32_t Mask;
+        std::unique_ptr<std::atomic<Node*>[]> Slots;
+    };
+
+    // Entries are never removed, so a probe can stop at the first empty slot
+    static Node* Probe( const Table* T, uint64_t Hash, const KeyType& Key, bool& Collided )
+    {
+        if (T == nullptr)
+            return nullptr;
+
+        // The low bits pick the shard, the slot comes from the high bits
+        for (uint32_t Index = (uint32_t)(Hash >> 32) & T->Mask; ; Index = (Index + 1) & T->Mask)
+        {
+            Node* N = T->Slots[Index].load(std::memory_order_acquire);
+            if (N == nullptr)
+                return nullptr;
+            if (N->Hash == Hash)
+            {
+                if (N->Key == Key)
+                    return N;
+                Collided = true;
+            }
+        }
+    }
+
+    static void Link( Table& T, Node* N )
+    {
+        uint32_t Index = (uint32_t)(N->Hash >> 32) & T.Mask;
+        while (T.Slots[Index].load(std::memory_order_relaxed) != nullptr)
+            Index = (Index + 1) & T.Mask;
+        T.Slots[Index].store(N, std::memory_order_release);
+    }
+
+    struct Shard
+    {
+        Shard() : Current(nullptr) {}
+
+        std::atomic<Table*> Current;
+        std::mutex Mutex;
+        std::condition_variable Created;     // Signalled when a value of this shard becomes ready
+        std::vector<std::unique_ptr<Table>> Tables;
+        std::vector<std::unique_ptr<Node>> Nodes;
+    };
+
+    // Called with the shard locked
+    static Node* Insert( Shard& S, uint64_t Hash, const KeyType& Key )
+    {
+        S.Nodes.emplace_back(new Node(Hash, Key));
+        Node* N = S.Nodes.back().get();
+
+        Table* T = S.Current.load(std::memory_order_relaxed);
+
+        // Keep the load factor at or below one half so probes stay short
+        if (T == nullptr || S.Nodes.size() * 2 > (size_t)T->Mask + 1)
+        {
+            uint32_t Capacity = T == nullptr ? 64 : (T->Mask + 1) * 2;
+            Table* Grown = new Table(Capacity);
+            for (auto& Existing : S.Nodes)
+                Link(*Grown, Existing.get());
+
+            // Readers still probing the old table will retry under the lock if they miss
+            S.Tables.emplace_back(Grown);
+            S.Current.store(Grown, std::memory_order_release);
+        }
+        else
+        {
+            Link(*T, N);
+        }
+
+        return N;
+    }
+
+    // Each shard sits on its own cache line so writers to different shards don't contend
+    struct alignas(64) PaddedShard : Shard {};
+
+    PaddedShard m_Shards[ShardCount];
+};
@@ -19,7 +19,12 @@
 #include "GraphicsCore.h"
 #include "CommandContext.h"
 #include <map>
+#include <set>
+#include <queue>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 using namespace std;
 using namespace Graphics;
@@ -69,7 +74,8 @@ void Texture::Create( size_t Pitch, size_t Width, size_t Height, DXGI_FORMAT For
     g_Device->CreateShaderResourceView(m_pResource.Get(), nullptr, m_hCpuDescriptorHandle);
 }
 
-void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
+// Converts a 24 or 32-bit uncompressed TGA to RGBA8
+static void DecodeTGA( const void* _filePtr, vector<uint32_t>& Pixels, uint16_t& Width, uint16_t& Height )
 {
     const uint8_t* filePtr = (const uint8_t*)_filePtr;
 
@@ -90,8 +96,8 @@ void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
     // Ignore another byte
     filePtr++;
 
-    uint32_t* formattedData = new uint32_t[imageWidth * imageHeight];
-    uint32_t* iter = formattedData;
+    Pixels.resize(imageWidth * imageHeight);
+    uint32_t* iter = Pixels.data();
 
     uint8_t numChannels = bitCount / 8;
     uint32_t numBytes = imageWidth * imageHeight * numChannels;
@@ -116,9 +122,17 @@ void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
         break;
     }
 
-    Create( imageWidth, imageHeight, sRGB ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, formattedData );
+    Width = imageWidth;
+    Height = imageHeight;
+}
+
+void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
+{
+    vector<uint32_t> formattedData;
+    uint16_t imageWidth, imageHeight;
+    DecodeTGA(_filePtr, formattedData, imageWidth, imageHeight);
 
-    delete [] formattedData;
+    Create( imageWidth, imageHeight, sRGB ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, formattedData.data() );
 }
 
 bool Texture::CreateDDSFromMemory( const void* filePtr, size_t fileSize, bool sRGB )
@@ -153,20 +167,397 @@ namespace TextureManager
 {
     wstring s_RootPath = L"";
     map< wstring, unique_ptr<ManagedTexture> > s_TextureCache;
+    mutex s_Mutex;
+
+    // Anyone waiting for a texture sleeps here and is woken whenever a load finishes
+    mutex s_LoadMutex;
+    condition_variable s_LoadCondition;
+
+    // Resources of unloaded textures, kept until the GPU is past the fence they were retired with
+    mutex s_RetiredMutex;
+    queue<pair<uint64_t, Microsoft::WRL::ComPtr<ID3D12Resource>>> s_RetiredResources;
+
+    void RetireResource( uint64_t FenceValue, Microsoft::WRL::ComPtr<ID3D12Resource>&& Resource );
+
+    const Texture& GetMagentaTex2D(void);
+}
+
+//
+// Loads textures on worker threads in three stages connected by bounded queues: reading the
+// file, decoding it into GPU ready data, and creating and uploading the resource.  Each queue
+// hands out the highest priority request first, oldest first within a priority, and a full
+// queue blocks the stage feeding it, which bounds the memory held by loads in flight.
+//
+class TextureStreamer
+{
+public:
+
+    struct Request
+    {
+        ManagedTexture* Texture;
+        wstring FileName;       // Without extension, .dds is tried before .tga
+        bool sRGB;
+        int Priority;
+        uint64_t Sequence;
+
+        Utility::FileView File;     // Points into the asset pack when the file is stored there
+        bool IsDDS;
+        vector<uint32_t> Pixels;
+        uint16_t Width;
+        uint16_t Height;
+    };
+
+    TextureStreamer() : m_ReadQueue(1024), m_DecodeQueue(8), m_UploadQueue(8), m_NextSequence(0) {}
+
+    void Start( void );
+    void Stop( void );
+
+    // Points the texture at a placeholder and queues the load, blocking while the queue is full
+    void Submit( ManagedTexture& Texture, const wstring& FileName, bool sRGB, int Priority );
+
+    // Takes the texture's request out of the queue if no worker has started on it and loads it
+    // on the calling thread.  Returns false if there was no such request.
+    bool LoadNow( const ManagedTexture& Texture );
+
+    static void FinishLoad( ManagedTexture& Texture );
+
+    // Copies finished uploads into their textures' descriptors and wakes anyone waiting for them
+    static void PublishCompletedLoads( void );
+
+    // True if an upload is waiting to be published.  Requires TextureManager::s_LoadMutex.
+    static bool HasCompletedLoads( void ) { return !s_CompletedLoads.empty(); }
+
+private:
+
+    // The upload worker builds the texture off to the side with its own descriptor, because
+    // the render thread may copy the texture's descriptor at any time
+    struct CompletedLoad
+    {
+        ManagedTexture* Target;
+        Texture Staged;
+        DescriptorAllocation Descriptor;
+        bool Loaded;
+    };
+
+    class Queue
+    {
+    public:
+        explicit Queue( size_t Capacity ) : m_Capacity(Capacity), m_Closed(false) {}
+
+        bool Push( Request* R );
+        Request* Pop( void );
+        Request* Remove( const ManagedTexture& Texture );
+        void Close( bool Closed );
+
+    private:
+        struct HigherPriority
+        {
+            bool operator()( const Request* A, const Request* B ) const
+            {
+                return A->Priority != B->Priority ? A->Priority > B->Priority : A->Sequence < B->Sequence;
+            }
+        };
+
+        set<Request*, HigherPriority> m_Requests;
+        size_t m_Capacity;
+        bool m_Closed;
+        mutex m_Mutex;
+        condition_variable m_NotEmpty;
+        condition_variable m_NotFull;
+    };
+
+    static void Read( Request& R );
+    static void Decode( Request& R );
+    static void Upload( Request& R );
+
+    // Leaves the texture of a request that won't be finished invalid and wakes its waiters
+    static void CancelLoad( Request* R );
+
+    void RunStage( Queue& Input, Queue* Output, void (*Work)(Request&) );
+
+    Queue m_ReadQueue;
+    Queue m_DecodeQueue;
+    Queue m_UploadQueue;
+    vector<thread> m_Threads;
+    atomic<uint64_t> m_NextSequence;
+
+    // Guarded by TextureManager::s_LoadMutex
+    static vector<CompletedLoad> s_CompletedLoads;
+};
+
+vector<TextureStreamer::CompletedLoad> TextureStreamer::s_CompletedLoads;
+
+bool TextureStreamer::Queue::Push( Request* R )
+{
+    unique_lock<mutex> Lock(m_Mutex);
+    m_NotFull.wait(Lock, [this] { return m_Closed || m_Requests.size() < m_Capacity; });
+    if (m_Closed)
+        return false;
+
+    m_Requests.insert(R);
+    m_NotEmpty.notify_one();
+    return true;
+}
+
+TextureStreamer::Request* TextureStreamer::Queue::Pop( void )
+{
+    unique_lock<mutex> Lock(m_Mutex);
+    m_NotEmpty.wait(Lock, [this] { return m_Closed || !m_Requests.empty(); });
+    if (m_Closed)
+        return nullptr;
+
+    Request* R = *m_Requests.begin();
+    m_Requests.erase(m_Requests.begin());
+    m_NotFull.notify_one();
+    return R;
+}
+
+TextureStreamer::Request* TextureStreamer::Queue::Remove( const ManagedTexture& Texture )
+{
+    lock_guard<mutex> Lock(m_Mutex);
+    for (auto Iter = m_Requests.begin(); Iter != m_Requests.end(); ++Iter)
+    {
+        if ((*Iter)->Texture == &Texture)
+        {
+            Request* R = *Iter;
+            m_Requests.erase(Iter);
+            m_NotFull.notify_one();
+            return R;
+        }
+    }
+    return nullptr;
+}
+
+void TextureStreamer::Queue::Close( bool Closed )
+{
+    set<Request*, HigherPriority> Dropped;
+    {
+        lock_guard<mutex> Lock(m_Mutex);
+        m_Closed = Closed;
+        if (Closed)
+            Dropped.swap(m_Requests);
+    }
+    m_NotEmpty.notify_all();
+    m_NotFull.notify_all();
+
+    for (Request* R : Dropped)
+        CancelLoad(R);
+}
+
+void TextureStreamer::Start( void )
+{
+    m_ReadQueue.Close(false);
+    m_DecodeQueue.Close(false);
+    m_UploadQueue.Close(false);
+
+    // Reading is mostly waiting and uploading is serialized on the copy queue anyway
+    const uint32_t DecodeThreads = max(thread::hardware_concurrency() / 2, 1u);
+    for (uint32_t i = 0; i < 2; ++i)
+        m_Threads.emplace_back(&TextureStreamer::RunStage, this, ref(m_ReadQueue), &m_DecodeQueue, &TextureStreamer::Read);
+    for (uint32_t i = 0; i < DecodeThreads; ++i)
+        m_Threads.emplace_back(&TextureStreamer::RunStage, this, ref(m_DecodeQueue), &m_UploadQueue, &TextureStreamer::Decode);
+    m_Threads.emplace_back(&TextureStreamer::RunStage, this, ref(m_UploadQueue), nullptr, &TextureStreamer::Upload);
+}
+
+void TextureStreamer::Stop( void )
+{
+    // Requests that haven't finished are cancelled, so nothing waits for them forever
+    m_ReadQueue.Close(true);
+    m_DecodeQueue.Close(true);
+    m_UploadQueue.Close(true);
+
+    for (auto& Thread : m_Threads)
+        Thread.join();
+    m_Threads.clear();
+
+    // Uploads that were never published are released with the textures
+    vector<CompletedLoad> Loads;
+    {
+        lock_guard<mutex> Guard(TextureManager::s_LoadMutex);
+        Loads.swap(s_CompletedLoads);
+    }
+    for (CompletedLoad& Load : Loads)
+        FinishLoad(*Load.Target);
+}
+
+void TextureStreamer::RunStage( Queue& Input, Queue* Output, void (*Work)(Request&) )
+{
+    while (Request* R = Input.Pop())
+    {
+        Work(*R);
+        if (Output == nullptr)
+            delete R;
+        else if (!Output->Push(R))
+            CancelLoad(R);
+    }
+}
+
+void TextureStreamer::Submit( ManagedTexture& Texture, const wstring& FileName, bool sRGB, int Priority )
+{
+    // The descriptor never changes, so callers can keep the SRV and pick up the real texture
+    // once it is written over the placeholder
+    g_Device->CopyDescriptorsSimple(1, Texture.m_hCpuDescriptorHandle, TextureManager::GetBlackTex2D().GetSRV(),
+        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    Request* R = new Request;
+    R->Texture = &Texture;
+    R->FileName = FileName;
+    R->sRGB = sRGB;
+    R->Priority = Priority;
+    R->Sequence = m_NextSequence++;
+    R->IsDDS = false;
+    R->Width = 0;
+    R->Height = 0;
+
+    // Without workers, before Initialize() or after Shutdown(), load it right away
+    if (m_Threads.empty() || !m_ReadQueue.Push(R))
+    {
+        Read(*R);
+        Decode(*R);
+        Upload(*R);
+        delete R;
+    }
+}
+
+bool TextureStreamer::LoadNow( const ManagedTexture& Texture )
+{
+    Request* R = m_ReadQueue.Remove(Texture);
+    if (R == nullptr)
+        return false;
+
+    Read(*R);
+    Decode(*R);
+    Upload(*R);
+    delete R;
+    return true;
+}
+
+void TextureStreamer::FinishLoad( ManagedTexture& Texture )
+{
+    {
+        lock_guard<mutex> Guard(TextureManager::s_LoadMutex);
+        Texture.m_IsLoading = false;
+    }
+    TextureManager::s_LoadCondition.notify_all();
+}
+
+void TextureStreamer::CancelLoad( Request* R )
+{
+    R->Texture->m_IsValid = false;
+    FinishLoad(*R->Texture);
+    delete R;
+}
+
+void TextureStreamer::PublishCompletedLoads( void )
+{
+    vector<CompletedLoad> Loads;
+    {
+        lock_guard<mutex> Guard(TextureManager::s_LoadMutex);
+        Loads.swap(s_CompletedLoads);
+    }
+
+    for (CompletedLoad& Load : Loads)
+    {
+        ManagedTexture& Tex = *Load.Target;
+        if (Load.Loaded)
+        {
+            Tex.m_pResource = Load.Staged.m_pResource;
+            Tex.m_UsageState = Load.Staged.m_UsageState;
+            g_Device->CopyDescriptorsSimple(1, Tex.m_hCpuDescriptorHandle, Load.Staged.GetSRV(),
+                D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        }
+        else
+            Tex.SetToInvalidTexture();
+
+        FinishLoad(Tex);
+    }
+}
+
+void TextureStreamer::Read( Request& R )
+{
+    R.File = Utility::ReadFileView(TextureManager::s_RootPath + R.FileName + L".dds");
+    R.IsDDS = R.File.Size > 0;
+    if (!R.IsDDS)
+        R.File = Utility::ReadFileView(TextureManager::s_RootPath + R.FileName + L".tga");
+}
+
+void TextureStreamer::Decode( Request& R )
+{
+    // DDS data is uploaded as is
+    if (R.IsDDS || R.File.Size == 0)
+        return;
+
+    DecodeTGA(R.File.Data, R.Pixels, R.Width, R.Height);
+    R.File = Utility::FileView();
+}
+
+void TextureStreamer::Upload( Request& R )
+{
+    CompletedLoad Load;
+    Load.Target = R.Texture;
+    Load.Descriptor = AllocateOwnedDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    Load.Staged = Texture(Load.Descriptor.GetCpuHandle());
+    Load.Loaded = false;
+
+    if (R.IsDDS)
+        Load.Loaded = Load.Staged.CreateDDSFromMemory(R.File.Data, R.File.Size, R.sRGB);
+    else if (!R.Pixels.empty())
+    {
+        Load.Staged.Create(R.Width, R.Height, R.sRGB ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM, R.Pixels.data());
+        Load.Loaded = true;
+    }
+
+    if (Load.Loaded)
+        Load.Staged.GetResource()->SetName((R.FileName + (R.IsDDS ? L".dds" : L".tga")).c_str());
+
+    {
+        lock_guard<mutex> Guard(TextureManager::s_LoadMutex);
+        s_CompletedLoads.push_back(std::move(Load));
+    }
+    TextureManager::s_LoadCondition.notify_all();
+}
+
+namespace TextureManager
+{
+    TextureStreamer s_Streamer;
 
     void Initialize( const std::wstring& TextureLibRoot )
     {
         s_RootPath = TextureLibRoot;
+        s_Streamer.Start();
     }
 
     void Shutdown( void )
     {
+        s_Streamer.Stop();
         s_TextureCache.clear();
+
+        lock_guard<mutex> Guard(s_RetiredMutex);
+        s_RetiredResources = decltype(s_RetiredResources)();
+    }
+
+    void PublishCompletedLoads( void )
+    {
+        TextureStreamer::PublishCompletedLoads();
+    }
+
+    void PublishCompletedLoads( void )
+    {
+        TextureStreamer::PublishCompletedLoads();
+    }
+
+    void RetireResource( uint64_t FenceValue, Microsoft::WRL::ComPtr<ID3D12Resource>&& Resource )
+    {
+        lock_guard<mutex> Guard(s_RetiredMutex);
+
+        while (!s_RetiredResources.empty() && g_CommandManager.IsFenceComplete(s_RetiredResources.front().first))
+            s_RetiredResources.pop();
+
+        s_RetiredResources.push(make_pair(FenceValue, std::move(Resource)));
     }
 
     pair<ManagedTexture*, bool> FindOrLoadTexture( const wstring& fileName )
     {
-        static mutex s_Mutex;
         lock_guard<mutex> Guard(s_Mutex);
 
         auto iter = s_TextureCache.find(fileName);
@@ -182,6 +573,12 @@ namespace TextureManager
         return make_pair(NewTexture, true);
     }
 
+    void EraseTexture( const wstring& fileName )
+    {
+        lock_guard<mutex> Guard(s_Mutex);
+        s_TextureCache.erase(fileName);
+    }
+
     const Texture& GetBlackTex2D(void)
     {
         auto ManagedTex = FindOrLoadTexture(L"DefaultBlackTexture");
@@ -197,6 +594,7 @@ namespace TextureManager
 
         uint32_t BlackPixel = 0;
         ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &BlackPixel);
+        TextureStreamer::FinishLoad(*ManTex);
         return *ManTex;
     }
 
@@ -215,6 +613,7 @@ namespace TextureManager
 
         uint32_t WhitePixel = 0xFFFFFFFFul;
         ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &WhitePixel);
+        TextureStreamer::FinishLoad(*ManTex);
         return *ManTex;
     }
 
@@ -233,33 +632,83 @@ namespace TextureManager
 
         uint32_t MagentaPixel = 0x00FF00FF;
         ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &MagentaPixel);
+        TextureStreamer::FinishLoad(*ManTex);
         return *ManTex;
     }
 
 } // namespace TextureManager
 
+ManagedTexture::ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true), m_IsLoading(true)
+{
+    // Owned by the texture so unloading it can return the descriptor
+    m_Descriptor = AllocateOwnedDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_hCpuDescriptorHandle = m_Descriptor.GetCpuHandle();
+}
+
 void ManagedTexture::WaitForLoad( void ) const
 {
-    volatile D3D12_CPU_DESCRIPTOR_HANDLE& VolHandle = (volatile D3D12_CPU_DESCRIPTOR_HANDLE&)m_hCpuDescriptorHandle;
-    volatile bool& VolValid = (volatile bool&)m_IsValid;
-    while (VolHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN && VolValid)
-        this_thread::yield();
+    if (!m_IsLoading)
+        return;
+
+    // Rather than wait behind everything queued before it, load it on this thread
+    TextureManager::s_Streamer.LoadNow(*this);
+
+    // The upload finishes on a worker, but only this thread may publish it
+    unique_lock<mutex> Lock(TextureManager::s_LoadMutex);
+    while (m_IsLoading)
+    {
+        TextureManager::s_LoadCondition.wait(Lock, [this] { return !m_IsLoading || TextureStreamer::HasCompletedLoads(); });
+        if (TextureStreamer::HasCompletedLoads())
+        {
+            Lock.unlock();
+            TextureStreamer::PublishCompletedLoads();
+            Lock.lock();
+        }
+    }
+}
+
+void ManagedTexture::Unload( void )
+{
+    WaitForLoad();
+
+    // Frames in flight may still sample it.  Have the graphics queue wait for the compute queue
+    // on the GPU so a single graphics fence covers both, rather than stalling the CPU.
+    CommandQueue& GraphicsQueue = g_CommandManager.GetGraphicsQueue();
+    GraphicsQueue.StallForProducer(g_CommandManager.GetComputeQueue());
+    const uint64_t FenceValue = GraphicsQueue.IncrementFence();
+
+    m_Descriptor.Release(FenceValue);
+    TextureManager::RetireResource(FenceValue, std::move(m_pResource));
+
+    Destroy();
+
+    // This deletes the texture, so it must come last
+    TextureManager::EraseTexture(m_MapKey);
 }
 
 void ManagedTexture::SetToInvalidTexture( void )
 {
-    m_hCpuDescriptorHandle = TextureManager::GetMagentaTex2D().GetSRV();
+    // Keep the descriptor that was already handed out and make it show the magenta texture
+    g_Device->CopyDescriptorsSimple(1, m_hCpuDescriptorHandle, TextureManager::GetMagentaTex2D().GetSRV(),
+        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     m_IsValid = false;
 }
 
-const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName, bool sRGB )
+const ManagedTexture* TextureManager::LoadFromFileAsync( const std::wstring& fileName, bool sRGB, int Priority )
 {
-    std::wstring CatPath = fileName;
+    auto ManagedTex = FindOrLoadTexture(fileName);
+
+    ManagedTexture* ManTex = ManagedTex.first;
+    if (ManagedTex.second)
+        s_Streamer.Submit(*ManTex, fileName, sRGB, Priority);
 
-    const ManagedTexture* Tex = LoadDDSFromFile( CatPath + L".dds", sRGB );
-    if (!Tex->IsValid())
-        Tex = LoadTGAFromFile( CatPath + L".tga", sRGB );
+    return ManTex;
+}
 
+const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName, bool sRGB )
+{
+    const ManagedTexture* Tex = LoadFromFileAsync(fileName, sRGB);
+    Tex->WaitForLoad();
     return Tex;
 }
 
@@ -276,12 +725,13 @@ const ManagedTexture* TextureManager::LoadDDSFromFile( const std::wstring& fileN
         return ManTex;
     }
 
-    Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-    if (ba->size() == 0 || !ManTex->CreateDDSFromMemory( ba->data(), ba->size(), sRGB ))
+    Utility::FileView File = Utility::ReadFileView( s_RootPath + fileName );
+    if (File.Size == 0 || !ManTex->CreateDDSFromMemory( File.Data, File.Size, sRGB ))
         ManTex->SetToInvalidTexture();
     else
         ManTex->GetResource()->SetName(fileName.c_str());
 
+    TextureStreamer::FinishLoad(*ManTex);
     return ManTex;
 }
 
@@ -298,15 +748,16 @@ const ManagedTexture* TextureManager::LoadTGAFromFile( const std::wstring& fileN
         return ManTex;
     }
 
-    Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-    if (ba->size() > 0)
+    Utility::FileView File = Utility::ReadFileView( s_RootPath + fileName );
+    if (File.Size > 0)
     {
-        ManTex->CreateTGAFromMemory( ba->data(), ba->size(), sRGB );
+        ManTex->CreateTGAFromMemory( File.Data, File.Size, sRGB );
         ManTex->GetResource()->SetName(fileName.c_str());
     }
     else
         ManTex->SetToInvalidTexture();
 
+    TextureStreamer::FinishLoad(*ManTex);
     return ManTex;
 }
 
@@ -324,14 +775,15 @@ const ManagedTexture* TextureManager::LoadPIXImageFromFile( const std::wstring&
         return ManTex;
     }
 
-    Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-    if (ba->size() > 0)
+    Utility::FileView File = Utility::ReadFileView( s_RootPath + fileName );
+    if (File.Size > 0)
     {
-        ManTex->CreatePIXImageFromMemory(ba->data(), ba->size());
+        ManTex->CreatePIXImageFromMemory(File.Data, File.Size);
         ManTex->GetResource()->SetName(fileName.c_str());
     }
     else
         ManTex->SetToInvalidTexture();
 
+    TextureStreamer::FinishLoad(*ManTex);
     return ManTex;
 }
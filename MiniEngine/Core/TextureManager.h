@@ -16,11 +16,14 @@
 
 #include "pch.h"
 #include "GpuResource.h"
+#include "DescriptorHeap.h"
 #include "Utility.h"
+#include <atomic>
 
 class Texture : public GpuResource
 {
     friend class CommandContext;
+    friend class TextureStreamer;
 
 public:
 
@@ -55,12 +58,21 @@ protected:
 
 class ManagedTexture : public Texture
 {
+    friend class TextureStreamer;
+
 public:
-    ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true) {}
+    ManagedTexture( const std::wstring& FileName );
 
     void operator= ( const Texture& Texture );
 
+    // Blocks until the texture or its invalid placeholder is in place.  A texture still queued
+    // for streaming is loaded on the calling thread instead.  Publishes finished loads while it
+    // waits, so like TextureManager::PublishCompletedLoads() it must be called on the render thread.
     void WaitForLoad(void) const;
+    bool IsLoading(void) const { return m_IsLoading; }
+
+    // Removes the texture from the texture manager, which deletes this object.  The resource and
+    // descriptor are released once the GPU has finished the work submitted before this call.
     void Unload(void);
 
     void SetToInvalidTexture(void);
@@ -68,7 +80,9 @@ public:
 
 private:
     std::wstring m_MapKey;		// For deleting from the map later
+    DescriptorAllocation m_Descriptor;
     bool m_IsValid;
+    std::atomic<bool> m_IsLoading;
 };
 
 namespace TextureManager
@@ -76,7 +90,16 @@ namespace TextureManager
     void Initialize( const std::wstring& TextureLibRoot );
     void Shutdown(void);
 
+    // Points textures whose streaming finished at their new resource.  Called on the render
+    // thread at the start of each frame, since it rewrites descriptors the frame may copy.
+    void PublishCompletedLoads(void);
+
     const ManagedTexture* LoadFromFile( const std::wstring& fileName, bool sRGB = false );
+
+    // Queues the texture, given without extension, to be streamed in on worker threads and
+    // returns at once.  Its SRV shows black until the load completes and is then rewritten in
+    // place by PublishCompletedLoads().  Higher priorities are loaded first.
+    const ManagedTexture* LoadFromFileAsync( const std::wstring& fileName, bool sRGB = false, int Priority = 0 );
     const ManagedTexture* LoadDDSFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadTGAFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadPIXImageFromFile( const std::wstring& fileName );
@@ -86,6 +109,11 @@ namespace TextureManager
         return LoadFromFile(MakeWStr(fileName), sRGB);
     }
 
+    inline const ManagedTexture* LoadFromFileAsync( const std::string& fileName, bool sRGB = false, int Priority = 0 )
+    {
+        return LoadFromFileAsync(MakeWStr(fileName), sRGB, Priority);
+    }
+
     inline const ManagedTexture* LoadDDSFromFile( const std::string& fileName, bool sRGB = false )
     {
         return LoadDDSFromFile(MakeWStr(fileName), sRGB);
@@ -0,0 +1,363 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+//
+// Records begin and end markers from any thread into a ring buffer per thread, always, and turns a
+// window of them into a Chrome trace (chrome://tracing, ui.perfetto.dev) on request.
+//
+// A marker is a name interned once into an ID, a time stamp and a store into the thread's ring, so
+// recording costs about as much as reading the clock.  Nothing is locked except to intern a name or
+// to give a thread its ring.  A thread has one ring per recorder, which it keeps when it goes back
+// and forth between recorders, and which a later thread given the same ID takes over.  Rings hold the last kEventsPerTrack events, older ones are overwritten,
+// and exporting copies them while they are written, dropping whatever may have been overwritten.
+//
+// Ticks are std::chrono::steady_clock nanoseconds, which MSVC derives from the performance counter.
+// Events timed elsewhere, like GPU time stamps converted to that clock, go on tracks made with
+// AddTrack() that a single thread writes.
+//
+class TraceRecorder
+{
+public:
+
+    static const uint32_t kEventsPerTrack = 1 << 16;
+
+    enum EventType : uint32_t
+    {
+        kBegin,
+        kEnd,
+        kFrame      // Id is the frame index
+    };
+
+    TraceRecorder() : m_Generation(++NextGeneration()) {}
+
+    // The ID of a name, the same for every call with that name
+    uint32_t Intern( const std::string& Name )
+    {
+        std::lock_guard<std::mutex> LockGuard(m_NameMutex);
+        auto Iter = m_NameIds.find(Name);
+        if (Iter != m_NameIds.end())
+            return Iter->second;
+
+        uint32_t Id = (uint32_t)m_Names.size();
+        m_Names.push_back(Name);
+        m_NameIds[Name] = Id;
+        return Id;
+    }
+
+    // Names the calling thread's track in exported traces
+    void SetThreadName( const std::string& Name )
+    {
+        Track& ThreadTrack = GetThreadTrack();
+        std::lock_guard<std::mutex> LockGuard(m_TrackMutex);
+        ThreadTrack.Name = Name;
+    }
+
+    // Begin and End must nest on each thread
+    void Begin( uint32_t Id ) { Record(GetThreadTrack(), Id, kBegin, GetTick()); }
+    void End( uint32_t Id ) { Record(GetThreadTrack(), Id, kEnd, GetTick()); }
+    void MarkFrame( uint32_t FrameIndex ) { Record(GetThreadTrack(), FrameIndex, kFrame, GetTick()); }
+
+    // A track for events recorded with RecordOnTrack(), in the order they nest, by one thread at a time
+    uint32_t AddTrack( const std::string& Name )
+    {
+        std::lock_guard<std::mutex> LockGuard(m_TrackMutex);
+        m_Tracks.emplace_back(new Track(Name, (uint32_t)m_Tracks.size()));
+        return m_Tracks.back()->Index;
+    }
+
+    void RecordOnTrack( uint32_t TrackIndex, uint32_t Id, EventType Type, int64_t Tick )
+    {
+        Track* Target;
+        {
+            std::lock_guard<std::mutex> LockGuard(m_TrackMutex);
+            Target = m_Tracks[TrackIndex].get();
+        }
+        Record(*Target, Id, Type, Tick);
+    }
+
+    // Appends the markers that began and ended between the two ticks to Json as a trace event file,
+    // and returns how many there were.  Markers still open at EndTick are left out.
+    size_t ExportChromeTrace( int64_t StartTick, int64_t EndTick, std::string& Json ) const
+    {
+        std::vector<std::string> Names;
+        {
+            std::lock_guard<std::mutex> LockGuard(m_NameMutex);
+            Names = m_Names;
+        }
+        std::vector<std::pair<Track*, std::string>> Tracks;
+        {
+            std::lock_guard<std::mutex> LockGuard(m_TrackMutex);
+            for (const std::unique_ptr<Track>& Existing : m_Tracks)
+                Tracks.emplace_back(Existing.get(), Existing->Name);
+        }
+
+        size_t MarkerCount = 0;
+        Json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool First = true;
+
+        std::vector<Event> Events;
+        std::vector<const Event*> Open;
+        for (const std::pair<Track*, std::string>& Entry : Tracks)
+        {
+            const uint32_t Tid = Entry.first->Index + 1;
+            AppendEvent(Json, First, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", Tid);
+            AppendString(Json, Entry.second);
+            Json += "}}";
+
+            Snapshot(*Entry.first, Events);
+            Open.clear();
+            for (const Event& E : Events)
+            {
+                if (E.Tick < StartTick || E.Tick > EndTick)
+                    continue;
+
+                if (E.Type == kBegin)
+                {
+                    Open.push_back(&E);
+                }
+                else if (E.Type == kEnd)
+                {
+                    // Ends whose begin is before the window, or was overwritten, are dropped
+                    if (Open.empty() || Open.back()->Id != E.Id)
+                    {
+                        Open.clear();
+                        continue;
+                    }
+                    const Event& B = *Open.back();
+                    Open.pop_back();
+
+                    AppendEvent(Json, First, "{\"ph\":\"X\",\"pid\":1,\"tid\":%u,", Tid);
+                    AppendTime(Json, "ts", B.Tick - StartTick);
+                    Json += ",";
+                    AppendTime(Json, "dur", E.Tick - B.Tick);
+                    Json += ",\"name\":";
+                    AppendString(Json, B.Id < Names.size() ? Names[B.Id] : std::string("?"));
+                    Json += "}";
+                    ++MarkerCount;
+                }
+                else
+                {
+                    char Name[32];
+                    std::snprintf(Name, sizeof(Name), "Frame %u", E.Id);
+                    AppendEvent(Json, First, "{\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,", Tid);
+                    AppendTime(Json, "ts", E.Tick - StartTick);
+                    Json += ",\"name\":";
+                    AppendString(Json, Name);
+                    Json += "}";
+                }
+            }
+        }
+
+        Json += "\n]}\n";
+        return MarkerCount;
+    }
+
+    static int64_t GetTick( void )
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static double TicksToMicroseconds( int64_t Ticks ) { return Ticks * 1e-3; }
+
+private:
+
+    struct Event
+    {
+        int64_t Tick;
+        uint32_t Id;
+        uint32_t Type;
+    };
+
+    // Exporting reads slots while their thread may overwrite them, so each field is atomic.  Relaxed
+    // loads and stores are plain moves, and the write index orders whole events.
+    struct Slot
+    {
+        std::atomic<int64_t> Tick;
+        std::atomic<uint32_t> Id;
+        std::atomic<uint32_t> Type;
+    };
+
+    struct Track
+    {
+        Track( const std::string& TrackName, uint32_t TrackIndex )
+            : Name(TrackName), Index(TrackIndex), WriteIndex(0), Slots(new Slot[kEventsPerTrack]) {}
+
+        std::string Name;
+        uint32_t Index;
+        std::atomic<uint64_t> WriteIndex;       // Events written ever, only the writer changes it
+        std::unique_ptr<Slot[]> Slots;
+    };
+
+    static const uint32_t kThreadCacheSlots = 4;    // Recorders a thread finds its track in without locking
+
+    struct ThreadCache
+    {
+        ThreadCache() : NextSlot(0)
+        {
+            for (uint32_t Slot = 0; Slot < kThreadCacheSlots; ++Slot)
+            {
+                Generation[Slot] = 0;
+                Owner[Slot] = nullptr;
+            }
+        }
+
+        uint32_t Generation[kThreadCacheSlots];
+        Track* Owner[kThreadCacheSlots];
+        uint32_t NextSlot;      // Replaced on a miss
+    };
+
+    static std::atomic<uint32_t>& NextGeneration( void )
+    {
+        static std::atomic<uint32_t> s_NextGeneration(0);
+        return s_NextGeneration;
+    }
+
+    // Threads cache their tracks by the recorder's generation, which is never reused, so a cached
+    // track of a destroyed recorder is never touched
+    Track& GetThreadTrack( void )
+    {
+        static thread_local ThreadCache s_Cache;
+        for (uint32_t Slot = 0; Slot < kThreadCacheSlots; ++Slot)
+        {
+            if (s_Cache.Generation[Slot] == m_Generation)
+                return *s_Cache.Owner[Slot];
+        }
+        return CacheThreadTrack(s_Cache);
+    }
+
+    // Only the thread with that ID writes a track, and one that exited writes no more
+    Track& CacheThreadTrack( ThreadCache& Cache )
+    {
+        Track* ThreadTrack;
+        {
+            std::lock_guard<std::mutex> LockGuard(m_TrackMutex);
+            Track*& Existing = m_ThreadTracks[std::this_thread::get_id()];
+            if (Existing == nullptr)
+            {
+                uint32_t Index = (uint32_t)m_Tracks.size();
+                m_Tracks.emplace_back(new Track("Thread " + std::to_string(Index), Index));
+                Existing = m_Tracks.back().get();
+            }
+            ThreadTrack = Existing;
+        }
+
+        const uint32_t Slot = Cache.NextSlot++ % kThreadCacheSlots;
+        Cache.Generation[Slot] = m_Generation;
+        Cache.Owner[Slot] = ThreadTrack;
+        return *ThreadTrack;
+    }
+
+    static void Record( Track& Target, uint32_t Id, uint32_t Type, int64_t Tick )
+    {
+        uint64_t Index = Target.WriteIndex.load(std::memory_order_relaxed);
+
+        // Whoever sees this event's fields in the slot also sees the write index that says it's in progress
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Slot& S = Target.Slots[Index & (kEventsPerTrack - 1)];
+        S.Tick.store(Tick, std::memory_order_relaxed);
+        S.Id.store(Id, std::memory_order_relaxed);
+        S.Type.store(Type, std::memory_order_relaxed);
+        Target.WriteIndex.store(Index + 1, std::memory_order_release);
+    }
+
+    // Copies the events of a track in the order they were recorded
+    static void Snapshot( const Track& Source, std::vector<Event>& Events )
+    {
+        uint64_t EndIndex = Source.WriteIndex.load(std::memory_order_acquire);
+        uint64_t FirstIndex = EndIndex > kEventsPerTrack ? EndIndex - kEventsPerTrack : 0;
+
+        Events.clear();
+        for (uint64_t Index = FirstIndex; Index < EndIndex; ++Index)
+        {
+            const Slot& S = Source.Slots[Index & (kEventsPerTrack - 1)];
+            Event E;
+            E.Tick = S.Tick.load(std::memory_order_relaxed);
+            E.Id = S.Id.load(std::memory_order_relaxed);
+            E.Type = S.Type.load(std::memory_order_relaxed);
+            Events.push_back(E);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // The writer may since have overwritten the oldest events, up to the slot of the one it is writing now
+        uint64_t WrittenSince = Source.WriteIndex.load(std::memory_order_acquire);
+        if (WrittenSince + 1 > FirstIndex + kEventsPerTrack)
+        {
+            uint64_t Overwritten = WrittenSince + 1 - kEventsPerTrack - FirstIndex;
+            Events.erase(Events.begin(), Events.begin() + (size_t)std::min<uint64_t>(Overwritten, Events.size()));
+        }
+    }
+
+    static void AppendEvent( std::string& Json, bool& First, const char* Format, uint32_t Tid )
+    {
+        char Buffer[128];
+        std::snprintf(Buffer, sizeof(Buffer), Format, Tid);
+        if (!First)
+            Json += ",\n";
+        First = false;
+        Json += Buffer;
+    }
+
+    static void AppendTime( std::string& Json, const char* Key, int64_t Ticks )
+    {
+        char Buffer[64];
+        std::snprintf(Buffer, sizeof(Buffer), "\"%s\":%.3f", Key, TicksToMicroseconds(Ticks));
+        Json += Buffer;
+    }
+
+    static void AppendString( std::string& Json, const std::string& Value )
+    {
+        Json += '"';
+        for (char C : Value)
+        {
+            if (C == '"' || C == '\\')
+            {
+                Json += '\\';
+                Json += C;
+            }
+            else if ((unsigned char)C < 0x20)
+            {
+                char Escaped[8];
+                std::snprintf(Escaped, sizeof(Escaped), "\\u%04x", (unsigned)C);
+                Json += Escaped;
+            }
+            else
+            {
+                Json += C;
+            }
+        }
+        Json += '"';
+    }
+
+    const uint32_t m_Generation;
+
+    mutable std::mutex m_NameMutex;
+    std::vector<std::string> m_Names;
+    std::unordered_map<std::string, uint32_t> m_NameIds;
+
+    mutable std::mutex m_TrackMutex;
+    std::vector<std::unique_ptr<Track>> m_Tracks;
+    std::unordered_map<std::thread::id, Track*> m_ThreadTracks;
+};
@@ -14,15 +14,20 @@
 #include "Model.h"
 #include <string.h>
 #include <float.h>
+#include <algorithm>
 
 Model::Model()
     : m_pMesh(nullptr)
+    , m_pClusters(nullptr)
+    , m_ClusterCount(0)
     , m_pMaterial(nullptr)
     , m_pVertexData(nullptr)
     , m_pIndexData(nullptr)
     , m_pVertexDataDepth(nullptr)
     , m_pIndexDataDepth(nullptr)
     , m_SRVs(nullptr)
+    , m_pMappedFile(nullptr)
+    , m_OwnsMappedFile(false)
 {
     Clear();
 }
@@ -39,10 +44,30 @@ void Model::Clear()
     m_VertexBufferDepth.Destroy();
     m_IndexBufferDepth.Destroy();
 
+    if (m_pMappedFile != nullptr)
+    {
+        // these were never allocated, they point into the file mapping
+        m_pMesh = nullptr;
+        m_pClusters = nullptr;
+        m_pMaterial = nullptr;
+        m_pVertexData = nullptr;
+        m_pIndexData = nullptr;
+        m_pVertexDataDepth = nullptr;
+        m_pIndexDataDepth = nullptr;
+
+        if (m_OwnsMappedFile)
+            UnmapViewOfFile(m_pMappedFile);
+        m_pMappedFile = nullptr;
+    }
+
     delete [] m_pMesh;
     m_pMesh = nullptr;
     m_Header.meshCount = 0;
 
+    delete [] m_pClusters;
+    m_pClusters = nullptr;
+    m_ClusterCount = 0;
+
     delete [] m_pMaterial;
     m_pMaterial = nullptr;
     m_Header.materialCount = 0;
@@ -59,6 +84,7 @@ void Model::Clear()
     m_pVertexDataDepth = nullptr;
     m_Header.vertexDataByteSizeDepth = 0;
     m_pIndexDataDepth = nullptr;
+    m_Header.indexSize = sizeof(uint16_t);
 
     ReleaseTextures();
 
@@ -127,3 +153,50 @@ void Model::ComputeAllBoundingBoxes()
     }
     ComputeGlobalBoundingBox(m_Header.boundingBox);
 }
+
+void Model::CullMesh(uint32_t meshIndex, const Frustum& frustum, Vector3 viewerPos, bool cullBackfaces, std::vector<DrawRange>& ranges) const
+{
+    const Mesh& mesh = m_pMesh[meshIndex];
+    if (!frustum.IntersectBoundingBox(mesh.boundingBox.min, mesh.boundingBox.max))
+        return;
+
+    const uint32_t meshStartIndex = mesh.indexDataByteOffset / m_Header.indexSize;
+
+    const Cluster *clusterEnd = m_pClusters + m_ClusterCount;
+    const Cluster *cluster = std::lower_bound(m_pClusters, clusterEnd, meshIndex,
+        [](const Cluster& c, uint32_t index) { return c.meshIndex < index; });
+    if (cluster == clusterEnd || cluster->meshIndex != meshIndex)
+    {
+        ranges.push_back({ meshIndex, meshStartIndex, mesh.indexCount });
+        return;
+    }
+
+    // the last range is only extended if it was started by this call
+    const size_t firstRange = ranges.size();
+
+    for (; cluster != clusterEnd && cluster->meshIndex == meshIndex; ++cluster)
+    {
+        Vector3 center(cluster->center[0], cluster->center[1], cluster->center[2]);
+        Scalar radius(cluster->radius);
+
+        if (!frustum.IntersectSphere(BoundingSphere(center, radius)))
+            continue;
+
+        // Every point of the sphere sees every face of the cluster from behind when the
+        // direction to it is within 90 degrees minus the cone angle of the cone axis.
+        if (cullBackfaces && cluster->coneCutoff < 1.0f)
+        {
+            Vector3 axis(cluster->coneAxis[0], cluster->coneAxis[1], cluster->coneAxis[2]);
+            Vector3 toCenter = center - viewerPos;
+            float distance = Length(toCenter);
+            if (Dot(toCenter, axis) >= cluster->coneCutoff * (distance + cluster->radius) + cluster->radius)
+                continue;
+        }
+
+        uint32_t startIndex = meshStartIndex + cluster->indexOffset;
+        if (ranges.size() > firstRange && ranges.back().startIndex + ranges.back().indexCount == startIndex)
+            ranges.back().indexCount += cluster->indexCount;
+        else
+            ranges.push_back({ meshIndex, startIndex, cluster->indexCount });
+    }
+}
@@ -17,9 +17,13 @@
 #include "VectorMath.h"
 #include "TextureManager.h"
 #include "GpuBuffer.h"
+#include "Math/Frustum.h"
+#include <vector>
 
 using namespace Math;
 
+#define H3D_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
 class Model
 {
 public:
@@ -110,10 +114,57 @@ public:
         uint32_t vertexDataByteSize;
         uint32_t indexDataByteSize;
         uint32_t vertexDataByteSizeDepth;
+        uint32_t indexSize; // bytes per index, 2 or 4. Fits in what used to be padding, legacy files always use 2
         BoundingBox boundingBox;
     };
     Header m_Header;
 
+    // H3D v2 is a chunked container laid out so a file mapping can be used in place:
+    // an H3DFileHeader, a table of H3DChunk entries, then the chunks, each starting on
+    // an h3d_chunk_alignment boundary. Files without the magic are read as the legacy
+    // format (Header, meshes, materials, vertex and index data back to back).
+    enum
+    {
+        h3d_version_1 = 1, // legacy
+        h3d_version_2 = 2,
+        h3d_version_current = h3d_version_2,
+
+        h3d_chunk_alignment = 64,
+    };
+
+    enum : uint32_t
+    {
+        h3d_magic = H3D_FOURCC('H', '3', 'D', 'C'),
+
+        h3d_chunk_header = H3D_FOURCC('H', 'E', 'A', 'D'), // Header
+        h3d_chunk_meshes = H3D_FOURCC('M', 'E', 'S', 'H'), // Mesh[meshCount]
+        h3d_chunk_materials = H3D_FOURCC('M', 'A', 'T', 'L'), // Material[materialCount]
+        h3d_chunk_vertices = H3D_FOURCC('V', 'T', 'X', '0'), // vertexDataByteSize bytes
+        h3d_chunk_indices = H3D_FOURCC('I', 'D', 'X', '0'), // indexDataByteSize bytes
+        h3d_chunk_vertices_depth = H3D_FOURCC('V', 'T', 'X', 'D'), // vertexDataByteSizeDepth bytes
+        h3d_chunk_indices_depth = H3D_FOURCC('I', 'D', 'X', 'D'), // indexDataByteSize bytes
+        h3d_chunk_clusters = H3D_FOURCC('C', 'L', 'S', 'T'), // Cluster[m_ClusterCount], optional
+    };
+
+    struct H3DFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t chunkCount;
+        uint32_t chunkTableOffset; // byte offset from the start of the file
+    };
+
+    struct H3DChunk
+    {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset; // byte offset from the start of the file, aligned to h3d_chunk_alignment
+        uint64_t size;
+    };
+
+	// Quantized meshes follow a few conventions on top of what the table describes:
+	// - normalized integer positions are relative to Mesh::boundingBox
+	// - normals, tangents and bitangents with 2 components are octahedral encoded
 	struct Attrib
 	{
 		uint16_t offset; // byte offset from the start of the vertex
@@ -144,6 +195,34 @@ public:
     };
     Mesh *m_pMesh;
 
+    // Clusters split the index range of a mesh into pieces small enough to be culled on their
+    // own. They only describe the main index buffer, the depth-only stream is ordered differently.
+    enum
+    {
+        cluster_max_vertices = 64,
+        cluster_max_triangles = 124,
+    };
+    struct Cluster
+    {
+        float center[3]; // bounding sphere, model space
+        float radius;
+        float coneAxis[3]; // every face normal is within the cone around this axis
+        float coneCutoff; // sine of the cone half angle, 1 if the cluster can't be backface culled
+        uint32_t meshIndex; // clusters are sorted by mesh
+        uint32_t indexOffset; // first index of the cluster, relative to the start of the mesh
+        uint32_t indexCount;
+        uint32_t padding;
+    };
+    Cluster *m_pClusters;
+    uint32_t m_ClusterCount;
+
+    struct DrawRange
+    {
+        uint32_t meshIndex;
+        uint32_t startIndex; // from the start of the index buffer
+        uint32_t indexCount;
+    };
+
     struct Material
     {
         Vector3 diffuse;
@@ -192,6 +271,12 @@ public:
 		return m_Header.boundingBox;
 	}
 
+	// Appends the parts of a mesh that may be visible to ranges. The frustum and viewer position
+	// are in model space. Meshes without clusters are only tested with their bounding box, and
+	// adjacent visible clusters are merged into a single range. Pass cullBackfaces = false for
+	// meshes drawn two-sided, the normal cones only hold when back faces are culled.
+	void CullMesh(uint32_t meshIndex, const Frustum& frustum, Vector3 viewerPos, bool cullBackfaces, std::vector<DrawRange>& ranges) const;
+
     D3D12_CPU_DESCRIPTOR_HANDLE* GetSRVs( uint32_t materialIdx ) const
     {
         return m_SRVs + materialIdx * 6;
@@ -200,7 +285,12 @@ public:
 protected:
 
 	bool LoadH3D(const char *filename);
-	bool SaveH3D(const char *filename) const;
+	bool LoadH3DMapped(const char *filename);
+	bool LoadH3DView(uint64_t dataSize);
+	bool ParseH3DView(uint64_t dataSize);
+	bool SaveH3D(const char *filename, uint32_t version = h3d_version_1) const;
+	bool SaveH3DChunked(const char *filename) const;
+	void CreateBuffers();
 
 	void ComputeMeshBoundingBox(unsigned int meshIndex, BoundingBox &bbox) const;
 	void ComputeGlobalBoundingBox(BoundingBox &bbox) const;
@@ -209,4 +299,9 @@ protected:
     void ReleaseTextures();
     void LoadTextures();
     D3D12_CPU_DESCRIPTOR_HANDLE* m_SRVs;
+
+    // view of an H3D v2 file, set when m_pMesh, m_pMaterial and the vertex/index data point into it
+    void* m_pMappedFile;
+    // false when the view belongs to a mounted asset pack
+    bool m_OwnsMappedFile;
 };
@@ -17,17 +17,87 @@
 #include "GraphicsCore.h"
 #include "DescriptorHeap.h"
 #include "CommandContext.h"
+#include "FileUtility.h"
 #include <stdio.h>
 
+#if _DEBUG
+static void ValidateMeshes(const Model& model)
+{
+    for (uint32_t meshIndex = 1; meshIndex < model.m_Header.meshCount; ++meshIndex)
+    {
+        const Model::Mesh& mesh = model.m_pMesh[meshIndex];
+        ASSERT(mesh.vertexStride == model.m_VertexStride);
+        ASSERT(mesh.vertexStrideDepth == model.m_VertexStrideDepth);
+    }
+    for (uint32_t meshIndex = 0; meshIndex < model.m_Header.meshCount; ++meshIndex)
+    {
+        const Model::Mesh& mesh = model.m_pMesh[meshIndex];
+
+        ASSERT( mesh.attribsEnabled ==
+            (Model::attrib_mask_position | Model::attrib_mask_texcoord0 | Model::attrib_mask_normal | Model::attrib_mask_tangent | Model::attrib_mask_bitangent) );
+
+        // either the float layout or the one written by the converter's -quantize option
+        auto IsFormat = [](const Model::Attrib& attrib, uint16_t components, uint16_t format, uint16_t normalized)
+        {
+            return attrib.components == components && attrib.format == format && attrib.normalized == normalized;
+        };
+        ASSERT(IsFormat(mesh.attrib[0], 3, Model::attrib_format_float, 0) || IsFormat(mesh.attrib[0], 3, Model::attrib_format_ushort, 1)); // position
+        ASSERT(IsFormat(mesh.attrib[1], 2, Model::attrib_format_float, 0) || IsFormat(mesh.attrib[1], 2, Model::attrib_format_ushort, 1)); // texcoord0
+        ASSERT(IsFormat(mesh.attrib[2], 3, Model::attrib_format_float, 0) || IsFormat(mesh.attrib[2], 2, Model::attrib_format_short, 1)); // normal
+        ASSERT(IsFormat(mesh.attrib[3], 3, Model::attrib_format_float, 0) || IsFormat(mesh.attrib[3], 2, Model::attrib_format_short, 1)); // tangent
+        ASSERT(IsFormat(mesh.attrib[4], 3, Model::attrib_format_float, 0) || IsFormat(mesh.attrib[4], 2, Model::attrib_format_short, 1)); // bitangent
+
+        ASSERT( mesh.attribsEnabledDepth ==
+            (Model::attrib_mask_position) );
+        ASSERT(IsFormat(mesh.attribDepth[0], 3, Model::attrib_format_float, 0) || IsFormat(mesh.attribDepth[0], 3, Model::attrib_format_ushort, 1)); // position
+    }
+}
+#endif
+
+void Model::CreateBuffers()
+{
+    m_VertexStride = m_pMesh[0].vertexStride;
+    m_VertexStrideDepth = m_pMesh[0].vertexStrideDepth;
+#if _DEBUG
+    ValidateMeshes(*this);
+#endif
+
+    m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, m_pVertexData);
+    m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / m_Header.indexSize, m_Header.indexSize, m_pIndexData);
+
+    m_VertexBufferDepth.Create(L"VertexBufferDepth", m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth, m_VertexStrideDepth, m_pVertexDataDepth);
+    m_IndexBufferDepth.Create(L"IndexBufferDepth", m_Header.indexDataByteSize / m_Header.indexSize, m_Header.indexSize, m_pIndexDataDepth);
+}
+
 bool Model::LoadH3D(const char *filename)
 {
+    // chunked files in a mounted asset pack are used in place
+    size_t packedSize = 0;
+    const unsigned char *packed = Utility::FindPackedFile(MakeWStr(filename), packedSize);
+    if (packed != nullptr && packedSize >= sizeof(H3DFileHeader) && ((const H3DFileHeader*)packed)->magic == h3d_magic)
+    {
+        m_pMappedFile = (void*)packed;
+        m_OwnsMappedFile = false;
+        return LoadH3DView(packedSize);
+    }
+
     FILE *file = nullptr;
     if (0 != fopen_s(&file, filename, "rb"))
         return false;
 
     bool ok = false;
 
+    // chunked files are mapped instead of read
+    uint32_t magic = 0;
+    if (1 == fread(&magic, sizeof(magic), 1, file) && magic == h3d_magic)
+    {
+        fclose(file);
+        return LoadH3DMapped(filename);
+    }
+    if (0 != fseek(file, 0, SEEK_SET)) goto h3d_load_fail;
+
     if (1 != fread(&m_Header, sizeof(Header), 1, file)) goto h3d_load_fail;
+    m_Header.indexSize = sizeof(uint16_t); // whatever was written here was padding
 
     m_pMesh = new Mesh [m_Header.meshCount];
     m_pMaterial = new Material [m_Header.materialCount];
@@ -37,33 +107,6 @@ bool Model::LoadH3D(const char *filename)
     if (m_Header.materialCount > 0)
         if (1 != fread(m_pMaterial, sizeof(Material) * m_Header.materialCount, 1, file)) goto h3d_load_fail;
 
-    m_VertexStride = m_pMesh[0].vertexStride;
-    m_VertexStrideDepth = m_pMesh[0].vertexStrideDepth;
-#if _DEBUG
-    for (uint32_t meshIndex = 1; meshIndex < m_Header.meshCount; ++meshIndex)
-    {
-        const Mesh& mesh = m_pMesh[meshIndex];
-        ASSERT(mesh.vertexStride == m_VertexStride);
-        ASSERT(mesh.vertexStrideDepth == m_VertexStrideDepth);
-    }
-    for (uint32_t meshIndex = 0; meshIndex < m_Header.meshCount; ++meshIndex)
-    {
-        const Mesh& mesh = m_pMesh[meshIndex];
-
-        ASSERT( mesh.attribsEnabled ==
-            (attrib_mask_position | attrib_mask_texcoord0 | attrib_mask_normal | attrib_mask_tangent | attrib_mask_bitangent) );
-        ASSERT(mesh.attrib[0].components == 3 && mesh.attrib[0].format == Model::attrib_format_float); // position
-        ASSERT(mesh.attrib[1].components == 2 && mesh.attrib[1].format == Model::attrib_format_float); // texcoord0
-        ASSERT(mesh.attrib[2].components == 3 && mesh.attrib[2].format == Model::attrib_format_float); // normal
-        ASSERT(mesh.attrib[3].components == 3 && mesh.attrib[3].format == Model::attrib_format_float); // tangent
-        ASSERT(mesh.attrib[4].components == 3 && mesh.attrib[4].format == Model::attrib_format_float); // bitangent
-
-        ASSERT( mesh.attribsEnabledDepth ==
-            (attrib_mask_position) );
-        ASSERT(mesh.attrib[0].components == 3 && mesh.attrib[0].format == Model::attrib_format_float); // position
-    }
-#endif
-
     m_pVertexData = new unsigned char[ m_Header.vertexDataByteSize ];
     m_pIndexData = new unsigned char[ m_Header.indexDataByteSize ];
     m_pVertexDataDepth = new unsigned char[ m_Header.vertexDataByteSizeDepth ];
@@ -79,15 +122,12 @@ bool Model::LoadH3D(const char *filename)
     if (m_Header.indexDataByteSize > 0)
         if (1 != fread(m_pIndexDataDepth, m_Header.indexDataByteSize, 1, file)) goto h3d_load_fail;
 
-    m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, m_pVertexData);
-    m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / sizeof(uint16_t), sizeof(uint16_t), m_pIndexData);
+    CreateBuffers();
+
     delete [] m_pVertexData;
     m_pVertexData = nullptr;
     delete [] m_pIndexData;
     m_pIndexData = nullptr;
-
-    m_VertexBufferDepth.Create(L"VertexBufferDepth", m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth, m_VertexStrideDepth, m_pVertexDataDepth);
-    m_IndexBufferDepth.Create(L"IndexBufferDepth", m_Header.indexDataByteSize / sizeof(uint16_t), sizeof(uint16_t), m_pIndexDataDepth);
     delete [] m_pVertexDataDepth;
     m_pVertexDataDepth = nullptr;
     delete [] m_pIndexDataDepth;
@@ -105,8 +145,136 @@ h3d_load_fail:
     return ok;
 }
 
-bool Model::SaveH3D(const char *filename) const
+static const Model::H3DChunk* FindChunk(const Model::H3DChunk* chunks, uint32_t chunkCount, uint32_t id)
+{
+    for (uint32_t n = 0; n < chunkCount; n++)
+    {
+        if (chunks[n].id == id)
+            return chunks + n;
+    }
+    return nullptr;
+}
+
+// Maps the file copy-on-write and points the mesh, material, vertex and index arrays
+// straight into the view, so nothing is read into intermediate heap buffers. The only
+// copy made is the upload to the GPU buffers.
+bool Model::LoadH3DMapped(const char *filename)
+{
+    HANDLE file = CreateFile2(MakeWStr(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize = {};
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= (LONGLONG)sizeof(H3DFileHeader))
+        mapping = CreateFileMappingFromApp(file, nullptr, PAGE_WRITECOPY, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+
+    // the view keeps the mapping alive
+    m_pMappedFile = MapViewOfFileFromApp(mapping, FILE_MAP_COPY, 0, 0);
+    CloseHandle(mapping);
+    if (m_pMappedFile == nullptr)
+        return false;
+
+    m_OwnsMappedFile = true;
+    return LoadH3DView((uint64_t)fileSize.QuadPart);
+}
+
+// Validates the chunk table of the file m_pMappedFile points at and loads the model from it
+bool Model::LoadH3DView(uint64_t dataSize)
+{
+    if (!ParseH3DView(dataSize))
+        return false;
+
+    CreateBuffers();
+    LoadTextures();
+
+    return true;
+}
+
+// Points the mesh, material, vertex, index and cluster arrays into the file m_pMappedFile points
+// at, once its chunk table is known to fit. Nothing is uploaded, so it runs without a device.
+bool Model::ParseH3DView(uint64_t dataSize)
 {
+    unsigned char *fileData = (unsigned char*)m_pMappedFile;
+
+    const H3DFileHeader *fileHeader = (const H3DFileHeader*)fileData;
+    if (fileHeader->magic != h3d_magic || fileHeader->version < h3d_version_2 || fileHeader->version > h3d_version_current)
+        return false;
+    if ((uint64_t)fileHeader->chunkTableOffset + (uint64_t)fileHeader->chunkCount * sizeof(H3DChunk) > dataSize)
+        return false;
+
+    const H3DChunk *chunks = (const H3DChunk*)(fileData + fileHeader->chunkTableOffset);
+    for (uint32_t n = 0; n < fileHeader->chunkCount; n++)
+    {
+        if (chunks[n].offset % h3d_chunk_alignment != 0 || chunks[n].offset > dataSize || chunks[n].size > dataSize - chunks[n].offset)
+            return false;
+    }
+
+    auto GetChunk = [&](uint32_t id, uint64_t expectedSize) -> unsigned char*
+    {
+        const H3DChunk *chunk = FindChunk(chunks, fileHeader->chunkCount, id);
+        if (chunk == nullptr || chunk->size != expectedSize)
+            return nullptr;
+        return fileData + chunk->offset;
+    };
+
+    const unsigned char *header = GetChunk(h3d_chunk_header, sizeof(Header));
+    if (header == nullptr)
+        return false;
+    memcpy(&m_Header, header, sizeof(Header));
+    if (m_Header.indexSize != sizeof(uint16_t) && m_Header.indexSize != sizeof(uint32_t))
+        return false;
+
+    m_pMesh = (Mesh*)GetChunk(h3d_chunk_meshes, (uint64_t)sizeof(Mesh) * m_Header.meshCount);
+    m_pMaterial = (Material*)GetChunk(h3d_chunk_materials, (uint64_t)sizeof(Material) * m_Header.materialCount);
+    m_pVertexData = GetChunk(h3d_chunk_vertices, m_Header.vertexDataByteSize);
+    m_pIndexData = GetChunk(h3d_chunk_indices, m_Header.indexDataByteSize);
+    m_pVertexDataDepth = GetChunk(h3d_chunk_vertices_depth, m_Header.vertexDataByteSizeDepth);
+    m_pIndexDataDepth = GetChunk(h3d_chunk_indices_depth, m_Header.indexDataByteSize);
+
+    if (m_pMesh == nullptr || m_pMaterial == nullptr || m_pVertexData == nullptr || m_pIndexData == nullptr ||
+        m_pVertexDataDepth == nullptr || m_pIndexDataDepth == nullptr)
+    {
+        return false;
+    }
+
+    // clusters are optional, but when present they have to fit the meshes they refer to
+    const H3DChunk *clusterChunk = FindChunk(chunks, fileHeader->chunkCount, h3d_chunk_clusters);
+    if (clusterChunk != nullptr)
+    {
+        if (clusterChunk->size % sizeof(Cluster) != 0)
+            return false;
+
+        const Cluster *clusters = (const Cluster*)(fileData + clusterChunk->offset);
+        const uint32_t clusterCount = (uint32_t)(clusterChunk->size / sizeof(Cluster));
+        for (uint32_t n = 0; n < clusterCount; n++)
+        {
+            const Cluster &cluster = clusters[n];
+            if (cluster.meshIndex >= m_Header.meshCount || (n > 0 && cluster.meshIndex < clusters[n - 1].meshIndex))
+                return false;
+            if ((uint64_t)cluster.indexOffset + cluster.indexCount > m_pMesh[cluster.meshIndex].indexCount)
+                return false;
+        }
+
+        m_pClusters = (Cluster*)clusters;
+        m_ClusterCount = clusterCount;
+    }
+
+    return true;
+}
+
+bool Model::SaveH3D(const char *filename, uint32_t version) const
+{
+    if (version == h3d_version_2)
+        return SaveH3DChunked(filename);
+
+    // the legacy header has no room to say the indices are 32-bit
+    if (m_Header.indexSize != sizeof(uint16_t))
+        return false;
+
     FILE *file = nullptr;
     if (0 != fopen_s(&file, filename, "wb"))
         return false;
@@ -140,6 +308,78 @@ h3d_save_fail:
     return ok;
 }
 
+bool Model::SaveH3DChunked(const char *filename) const
+{
+    struct ChunkSource
+    {
+        uint32_t id;
+        const void *data;
+        uint64_t size;
+    };
+    const ChunkSource sources[] =
+    {
+        { h3d_chunk_header, &m_Header, sizeof(Header) },
+        { h3d_chunk_meshes, m_pMesh, (uint64_t)sizeof(Mesh) * m_Header.meshCount },
+        { h3d_chunk_materials, m_pMaterial, (uint64_t)sizeof(Material) * m_Header.materialCount },
+        { h3d_chunk_vertices, m_pVertexData, m_Header.vertexDataByteSize },
+        { h3d_chunk_indices, m_pIndexData, m_Header.indexDataByteSize },
+        { h3d_chunk_vertices_depth, m_pVertexDataDepth, m_Header.vertexDataByteSizeDepth },
+        { h3d_chunk_indices_depth, m_pIndexDataDepth, m_Header.indexDataByteSize },
+        { h3d_chunk_clusters, m_pClusters, (uint64_t)sizeof(Cluster) * m_ClusterCount },
+    };
+    // the cluster chunk is last so it can be left out when there are none
+    const uint32_t chunkCount = _countof(sources) - (m_ClusterCount == 0 ? 1 : 0);
+
+    H3DFileHeader fileHeader = {};
+    fileHeader.magic = h3d_magic;
+    fileHeader.version = h3d_version_2;
+    fileHeader.chunkCount = chunkCount;
+    fileHeader.chunkTableOffset = sizeof(H3DFileHeader);
+
+    H3DChunk chunks[_countof(sources)] = {};
+    const size_t chunkTableSize = sizeof(H3DChunk) * chunkCount;
+    uint64_t offset = sizeof(H3DFileHeader) + chunkTableSize;
+    for (uint32_t n = 0; n < chunkCount; n++)
+    {
+        offset = AlignUp(offset, (size_t)h3d_chunk_alignment);
+        chunks[n].id = sources[n].id;
+        chunks[n].offset = offset;
+        chunks[n].size = sources[n].size;
+        offset += sources[n].size;
+    }
+
+    FILE *file = nullptr;
+    if (0 != fopen_s(&file, filename, "wb"))
+        return false;
+
+    bool ok = false;
+    uint64_t written = 0;
+    static const unsigned char padding[h3d_chunk_alignment] = {};
+
+    if (1 != fwrite(&fileHeader, sizeof(fileHeader), 1, file)) goto h3d_save_fail;
+    if (1 != fwrite(chunks, chunkTableSize, 1, file)) goto h3d_save_fail;
+    written = sizeof(fileHeader) + chunkTableSize;
+
+    for (uint32_t n = 0; n < chunkCount; n++)
+    {
+        size_t paddingSize = (size_t)(chunks[n].offset - written);
+        if (paddingSize > 0)
+            if (1 != fwrite(padding, paddingSize, 1, file)) goto h3d_save_fail;
+        if (chunks[n].size > 0)
+            if (1 != fwrite(sources[n].data, (size_t)chunks[n].size, 1, file)) goto h3d_save_fail;
+        written = chunks[n].offset + chunks[n].size;
+    }
+
+    ok = true;
+
+h3d_save_fail:
+
+    if (EOF == fclose(file))
+        ok = false;
+
+    return ok;
+}
+
 void Model::ReleaseTextures()
 {
     /*
@@ -167,6 +407,16 @@ void Model::LoadTextures(void)
 
     const ManagedTexture* MatTextures[6] = {};
 
+    // Queue every material's textures so they stream in together, the loop below only waits
+    // for them and falls back to the defaults for any that failed
+    for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
+    {
+        const Material& pMaterial = m_pMaterial[materialIdx];
+        TextureManager::LoadFromFileAsync(pMaterial.texDiffusePath, true);
+        TextureManager::LoadFromFileAsync(pMaterial.texSpecularPath, true);
+        TextureManager::LoadFromFileAsync(pMaterial.texNormalPath, false);
+    }
+
     for (uint32_t materialIdx = 0; materialIdx < m_Header.materialCount; ++materialIdx)
     {
         const Material& pMaterial = m_pMaterial[materialIdx];
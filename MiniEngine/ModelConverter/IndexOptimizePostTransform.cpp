@@ -17,9 +17,11 @@
 // modified from original source to improve performance (especially in debug builds), memory allocations, etc.
 
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 #include <algorithm>
+#include <limits>
 
 #include "IndexOptimizePostTransform.h"
 
@@ -461,3 +463,6 @@ void OptimizeFaces(const IndexType* indexList, uint32_t indexCount, IndexType* n
     delete [] faceSorted;
     delete [] faceReverseLookup;
 }
+
+template void OptimizeFaces<uint16_t>(const uint16_t* indexList, uint32_t indexCount, uint16_t* newIndexList, uint16_t lruCacheSize);
+template void OptimizeFaces<uint32_t>(const uint32_t* indexList, uint32_t indexCount, uint32_t* newIndexList, uint16_t lruCacheSize);
@@ -79,7 +79,7 @@ bool AssimpModel::Save(const char *filename) const
 		break;
 
 	case format_h3d:
-		rval = SaveH3D(filename);
+		rval = SaveH3D(filename, m_Options.h3dVersion);
 		break;
 	}
 
@@ -97,7 +97,8 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
     // max triangles and vertices per mesh, splits above this threshold
     importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, INT_MAX);
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, 0xfffe); // avoid the primitive restart index
+    // avoid the primitive restart index
+    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, m_Options.index32 ? INT_MAX : 0xfffe);
 
     // remove points and lines
     importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
@@ -215,6 +216,8 @@ bool AssimpModel::LoadAssimp(const char *filename)
         strncpy_s(dstMat->name, matName.C_Str(), Material::maxMaterialName - 1);
     }
 
+    m_Header.indexSize = m_Options.index32 ? sizeof(uint32_t) : sizeof(uint16_t);
+
     m_Header.meshCount = scene->mNumMeshes;
     m_pMesh = new Mesh [m_Header.meshCount];
     memset(m_pMesh, 0, sizeof(Mesh) * m_Header.meshCount);
@@ -280,7 +283,7 @@ bool AssimpModel::LoadAssimp(const char *filename)
         dstMesh->indexCount = srcMesh->mNumFaces * 3;
 
         m_Header.vertexDataByteSize += dstMesh->vertexStride * dstMesh->vertexCount;
-        m_Header.indexDataByteSize += sizeof(uint16_t) * dstMesh->indexCount;
+        m_Header.indexDataByteSize += m_Header.indexSize * dstMesh->indexCount;
 
         // depth-only rendering
         dstMesh->vertexDataByteOffsetDepth = m_Header.vertexDataByteSizeDepth;
@@ -384,20 +387,25 @@ bool AssimpModel::LoadAssimp(const char *filename)
             dstBitangent = (float*)((unsigned char*)dstBitangent + dstMesh->vertexStride);
         }
 
-        uint16_t *dstIndex = (uint16_t*)(m_pIndexData + dstMesh->indexDataByteOffset);
-        uint16_t *dstIndexDepth = (uint16_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset);
-        for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
+        auto copyIndices = [srcMesh](auto *dstIndex, auto *dstIndexDepth)
         {
-            assert(srcMesh->mFaces[f].mNumIndices == 3);
+            for (unsigned int f = 0; f < srcMesh->mNumFaces; f++)
+            {
+                assert(srcMesh->mFaces[f].mNumIndices == 3);
 
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndex++ = srcMesh->mFaces[f].mIndices[2];
+                *dstIndex++ = srcMesh->mFaces[f].mIndices[0];
+                *dstIndex++ = srcMesh->mFaces[f].mIndices[1];
+                *dstIndex++ = srcMesh->mFaces[f].mIndices[2];
 
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[0];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[1];
-            *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[2];
-        }
+                *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[0];
+                *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[1];
+                *dstIndexDepth++ = srcMesh->mFaces[f].mIndices[2];
+            }
+        };
+        if (m_Header.indexSize == sizeof(uint32_t))
+            copyIndices((uint32_t*)(m_pIndexData + dstMesh->indexDataByteOffset), (uint32_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset));
+        else
+            copyIndices((uint16_t*)(m_pIndexData + dstMesh->indexDataByteOffset), (uint16_t*)(m_pIndexDataDepth + dstMesh->indexDataByteOffset));
     }
 
     ComputeAllBoundingBoxes();
@@ -27,6 +27,33 @@ public:
 	static const char *s_FormatString[];
 	static int FormatFromFilename(const char *filename);
 
+	struct Options
+	{
+		bool quantizeVertices = false; // see QuantizeVertexData()
+		float weldEpsilon = 0.0f; // merge distance for OptimizeRemoveDuplicateVertices, 0 only merges exact duplicates
+		uint32_t h3dVersion = h3d_version_1; // h3d_version_2 writes the chunked container
+		bool index32 = false; // 32-bit indices and no vertex limit per mesh, requires h3d_version_2
+		uint16_t postTransformCacheSize = 64; // simulated cache size for OptimizePostTransform, 4-64
+		bool buildClusters = false; // see BuildClusters(), requires h3d_version_2
+	};
+	Options m_Options;
+
+	// filled in by QuantizeVertexData(), errors are measured against the float data
+	struct QuantizationStats
+	{
+		bool texcoordsQuantized;
+		uint32_t vertexCount;
+		uint32_t vertexDataByteSizeBefore; // color and depth-only streams
+		uint32_t vertexDataByteSizeAfter;
+		float maxPositionError; // model units
+		float avgPositionError;
+		float maxTexcoordError;
+		float maxNormalError; // degrees
+		float maxTangentError;
+		float maxBitangentError;
+	};
+	const QuantizationStats& GetQuantizationStats() const { return m_QuantizationStats; }
+
 	virtual bool Load(const char* filename) override;
 	bool Save(const char* filename) const;
 
@@ -35,8 +62,13 @@ private:
 	bool LoadAssimp(const char *filename);
 
 	void Optimize();
-	void OptimizeRemoveDuplicateVertices(bool depth);
+	void QuantizeVertexData();
+	// weldEpsilon > 0 also merges vertices whose float attributes quantize to the same grid cell
+	void OptimizeRemoveDuplicateVertices(bool depth, float weldEpsilon = 0.0f);
 	void OptimizePostTransform(bool depth);
 	void OptimizePreTransform(bool depth);
+	void BuildClusters();
+
+	QuantizationStats m_QuantizationStats = {};
 };
 
@@ -0,0 +1,287 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "ModelAssimp.h"
+
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <ppl.h>
+
+namespace
+{
+    struct Float3
+    {
+        float x, y, z;
+    };
+
+    inline Float3 operator-(const Float3 &a, const Float3 &b)
+    {
+        return { a.x - b.x, a.y - b.y, a.z - b.z };
+    }
+
+    inline float Dot(const Float3 &a, const Float3 &b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline Float3 Cross(const Float3 &a, const Float3 &b)
+    {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    // Reads positions in either the float layout or the quantized one, see QuantizeVertexData()
+    class PositionReader
+    {
+    public:
+        PositionReader(const Model::Mesh &mesh, const unsigned char *vertexData)
+            : m_VertexData(vertexData + mesh.vertexDataByteOffset + mesh.attrib[Model::attrib_position].offset)
+            , m_Stride(mesh.vertexStride)
+            , m_Quantized(mesh.attrib[Model::attrib_position].format == Model::attrib_format_ushort)
+        {
+            m_BoxMin = { mesh.boundingBox.min.GetX(), mesh.boundingBox.min.GetY(), mesh.boundingBox.min.GetZ() };
+            Float3 boxMax = { mesh.boundingBox.max.GetX(), mesh.boundingBox.max.GetY(), mesh.boundingBox.max.GetZ() };
+            m_BoxScale = boxMax - m_BoxMin;
+        }
+
+        Float3 operator[](uint32_t index) const
+        {
+            const unsigned char *p = m_VertexData + index * m_Stride;
+            if (m_Quantized)
+            {
+                const uint16_t *q = (const uint16_t*)p;
+                return { m_BoxMin.x + q[0] / 65535.0f * m_BoxScale.x,
+                         m_BoxMin.y + q[1] / 65535.0f * m_BoxScale.y,
+                         m_BoxMin.z + q[2] / 65535.0f * m_BoxScale.z };
+            }
+            const float *f = (const float*)p;
+            return { f[0], f[1], f[2] };
+        }
+
+    private:
+        const unsigned char *m_VertexData;
+        unsigned int m_Stride;
+        bool m_Quantized;
+        Float3 m_BoxMin;
+        Float3 m_BoxScale;
+    };
+
+    // Ritter's bounding sphere: start from the most separated pair of axis extremes and grow
+    // the sphere to include any point left outside. Within a few percent of the minimal sphere.
+    void ComputeBoundingSphere(const Float3 *points, size_t pointCount, Model::Cluster &cluster)
+    {
+        size_t minIndex[3] = {};
+        size_t maxIndex[3] = {};
+        for (size_t n = 1; n < pointCount; n++)
+        {
+            const float *p = &points[n].x;
+            for (int c = 0; c < 3; c++)
+            {
+                if (p[c] < (&points[minIndex[c]].x)[c])
+                    minIndex[c] = n;
+                if (p[c] > (&points[maxIndex[c]].x)[c])
+                    maxIndex[c] = n;
+            }
+        }
+
+        int axis = 0;
+        float maxSpan = -1.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            Float3 d = points[maxIndex[c]] - points[minIndex[c]];
+            float span = Dot(d, d);
+            if (span > maxSpan)
+            {
+                maxSpan = span;
+                axis = c;
+            }
+        }
+
+        const Float3 &a = points[minIndex[axis]];
+        const Float3 &b = points[maxIndex[axis]];
+        Float3 center = { (a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f, (a.z + b.z) * 0.5f };
+        float radius = sqrtf(maxSpan) * 0.5f;
+
+        for (size_t n = 0; n < pointCount; n++)
+        {
+            Float3 d = points[n] - center;
+            float distanceSq = Dot(d, d);
+            if (distanceSq > radius * radius)
+            {
+                float distance = sqrtf(distanceSq);
+                float newRadius = (radius + distance) * 0.5f;
+                float shift = (newRadius - radius) / distance;
+                center = { center.x + d.x * shift, center.y + d.y * shift, center.z + d.z * shift };
+                radius = newRadius;
+            }
+        }
+
+        cluster.center[0] = center.x;
+        cluster.center[1] = center.y;
+        cluster.center[2] = center.z;
+        // covers the rounding in the incremental updates
+        cluster.radius = radius * (1.0f + 1e-5f);
+    }
+
+    // The cone axis is the average face normal and its angle the widest deviation from it.
+    // Faces are front facing when counter-clockwise, so cross(p1 - p0, p2 - p0) points out.
+    void ComputeNormalCone(const Float3 *faceNormals, size_t faceCount, Model::Cluster &cluster)
+    {
+        Float3 axis = { 0.0f, 0.0f, 0.0f };
+        for (size_t n = 0; n < faceCount; n++)
+        {
+            axis.x += faceNormals[n].x;
+            axis.y += faceNormals[n].y;
+            axis.z += faceNormals[n].z;
+        }
+
+        float minDot = -1.0f;
+        float axisLength = sqrtf(Dot(axis, axis));
+        if (axisLength > 0.0f)
+        {
+            axis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+
+            minDot = 1.0f;
+            for (size_t n = 0; n < faceCount; n++)
+            {
+                float d = Dot(faceNormals[n], axis);
+                if (d < minDot)
+                    minDot = d;
+            }
+        }
+        else
+        {
+            axis = { 0.0f, 0.0f, 1.0f };
+        }
+
+        cluster.coneAxis[0] = axis.x;
+        cluster.coneAxis[1] = axis.y;
+        cluster.coneAxis[2] = axis.z;
+
+        // a cone of 90 degrees or more has a view from the back side of every face
+        cluster.coneCutoff = minDot > 0.0f ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+    }
+
+    template <typename IndexType>
+    void BuildMeshClusters(const IndexType *indices, unsigned int indexCount, unsigned int vertexCount,
+        const PositionReader &positions, uint32_t meshIndex, std::vector<Model::Cluster> &clusters)
+    {
+        // the cluster each vertex was last added to, to count unique vertices
+        std::vector<uint32_t> vertexCluster(vertexCount, (uint32_t)-1);
+
+        std::vector<Float3> clusterPoints;
+        std::vector<Float3> faceNormals;
+        clusterPoints.reserve(Model::cluster_max_vertices);
+        faceNormals.reserve(Model::cluster_max_triangles);
+
+        uint32_t clusterTriangles = 0;
+
+        Model::Cluster cluster = {};
+        cluster.meshIndex = meshIndex;
+
+        auto finishCluster = [&](unsigned int endIndex)
+        {
+            cluster.indexCount = endIndex - cluster.indexOffset;
+            ComputeBoundingSphere(clusterPoints.data(), clusterPoints.size(), cluster);
+            ComputeNormalCone(faceNormals.data(), faceNormals.size(), cluster);
+            clusters.push_back(cluster);
+
+            cluster.indexOffset = endIndex;
+            clusterTriangles = 0;
+            clusterPoints.clear();
+            faceNormals.clear();
+        };
+
+        // Triangles are taken in the post-transform optimized order, which already keeps
+        // neighbors close together. A cluster ends when the next triangle no longer fits,
+        // so clusters are contiguous index ranges and the index buffer is left unchanged.
+        for (unsigned int n = 0; n + 2 < indexCount; n += 3)
+        {
+            const uint32_t clusterIndex = (uint32_t)clusters.size();
+
+            // the same vertex twice in a triangle only counts once
+            uint32_t newVertices = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                IndexType index = indices[n + c];
+                if (vertexCluster[index] != clusterIndex && (c < 1 || index != indices[n]) && (c < 2 || index != indices[n + 1]))
+                    newVertices++;
+            }
+
+            if (clusterPoints.size() + newVertices > Model::cluster_max_vertices ||
+                clusterTriangles + 1 > Model::cluster_max_triangles)
+            {
+                finishCluster(n);
+            }
+
+            const uint32_t currentCluster = (uint32_t)clusters.size();
+            Float3 p[3];
+            for (int c = 0; c < 3; c++)
+            {
+                IndexType index = indices[n + c];
+                p[c] = positions[index];
+                if (vertexCluster[index] != currentCluster)
+                {
+                    vertexCluster[index] = currentCluster;
+                    clusterPoints.push_back(p[c]);
+                }
+            }
+
+            clusterTriangles++;
+
+            // degenerate triangles are never rasterized, so they don't widen the cone
+            Float3 normal = Cross(p[1] - p[0], p[2] - p[0]);
+            float length = sqrtf(Dot(normal, normal));
+            if (length > 0.0f)
+                faceNormals.push_back({ normal.x / length, normal.y / length, normal.z / length });
+        }
+
+        if (clusterTriangles > 0)
+            finishCluster(indexCount - indexCount % 3);
+    }
+}
+
+// Splits every mesh into clusters of at most cluster_max_vertices unique vertices and
+// cluster_max_triangles triangles, each with a bounding sphere and normal cone so the
+// runtime can cull them individually, see Model::CullMesh().
+void AssimpModel::BuildClusters()
+{
+    delete [] m_pClusters;
+    m_pClusters = nullptr;
+    m_ClusterCount = 0;
+
+    std::vector<std::vector<Cluster>> meshClusters(m_Header.meshCount);
+
+    Concurrency::parallel_for(0u, m_Header.meshCount, [&](unsigned int meshIndex)
+    {
+        const Mesh &mesh = m_pMesh[meshIndex];
+        PositionReader positions(mesh, m_pVertexData);
+        const unsigned char *indices = m_pIndexData + mesh.indexDataByteOffset;
+
+        if (m_Header.indexSize == sizeof(uint32_t))
+            BuildMeshClusters((const uint32_t*)indices, mesh.indexCount, mesh.vertexCount, positions, meshIndex, meshClusters[meshIndex]);
+        else
+            BuildMeshClusters((const uint16_t*)indices, mesh.indexCount, mesh.vertexCount, positions, meshIndex, meshClusters[meshIndex]);
+    });
+
+    size_t clusterCount = 0;
+    for (const auto &clusters : meshClusters)
+        clusterCount += clusters.size();
+    if (clusterCount == 0)
+        return;
+
+    m_pClusters = new Cluster [clusterCount];
+    for (const auto &clusters : meshClusters)
+    {
+        memcpy(m_pClusters + m_ClusterCount, clusters.data(), sizeof(Cluster) * clusters.size());
+        m_ClusterCount += (uint32_t)clusters.size();
+    }
+}
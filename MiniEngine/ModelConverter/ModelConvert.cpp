@@ -14,13 +14,38 @@
 #include "ModelAssimp.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 void PrintHelp()
 {
     printf("model_convert\n");
 
     printf("usage:\n");
-    printf("model_convert input_file output_file\n");
+    printf("model_convert [options] input_file output_file\n");
+    printf("options:\n");
+    printf("  -quantize        store positions, texcoords and tangent frames as 16-bit integers\n");
+    printf("  -weld epsilon    merge vertices whose attributes differ by less than epsilon\n");
+    printf("  -h3dv2           write the chunked h3d container that can be memory mapped\n");
+    printf("  -index32         use 32-bit indices instead of splitting meshes at 64k vertices, implies -h3dv2\n");
+    printf("  -clusters        split meshes into clusters with culling bounds, implies -h3dv2\n");
+    printf("  -cachesize n     post-transform cache size the index optimizer targets (4-64, default 64)\n");
+}
+
+void PrintQuantizationStats(const AssimpModel::QuantizationStats &stats)
+{
+    printf("quantization stats:\n");
+    printf("vertex data size: %u -> %u (%.1f%%)\n", stats.vertexDataByteSizeBefore, stats.vertexDataByteSizeAfter,
+        stats.vertexDataByteSizeBefore > 0 ? 100.0f * stats.vertexDataByteSizeAfter / stats.vertexDataByteSizeBefore : 0.0f);
+    printf("position error: max %g, avg %g\n", stats.maxPositionError, stats.avgPositionError);
+    if (stats.texcoordsQuantized)
+        printf("texcoord error: max %g\n", stats.maxTexcoordError);
+    else
+        printf("texcoord error: none, texcoords outside [0, 1] were kept as float\n");
+    printf("normal error: max %g degrees\n", stats.maxNormalError);
+    printf("tangent error: max %g degrees\n", stats.maxTangentError);
+    printf("bitangent error: max %g degrees\n", stats.maxBitangentError);
+    printf("\n");
 }
 
 void PrintModelStats(const Model *model)
@@ -34,7 +59,9 @@ void PrintModelStats(const Model *model)
 
     printf("vertex data size: %u\n", model->m_Header.vertexDataByteSize);
     printf("index data size: %u\n", model->m_Header.indexDataByteSize);
+    printf("index size: %u\n", model->m_Header.indexSize);
     printf("vertex data size depth-only: %u\n", model->m_Header.vertexDataByteSizeDepth);
+    printf("cluster count: %u\n", model->m_ClusterCount);
     printf("\n");
 
     printf("mesh count: %u\n", model->m_Header.meshCount);
@@ -112,20 +139,62 @@ void PrintModelStats(const Model *model)
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+	AssimpModel model;
+
+    int argIndex = 1;
+    for (; argIndex < argc && argv[argIndex][0] == '-'; argIndex++)
+    {
+        if (0 == strcmp(argv[argIndex], "-quantize"))
+        {
+            model.m_Options.quantizeVertices = true;
+        }
+        else if (0 == strcmp(argv[argIndex], "-weld") && argIndex + 1 < argc)
+        {
+            model.m_Options.weldEpsilon = (float)atof(argv[++argIndex]);
+        }
+        else if (0 == strcmp(argv[argIndex], "-h3dv2"))
+        {
+            model.m_Options.h3dVersion = Model::h3d_version_2;
+        }
+        else if (0 == strcmp(argv[argIndex], "-index32"))
+        {
+            model.m_Options.index32 = true;
+            model.m_Options.h3dVersion = Model::h3d_version_2;
+        }
+        else if (0 == strcmp(argv[argIndex], "-clusters"))
+        {
+            model.m_Options.buildClusters = true;
+            model.m_Options.h3dVersion = Model::h3d_version_2;
+        }
+        else if (0 == strcmp(argv[argIndex], "-cachesize") && argIndex + 1 < argc)
+        {
+            int cacheSize = atoi(argv[++argIndex]);
+            if (cacheSize < 4 || cacheSize > 64)
+            {
+                PrintHelp();
+                return -1;
+            }
+            model.m_Options.postTransformCacheSize = (uint16_t)cacheSize;
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    if (argc - argIndex != 2)
     {
         PrintHelp();
         return -1;
     }
 
-    const char *input_file = argv[1];
-    const char *output_file = argv[2];
+    const char *input_file = argv[argIndex];
+    const char *output_file = argv[argIndex + 1];
 
     printf("input file %s\n", input_file);
     printf("output file %s\n", output_file);
 
-	AssimpModel model;
-
     printf("loading...\n");
     if (!model.Load(input_file))
     {
@@ -144,5 +213,8 @@ int main(int argc, char **argv)
 
     PrintModelStats(&model);
 
+    if (model.m_Options.quantizeVertices)
+        PrintQuantizationStats(model.GetQuantizationStats());
+
     return 0;
 }
@@ -13,77 +13,141 @@
 
 #include "ModelAssimp.h"
 #include "IndexOptimizePostTransform.h"
+#include "VertexDeduplicate.h"
 
 #include <string.h>
+#include <math.h>
+#include <vector>
+#include <ppl.h>
 
-void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
+namespace
+{
+    template <typename IndexType>
+    void RemapIndices(IndexType *indexArray, unsigned int indexCount, const uint32_t *vertexRemap)
+    {
+        for (unsigned int n = 0; n < indexCount; n++)
+        {
+            indexArray[n] = (IndexType)vertexRemap[indexArray[n]];
+        }
+    }
+
+    template <typename IndexType>
+    void OptimizeMeshFaces(IndexType *indices, unsigned int indexCount, uint16_t lruCacheSize)
+    {
+        IndexType *srcIndices = new IndexType [indexCount];
+        memcpy(srcIndices, indices, sizeof(IndexType) * indexCount);
+
+        OptimizeFaces<IndexType>(srcIndices, indexCount, indices, lruCacheSize);
+
+        delete [] srcIndices;
+    }
+
+    // Copies vertices to dstVertexData in the order they are first referenced and rewrites the
+    // indices to match. Returns the number of vertices that were referenced.
+    template <typename IndexType>
+    unsigned int ReorderVertices(IndexType *indexArray, unsigned int indexCount, const unsigned char *srcVertexData,
+        unsigned char *dstVertexData, unsigned int vertexCount, unsigned int vertexStride)
+    {
+        unsigned int reorderedCount = 0;
+
+        uint32_t *vertexRemap = new uint32_t [vertexCount];
+        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
+
+        for (unsigned int n = 0; n < indexCount; n++)
+        {
+            IndexType index = indexArray[n];
+            if (vertexRemap[index] == (uint32_t)-1)
+            {
+                // not relocated yet
+                const unsigned char *vSrc = srcVertexData + index * vertexStride;
+                unsigned char *vDst = dstVertexData + reorderedCount * vertexStride;
+                memcpy(vDst, vSrc, vertexStride);
+
+                vertexRemap[index] = reorderedCount;
+                reorderedCount++;
+            }
+            indexArray[n] = (IndexType)vertexRemap[index];
+        }
+
+        delete [] vertexRemap;
+
+        return reorderedCount;
+    }
+}
+
+void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth, float weldEpsilon)
 {
     unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
-    uint32_t deduplicatedVertexDataSize = 0;
+    uint32_t *deduplicatedCounts = new uint32_t [m_Header.meshCount];
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    // Meshes are independent, so each one is deduplicated in parallel into the front of
+    // its original range of the output buffer. The ranges are compacted afterwards.
+    Concurrency::parallel_for(0u, m_Header.meshCount, [&](unsigned int meshIndex)
     {
         Mesh *mesh = m_pMesh + meshIndex;
         unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
+        unsigned int vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+        const Attrib *attribs = depth ? mesh->attribDepth : mesh->attrib;
+        const unsigned char *meshVertexData = (depth ? m_pVertexDataDepth : m_pVertexData) + vertexDataByteOffset;
 
-        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataSize;
-        unsigned int deduplicatedCount = 0;
+        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + vertexDataByteOffset;
 
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
         uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
         assert(vertexCount <= (uint32_t)-1);
 
-        for (unsigned int v1 = 0; v1 < vertexCount; v1++)
+        // welding snaps the words of float attributes to a grid
+        bool *isFloatWord = nullptr;
+        if (weldEpsilon > 0.0f)
         {
-            if (vertexRemap[v1] != (uint32_t)-1)
-                continue; // this was already found to be a duplicate
+            const unsigned int vertexWords = vertexStride / 4;
+            isFloatWord = new bool [vertexWords];
+            memset(isFloatWord, 0, sizeof(bool) * vertexWords);
+            for (int n = 0; n < maxAttribs; n++)
+            {
+                if (attribs[n].format != attrib_format_float)
+                    continue;
+                for (unsigned int c = 0; c < attribs[n].components; c++)
+                    isFloatWord[attribs[n].offset / 4 + c] = true;
+            }
+        }
 
-            const unsigned char *v1Data = meshVertexData + v1 * vertexStride;
+        uint32_t deduplicatedCount = DeduplicateVertices(meshVertexData, vertexCount, vertexStride, isFloatWord, weldEpsilon,
+            meshDeduplicatedVertexData, vertexRemap);
 
-            // this is a new unique vertex
-            uint32_t remappedSlot = deduplicatedCount++;
-            vertexRemap[v1] = remappedSlot;
-            memcpy(meshDeduplicatedVertexData + remappedSlot * vertexStride, v1Data, vertexStride);
+        delete [] isFloatWord;
 
-            // scan for duplicates
-            for (unsigned int v2 = v1 + 1; v2 < vertexCount; v2++)
-            {
-                if (vertexRemap[v2] != (uint32_t)-1)
-                    continue; // this was already found to be a duplicate of another vertex
+        unsigned char *indexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
+        if (m_Header.indexSize == sizeof(uint32_t))
+            RemapIndices((uint32_t*)indexData, mesh->indexCount, vertexRemap);
+        else
+            RemapIndices((uint16_t*)indexData, mesh->indexCount, vertexRemap);
 
-                const unsigned char *v2Data = meshVertexData + v2 * vertexStride;
+        delete [] vertexRemap;
 
-                if (0 == memcmp(v1Data, v2Data, vertexStride))
-                {
-                    vertexRemap[v2] = remappedSlot;
-                }
-            }
-        }
+        deduplicatedCounts[meshIndex] = deduplicatedCount;
+    });
 
-        unsigned int indexCount = mesh->indexCount;
-        uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        for (unsigned int n = 0; n < indexCount; n++)
-        {
-            indexArray[n] = vertexRemap[indexArray[n]];
-        }
+    // Meshes were laid out in order, so sliding each one down to the end of the previous
+    // one never overwrites data that hasn't been moved yet
+    uint32_t deduplicatedVertexDataSize = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        unsigned int &vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+        unsigned int &vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
 
-        delete [] vertexRemap;
+        assert(vertexDataByteOffset >= deduplicatedVertexDataSize);
+        memmove(deduplicatedVertexData + deduplicatedVertexDataSize, deduplicatedVertexData + vertexDataByteOffset, deduplicatedCounts[meshIndex] * vertexStride);
 
-        if (depth)
-        {
-            mesh->vertexCountDepth = deduplicatedCount;
-            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataSize;
-        }
-        else
-        {
-            mesh->vertexCount = deduplicatedCount;
-            mesh->vertexDataByteOffset = deduplicatedVertexDataSize;
-        }
-        deduplicatedVertexDataSize += deduplicatedCount * vertexStride;
+        vertexCount = deduplicatedCounts[meshIndex];
+        vertexDataByteOffset = deduplicatedVertexDataSize;
+        deduplicatedVertexDataSize += vertexCount * vertexStride;
     }
 
+    delete [] deduplicatedCounts;
+
     if (depth)
     {
         delete [] m_pVertexDataDepth;
@@ -100,60 +164,40 @@ void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
 
 void AssimpModel::OptimizePostTransform(bool depth)
 {
-    enum {lruCacheSize = 64};
+    const uint16_t lruCacheSize = m_Options.postTransformCacheSize;
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    // meshes own disjoint ranges of the index buffer
+    Concurrency::parallel_for(0u, m_Header.meshCount, [&](unsigned int meshIndex)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
-
-        uint16_t *srcIndices = new uint16_t [mesh->indexCount];
-        uint16_t *dstIndices = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        memcpy(srcIndices, dstIndices, sizeof(uint16_t) * mesh->indexCount);
+        const Mesh *mesh = m_pMesh + meshIndex;
+        unsigned char *indexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
 
-        OptimizeFaces<uint16_t>(srcIndices, mesh->indexCount, dstIndices, lruCacheSize);
-
-        delete [] srcIndices;
-    }
+        if (m_Header.indexSize == sizeof(uint32_t))
+            OptimizeMeshFaces((uint32_t*)indexData, mesh->indexCount, lruCacheSize);
+        else
+            OptimizeMeshFaces((uint16_t*)indexData, mesh->indexCount, lruCacheSize);
+    });
 }
 
 void AssimpModel::OptimizePreTransform(bool depth)
 {
     unsigned char *reorderedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    Concurrency::parallel_for(0u, m_Header.meshCount, [&](unsigned int meshIndex)
     {
-        Mesh *mesh = m_pMesh + meshIndex;
-        unsigned int indexCount = mesh->indexCount;
+        const Mesh *mesh = m_pMesh + meshIndex;
         unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
-
-        unsigned char *meshReorderedVertexData = reorderedVertexData + (depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset);
-        unsigned int reorderedCount = 0;
-
+        unsigned int vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
-        uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
-
-        uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        for (unsigned int n = 0; n < indexCount; n++)
-        {
-            uint16_t index = indexArray[n];
-            if (vertexRemap[index] == (uint32_t)-1)
-            {
-                // not relocated yet
-                const unsigned char *vSrc = meshVertexData + index * vertexStride;
-                unsigned char *vDst = meshReorderedVertexData + reorderedCount * vertexStride;
-                memcpy(vDst, vSrc, vertexStride);
-
-                vertexRemap[index] = reorderedCount;
-                reorderedCount++;
-            }
-            indexArray[n] = vertexRemap[index];
-        }
+        const unsigned char *meshVertexData = (depth ? m_pVertexDataDepth : m_pVertexData) + vertexDataByteOffset;
+        unsigned char *meshReorderedVertexData = reorderedVertexData + vertexDataByteOffset;
 
-        delete [] vertexRemap;
-    }
+        unsigned char *indexData = (depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset;
+        if (m_Header.indexSize == sizeof(uint32_t))
+            ReorderVertices((uint32_t*)indexData, mesh->indexCount, meshVertexData, meshReorderedVertexData, vertexCount, vertexStride);
+        else
+            ReorderVertices((uint16_t*)indexData, mesh->indexCount, meshVertexData, meshReorderedVertexData, vertexCount, vertexStride);
+    });
 
     if (depth)
     {
@@ -169,10 +213,23 @@ void AssimpModel::OptimizePreTransform(bool depth)
 
 void AssimpModel::Optimize()
 {
-    // TODO: quantize/compress vertex data
+    // weld while positions and directions are still floats, welding only snaps float attributes
+    const bool weld = m_Options.weldEpsilon > 0.0f;
+    if (weld)
+    {
+        OptimizeRemoveDuplicateVertices(false, m_Options.weldEpsilon);
+        OptimizeRemoveDuplicateVertices(true, m_Options.weldEpsilon);
+    }
+
+    // then quantize, after which vertices that became identical get merged
+    if (m_Options.quantizeVertices)
+        QuantizeVertexData();
 
-    OptimizeRemoveDuplicateVertices(false);
-    OptimizeRemoveDuplicateVertices(true);
+    if (!weld || m_Options.quantizeVertices)
+    {
+        OptimizeRemoveDuplicateVertices(false);
+        OptimizeRemoveDuplicateVertices(true);
+    }
 
     // re-order indices for post transform cache
     OptimizePostTransform(false);
@@ -181,4 +238,8 @@ void AssimpModel::Optimize()
     // re-order vertices for linear memory access
     OptimizePreTransform(false);
     OptimizePreTransform(true);
+
+    // clusters are index ranges, so the index order has to be final
+    if (m_Options.buildClusters)
+        BuildClusters();
 }
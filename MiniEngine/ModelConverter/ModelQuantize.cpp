@@ -0,0 +1,303 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "ModelAssimp.h"
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+namespace
+{
+    inline float Clamp(float v, float lo, float hi)
+    {
+        return v < lo ? lo : (v > hi ? hi : v);
+    }
+
+    inline float SignNotZero(float v)
+    {
+        return v >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    inline uint16_t EncodeUnorm16(float v)
+    {
+        return (uint16_t)(Clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    inline float DecodeUnorm16(uint16_t q)
+    {
+        return q / 65535.0f;
+    }
+
+    inline float DecodeSnorm16(int16_t q)
+    {
+        // -32768 and -32767 both map to -1, same as the hardware conversion
+        return q < -32767 ? -1.0f : q / 32767.0f;
+    }
+
+    void Normalize(float v[3])
+    {
+        float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (len > 0.0f)
+        {
+            v[0] /= len;
+            v[1] /= len;
+            v[2] /= len;
+        }
+        else
+        {
+            v[0] = 0.0f;
+            v[1] = 0.0f;
+            v[2] = 1.0f;
+        }
+    }
+
+    void DecodeOctahedral(const int16_t q[2], float v[3])
+    {
+        float x = DecodeSnorm16(q[0]);
+        float y = DecodeSnorm16(q[1]);
+        float z = 1.0f - fabsf(x) - fabsf(y);
+        if (z < 0.0f)
+        {
+            float ox = x;
+            x = (1.0f - fabsf(y)) * SignNotZero(ox);
+            y = (1.0f - fabsf(ox)) * SignNotZero(y);
+        }
+        v[0] = x;
+        v[1] = y;
+        v[2] = z;
+        Normalize(v);
+    }
+
+    // Projects the unit vector onto the octahedron and unfolds the lower hemisphere
+    // into the corners of the square. All four snorm16 roundings of the projected point
+    // are tried and the one that decodes closest to the input is kept.
+    // Returns the cosine of the angle between v and the decoded result.
+    float EncodeOctahedral(const float vIn[3], int16_t q[2])
+    {
+        float v[3] = { vIn[0], vIn[1], vIn[2] };
+        Normalize(v);
+
+        float l1 = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+        float x = v[0] / l1;
+        float y = v[1] / l1;
+        if (v[2] < 0.0f)
+        {
+            float ox = x;
+            x = (1.0f - fabsf(y)) * SignNotZero(ox);
+            y = (1.0f - fabsf(ox)) * SignNotZero(y);
+        }
+
+        float fx = floorf(Clamp(x, -1.0f, 1.0f) * 32767.0f);
+        float fy = floorf(Clamp(y, -1.0f, 1.0f) * 32767.0f);
+
+        float bestCos = -FLT_MAX;
+        for (int n = 0; n < 4; n++)
+        {
+            int16_t candidate[2] =
+            {
+                (int16_t)Clamp(fx + (n & 1), -32767.0f, 32767.0f),
+                (int16_t)Clamp(fy + (n >> 1), -32767.0f, 32767.0f)
+            };
+            float decoded[3];
+            DecodeOctahedral(candidate, decoded);
+            float cosAngle = v[0] * decoded[0] + v[1] * decoded[1] + v[2] * decoded[2];
+            if (cosAngle > bestCos)
+            {
+                bestCos = cosAngle;
+                q[0] = candidate[0];
+                q[1] = candidate[1];
+            }
+        }
+        return bestCos;
+    }
+
+    float AngleInDegrees(float cosAngle)
+    {
+        return acosf(Clamp(cosAngle, -1.0f, 1.0f)) * (180.0f / 3.14159265f);
+    }
+
+    void SetAttrib(Model::Attrib &attrib, uint16_t offset, uint16_t normalized, uint16_t components, uint16_t format)
+    {
+        attrib.offset = offset;
+        attrib.normalized = normalized;
+        attrib.components = components;
+        attrib.format = format;
+    }
+}
+
+// Rewrites the float vertex streams produced by LoadAssimp in a compact layout:
+//   position     4 x ushort normalized, relative to Mesh::boundingBox (w is padding)
+//   texcoord0    2 x ushort normalized when every uv of the model is in [0, 1], float otherwise
+//   normal       2 x short normalized, octahedral
+//   tangent      2 x short normalized, octahedral
+//   bitangent    2 x short normalized, octahedral
+// The depth-only stream gets the same position encoding so both passes produce identical depth.
+// Every mesh uses the same layout so the model keeps a single vertex stride.
+void AssimpModel::QuantizeVertexData()
+{
+    QuantizationStats &stats = m_QuantizationStats;
+    memset(&stats, 0, sizeof(stats));
+    stats.vertexDataByteSizeBefore = m_Header.vertexDataByteSize + m_Header.vertexDataByteSizeDepth;
+
+    // unorm texcoords can't represent wrapping, so only use them if nothing needs it
+    bool quantizeTexcoords = true;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount && quantizeTexcoords; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        assert(mesh->attrib[attrib_texcoord0].format == attrib_format_float);
+
+        const unsigned char *vertexData = m_pVertexData + mesh->vertexDataByteOffset + mesh->attrib[attrib_texcoord0].offset;
+        for (unsigned int v = 0; v < mesh->vertexCount; v++)
+        {
+            const float *uv = (const float*)(vertexData + v * mesh->vertexStride);
+            if (uv[0] < 0.0f || uv[0] > 1.0f || uv[1] < 0.0f || uv[1] > 1.0f)
+            {
+                quantizeTexcoords = false;
+                break;
+            }
+        }
+    }
+    stats.texcoordsQuantized = quantizeTexcoords;
+
+    const uint16_t positionSize = sizeof(uint16_t) * 4;
+    const uint16_t texcoordSize = quantizeTexcoords ? sizeof(uint16_t) * 2 : sizeof(float) * 2;
+    const uint16_t directionSize = sizeof(int16_t) * 2;
+
+    const uint16_t positionOffset = 0;
+    const uint16_t texcoordOffset = positionOffset + positionSize;
+    const uint16_t normalOffset = texcoordOffset + texcoordSize;
+    const uint16_t tangentOffset = normalOffset + directionSize;
+    const uint16_t bitangentOffset = tangentOffset + directionSize;
+    const uint16_t vertexStride = bitangentOffset + directionSize;
+    const uint16_t vertexStrideDepth = positionSize;
+
+    uint32_t vertexDataByteSize = 0;
+    uint32_t vertexDataByteSizeDepth = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        vertexDataByteSize += mesh->vertexCount * vertexStride;
+        vertexDataByteSizeDepth += mesh->vertexCountDepth * vertexStrideDepth;
+    }
+
+    unsigned char *quantizedVertexData = new unsigned char [vertexDataByteSize];
+    unsigned char *quantizedVertexDataDepth = new unsigned char [vertexDataByteSizeDepth];
+    memset(quantizedVertexData, 0, vertexDataByteSize);
+    memset(quantizedVertexDataDepth, 0, vertexDataByteSizeDepth);
+
+    double positionErrorSum = 0.0;
+    float minDirectionCos[3] = { 1.0f, 1.0f, 1.0f };
+
+    uint32_t dstOffset = 0;
+    uint32_t dstOffsetDepth = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+
+        float boxMin[3] = { mesh->boundingBox.min.GetX(), mesh->boundingBox.min.GetY(), mesh->boundingBox.min.GetZ() };
+        float boxMax[3] = { mesh->boundingBox.max.GetX(), mesh->boundingBox.max.GetY(), mesh->boundingBox.max.GetZ() };
+        float boxScale[3];
+        for (int c = 0; c < 3; c++)
+            boxScale[c] = boxMax[c] > boxMin[c] ? 1.0f / (boxMax[c] - boxMin[c]) : 0.0f;
+
+        auto quantizePosition = [&](const float *src, uint16_t *dst) -> float
+        {
+            float errorSq = 0.0f;
+            for (int c = 0; c < 3; c++)
+            {
+                dst[c] = EncodeUnorm16((src[c] - boxMin[c]) * boxScale[c]);
+                float decoded = boxMin[c] + DecodeUnorm16(dst[c]) * (boxMax[c] - boxMin[c]);
+                errorSq += (decoded - src[c]) * (decoded - src[c]);
+            }
+            dst[3] = 0;
+            return sqrtf(errorSq);
+        };
+
+        const unsigned char *srcVertices = m_pVertexData + mesh->vertexDataByteOffset;
+        unsigned char *dstVertices = quantizedVertexData + dstOffset;
+        for (unsigned int v = 0; v < mesh->vertexCount; v++)
+        {
+            const unsigned char *src = srcVertices + v * mesh->vertexStride;
+            unsigned char *dst = dstVertices + v * vertexStride;
+
+            float positionError = quantizePosition((const float*)(src + mesh->attrib[attrib_position].offset), (uint16_t*)(dst + positionOffset));
+            positionErrorSum += positionError;
+            if (positionError > stats.maxPositionError)
+                stats.maxPositionError = positionError;
+
+            const float *uv = (const float*)(src + mesh->attrib[attrib_texcoord0].offset);
+            if (quantizeTexcoords)
+            {
+                uint16_t *dstUV = (uint16_t*)(dst + texcoordOffset);
+                for (int c = 0; c < 2; c++)
+                {
+                    dstUV[c] = EncodeUnorm16(uv[c]);
+                    float error = fabsf(DecodeUnorm16(dstUV[c]) - uv[c]);
+                    if (error > stats.maxTexcoordError)
+                        stats.maxTexcoordError = error;
+                }
+            }
+            else
+            {
+                memcpy(dst + texcoordOffset, uv, sizeof(float) * 2);
+            }
+
+            const unsigned int directionAttribs[3] = { attrib_normal, attrib_tangent, attrib_bitangent };
+            const uint16_t directionOffsets[3] = { normalOffset, tangentOffset, bitangentOffset };
+            for (int n = 0; n < 3; n++)
+            {
+                const float *direction = (const float*)(src + mesh->attrib[directionAttribs[n]].offset);
+                float cosAngle = EncodeOctahedral(direction, (int16_t*)(dst + directionOffsets[n]));
+                if (cosAngle < minDirectionCos[n])
+                    minDirectionCos[n] = cosAngle;
+            }
+        }
+
+        const unsigned char *srcVerticesDepth = m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth;
+        unsigned char *dstVerticesDepth = quantizedVertexDataDepth + dstOffsetDepth;
+        for (unsigned int v = 0; v < mesh->vertexCountDepth; v++)
+        {
+            const float *src = (const float*)(srcVerticesDepth + v * mesh->vertexStrideDepth + mesh->attribDepth[attrib_position].offset);
+            quantizePosition(src, (uint16_t*)(dstVerticesDepth + v * vertexStrideDepth));
+        }
+
+        SetAttrib(mesh->attrib[attrib_position], positionOffset, 1, 3, attrib_format_ushort);
+        SetAttrib(mesh->attrib[attrib_texcoord0], texcoordOffset, quantizeTexcoords ? 1 : 0, 2, quantizeTexcoords ? attrib_format_ushort : attrib_format_float);
+        SetAttrib(mesh->attrib[attrib_normal], normalOffset, 1, 2, attrib_format_short);
+        SetAttrib(mesh->attrib[attrib_tangent], tangentOffset, 1, 2, attrib_format_short);
+        SetAttrib(mesh->attrib[attrib_bitangent], bitangentOffset, 1, 2, attrib_format_short);
+        SetAttrib(mesh->attribDepth[attrib_position], 0, 1, 3, attrib_format_ushort);
+
+        mesh->vertexStride = vertexStride;
+        mesh->vertexStrideDepth = vertexStrideDepth;
+        mesh->vertexDataByteOffset = dstOffset;
+        mesh->vertexDataByteOffsetDepth = dstOffsetDepth;
+
+        dstOffset += mesh->vertexCount * vertexStride;
+        dstOffsetDepth += mesh->vertexCountDepth * vertexStrideDepth;
+        stats.vertexCount += mesh->vertexCount;
+    }
+
+    delete [] m_pVertexData;
+    m_pVertexData = quantizedVertexData;
+    m_Header.vertexDataByteSize = vertexDataByteSize;
+
+    delete [] m_pVertexDataDepth;
+    m_pVertexDataDepth = quantizedVertexDataDepth;
+    m_Header.vertexDataByteSizeDepth = vertexDataByteSizeDepth;
+
+    stats.vertexDataByteSizeAfter = vertexDataByteSize + vertexDataByteSizeDepth;
+    stats.avgPositionError = stats.vertexCount > 0 ? (float)(positionErrorSum / stats.vertexCount) : 0.0f;
+    stats.maxNormalError = AngleInDegrees(minDirectionCos[0]);
+    stats.maxTangentError = AngleInDegrees(minDirectionCos[1]);
+    stats.maxBitangentError = AngleInDegrees(minDirectionCos[2]);
+}
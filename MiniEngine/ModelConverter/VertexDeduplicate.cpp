@@ -0,0 +1,158 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author(s):	Alex Nankervis
+//
+
+#include "VertexDeduplicate.h"
+#include "Hash.h"
+
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+
+namespace
+{
+    // Open-addressing table mapping a vertex to the slot of its first occurrence.
+    // The full hash is kept next to the slot so most probes that don't match never
+    // have to touch the vertex data.
+    class VertexHashTable
+    {
+    public:
+        enum { emptySlot = 0xffffffff };
+
+        VertexHashTable(uint32_t maxEntries)
+        {
+            uint32_t capacity = 16;
+            while (capacity < maxEntries * 2)
+                capacity *= 2;
+            m_Mask = capacity - 1;
+            m_Entries.resize(capacity, Entry{0, emptySlot});
+        }
+
+        // Returns the slot stored for an equal key, or inserts newSlot and returns it.
+        // isEqual(slot) compares the key being looked up with the one stored for slot.
+        template <typename IsEqual>
+        uint32_t FindOrInsert(uint32_t hash, uint32_t newSlot, const IsEqual &isEqual)
+        {
+            for (uint32_t n = hash & m_Mask; ; n = (n + 1) & m_Mask)
+            {
+                Entry &entry = m_Entries[n];
+                if (entry.slot == emptySlot)
+                {
+                    entry.hash = hash;
+                    entry.slot = newSlot;
+                    return newSlot;
+                }
+                if (entry.hash == hash && isEqual(entry.slot))
+                    return entry.slot;
+            }
+        }
+
+    private:
+        struct Entry
+        {
+            uint32_t hash;
+            uint32_t slot;
+        };
+        std::vector<Entry> m_Entries;
+        uint32_t m_Mask;
+    };
+
+    // Returns the grid cell value falls in. Cells past the int32 range are clamped to its ends,
+    // and every NaN gets INT32_MIN, which no number is clamped to.
+    uint32_t WeldCell(float value, double invEpsilon)
+    {
+        double cell = floor(value * invEpsilon + 0.5);
+        if (cell != cell)
+            return (uint32_t)INT32_MIN;
+        if (cell < (double)INT32_MIN + 1)
+            return (uint32_t)(INT32_MIN + 1);
+        if (cell > (double)INT32_MAX)
+            return (uint32_t)INT32_MAX;
+        return (uint32_t)(int32_t)cell;
+    }
+}
+
+uint32_t DeduplicateVertices(const unsigned char *srcVertexData, uint32_t vertexCount, uint32_t vertexStride,
+    const bool *isFloatWord, float weldEpsilon, unsigned char *dstVertexData, uint32_t *vertexRemap)
+{
+    uint32_t deduplicatedCount = 0;
+
+    // keys are hashed a word at a time
+    assert((vertexStride & 3) == 0);
+    const unsigned int vertexWords = vertexStride / 4;
+
+    VertexHashTable hashTable(vertexCount);
+
+    if (weldEpsilon <= 0.0f)
+    {
+        // Exact match on the raw vertex bytes. Vertices are visited in order and the first
+        // occurrence claims the next slot, which is the same output as a pairwise scan.
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            const unsigned char *vData = srcVertexData + v * vertexStride;
+            uint32_t hash = (uint32_t)Utility::HashRange((const uint32_t*)vData, (const uint32_t*)vData + vertexWords, 2166136261U);
+
+            uint32_t remappedSlot = hashTable.FindOrInsert(hash, deduplicatedCount, [&](uint32_t slot)
+            {
+                return 0 == memcmp(dstVertexData + slot * vertexStride, vData, vertexStride);
+            });
+
+            if (remappedSlot == deduplicatedCount)
+            {
+                // this is a new unique vertex
+                memcpy(dstVertexData + remappedSlot * vertexStride, vData, vertexStride);
+                deduplicatedCount++;
+            }
+            vertexRemap[v] = remappedSlot;
+        }
+    }
+    else
+    {
+        // Float components are snapped to a grid of weldEpsilon before hashing so vertices
+        // that land in the same cell are merged. The first vertex in a cell is kept as is.
+        assert(isFloatWord != nullptr);
+
+        const double invEpsilon = 1.0 / weldEpsilon;
+        uint32_t *quantizedKeys = new uint32_t [vertexCount * vertexWords];
+
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            const uint32_t *vWords = (const uint32_t*)(srcVertexData + v * vertexStride);
+            uint32_t *vKey = quantizedKeys + deduplicatedCount * vertexWords;
+            for (unsigned int w = 0; w < vertexWords; w++)
+            {
+                if (isFloatWord[w])
+                    vKey[w] = WeldCell(((const float*)vWords)[w], invEpsilon);
+                else
+                    vKey[w] = vWords[w];
+            }
+            uint32_t hash = (uint32_t)Utility::HashRange(vKey, vKey + vertexWords, 2166136261U);
+
+            uint32_t remappedSlot = hashTable.FindOrInsert(hash, deduplicatedCount, [&](uint32_t slot)
+            {
+                return 0 == memcmp(quantizedKeys + slot * vertexWords, vKey, vertexStride);
+            });
+
+            if (remappedSlot == deduplicatedCount)
+            {
+                memcpy(dstVertexData + remappedSlot * vertexStride, vWords, vertexStride);
+                deduplicatedCount++;
+            }
+            vertexRemap[v] = remappedSlot;
+        }
+
+        delete [] quantizedKeys;
+    }
+
+    return deduplicatedCount;
+}
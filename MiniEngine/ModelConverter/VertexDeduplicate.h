@@ -0,0 +1,26 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author(s):	Alex Nankervis
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// Copies the distinct vertices of a mesh to dstVertexData in the order they first occur and sets
+// vertexRemap[v] to where vertex v went. Returns the number of vertices copied. vertexStride must
+// be a multiple of 4 bytes.
+//
+// With weldEpsilon above zero, the words isFloatWord marks are snapped to a grid of that size
+// before vertices are compared, so vertices that land in the same cell are merged into the first
+// of them. isFloatWord has a bool per 32-bit word of a vertex and may be null otherwise.
+uint32_t DeduplicateVertices(const unsigned char *srcVertexData, uint32_t vertexCount, uint32_t vertexStride,
+    const bool *isFloatWord, float weldEpsilon, unsigned char *dstVertexData, uint32_t *vertexRemap);
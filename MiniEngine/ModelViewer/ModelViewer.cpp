@@ -32,6 +32,7 @@
 #include "ShadowCamera.h"
 #include "ParticleEffectManager.h"
 #include "GameInput.h"
+#include "FileUtility.h"
 #include "./ForwardPlusLighting.h"
 
 // To enable wave intrinsics, uncomment this macro and #define DXIL in Core/GraphcisCore.cpp.
@@ -70,7 +71,8 @@ private:
     void RenderLightShadows(GraphicsContext& gfxContext);
 
     enum eObjectFilter { kOpaque = 0x1, kCutout = 0x2, kTransparent = 0x4, kAll = 0xF, kNone = 0x0 };
-    void RenderObjects( GraphicsContext& Context, const Matrix4& ViewProjMat, eObjectFilter Filter = kAll );
+    void RenderObjects( GraphicsContext& Context, const Matrix4& ViewProjMat, const std::vector<Model::DrawRange>& Ranges, eObjectFilter Filter = kAll );
+    void CullObjects( void );
     void CreateParticleEffects();
     Camera m_Camera;
     std::auto_ptr<CameraController> m_CameraController;
@@ -99,6 +101,10 @@ private:
     Model m_Model;
     std::vector<bool> m_pMaterialIsCutout;
 
+    // one range per mesh, and the parts of them that pass cluster culling for the main camera
+    std::vector<Model::DrawRange> m_AllMeshRanges;
+    std::vector<Model::DrawRange> m_VisibleRanges;
+
     Vector3 m_SunDirection;
     ShadowCamera m_SunShadow;
 };
@@ -114,10 +120,52 @@ NumVar ShadowDimY("Application/Lighting/Shadow Dim Y", 3000, 1000, 10000, 100 );
 NumVar ShadowDimZ("Application/Lighting/Shadow Dim Z", 3000, 1000, 10000, 100 );
 
 BoolVar ShowWaveTileCounts("Application/Forward+/Show Wave Tile Counts", false);
+BoolVar EnableClusterCulling("Application/Cluster Culling", true);
 #ifdef _WAVE_OP
 BoolVar EnableWaveOps("Application/Forward+/Enable Wave Ops", true);
 #endif
 
+// Matches ModelViewerVertex.hlsli, including its packing, and num32BitConstants in ModelViewerRS.hlsli
+struct MeshConstants
+{
+    XMFLOAT3 positionOffset;
+    uint32_t baseVertex;
+    XMFLOAT3 positionScale;
+    uint32_t materialIdx;
+    uint32_t octahedralDirections;
+};
+static_assert(offsetof(MeshConstants, positionOffset) == 0 && offsetof(MeshConstants, positionScale) == 16,
+    "float3s in MeshConstants must not cross a 16-byte boundary, HLSL cbuffers don't allow it");
+static_assert(sizeof(MeshConstants) == 9 * 4, "Update num32BitConstants in ModelViewerRS.hlsli");
+
+// The formats LoadH3D accepts: floats, and the normalized integers written by the converter's -quantize
+// option.  Three 16-bit components are read as four, the converter pads positions to 8 bytes.
+static DXGI_FORMAT GetAttribFormat( const Model::Attrib& attrib )
+{
+    switch (attrib.format)
+    {
+    case Model::attrib_format_float:
+        switch (attrib.components)
+        {
+        case 1: return DXGI_FORMAT_R32_FLOAT;
+        case 2: return DXGI_FORMAT_R32G32_FLOAT;
+        case 3: return DXGI_FORMAT_R32G32B32_FLOAT;
+        case 4: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        }
+        break;
+    case Model::attrib_format_ushort:
+        if (attrib.normalized)
+            return attrib.components <= 2 ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R16G16B16A16_UNORM;
+        break;
+    case Model::attrib_format_short:
+        if (attrib.normalized)
+            return attrib.components <= 2 ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R16G16B16A16_SNORM;
+        break;
+    }
+    ERROR("Unsupported vertex attribute format");
+    return DXGI_FORMAT_UNKNOWN;
+}
+
 void ModelViewer::Startup( void )
 {
     SamplerDesc DefaultSamplerDesc;
@@ -130,21 +178,28 @@ void ModelViewer::Startup( void )
     m_RootSig[1].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_PIXEL);
     m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 6, D3D12_SHADER_VISIBILITY_PIXEL);
     m_RootSig[3].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 64, 6, D3D12_SHADER_VISIBILITY_PIXEL);
-    m_RootSig[4].InitAsConstants(1, 2, D3D12_SHADER_VISIBILITY_VERTEX);
+    m_RootSig[4].InitAsConstants(1, sizeof(MeshConstants) / 4, D3D12_SHADER_VISIBILITY_VERTEX);
     m_RootSig.Finalize(L"ModelViewer", D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
     DXGI_FORMAT ColorFormat = g_SceneColorBuffer.GetFormat();
     DXGI_FORMAT DepthFormat = g_SceneDepthBuffer.GetFormat();
     DXGI_FORMAT ShadowFormat = g_ShadowBuffer.GetFormat();
 
-    D3D12_INPUT_ELEMENT_DESC vertElem[] =
+    // Everything is loaded out of the asset pack when there is one, see AssetPacker
+    Utility::MountAssetPack(L"Assets.pak");
+
+    TextureManager::Initialize(L"Textures/");
+    ASSERT(m_Model.Load("Models/sponza.h3d"), "Failed to load model");
+    ASSERT(m_Model.m_Header.meshCount > 0, "Model contains no meshes");
+
+    // Float or quantized, every mesh of a model shares one vertex layout
+    static const char* attribSemantics[] = { "POSITION", "TEXCOORD", "NORMAL", "TANGENT", "BITANGENT" };
+    D3D12_INPUT_ELEMENT_DESC vertElem[_countof(attribSemantics)];
+    for (uint32_t i = 0; i < _countof(attribSemantics); ++i)
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-    };
+        const Model::Attrib& attrib = m_Model.m_pMesh[0].attrib[i];
+        vertElem[i] = { attribSemantics[i], 0, GetAttribFormat(attrib), 0, attrib.offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 };
+    }
 
     // Depth-only (2x rate)
     m_DepthPSO.SetRootSignature(m_RootSig);
@@ -209,10 +264,6 @@ void ModelViewer::Startup( void )
     m_ExtraTextures[0] = g_SSAOFullScreen.GetSRV();
     m_ExtraTextures[1] = g_ShadowBuffer.GetSRV();
 
-    TextureManager::Initialize(L"Textures/");
-    ASSERT(m_Model.Load("Models/sponza.h3d"), "Failed to load model");
-    ASSERT(m_Model.m_Header.meshCount > 0, "Model contains no meshes");
-
     // The caller of this function can override which materials are considered cutouts
     m_pMaterialIsCutout.resize(m_Model.m_Header.materialCount);
     for (uint32_t i = 0; i < m_Model.m_Header.materialCount; ++i)
@@ -230,6 +281,12 @@ void ModelViewer::Startup( void )
         }
     }
 
+    for (uint32_t meshIndex = 0; meshIndex < m_Model.m_Header.meshCount; meshIndex++)
+    {
+        const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
+        m_AllMeshRanges.push_back({ meshIndex, mesh.indexDataByteOffset / m_Model.m_Header.indexSize, mesh.indexCount });
+    }
+
     CreateParticleEffects();
 
     float modelRadius = Length(m_Model.m_Header.boundingBox.max - m_Model.m_Header.boundingBox.min) * .5f;
@@ -303,7 +360,26 @@ void ModelViewer::Update( float deltaT )
     m_MainScissor.bottom = (LONG)g_SceneColorBuffer.GetHeight();
 }
 
-void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& ViewProjMat, eObjectFilter Filter )
+void ModelViewer::CullObjects( void )
+{
+    m_VisibleRanges.clear();
+    if (!EnableClusterCulling)
+    {
+        m_VisibleRanges = m_AllMeshRanges;
+        return;
+    }
+
+    // The model is drawn without a world transform, so world space is model space. Cutouts
+    // are drawn two-sided and can only be frustum culled.
+    const Frustum& frustum = m_Camera.GetWorldSpaceFrustum();
+    for (uint32_t meshIndex = 0; meshIndex < m_Model.m_Header.meshCount; meshIndex++)
+    {
+        const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
+        m_Model.CullMesh(meshIndex, frustum, m_Camera.GetPosition(), !m_pMaterialIsCutout[mesh.materialIndex], m_VisibleRanges);
+    }
+}
+
+void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& ViewProjMat, const std::vector<Model::DrawRange>& Ranges, eObjectFilter Filter )
 {
     struct VSConstants
     {
@@ -321,12 +397,12 @@ void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& Vie
 
     uint32_t VertexStride = m_Model.m_VertexStride;
 
-    for (uint32_t meshIndex = 0; meshIndex < m_Model.m_Header.meshCount; meshIndex++)
+    for (const Model::DrawRange& range : Ranges)
     {
-        const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
+        const Model::Mesh& mesh = m_Model.m_pMesh[range.meshIndex];
 
-        uint32_t indexCount = mesh.indexCount;
-        uint32_t startIndex = mesh.indexDataByteOffset / sizeof(uint16_t);
+        uint32_t indexCount = range.indexCount;
+        uint32_t startIndex = range.startIndex;
         uint32_t baseVertex = mesh.vertexDataByteOffset / VertexStride;
 
         if (mesh.materialIndex != materialIdx)
@@ -339,7 +415,22 @@ void ModelViewer::RenderObjects( GraphicsContext& gfxContext, const Matrix4& Vie
             gfxContext.SetDynamicDescriptors(2, 0, 6, m_Model.GetSRVs(materialIdx) );
         }
 
-        gfxContext.SetConstants(4, baseVertex, materialIdx);
+        // quantized positions are relative to the mesh bounds
+        MeshConstants meshConstants;
+        meshConstants.baseVertex = baseVertex;
+        meshConstants.materialIdx = materialIdx;
+        meshConstants.octahedralDirections = mesh.attrib[Model::attrib_normal].components == 2;
+        if (mesh.attrib[Model::attrib_position].format == Model::attrib_format_float)
+        {
+            meshConstants.positionOffset = XMFLOAT3(0.0f, 0.0f, 0.0f);
+            meshConstants.positionScale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+        }
+        else
+        {
+            XMStoreFloat3(&meshConstants.positionOffset, mesh.boundingBox.min);
+            XMStoreFloat3(&meshConstants.positionScale, mesh.boundingBox.max - mesh.boundingBox.min);
+        }
+        gfxContext.SetConstantArray(4, sizeof(meshConstants) / 4, &meshConstants);
 
         gfxContext.DrawIndexed(indexCount, startIndex, baseVertex);
     }
@@ -358,9 +449,9 @@ void ModelViewer::RenderLightShadows(GraphicsContext& gfxContext)
     m_LightShadowTempBuffer.BeginRendering(gfxContext);
     {
         gfxContext.SetPipelineState(m_ShadowPSO);
-        RenderObjects(gfxContext, m_LightShadowMatrix[LightIndex], kOpaque);
+        RenderObjects(gfxContext, m_LightShadowMatrix[LightIndex], m_AllMeshRanges, kOpaque);
         gfxContext.SetPipelineState(m_CutoutShadowPSO);
-        RenderObjects(gfxContext, m_LightShadowMatrix[LightIndex], kCutout);
+        RenderObjects(gfxContext, m_LightShadowMatrix[LightIndex], m_AllMeshRanges, kCutout);
     }
     m_LightShadowTempBuffer.EndRendering(gfxContext);
 
@@ -392,6 +483,8 @@ void ModelViewer::RenderScene( void )
         s_ShowLightCounts = ShowWaveTileCounts;
     }
 
+    CullObjects();
+
     GraphicsContext& gfxContext = GraphicsContext::Begin(L"Scene Render");
 
     ParticleEffects::Update(gfxContext.GetComputeContext(), Graphics::GetFrameTime());
@@ -453,13 +546,13 @@ void ModelViewer::RenderScene( void )
 #endif
             gfxContext.SetDepthStencilTarget(g_SceneDepthBuffer.GetDSV());
             gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
-            RenderObjects(gfxContext, m_ViewProjMatrix, kOpaque );
+            RenderObjects(gfxContext, m_ViewProjMatrix, m_VisibleRanges, kOpaque );
         }
 
         {
             ScopedTimer _prof(L"Cutout", gfxContext);
             gfxContext.SetPipelineState(m_CutoutDepthPSO);
-            RenderObjects(gfxContext, m_ViewProjMatrix, kCutout );
+            RenderObjects(gfxContext, m_ViewProjMatrix, m_VisibleRanges, kCutout );
         }
     }
 
@@ -484,9 +577,9 @@ void ModelViewer::RenderScene( void )
 
             g_ShadowBuffer.BeginRendering(gfxContext);
             gfxContext.SetPipelineState(m_ShadowPSO);
-            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), kOpaque);
+            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), m_AllMeshRanges, kOpaque);
             gfxContext.SetPipelineState(m_CutoutShadowPSO);
-            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), kCutout);
+            RenderObjects(gfxContext, m_SunShadow.GetViewProjMatrix(), m_AllMeshRanges, kCutout);
             g_ShadowBuffer.EndRendering(gfxContext);
         }
 
@@ -515,12 +608,12 @@ void ModelViewer::RenderScene( void )
             gfxContext.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV_DepthReadOnly());
             gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
 
-            RenderObjects( gfxContext, m_ViewProjMatrix, kOpaque );
+            RenderObjects( gfxContext, m_ViewProjMatrix, m_VisibleRanges, kOpaque );
 
             if (!ShowWaveTileCounts)
             {
                 gfxContext.SetPipelineState(m_CutoutModelPSO);
-                RenderObjects( gfxContext, m_ViewProjMatrix, kCutout );
+                RenderObjects( gfxContext, m_ViewProjMatrix, m_VisibleRanges, kCutout );
             }
         }
 
@@ -13,6 +13,7 @@
 //
 
 #include "ModelViewerRS.hlsli"
+#include "ModelViewerVertex.hlsli"
 
 cbuffer VSConstants : register(b0)
 {
@@ -38,7 +39,7 @@ struct VSOutput
 VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
-    vsOutput.pos = mul(modelToProjection, float4(vsInput.position, 1.0));
+    vsOutput.pos = mul(modelToProjection, float4(DecodePosition(vsInput.position), 1.0));
     vsOutput.uv = vsInput.texcoord0;
     return vsOutput;
 }
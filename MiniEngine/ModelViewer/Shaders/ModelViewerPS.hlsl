@@ -342,6 +342,19 @@ float3 main(VSOutput vsOutput) : SV_Target0
     float3 normal;
     {
         normal = texNormal.Sample(sampler0, vsOutput.uv) * 2.0 - 1.0;
+
+        // Two channel (BC5) normal maps read z as -1, rebuild it from x and y.  That comes out unit
+        // length, losing the shortening from filtering that AntiAliasSpecular reads as bumpiness,
+        // so estimate the spread of normals under the pixel from their screen-space derivatives
+        // instead.  The mean of unit vectors with variance v is about 1 - v / 2 long.  Derivatives
+        // are taken outside the branch so they stay defined.
+        float3 rebuilt = float3(normal.xy, sqrt(saturate(1.0 - dot(normal.xy, normal.xy))));
+        float3 dndx = ddx(rebuilt);
+        float3 dndy = ddy(rebuilt);
+        float variance = 0.5 * (dot(dndx, dndx) + dot(dndy, dndy));
+        if (normal.z <= -1.0)
+            normal = rebuilt * max(1.0 - 0.5 * variance, 0.25);
+
         AntiAliasSpecular(normal, gloss);
         float3x3 tbn = float3x3(normalize(vsOutput.tangent), normalize(vsOutput.bitangent), normalize(vsOutput.normal));
         normal = normalize(mul(normal, tbn));
@@ -13,6 +13,7 @@
 //
 
 #include "ModelViewerRS.hlsli"
+#include "ModelViewerVertex.hlsli"
 
 cbuffer VSConstants : register(b0)
 {
@@ -47,15 +48,17 @@ VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
 
-    vsOutput.position = mul(modelToProjection, float4(vsInput.position, 1.0));
-    vsOutput.worldPos = vsInput.position;
+    float3 position = DecodePosition(vsInput.position);
+
+    vsOutput.position = mul(modelToProjection, float4(position, 1.0));
+    vsOutput.worldPos = position;
     vsOutput.texCoord = vsInput.texcoord0;
-    vsOutput.viewDir = vsInput.position - ViewerPos;
-    vsOutput.shadowCoord = mul(modelToShadow, float4(vsInput.position, 1.0)).xyz;
+    vsOutput.viewDir = position - ViewerPos;
+    vsOutput.shadowCoord = mul(modelToShadow, float4(position, 1.0)).xyz;
 
-    vsOutput.normal = vsInput.normal;
-    vsOutput.tangent = vsInput.tangent;
-    vsOutput.bitangent = vsInput.bitangent;
+    vsOutput.normal = DecodeDirection(vsInput.normal);
+    vsOutput.tangent = DecodeDirection(vsInput.tangent);
+    vsOutput.bitangent = DecodeDirection(vsInput.bitangent);
 
     return vsOutput;
 }
@@ -0,0 +1,42 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Decodes vertices written by the model converter's -quantize option.  The input layout
+// is built from the model's attributes, so normalized positions arrive in [0, 1] relative
+// to the mesh bounds and tangent frames as two octahedral components.  Float models set
+// the offset to 0 and the scale to 1 and leave OctahedralDirections off.
+
+// Each float3 is followed by a uint so that nothing crosses a 16-byte boundary and the
+// cbuffer packs the same as the tightly packed C++ struct
+cbuffer MeshConstants : register(b1)
+{
+    float3 PositionOffset;      // mesh bounding box min
+    uint BaseVertex;
+    float3 PositionScale;       // mesh bounding box extent
+    uint MaterialIndex;
+    uint OctahedralDirections;
+};
+
+float3 DecodePosition( float3 position )
+{
+    return PositionOffset + position * PositionScale;
+}
+
+float3 DecodeDirection( float3 direction )
+{
+    if (OctahedralDirections == 0)
+        return direction;
+
+    float2 e = direction.xy;
+    float3 v = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * (v.xy >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
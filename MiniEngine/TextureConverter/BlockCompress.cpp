@@ -0,0 +1,784 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BlockCompress.h"
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <emmintrin.h>
+
+using namespace BlockCompress;
+
+namespace
+{
+    // The block as floats, once per texel for the endpoint fits and once with each channel
+    // spread over four registers so the error of all sixteen texels against a palette entry
+    // takes four subtract, multiply and add steps per channel.
+    struct Block
+    {
+        float texel[16][4];
+        __m128 channel[4][4];
+    };
+
+    void LoadBlock(const uint8_t *texels, Block &block)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (int group = 0; group < 4; group++)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(texels + group * 16));
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            __m128 t0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+            __m128 t1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+            __m128 t2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+            __m128 t3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+
+            _mm_storeu_ps(block.texel[group * 4 + 0], t0);
+            _mm_storeu_ps(block.texel[group * 4 + 1], t1);
+            _mm_storeu_ps(block.texel[group * 4 + 2], t2);
+            _mm_storeu_ps(block.texel[group * 4 + 3], t3);
+
+            _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+            block.channel[0][group] = t0;
+            block.channel[1][group] = t1;
+            block.channel[2][group] = t2;
+            block.channel[3][group] = t3;
+        }
+    }
+
+    const float kRGBWeights[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    const float kRGBAWeights[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    const float kChannelWeights[4][4] = { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } };
+
+    // Picks the nearest palette entry for every texel and returns the summed squared error
+    float FindClosest(const Block &block, const float (*palette)[4], int paletteSize, const float *weights, uint8_t *indices)
+    {
+        __m128 totalError = _mm_setzero_ps();
+
+        for (int group = 0; group < 4; group++)
+        {
+            __m128 bestError = _mm_set1_ps(FLT_MAX);
+            __m128i bestIndex = _mm_setzero_si128();
+
+            for (int entry = 0; entry < paletteSize; entry++)
+            {
+                __m128 error = _mm_setzero_ps();
+                for (int c = 0; c < 4; c++)
+                {
+                    if (weights[c] == 0.0f)
+                        continue;
+                    __m128 d = _mm_sub_ps(block.channel[c][group], _mm_set1_ps(palette[entry][c]));
+                    error = _mm_add_ps(error, _mm_mul_ps(_mm_mul_ps(d, d), _mm_set1_ps(weights[c])));
+                }
+
+                // ties keep the lower index
+                __m128i better = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+                bestError = _mm_min_ps(error, bestError);
+                bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(entry)), _mm_andnot_si128(better, bestIndex));
+            }
+
+            totalError = _mm_add_ps(totalError, bestError);
+
+            int32_t groupIndices[4];
+            _mm_storeu_si128((__m128i*)groupIndices, bestIndex);
+            for (int n = 0; n < 4; n++)
+                indices[group * 4 + n] = (uint8_t)groupIndices[n];
+        }
+
+        float errors[4];
+        _mm_storeu_ps(errors, totalError);
+        return errors[0] + errors[1] + errors[2] + errors[3];
+    }
+
+    // Fits a line through the texels along their principal axis, the endpoints are the
+    // extremes of the texels projected onto it
+    void FitEndpoints(const Block &block, int channelCount, float *endpoint0, float *endpoint1)
+    {
+        float mean[4] = {};
+        for (int n = 0; n < 16; n++)
+        {
+            for (int c = 0; c < channelCount; c++)
+                mean[c] += block.texel[n][c];
+        }
+        for (int c = 0; c < channelCount; c++)
+            mean[c] /= 16.0f;
+
+        float covariance[4][4] = {};
+        for (int n = 0; n < 16; n++)
+        {
+            float d[4];
+            for (int c = 0; c < channelCount; c++)
+                d[c] = block.texel[n][c] - mean[c];
+            for (int i = 0; i < channelCount; i++)
+            {
+                for (int j = 0; j < channelCount; j++)
+                    covariance[i][j] += d[i] * d[j];
+            }
+        }
+
+        // power iteration, starting from the row of the channel with the most variance
+        int start = 0;
+        for (int c = 1; c < channelCount; c++)
+        {
+            if (covariance[c][c] > covariance[start][start])
+                start = c;
+        }
+
+        float axis[4] = {};
+        for (int c = 0; c < channelCount; c++)
+            axis[c] = covariance[start][c];
+
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = {};
+            float largest = 0.0f;
+            for (int i = 0; i < channelCount; i++)
+            {
+                for (int j = 0; j < channelCount; j++)
+                    next[i] += covariance[i][j] * axis[j];
+                largest = fmaxf(largest, fabsf(next[i]));
+            }
+            if (largest == 0.0f)
+                break;
+            for (int c = 0; c < channelCount; c++)
+                axis[c] = next[c] / largest;
+        }
+
+        float lengthSq = 0.0f;
+        for (int c = 0; c < channelCount; c++)
+            lengthSq += axis[c] * axis[c];
+
+        // a single color, both endpoints sit on the mean
+        if (lengthSq == 0.0f)
+        {
+            for (int c = 0; c < channelCount; c++)
+                endpoint0[c] = endpoint1[c] = mean[c];
+            return;
+        }
+
+        float minT = FLT_MAX;
+        float maxT = -FLT_MAX;
+        for (int n = 0; n < 16; n++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channelCount; c++)
+                t += (block.texel[n][c] - mean[c]) * axis[c];
+            minT = fminf(minT, t);
+            maxT = fmaxf(maxT, t);
+        }
+
+        for (int c = 0; c < channelCount; c++)
+        {
+            endpoint0[c] = fminf(fmaxf(mean[c] + axis[c] * minT / lengthSq, 0.0f), 255.0f);
+            endpoint1[c] = fminf(fmaxf(mean[c] + axis[c] * maxT / lengthSq, 0.0f), 255.0f);
+        }
+    }
+
+    // Solves for the endpoints that minimize the squared error of the texels given their
+    // indices, where indexWeights[i] is how far along from endpoint 0 to 1 palette entry i lies
+    bool RefitEndpoints(const Block &block, const uint8_t *indices, const float *indexWeights,
+        int firstChannel, int channelCount, float *endpoint0, float *endpoint1)
+    {
+        float a = 0.0f, b = 0.0f, c = 0.0f;
+        float x0[4] = {};
+        float x1[4] = {};
+        for (int n = 0; n < 16; n++)
+        {
+            float t = indexWeights[indices[n]];
+            float s = 1.0f - t;
+            a += s * s;
+            b += s * t;
+            c += t * t;
+            for (int ch = firstChannel; ch < firstChannel + channelCount; ch++)
+            {
+                x0[ch] += s * block.texel[n][ch];
+                x1[ch] += t * block.texel[n][ch];
+            }
+        }
+
+        // all texels on one endpoint, the line isn't determined
+        float determinant = a * c - b * b;
+        if (fabsf(determinant) < 1e-6f)
+            return false;
+
+        for (int ch = firstChannel; ch < firstChannel + channelCount; ch++)
+        {
+            endpoint0[ch] = fminf(fmaxf((c * x0[ch] - b * x1[ch]) / determinant, 0.0f), 255.0f);
+            endpoint1[ch] = fminf(fmaxf((a * x1[ch] - b * x0[ch]) / determinant, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    // Writes fields least significant bit first, as the BC7 layout is specified
+    class BitWriter
+    {
+    public:
+        BitWriter(uint8_t *data) : m_Data(data), m_Position(0)
+        {
+            memset(data, 0, 16);
+        }
+
+        void Write(uint32_t value, uint32_t bitCount)
+        {
+            for (uint32_t n = 0; n < bitCount; n++, m_Position++)
+                m_Data[m_Position >> 3] |= (uint8_t)(((value >> n) & 1) << (m_Position & 7));
+        }
+
+    private:
+        uint8_t *m_Data;
+        uint32_t m_Position;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t *data) : m_Data(data), m_Position(0) {}
+
+        uint32_t Read(uint32_t bitCount)
+        {
+            uint32_t value = 0;
+            for (uint32_t n = 0; n < bitCount; n++, m_Position++)
+                value |= (uint32_t)((m_Data[m_Position >> 3] >> (m_Position & 7)) & 1) << n;
+            return value;
+        }
+
+    private:
+        const uint8_t *m_Data;
+        uint32_t m_Position;
+    };
+
+    //
+    // BC1
+    //
+
+    // index 2 is a third of the way from color 0 to color 1, index 3 two thirds
+    const float kBC1IndexWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    uint16_t QuantizeRGB565(const float *color)
+    {
+        int r = (int)(color[0] * (31.0f / 255.0f) + 0.5f);
+        int g = (int)(color[1] * (63.0f / 255.0f) + 0.5f);
+        int b = (int)(color[2] * (31.0f / 255.0f) + 0.5f);
+        return (uint16_t)(r << 11 | g << 5 | b);
+    }
+
+    void ExpandRGB565(uint16_t color, int *rgb)
+    {
+        int r = color >> 11;
+        int g = (color >> 5) & 0x3F;
+        int b = color & 0x1F;
+        rgb[0] = r << 3 | r >> 2;
+        rgb[1] = g << 2 | g >> 4;
+        rgb[2] = b << 3 | b >> 2;
+    }
+
+    // The four color palette, rounded the same way DecodeBC1() rounds it
+    void BuildBC1Palette(uint16_t color0, uint16_t color1, int (*palette)[3])
+    {
+        ExpandRGB565(color0, palette[0]);
+        ExpandRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+        }
+    }
+
+    float EvaluateBC1(const Block &block, uint16_t color0, uint16_t color1, uint8_t *indices)
+    {
+        int colors[4][3];
+        BuildBC1Palette(color0, color1, colors);
+
+        float palette[4][4] = {};
+        for (int n = 0; n < 4; n++)
+        {
+            for (int c = 0; c < 3; c++)
+                palette[n][c] = (float)colors[n][c];
+        }
+        return FindClosest(block, palette, 4, kRGBWeights, indices);
+    }
+
+    void EncodeBC1Color(const Block &block, uint8_t *output)
+    {
+        float endpoint0[4], endpoint1[4];
+        FitEndpoints(block, 3, endpoint0, endpoint1);
+
+        uint16_t color0 = QuantizeRGB565(endpoint0);
+        uint16_t color1 = QuantizeRGB565(endpoint1);
+        uint8_t indices[16];
+        float error = EvaluateBC1(block, color0, color1, indices);
+
+        // refit the endpoints to the chosen indices for as long as that helps
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            if (!RefitEndpoints(block, indices, kBC1IndexWeights, 0, 3, endpoint0, endpoint1))
+                break;
+
+            uint16_t newColor0 = QuantizeRGB565(endpoint0);
+            uint16_t newColor1 = QuantizeRGB565(endpoint1);
+            if (newColor0 == color0 && newColor1 == color1)
+                break;
+
+            uint8_t newIndices[16];
+            float newError = EvaluateBC1(block, newColor0, newColor1, newIndices);
+            if (newError >= error)
+                break;
+
+            color0 = newColor0;
+            color1 = newColor1;
+            error = newError;
+            memcpy(indices, newIndices, sizeof(indices));
+        }
+
+        // color 0 greater than color 1 selects the four color mode, which swapping the
+        // endpoints and the matching pairs of indices keeps intact
+        if (color0 < color1)
+        {
+            uint16_t swap = color0;
+            color0 = color1;
+            color1 = swap;
+            for (int n = 0; n < 16; n++)
+                indices[n] ^= 1;
+        }
+        else if (color0 == color1)
+        {
+            memset(indices, 0, sizeof(indices));
+        }
+
+        uint32_t packedIndices = 0;
+        for (int n = 0; n < 16; n++)
+            packedIndices |= (uint32_t)indices[n] << (n * 2);
+
+        memcpy(output, &color0, 2);
+        memcpy(output + 2, &color1, 2);
+        memcpy(output + 4, &packedIndices, 4);
+    }
+
+    void DecodeBC1Color(const uint8_t *input, uint8_t *texels, bool alwaysFourColor)
+    {
+        uint16_t color0, color1;
+        uint32_t packedIndices;
+        memcpy(&color0, input, 2);
+        memcpy(&color1, input + 2, 2);
+        memcpy(&packedIndices, input + 4, 4);
+
+        int palette[4][4];
+        ExpandRGB565(color0, palette[0]);
+        ExpandRGB565(color1, palette[1]);
+        palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+        if (color0 > color1 || alwaysFourColor)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+                palette[3][c] = 0;
+            }
+            palette[3][3] = 0;
+        }
+
+        for (int n = 0; n < 16; n++)
+        {
+            const int *color = palette[(packedIndices >> (n * 2)) & 3];
+            for (int c = 0; c < 4; c++)
+                texels[n * 4 + c] = (uint8_t)color[c];
+        }
+    }
+
+    //
+    // BC4, used for BC3 alpha and both BC5 channels
+    //
+
+    // indices 2 through 7 step from value 0 towards value 1 in sevenths
+    const float kBC4IndexWeights[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+
+    // The eight value palette, only valid when value 0 is greater than value 1
+    void BuildBC4Palette(int value0, int value1, int *palette)
+    {
+        palette[0] = value0;
+        palette[1] = value1;
+        for (int n = 2; n < 8; n++)
+            palette[n] = ((8 - n) * value0 + (n - 1) * value1 + 3) / 7;
+    }
+
+    float EvaluateBC4(const Block &block, int channel, int value0, int value1, uint8_t *indices)
+    {
+        int values[8];
+        BuildBC4Palette(value0, value1, values);
+
+        float palette[8][4] = {};
+        for (int n = 0; n < 8; n++)
+            palette[n][channel] = (float)values[n];
+        return FindClosest(block, palette, 8, kChannelWeights[channel], indices);
+    }
+
+    void EncodeBC4Channel(const Block &block, int channel, uint8_t *output)
+    {
+        float minValue = 255.0f;
+        float maxValue = 0.0f;
+        for (int n = 0; n < 16; n++)
+        {
+            minValue = fminf(minValue, block.texel[n][channel]);
+            maxValue = fmaxf(maxValue, block.texel[n][channel]);
+        }
+
+        int value0 = (int)maxValue;
+        int value1 = (int)minValue;
+
+        memset(output, 0, 8);
+        output[0] = (uint8_t)value0;
+        output[1] = (uint8_t)value1;
+
+        // equal values select the six value mode, but index 0 still decodes to value 0
+        if (value0 == value1)
+            return;
+
+        uint8_t indices[16];
+        float error = EvaluateBC4(block, channel, value0, value1, indices);
+
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            float endpoint0[4], endpoint1[4];
+            if (!RefitEndpoints(block, indices, kBC4IndexWeights, channel, 1, endpoint0, endpoint1))
+                break;
+
+            int newValue0 = (int)(endpoint0[channel] + 0.5f);
+            int newValue1 = (int)(endpoint1[channel] + 0.5f);
+            if (newValue0 <= newValue1 || (newValue0 == value0 && newValue1 == value1))
+                break;
+
+            uint8_t newIndices[16];
+            float newError = EvaluateBC4(block, channel, newValue0, newValue1, newIndices);
+            if (newError >= error)
+                break;
+
+            value0 = newValue0;
+            value1 = newValue1;
+            error = newError;
+            memcpy(indices, newIndices, sizeof(indices));
+        }
+
+        output[0] = (uint8_t)value0;
+        output[1] = (uint8_t)value1;
+
+        uint64_t packedIndices = 0;
+        for (int n = 0; n < 16; n++)
+            packedIndices |= (uint64_t)indices[n] << (n * 3);
+        for (int n = 0; n < 6; n++)
+            output[2 + n] = (uint8_t)(packedIndices >> (n * 8));
+    }
+
+    void DecodeBC4Channel(const uint8_t *input, int channel, uint8_t *texels)
+    {
+        int value0 = input[0];
+        int value1 = input[1];
+
+        int palette[8];
+        if (value0 > value1)
+        {
+            BuildBC4Palette(value0, value1, palette);
+        }
+        else
+        {
+            palette[0] = value0;
+            palette[1] = value1;
+            for (int n = 2; n < 6; n++)
+                palette[n] = ((6 - n) * value0 + (n - 1) * value1 + 2) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t packedIndices = 0;
+        for (int n = 0; n < 6; n++)
+            packedIndices |= (uint64_t)input[2 + n] << (n * 8);
+
+        for (int n = 0; n < 16; n++)
+            texels[n * 4 + channel] = (uint8_t)palette[(packedIndices >> (n * 3)) & 7];
+    }
+
+    //
+    // BC7 mode 6
+    //
+
+    const int kBC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    const float kBC7IndexWeights[16] = { 0.0f, 4.0f / 64, 9.0f / 64, 13.0f / 64, 17.0f / 64, 21.0f / 64, 26.0f / 64,
+        30.0f / 64, 34.0f / 64, 38.0f / 64, 43.0f / 64, 47.0f / 64, 51.0f / 64, 55.0f / 64, 60.0f / 64, 1.0f };
+
+    // Two RGBA endpoints of seven bits per channel, each extended by its own p-bit
+    struct BC7Endpoints
+    {
+        int value[2][4];
+        int pBit[2];
+    };
+
+    int ExpandBC7(const BC7Endpoints &endpoints, int endpoint, int channel)
+    {
+        return endpoints.value[endpoint][channel] << 1 | endpoints.pBit[endpoint];
+    }
+
+    void QuantizeBC7Endpoint(const float *color, int pBit, BC7Endpoints &endpoints, int endpoint)
+    {
+        endpoints.pBit[endpoint] = pBit;
+        for (int c = 0; c < 4; c++)
+        {
+            int value = (int)((color[c] - pBit) * 0.5f + 0.5f);
+            endpoints.value[endpoint][c] = value < 0 ? 0 : value > 127 ? 127 : value;
+        }
+    }
+
+    // The p-bit that rounds the color with the least error
+    int ChooseBC7PBit(const float *color)
+    {
+        float errors[2] = {};
+        BC7Endpoints endpoints;
+        for (int pBit = 0; pBit < 2; pBit++)
+        {
+            QuantizeBC7Endpoint(color, pBit, endpoints, 0);
+            for (int c = 0; c < 4; c++)
+            {
+                float d = (float)ExpandBC7(endpoints, 0, c) - color[c];
+                errors[pBit] += d * d;
+            }
+        }
+        return errors[1] < errors[0] ? 1 : 0;
+    }
+
+    float EvaluateBC7(const Block &block, const BC7Endpoints &endpoints, uint8_t *indices)
+    {
+        float palette[16][4];
+        for (int c = 0; c < 4; c++)
+        {
+            int value0 = ExpandBC7(endpoints, 0, c);
+            int value1 = ExpandBC7(endpoints, 1, c);
+            for (int n = 0; n < 16; n++)
+                palette[n][c] = (float)(((64 - kBC7Weights[n]) * value0 + kBC7Weights[n] * value1 + 32) >> 6);
+        }
+        return FindClosest(block, palette, 16, kRGBAWeights, indices);
+    }
+
+    struct BC7Candidate
+    {
+        BC7Endpoints endpoints;
+        uint8_t indices[16];
+        float error;
+    };
+
+    // Quantizes the endpoints, with either the best rounding p-bits or every combination
+    void TryBC7Endpoints(const Block &block, const float *endpoint0, const float *endpoint1, bool searchPBits, BC7Candidate &best)
+    {
+        for (int combination = 0; combination < 4; combination++)
+        {
+            BC7Candidate candidate;
+            if (searchPBits)
+            {
+                QuantizeBC7Endpoint(endpoint0, combination & 1, candidate.endpoints, 0);
+                QuantizeBC7Endpoint(endpoint1, combination >> 1, candidate.endpoints, 1);
+            }
+            else
+            {
+                QuantizeBC7Endpoint(endpoint0, ChooseBC7PBit(endpoint0), candidate.endpoints, 0);
+                QuantizeBC7Endpoint(endpoint1, ChooseBC7PBit(endpoint1), candidate.endpoints, 1);
+            }
+
+            candidate.error = EvaluateBC7(block, candidate.endpoints, candidate.indices);
+            if (candidate.error < best.error)
+                best = candidate;
+
+            if (!searchPBits)
+                break;
+        }
+    }
+
+    void EncodeBC7Mode6(const Block &block, uint8_t *output, BC7Quality quality)
+    {
+        const bool searchPBits = quality >= bc7_quality_normal;
+        const int refitIterations = quality == bc7_quality_fast ? 1 : quality == bc7_quality_normal ? 3 : 8;
+
+        float endpoint0[4], endpoint1[4];
+        FitEndpoints(block, 4, endpoint0, endpoint1);
+
+        BC7Candidate best;
+        best.error = FLT_MAX;
+        TryBC7Endpoints(block, endpoint0, endpoint1, searchPBits, best);
+
+        for (int iteration = 0; iteration < refitIterations && best.error > 0.0f; iteration++)
+        {
+            if (!RefitEndpoints(block, best.indices, kBC7IndexWeights, 0, 4, endpoint0, endpoint1))
+                break;
+
+            float previousError = best.error;
+            TryBC7Endpoints(block, endpoint0, endpoint1, searchPBits, best);
+            if (best.error >= previousError)
+                break;
+        }
+
+        // nudge each quantized endpoint channel by one step while that lowers the error
+        if (quality == bc7_quality_slow)
+        {
+            for (int pass = 0; pass < 4 && best.error > 0.0f; pass++)
+            {
+                bool improved = false;
+                for (int endpoint = 0; endpoint < 2; endpoint++)
+                {
+                    for (int c = 0; c < 4; c++)
+                    {
+                        for (int step = -1; step <= 1; step += 2)
+                        {
+                            BC7Candidate candidate = best;
+                            int value = candidate.endpoints.value[endpoint][c] + step;
+                            if (value < 0 || value > 127)
+                                continue;
+
+                            candidate.endpoints.value[endpoint][c] = value;
+                            candidate.error = EvaluateBC7(block, candidate.endpoints, candidate.indices);
+                            if (candidate.error < best.error)
+                            {
+                                best = candidate;
+                                improved = true;
+                            }
+                        }
+                    }
+                }
+                if (!improved)
+                    break;
+            }
+        }
+
+        // the first index is stored without its top bit, so it must be below 8
+        BC7Endpoints &endpoints = best.endpoints;
+        if (best.indices[0] >= 8)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                int swap = endpoints.value[0][c];
+                endpoints.value[0][c] = endpoints.value[1][c];
+                endpoints.value[1][c] = swap;
+            }
+            int swap = endpoints.pBit[0];
+            endpoints.pBit[0] = endpoints.pBit[1];
+            endpoints.pBit[1] = swap;
+
+            for (int n = 0; n < 16; n++)
+                best.indices[n] = (uint8_t)(15 - best.indices[n]);
+        }
+
+        BitWriter writer(output);
+        writer.Write(1 << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            writer.Write(endpoints.value[0][c], 7);
+            writer.Write(endpoints.value[1][c], 7);
+        }
+        writer.Write(endpoints.pBit[0], 1);
+        writer.Write(endpoints.pBit[1], 1);
+        writer.Write(best.indices[0], 3);
+        for (int n = 1; n < 16; n++)
+            writer.Write(best.indices[n], 4);
+    }
+}
+
+void BlockCompress::EncodeBC1(const uint8_t *texels, uint8_t *block)
+{
+    Block source;
+    LoadBlock(texels, source);
+    EncodeBC1Color(source, block);
+}
+
+void BlockCompress::EncodeBC3(const uint8_t *texels, uint8_t *block)
+{
+    Block source;
+    LoadBlock(texels, source);
+    EncodeBC4Channel(source, 3, block);
+    EncodeBC1Color(source, block + 8);
+}
+
+void BlockCompress::EncodeBC5(const uint8_t *texels, uint8_t *block)
+{
+    Block source;
+    LoadBlock(texels, source);
+    EncodeBC4Channel(source, 0, block);
+    EncodeBC4Channel(source, 1, block + 8);
+}
+
+void BlockCompress::EncodeBC7(const uint8_t *texels, uint8_t *block, BC7Quality quality)
+{
+    Block source;
+    LoadBlock(texels, source);
+    EncodeBC7Mode6(source, block, quality);
+}
+
+void BlockCompress::DecodeBC1(const uint8_t *block, uint8_t *texels)
+{
+    DecodeBC1Color(block, texels, false);
+}
+
+void BlockCompress::DecodeBC3(const uint8_t *block, uint8_t *texels)
+{
+    DecodeBC1Color(block + 8, texels, true);
+    DecodeBC4Channel(block, 3, texels);
+}
+
+void BlockCompress::DecodeBC5(const uint8_t *block, uint8_t *texels)
+{
+    for (int n = 0; n < 16; n++)
+    {
+        texels[n * 4 + 2] = 0;
+        texels[n * 4 + 3] = 255;
+    }
+    DecodeBC4Channel(block, 0, texels);
+    DecodeBC4Channel(block + 8, 1, texels);
+}
+
+void BlockCompress::DecodeBC7(const uint8_t *block, uint8_t *texels)
+{
+    BitReader reader(block);
+    if (reader.Read(7) != 1 << 6)
+    {
+        for (int n = 0; n < 16; n++)
+        {
+            texels[n * 4 + 0] = 255;
+            texels[n * 4 + 1] = 0;
+            texels[n * 4 + 2] = 255;
+            texels[n * 4 + 3] = 255;
+        }
+        return;
+    }
+
+    BC7Endpoints endpoints;
+    for (int c = 0; c < 4; c++)
+    {
+        endpoints.value[0][c] = (int)reader.Read(7);
+        endpoints.value[1][c] = (int)reader.Read(7);
+    }
+    endpoints.pBit[0] = (int)reader.Read(1);
+    endpoints.pBit[1] = (int)reader.Read(1);
+
+    for (int n = 0; n < 16; n++)
+    {
+        int weight = kBC7Weights[reader.Read(n == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+        {
+            int value0 = ExpandBC7(endpoints, 0, c);
+            int value1 = ExpandBC7(endpoints, 1, c);
+            texels[n * 4 + c] = (uint8_t)(((64 - weight) * value0 + weight * value1 + 32) >> 6);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// Block encoders and decoders for the BC formats the cooker emits. Every function works on
+// one 4x4 block of RGBA8 texels given in row order, 64 bytes.
+namespace BlockCompress
+{
+    // BC7 encoding effort, higher is slower and closer to the source
+    enum BC7Quality
+    {
+        bc7_quality_fast = 0,
+        bc7_quality_normal = 1,
+        bc7_quality_slow = 2,
+    };
+
+    // Byte size of one encoded block
+    const uint32_t bc1BlockSize = 8;
+    const uint32_t bc3BlockSize = 16;
+    const uint32_t bc5BlockSize = 16;
+    const uint32_t bc7BlockSize = 16;
+
+    // RGB only, alpha is ignored. Always uses the four color mode.
+    void EncodeBC1(const uint8_t *texels, uint8_t *block);
+
+    // BC1 color plus BC4 alpha
+    void EncodeBC3(const uint8_t *texels, uint8_t *block);
+
+    // BC4 on the red and green channels, for two channel normal maps
+    void EncodeBC5(const uint8_t *texels, uint8_t *block);
+
+    // Single subset mode 6 with 7.7.7.7 endpoints and shared p-bits
+    void EncodeBC7(const uint8_t *texels, uint8_t *block, BC7Quality quality);
+
+    // Decoders, used to measure the error of the encoders
+    void DecodeBC1(const uint8_t *block, uint8_t *texels);
+    void DecodeBC3(const uint8_t *block, uint8_t *texels);
+    void DecodeBC5(const uint8_t *block, uint8_t *texels);
+
+    // Only mode 6 is supported, other modes decode to magenta
+    void DecodeBC7(const uint8_t *block, uint8_t *texels);
+}
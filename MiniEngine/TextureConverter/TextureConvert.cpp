@@ -0,0 +1,406 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "BlockCompress.h"
+#include "TextureImage.h"
+#include "dds.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ppl.h>
+
+using namespace BlockCompress;
+using namespace DirectX;
+
+namespace
+{
+    struct CookOptions
+    {
+        CookOptions() : useBC7(false), bc7Quality(bc7_quality_normal), generateMips(true), linear(false), normalMap(false) {}
+
+        bool useBC7;                // BC7 instead of BC1 and BC3 for color textures
+        BC7Quality bc7Quality;
+        bool generateMips;
+        bool linear;                // color textures hold data rather than sRGB color
+        bool normalMap;             // treat every input as a normal map, not only *_normal
+    };
+
+    struct CookStats
+    {
+        DXGI_FORMAT format;
+        uint32_t mipCount;
+        uint64_t texelCount;        // in all levels
+        uint64_t uncompressedBytes; // the same levels as RGBA8
+        uint64_t compressedBytes;
+        double psnr;                // of the top level, over the channels the texture uses
+        double mipSeconds;
+        double encodeSeconds;
+    };
+
+    const char *FormatName(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_BC1_UNORM: return "BC1";
+        case DXGI_FORMAT_BC1_UNORM_SRGB: return "BC1 sRGB";
+        case DXGI_FORMAT_BC3_UNORM: return "BC3";
+        case DXGI_FORMAT_BC3_UNORM_SRGB: return "BC3 sRGB";
+        case DXGI_FORMAT_BC5_UNORM: return "BC5";
+        case DXGI_FORMAT_BC7_UNORM: return "BC7";
+        case DXGI_FORMAT_BC7_UNORM_SRGB: return "BC7 sRGB";
+        default: return "unknown";
+        }
+    }
+
+    double ElapsedSeconds(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    bool IsNormalMap(const std::string &filename)
+    {
+        size_t extension = filename.find_last_of('.');
+        std::string baseName = filename.substr(0, extension);
+        const char suffix[] = "_normal";
+        return baseName.size() >= sizeof(suffix) - 1 && 0 == baseName.compare(baseName.size() - (sizeof(suffix) - 1), std::string::npos, suffix);
+    }
+
+    bool HasTransparency(const Surface &surface)
+    {
+        for (size_t n = 3; n < surface.texels.size(); n += 4)
+        {
+            if (surface.texels[n] != 255)
+                return true;
+        }
+        return false;
+    }
+
+    void EncodeBlock(DXGI_FORMAT format, BC7Quality bc7Quality, const uint8_t *texels, uint8_t *block)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+            EncodeBC1(texels, block);
+            break;
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+            EncodeBC3(texels, block);
+            break;
+        case DXGI_FORMAT_BC5_UNORM:
+            EncodeBC5(texels, block);
+            break;
+        default:
+            EncodeBC7(texels, block, bc7Quality);
+            break;
+        }
+    }
+
+    // Returns the channels the format stores as a mask, red in the lowest bit
+    uint32_t DecodeBlock(DXGI_FORMAT format, const uint8_t *block, uint8_t *texels)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+            DecodeBC1(block, texels);
+            return 0x7;
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+            DecodeBC3(block, texels);
+            return 0xF;
+        case DXGI_FORMAT_BC5_UNORM:
+            DecodeBC5(block, texels);
+            return 0x3;
+        default:
+            DecodeBC7(block, texels);
+            return 0xF;
+        }
+    }
+
+    uint32_t BlockSize(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_BC1_UNORM || format == DXGI_FORMAT_BC1_UNORM_SRGB ? bc1BlockSize : bc3BlockSize;
+    }
+
+    // Blocks are independent, so rows of them are spread over all cores
+    void EncodeLevel(const Surface &surface, DXGI_FORMAT format, BC7Quality bc7Quality, std::vector<uint8_t> &encoded)
+    {
+        const uint32_t blocksWide = (surface.width + 3) / 4;
+        const uint32_t blocksHigh = (surface.height + 3) / 4;
+        const uint32_t blockSize = BlockSize(format);
+        encoded.resize((size_t)blocksWide * blocksHigh * blockSize);
+
+        Concurrency::parallel_for(0u, blocksHigh, [&](uint32_t blockY)
+        {
+            uint8_t texels[64];
+            for (uint32_t blockX = 0; blockX < blocksWide; blockX++)
+            {
+                ExtractBlock(surface, blockX, blockY, texels);
+                EncodeBlock(format, bc7Quality, texels, &encoded[((size_t)blockY * blocksWide + blockX) * blockSize]);
+            }
+        });
+    }
+
+    // Alpha only counts when the source has some, opaque alpha would hide the color error
+    double ComputePSNR(const Surface &surface, DXGI_FORMAT format, const std::vector<uint8_t> &encoded, bool includeAlpha)
+    {
+        const uint32_t blocksWide = (surface.width + 3) / 4;
+        const uint32_t blocksHigh = (surface.height + 3) / 4;
+        const uint32_t blockSize = BlockSize(format);
+
+        double squaredError = 0.0;
+        uint64_t sampleCount = 0;
+
+        for (uint32_t blockY = 0; blockY < blocksHigh; blockY++)
+        {
+            for (uint32_t blockX = 0; blockX < blocksWide; blockX++)
+            {
+                uint8_t texels[64];
+                uint32_t channelMask = DecodeBlock(format, &encoded[((size_t)blockY * blocksWide + blockX) * blockSize], texels);
+                if (!includeAlpha)
+                    channelMask &= 0x7;
+
+                for (uint32_t y = 0; y < 4 && blockY * 4 + y < surface.height; y++)
+                {
+                    for (uint32_t x = 0; x < 4 && blockX * 4 + x < surface.width; x++)
+                    {
+                        const uint8_t *source = &surface.texels[((blockY * 4 + y) * surface.width + blockX * 4 + x) * 4];
+                        const uint8_t *decoded = texels + (y * 4 + x) * 4;
+                        for (int c = 0; c < 4; c++)
+                        {
+                            if (0 == (channelMask & (1 << c)))
+                                continue;
+                            double d = (double)source[c] - decoded[c];
+                            squaredError += d * d;
+                            sampleCount++;
+                        }
+                    }
+                }
+            }
+        }
+
+        double meanSquaredError = squaredError / sampleCount;
+        return meanSquaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+    }
+
+    // Always writes the DX10 header so the exact format, including sRGB, round trips
+    bool SaveDDS(const char *filename, DXGI_FORMAT format, const std::vector<Surface> &mips, const std::vector<std::vector<uint8_t>> &levels)
+    {
+        DDS_HEADER header = {};
+        header.size = sizeof(DDS_HEADER);
+        header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_LINEARSIZE | (levels.size() > 1 ? DDS_HEADER_FLAGS_MIPMAP : 0);
+        header.width = mips[0].width;
+        header.height = mips[0].height;
+        header.pitchOrLinearSize = (uint32_t)levels[0].size();
+        header.mipMapCount = (uint32_t)levels.size();
+        header.ddspf = DDSPF_DX10;
+        header.caps = DDS_SURFACE_FLAGS_TEXTURE | (levels.size() > 1 ? DDS_SURFACE_FLAGS_MIPMAP : 0);
+
+        DDS_HEADER_DXT10 extension = {};
+        extension.dxgiFormat = format;
+        extension.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        extension.arraySize = 1;
+
+        FILE *file = nullptr;
+        if (0 != fopen_s(&file, filename, "wb"))
+            return false;
+
+        bool ok = 1 == fwrite(&DDS_MAGIC, sizeof(DDS_MAGIC), 1, file) &&
+            1 == fwrite(&header, sizeof(header), 1, file) &&
+            1 == fwrite(&extension, sizeof(extension), 1, file);
+
+        for (size_t level = 0; ok && level < levels.size(); level++)
+            ok = 1 == fwrite(levels[level].data(), levels[level].size(), 1, file);
+
+        if (EOF == fclose(file))
+            ok = false;
+
+        return ok;
+    }
+
+    bool CookTexture(const std::string &inputFile, const std::string &outputFile, const CookOptions &options, CookStats &stats)
+    {
+        Surface source;
+        if (!LoadTGA(inputFile.c_str(), source))
+        {
+            printf("failed to load texture: %s\n", inputFile.c_str());
+            return false;
+        }
+
+        // D3D12 needs the top level of a block compressed texture to be whole blocks
+        if (source.width % 4 != 0 || source.height % 4 != 0)
+        {
+            printf("%s is %ux%u, block compression needs multiples of 4\n", inputFile.c_str(), source.width, source.height);
+            return false;
+        }
+
+        const bool hasTransparency = HasTransparency(source);
+
+        TextureKind kind = texture_kind_color;
+        if (options.normalMap || IsNormalMap(inputFile))
+        {
+            kind = texture_kind_normal;
+            stats.format = DXGI_FORMAT_BC5_UNORM;
+        }
+        else
+        {
+            if (options.linear)
+                kind = texture_kind_linear;
+
+            if (options.useBC7)
+                stats.format = options.linear ? DXGI_FORMAT_BC7_UNORM : DXGI_FORMAT_BC7_UNORM_SRGB;
+            else if (hasTransparency)
+                stats.format = options.linear ? DXGI_FORMAT_BC3_UNORM : DXGI_FORMAT_BC3_UNORM_SRGB;
+            else
+                stats.format = options.linear ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC1_UNORM_SRGB;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<Surface> mips;
+        GenerateMipChain(source, kind, options.generateMips, mips);
+        stats.mipSeconds = ElapsedSeconds(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        std::vector<std::vector<uint8_t>> levels(mips.size());
+        for (size_t level = 0; level < mips.size(); level++)
+            EncodeLevel(mips[level], stats.format, options.bc7Quality, levels[level]);
+        stats.encodeSeconds = ElapsedSeconds(start);
+
+        stats.mipCount = (uint32_t)mips.size();
+        stats.texelCount = 0;
+        stats.compressedBytes = 0;
+        for (size_t level = 0; level < mips.size(); level++)
+        {
+            stats.texelCount += (uint64_t)mips[level].width * mips[level].height;
+            stats.compressedBytes += levels[level].size();
+        }
+        stats.uncompressedBytes = stats.texelCount * 4;
+        stats.psnr = ComputePSNR(mips[0], stats.format, levels[0], hasTransparency);
+
+        if (!SaveDDS(outputFile.c_str(), stats.format, mips, levels))
+        {
+            printf("failed to save texture: %s\n", outputFile.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
+
+void PrintHelp()
+{
+    printf("texture_convert\n");
+
+    printf("usage:\n");
+    printf("texture_convert [options] input_file [input_file ...]\n");
+    printf("each input TGA is written next to itself as a DDS with the same name, which\n");
+    printf("TextureManager loads in place of the TGA\n");
+    printf("options:\n");
+    printf("  -bc7 quality     encode color textures as BC7 at quality 0 (fast) to 2 (slow) instead of BC1/BC3\n");
+    printf("  -linear          color textures hold linear data, not sRGB\n");
+    printf("  -normal          treat every input as a normal map, by default only *_normal files are\n");
+    printf("  -nomips          only encode the top level\n");
+    printf("color textures become BC1, or BC3 when they have alpha, and normal maps become BC5\n");
+}
+
+int main(int argc, char **argv)
+{
+    CookOptions options;
+
+    int argIndex = 1;
+    for (; argIndex < argc && argv[argIndex][0] == '-'; argIndex++)
+    {
+        if (0 == strcmp(argv[argIndex], "-bc7") && argIndex + 1 < argc)
+        {
+            int quality = atoi(argv[++argIndex]);
+            if (quality < bc7_quality_fast || quality > bc7_quality_slow)
+            {
+                PrintHelp();
+                return -1;
+            }
+            options.useBC7 = true;
+            options.bc7Quality = (BC7Quality)quality;
+        }
+        else if (0 == strcmp(argv[argIndex], "-linear"))
+        {
+            options.linear = true;
+        }
+        else if (0 == strcmp(argv[argIndex], "-normal"))
+        {
+            options.normalMap = true;
+        }
+        else if (0 == strcmp(argv[argIndex], "-nomips"))
+        {
+            options.generateMips = false;
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    if (argIndex == argc)
+    {
+        PrintHelp();
+        return -1;
+    }
+
+    int failures = 0;
+    uint64_t totalTexels = 0;
+    uint64_t totalUncompressedBytes = 0;
+    uint64_t totalCompressedBytes = 0;
+    double totalEncodeSeconds = 0.0;
+
+    for (; argIndex < argc; argIndex++)
+    {
+        std::string inputFile = argv[argIndex];
+        std::string outputFile = inputFile.substr(0, inputFile.find_last_of('.')) + ".dds";
+
+        CookStats stats;
+        if (!CookTexture(inputFile, outputFile, options, stats))
+        {
+            failures++;
+            continue;
+        }
+
+        printf("%s -> %s\n", inputFile.c_str(), outputFile.c_str());
+        printf("  %s, %u mips, %.1f KB -> %.1f KB (%.1fx smaller)\n", FormatName(stats.format), stats.mipCount,
+            stats.uncompressedBytes / 1024.0, stats.compressedBytes / 1024.0, (double)stats.uncompressedBytes / stats.compressedBytes);
+        printf("  psnr %.2f dB, mips %.1f ms, encode %.1f ms (%.1f Mtexels/s)\n", stats.psnr, stats.mipSeconds * 1000.0,
+            stats.encodeSeconds * 1000.0, stats.texelCount / stats.encodeSeconds / 1e6);
+
+        totalTexels += stats.texelCount;
+        totalUncompressedBytes += stats.uncompressedBytes;
+        totalCompressedBytes += stats.compressedBytes;
+        totalEncodeSeconds += stats.encodeSeconds;
+    }
+
+    if (totalCompressedBytes > 0)
+    {
+        printf("total: %.1f MB -> %.1f MB (%.1fx smaller), %.1f Mtexels/s\n", totalUncompressedBytes / 1048576.0,
+            totalCompressedBytes / 1048576.0, (double)totalUncompressedBytes / totalCompressedBytes, totalTexels / totalEncodeSeconds / 1e6);
+    }
+
+    if (failures > 0)
+    {
+        printf("%d textures failed\n", failures);
+        return -1;
+    }
+
+    return 0;
+}
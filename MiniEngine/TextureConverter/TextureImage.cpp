@@ -0,0 +1,232 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "TextureImage.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+    float SRGBToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float LinearToSRGB(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    uint8_t ToByte(float value)
+    {
+        return (uint8_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    // A level at full precision. Color is linear and normals are in [-1, 1].
+    struct FloatSurface
+    {
+        uint32_t width;
+        uint32_t height;
+        std::vector<float> texels;
+    };
+
+    void ToFloat(const Surface &source, TextureKind kind, FloatSurface &result)
+    {
+        float srgbTable[256];
+        for (int n = 0; n < 256; n++)
+            srgbTable[n] = SRGBToLinear(n / 255.0f);
+
+        result.width = source.width;
+        result.height = source.height;
+        result.texels.resize(source.texels.size());
+
+        for (size_t n = 0; n < source.texels.size(); n++)
+        {
+            uint8_t value = source.texels[n];
+            bool isAlpha = (n & 3) == 3;
+            if (kind == texture_kind_color && !isAlpha)
+                result.texels[n] = srgbTable[value];
+            else if (kind == texture_kind_normal && !isAlpha)
+                result.texels[n] = value / 255.0f * 2.0f - 1.0f;
+            else
+                result.texels[n] = value / 255.0f;
+        }
+    }
+
+    void ToBytes(const FloatSurface &source, TextureKind kind, Surface &result)
+    {
+        result.width = source.width;
+        result.height = source.height;
+        result.texels.resize(source.texels.size());
+
+        for (size_t n = 0; n < source.texels.size(); n++)
+        {
+            float value = source.texels[n];
+            bool isAlpha = (n & 3) == 3;
+            if (kind == texture_kind_color && !isAlpha)
+                result.texels[n] = ToByte(LinearToSRGB(value));
+            else if (kind == texture_kind_normal && !isAlpha)
+                result.texels[n] = ToByte(value * 0.5f + 0.5f);
+            else
+                result.texels[n] = ToByte(value);
+        }
+    }
+
+    // 2x2 box filter. Odd sizes repeat their last row or column. Color is weighted by alpha
+    // so fully transparent texels don't bleed into their neighbors.
+    void Downsample(const FloatSurface &source, TextureKind kind, FloatSurface &result)
+    {
+        result.width = std::max(source.width / 2, 1u);
+        result.height = std::max(source.height / 2, 1u);
+        result.texels.resize(result.width * result.height * 4);
+
+        for (uint32_t y = 0; y < result.height; y++)
+        {
+            uint32_t y0 = std::min(y * 2, source.height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+
+            for (uint32_t x = 0; x < result.width; x++)
+            {
+                uint32_t x0 = std::min(x * 2, source.width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+
+                const float *texels[4] =
+                {
+                    &source.texels[(y0 * source.width + x0) * 4],
+                    &source.texels[(y0 * source.width + x1) * 4],
+                    &source.texels[(y1 * source.width + x0) * 4],
+                    &source.texels[(y1 * source.width + x1) * 4],
+                };
+
+                float *output = &result.texels[(y * result.width + x) * 4];
+
+                float alphaSum = 0.0f;
+                for (int n = 0; n < 4; n++)
+                    alphaSum += texels[n][3];
+                output[3] = alphaSum * 0.25f;
+
+                bool weightByAlpha = kind != texture_kind_normal && alphaSum > 0.0f;
+                for (int c = 0; c < 3; c++)
+                {
+                    float sum = 0.0f;
+                    for (int n = 0; n < 4; n++)
+                        sum += texels[n][c] * (weightByAlpha ? texels[n][3] : 1.0f);
+                    output[c] = weightByAlpha ? sum / alphaSum : sum * 0.25f;
+                }
+
+                if (kind == texture_kind_normal)
+                {
+                    float length = sqrtf(output[0] * output[0] + output[1] * output[1] + output[2] * output[2]);
+                    if (length > 0.0f)
+                    {
+                        for (int c = 0; c < 3; c++)
+                            output[c] /= length;
+                    }
+                    else
+                    {
+                        output[0] = output[1] = 0.0f;
+                        output[2] = 1.0f;
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool LoadTGA(const char *filename, Surface &surface)
+{
+    FILE *file = nullptr;
+    if (0 != fopen_s(&file, filename, "rb"))
+        return false;
+
+    uint8_t header[18];
+    bool ok = 1 == fread(header, sizeof(header), 1, file);
+
+    uint8_t idLength = header[0];
+    uint8_t imageType = header[2];
+    uint16_t width = (uint16_t)(header[12] | header[13] << 8);
+    uint16_t height = (uint16_t)(header[14] | header[15] << 8);
+    uint8_t bitCount = header[16];
+    uint32_t channelCount = bitCount / 8;
+
+    // only uncompressed true color, like the runtime loader
+    if (ok && (imageType != 2 || (channelCount != 3 && channelCount != 4) || width == 0 || height == 0))
+    {
+        printf("unsupported TGA, only uncompressed 24 and 32-bit images are read: %s\n", filename);
+        ok = false;
+    }
+
+    std::vector<uint8_t> fileTexels;
+    if (ok)
+    {
+        fileTexels.resize((size_t)width * height * channelCount);
+        ok = 0 == fseek(file, idLength, SEEK_CUR) && 1 == fread(fileTexels.data(), fileTexels.size(), 1, file);
+    }
+
+    fclose(file);
+    if (!ok)
+        return false;
+
+    surface.width = width;
+    surface.height = height;
+    surface.texels.resize((size_t)width * height * 4);
+
+    // BGR(A) to RGBA
+    for (size_t n = 0; n < (size_t)width * height; n++)
+    {
+        const uint8_t *input = &fileTexels[n * channelCount];
+        uint8_t *output = &surface.texels[n * 4];
+        output[0] = input[2];
+        output[1] = input[1];
+        output[2] = input[0];
+        output[3] = channelCount == 4 ? input[3] : 255;
+    }
+
+    return true;
+}
+
+void GenerateMipChain(const Surface &source, TextureKind kind, bool generateMips, std::vector<Surface> &mips)
+{
+    mips.clear();
+    mips.push_back(source);
+    if (!generateMips)
+        return;
+
+    FloatSurface level;
+    ToFloat(source, kind, level);
+
+    while (level.width > 1 || level.height > 1)
+    {
+        FloatSurface next;
+        Downsample(level, kind, next);
+
+        mips.emplace_back();
+        ToBytes(next, kind, mips.back());
+
+        level = std::move(next);
+    }
+}
+
+void ExtractBlock(const Surface &surface, uint32_t blockX, uint32_t blockY, uint8_t *texels)
+{
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        uint32_t sourceY = std::min(blockY * 4 + y, surface.height - 1);
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            uint32_t sourceX = std::min(blockX * 4 + x, surface.width - 1);
+            memcpy(texels + (y * 4 + x) * 4, &surface.texels[(sourceY * surface.width + sourceX) * 4], 4);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// An RGBA8 image with its texels in row order
+struct Surface
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> texels;
+};
+
+enum TextureKind
+{
+    texture_kind_color,         // sRGB color, filtered in linear space
+    texture_kind_linear,        // any other data, filtered as is
+    texture_kind_normal,        // tangent space normals, renormalized at every level
+};
+
+// Reads an uncompressed 24 or 32-bit TGA. Rows are kept in file order, the same way
+// Texture::CreateTGAFromMemory() uploads them, so cooked textures keep their orientation.
+bool LoadTGA(const char *filename, Surface &surface);
+
+// Builds the full chain down to 1x1, the first level is a copy of the source. Each level is
+// filtered from the full precision level above it, not from the rounded texels.
+void GenerateMipChain(const Surface &source, TextureKind kind, bool generateMips, std::vector<Surface> &mips);
+
+// Copies the 4x4 block at the given block coordinates, repeating the edge texels of levels
+// smaller than a block
+void ExtractBlock(const Surface &surface, uint32_t blockX, uint32_t blockY, uint8_t *texels);
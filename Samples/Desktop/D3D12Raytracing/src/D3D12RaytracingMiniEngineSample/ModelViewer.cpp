@@ -851,6 +851,7 @@ void D3D12RaytracingMiniEngineSample::Startup( void )
     bool bModelLoadSuccess = m_Model.Load(ASSET_DIRECTORY "Models/sponza.h3d");
     ASSERT(bModelLoadSuccess, "Failed to load model");
     ASSERT(m_Model.m_Header.meshCount > 0, "Model contains no meshes");
+    ASSERT(m_Model.m_Header.indexSize == sizeof(uint16_t), "The hit shaders only decode 16-bit indices");
 
     // The caller of this function can override which materials are considered cutouts
     m_pMaterialIsCutout.resize(m_Model.m_Header.materialCount);